@@ -3,6 +3,12 @@
 
 
 #include "Application.h"
+#include "FramePacer.h"
+#include "NullRenderer.h"
+#include "SoftwareRenderer.h"
+#if _WIN32
+#include "D3D12Renderer.h"
+#endif
 
     const int DisplaySizeX = 1024;
     const int DisplaySizeY = 1024;
@@ -15,16 +21,48 @@
 
 	const float Velocity = 100.0f;
 
-    Application::Application()
+    Application::Application(int FramesInFlight, RendererBackend Backend, int MaxFrames, const std::string& CapturePath, [[maybe_unused]] bool bBakeIblOnCpu,
+        [[maybe_unused]] bool bPackedVertices)
         :m_window(nullptr)
         ,m_PrevCursorX(0.0)
         ,m_PrevCursorY(0.0)
         ,m_Mode(InputMode::None)
+        ,m_Backend(Backend)
+        ,m_MaxFrames(MaxFrames)
     {
+        if (m_Backend != RendererBackend::D3D12 && m_MaxFrames <= 0)
+        {
+            throw std::invalid_argument("The headless renderers need a frame count");
+        }
+
+        //A single frame in flight is left to FramePacer for the --bench-pacing baseline, the renderers always overlap
+        if (FramesInFlight < 2 || FramesInFlight > int(FramePacer::MaxFramesInFlight))
+        {
+            throw std::invalid_argument("FramesInFlight has to be between 2 and FramePacer::MaxFramesInFlight");
+        }
 
-        if(!glfwInit())
+        if (m_Backend == RendererBackend::Null)
+        {
+            mRenderer = std::make_unique<NullRenderer>(static_cast<uint32_t>(FramesInFlight));
+        }
+        else if (m_Backend == RendererBackend::Software)
+        {
+            mRenderer = std::make_unique<SoftwareRenderer>(CapturePath);
+        }
+        else
         {
-            throw std::runtime_error("Failed to initialize GLFW library");
+#if _WIN32
+            if(!glfwInit())
+            {
+                throw std::runtime_error("Failed to initialize GLFW library");
+            }
+
+            mRenderer = std::make_unique<D3D12Renderer>(static_cast<UINT>(FramesInFlight), bBakeIblOnCpu,
+                bPackedVertices ? VertexFormat::Packed : VertexFormat::Full);
+#else
+            //Only the headless renderers exist without D3D12
+            throw std::runtime_error("The D3D12 renderer needs Windows, run with --null or --software");
+#endif
         }
 
         m_ViewSettings.distance = ViewDistance;
@@ -46,11 +84,20 @@
             glfwDestroyWindow(m_window);
         }
 
-        glfwTerminate();
+        if (m_Backend == RendererBackend::D3D12)
+        {
+            glfwTerminate();
+        }
     }
 
     void Application::run()
     {
+        if (m_Backend != RendererBackend::D3D12)
+        {
+            runHeadless();
+            return;
+        }
+
         glfwWindowHint(GLFW_RESIZABLE, 0);
 
         m_window = mRenderer->initialize(DisplaySizeX, DisplaySizeY, DisplaySamples);
@@ -63,7 +110,7 @@
 
 		mRenderer->Setup(m_ViewSettings, m_SceneSettings);
 
-        while(!glfwWindowShouldClose(m_window))
+        for (int Frame = 0; !glfwWindowShouldClose(m_window) && (m_MaxFrames == 0 || Frame < m_MaxFrames); ++Frame)
         {
 			float CurrentTime = static_cast<float>(glfwGetTime());
 			DeltaTime = CurrentTime - LastTime;
@@ -77,6 +124,23 @@
 		mRenderer->ShutDown();
     }
 
+    void Application::runHeadless()
+    {
+        const float FixedDeltaTime = 1.0f / 60.0f;
+
+        mRenderer->initialize(DisplaySizeX, DisplaySizeY, DisplaySamples);
+        mRenderer->Setup(m_ViewSettings, m_SceneSettings);
+
+        for (int Frame = 0; Frame < m_MaxFrames; ++Frame)
+        {
+            DeltaTime = FixedDeltaTime;
+            mRenderer->Update(DeltaTime);
+            mRenderer->Render(nullptr, DeltaTime);
+        }
+
+        mRenderer->ShutDown();
+    }
+
 	void Application::MousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 	{
 		Application* self = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
@@ -94,6 +158,8 @@
 			    case InputMode::RotatingView:
 				    self->mRenderer->mCamera.Rotate(OrbitSpeed * float(dy), OrbitSpeed * float(dx));
 				    break;
+			    case InputMode::None:
+				    break;
 			}
 
 			self->m_PrevCursorX = xpos;
@@ -101,7 +167,7 @@
 		}
 	}
 
-	void Application::MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+	void Application::MouseButtonCallback(GLFWwindow* window, int button, int action, int)
 	{
 		Application* self = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
 
@@ -137,13 +203,13 @@
 		}
 	}
 
-	void Application::MouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+	void Application::MouseScrollCallback(GLFWwindow* window, double, double yoffset)
 	{
 		Application* self = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
 		self->m_ViewSettings.fov += ZoomSpeed * float(-yoffset);
 	}
 
-	void Application::KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+	void Application::KeyCallback(GLFWwindow* window, int key, int, int action, int)
 	{
 		auto Offset = Velocity * DeltaTime;
 		Application* self = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
@@ -1,8 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
-#include "D3D12Renderer.h"
 #include "Renderer.h"
 
     enum class InputMode
@@ -12,17 +12,33 @@
         RotatingScene,
     };
 
+    enum class RendererBackend
+    {
+        D3D12,
+        Null,   //NullRenderer: no window or GPU, see NullRenderer.h
+        Software,   //SoftwareRenderer: draws the scene on the CPU without a window, see SoftwareRenderer.h
+    };
+
     class Application
     {
     public:
-        Application();
+        //FramesInFlight: frames the CPU may record ahead of the GPU, 2..FramePacer::MaxFramesInFlight
+        //MaxFrames: run stops after that many frames, 0 runs until the window is closed. Required for the headless backends
+        //CapturePath: the software backend writes its last frame there, see SoftwareRenderer
+        //bBakeIblOnCpu: the D3D12 backend bakes its environment maps with IblBaker instead of compute shaders
+        //bPackedVertices: the D3D12 backend uploads the model as 20-byte PackedVertex, see VertexPacking.h
+        explicit Application(int FramesInFlight = 2, RendererBackend Backend = RendererBackend::D3D12, int MaxFrames = 0, const std::string& CapturePath = {},
+            bool bBakeIblOnCpu = false, bool bPackedVertices = false);
         ~Application();
 
-        inline static std::unique_ptr<RendererInterface>  mRenderer = std::make_unique<D3D12Renderer>();
+        inline static std::unique_ptr<RendererInterface>  mRenderer;
 
         void run();
 
     private:
+        //Fixed time step and no input, so every headless run does the same work
+        void runHeadless();
+
         static void MousePositionCallback(GLFWwindow* Window, double Xpos, double Ypos);
         static void MouseButtonCallback(GLFWwindow* Window, int button, int action, int mods);
         static void MouseScrollCallback(GLFWwindow* Window, double XOffset, double YOffset);
@@ -39,5 +55,8 @@
         SceneSettings m_SceneSettings;
 
         InputMode m_Mode;
+
+        RendererBackend m_Backend;
+        int m_MaxFrames;
     };
 
@@ -0,0 +1,222 @@
+#include "AssetLoader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#include "Image.h"
+#include "Mesh.h"
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+AssetLoader::AssetLoader(ThreadPool& Pool)
+    :m_Pool(Pool)
+    ,m_StartTime(Clock::now())
+{}
+
+AssetLoader::AssetLoader()
+    :AssetLoader(ThreadPool::Get())
+{}
+
+AssetLoader::~AssetLoader()
+{
+    // Workers write into m_Assets, never let them outlive it.
+    std::unique_lock<std::mutex> Lock{ m_Mutex };
+    m_Completed.wait(Lock, [this]() { return m_Pending == 0; });
+}
+
+AssetHandle AssetLoader::RequestImage(const std::string& FileName, int Channels)
+{
+    return Start(FileName, AssetKind::Image, [FileName, Channels](Asset& Out)
+    {
+        Out.ImageData = Image::FromFile(FileName, Channels);
+    });
+}
+
+AssetHandle AssetLoader::RequestMesh(const std::string& FileName)
+{
+    return Start(FileName, AssetKind::Mesh, [FileName](Asset& Out)
+    {
+        Out.MeshData = Mesh::FromFile(FileName);
+    });
+}
+
+AssetHandle AssetLoader::RequestTexture(const std::string& FileName, bool bSrgb, int Channels)
+{
+    return Start(FileName, AssetKind::Texture, [this, FileName, bSrgb, Channels](Asset& Out)
+    {
+        //Kaiser keeps LDR detail sharper, its negative lobes would ring around HDR highlights. Only the chain is
+        //kept, its mip 0 is a copy of the image
+        const std::shared_ptr<Image> Decoded = Image::FromFile(FileName, Channels);
+        const MipFilter Filter = Decoded->IsHdr() ? MipFilter::Box : MipFilter::Kaiser;
+        Out.MipData = std::make_shared<MipChain>(Decoded->GenerateMips(m_Pool, Filter, bSrgb));
+    });
+}
+
+AssetHandle AssetLoader::Start(const std::string& FileName, AssetKind Kind, std::function<void(Asset&)> Decode)
+{
+    Asset* Target = nullptr;
+    AssetHandle Handle = 0;
+    {
+        std::lock_guard<std::mutex> Lock{ m_Mutex };
+        Handle = static_cast<AssetHandle>(m_Assets.size());
+        m_Assets.push_back(std::make_unique<Asset>());
+        Target = m_Assets.back().get();
+        Target->FileName = FileName;
+        Target->Kind = Kind;
+        ++m_Pending;
+    }
+
+    auto Task = [this, Target, Decode]()
+    {
+        const auto DecodeStart = Clock::now();
+        std::exception_ptr Error;
+        try
+        {
+            Decode(*Target);
+        }
+        catch (...)
+        {
+            Error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> Lock{ m_Mutex };
+            Target->Error = Error;
+            Target->DecodeMs = ElapsedMs(DecodeStart);
+            Target->bDone = true;
+            --m_Pending;
+
+            // Notify under the lock, the destructor may run as soon as m_Pending hits zero.
+            m_Completed.notify_all();
+        }
+    };
+
+    // A pool without workers runs the task right here
+    m_Pool.Submit(std::move(Task));
+    return Handle;
+}
+
+void AssetLoader::Wait(AssetHandle Handle)
+{
+    const auto WaitStart = Clock::now();
+    std::unique_lock<std::mutex> Lock{ m_Mutex };
+    if (Handle >= m_Assets.size())
+    {
+        throw std::runtime_error("Invalid asset handle");
+    }
+
+    Asset& Target = *m_Assets[Handle];
+    m_Completed.wait(Lock, [&Target]() { return Target.bDone; });
+    m_WaitMs += ElapsedMs(WaitStart);
+}
+
+void AssetLoader::Rethrow(AssetHandle Handle)
+{
+    std::lock_guard<std::mutex> Lock{ m_Mutex };
+    if (m_Assets[Handle]->Error)
+    {
+        std::rethrow_exception(m_Assets[Handle]->Error);
+    }
+}
+
+std::shared_ptr<Image> AssetLoader::GetImage(AssetHandle Handle)
+{
+    Wait(Handle);
+    Rethrow(Handle);
+
+    std::lock_guard<std::mutex> Lock{ m_Mutex };
+    if (m_Assets[Handle]->Kind != AssetKind::Image)
+    {
+        throw std::runtime_error("Asset is not an image: " + m_Assets[Handle]->FileName);
+    }
+    return m_Assets[Handle]->ImageData;
+}
+
+std::shared_ptr<Mesh> AssetLoader::GetMesh(AssetHandle Handle)
+{
+    Wait(Handle);
+    Rethrow(Handle);
+
+    std::lock_guard<std::mutex> Lock{ m_Mutex };
+    if (m_Assets[Handle]->Kind != AssetKind::Mesh)
+    {
+        throw std::runtime_error("Asset is not a mesh: " + m_Assets[Handle]->FileName);
+    }
+    return m_Assets[Handle]->MeshData;
+}
+
+std::shared_ptr<MipChain> AssetLoader::GetTexture(AssetHandle Handle)
+{
+    Wait(Handle);
+    Rethrow(Handle);
+
+    std::lock_guard<std::mutex> Lock{ m_Mutex };
+    if (m_Assets[Handle]->Kind != AssetKind::Texture)
+    {
+        throw std::runtime_error("Asset is not a texture: " + m_Assets[Handle]->FileName);
+    }
+    return m_Assets[Handle]->MipData;
+}
+
+void AssetLoader::ForEachCompleted(const std::vector<AssetHandle>& Handles, const std::function<void(AssetHandle)>& OnDecoded)
+{
+    std::vector<AssetHandle> Remaining = Handles;
+    while (!Remaining.empty())
+    {
+        AssetHandle Next = 0;
+        {
+            const auto WaitStart = Clock::now();
+            std::unique_lock<std::mutex> Lock{ m_Mutex };
+
+            // Take the first finished handle in request order, so ties resolve the same way every run.
+            std::vector<AssetHandle>::iterator Found;
+            m_Completed.wait(Lock, [&]()
+            {
+                Found = std::find_if(Remaining.begin(), Remaining.end(), [this](AssetHandle Handle)
+                {
+                    return m_Assets[Handle]->bDone;
+                });
+                return Found != Remaining.end();
+            });
+
+            Next = *Found;
+            Remaining.erase(Found);
+            m_WaitMs += ElapsedMs(WaitStart);
+        }
+
+        Upload(Next, [&]() { OnDecoded(Next); });
+    }
+}
+
+void AssetLoader::Upload(AssetHandle Handle, const std::function<void()>& Body)
+{
+    const auto UploadStart = Clock::now();
+    Body();
+    const double UploadMs = ElapsedMs(UploadStart);
+
+    std::lock_guard<std::mutex> Lock{ m_Mutex };
+    m_Assets[Handle]->UploadMs += UploadMs;
+}
+
+void AssetLoader::PrintReport() const
+{
+    std::lock_guard<std::mutex> Lock{ m_Mutex };
+    const double WallMs = ElapsedMs(m_StartTime);
+
+    double DecodeMs = 0.0;
+    double UploadMs = 0.0;
+    std::printf("Asset loading : %zu assets on %u workers\n", m_Assets.size(), m_Pool.NumThreads());
+    for (const std::unique_ptr<Asset>& Entry : m_Assets)
+    {
+        std::printf("  %-32s decode %8.2f ms, upload %8.2f ms%s\n",
+            Entry->FileName.c_str(), Entry->DecodeMs, Entry->UploadMs,
+            Entry->bDone ? "" : " (pending)");
+        DecodeMs += Entry->DecodeMs;
+        UploadMs += Entry->UploadMs;
+    }
+
+    // The serial sum is what Setup paid when every decode and upload ran back to back on one thread.
+    std::printf("  Serial sum    : %8.2f ms (decode %.2f + upload %.2f)\n", DecodeMs + UploadMs, DecodeMs, UploadMs);
+    std::printf("  Critical path : %8.2f ms, main thread waited %.2f ms for decodes\n", WallMs, m_WaitMs);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Image;
+class Mesh;
+struct MipChain;
+class ThreadPool;
+
+using AssetHandle = uint32_t;
+
+// Decodes images and meshes on the thread pool while the caller keeps setting up the device.
+// Decoding and RequestTexture's mip generation are all that runs off the calling thread: results are handed
+// back through Get*/ForEachCompleted, so every GPU upload still happens on the thread that owns the command list.
+class AssetLoader
+{
+public:
+    explicit AssetLoader(ThreadPool& Pool);
+    AssetLoader();
+    ~AssetLoader();
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // Named Request* rather than Load*, windows.h defines LoadImage as a macro.
+    AssetHandle RequestImage(const std::string& FileName, int Channels = 4);
+    AssetHandle RequestMesh(const std::string& FileName);
+
+    // Decodes like RequestImage and generates the full mip chain in the same pool job, so the upload on the
+    // calling thread only copies levels. bSrgb filters LDR color in linear space, see Image::GenerateMips.
+    AssetHandle RequestTexture(const std::string& FileName, bool bSrgb, int Channels = 4);
+
+    // Block until the asset is decoded, rethrows the decode's exception.
+    std::shared_ptr<Image> GetImage(AssetHandle Handle);
+    std::shared_ptr<Mesh> GetMesh(AssetHandle Handle);
+    std::shared_ptr<MipChain> GetTexture(AssetHandle Handle);
+
+    // Runs OnDecoded on the calling thread for every handle, in the order their decodes finish,
+    // so the first upload can start while the rest are still decoding.
+    void ForEachCompleted(const std::vector<AssetHandle>& Handles, const std::function<void(AssetHandle)>& OnDecoded);
+
+    // Times an upload done outside ForEachCompleted so it shows up in the report.
+    void Upload(AssetHandle Handle, const std::function<void()>& Body);
+
+    // Per asset decode/upload times, the serial sum of both and the wall time since the first request.
+    void PrintReport() const;
+
+private:
+    enum class AssetKind
+    {
+        Image,
+        Mesh,
+        Texture,
+    };
+
+    struct Asset
+    {
+        std::string FileName;
+        AssetKind Kind;
+        std::shared_ptr<Image> ImageData;
+        std::shared_ptr<Mesh> MeshData;
+        std::shared_ptr<MipChain> MipData;
+        std::exception_ptr Error;
+        bool bDone = false;
+        double DecodeMs = 0.0;
+        double UploadMs = 0.0;
+    };
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    AssetHandle Start(const std::string& FileName, AssetKind Kind, std::function<void(Asset&)> Decode);
+    void Wait(AssetHandle Handle);
+    void Rethrow(AssetHandle Handle);
+
+    ThreadPool& m_Pool;
+
+    // Assets are never removed, the unique_ptr keeps each one in place while workers write to it.
+    std::vector<std::unique_ptr<Asset>> m_Assets;
+    size_t m_Pending = 0;
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Completed;
+
+    Clock::time_point m_StartTime;
+    double m_WaitMs = 0.0;
+};
@@ -76,7 +76,8 @@ private:
     float mNearWindowHeight = 0.0f;
     float mFarWindowHeight = 0.0f;
 
-    float Pitch;
-    float Yaw;
+    //Match mLook until the first Rotate
+    float Pitch = 0.0f;
+    float Yaw = 90.0f;
 };
 
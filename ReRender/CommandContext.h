@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// One command list with an allocator for every frame in flight. A context is recorded by one thread at a time,
+// different contexts may be recorded concurrently.
+class CommandContext
+{
+public:
+    virtual ~CommandContext() = default;
+
+    // Starts recording into the allocator of FrameIndex. The GPU must be done with that frame's previous work.
+    virtual void Begin(uint32_t FrameIndex) = 0;
+
+    // Stops recording, afterwards the context can be submitted.
+    virtual void End() = 0;
+
+    // Named region that shows up in GPU captures.
+    virtual void BeginEvent(const char* Name) = 0;
+    virtual void EndEvent() = 0;
+
+    // Backend-neutral draws. Pipeline, targets and buffers are still bound by the pass through its backend.
+    virtual void Draw(uint32_t VertexCount, uint32_t InstanceCount) = 0;
+    virtual void DrawIndexed(uint32_t IndexCount, uint32_t InstanceCount, uint32_t FirstIndex, int32_t BaseVertex) = 0;
+};
+
+// Creates contexts and submits them. D3D12CommandBackend is the real one, RecordingCommandBackend only logs and
+// validates, so pass scheduling and whole frames of NullRenderer can be checked and timed without a device.
+class CommandBackend
+{
+public:
+    virtual ~CommandBackend() = default;
+
+    virtual std::unique_ptr<CommandContext> CreateContext() = 0;
+
+    // Executes the ended Contexts in the given order as one submission.
+    virtual void Execute(CommandContext* const* Contexts, size_t Count) = 0;
+};
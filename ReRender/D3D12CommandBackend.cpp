@@ -0,0 +1,87 @@
+#include "D3D12CommandBackend.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    //PIX reads event data with this metadata as a plain ANSI string
+    constexpr UINT PixEventAnsiVersion = 1;
+}
+
+D3D12CommandContext::D3D12CommandContext(ID3D12Device* Device, UINT NumFrames)
+{
+    m_Allocators.resize(NumFrames);
+    for (UINT FrameIndex = 0; FrameIndex < NumFrames; ++FrameIndex)
+    {
+        if (FAILED(Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_Allocators[FrameIndex]))))
+        {
+            throw std::runtime_error("Failed to create pass command allocator");
+        }
+    }
+
+    if (FAILED(Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_Allocators[0].Get(), nullptr, IID_PPV_ARGS(&m_CommandList))))
+    {
+        throw std::runtime_error("Failed to create pass command list");
+    }
+    //Lists are created recording, Begin expects a closed one
+    m_CommandList->Close();
+}
+
+void D3D12CommandContext::Begin(uint32_t FrameIndex)
+{
+    ID3D12CommandAllocator* Allocator = m_Allocators[FrameIndex].Get();
+    if (FAILED(Allocator->Reset()) || FAILED(m_CommandList->Reset(Allocator, nullptr)))
+    {
+        throw std::runtime_error("Failed to reset pass command list (the frame's previous work may still be in flight)");
+    }
+}
+
+void D3D12CommandContext::End()
+{
+    if (FAILED(m_CommandList->Close()))
+    {
+        throw std::runtime_error("Failed close command list (validation error or not in recording state)");
+    }
+}
+
+void D3D12CommandContext::BeginEvent(const char* Name)
+{
+    m_CommandList->BeginEvent(PixEventAnsiVersion, Name, static_cast<UINT>(std::strlen(Name) + 1));
+}
+
+void D3D12CommandContext::EndEvent()
+{
+    m_CommandList->EndEvent();
+}
+
+void D3D12CommandContext::Draw(uint32_t VertexCount, uint32_t InstanceCount)
+{
+    m_CommandList->DrawInstanced(VertexCount, InstanceCount, 0, 0);
+}
+
+void D3D12CommandContext::DrawIndexed(uint32_t IndexCount, uint32_t InstanceCount, uint32_t FirstIndex, int32_t BaseVertex)
+{
+    m_CommandList->DrawIndexedInstanced(IndexCount, InstanceCount, FirstIndex, BaseVertex, 0);
+}
+
+D3D12CommandBackend::D3D12CommandBackend(Microsoft::WRL::ComPtr<ID3D12Device> Device, Microsoft::WRL::ComPtr<ID3D12CommandQueue> CommandQueue, UINT NumFrames)
+    :m_Device(Device)
+    ,m_CommandQueue(CommandQueue)
+    ,m_NumFrames(NumFrames)
+{}
+
+std::unique_ptr<CommandContext> D3D12CommandBackend::CreateContext()
+{
+    return std::make_unique<D3D12CommandContext>(m_Device.Get(), m_NumFrames);
+}
+
+void D3D12CommandBackend::Execute(CommandContext* const* Contexts, size_t Count)
+{
+    m_Lists.clear();
+    for (size_t i = 0; i < Count; ++i)
+    {
+        m_Lists.push_back(D3D12CommandContext::Native(*Contexts[i]));
+    }
+    m_CommandQueue->ExecuteCommandLists(static_cast<UINT>(m_Lists.size()), m_Lists.data());
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <vector>
+
+#include "CommandContext.h"
+
+// A direct command list with one allocator per frame in flight.
+class D3D12CommandContext : public CommandContext
+{
+public:
+    D3D12CommandContext(ID3D12Device* Device, UINT NumFrames);
+
+    void Begin(uint32_t FrameIndex) override;
+    void End() override;
+    void BeginEvent(const char* Name) override;
+    void EndEvent() override;
+    void Draw(uint32_t VertexCount, uint32_t InstanceCount) override;
+    void DrawIndexed(uint32_t IndexCount, uint32_t InstanceCount, uint32_t FirstIndex, int32_t BaseVertex) override;
+
+    ID3D12GraphicsCommandList* Get() const { return m_CommandList.Get(); }
+
+    // The list behind a context of D3D12CommandBackend, for pass functions of the D3D12 renderer.
+    static ID3D12GraphicsCommandList* Native(CommandContext& Context) { return static_cast<D3D12CommandContext&>(Context).Get(); }
+
+private:
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> m_Allocators;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
+};
+
+// Submits contexts to the renderer's direct queue with one ExecuteCommandLists call. Signaling the frame
+// fence stays with the caller.
+class D3D12CommandBackend : public CommandBackend
+{
+public:
+    D3D12CommandBackend(Microsoft::WRL::ComPtr<ID3D12Device> Device, Microsoft::WRL::ComPtr<ID3D12CommandQueue> CommandQueue, UINT NumFrames);
+
+    std::unique_ptr<CommandContext> CreateContext() override;
+    void Execute(CommandContext* const* Contexts, size_t Count) override;
+
+private:
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CommandQueue;
+    UINT m_NumFrames;
+    std::vector<ID3D12CommandList*> m_Lists;
+};
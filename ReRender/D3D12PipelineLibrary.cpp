@@ -0,0 +1,69 @@
+#include "D3D12PipelineLibrary.h"
+
+#include <stdexcept>
+#include <utility>
+
+#include "Utils.h"
+
+D3D12PipelineLibrary::D3D12PipelineLibrary(Microsoft::WRL::ComPtr<ID3D12Device> Device, ShaderCache& Shaders, ThreadPool& Pool)
+    :m_Device(Device)
+    ,m_Shaders(Shaders)
+    ,m_Pipelines(std::make_unique<Microsoft::WRL::ComPtr<ID3D12PipelineState>[]>(MaxPipelines))
+    ,m_Queue(Pool, MaxPipelines)
+{}
+
+PipelineHandle D3D12PipelineLibrary::AddGraphics(GraphicsPipelineDesc Desc)
+{
+    std::string Name = Desc.Name;
+    auto Shared = std::make_shared<GraphicsPipelineDesc>(std::move(Desc));
+    return m_Queue.Add(std::move(Name), [this, Shared](PipelineHandle Slot)
+    {
+        GraphicsPipelineDesc& Pipeline = *Shared;
+        const std::vector<uint8_t> VS = m_Shaders.Compile(Pipeline.VS);
+        const std::vector<uint8_t> PS = m_Shaders.Compile(Pipeline.PS);
+
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC PsoDesc = Pipeline.Desc;
+        PsoDesc.pRootSignature = Pipeline.RootSignature.Get();
+        PsoDesc.InputLayout = { Pipeline.InputLayout.data(), static_cast<UINT>(Pipeline.InputLayout.size()) };
+        PsoDesc.VS = { VS.data(), VS.size() };
+        PsoDesc.PS = { PS.data(), PS.size() };
+        if (FAILED(m_Device->CreateGraphicsPipelineState(&PsoDesc, IID_PPV_ARGS(&m_Pipelines[Slot]))))
+        {
+            throw std::runtime_error("Failed to create graphics pipeline state for " + Pipeline.Name);
+        }
+        Re::SetName(m_Pipelines[Slot].Get(), Pipeline.Name);
+    });
+}
+
+PipelineHandle D3D12PipelineLibrary::AddCompute(std::string Name, Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature, ShaderCompileRequest CS)
+{
+    return m_Queue.Add(Name, [this, Name, RootSignature, CS = std::move(CS)](PipelineHandle Slot)
+    {
+        const std::vector<uint8_t> Bytecode = m_Shaders.Compile(CS);
+
+        D3D12_COMPUTE_PIPELINE_STATE_DESC PsoDesc = {};
+        PsoDesc.pRootSignature = RootSignature.Get();
+        PsoDesc.CS = { Bytecode.data(), Bytecode.size() };
+        if (FAILED(m_Device->CreateComputePipelineState(&PsoDesc, IID_PPV_ARGS(&m_Pipelines[Slot]))))
+        {
+            throw std::runtime_error("Failed to create compute pipeline state (" + Name + ")");
+        }
+        Re::SetName(m_Pipelines[Slot].Get(), Name);
+    });
+}
+
+ID3D12PipelineState* D3D12PipelineLibrary::Get(PipelineHandle Handle)
+{
+    m_Queue.Wait(Handle);
+    return m_Pipelines[Handle].Get();
+}
+
+void D3D12PipelineLibrary::WaitAll()
+{
+    m_Queue.WaitAll();
+}
+
+void D3D12PipelineLibrary::PrintStats(const char* Name) const
+{
+    m_Queue.PrintStats(Name);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PipelineBuildQueue.h"
+#include "ShaderCache.h"
+
+class ThreadPool;
+
+// Everything a graphics pipeline needs. The library compiles VS and PS and fills in Desc's shaders, input
+// layout and root signature, the rest of Desc is used as is.
+struct GraphicsPipelineDesc
+{
+    std::string Name;
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature;
+    ShaderCompileRequest VS;
+    ShaderCompileRequest PS;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> InputLayout;
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc = {};
+};
+
+// Builds pipeline state objects on the thread pool: every Add compiles its shaders through the ShaderCache and
+// creates the PSO on a worker right away, Get hands it out by handle and only blocks if it is not built yet.
+// Root signatures are created by the caller up front, they are cheap and shared between pipelines.
+class D3D12PipelineLibrary
+{
+public:
+    static const size_t MaxPipelines = 256;
+
+    D3D12PipelineLibrary(Microsoft::WRL::ComPtr<ID3D12Device> Device, ShaderCache& Shaders, ThreadPool& Pool);
+
+    D3D12PipelineLibrary(const D3D12PipelineLibrary&) = delete;
+    D3D12PipelineLibrary& operator=(const D3D12PipelineLibrary&) = delete;
+
+    PipelineHandle AddGraphics(GraphicsPipelineDesc Desc);
+    PipelineHandle AddCompute(std::string Name, Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature, ShaderCompileRequest CS);
+
+    // Waits for the build, throws std::runtime_error if a shader or the PSO failed. Any thread.
+    ID3D12PipelineState* Get(PipelineHandle Handle);
+
+    void WaitAll();
+    void PrintStats(const char* Name) const;
+
+private:
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+    ShaderCache& m_Shaders;
+
+    // Indexed by handle, each slot is written once by its build before the queue marks it done.
+    std::unique_ptr<Microsoft::WRL::ComPtr<ID3D12PipelineState>[]> m_Pipelines;
+
+    // Last, so it is torn down first and no build outlives the members above.
+    PipelineBuildQueue m_Queue;
+};
@@ -0,0 +1,213 @@
+#include "D3D12RenderGraph.h"
+
+#include <stdexcept>
+#include <utility>
+#include <d3dx12/d3dx12.h>
+
+#include "D3D12CommandBackend.h"
+
+D3D12RenderGraph::D3D12RenderGraph(Microsoft::WRL::ComPtr<ID3D12Device> Device, GpuHeapManager& HeapManager)
+    :m_Device(Device)
+    ,m_HeapManager(HeapManager)
+{}
+
+D3D12RenderGraph::~D3D12RenderGraph()
+{
+    m_Transients.clear();
+    if (m_Region.IsValid())
+    {
+        m_HeapManager.Free(m_Region);
+    }
+}
+
+RenderGraphResource D3D12RenderGraph::CreateTexture(std::string Name, const D3D12_RESOURCE_DESC& Desc, const D3D12_CLEAR_VALUE* ClearValue)
+{
+    const GpuHeapPool Pool = GpuHeapManager::PoolFor(Desc);
+    if (m_bHasTransients && Pool != m_Pool)
+    {
+        throw std::invalid_argument("Transient " + Name + " needs another heap pool than the frame graph's other transients");
+    }
+    m_Pool = Pool;
+    m_bHasTransients = true;
+
+    //Transients are placed with the default alignment, 4 MB for MSAA targets
+    D3D12_RESOURCE_DESC PlacedDesc = Desc;
+    PlacedDesc.Alignment = 0;
+    const D3D12_RESOURCE_ALLOCATION_INFO Info = m_Device->GetResourceAllocationInfo(0, 1, &PlacedDesc);
+
+    ResourceState DiscardState = ResourceState::Common;
+    if (Desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+    {
+        DiscardState = ResourceState::DepthWrite;
+    }
+    else if (Desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+    {
+        DiscardState = ResourceState::RenderTarget;
+    }
+
+    const RenderGraphResource Resource = m_Graph.CreateTransient(std::move(Name), Info.SizeInBytes, Info.Alignment, DiscardState);
+    TextureDesc Texture;
+    Texture.Desc = PlacedDesc;
+    if (ClearValue)
+    {
+        Texture.ClearValue = *ClearValue;
+        Texture.bClearValue = true;
+    }
+    m_Descs.resize(Resource + 1);
+    m_Descs[Resource] = Texture;
+    m_Native.resize(Resource + 1, nullptr);
+    return Resource;
+}
+
+RenderGraphResource D3D12RenderGraph::Import(std::string Name, ID3D12Resource* Resource, ResourceState InitialState, ResourceState FinalState)
+{
+    const RenderGraphResource Imported = m_Graph.Import(std::move(Name), InitialState, FinalState);
+    m_Descs.resize(Imported + 1);
+    m_Native.resize(Imported + 1, nullptr);
+    m_Native[Imported] = Resource;
+    return Imported;
+}
+
+void D3D12RenderGraph::SetImported(RenderGraphResource Resource, ID3D12Resource* Native)
+{
+    if (!m_Graph.IsImported(Resource))
+    {
+        throw std::invalid_argument("Render graph resource " + m_Graph.ResourceName(Resource) + " is not imported");
+    }
+    m_Native[Resource] = Native;
+}
+
+void D3D12RenderGraph::Compile(ParallelPassRecorder& Recorder)
+{
+    if (!m_Transients.empty())
+    {
+        throw std::logic_error("Frame graph compiled twice");
+    }
+
+    //Every pass records a command list of its own and legacy split barriers cannot span lists
+    RenderGraphCompileOptions Options;
+    Options.bSplitBarriers = false;
+    const CompiledRenderGraph& Compiled = m_Graph.Compile(Options);
+
+    if (Compiled.HeapSize > 0)
+    {
+        m_Region = m_HeapManager.AllocateAliasingRegion(m_Pool, { Compiled.HeapSize, Compiled.HeapAlignment });
+        if (!m_Region.IsValid())
+        {
+            throw std::runtime_error("Failed to allocate the frame graph's transient heap");
+        }
+    }
+
+    m_Transients.resize(m_Graph.NumResources());
+    for (RenderGraphResource Resource = 0; Resource < m_Graph.NumResources(); ++Resource)
+    {
+        const TransientPlacement& Placement = Compiled.Placements[Resource];
+        if (Placement.Offset == TransientPlacement::Unplaced)
+        {
+            continue;
+        }
+        const TextureDesc& Texture = m_Descs[Resource];
+        if (FAILED(m_HeapManager.CreateAliasedResource(
+            m_Region,
+            Placement.Offset,
+            Texture.Desc,
+            ToD3D12(Placement.FrameStartState),
+            Texture.bClearValue ? &Texture.ClearValue : nullptr,
+            m_Transients[Resource])))
+        {
+            throw std::runtime_error("Failed to create frame graph transient " + m_Graph.ResourceName(Resource));
+        }
+        m_Native[Resource] = m_Transients[Resource].Get();
+    }
+
+    m_Graph.Register(Recorder, [this](CommandContext& Context, const std::vector<RenderGraphBarrier>& Barriers)
+    {
+        EmitBarriers(D3D12CommandContext::Native(Context), Barriers);
+    });
+}
+
+D3D12_RESOURCE_STATES D3D12RenderGraph::ToD3D12(ResourceState State)
+{
+    static const std::pair<ResourceState, D3D12_RESOURCE_STATES> States[] =
+    {
+        { ResourceState::VertexAndConstantBuffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER },
+        { ResourceState::IndexBuffer, D3D12_RESOURCE_STATE_INDEX_BUFFER },
+        { ResourceState::RenderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET },
+        { ResourceState::UnorderedAccess, D3D12_RESOURCE_STATE_UNORDERED_ACCESS },
+        { ResourceState::DepthWrite, D3D12_RESOURCE_STATE_DEPTH_WRITE },
+        { ResourceState::DepthRead, D3D12_RESOURCE_STATE_DEPTH_READ },
+        { ResourceState::NonPixelShaderResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE },
+        { ResourceState::PixelShaderResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE },
+        { ResourceState::IndirectArgument, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT },
+        { ResourceState::CopyDest, D3D12_RESOURCE_STATE_COPY_DEST },
+        { ResourceState::CopySource, D3D12_RESOURCE_STATE_COPY_SOURCE },
+        { ResourceState::ResolveDest, D3D12_RESOURCE_STATE_RESOLVE_DEST },
+        { ResourceState::ResolveSource, D3D12_RESOURCE_STATE_RESOLVE_SOURCE },
+        { ResourceState::Present, D3D12_RESOURCE_STATE_PRESENT },
+    };
+
+    D3D12_RESOURCE_STATES Result = D3D12_RESOURCE_STATE_COMMON;
+    for (const auto& Entry : States)
+    {
+        if (Contains(State, Entry.first))
+        {
+            Result |= Entry.second;
+        }
+    }
+    return Result;
+}
+
+void D3D12RenderGraph::EmitBarriers(ID3D12GraphicsCommandList* CommandList, const std::vector<RenderGraphBarrier>& Barriers) const
+{
+    //Passes record in parallel, so the batch lives on the recording thread's stack
+    std::vector<D3D12_RESOURCE_BARRIER> Batch;
+    Batch.reserve(Barriers.size());
+    const auto Flush = [CommandList, &Batch]()
+    {
+        if (!Batch.empty())
+        {
+            CommandList->ResourceBarrier(static_cast<UINT>(Batch.size()), Batch.data());
+            Batch.clear();
+        }
+    };
+
+    for (const RenderGraphBarrier& Barrier : Barriers)
+    {
+        ID3D12Resource* Resource = m_Native[Barrier.Resource];
+        switch (Barrier.BarrierType)
+        {
+        case RenderGraphBarrier::Type::Transition:
+        {
+            //Present and Common are both state 0 to D3D12
+            const D3D12_RESOURCE_STATES Before = ToD3D12(Barrier.StateBefore);
+            const D3D12_RESOURCE_STATES After = ToD3D12(Barrier.StateAfter);
+            if (Before != After)
+            {
+                const D3D12_RESOURCE_BARRIER_FLAGS Flags =
+                    Barrier.SplitType == RenderGraphBarrier::Split::Begin ? D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY :
+                    Barrier.SplitType == RenderGraphBarrier::Split::End ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY :
+                    D3D12_RESOURCE_BARRIER_FLAG_NONE;
+                Batch.push_back(CD3DX12_RESOURCE_BARRIER::Transition(Resource, Before, After, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, Flags));
+            }
+            break;
+        }
+        case RenderGraphBarrier::Type::Aliasing:
+            Batch.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(
+                Barrier.Before == InvalidRenderGraphResource ? nullptr : m_Native[Barrier.Before], Resource));
+            break;
+        case RenderGraphBarrier::Type::Uav:
+            Batch.push_back(CD3DX12_RESOURCE_BARRIER::UAV(Resource));
+            break;
+        case RenderGraphBarrier::Type::Discard:
+            Flush();
+            CommandList->DiscardResource(Resource, nullptr);
+            break;
+        }
+    }
+    Flush();
+}
+
+void D3D12RenderGraph::PrintReport(const char* Name) const
+{
+    m_Graph.PrintReport(Name);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <string>
+#include <vector>
+
+#include "GpuHeapManager.h"
+#include "RenderGraph.h"
+
+// Runs a RenderGraph on D3D12. Transient textures are placed at their compiled offsets inside one aliasing
+// region of the GpuHeapManager, the compiled barriers are recorded in batches around each pass and the passes
+// go to a ParallelPassRecorder. One set of transients serves every frame in flight since the single direct
+// queue runs frames in order.
+class D3D12RenderGraph
+{
+public:
+    D3D12RenderGraph(Microsoft::WRL::ComPtr<ID3D12Device> Device, GpuHeapManager& HeapManager);
+    ~D3D12RenderGraph();
+
+    D3D12RenderGraph(const D3D12RenderGraph&) = delete;
+    D3D12RenderGraph& operator=(const D3D12RenderGraph&) = delete;
+
+    RenderGraph& Graph() { return m_Graph; }
+
+    // Render targets and depth buffers are discarded at their first use every frame. Every texture has to go in
+    // the same GpuHeapPool.
+    RenderGraphResource CreateTexture(std::string Name, const D3D12_RESOURCE_DESC& Desc, const D3D12_CLEAR_VALUE* ClearValue);
+
+    RenderGraphResource Import(std::string Name, ID3D12Resource* Resource, ResourceState InitialState, ResourceState FinalState);
+
+    // Swaps the resource behind an import, e.g. for this frame's back buffer. Not while passes record.
+    void SetImported(RenderGraphResource Resource, ID3D12Resource* Native);
+
+    // Compiles the graph, creates the transients and adds the surviving passes to Recorder. Once.
+    void Compile(ParallelPassRecorder& Recorder);
+
+    // A transient exists after Compile.
+    ID3D12Resource* Resource(RenderGraphResource Resource) const { return m_Native[Resource]; }
+
+    static D3D12_RESOURCE_STATES ToD3D12(ResourceState State);
+
+    void PrintReport(const char* Name) const;
+
+private:
+    struct TextureDesc
+    {
+        D3D12_RESOURCE_DESC Desc = {};
+        D3D12_CLEAR_VALUE ClearValue = {};
+        bool bClearValue = false;
+    };
+
+    void EmitBarriers(ID3D12GraphicsCommandList* CommandList, const std::vector<RenderGraphBarrier>& Barriers) const;
+
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+    GpuHeapManager& m_HeapManager;
+    RenderGraph m_Graph;
+
+    // Indexed by resource, descriptions and placed resources are only set for transients.
+    std::vector<TextureDesc> m_Descs;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> m_Transients;
+    std::vector<ID3D12Resource*> m_Native;
+
+    GpuHeapPool m_Pool = GpuHeapPool::RenderTargets;
+    bool m_bHasTransients = false;
+    GpuAllocation m_Region;
+};
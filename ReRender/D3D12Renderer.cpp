@@ -1,7 +1,10 @@
 #include "D3D12Renderer.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <stdexcept>
+#include <utility>
 
 #include "Mesh.h"
 #include "Image.h"
@@ -18,10 +21,17 @@
 #include <glm/include/glm/gtc/matrix_transform.hpp>
 #include <glm/include/glm/gtx/euler_angles.hpp>
 
+#include "AssetLoader.h"
+#include "D3D12UploadQueue.h"
 #include "Debugger.h"
+#include "IblBaker.h"
+#include "IblCache.h"
 #include "RootSignature.h"
+#include "ScenePasses.h"
 #include "Shader.h"
 #include "ShadowMap.h"
+#include "SphericalHarmonics.h"
+#include "ThreadPool.h"
 #include "UploadBuffer.h"
 
 
@@ -29,30 +39,12 @@ using Mat4 = glm::mat4;
 using Vec4 = glm::vec4;
 using Vec3 = glm::vec3;
 
-struct TransformCB
-{
-    Mat4 ViewPorjectionMatrix;
-    Mat4 SkyProjectionMatrix;
-    Mat4 ObjectMVPMatix;
-};
-
-struct ShadingCB
-{
-    struct 
-    {
-        Vec4 Position;
-        Vec4 Direction;
-        Vec4 Radiance;
-    }Light[SceneSettings::NumLights];
-
-    Vec4 EyePosition;
-    float RenderTargetWidth;
-    float RenderTargetHeight;
-    float NearZ;
-    float FarZ;
-    Mat4 ShadowTransform;
-};
-
+D3D12Renderer::D3D12Renderer(UINT FramesInFlight, bool bBakeIblOnCpu, VertexFormat ModelFormat)
+    :m_NumFrames(FramesInFlight)
+    ,m_Pacer(FramesInFlight)
+    ,m_bBakeIblOnCpu(bBakeIblOnCpu)
+    ,m_ModelFormat(ModelFormat)
+{}
 
 GLFWwindow* D3D12Renderer::initialize(int Width, int Height, int MaxSamples)
 {
@@ -118,8 +110,10 @@ GLFWwindow* D3D12Renderer::initialize(int Width, int Height, int MaxSamples)
         SwapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
         SwapChainDesc.SampleDesc.Count = 1;
         SwapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-        SwapChainDesc.BufferCount = NumFrames;
+        //One more back buffer than frames in flight so Present does not block on the display
+        SwapChainDesc.BufferCount = m_NumFrames + 1;
         SwapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+        SwapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
 
         ComPtr<IDXGISwapChain1> SwapChain;
         if (FAILED(DxgiFactory->CreateSwapChainForHwnd
@@ -134,9 +128,17 @@ GLFWwindow* D3D12Renderer::initialize(int Width, int Height, int MaxSamples)
             throw std::runtime_error("Failed to create swap chain");
         }
         SwapChain.As(&m_SwapChain);
+
+        ComPtr<IDXGISwapChain2> SwapChain2;
+        if (SUCCEEDED(SwapChain.As(&SwapChain2)))
+        {
+            SwapChain2->SetMaximumFrameLatency(m_NumFrames);
+            m_FrameLatencyWaitable = SwapChain2->GetFrameLatencyWaitableObject();
+        }
     }
 
-    m_FrameIndex = m_SwapChain->GetCurrentBackBufferIndex();
+    m_FrameIndex = 0;
+    m_BackBufferIndex = m_SwapChain->GetCurrentBackBufferIndex();
     DxgiFactory->MakeWindowAssociation(glfwGetWin32Window(Window),DXGI_MWA_NO_ALT_ENTER);
 
     //ȷMSAA level
@@ -181,10 +183,31 @@ GLFWwindow* D3D12Renderer::initialize(int Width, int Height, int MaxSamples)
                 D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
                 10000,
             D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE });
+
+        //One block at the back of the heap, 2D textures first and cubes right after, bound as a single table.
+        //Resource binding tier 1 only allows 128 SRVs in the tables of one stage, so both ranges share those
+        D3D12_FEATURE_DATA_D3D12_OPTIONS Options = {};
+        m_Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &Options, sizeof(Options));
+        const bool bTier1 = Options.ResourceBindingTier == D3D12_RESOURCE_BINDING_TIER_1;
+        const UINT NumBindlessTextures = bTier1 ? 112 : 4096;
+        const UINT NumBindlessCubes = bTier1 ? 16 : 256;
+        const UINT BindlessFirst = m_DescHeapCBV_SRV_UAV.ReserveBack(NumBindlessTextures + NumBindlessCubes);
+        m_BindlessTextures = std::make_unique<DescriptorAllocator>(m_Device, m_DescHeapCBV_SRV_UAV, BindlessFirst, NumBindlessTextures,
+            D3D12_SRV_DIMENSION_TEXTURE2D);
+        m_BindlessCubes = std::make_unique<DescriptorAllocator>(m_Device, m_DescHeapCBV_SRV_UAV, BindlessFirst + NumBindlessTextures, NumBindlessCubes,
+            D3D12_SRV_DIMENSION_TEXTURECUBE);
+
+        //Never part of a bound table, so no null views needed
+        m_MipmapDescriptors = std::make_unique<DescriptorAllocator>(m_DescHeapCBV_SRV_UAV, 64);
     }
 
+    m_HeapManager = std::make_unique<GpuHeapManager>(m_Device);
+    m_GeometryPool = std::make_unique<GeometryPool>(m_Device, m_HeapManager.get(), 64 * 1024 * 1024, 32 * 1024 * 1024);
+    m_FrameGraph = std::make_unique<D3D12RenderGraph>(m_Device, *m_HeapManager);
+
     //ÿ֡Դ
-    for (UINT FrameIndex = 0; FrameIndex < NumFrames; ++FrameIndex)
+    m_CommandAllocators.resize(m_NumFrames);
+    for (UINT FrameIndex = 0; FrameIndex < m_NumFrames; ++FrameIndex)
     {
         if (FAILED(m_Device->CreateCommandAllocator(
             D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -192,41 +215,49 @@ GLFWwindow* D3D12Renderer::initialize(int Width, int Height, int MaxSamples)
         {
             throw std::runtime_error("Failed to create command allocator");
         }
+    }
 
-        if (FAILED(m_SwapChain->GetBuffer(FrameIndex, IID_PPV_ARGS(&m_BackBuffers[FrameIndex].Buffer))))
+    //Back buffers go by the swap chain's own index
+    m_BackBuffers.resize(m_NumFrames + 1);
+    for (UINT BufferIndex = 0; BufferIndex < m_BackBuffers.size(); ++BufferIndex)
+    {
+        if (FAILED(m_SwapChain->GetBuffer(BufferIndex, IID_PPV_ARGS(&m_BackBuffers[BufferIndex].Buffer))))
         {
             throw std::runtime_error("Failed to retrieve swap chain back buffer");
         }
 
-        m_BackBuffers[FrameIndex].Rtv = m_DescHeapRtv.Alloc();
+        m_BackBuffers[BufferIndex].Rtv = m_DescHeapRtv.Alloc();
         m_Device->CreateRenderTargetView(
-            m_BackBuffers[FrameIndex].Buffer.Get(),
+            m_BackBuffers[BufferIndex].Buffer.Get(),
             nullptr,
-            m_BackBuffers[FrameIndex].Rtv.CpuHandle
+            m_BackBuffers[BufferIndex].Rtv.CpuHandle
         );
+    }
 
-        m_FrameBuffers[FrameIndex] = CreateFrameBuffer(
+    //Transients of the frame graph, the resolve target can share memory with the depth buffer
+    m_FrameBuffer = CreateFrameBuffer(
+        "Scene",
+        Width,
+        Height,
+        Samples,
+        DXGI_FORMAT_R16G16B16A16_FLOAT,
+        DXGI_FORMAT_D24_UNORM_S8_UINT
+    );
+
+    if (Samples > 1)
+    {
+        m_ResolveFrameBuffer = CreateFrameBuffer(
+            "Resolve",
             Width,
             Height,
-            Samples,
+            1,
             DXGI_FORMAT_R16G16B16A16_FLOAT,
-            DXGI_FORMAT_D24_UNORM_S8_UINT
+            (DXGI_FORMAT)0
         );
-
-        if (Samples > 1)
-        {
-            m_ResolveFrameBuffers[FrameIndex] = CreateFrameBuffer(
-                Width,
-                Height,
-                1,
-                DXGI_FORMAT_R16G16B16A16_FLOAT,
-                (DXGI_FORMAT)0
-            );
-        }
-        else
-        {
-            m_ResolveFrameBuffers[FrameIndex] = m_FrameBuffers[FrameIndex];
-        }
+    }
+    else
+    {
+        m_ResolveFrameBuffer = m_FrameBuffer;
     }
 
     //Fence
@@ -247,6 +278,16 @@ GLFWwindow* D3D12Renderer::initialize(int Width, int Height, int MaxSamples)
 void D3D12Renderer::ShutDown()
 {
     WaitForGPU();
+    if (m_Passes)
+    {
+        m_Passes->PrintStats("Frame");
+    }
+    m_Pacer.PrintStats("Frame");
+    Shader::Cache().PrintStats("Shaders");
+    if (m_FrameLatencyWaitable)
+    {
+        CloseHandle(m_FrameLatencyWaitable);
+    }
     CloseHandle(m_FenceCompletionEvent);
 }
 
@@ -255,6 +296,34 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
     m_View = view;
     m_Scene = Scene;
 
+    //Decode every asset on the thread pool while the root signatures and PSOs below are built
+    AssetLoader Loader;
+    const AssetHandle PbrMeshAsset = Loader.RequestMesh("Meshes/cerberus.fbx");
+    const AssetHandle SkyBoxAsset = Loader.RequestMesh("meshes/skybox.obj");
+    //The workers generate the mip chains as well, only the albedo is sRGB
+    const AssetHandle AlbedoAsset = Loader.RequestTexture("textures/cerberus_A.png", true);
+    const AssetHandle NormalAsset = Loader.RequestTexture("textures/cerberus_N.png", false);
+    const AssetHandle MetalnessAsset = Loader.RequestTexture("textures/cerberus_M.png", false);
+    const AssetHandle RoughnessAsset = Loader.RequestTexture("textures/cerberus_R.png", false, 1);
+
+    //A hit of the IBL cache skips decoding the HDR and the whole precompute. The settings are the shaders' sizes
+    //and sample counts, and the key holds the shaders' sources, or IblBaker's version when it bakes on the CPU
+    const std::string EnvironmentFile = "environment1.hdr";
+    const IblBaker::Settings IblSettings;
+    const std::string IblCacheFile = IblCache::CachePath(EnvironmentFile);
+    const IblCacheKey IblKey = {
+        IblCache::HashFiles({ EnvironmentFile }),
+        IblCache::HashSettings(IblSettings),
+        m_bBakeIblOnCpu ? IblBaker::Version : IblCache::HashFiles({
+            "shaders/hlsl/equirect2cube.hlsl",
+            "shaders/hlsl/downsample_array.hlsl",
+            "shaders/hlsl/spmap.hlsl",
+            "shaders/hlsl/spbrdf.hlsl" }) };
+    const bool bCacheIbl = IblKey.SourceHash != 0 && IblKey.ProducerHash != 0;
+    const std::shared_ptr<const IblCacheEntry> CachedIbl = bCacheIbl ? IblCache::Load(IblCacheFile, IblKey) : nullptr;
+    //Only requested on a miss
+    const AssetHandle EnvironmentAsset = CachedIbl ? AssetHandle{ 0 } : Loader.RequestImage(EnvironmentFile);
+
     CD3DX12_STATIC_SAMPLER_DESC DefaultSamplerDesc
     {
     0,
@@ -284,18 +353,14 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
         throw std::runtime_error("Failed to create direct command list");
     }
 
+    //Root signatures are made here, every PSO then compiles and builds on the thread pool next to the asset decodes.
+    //The passes and dispatches below fetch them by handle and only wait for what is not done yet
+    m_Pipelines = std::make_unique<D3D12PipelineLibrary>(m_Device, Shader::Cache(), ThreadPool::Get());
+    m_mipmapGeneration.Pipelines = m_Pipelines.get();
+    Texture::PrewarmMipmapPipelines(m_Device, m_mipmapGeneration, m_RootSignatureVersion);
+
     //TonemapĸǩPSO
     {
-        ComPtr<ID3DBlob> ToneMapVs = Shader::compileShader(
-            "Shaders/hlsl/tonemap.hlsl",
-            "main_vs",
-            "vs_5_0");
-
-        ComPtr<ID3DBlob> ToneMapPs = Shader::compileShader(
-            "Shaders/hlsl/tonemap.hlsl",
-            "main_ps",
-            "ps_5_0");
-
         const CD3DX12_DESCRIPTOR_RANGE1 DescriptorRanges[] =
         {
            { D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -324,10 +389,13 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
 
         m_ToneMapRootSignature = RootSignature::CreateRootSignature(m_Device,m_RootSignatureVersion,SignatureDesc);
 
-        D3D12_GRAPHICS_PIPELINE_STATE_DESC PsoDesc = {};
-        PsoDesc.pRootSignature = m_ToneMapRootSignature.Get();
-        PsoDesc.VS = CD3DX12_SHADER_BYTECODE(ToneMapVs.Get());
-        PsoDesc.PS = CD3DX12_SHADER_BYTECODE(ToneMapPs.Get());
+        GraphicsPipelineDesc Pipeline;
+        Pipeline.Name = "Tonemap";
+        Pipeline.RootSignature = m_ToneMapRootSignature;
+        Pipeline.VS = Shader::Request("Shaders/hlsl/tonemap.hlsl", "main_vs", "vs_5_0");
+        Pipeline.PS = Shader::Request("Shaders/hlsl/tonemap.hlsl", "main_ps", "ps_5_0");
+
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC& PsoDesc = Pipeline.Desc;
         PsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC{ D3D12_DEFAULT };
         PsoDesc.RasterizerState.FrontCounterClockwise = true;
         PsoDesc.BlendState = CD3DX12_BLEND_DESC{ D3D12_DEFAULT };
@@ -337,12 +405,7 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
         PsoDesc.SampleDesc.Count = 1;
         PsoDesc.SampleMask = UINT_MAX;
 
-        if (FAILED(m_Device->CreateGraphicsPipelineState(
-            &PsoDesc, 
-            IID_PPV_ARGS(&m_ToneMapPipelineState))))
-        {
-            throw std::runtime_error("Failed to create tonemap pipeline state");
-        }
+        m_ToneMapPipeline = m_Pipelines->AddGraphics(std::move(Pipeline));
     }
 
     const std::vector<D3D12_INPUT_ELEMENT_DESC> MeshInputLayout =
@@ -396,51 +459,61 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
 
     //PBR modelĸǩPSO
     {
-        ComPtr<ID3DBlob> PbrVs = Shader::compileShader(
-            "Shaders/hlsl/pbr.hlsl",
-            "main_vs",
-            "vs_5_0");
-
-        ComPtr<ID3DBlob> PbrPs = Shader::compileShader(
-            "shaders/hlsl/pbr.hlsl",
-            "main_ps",
-            "ps_5_0"
-        );
-
+        //2D textures in space1 and the cubes after them in space2, disjoint so every slot is seen with the dimension
+        //of its view. Volatile because descriptors are written and freed while the table stays bound, the unused
+        //ones hold null views
         const CD3DX12_DESCRIPTOR_RANGE1 DescriptorRange[] =
         {
             {
-                D3D12_DESCRIPTOR_RANGE_TYPE_CBV,
-                1,
-                0,
+                D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+                m_BindlessTextures->Capacity(),
                 0,
-                D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC
+                1,
+                D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE,
+                0
             },
             {
                 D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
-                7,
-                0,
+                m_BindlessCubes->Capacity(),
                 0,
-                D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC
+                2,
+                D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE,
+                m_BindlessTextures->Capacity()
             }
         };
 
-        CD3DX12_ROOT_PARAMETER1 RootParameter[3];
-        RootParameter[0].InitAsDescriptorTable(
-            1,
-            &DescriptorRange[0],
+        //Constants are root CBVs into the transient constant buffer, no descriptor per frame or draw.
+        //Textures are picked by the indices in root constants, packed positions are decoded with the last ones
+        CD3DX12_ROOT_PARAMETER1 RootParameter[5];
+        RootParameter[0].InitAsConstantBufferView(
+            0,
+            0,
+            D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE,
             D3D12_SHADER_VISIBILITY_VERTEX
         );
-        RootParameter[1].InitAsDescriptorTable(
-            1,
-            &DescriptorRange[0],
+        RootParameter[1].InitAsConstantBufferView(
+            0,
+            0,
+            D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE,
             D3D12_SHADER_VISIBILITY_PIXEL
         );
-        RootParameter[2].InitAsDescriptorTable(
+        RootParameter[2].InitAsConstants(
+            sizeof(PbrMaterialIndices) / sizeof(uint32_t),
             1,
-            &DescriptorRange[1],
+            0,
+            D3D12_SHADER_VISIBILITY_PIXEL
+        );
+        RootParameter[3].InitAsDescriptorTable(
+            2,
+            DescriptorRange,
             D3D12_SHADER_VISIBILITY_PIXEL
         );
+        RootParameter[4].InitAsConstants(
+            sizeof(PackedPositionConstants) / sizeof(uint32_t),
+            2,
+            0,
+            D3D12_SHADER_VISIBILITY_VERTEX
+        );
 
         D3D12_STATIC_SAMPLER_DESC StaticSamplers[2];
         StaticSamplers[0] = DefaultSamplerDesc;
@@ -449,7 +522,7 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
 
         CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC SignatureDesc;
         SignatureDesc.Init_1_1(
-            3,
+            5,
             RootParameter,
             2,
             StaticSamplers,
@@ -458,11 +531,16 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
 
         m_PbrRootSignature = RootSignature::CreateRootSignature(m_Device,m_RootSignatureVersion,SignatureDesc);
 
-        D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-        psoDesc.pRootSignature = m_PbrRootSignature.Get();
-        psoDesc.InputLayout = { MeshInputLayout.data(), (UINT)MeshInputLayout.size() };
-        psoDesc.VS = CD3DX12_SHADER_BYTECODE(PbrVs.Get());
-        psoDesc.PS = CD3DX12_SHADER_BYTECODE(PbrPs.Get());
+        //5.1 for the unbounded resource arrays of the bindless table. Only the variant of m_ModelFormat is built
+        const bool bPacked = m_ModelFormat == VertexFormat::Packed;
+        GraphicsPipelineDesc Pipeline;
+        Pipeline.Name = bPacked ? "PBR model packed" : "PBR model";
+        Pipeline.RootSignature = m_PbrRootSignature;
+        Pipeline.VS = Shader::Request("Shaders/hlsl/pbr.hlsl", bPacked ? "main_vs_packed" : "main_vs", "vs_5_1");
+        Pipeline.PS = Shader::Request("shaders/hlsl/pbr.hlsl", "main_ps", "ps_5_1");
+        Pipeline.InputLayout = bPacked ? MeshBuffer::PackedInputLayout() : MeshInputLayout;
+
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc = Pipeline.Desc;
         psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
         psoDesc.RasterizerState.FrontCounterClockwise = true;
         psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
@@ -471,75 +549,30 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
         psoDesc.NumRenderTargets = 1;
         psoDesc.RTVFormats[0] = DXGI_FORMAT_R16G16B16A16_FLOAT;
         psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
-        psoDesc.SampleDesc.Count = m_FrameBuffers[0].Samples;
+        psoDesc.SampleDesc.Count = m_FrameBuffer.Samples;
         psoDesc.SampleMask = UINT_MAX;
 
-        if (FAILED(m_Device->CreateGraphicsPipelineState(
-            &psoDesc, 
-            IID_PPV_ARGS(&m_PbrPipelineState)))) 
-        {
-            throw std::runtime_error("Failed to create graphics pipeline state for PBR model");
-        }
-    }
-
-    auto Callback = [&]()
-    {
-        ExecuteCommandList();
-        WaitForGPU();
-    };
-
-    //PBRasset
-    {
-        m_PbrModel = MeshBuffer::CreateMeshBuffer(Callback,m_CommandList,m_Device,Mesh::FromFile("Meshes/cerberus.fbx"));
-
-        m_AlbedoTexture = Texture::CreateTexture(
-            Callback,
-            m_Device,
-            m_CommandList,
-            m_mipmapGeneration,
-            m_DescHeapCBV_SRV_UAV,
-            m_RootSignatureVersion,
-            Image::FromFile("textures/cerberus_A.png"),
-            DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
-
-
-        m_NormalTexture = Texture::CreateTexture(
-            Callback,
-            m_Device,
-            m_CommandList,
-            m_mipmapGeneration,
-            m_DescHeapCBV_SRV_UAV,
-            m_RootSignatureVersion,
-            Image::FromFile("textures/cerberus_N.png"),
-            DXGI_FORMAT_R8G8B8A8_UNORM);
-
-        m_MetalnessTexture = Texture::CreateTexture(
-            Callback,
-            m_Device,
-            m_CommandList,
-            m_mipmapGeneration,
-            m_DescHeapCBV_SRV_UAV,
-            m_RootSignatureVersion,
-            Image::FromFile("textures/cerberus_M.png"),
-            DXGI_FORMAT_R8_UNORM);
-
-
-        m_RoughnessTexture = Texture::CreateTexture(
-            Callback,
-            m_Device,
-            m_CommandList,
-            m_mipmapGeneration,
-            m_DescHeapCBV_SRV_UAV,
-            m_RootSignatureVersion,
-            Image::FromFile("textures/cerberus_R.png", 1), 
-            DXGI_FORMAT_R8_UNORM);
-
-
+        m_PbrPipeline = m_Pipelines->AddGraphics(std::move(Pipeline));
     }
 
     //SkyBoxĸǩԼPSO
     {
-        const std::vector<D3D12_INPUT_ELEMENT_DESC> SkyboxInputLayout = {
+        const CD3DX12_DESCRIPTOR_RANGE1 descriptorRanges[] = {
+            {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC},
+        };
+        CD3DX12_ROOT_PARAMETER1 rootParameters[2];
+        rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_VERTEX);
+        rootParameters[1].InitAsDescriptorTable(1, &descriptorRanges[0], D3D12_SHADER_VISIBILITY_PIXEL);
+        CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC signatureDesc = {};
+        signatureDesc.Init_1_1(2, rootParameters, 1, &DefaultSamplerDesc, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+        m_SkyBoxRootSignature = RootSignature::CreateRootSignature(m_Device,m_RootSignatureVersion,signatureDesc);
+
+        GraphicsPipelineDesc Pipeline;
+        Pipeline.Name = "skybox";
+        Pipeline.RootSignature = m_SkyBoxRootSignature;
+        Pipeline.VS = Shader::Request("shaders/hlsl/skybox.hlsl", "main_vs", "vs_5_0");
+        Pipeline.PS = Shader::Request("shaders/hlsl/skybox.hlsl", "main_ps", "ps_5_0");
+        Pipeline.InputLayout = {
             { "POSITION",
                 0,
                 DXGI_FORMAT_R32G32B32_FLOAT,
@@ -549,74 +582,170 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
                 0 },
         };
 
-        ComPtr<ID3DBlob> SkyboxVS = Shader::compileShader(
-            "shaders/hlsl/skybox.hlsl", 
-            "main_vs", 
-            "vs_5_0");
-
-        ComPtr<ID3DBlob> SkyboxPS = Shader::compileShader(
-            "shaders/hlsl/skybox.hlsl", 
-            "main_ps", 
-            "ps_5_0");
-
-        const CD3DX12_DESCRIPTOR_RANGE1 descriptorRanges[] = {
-            {D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC},
-            {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC},
-        };
-        CD3DX12_ROOT_PARAMETER1 rootParameters[2];
-        rootParameters[0].InitAsDescriptorTable(1, &descriptorRanges[0], D3D12_SHADER_VISIBILITY_VERTEX);
-        rootParameters[1].InitAsDescriptorTable(1, &descriptorRanges[1], D3D12_SHADER_VISIBILITY_PIXEL);
-        CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC signatureDesc = {};
-        signatureDesc.Init_1_1(2, rootParameters, 1, &DefaultSamplerDesc, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
-        m_SkyBoxRootSignature = RootSignature::CreateRootSignature(m_Device,m_RootSignatureVersion,signatureDesc);
-
-        D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-        psoDesc.pRootSignature = m_SkyBoxRootSignature.Get();
-        psoDesc.InputLayout = { SkyboxInputLayout.data(), (UINT)SkyboxInputLayout.size() };
-        psoDesc.VS = CD3DX12_SHADER_BYTECODE(SkyboxVS.Get());
-        psoDesc.PS = CD3DX12_SHADER_BYTECODE(SkyboxPS.Get());
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc = Pipeline.Desc;
         psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
         psoDesc.RasterizerState.FrontCounterClockwise = true;
         psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
         psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
         psoDesc.NumRenderTargets = 1;
         psoDesc.RTVFormats[0] = DXGI_FORMAT_R16G16B16A16_FLOAT;
-        psoDesc.SampleDesc.Count = m_FrameBuffers[0].Samples;
+        psoDesc.SampleDesc.Count = m_FrameBuffer.Samples;
         psoDesc.SampleMask = UINT_MAX;
 
-        if (FAILED(m_Device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_SkyBoxPipelineState)))) {
-            throw std::runtime_error("Failed to create graphics pipeline state for skybox");
-        }
+        m_SkyBoxPipeline = m_Pipelines->AddGraphics(std::move(Pipeline));
+    }
+
+    //ͨüǩ, the environment precompute dispatches further down wait for these
+    ComPtr<ID3D12RootSignature> ComputeRootSignature;
+    {
+        const CD3DX12_DESCRIPTOR_RANGE1 descriptorRanges[] = 
+        {
+            {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC},
+            {D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE},
+        };
+        CD3DX12_ROOT_PARAMETER1 rootParameters[3];
+        rootParameters[0].InitAsDescriptorTable(1, &descriptorRanges[0]);
+        rootParameters[1].InitAsDescriptorTable(1, &descriptorRanges[1]);
+        rootParameters[2].InitAsConstants(1, 0);
+        CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC signatureDesc;
+        signatureDesc.Init_1_1(3, rootParameters, 1, &ComputeSamplerDesc);
+        ComputeRootSignature = RootSignature::CreateRootSignature(m_Device,m_RootSignatureVersion,signatureDesc);
     }
+    //Nothing to build when the cache hits or IblBaker does the work
+    const bool bDispatchIbl = !CachedIbl && !m_bBakeIblOnCpu;
+    const PipelineHandle Equirect2CubePipeline = bDispatchIbl ? m_Pipelines->AddCompute("equirect2cube", ComputeRootSignature, Shader::Request("shaders/hlsl/equirect2cube.hlsl", "main", "cs_5_0")) : InvalidPipeline;
+    const PipelineHandle SpmapPipeline = bDispatchIbl ? m_Pipelines->AddCompute("spmap", ComputeRootSignature, Shader::Request("shaders/hlsl/spmap.hlsl", "main", "cs_5_0")) : InvalidPipeline;
+    const PipelineHandle SpBRDFPipeline = bDispatchIbl ? m_Pipelines->AddCompute("spbrdf", ComputeRootSignature, Shader::Request("shaders/hlsl/spbrdf.hlsl", "main", "cs_5_0")) : InvalidPipeline;
 
-    //պ
-    m_SkyBox = MeshBuffer::CreateMeshBuffer(Callback, m_CommandList, m_Device, Mesh::FromFile("meshes/skybox.obj"));
+    //ShadowMap
+    m_ShadowMap = std::make_unique<ShadowMap>(m_Device,m_DescHeapCBV_SRV_UAV,m_DescHeapDsv,1024,1024,1, MeshInputLayout,m_ModelFormat,DefaultSamplerDesc,m_RootSignatureVersion,*m_Pipelines,m_HeapManager.get());
 
-    //زԤȼ㻷
+    //Uploads only record into m_CommandList, the batch submits them together and frees the staging memory on one fence
+    D3D12UploadQueue UploadQueue{ m_CommandQueue, m_CommandList, m_CommandAllocators[m_FrameIndex], m_Fence, m_FenceValue, m_FenceCompletionEvent };
+    UploadBatch Batch{ UploadQueue };
+    if (!m_StagingRing)
     {
-        ComPtr<ID3D12RootSignature> ComputeRootSignature;
+        m_StagingRing = std::make_unique<StagingRing>(m_Device, 64 * 1024 * 1024);
+    }
+    m_StagingRing->Attach(Batch);
+    m_BindlessTextures->Attach(Batch);
+    m_BindlessCubes->Attach(Batch);
+    m_MipmapDescriptors->Attach(Batch);
+    m_GeometryPool->Attach(Batch);
+    m_mipmapGeneration.Descriptors = m_MipmapDescriptors.get();
 
-        ID3D12DescriptorHeap* ComputeDescriptorHeaps[] = {
-            m_DescHeapCBV_SRV_UAV.Heap.Get()
+    //Debug, its quad goes up with the PBR assets
+    m_Debugger = std::make_unique<Debugger>(Batch, m_Device, m_CommandList, MeshInputLayout, DefaultSamplerDesc, m_RootSignatureVersion, *m_Pipelines, 1, m_ShadowMap->ShadowMapTexture, 0.0f, 0.0f, 0.5f, 0.5f, 0.0f);
+
+    //PBRasset
+    {
+        //Materials find their textures by bindless index, so textures and meshes alike go up in whatever order
+        //their decodes finish
+        struct PbrTextureAsset
+        {
+            AssetHandle Handle;
+            DXGI_FORMAT Format;
+            Texture* Target;
+            uint32_t* BindlessIndex;
         };
+        const PbrTextureAsset PbrTextureAssets[] = {
+            { AlbedoAsset, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, &m_AlbedoTexture, &m_PbrMaterial.Albedo },
+            { NormalAsset, DXGI_FORMAT_R8G8B8A8_UNORM, &m_NormalTexture, &m_PbrMaterial.Normal },
+            { MetalnessAsset, DXGI_FORMAT_R8_UNORM, &m_MetalnessTexture, &m_PbrMaterial.Metalness },
+            { RoughnessAsset, DXGI_FORMAT_R8_UNORM, &m_RoughnessTexture, &m_PbrMaterial.Roughness },
+        };
+
+        Loader.ForEachCompleted({ AlbedoAsset, NormalAsset, MetalnessAsset, RoughnessAsset, PbrMeshAsset, SkyBoxAsset }, [&](AssetHandle Handle)
+        {
+            const auto TextureAsset = std::find_if(std::begin(PbrTextureAssets), std::end(PbrTextureAssets),
+                [Handle](const PbrTextureAsset& Asset) { return Asset.Handle == Handle; });
+            if (TextureAsset != std::end(PbrTextureAssets))
+            {
+                *TextureAsset->Target = Texture::CreateTexture(
+                    Batch,
+                    m_Device,
+                    m_CommandList,
+                    m_DescHeapCBV_SRV_UAV,
+                    *Loader.GetTexture(Handle),
+                    TextureAsset->Format,
+                    m_HeapManager.get());
+                Texture::CreateBindlessSRV(m_Device, *m_BindlessTextures, *TextureAsset->Target, D3D12_SRV_DIMENSION_TEXTURE2D);
+                *TextureAsset->BindlessIndex = TextureAsset->Target->Bindless.Index;
+                return;
+            }
 
-        //ͨüǩ
+            const std::shared_ptr<Mesh> mesh = Loader.GetMesh(Handle);
+            if (Handle == PbrMeshAsset)
+            {
+                m_PbrMeshlets = MeshletBuilder::Build(*mesh);
+                m_PbrModel = MeshBuffer::CreateMeshBuffer(Batch, m_CommandList, m_Device, mesh, m_ModelFormat, m_HeapManager.get(), m_GeometryPool.get());
+                m_SceneFrame.SetModel(&m_PbrMeshlets, &m_PbrModel.SubMeshes, &m_PbrModel.Lods);
+            }
+            else
+            {
+                m_SkyBox = MeshBuffer::CreateMeshBuffer(Batch, m_CommandList, m_Device, mesh, VertexFormat::Full, m_HeapManager.get(), m_GeometryPool.get());
+            }
+        });
+
+        //One submission for every PBR asset, the GPU copies while the environment maps are set up
+        Batch.Submit();
+
+
+    }
+
+    //زԤȼ㻷
+    //Takes a BakedTexture or an IblCacheTexture
+    const auto UploadBaked = [&](const auto& Source, DXGI_FORMAT Format)
+    {
+        std::vector<D3D12_SUBRESOURCE_DATA> Subresources(Source.NumSubresources());
+        for (UINT Slice = 0; Slice < Source.ArraySize; ++Slice)
         {
-            const CD3DX12_DESCRIPTOR_RANGE1 descriptorRanges[] = 
+            for (UINT Mip = 0; Mip < Source.Levels; ++Mip)
             {
-                {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC},
-                {D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE},
-            };
-            CD3DX12_ROOT_PARAMETER1 rootParameters[3];
-            rootParameters[0].InitAsDescriptorTable(1, &descriptorRanges[0]);
-            rootParameters[1].InitAsDescriptorTable(1, &descriptorRanges[1]);
-            rootParameters[2].InitAsConstants(1, 0);
-            CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC signatureDesc;
-            signatureDesc.Init_1_1(3, rootParameters, 1, &ComputeSamplerDesc);
-            ComputeRootSignature = RootSignature::CreateRootSignature(m_Device,m_RootSignatureVersion,signatureDesc);
+                const LONG_PTR RowPitch = LONG_PTR(Source.RowPitch(Mip));
+                Subresources[D3D12CalcSubresource(Mip, Slice, 0, Source.Levels, Source.ArraySize)] = { Source.Subresource(Mip, Slice), RowPitch, RowPitch * Source.MipHeight(Mip) };
+            }
         }
+        return Texture::CreateTexture(Batch, m_Device, m_CommandList, m_DescHeapCBV_SRV_UAV, Source.Width, Source.Height, Source.ArraySize, Format, Source.Levels, Subresources.data(), m_HeapManager.get());
+    };
+    const auto SaveIbl = [&](const BakedIbl& Baked)
+    {
+        if (bCacheIbl && !IblCache::Save(IblCacheFile, Baked, IblKey))
+        {
+            std::printf("IBL cache: failed to write %s\n", IblCacheFile.c_str());
+        }
+    };
+    if (CachedIbl)
+    {
+        //Copied from the mapping into the staging buffers, the mapping closes at the end of Setup
+        m_EnvTexture = UploadBaked(CachedIbl->Environment, DXGI_FORMAT_R16G16B16A16_FLOAT);
+        m_spBRDF_LUT = UploadBaked(CachedIbl->BrdfLut, DXGI_FORMAT_R16G16_FLOAT);
+        m_SceneFrame.SetIrradiance(CachedIbl->Irradiance);
+        std::printf("IBL cache: hit %s\n", IblCacheFile.c_str());
+    }
+    else if (m_bBakeIblOnCpu)
+    {
+        //The same maps from IblBaker on the thread pool, uploaded as initial data without a single dispatch
+        IblBaker Baker{ ThreadPool::Get(), IblSettings };
+        const BakedIbl Baked = Baker.Bake(*Loader.GetImage(EnvironmentAsset));
+        Baker.PrintStats();
 
-        m_EnvTexture = Texture::CreateTexture(m_Device,m_DescHeapCBV_SRV_UAV,1024, 1024, 6, DXGI_FORMAT_R16G16B16A16_FLOAT);
+        Loader.Upload(EnvironmentAsset, [&]()
+        {
+            m_EnvTexture = UploadBaked(Baked.Environment, DXGI_FORMAT_R16G16B16A16_FLOAT);
+            m_spBRDF_LUT = UploadBaked(Baked.BrdfLut, DXGI_FORMAT_R16G16_FLOAT);
+        });
+        m_SceneFrame.SetIrradiance(Baked.Irradiance);
+        Batch.Flush();
+        SaveIbl(Baked);
+    }
+    else
+    {
+        ID3D12DescriptorHeap* ComputeDescriptorHeaps[] = {
+            m_DescHeapCBV_SRV_UAV.Heap.Get()
+        };
+
+        m_EnvTexture = Texture::CreateTexture(m_Device,m_DescHeapCBV_SRV_UAV,1024, 1024, 6, DXGI_FORMAT_R16G16B16A16_FLOAT, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, m_HeapManager.get());
         {
             DescriptorHeapMark mark(m_DescHeapCBV_SRV_UAV);
 
@@ -628,63 +757,49 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
             {
                 DescriptorHeapMark mark(m_DescHeapCBV_SRV_UAV);
 
-                Texture envTextureEquirect = Texture::CreateTexture(
-                    Callback,
-                    m_Device,
-                    m_CommandList,
-                    m_mipmapGeneration,
-                    m_DescHeapCBV_SRV_UAV,
-                    m_RootSignatureVersion,
-                    Image::FromFile("environment1.hdr"),
-                    DXGI_FORMAT_R32G32B32A32_FLOAT,
-                    1);
-
-                ComPtr<ID3D12PipelineState> pipelineState;
-                ComPtr<ID3DBlob> equirectToCubemapShader = Shader::compileShader(
-                    "shaders/hlsl/equirect2cube.hlsl",
-                    "main",
-                    "cs_5_0");
-
-                D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
-                psoDesc.pRootSignature = ComputeRootSignature.Get();
-                psoDesc.CS = CD3DX12_SHADER_BYTECODE(equirectToCubemapShader.Get());
-                if (FAILED(m_Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&pipelineState))))
+                const std::shared_ptr<Image> envImage = Loader.GetImage(EnvironmentAsset);
+                Texture envTextureEquirect;
+                Loader.Upload(EnvironmentAsset, [&]()
                 {
-                    throw std::runtime_error("Failed to create compute pipeline state (equirect2cube)");
-                }
+                    const D3D12_SUBRESOURCE_DATA Data{ envImage->Pixels<void>(), envImage->Pitch(), LONG_PTR(envImage->Pitch()) * envImage->Height() };
+                    envTextureEquirect = Texture::CreateTexture(
+                        Batch,
+                        m_Device,
+                        m_CommandList,
+                        m_DescHeapCBV_SRV_UAV,
+                        envImage->Width(),
+                        envImage->Height(),
+                        1,
+                        DXGI_FORMAT_R32G32B32A32_FLOAT,
+                        1,
+                        &Data);
+                });
+
+                ID3D12PipelineState* pipelineState = m_Pipelines->Get(Equirect2CubePipeline);
 
                 auto Common2UA = CD3DX12_RESOURCE_BARRIER::Transition(envTextureUnfiltered.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
                 auto UA2Common = CD3DX12_RESOURCE_BARRIER::Transition(envTextureUnfiltered.texture.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON);
                 m_CommandList->ResourceBarrier(1, &Common2UA);
                 m_CommandList->SetDescriptorHeaps(1, ComputeDescriptorHeaps);
-                m_CommandList->SetPipelineState(pipelineState.Get());
+                m_CommandList->SetPipelineState(pipelineState);
                 m_CommandList->SetComputeRootSignature(ComputeRootSignature.Get());
                 m_CommandList->SetComputeRootDescriptorTable(0, envTextureEquirect.Srv.GpuHandle);
                 m_CommandList->SetComputeRootDescriptorTable(1, envTextureUnfiltered.Uav.GpuHandle);
                 m_CommandList->Dispatch(m_EnvTexture.Width / 32, m_EnvTexture.Height / 32, 6);
                 m_CommandList->ResourceBarrier(1, &UA2Common);
 
-                Texture::GenerateMipmaps(Callback,m_Device,m_CommandList,m_mipmapGeneration,m_DescHeapCBV_SRV_UAV, m_RootSignatureVersion,envTextureUnfiltered);
+                Texture::GenerateMipmaps(Batch,m_Device,m_CommandList,m_mipmapGeneration, m_RootSignatureVersion,envTextureUnfiltered);
+
+                //The next block reuses this block's descriptors and the equirect texture goes out of scope
+                Batch.Flush();
             }
 
             //Pre-filtered Specular
             {
                 DescriptorHeapMark mark(m_DescHeapCBV_SRV_UAV);
 
-                ComPtr<ID3D12PipelineState> PipelineStae;
-                ComPtr<ID3DBlob> spmapShader = Shader::compileShader(
-                    "shaders/hlsl/spmap.hlsl",
-                    "main",
-                    "cs_5_0");
-
-                D3D12_COMPUTE_PIPELINE_STATE_DESC PsoDesc = {};
-                PsoDesc.pRootSignature = ComputeRootSignature.Get();
-                PsoDesc.CS = CD3DX12_SHADER_BYTECODE{ spmapShader.Get() };
-                if (FAILED(m_Device->CreateComputePipelineState(&PsoDesc, IID_PPV_ARGS(&PipelineStae))))
-                {
-                    throw std::runtime_error("Failed to create compute pipeline state (spmap)");
-                }
+                ID3D12PipelineState* PipelineStae = m_Pipelines->Get(SpmapPipeline);
 
                 // Copy 0th mipmap level into destination environment map.
                 const D3D12_RESOURCE_BARRIER preCopyBarriers[] = {
@@ -712,7 +827,7 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
 
                 // Pre-filter rest of the mip chain.
                 m_CommandList->SetDescriptorHeaps(1, ComputeDescriptorHeaps);
-                m_CommandList->SetPipelineState(PipelineStae.Get());
+                m_CommandList->SetPipelineState(PipelineStae);
                 m_CommandList->SetComputeRootSignature(ComputeRootSignature.Get());
                 m_CommandList->SetComputeRootDescriptorTable(0, envTextureUnfiltered.Srv.GpuHandle);
 
@@ -732,65 +847,17 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
 
                 m_CommandList->ResourceBarrier(1, &trans);
 
-                ExecuteCommandList();
-                WaitForGPU();
-            }
-        }
-
-        //Irradiance cubemap
-        m_IrMapTexture = Texture::CreateTexture(m_Device,m_DescHeapCBV_SRV_UAV,32, 32, 6, DXGI_FORMAT_R16G16B16A16_FLOAT, 1);
-        {
-            DescriptorHeapMark mark(m_DescHeapCBV_SRV_UAV);
-            Texture::CreateTextureUAV(m_Device, m_DescHeapCBV_SRV_UAV, m_IrMapTexture, 0);
-
-            ComPtr<ID3D12PipelineState> PipelineState;
-            ComPtr<ID3DBlob> IrmapShader = Shader::compileShader(
-                "Shaders/hlsl/irmap.hlsl",
-                "main",
-                "cs_5_0"
-            );
-
-            D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
-            psoDesc.pRootSignature = ComputeRootSignature.Get();
-            psoDesc.CS = CD3DX12_SHADER_BYTECODE{ IrmapShader.Get() };
-            if (FAILED(m_Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&PipelineState)))) 
-            {
-                throw std::runtime_error("Failed to create compute pipeline state (irmap)");
+                Batch.Flush();
             }
-
-            auto Common2UA = CD3DX12_RESOURCE_BARRIER::Transition(m_IrMapTexture.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-            auto UA2Common = CD3DX12_RESOURCE_BARRIER::Transition(m_IrMapTexture.texture.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON);
-
-            m_CommandList->ResourceBarrier(1, &Common2UA);
-            m_CommandList->SetDescriptorHeaps(1, ComputeDescriptorHeaps);
-            m_CommandList->SetPipelineState(PipelineState.Get());
-            m_CommandList->SetComputeRootSignature(ComputeRootSignature.Get());
-            m_CommandList->SetComputeRootDescriptorTable(0, m_EnvTexture.Srv.GpuHandle);
-            m_CommandList->SetComputeRootDescriptorTable(1, m_IrMapTexture.Uav.GpuHandle);
-            m_CommandList->Dispatch(m_IrMapTexture.Width / 32, m_IrMapTexture.Height / 32, 6);
-            m_CommandList->ResourceBarrier(1, &UA2Common);
-
-            ExecuteCommandList();
-            WaitForGPU();
-
         }
 
         //  Cook-Torrance BRDF 2D LUT for split-sum approximation.
-        m_spBRDF_LUT = Texture::CreateTexture(m_Device, m_DescHeapCBV_SRV_UAV, 256, 256, 1, DXGI_FORMAT_R16G16_FLOAT, 1);
+        m_spBRDF_LUT = Texture::CreateTexture(m_Device, m_DescHeapCBV_SRV_UAV, 256, 256, 1, DXGI_FORMAT_R16G16_FLOAT, 1, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, m_HeapManager.get());
         {
             DescriptorHeapMark mark(m_DescHeapCBV_SRV_UAV);
             Texture::CreateTextureUAV(m_Device, m_DescHeapCBV_SRV_UAV, m_spBRDF_LUT, 0);
 
-            ComPtr<ID3D12PipelineState> pipelineState;
-            ComPtr<ID3DBlob> spBRDFShader = Shader::compileShader("shaders/hlsl/spbrdf.hlsl", "main", "cs_5_0");
-
-            D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
-            psoDesc.pRootSignature = ComputeRootSignature.Get();
-            psoDesc.CS = CD3DX12_SHADER_BYTECODE{ spBRDFShader.Get() };
-            if (FAILED(m_Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&pipelineState)))) {
-                throw std::runtime_error("Failed to create compute pipeline state (spbrdf)");
-            }
+            ID3D12PipelineState* pipelineState = m_Pipelines->Get(SpBRDFPipeline);
 
             auto Common2UA = CD3DX12_RESOURCE_BARRIER::Transition(m_spBRDF_LUT.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
@@ -798,238 +865,252 @@ void D3D12Renderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
 
             m_CommandList->ResourceBarrier(1, &Common2UA);
             m_CommandList->SetDescriptorHeaps(1, ComputeDescriptorHeaps);
-            m_CommandList->SetPipelineState(pipelineState.Get());
+            m_CommandList->SetPipelineState(pipelineState);
             m_CommandList->SetComputeRootSignature(ComputeRootSignature.Get());
             m_CommandList->SetComputeRootDescriptorTable(1, m_spBRDF_LUT.Uav.GpuHandle);
             m_CommandList->Dispatch(m_spBRDF_LUT.Width / 32, m_spBRDF_LUT.Height / 32, 1);
             m_CommandList->ResourceBarrier(1, &UA2Common);
 
-            ExecuteCommandList();
-            WaitForGPU();
+            Batch.Flush();
         }
-    }
-
-    //ShadowMap
-     m_ShadowMap = std::make_unique<ShadowMap>(m_Device,m_DescHeapCBV_SRV_UAV,m_DescHeapDsv,1024,1024,1, MeshInputLayout,DefaultSamplerDesc,m_RootSignatureVersion);
-
-     //Debug
-     m_Debugger = std::make_unique<Debugger>(Callback, m_Device, m_CommandList, MeshInputLayout, DefaultSamplerDesc, m_RootSignatureVersion, 1, m_ShadowMap->ShadowMapTexture, 0.0f, 0.0f, 0.5f, 0.5f, 0.0f);
-
-    //128KB host-mappedBufferUploadheapshaderconstants
-    m_constantBuffer = UploadBuffer::CreateUploadBuffer(m_Device,128 * 1024); // 128 KB
-
-    SetDebugName(m_constantBuffer.Buffer.Get(),UploadBuffer)
-
-    //ÿ֡Resource
-    {
-        DescriptorHeapMark Mark(m_DescHeapCBV_SRV_UAV);
 
-        std::vector<D3D12_RESOURCE_BARRIER> barriers{ NumFrames };
-        for(UINT FrameIndex = 0 ; FrameIndex < NumFrames ; ++FrameIndex)
+        //The irradiance SH is projected on the CPU from mip 0 of the environment, so the cube is read back once.
+        //A miss reads the LUT back with it, the same stall then lets the next launch skip all of the above
         {
-            m_TransformCBVs[FrameIndex] = ConstantBufferView::CreateConstantBufferView<TransformCB>(m_Device,m_DescHeapCBV_SRV_UAV,m_constantBuffer);
-
-            m_ShadingCBVs[FrameIndex] = ConstantBufferView::CreateConstantBufferView<ShadingCB>(m_Device, m_DescHeapCBV_SRV_UAV, m_constantBuffer);
+            const TextureReadback EnvReadback = Texture::RecordReadback(m_Device, m_CommandList, m_EnvTexture);
+            TextureReadback LutReadback;
+            if (bCacheIbl)
+            {
+                LutReadback = Texture::RecordReadback(m_Device, m_CommandList, m_spBRDF_LUT);
+            }
+            Batch.Flush();
 
-            m_ShadowMapCBVs[FrameIndex] = ConstantBufferView::CreateConstantBufferView<Constant4Shader>(m_Device, m_DescHeapCBV_SRV_UAV, m_constantBuffer);
+            BakedIbl Baked;
+            Baked.Environment = BakedTexture::Allocate(m_EnvTexture.Width, m_EnvTexture.Height, 6, m_EnvTexture.Levels, 4);
+            Texture::ReadSubresources(EnvReadback, Baked.Environment.Texels.data());
+            const uint16_t* Faces[6];
+            for (UINT Face = 0; Face < 6; ++Face)
+            {
+                Faces[Face] = Baked.Environment.Subresource(0, Face);
+            }
+            Baked.Irradiance = SphericalHarmonics::ProjectIrradiance(ThreadPool::Get(), Faces, Baked.Environment.Width);
+            m_SceneFrame.SetIrradiance(Baked.Irradiance);
 
-            barriers[FrameIndex] = CD3DX12_RESOURCE_BARRIER::Transition(m_ResolveFrameBuffers[FrameIndex].ColorTexture.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            if (bCacheIbl)
+            {
+                Baked.BrdfLut = BakedTexture::Allocate(m_spBRDF_LUT.Width, m_spBRDF_LUT.Height, 1, 1, 2);
+                Texture::ReadSubresources(LutReadback, Baked.BrdfLut.Texels.data());
+                SaveIbl(Baked);
+            }
         }
-
-        m_CommandList->ResourceBarrier(NumFrames, barriers.data());
     }
 
+    Texture::CreateBindlessSRV(m_Device, *m_BindlessCubes, m_EnvTexture, D3D12_SRV_DIMENSION_TEXTURECUBE);
+    Texture::CreateBindlessSRV(m_Device, *m_BindlessTextures, m_spBRDF_LUT, D3D12_SRV_DIMENSION_TEXTURE2D);
+    m_PbrMaterial.Specular = m_EnvTexture.Bindless.Index;
+    m_PbrMaterial.SpecularBRDF = m_spBRDF_LUT.Bindless.Index;
+
+    Batch.Flush();
+    Batch.PrintStats("Setup");
+    //Surfaces a failed build here rather than in the first frame
+    m_Pipelines->WaitAll();
+    m_Pipelines->PrintStats("Setup");
+    m_StagingRing->PrintStats("Setup staging");
+    m_HeapManager->PrintStats();
+    m_BindlessTextures->PrintStats("Bindless textures");
+    m_BindlessCubes->PrintStats("Bindless cubes");
+    m_GeometryPool->PrintStats();
+
+    //Shader constants are allocated every frame in Update, 2 MB per frame in flight leaves room for thousands of draws
+    m_TransientConstants = std::make_unique<TransientConstantBuffer>(m_Device, 2 * 1024 * 1024, m_NumFrames);
+
     mCamera.SetLens(m_View.fov, float(1024), float(1024), 1.0f, 1000.0f);
 
     ExecuteCommandList(false);
     WaitForGPU();
+
+    Loader.PrintReport();
+
+    SetupPasses();
 }
 
 void D3D12Renderer::Update(const float DeltaTime)
 {
-    const ConstantBufferView& transformCBV = m_TransformCBVs[m_FrameIndex];
-    const ConstantBufferView& shadingCBV = m_ShadingCBVs[m_FrameIndex];
-    const ConstantBufferView& ShadowMapCBV = m_ShadowMapCBVs[m_FrameIndex];
-
-    const Vec3 EyePosition = glm::inverse(mCamera.GetView())[3];
-
-    //Update ShadowMapCBV
-    {
-        m_ShadowMap->UpdateShadowTransform(DeltaTime, m_Scene.Lights[0], ShadowMapCBV);
-    }
-
-    //Update TransformCB
-    {
-        TransformCB* transformConstants = transformCBV.as<TransformCB>();
-        transformConstants->ViewPorjectionMatrix = mCamera.GetProj() * mCamera.GetView();
-        transformConstants->SkyProjectionMatrix = mCamera.GetProj() * mCamera.GetRotation();
-
-        //ObjectMvp
-        //ţתƽ
-        Mat4 ModelMVP = glm::mat4x4(1);
-        ModelMVP = glm::translate(ModelMVP, Vec3{ 5,0,0 });
-        ModelMVP *= glm::eulerAngleXY(glm::radians(m_Scene.pitch), glm::radians(m_Scene.yaw));
-        transformConstants->ObjectMVPMatix = ModelMVP;
-    }
-
-    //Update Shading constant
-    {
-        // std::printf("%0.3f %0.3f %0.3f\n", mCamera.GetPosition()[0], mCamera.GetPosition()[1], mCamera.GetPosition()[2]);
-        // std::printf("LOOKAT %0.3f %0.3f %0.3f\n", mCamera.GetLook()[0], mCamera.GetLook()[1], mCamera.GetLook()[2]);
-
-        ShadingCB* ShadingConstants = shadingCBV.as<ShadingCB>();
-        ShadingConstants->EyePosition = Vec4{ EyePosition,0.0f };
-        for (int i = 0; i < SceneSettings::NumLights; ++i)
-        {
-            const Light& light = m_Scene.Lights[i];
-            ShadingConstants->Light[i].Direction = Vec4{ light.Direction,0.0f };
-            if (light.Enabel)
-            {
-                ShadingConstants->Light[i].Radiance = Vec4{ light.Radiance,0.0f };
-            }
-            else
-            {
-                ShadingConstants->Light[i].Radiance = Vec4{ 1.0,1.0,1.0,0.0 };
-            }
-        }
-    }
+    WaitForFrame();
+
+    //WaitForFrame already waited for this slot's fence, BeginFrame only checks it before rewinding
+    m_TransientConstants->BeginFrame(m_FrameIndex, m_Fence.Get(), m_FenceCompletionEvent);
+    m_BindlessTextures->Reclaim(m_Fence->GetCompletedValue());
+    m_BindlessCubes->Reclaim(m_Fence->GetCompletedValue());
+    m_GeometryPool->Reclaim(m_Fence->GetCompletedValue());
+
+    //Constants, shadow transform and culling are backend independent, only the copies below are D3D12
+    m_SceneFrame.Update(mCamera, m_Scene, float(1024));
+
+    *m_TransientConstants->Allocate<TransformCB>(m_TransformConstants) = m_SceneFrame.Transform();
+    *m_TransientConstants->Allocate<ShadingCB>(m_ShadingConstants) = m_SceneFrame.Shading();
+    const UploadBufferRegion ShadowMapConstants = m_TransientConstants->Allocate(sizeof(Constant4Shader));
+    m_ShadowMapConstants = ShadowMapConstants.GpuAddress;
+    m_ShadowMap->UpdateShadowTransform(m_SceneFrame.Shadow(), ShadowMapConstants);
 }
 
 void D3D12Renderer::Render(GLFWwindow* Window,const float DeltaTime)
 {
-    const ConstantBufferView& transformCBV = m_TransformCBVs[m_FrameIndex];
-    const ConstantBufferView& shadingCBV = m_ShadingCBVs[m_FrameIndex];
-    const ConstantBufferView& ShadowMapCBV = m_ShadowMapCBVs[m_FrameIndex];
-
-    ID3D12CommandAllocator* commandAllocator = m_CommandAllocators[m_FrameIndex].Get();
-    const SwapChainBuffer& backbuffer = m_BackBuffers[m_FrameIndex];
-    const FrameBuffer& framebuffer = m_FrameBuffers[m_FrameIndex];
-    const FrameBuffer& resolveFramebuffer = m_ResolveFrameBuffers[m_FrameIndex];
-
-    commandAllocator->Reset();
-    m_CommandList->Reset(commandAllocator, m_SkyBoxPipelineState.Get());
+    m_BackBufferIndex = m_SwapChain->GetCurrentBackBufferIndex();
+    m_FrameGraph->SetImported(m_BackBufferTarget, m_BackBuffers[m_BackBufferIndex].Buffer.Get());
+    m_Passes->Execute(m_FrameIndex);
+
+    //PresentFrame signals the next value once the frame is done, the constants stay put until then
+    const UINT64 FrameFenceValue = m_FenceValue + 1;
+    m_TransientConstants->EndFrame(FrameFenceValue);
+    m_BindlessTextures->Close(FrameFenceValue);
+    m_BindlessCubes->Close(FrameFenceValue);
+    m_GeometryPool->Close(FrameFenceValue);
+    PresentFrame();
+}
 
-    if(framebuffer.Samples <= 1)
-    {
-        auto ResourceBarrier = CD3DX12_RESOURCE_BARRIER::Transition(framebuffer.ColorTexture.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-        m_CommandList->ResourceBarrier(1, &ResourceBarrier);
-    }
+void D3D12Renderer::SetupPasses()
+{
+    m_PassBackend = std::make_unique<D3D12CommandBackend>(m_Device, m_CommandQueue, m_NumFrames);
+    m_Passes = std::make_unique<ParallelPassRecorder>(*m_PassBackend, ThreadPool::Get());
 
-    //DescriptorHeap
+    //Every list starts without state, so each pass binds its heaps, viewport and targets itself
+    const auto BindFrameBuffer = [this](ID3D12GraphicsCommandList* CommandList, const FrameBuffer& framebuffer)
     {
         ID3D12DescriptorHeap* DescriptorHeap[] =
         {
             m_DescHeapCBV_SRV_UAV.Heap.Get()
         };
+        CommandList->SetDescriptorHeaps(1, DescriptorHeap);
+        CommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-        m_CommandList->SetDescriptorHeaps(1, DescriptorHeap);
-    }
-
-    //Ӱ
-    {
-        m_CommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
         auto Viewport = CD3DX12_VIEWPORT{ 0.0f, 0.0f, (FLOAT)framebuffer.Width, (FLOAT)framebuffer.Height };
         auto ScissRect = CD3DX12_RECT{ 0, 0, (LONG)framebuffer.Width, (LONG)framebuffer.Height };
-        //
-        m_CommandList->RSSetViewports(1, &Viewport);
-        m_CommandList->RSSetScissorRects(1, &ScissRect);
-        //
-        auto Read2Write = CD3DX12_RESOURCE_BARRIER::Transition(m_ShadowMap->ShadowMapTexture.texture.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-        m_CommandList->ResourceBarrier(1, &Read2Write);
-        //
-        m_CommandList->ClearDepthStencilView(m_ShadowMap->Dsv.CpuHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0,nullptr);
-        //
-        m_CommandList->OMSetRenderTargets(0,nullptr, false, &m_ShadowMap->Dsv.CpuHandle);
-        //
-        m_CommandList->SetGraphicsRootSignature(m_ShadowMap->m_ShadowSignature.Get());
-        m_CommandList->SetGraphicsRootDescriptorTable(0, ShadowMapCBV.Cbv.GpuHandle);
-        //
-        m_CommandList->SetPipelineState(m_ShadowMap->m_ShadowPipelineState.Get());
-        m_CommandList->IASetVertexBuffers(0, 1, &m_PbrModel.Vbv);
-        m_CommandList->IASetIndexBuffer(&m_PbrModel.Ibv);
-        //
-        m_CommandList->DrawIndexedInstanced(m_PbrModel.NumElements, 1, 0, 0, 0);
-        //
-        auto Write2Read = CD3DX12_RESOURCE_BARRIER::Transition(m_ShadowMap->ShadowMapTexture.texture.Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ);
-        m_CommandList->ResourceBarrier(1, &Write2Read);
-    }
+        CommandList->RSSetViewports(1, &Viewport);
+        CommandList->RSSetScissorRects(1, &ScissRect);
+    };
+
+    //The graph records every barrier between the passes below, the back buffer changes every frame in Render
+    const RenderGraphResource ShadowMapTexture = m_FrameGraph->Import("ShadowMap", m_ShadowMap->ShadowMapTexture.texture.Get(), ResourceState::GenericRead, ResourceState::GenericRead);
+    m_BackBufferTarget = m_FrameGraph->Import("BackBuffer", m_BackBuffers[0].Buffer.Get(), ResourceState::Present, ResourceState::Present);
 
-    //ȫ״̬
+    //Prepare is serial: the geometry moves change the offsets every draw below reads
+    ScenePasses::Hooks Hooks;
+    Hooks.Prepare = [this](CommandContext& Context)
     {
-        auto Viewport = CD3DX12_VIEWPORT{ 0.0f, 0.0f, (FLOAT)framebuffer.Width, (FLOAT)framebuffer.Height };
-        auto ScissRect = CD3DX12_RECT{ 0, 0, (LONG)framebuffer.Width, (LONG)framebuffer.Height };
+        m_GeometryPool->Defragment(D3D12CommandContext::Native(Context), 1024 * 1024);
+    };
 
-        m_CommandList->RSSetViewports(1, &Viewport);
-        m_CommandList->RSSetScissorRects(1, &ScissRect);
+    //Ӱ
+    Hooks.Shadow = [this, BindFrameBuffer](CommandContext& Context)
+    {
+        ID3D12GraphicsCommandList* CommandList = D3D12CommandContext::Native(Context);
+        BindFrameBuffer(CommandList, m_FrameBuffer);
 
-        //׼ȾFrameBuffer
-        float a[4] = { 0.0f,0.0f,0.0f,0.0f };
+        CommandList->ClearDepthStencilView(m_ShadowMap->Dsv.CpuHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0,nullptr);
+        CommandList->OMSetRenderTargets(0,nullptr, false, &m_ShadowMap->Dsv.CpuHandle);
 
-        m_CommandList->OMSetRenderTargets(1, &framebuffer.Rtv.CpuHandle, false, &framebuffer.Dsv.CpuHandle);
+        CommandList->SetGraphicsRootSignature(m_ShadowMap->m_ShadowSignature.Get());
+        CommandList->SetGraphicsRootConstantBufferView(0, m_ShadowMapConstants);
+        if (m_PbrModel.Format == VertexFormat::Packed)
+        {
+            const PackedPositionConstants PositionConstants = m_PbrModel.PositionConstants();
+            CommandList->SetGraphicsRoot32BitConstants(1, sizeof(PackedPositionConstants) / sizeof(uint32_t), &PositionConstants, 0);
+        }
+        CommandList->SetPipelineState(m_Pipelines->Get(m_ShadowMap->m_ShadowPipeline));
+        CommandList->IASetVertexBuffers(0, 1, &m_PbrModel.Vbv);
+        CommandList->IASetIndexBuffer(&m_PbrModel.Ibv);
 
-        m_CommandList->ClearRenderTargetView(framebuffer.Rtv.CpuHandle, a, 1, &ScissRect);
-        m_CommandList->ClearDepthStencilView(framebuffer.Dsv.CpuHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
-    }
+        m_PbrModel.DrawRanges(Context, m_SceneFrame.ShadowDraws());
+    };
 
     //Skybox
+    Hooks.Skybox = [this, BindFrameBuffer](CommandContext& Context)
     {
-        m_CommandList->SetGraphicsRootSignature(m_SkyBoxRootSignature.Get());
-        m_CommandList->SetGraphicsRootDescriptorTable(0, transformCBV.Cbv.GpuHandle);
-        m_CommandList->SetGraphicsRootDescriptorTable(1, m_EnvTexture.Srv.GpuHandle);
+        ID3D12GraphicsCommandList* CommandList = D3D12CommandContext::Native(Context);
+        const FrameBuffer& framebuffer = m_FrameBuffer;
+        BindFrameBuffer(CommandList, framebuffer);
 
-        m_CommandList->SetPipelineState(m_SkyBoxPipelineState.Get());
+        //׼ȾFrameBuffer
+        float a[4] = { 0.0f,0.0f,0.0f,0.0f };
+        auto ScissRect = CD3DX12_RECT{ 0, 0, (LONG)framebuffer.Width, (LONG)framebuffer.Height };
+        CommandList->OMSetRenderTargets(1, &framebuffer.Rtv.CpuHandle, false, &framebuffer.Dsv.CpuHandle);
+        CommandList->ClearRenderTargetView(framebuffer.Rtv.CpuHandle, a, 1, &ScissRect);
+        CommandList->ClearDepthStencilView(framebuffer.Dsv.CpuHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+
+        CommandList->SetGraphicsRootSignature(m_SkyBoxRootSignature.Get());
+        CommandList->SetGraphicsRootConstantBufferView(0, m_TransformConstants);
+        CommandList->SetGraphicsRootDescriptorTable(1, m_EnvTexture.Srv.GpuHandle);
+        CommandList->SetPipelineState(m_Pipelines->Get(m_SkyBoxPipeline));
+        CommandList->IASetVertexBuffers(0, 1, &m_SkyBox.Vbv);
+        CommandList->IASetIndexBuffer(&m_SkyBox.Ibv);
+
+        m_SkyBox.DrawSubMeshes(Context);
+    };
 
-        m_CommandList->IASetVertexBuffers(0, 1, &m_SkyBox.Vbv);
-        m_CommandList->IASetIndexBuffer(&m_SkyBox.Ibv);
+    // PBR model, the debugger shows the shadow map on top
+    Hooks.Pbr = [this, BindFrameBuffer](CommandContext& Context)
+    {
+        ID3D12GraphicsCommandList* CommandList = D3D12CommandContext::Native(Context);
+        const FrameBuffer& framebuffer = m_FrameBuffer;
+        BindFrameBuffer(CommandList, framebuffer);
+        CommandList->OMSetRenderTargets(1, &framebuffer.Rtv.CpuHandle, false, &framebuffer.Dsv.CpuHandle);
+
+        CommandList->SetGraphicsRootSignature(m_PbrRootSignature.Get());
+        CommandList->SetGraphicsRootConstantBufferView(0, m_TransformConstants);
+        CommandList->SetGraphicsRootConstantBufferView(1, m_ShadingConstants);
+        CommandList->SetGraphicsRoot32BitConstants(2, sizeof(PbrMaterialIndices) / sizeof(uint32_t), &m_PbrMaterial, 0);
+        CommandList->SetGraphicsRootDescriptorTable(3, m_BindlessTextures->TableStart());
+        if (m_PbrModel.Format == VertexFormat::Packed)
+        {
+            const PackedPositionConstants PositionConstants = m_PbrModel.PositionConstants();
+            CommandList->SetGraphicsRoot32BitConstants(4, sizeof(PackedPositionConstants) / sizeof(uint32_t), &PositionConstants, 0);
+        }
+        CommandList->SetPipelineState(m_Pipelines->Get(m_PbrPipeline));
+        CommandList->IASetVertexBuffers(0, 1, &m_PbrModel.Vbv);
+        CommandList->IASetIndexBuffer(&m_PbrModel.Ibv);
 
-        m_CommandList->DrawIndexedInstanced(m_SkyBox.NumElements, 1, 0, 0, 0);
-    }
+        m_PbrModel.DrawRanges(Context, m_SceneFrame.MainDraws());
+
+        m_Debugger->Draw(Context);
+    };
+
+    Hooks.Resolve = [this](CommandContext& Context)
+    {
+        ResolveFrameBuffer(D3D12CommandContext::Native(Context), m_FrameBuffer, m_ResolveFrameBuffer, DXGI_FORMAT_R16G16B16A16_FLOAT);
+    };
 
-    // PBR model
+    //һȫ
+    Hooks.Tonemap = [this, BindFrameBuffer](CommandContext& Context)
     {
-        m_CommandList->SetGraphicsRootSignature(m_PbrRootSignature.Get());
-        m_CommandList->SetGraphicsRootDescriptorTable(0, transformCBV.Cbv.GpuHandle);
-        m_CommandList->SetGraphicsRootDescriptorTable(1, shadingCBV.Cbv.GpuHandle);
-        m_CommandList->SetGraphicsRootDescriptorTable(2, m_AlbedoTexture.Srv.GpuHandle);
-        m_CommandList->SetPipelineState(m_PbrPipelineState.Get());
+        ID3D12GraphicsCommandList* CommandList = D3D12CommandContext::Native(Context);
+        const SwapChainBuffer& backbuffer = m_BackBuffers[m_BackBufferIndex];
+        BindFrameBuffer(CommandList, m_FrameBuffer);
 
-        m_CommandList->IASetVertexBuffers(0, 1, &m_PbrModel.Vbv);
-        m_CommandList->IASetIndexBuffer(&m_PbrModel.Ibv);
+        //  ȾBackBuffer
+        CommandList->OMSetRenderTargets(1, &backbuffer.Rtv.CpuHandle, false, nullptr);
 
-        m_CommandList->DrawIndexedInstanced(m_PbrModel.NumElements, 1, 0, 0, 0);
-    }
+        CommandList->SetGraphicsRootSignature(m_ToneMapRootSignature.Get());
+        CommandList->SetGraphicsRootDescriptorTable(0, m_ResolveFrameBuffer.Srv.GpuHandle);
+        CommandList->SetPipelineState(m_Pipelines->Get(m_ToneMapPipeline));
+        Context.Draw(3, 1);
+    };
 
-    m_Debugger->Draw();
+    //Without MSAA m_ResolveFrameBuffer is m_FrameBuffer and there is no Resolve pass
+    const ScenePasses::Targets Targets{ ShadowMapTexture, m_FrameBuffer.Color, m_FrameBuffer.DepthStencil, m_ResolveFrameBuffer.Color, m_BackBufferTarget };
+    ScenePasses::Add(m_FrameGraph->Graph(), Targets, std::move(Hooks));
 
-    if(framebuffer.Samples > 1)
+    m_FrameGraph->Compile(*m_Passes);
+    CreateFrameBufferViews(m_FrameBuffer);
+    if (m_FrameBuffer.Samples > 1)
     {
-        ResolveFrameBuffer(framebuffer, resolveFramebuffer, DXGI_FORMAT_R16G16B16A16_FLOAT);
+        CreateFrameBufferViews(m_ResolveFrameBuffer);
     }
     else
     {
-        auto Rt2ShaderResource = CD3DX12_RESOURCE_BARRIER::Transition(framebuffer.ColorTexture.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-        m_CommandList->ResourceBarrier(1, &Rt2ShaderResource);
-    }
-
-    //  ׼ȾBackBuffer
-    auto Present2RT = CD3DX12_RESOURCE_BARRIER::Transition(backbuffer.Buffer.Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    m_CommandList->ResourceBarrier(1, &Present2RT);
-    m_CommandList->OMSetRenderTargets(1, &backbuffer.Rtv.CpuHandle, false, nullptr);
-
-    //һȫ
-    {
-        m_CommandList->SetGraphicsRootSignature(m_ToneMapRootSignature.Get());
-        m_CommandList->SetGraphicsRootDescriptorTable(0, resolveFramebuffer.Srv.GpuHandle);
-        m_CommandList->SetPipelineState(m_ToneMapPipelineState.Get());
-
-        m_CommandList->DrawInstanced(3, 1, 0, 0);
+        m_ResolveFrameBuffer = m_FrameBuffer;
     }
-
-    auto RT2PRE = CD3DX12_RESOURCE_BARRIER::Transition(backbuffer.Buffer.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-    m_CommandList->ResourceBarrier(1, &RT2PRE);
-
-    ExecuteCommandList(false);
-    PresentFrame();
+    m_FrameGraph->PrintReport("Frame");
 }
 
 void D3D12Renderer::SetLight()
@@ -1041,12 +1122,14 @@ void D3D12Renderer::SetLight()
 
 }
 
-FrameBuffer D3D12Renderer::CreateFrameBuffer(UINT Width, UINT Height, UINT Samples, DXGI_FORMAT ColorFormat,DXGI_FORMAT DepthStencilFormat)
+FrameBuffer D3D12Renderer::CreateFrameBuffer(const char* Name, UINT Width, UINT Height, UINT Samples, DXGI_FORMAT ColorFormat,DXGI_FORMAT DepthStencilFormat)
 {
     FrameBuffer fb = {  };
     fb.Width = Width;
     fb.Height = Height;
     fb.Samples = Samples;
+    fb.ColorFormat = ColorFormat;
+    fb.DepthStencilFormat = DepthStencilFormat;
 
     D3D12_RESOURCE_DESC Desc = {};
     Desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
@@ -1063,32 +1146,41 @@ FrameBuffer D3D12Renderer::CreateFrameBuffer(UINT Width, UINT Height, UINT Sampl
 
         const float OptimizedClearColor[] = { 0.0f,0.0f,0.0f,0.0f };
 
-        auto HeapProPerties = CD3DX12_HEAP_PROPERTIES{ D3D12_HEAP_TYPE_DEFAULT };
         auto ClearColor = CD3DX12_CLEAR_VALUE{ ColorFormat,OptimizedClearColor };
-        if (FAILED(m_Device->CreateCommittedResource(
-            &HeapProPerties,
-            D3D12_HEAP_FLAG_NONE,
-            &Desc, D3D12_RESOURCE_STATE_RENDER_TARGET,
-            &ClearColor,
-            IID_PPV_ARGS(&fb.ColorTexture)
-        )))
-        {
-            throw std::runtime_error("Failed to create FrameBuffer color texture");
-        }
+        fb.Color = m_FrameGraph->CreateTexture(std::string(Name) + "Color", Desc, &ClearColor);
+    }
+    if(DepthStencilFormat != DXGI_FORMAT_UNKNOWN)
+    {
+        Desc.Format = DepthStencilFormat;
+        Desc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL |
+            D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE;
+
+        auto ClearDepth = CD3DX12_CLEAR_VALUE{ DepthStencilFormat,1.0f,0 };
+        fb.DepthStencil = m_FrameGraph->CreateTexture(std::string(Name) + "DepthStencil", Desc, &ClearDepth);
+    }
+
+    return fb;
+}
+
+void D3D12Renderer::CreateFrameBufferViews(FrameBuffer& fb)
+{
+    if (fb.Color != InvalidRenderGraphResource)
+    {
+        fb.ColorTexture = m_FrameGraph->Resource(fb.Color);
 
         D3D12_RENDER_TARGET_VIEW_DESC RtvDesc = {};
-        RtvDesc.Format = Desc.Format;
-        RtvDesc.ViewDimension = (Samples > 1) ?
+        RtvDesc.Format = fb.ColorFormat;
+        RtvDesc.ViewDimension = (fb.Samples > 1) ?
             D3D12_RTV_DIMENSION_TEXTURE2DMS :
             D3D12_RTV_DIMENSION_TEXTURE2D;
 
         fb.Rtv = m_DescHeapRtv.Alloc();
         m_Device->CreateRenderTargetView(fb.ColorTexture.Get(), &RtvDesc, fb.Rtv.CpuHandle);
 
-        if (Samples <= 1)
+        if (fb.Samples <= 1)
         {
             D3D12_SHADER_RESOURCE_VIEW_DESC SrvDesc = {};
-            SrvDesc.Format = Desc.Format;
+            SrvDesc.Format = fb.ColorFormat;
             SrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
             SrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
             SrvDesc.Texture2D.MostDetailedMip = 0;
@@ -1098,29 +1190,13 @@ FrameBuffer D3D12Renderer::CreateFrameBuffer(UINT Width, UINT Height, UINT Sampl
             m_Device->CreateShaderResourceView(fb.ColorTexture.Get(), &SrvDesc, fb.Srv.CpuHandle);
         }
     }
-    if(DepthStencilFormat != DXGI_FORMAT_UNKNOWN)
+    if (fb.DepthStencil != InvalidRenderGraphResource)
     {
-        Desc.Format = DepthStencilFormat;
-        Desc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL |
-            D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE;
-
-        auto DeFaultHeap = CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_DEFAULT);
-        auto ClearDepth = CD3DX12_CLEAR_VALUE{ DepthStencilFormat,1.0f,0 };
-        if (FAILED(m_Device->CreateCommittedResource(
-            &DeFaultHeap,
-            D3D12_HEAP_FLAG_NONE,
-            &Desc,
-            D3D12_RESOURCE_STATE_DEPTH_WRITE,
-            &ClearDepth,
-            IID_PPV_ARGS(&fb.DepthStencilTexture)
-        )))
-        {
-            throw std::runtime_error("Failed to create FrameBuffer depth-stencil texture");
-        }
+        fb.DepthStencilTexture = m_FrameGraph->Resource(fb.DepthStencil);
 
         D3D12_DEPTH_STENCIL_VIEW_DESC DsvDesc = {};
-        DsvDesc.Format = Desc.Format;
-        DsvDesc.ViewDimension = (Samples > 1) ?
+        DsvDesc.Format = fb.DepthStencilFormat;
+        DsvDesc.ViewDimension = (fb.Samples > 1) ?
             D3D12_DSV_DIMENSION_TEXTURE2DMS :
             D3D12_DSV_DIMENSION_TEXTURE2D;
 
@@ -1130,28 +1206,14 @@ FrameBuffer D3D12Renderer::CreateFrameBuffer(UINT Width, UINT Height, UINT Sampl
             &DsvDesc, 
             fb.Dsv.CpuHandle);
     }
-
-    return fb;
 }
 
-void D3D12Renderer::ResolveFrameBuffer(const FrameBuffer& SourceBuffer, const FrameBuffer& DestBuffer,DXGI_FORMAT Format) const
+void D3D12Renderer::ResolveFrameBuffer(ID3D12GraphicsCommandList* CommandList, const FrameBuffer& SourceBuffer, const FrameBuffer& DestBuffer,DXGI_FORMAT Format) const
 {
-    const CD3DX12_RESOURCE_BARRIER PreResolveBarriers[] = {
-        CD3DX12_RESOURCE_BARRIER::Transition(SourceBuffer.ColorTexture.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_RESOLVE_SOURCE),
-        CD3DX12_RESOURCE_BARRIER::Transition(DestBuffer.ColorTexture.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RESOLVE_DEST)
-    };
-
-    const CD3DX12_RESOURCE_BARRIER PostResolveBarriers[] =
-    {
-    CD3DX12_RESOURCE_BARRIER::Transition(SourceBuffer.ColorTexture.Get(), D3D12_RESOURCE_STATE_RESOLVE_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
-    CD3DX12_RESOURCE_BARRIER::Transition(DestBuffer.ColorTexture.Get(), D3D12_RESOURCE_STATE_RESOLVE_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
-    };
-
+    //The frame graph moved both to the resolve states
     if (SourceBuffer.ColorTexture != DestBuffer.ColorTexture)
     {
-        m_CommandList->ResourceBarrier(2, PreResolveBarriers);
-        m_CommandList->ResolveSubresource(DestBuffer.ColorTexture.Get(), 0, SourceBuffer.ColorTexture.Get(), 0, Format);
-        m_CommandList->ResourceBarrier(2, PostResolveBarriers);
+        CommandList->ResolveSubresource(DestBuffer.ColorTexture.Get(), 0, SourceBuffer.ColorTexture.Get(), 0, Format);
     }
 
 }
@@ -1175,28 +1237,41 @@ void D3D12Renderer::ExecuteCommandList(bool Reset) const
 
 void D3D12Renderer::WaitForGPU() const
 {
-    UINT64& fenceValue = m_FenceValue[m_FrameIndex];
-    ++fenceValue;
+    ++m_FenceValue;
 
-    m_CommandQueue->Signal(m_Fence.Get(), fenceValue);
-    m_Fence->SetEventOnCompletion(fenceValue, m_FenceCompletionEvent);
+    m_CommandQueue->Signal(m_Fence.Get(), m_FenceValue);
+    m_Fence->SetEventOnCompletion(m_FenceValue, m_FenceCompletionEvent);
     WaitForSingleObject(m_FenceCompletionEvent, INFINITE);
 }
 
-void D3D12Renderer::PresentFrame()
+void D3D12Renderer::WaitForFrame()
 {
-    m_SwapChain->Present(1, 0);
-    const UINT64 prevFrameFenceValue = m_FenceValue[m_FrameIndex];
-    m_FrameIndex = m_SwapChain->GetCurrentBackBufferIndex();
-    UINT64& currentFrameFenceValue = m_FenceValue[m_FrameIndex];
+    const auto WaitBegin = std::chrono::steady_clock::now();
 
-    m_CommandQueue->Signal(m_Fence.Get(), prevFrameFenceValue);
-    if (m_Fence->GetCompletedValue() < currentFrameFenceValue) 
+    //The swap chain lets go once fewer than m_NumFrames presents are queued
+    if (m_FrameLatencyWaitable)
     {
-        m_Fence->SetEventOnCompletion(currentFrameFenceValue, m_FenceCompletionEvent);
+        WaitForSingleObjectEx(m_FrameLatencyWaitable, 1000, TRUE);
+    }
+
+    const UINT64 WaitValue = m_Pacer.WaitValue();
+    if (m_Fence->GetCompletedValue() < WaitValue)
+    {
+        m_Fence->SetEventOnCompletion(WaitValue, m_FenceCompletionEvent);
         WaitForSingleObject(m_FenceCompletionEvent, INFINITE);
     }
-    currentFrameFenceValue = prevFrameFenceValue + 1;
+
+    m_Pacer.RecordWait(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - WaitBegin).count());
+    m_FrameIndex = m_Pacer.BeginFrame(m_Fence->GetCompletedValue());
+}
+
+void D3D12Renderer::PresentFrame()
+{
+    //No wait here, the next frame's WaitForFrame blocks only if its slot is still in flight
+    m_SwapChain->Present(1, 0);
+    ++m_FenceValue;
+    m_CommandQueue->Signal(m_Fence.Get(), m_FenceValue);
+    m_Pacer.EndFrame(m_FenceValue);
 }
 
 ComPtr<IDXGIAdapter1> D3D12Renderer::getAdapter(const ComPtr<IDXGIFactory4>& factory)
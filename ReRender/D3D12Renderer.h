@@ -1,17 +1,32 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <d3d12.h>
 #include <dxgi1_4.h>
 #include <wrl/client.h>
 
+#include "D3D12CommandBackend.h"
+#include "D3D12PipelineLibrary.h"
+#include "D3D12RenderGraph.h"
 #include "Debugger.h"
+#include "FramePacer.h"
 #include "Descriptor.h"
+#include "DescriptorAllocator.h"
+#include "GeometryPool.h"
+#include "GpuHeapManager.h"
 #include "MeshBuffer.h"
+#include "Meshlet.h"
+#include "MeshletCuller.h"
+#include "MeshSimplifier.h"
+#include "ParallelPassRecorder.h"
 #include "renderer.h"
+#include "SceneFrame.h"
 #include "ShadowMap.h"
 #include "StagingBuffer.h"
+#include "StagingRing.h"
 #include "Texture.h"
+#include "TransientConstantBuffer.h"
 #include "UploadBuffer.h"
 #include "utils.h"
 
@@ -25,6 +40,17 @@ struct SwapChainBuffer
 };
 
 
+//Root constants of the PBR pass, bindless indices of its textures, see MaterialIndices in shaders/hlsl/pbr.hlsl
+struct PbrMaterialIndices
+{
+    uint32_t Albedo = 0;
+    uint32_t Normal = 0;
+    uint32_t Metalness = 0;
+    uint32_t Roughness = 0;
+    uint32_t Specular = 0;
+    uint32_t SpecularBRDF = 0;
+};
+
 struct FrameBuffer
 {
     ComPtr<ID3D12Resource> ColorTexture;
@@ -34,12 +60,23 @@ struct FrameBuffer
     Descriptor Srv;
     UINT Width, Height;
     UINT Samples;
+
+    //Transients of the frame graph, the textures and views above exist once it is compiled
+    RenderGraphResource Color = InvalidRenderGraphResource;
+    RenderGraphResource DepthStencil = InvalidRenderGraphResource;
+    DXGI_FORMAT ColorFormat = DXGI_FORMAT_UNKNOWN;
+    DXGI_FORMAT DepthStencilFormat = DXGI_FORMAT_UNKNOWN;
 };
 
 
 class D3D12Renderer final : public RendererInterface
 {
 public:
+    //FramesInFlight: 2..FramePacer::MaxFramesInFlight frames the CPU may record ahead of the GPU
+    //bBakeIblOnCpu: Setup bakes the environment maps with IblBaker instead of the compute shaders
+    //ModelFormat: vertex layout of the PBR model, its PBR and shadow pipelines decode VertexFormat::Packed
+    explicit D3D12Renderer(UINT FramesInFlight = 2, bool bBakeIblOnCpu = false, VertexFormat ModelFormat = VertexFormat::Full);
+
     GLFWwindow* initialize(int Width, int Height, int MaxSamples) override;
     void ShutDown() override;
     void Setup(const ViewSettings& view, const SceneSettings& Scene) override;
@@ -50,7 +87,9 @@ public:
 
 
 private:
+    //Declares the targets in the frame graph, CreateFrameBufferViews fills in textures and views after Compile
     FrameBuffer CreateFrameBuffer(
+        const char* Name,
         UINT Width,
         UINT Height,
         UINT Samples,
@@ -58,15 +97,23 @@ private:
         DXGI_FORMAT DepthStencilFormat
     );
 
+    void CreateFrameBufferViews(FrameBuffer& fb);
+
     void ResolveFrameBuffer(
+        ID3D12GraphicsCommandList* CommandList,
         const FrameBuffer& SourceBuffer,
         const FrameBuffer& DestBuffer,
         DXGI_FORMAT Format
     )const;
 
 
+    //Render's passes as a frame graph, each records into a command list of its own on the thread pool
+    void SetupPasses();
+
     void ExecuteCommandList(bool Reset = true)const;
     void WaitForGPU()const;
+    //Blocks until the swap chain takes another frame and the GPU is done with this frame's slot
+    void WaitForFrame();
     void PresentFrame();
 
     static ComPtr<IDXGIAdapter1> getAdapter(const ComPtr<IDXGIFactory4>& factory);
@@ -81,49 +128,87 @@ private:
     DescriptorHeap m_DescHeapDsv;
     DescriptorHeap m_DescHeapCBV_SRV_UAV;
 
-    UploadBuffer m_constantBuffer;
+    //Placed-resource pools for long-lived targets, textures and meshes. Declared before them so it goes last
+    std::unique_ptr<GpuHeapManager> m_HeapManager;
+
+    //Shared vertex/index buffers every scene mesh is suballocated from, compacted a little every frame
+    std::unique_ptr<GeometryPool> m_GeometryPool;
 
-    static const UINT NumFrames = 2;
-    ComPtr<ID3D12CommandAllocator>m_CommandAllocators[NumFrames];
-    SwapChainBuffer m_BackBuffers[NumFrames];
+    //Owns the framebuffer targets and places them in one aliasing region, adds the barriers between passes
+    std::unique_ptr<D3D12RenderGraph> m_FrameGraph;
+    RenderGraphResource m_BackBufferTarget = InvalidRenderGraphResource;
 
-    FrameBuffer m_FrameBuffers[NumFrames];
-    FrameBuffer m_ResolveFrameBuffers[NumFrames];
+    //Back of m_DescHeapCBV_SRV_UAV: individually freed descriptors. The 2D textures and the cubes right after them
+    //are bound as one bindless table, the mipmap SRV/UAVs sit in front of both
+    std::unique_ptr<DescriptorAllocator> m_BindlessTextures;
+    std::unique_ptr<DescriptorAllocator> m_BindlessCubes;
+    std::unique_ptr<DescriptorAllocator> m_MipmapDescriptors;
 
-    ConstantBufferView m_TransformCBVs[NumFrames];
-    ConstantBufferView m_ShadingCBVs[NumFrames];
-    ConstantBufferView m_ShadowMapCBVs[NumFrames];
+    //Per-frame resources are indexed by the pacer's slot m_FrameIndex, back buffers by m_BackBufferIndex
+    const UINT m_NumFrames;
+    FramePacer m_Pacer;
+    std::vector<ComPtr<ID3D12CommandAllocator>> m_CommandAllocators;
+    std::vector<SwapChainBuffer> m_BackBuffers;
+    UINT m_BackBufferIndex = 0;
+    HANDLE m_FrameLatencyWaitable = nullptr;
+
+    //One set shared by every frame in flight, enough because the queue runs the frames in order
+    FrameBuffer m_FrameBuffer;
+    FrameBuffer m_ResolveFrameBuffer;
+
+    //Rewound every frame, the addresses are written in Update and bound as root CBVs in Render
+    std::unique_ptr<TransientConstantBuffer> m_TransientConstants;
+    D3D12_GPU_VIRTUAL_ADDRESS m_TransformConstants = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS m_ShadingConstants = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS m_ShadowMapConstants = 0;
 
     MipMapGeneration m_mipmapGeneration;
 
     MeshBuffer m_PbrModel;
     MeshBuffer m_SkyBox;
 
+    //Culled every frame by m_SceneFrame in Update
+    MeshletData m_PbrMeshlets;
+    SceneFrame m_SceneFrame;
+
     Texture m_AlbedoTexture;
     Texture m_NormalTexture;
     Texture m_MetalnessTexture;
     Texture m_RoughnessTexture;
 
     Texture m_EnvTexture;
-    Texture m_IrMapTexture;
     Texture m_spBRDF_LUT;
+    const bool m_bBakeIblOnCpu;
+    const VertexFormat m_ModelFormat;
+
+    PbrMaterialIndices m_PbrMaterial;
+
+    //Every PSO is built on the thread pool during Setup, the passes fetch them by handle
+    std::unique_ptr<D3D12PipelineLibrary> m_Pipelines;
 
     ComPtr<ID3D12RootSignature> m_ToneMapRootSignature;
-    ComPtr<ID3D12PipelineState>m_ToneMapPipelineState;
+    PipelineHandle m_ToneMapPipeline = InvalidPipeline;
 
     ComPtr<ID3D12RootSignature> m_PbrRootSignature;
-    ComPtr<ID3D12PipelineState>m_PbrPipelineState;
+    PipelineHandle m_PbrPipeline = InvalidPipeline;
 
     ComPtr<ID3D12RootSignature> m_SkyBoxRootSignature;
-    ComPtr<ID3D12PipelineState> m_SkyBoxPipelineState;
+    PipelineHandle m_SkyBoxPipeline = InvalidPipeline;
 
     std::unique_ptr<ShadowMap> m_ShadowMap;
     std::unique_ptr<Debugger> m_Debugger;
 
-    UINT m_FrameIndex;
+    std::unique_ptr<D3D12CommandBackend> m_PassBackend;
+    std::unique_ptr<ParallelPassRecorder> m_Passes;
+
+    //Persistently mapped staging memory for every upload, reclaimed by fence
+    std::unique_ptr<StagingRing> m_StagingRing;
+
+    UINT m_FrameIndex = 0;
     ComPtr<ID3D12Fence> m_Fence;
     HANDLE m_FenceCompletionEvent;
-    mutable UINT64 m_FenceValue[NumFrames] = {};
+    //Last value signaled on m_Fence, frames and setup uploads share it
+    mutable UINT64 m_FenceValue = 0;
 
     D3D_ROOT_SIGNATURE_VERSION m_RootSignatureVersion;
 
@@ -0,0 +1,48 @@
+#include "D3D12UploadQueue.h"
+
+#include <stdexcept>
+
+D3D12UploadQueue::D3D12UploadQueue(
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> CommandQueue,
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList,
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CommandAllocator,
+    Microsoft::WRL::ComPtr<ID3D12Fence> Fence,
+    UINT64& FenceValue,
+    HANDLE FenceEvent)
+    :m_CommandQueue(CommandQueue)
+    ,m_CommandList(CommandList)
+    ,m_CommandAllocator(CommandAllocator)
+    ,m_Fence(Fence)
+    ,m_FenceValue(FenceValue)
+    ,m_FenceEvent(FenceEvent)
+{}
+
+uint64_t D3D12UploadQueue::Submit()
+{
+    if (FAILED(m_CommandList->Close()))
+    {
+        throw std::runtime_error("Failed close command list (validation error or not in recording state)");
+    }
+
+    ID3D12CommandList* Lists[] = { m_CommandList.Get() };
+    m_CommandQueue->ExecuteCommandLists(1, Lists);
+    m_CommandList->Reset(m_CommandAllocator.Get(), nullptr);
+
+    ++m_FenceValue;
+    m_CommandQueue->Signal(m_Fence.Get(), m_FenceValue);
+    return m_FenceValue;
+}
+
+uint64_t D3D12UploadQueue::CompletedValue() const
+{
+    return m_Fence->GetCompletedValue();
+}
+
+void D3D12UploadQueue::Wait(uint64_t FenceValue)
+{
+    if (m_Fence->GetCompletedValue() < FenceValue)
+    {
+        m_Fence->SetEventOnCompletion(FenceValue, m_FenceEvent);
+        WaitForSingleObject(m_FenceEvent, INFINITE);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+
+#include "UploadBatch.h"
+
+// Submits the renderer's command list on its direct queue and signals the shared frame fence.
+// The list is reset on the same allocator right away, so recording can continue while the GPU copies.
+class D3D12UploadQueue : public UploadQueue
+{
+public:
+    D3D12UploadQueue(
+        Microsoft::WRL::ComPtr<ID3D12CommandQueue> CommandQueue,
+        Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList,
+        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CommandAllocator,
+        Microsoft::WRL::ComPtr<ID3D12Fence> Fence,
+        UINT64& FenceValue,
+        HANDLE FenceEvent);
+
+    uint64_t Submit() override;
+    uint64_t CompletedValue() const override;
+    void Wait(uint64_t FenceValue) override;
+
+private:
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CommandQueue;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_CommandAllocator;
+    Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+    UINT64& m_FenceValue;
+    HANDLE m_FenceEvent;
+};
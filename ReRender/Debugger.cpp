@@ -1,44 +1,35 @@
 #include "Debugger.h"
 
+#include "D3D12CommandBackend.h"
 #include "Shader.h"
 
 Debugger::Debugger(
-    std::function<void()> CallBack,
+    UploadBatch& Batch,
     ComPtr<ID3D12Device> Device,
     ComPtr<ID3D12GraphicsCommandList> CommandList,
     const std::vector<D3D12_INPUT_ELEMENT_DESC> Layout,
     CD3DX12_STATIC_SAMPLER_DESC& DefaultSamplerDesc,
     D3D_ROOT_SIGNATURE_VERSION& RootSignatureVersion,
+    D3D12PipelineLibrary& Pipelines,
     UINT SampleCount,
     Texture& InDebugTexture,
     float x, float y, float w, float h, float depth):
     m_Device(Device),
     m_DefaultSamplerDesc(DefaultSamplerDesc),
     m_RootSignatureVersion(RootSignatureVersion),
+    m_Pipelines(Pipelines),
     m_CommandList(CommandList),
     DebugTexture(InDebugTexture)
 {
     //MeshBuffer
     {
         MeshData quad = GeometryGenerator::CreateQuad(0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
-        QuadBuffer = MeshBuffer::CreateMeshBuffer(CallBack, m_CommandList, m_Device, quad);
+        QuadBuffer = MeshBuffer::CreateMeshBuffer(Batch, m_CommandList, m_Device, quad);
         SetDebugName(QuadBuffer.VertexBuffer.Get(),QuadBuffer)
     }
 
     //ShadowMapĸǩPSO
     {
-        ComPtr<ID3DBlob> DebugVS = Shader::compileShader(
-            "shaders/hlsl/debug.hlsl",
-            "main_vs",
-            "vs_5_0"
-        );
-
-        ComPtr<ID3DBlob> DebugPS = Shader::compileShader(
-            "shaders/hlsl/debug.hlsl",
-            "main_ps",
-            "ps_5_0"
-        );
-
         const CD3DX12_DESCRIPTOR_RANGE1 DescriptorRanges[] =
         {
             {
@@ -56,11 +47,14 @@ Debugger::Debugger(
 
         m_DebugRootSignature = RootSignature::CreateRootSignature(m_Device, m_RootSignatureVersion, SignatureDesc);
 
-        D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-        psoDesc.pRootSignature = m_DebugRootSignature.Get();
-        psoDesc.InputLayout = { Layout.data(), (UINT)Layout.size() };
-        psoDesc.VS = CD3DX12_SHADER_BYTECODE(DebugVS.Get());
-        psoDesc.PS = CD3DX12_SHADER_BYTECODE(DebugPS.Get());
+        GraphicsPipelineDesc Pipeline;
+        Pipeline.Name = "m_DebugPSO";
+        Pipeline.RootSignature = m_DebugRootSignature;
+        Pipeline.VS = Shader::Request("shaders/hlsl/debug.hlsl", "main_vs", "vs_5_0");
+        Pipeline.PS = Shader::Request("shaders/hlsl/debug.hlsl", "main_ps", "ps_5_0");
+        Pipeline.InputLayout = Layout;
+
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc = Pipeline.Desc;
         psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
         psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
         psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
@@ -72,24 +66,22 @@ Debugger::Debugger(
         psoDesc.SampleMask = UINT_MAX;
         psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 
-        if (FAILED(m_Device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_DebugPso)))) {
-            throw std::runtime_error("Failed to create graphics pipeline state for Debbuger");
-        }
+        m_DebugPipeline = m_Pipelines.AddGraphics(std::move(Pipeline));
     }
 
     Re::SetName(m_DebugRootSignature.Get(), std::string("DebugSignature").c_str());
-    Re::SetName(m_DebugPso.Get(), std::string("m_DebugPSO").c_str());
 
 }
 
-void Debugger::Draw()
+void Debugger::Draw(CommandContext& Context)
 {
-    m_CommandList->SetGraphicsRootSignature(m_DebugRootSignature.Get());
-    m_CommandList->SetGraphicsRootDescriptorTable(0, DebugTexture.Srv.GpuHandle);
-    m_CommandList->SetPipelineState(m_DebugPso.Get());
-    m_CommandList->IASetVertexBuffers(0, 1, &QuadBuffer.Vbv);
-    m_CommandList->IASetIndexBuffer(&QuadBuffer.Ibv);
+    ID3D12GraphicsCommandList* CommandList = D3D12CommandContext::Native(Context);
+    CommandList->SetGraphicsRootSignature(m_DebugRootSignature.Get());
+    CommandList->SetGraphicsRootDescriptorTable(0, DebugTexture.Srv.GpuHandle);
+    CommandList->SetPipelineState(m_Pipelines.Get(m_DebugPipeline));
+    CommandList->IASetVertexBuffers(0, 1, &QuadBuffer.Vbv);
+    CommandList->IASetIndexBuffer(&QuadBuffer.Ibv);
 
-    m_CommandList->DrawIndexedInstanced(QuadBuffer.NumElements, 1, 0, 0, 0);
+    QuadBuffer.DrawSubMeshes(Context);
 
 }
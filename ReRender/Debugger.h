@@ -1,7 +1,9 @@
 #pragma once
+#include "D3D12PipelineLibrary.h"
 #include "GeometryGenerator.h"
 #include "MeshBuffer.h"
 #include "RootSignature.h"
+#include "UploadBatch.h"
 #include <functional>
 
 
@@ -10,28 +12,31 @@ class Debugger
 public:
     MeshBuffer QuadBuffer;
     ComPtr<ID3D12RootSignature> m_DebugRootSignature;
-    ComPtr<ID3D12PipelineState> m_DebugPso;
+    D3D12PipelineLibrary& m_Pipelines;
+    PipelineHandle m_DebugPipeline = InvalidPipeline;
     ComPtr<ID3D12GraphicsCommandList> m_CommandList;
 
     ComPtr<ID3D12Device> m_Device;
     CD3DX12_STATIC_SAMPLER_DESC& m_DefaultSamplerDesc;
     D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion;
-    std::function<void()> m_CallBack;
 
     Texture& DebugTexture;
 
+    //The quad is recorded into Batch, the caller submits it
     Debugger(
-        std::function<void()> m_CallBack,
+        UploadBatch& Batch,
         ComPtr<ID3D12Device> Device, 
         ComPtr<ID3D12GraphicsCommandList> CommandList, const std::vector<D3D12_INPUT_ELEMENT_DESC> Layout,
         CD3DX12_STATIC_SAMPLER_DESC& DefaultSamplerDesc,
         D3D_ROOT_SIGNATURE_VERSION& RootSignatureVersion, 
+        D3D12PipelineLibrary& Pipelines,
         UINT SampleCount,
         Texture& DebugTexture,
         float x,float y , float w,float h,float depth
     );
 
-    void Draw();
+    //Context has to be a D3D12CommandContext
+    void Draw(CommandContext& Context);
 
 };
 
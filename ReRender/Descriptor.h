@@ -25,6 +25,15 @@ struct DescriptorHeap
         return (*this)[NumDescriptorsAllocated++];
     }
 
+    //Hands the last Count descriptors to someone else, e.g. a DescriptorAllocator. Returns the first of them,
+    //Alloc and DescriptorHeapMark keep working on the rest
+    UINT ReserveBack(UINT Count)
+    {
+        assert(NumDescriptorsAllocated + Count <= NumDescriptorsInHeap);
+        NumDescriptorsInHeap -= Count;
+        return NumDescriptorsInHeap;
+    }
+
     Descriptor operator[](UINT Index) const
     {
         assert(Index < NumDescriptorsInHeap);
@@ -0,0 +1,72 @@
+#include "DescriptorAllocator.h"
+
+#include <cassert>
+#include <stdexcept>
+
+DescriptorAllocator::DescriptorAllocator(DescriptorHeap& InHeap, UINT Count)
+    :m_Heap(InHeap)
+    ,m_Indices(Count)
+{
+    // Not through operator[], the reserved range lies past the heap's new end.
+    const UINT First = m_Heap.ReserveBack(Count);
+    m_TableStart.CpuHandle.ptr = m_Heap.Heap->GetCPUDescriptorHandleForHeapStart().ptr + SIZE_T(First) * m_Heap.DescriptorSize;
+    m_TableStart.GpuHandle.ptr = m_Heap.Heap->GetGPUDescriptorHandleForHeapStart().ptr + UINT64(First) * m_Heap.DescriptorSize;
+}
+
+DescriptorAllocator::DescriptorAllocator(Microsoft::WRL::ComPtr<ID3D12Device> Device, DescriptorHeap& InHeap, UINT First, UINT Count,
+    D3D12_SRV_DIMENSION NullDimension)
+    :m_Heap(InHeap)
+    ,m_Device(Device)
+    ,m_NullDimension(NullDimension)
+    ,m_Indices(Count)
+{
+    m_TableStart.CpuHandle.ptr = m_Heap.Heap->GetCPUDescriptorHandleForHeapStart().ptr + SIZE_T(First) * m_Heap.DescriptorSize;
+    m_TableStart.GpuHandle.ptr = m_Heap.Heap->GetGPUDescriptorHandleForHeapStart().ptr + UINT64(First) * m_Heap.DescriptorSize;
+
+    for (UINT Index = 0; Index < Count; ++Index)
+    {
+        WriteNullView(Index);
+    }
+    m_Indices.SetRecycleCallback([this](uint32_t Index) { WriteNullView(Index); });
+}
+
+DescriptorHandle DescriptorAllocator::Allocate()
+{
+    const DescriptorHandle Handle = m_Indices.Allocate();
+    if (!Handle.IsValid())
+    {
+        throw std::runtime_error("Out of descriptors in the bindless range");
+    }
+    return Handle;
+}
+
+Descriptor DescriptorAllocator::operator[](DescriptorHandle Handle) const
+{
+    assert(m_Indices.IsCurrent(Handle) && "Stale descriptor handle");
+    return {
+        D3D12_CPU_DESCRIPTOR_HANDLE{ m_TableStart.CpuHandle.ptr + SIZE_T(Handle.Index) * m_Heap.DescriptorSize },
+        D3D12_GPU_DESCRIPTOR_HANDLE{ m_TableStart.GpuHandle.ptr + UINT64(Handle.Index) * m_Heap.DescriptorSize }
+    };
+}
+
+void DescriptorAllocator::WriteNullView(uint32_t Index) const
+{
+    D3D12_SHADER_RESOURCE_VIEW_DESC Desc = {};
+    Desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    Desc.ViewDimension = m_NullDimension;
+    Desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    switch (m_NullDimension)
+    {
+    case D3D12_SRV_DIMENSION_TEXTURE2D:
+        Desc.Texture2D.MipLevels = 1;
+        break;
+    case D3D12_SRV_DIMENSION_TEXTURECUBE:
+        Desc.TextureCube.MipLevels = 1;
+        break;
+    default:
+        assert(0 && "No null view for this dimension");
+    }
+
+    const D3D12_CPU_DESCRIPTOR_HANDLE Handle{ m_TableStart.CpuHandle.ptr + SIZE_T(Index) * m_Heap.DescriptorSize };
+    m_Device->CreateShaderResourceView(nullptr, &Desc, Handle);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include "Descriptor.h"
+#include "DescriptorIndexAllocator.h"
+
+// Individually freed descriptors in the back of a shader-visible heap. Handles double as bindless indices:
+// a root table set to TableStart() sees descriptor Handle.Index at position Handle.Index, so shaders can
+// index textures by an integer instead of needing their descriptors next to each other.
+class DescriptorAllocator
+{
+public:
+    // Takes the last Count descriptors of Heap, its Alloc and DescriptorHeapMark keep the front.
+    DescriptorAllocator(DescriptorHeap& InHeap, UINT Count);
+
+    // Bindless range of one dimension over descriptors First..First + Count of Heap, which the caller reserved.
+    // Resource binding tier 1 needs every descriptor of a bound table initialized, so each slot without a view
+    // holds a null SRV of NullDimension: all of them up front, freed ones at once and retired ones on Reclaim.
+    DescriptorAllocator(Microsoft::WRL::ComPtr<ID3D12Device> Device, DescriptorHeap& InHeap, UINT First, UINT Count,
+        D3D12_SRV_DIMENSION NullDimension);
+
+    // Lock-free, throws when every descriptor is taken or waiting for a fence.
+    DescriptorHandle Allocate();
+
+    // Asserts that Handle is still current, i.e. was not freed or retired since.
+    Descriptor operator[](DescriptorHandle Handle) const;
+
+    // For descriptors no submitted work can reference.
+    void Free(DescriptorHandle Handle) { m_Indices.Free(Handle); }
+
+    // For descriptors the GPU may still read, reused after the fence of the next Close.
+    void Retire(DescriptorHandle Handle) { m_Indices.Retire(Handle); }
+
+    void Close(uint64_t FenceValue) { m_Indices.Close(FenceValue); }
+    void Reclaim(uint64_t CompletedValue) { m_Indices.Reclaim(CompletedValue); }
+    void Attach(UploadBatch& Batch) { m_Indices.Attach(Batch); }
+
+    bool IsCurrent(DescriptorHandle Handle) const { return m_Indices.IsCurrent(Handle); }
+    UINT Capacity() const { return m_Indices.Capacity(); }
+    UINT NumFree() const { return m_Indices.NumFree(); }
+
+    // The only dimension the views may have, UNKNOWN if the range is not bound as one.
+    D3D12_SRV_DIMENSION Dimension() const { return m_NullDimension; }
+
+    // The heap the descriptors live in, also the one to bind with SetDescriptorHeaps.
+    DescriptorHeap& Heap() const { return m_Heap; }
+
+    // Start of the bindless table, descriptor Handle.Index is at this plus Handle.Index descriptors.
+    D3D12_GPU_DESCRIPTOR_HANDLE TableStart() const { return m_TableStart.GpuHandle; }
+
+    void PrintStats(const char* Name) const { m_Indices.PrintStats(Name); }
+
+private:
+    void WriteNullView(uint32_t Index) const;
+
+    DescriptorHeap& m_Heap;
+    Descriptor m_TableStart;
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+    D3D12_SRV_DIMENSION m_NullDimension = D3D12_SRV_DIMENSION_UNKNOWN;
+    DescriptorIndexAllocator m_Indices;
+};
@@ -0,0 +1,450 @@
+#include "DescriptorIndexAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "PortableUtils.h"
+#include "UploadBatch.h"
+
+namespace
+{
+    uint64_t PackHead(uint64_t Tag, uint32_t Index)
+    {
+        return (Tag << 32) | Index;
+    }
+
+    // The baseline the lock-free list is measured against.
+    class MutexFreeList
+    {
+    public:
+        explicit MutexFreeList(uint32_t Capacity)
+        {
+            for (uint32_t Index = Capacity; Index-- > 0;)
+            {
+                m_Free.push_back(Index);
+            }
+        }
+
+        uint32_t Allocate()
+        {
+            std::lock_guard<std::mutex> Lock{ m_Mutex };
+            if (m_Free.empty())
+            {
+                return DescriptorHandle::InvalidIndex;
+            }
+            const uint32_t Index = m_Free.back();
+            m_Free.pop_back();
+            return Index;
+        }
+
+        void Free(uint32_t Index)
+        {
+            std::lock_guard<std::mutex> Lock{ m_Mutex };
+            m_Free.push_back(Index);
+        }
+
+    private:
+        std::mutex m_Mutex;
+        std::vector<uint32_t> m_Free;
+    };
+
+    // Each thread keeps up to Held slots and randomly allocates or frees one per iteration.
+    template<typename AllocateFunc, typename FreeFunc>
+    double RunThreads(int Threads, int Iterations, size_t Held, AllocateFunc&& Allocate, FreeFunc&& Free)
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> Workers;
+        for (int Thread = 0; Thread < Threads; ++Thread)
+        {
+            Workers.emplace_back([&, Thread]()
+            {
+                std::mt19937 Random{ static_cast<uint32_t>(Thread + 1) };
+                std::vector<DescriptorHandle> Owned;
+                Owned.reserve(Held);
+                for (int Iteration = 0; Iteration < Iterations; ++Iteration)
+                {
+                    const bool bAllocate = Owned.empty() || (Owned.size() < Held && (Random() & 1));
+                    if (bAllocate)
+                    {
+                        const DescriptorHandle Handle = Allocate(Thread);
+                        if (Handle.IsValid())
+                        {
+                            Owned.push_back(Handle);
+                        }
+                    }
+                    else
+                    {
+                        const size_t Victim = Random() % Owned.size();
+                        Free(Thread, Owned[Victim]);
+                        Owned[Victim] = Owned.back();
+                        Owned.pop_back();
+                    }
+                }
+                for (const DescriptorHandle& Handle : Owned)
+                {
+                    Free(Thread, Handle);
+                }
+            });
+        }
+        for (std::thread& Worker : Workers)
+        {
+            Worker.join();
+        }
+        return ElapsedMs(Start);
+    }
+}
+
+DescriptorIndexAllocator::DescriptorIndexAllocator(uint32_t InCapacity)
+    :m_Capacity(InCapacity)
+    ,m_Next(new std::atomic<uint32_t>[InCapacity])
+    ,m_Generations(new std::atomic<uint32_t>[InCapacity])
+    ,m_Head(PackHead(0, 0))
+{
+    if (InCapacity == 0 || InCapacity == NoIndex)
+    {
+        throw std::invalid_argument("Descriptor allocator capacity out of range");
+    }
+
+    // Lowest indices on top, so a fresh allocator hands them out in order.
+    for (uint32_t Index = 0; Index < m_Capacity; ++Index)
+    {
+        m_Next[Index].store(Index + 1 < m_Capacity ? Index + 1 : NoIndex, std::memory_order_relaxed);
+        m_Generations[Index].store(0, std::memory_order_relaxed);
+    }
+}
+
+DescriptorHandle DescriptorIndexAllocator::Allocate()
+{
+    uint64_t Head = m_Head.load(std::memory_order_acquire);
+    for (;;)
+    {
+        const uint32_t Index = static_cast<uint32_t>(Head);
+        if (Index == NoIndex)
+        {
+            m_Failures.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+
+        // May read the link of a slot another thread just popped, the tag makes that compare_exchange fail.
+        const uint32_t Next = m_Next[Index].load(std::memory_order_relaxed);
+        if (m_Head.compare_exchange_weak(Head, PackHead((Head >> 32) + 1, Next), std::memory_order_acquire, std::memory_order_acquire))
+        {
+            break;
+        }
+    }
+
+    const uint32_t Index = static_cast<uint32_t>(Head);
+    const size_t Allocated = m_NumAllocated.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t Peak = m_PeakAllocated.load(std::memory_order_relaxed);
+    while (Allocated > Peak && !m_PeakAllocated.compare_exchange_weak(Peak, Allocated, std::memory_order_relaxed))
+    {
+    }
+
+    return { Index, m_Generations[Index].load(std::memory_order_relaxed) };
+}
+
+void DescriptorIndexAllocator::Free(DescriptorHandle Handle)
+{
+    Invalidate(Handle);
+    if (m_OnRecycle)
+    {
+        m_OnRecycle(Handle.Index);
+    }
+    m_NumAllocated.fetch_sub(1, std::memory_order_relaxed);
+    Push(Handle.Index);
+}
+
+void DescriptorIndexAllocator::Retire(DescriptorHandle Handle)
+{
+    Invalidate(Handle);
+
+    std::lock_guard<std::mutex> Lock{ m_RetireMutex };
+    m_NumAllocated.fetch_sub(1, std::memory_order_relaxed);
+    m_Open.push_back(Handle.Index);
+    ++m_NumRetired;
+    ++m_Retired;
+}
+
+void DescriptorIndexAllocator::Close(uint64_t FenceValue)
+{
+    std::lock_guard<std::mutex> Lock{ m_RetireMutex };
+    assert(FenceValue >= m_LastFenceValue && "Fence values must not decrease");
+    m_LastFenceValue = FenceValue;
+
+    if (m_Open.empty())
+    {
+        return;
+    }
+    if (!m_Closed.empty() && m_Closed.back().FenceValue == FenceValue)
+    {
+        m_Closed.back().Indices.insert(m_Closed.back().Indices.end(), m_Open.begin(), m_Open.end());
+        m_Open.clear();
+        return;
+    }
+    m_Closed.push_back({ FenceValue, std::move(m_Open) });
+    m_Open.clear();
+}
+
+void DescriptorIndexAllocator::Reclaim(uint64_t CompletedValue)
+{
+    std::lock_guard<std::mutex> Lock{ m_RetireMutex };
+    while (!m_Closed.empty() && m_Closed.front().FenceValue <= CompletedValue)
+    {
+        for (uint32_t Index : m_Closed.front().Indices)
+        {
+            if (m_OnRecycle)
+            {
+                m_OnRecycle(Index);
+            }
+            Push(Index);
+        }
+        m_NumRetired -= static_cast<uint32_t>(m_Closed.front().Indices.size());
+        m_Closed.pop_front();
+    }
+}
+
+void DescriptorIndexAllocator::Attach(UploadBatch& Batch)
+{
+    Batch.OnSubmit([this](uint64_t FenceValue) { Close(FenceValue); });
+
+    UploadQueue& Queue = Batch.Queue();
+    Batch.OnIdle([this, &Queue]() { Reclaim(Queue.CompletedValue()); });
+}
+
+bool DescriptorIndexAllocator::IsCurrent(DescriptorHandle Handle) const
+{
+    return Handle.Index < m_Capacity && m_Generations[Handle.Index].load(std::memory_order_acquire) == Handle.Generation;
+}
+
+uint32_t DescriptorIndexAllocator::NumRetired() const
+{
+    std::lock_guard<std::mutex> Lock{ m_RetireMutex };
+    return m_NumRetired;
+}
+
+DescriptorIndexAllocatorStats DescriptorIndexAllocator::Stats() const
+{
+    DescriptorIndexAllocatorStats Result;
+    Result.PeakAllocated = m_PeakAllocated.load(std::memory_order_relaxed);
+    Result.Failures = m_Failures.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> Lock{ m_RetireMutex };
+    Result.Retired = m_Retired;
+    return Result;
+}
+
+void DescriptorIndexAllocator::Invalidate(DescriptorHandle Handle)
+{
+    if (Handle.Index >= m_Capacity)
+    {
+        throw std::runtime_error("Descriptor handle out of range");
+    }
+
+    // Two threads freeing the same handle: only one of them gets past this.
+    uint32_t Expected = Handle.Generation;
+    if (!m_Generations[Handle.Index].compare_exchange_strong(Expected, Handle.Generation + 1, std::memory_order_acq_rel))
+    {
+        throw std::runtime_error("Stale descriptor handle freed, the slot was already freed or reused");
+    }
+}
+
+void DescriptorIndexAllocator::Push(uint32_t Index)
+{
+    uint64_t Head = m_Head.load(std::memory_order_relaxed);
+    do
+    {
+        m_Next[Index].store(static_cast<uint32_t>(Head), std::memory_order_relaxed);
+    } while (!m_Head.compare_exchange_weak(Head, PackHead((Head >> 32) + 1, Index), std::memory_order_release, std::memory_order_relaxed));
+}
+
+void DescriptorIndexAllocator::PrintStats(const char* Name) const
+{
+    const DescriptorIndexAllocatorStats Current = Stats();
+    std::printf("Descriptor allocator: %s (%u descriptors)\n", Name, m_Capacity);
+    std::printf("  Retired       : %zu, %u still waiting for a fence\n", Current.Retired, NumRetired());
+    std::printf("  Peak allocated: %zu, %u now, %zu failed allocations\n", Current.PeakAllocated, NumAllocated(), Current.Failures);
+}
+
+bool DescriptorIndexAllocator::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Descriptor allocator self test\n");
+
+    const auto Throws = [](const std::function<void()>& Body)
+    {
+        try
+        {
+            Body();
+        }
+        catch (const std::exception&)
+        {
+            return true;
+        }
+        return false;
+    };
+
+    Harness.Run("Generations and stale handles", [&]()
+    {
+        const uint32_t Capacity = 8;
+        DescriptorIndexAllocator Allocator{ Capacity };
+        std::vector<DescriptorHandle> Handles;
+        bool bInOrder = true;
+        for (uint32_t i = 0; i < Capacity; ++i)
+        {
+            Handles.push_back(Allocator.Allocate());
+            bInOrder &= Handles.back().Index == i && Allocator.IsCurrent(Handles.back());
+        }
+        Harness.Check(bInOrder, "a fresh allocator hands out current indices in order");
+        Harness.Check(!Allocator.Allocate().IsValid() && Allocator.Stats().Failures == 1, "nothing is allocated past capacity");
+
+        Allocator.Free(Handles[0]);
+        Harness.Check(!Allocator.IsCurrent(Handles[0]), "a freed handle is stale");
+        Harness.Check(Throws([&]() { Allocator.Free(Handles[0]); }), "a double free throws");
+
+        const DescriptorHandle Reused = Allocator.Allocate();
+        Harness.Check(Reused.Index == Handles[0].Index && Reused.Generation != Handles[0].Generation && Allocator.IsCurrent(Reused),
+            "a reused slot gets a new generation");
+        Harness.Check(!Allocator.IsCurrent(Handles[0]), "the old handle stays stale after its slot is reused");
+        Harness.Check(Throws([&]() { Allocator.Free(Handles[0]); }) && Throws([&]() { Allocator.Retire(Handles[0]); }),
+            "freeing or retiring the old handle throws");
+        Harness.Check(Allocator.IsCurrent(Reused) && Allocator.NumAllocated() == Capacity, "the failed calls leave the new owner alone");
+        Harness.Check(!Allocator.IsCurrent(DescriptorHandle{}), "the invalid handle is never current");
+    });
+
+    Harness.Run("Fenced reuse", [&]()
+    {
+        DescriptorIndexAllocator Allocator{ 2 };
+        const DescriptorHandle First = Allocator.Allocate();
+        Allocator.Allocate();
+
+        Allocator.Retire(First);
+        Harness.Check(!Allocator.IsCurrent(First) && Throws([&]() { Allocator.Retire(First); }), "a retired handle is stale at once");
+        Allocator.Reclaim(~uint64_t(0));
+        Harness.Check(!Allocator.Allocate().IsValid(), "a retired index is not reused before Close");
+        Allocator.Close(5);
+        Allocator.Reclaim(4);
+        Harness.Check(!Allocator.Allocate().IsValid() && Allocator.NumRetired() == 1, "a retired index is not reused before its fence passes");
+        Allocator.Reclaim(5);
+        const DescriptorHandle Reclaimed = Allocator.Allocate();
+        Harness.Check(Reclaimed.Index == First.Index && Reclaimed.Generation != First.Generation && Allocator.NumRetired() == 0,
+            "the index returns with a new generation once its fence passes");
+    });
+
+    // The callback has to see each index before it can be handed out again, and never while the GPU may read it
+    Harness.Run("Recycle callback", [&]()
+    {
+        // Both slots stay taken, so an Allocate from inside the callback only succeeds if the index is already back
+        DescriptorIndexAllocator Allocator{ 2 };
+        std::vector<uint32_t> Recycled;
+        bool bAllocatableWhenRecycled = false;
+        Allocator.SetRecycleCallback([&](uint32_t Index)
+        {
+            Recycled.push_back(Index);
+            bAllocatableWhenRecycled |= Allocator.Allocate().IsValid();
+        });
+        const DescriptorHandle Freed = Allocator.Allocate();
+        const DescriptorHandle Retired = Allocator.Allocate();
+
+        Allocator.Free(Freed);
+        Harness.Check(Recycled == std::vector<uint32_t>{ Freed.Index }, "Free recycles the index at once");
+        Allocator.Allocate();
+        Allocator.Retire(Retired);
+        Allocator.Close(3);
+        Allocator.Reclaim(2);
+        Harness.Check(Recycled.size() == 1, "a retired index is not recycled before its fence passes");
+        Allocator.Reclaim(3);
+        Harness.Check(Recycled == std::vector<uint32_t>{ Freed.Index, Retired.Index }, "Reclaim recycles the index once its fence passes");
+        Harness.Check(!bAllocatableWhenRecycled, "the callback runs before the index is back on the free list");
+    });
+
+    // Every slot has an owner tag that must be free when handed out and ours when freed.
+    Harness.Run("Concurrent allocate and free", [&]()
+    {
+        const int Threads = 4;
+        const size_t Held = 64;
+        const uint32_t Capacity = static_cast<uint32_t>(Threads * Held / 2 + 1);
+        DescriptorIndexAllocator Allocator{ Capacity };
+        std::unique_ptr<std::atomic<uint32_t>[]> Owners{ new std::atomic<uint32_t>[Capacity] };
+        for (uint32_t i = 0; i < Capacity; ++i)
+        {
+            Owners[i].store(0);
+        }
+        std::atomic<size_t> Conflicts{ 0 };
+
+        RunThreads(Threads, 20000, Held,
+            [&](int Thread)
+            {
+                const DescriptorHandle Handle = Allocator.Allocate();
+                if (Handle.IsValid() && Owners[Handle.Index].exchange(uint32_t(Thread + 1)) != 0)
+                {
+                    Conflicts.fetch_add(1);
+                }
+                return Handle;
+            },
+            [&](int Thread, DescriptorHandle Handle)
+            {
+                if (Owners[Handle.Index].exchange(0) != uint32_t(Thread + 1))
+                {
+                    Conflicts.fetch_add(1);
+                }
+                Allocator.Free(Handle);
+            });
+        Harness.Check(Conflicts.load() == 0, "no two threads own the same descriptor");
+
+        // Afterwards the list must still hold every index exactly once.
+        std::vector<bool> Seen(Capacity, false);
+        bool bComplete = true;
+        for (uint32_t i = 0; i < Capacity && bComplete; ++i)
+        {
+            const DescriptorHandle Handle = Allocator.Allocate();
+            bComplete = Handle.IsValid() && !Seen[Handle.Index];
+            Seen[Handle.IsValid() ? Handle.Index : 0] = true;
+        }
+        Harness.Check(bComplete, "the free list loses and duplicates no index under contention");
+        Harness.Check(Allocator.NumAllocated() == Capacity && !Allocator.Allocate().IsValid(), "the allocation count does not drift");
+    });
+
+    return Harness.Finish();
+}
+
+void DescriptorIndexAllocator::Benchmark(int Threads, int Iterations)
+{
+    Threads = std::max(Threads, 1);
+    Iterations = std::max(Iterations, 1);
+
+    // The workload of the self test's contention case without the owner tags, against a mutex protected free list.
+    const size_t Held = 64;
+    const uint32_t Capacity = static_cast<uint32_t>(Threads * Held / 2 + 1);
+    double LockFreeMs = 0.0;
+    {
+        DescriptorIndexAllocator Allocator{ Capacity };
+        LockFreeMs = RunThreads(Threads, Iterations, Held,
+            [&](int) { return Allocator.Allocate(); },
+            [&](int, DescriptorHandle Handle) { Allocator.Free(Handle); });
+    }
+
+    double MutexMs = 0.0;
+    {
+        MutexFreeList Baseline{ Capacity };
+        MutexMs = RunThreads(Threads, Iterations, Held,
+            [&](int)
+            {
+                DescriptorHandle Handle;
+                Handle.Index = Baseline.Allocate();
+                return Handle;
+            },
+            [&](int, DescriptorHandle Handle) { Baseline.Free(Handle.Index); });
+    }
+
+    const double Calls = double(Threads) * Iterations;
+    std::printf("Descriptor allocator benchmark: %d threads, %d calls each, %u descriptors\n", Threads, Iterations, Capacity);
+    std::printf("  Lock-free     : %8.2f ms, %.1f ns per call\n", LockFreeMs, LockFreeMs * 1e6 / Calls);
+    std::printf("  Mutex baseline: %8.2f ms, %.1f ns per call\n", MutexMs, MutexMs * 1e6 / Calls);
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class UploadBatch;
+
+// Slot of a DescriptorIndexAllocator. The generation changes every time the slot is freed, so a handle that
+// outlived its descriptor no longer matches and IsCurrent catches the stale use.
+struct DescriptorHandle
+{
+    static constexpr uint32_t InvalidIndex = ~uint32_t(0);
+
+    uint32_t Index = InvalidIndex;
+    uint32_t Generation = 0;
+
+    bool IsValid() const { return Index != InvalidIndex; }
+};
+
+struct DescriptorIndexAllocatorStats
+{
+    size_t Retired = 0;
+    size_t PeakAllocated = 0;
+    size_t Failures = 0;
+};
+
+// Free list of descriptor indices. Allocate and Free are lock-free and safe from any thread, e.g. asset workers
+// creating views. Indices the GPU may still read go through Retire instead: they are tagged with the fence of the
+// next Close and only return to the free list once Reclaim sees that fence pass. Only indices are handed out,
+// so the core runs without a device.
+class DescriptorIndexAllocator
+{
+public:
+    explicit DescriptorIndexAllocator(uint32_t InCapacity);
+
+    // Invalid handle when every index is allocated or still retired.
+    DescriptorHandle Allocate();
+
+    // Back to the free list at once, only for descriptors no submitted work can reference.
+    // Throws if Handle is stale, i.e. freed or retired before.
+    void Free(DescriptorHandle Handle);
+
+    // Stale right away, reusable after the fence of the next Close has passed. Throws if Handle is stale.
+    void Retire(DescriptorHandle Handle);
+
+    // Tags everything retired since the last Close with FenceValue. Fence values must not decrease.
+    void Close(uint64_t FenceValue);
+
+    // Returns the indices of every closed fence value <= CompletedValue to the free list.
+    void Reclaim(uint64_t CompletedValue);
+
+    // Closes on each of Batch's submissions and reclaims whenever it goes idle.
+    void Attach(UploadBatch& Batch);
+
+    // Called with each index right before Free or Reclaim puts it back on the free list, e.g. to reset its
+    // descriptor. Runs on whichever thread frees, set it before handing out the first index.
+    void SetRecycleCallback(std::function<void(uint32_t Index)> Callback) { m_OnRecycle = std::move(Callback); }
+
+    bool IsCurrent(DescriptorHandle Handle) const;
+
+    uint32_t Capacity() const { return m_Capacity; }
+    uint32_t NumAllocated() const { return m_NumAllocated.load(std::memory_order_relaxed); }
+    uint32_t NumRetired() const;
+    uint32_t NumFree() const { return m_Capacity - NumAllocated() - NumRetired(); }
+    DescriptorIndexAllocatorStats Stats() const;
+
+    void PrintStats(const char* Name) const;
+
+    // Checks that stale handles are caught after their slot is reused, the fenced reuse of retired indices, when
+    // the recycle callback runs, and that concurrent Allocate/Free never hands one index to two threads. No GPU needed.
+    static bool SelfTest();
+
+    // Hammers Allocate/Free from Threads threads and compares the time per call with a mutex protected free list.
+    static void Benchmark(int Threads, int Iterations);
+
+private:
+    static constexpr uint32_t NoIndex = DescriptorHandle::InvalidIndex;
+
+    struct ClosedRetirement
+    {
+        uint64_t FenceValue;
+        std::vector<uint32_t> Indices;
+    };
+
+    // Bumps the generation of Handle's slot, throws if it was not current.
+    void Invalidate(DescriptorHandle Handle);
+    void Push(uint32_t Index);
+
+    uint32_t m_Capacity;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_Next;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_Generations;
+
+    // Low half is the top index, high half a tag that changes on every push and pop so a stale pop cannot succeed.
+    std::atomic<uint64_t> m_Head;
+    std::atomic<uint32_t> m_NumAllocated{ 0 };
+    std::function<void(uint32_t)> m_OnRecycle;
+
+    std::atomic<size_t> m_Failures{ 0 };
+    std::atomic<size_t> m_PeakAllocated{ 0 };
+
+    mutable std::mutex m_RetireMutex;
+    std::vector<uint32_t> m_Open;
+    std::deque<ClosedRetirement> m_Closed;
+    uint64_t m_LastFenceValue = 0;
+    uint32_t m_NumRetired = 0;
+    size_t m_Retired = 0;
+};
@@ -0,0 +1,254 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "PortableUtils.h"
+
+namespace
+{
+    struct Workload
+    {
+        const char* Name;
+        double CpuMs;
+        double GpuMs;
+        double JitterMs;
+    };
+
+    const Workload Workloads[] =
+    {
+        { "CPU bound", 8.0, 5.0, 0.0 },
+        { "GPU bound", 4.0, 10.0, 0.0 },
+        { "Balanced with jitter", 7.0, 7.0, 4.0 },
+    };
+
+    struct PacingResult
+    {
+        std::string Failure;
+        double TotalMs = 0.0;
+        double GpuIdle = 0.0;
+        double CpuWaiting = 0.0;
+        double AverageLatency = 0.0;
+        double MaxLatency = 0.0;
+    };
+
+    // Frames of Load against a simulated in-order GPU. The CPU tries BeginFrame before waiting whenever the
+    // slot's fence has not completed yet, which has to throw, and no slot may be handed out while the GPU work of
+    // its previous frame is unfinished. Returns the first violation and the timing of the run.
+    PacingResult SimulatePacing(const Workload& Load, uint32_t FramesInFlight, int Frames)
+    {
+        // Same durations for every frame count, so only the pacing differs.
+        std::mt19937 Random{ 42 };
+        std::uniform_real_distribution<double> Jitter{ -Load.JitterMs, Load.JitterMs };
+
+        FramePacer Pacer{ FramesInFlight };
+        std::vector<double> FenceCompletion{ 0.0 };
+        std::vector<double> SlotBusyUntil(FramesInFlight, 0.0);
+        const auto CompletedAt = [&FenceCompletion](double Time)
+        {
+            //Completion times grow with the fence value on an in-order queue
+            return uint64_t(std::upper_bound(FenceCompletion.begin(), FenceCompletion.end(), Time) - FenceCompletion.begin()) - 1;
+        };
+
+        PacingResult Result;
+        double CpuTime = 0.0;
+        double GpuFree = 0.0;
+        double GpuBusy = 0.0;
+        double CpuWait = 0.0;
+        double TotalLatency = 0.0;
+        for (int Frame = 0; Frame < Frames && Result.Failure.empty(); ++Frame)
+        {
+            const uint64_t WaitValue = Pacer.WaitValue();
+            if (CompletedAt(CpuTime) < WaitValue)
+            {
+                bool bThrew = false;
+                try
+                {
+                    Pacer.BeginFrame(CompletedAt(CpuTime));
+                }
+                catch (const std::logic_error&)
+                {
+                    bThrew = true;
+                }
+                if (!bThrew)
+                {
+                    Result.Failure = "frame begun before its slot was free";
+                    break;
+                }
+                CpuWait += FenceCompletion[WaitValue] - CpuTime;
+                CpuTime = FenceCompletion[WaitValue];
+            }
+
+            const uint32_t Slot = Pacer.BeginFrame(CompletedAt(CpuTime));
+            if (SlotBusyUntil[Slot] > CpuTime)
+            {
+                Result.Failure = "slot rewritten while the GPU still reads it";
+                break;
+            }
+            const double FrameBegin = CpuTime;
+            CpuTime += std::max(0.5, Load.CpuMs + Jitter(Random));
+
+            const double GpuMs = std::max(0.5, Load.GpuMs + Jitter(Random));
+            const double Finish = std::max(CpuTime, GpuFree) + GpuMs;
+            GpuFree = Finish;
+            GpuBusy += GpuMs;
+            SlotBusyUntil[Slot] = Finish;
+            FenceCompletion.push_back(Finish);
+            Pacer.EndFrame(FenceCompletion.size() - 1);
+
+            TotalLatency += Finish - FrameBegin;
+            Result.MaxLatency = std::max(Result.MaxLatency, Finish - FrameBegin);
+        }
+
+        Result.TotalMs = std::max(GpuFree, 1e-6);
+        Result.GpuIdle = 1.0 - GpuBusy / Result.TotalMs;
+        Result.CpuWaiting = CpuWait / Result.TotalMs;
+        Result.AverageLatency = TotalLatency / Frames;
+        return Result;
+    }
+}
+
+FramePacer::FramePacer(uint32_t FramesInFlight)
+{
+    if (FramesInFlight < 1 || FramesInFlight > MaxFramesInFlight)
+    {
+        throw std::invalid_argument("Frames in flight must be between 1 and " + std::to_string(MaxFramesInFlight));
+    }
+    m_SlotFenceValues.resize(FramesInFlight, 0);
+}
+
+uint32_t FramePacer::BeginFrame(uint64_t CompletedValue)
+{
+    if (m_bInFrame)
+    {
+        throw std::logic_error("Frame begun twice");
+    }
+    if (CompletedValue < WaitValue())
+    {
+        throw std::logic_error("Frame begun while the GPU may still use its slot");
+    }
+    m_FrameIndex = static_cast<uint32_t>(m_FrameNumber % m_SlotFenceValues.size());
+    m_bInFrame = true;
+    return m_FrameIndex;
+}
+
+void FramePacer::EndFrame(uint64_t FenceValue)
+{
+    if (!m_bInFrame)
+    {
+        throw std::logic_error("Frame ended without BeginFrame");
+    }
+    if (FenceValue <= m_LastFenceValue)
+    {
+        throw std::logic_error("Frame fence values have to grow");
+    }
+    m_SlotFenceValues[m_FrameIndex] = FenceValue;
+    m_LastFenceValue = FenceValue;
+    m_bInFrame = false;
+    ++m_FrameNumber;
+    ++m_Stats.Frames;
+}
+
+void FramePacer::RecordWait(double Milliseconds)
+{
+    if (Milliseconds > 0.0)
+    {
+        ++m_Stats.WaitedFrames;
+        m_Stats.WaitMs += Milliseconds;
+    }
+}
+
+void FramePacer::PrintStats(const char* Name) const
+{
+    const double Frames = double(std::max<size_t>(m_Stats.Frames, 1));
+    std::printf("Frame pacer: %s (%u frames in flight)\n", Name, FramesInFlight());
+    std::printf("  Frames        : %zu, %.1f%% waited for the GPU, %.3f ms average wait\n",
+        m_Stats.Frames, 100.0 * double(m_Stats.WaitedFrames) / Frames, m_Stats.WaitMs / Frames);
+}
+
+bool FramePacer::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Frame pacer self test\n");
+
+    const auto Throws = [](const std::function<void()>& Body)
+    {
+        try
+        {
+            Body();
+        }
+        catch (const std::exception&)
+        {
+            return true;
+        }
+        return false;
+    };
+
+    Harness.Run("Slots and fence rules", [&]()
+    {
+        Harness.Check(Throws([]() { FramePacer Pacer{ 0 }; }) && Throws([]() { FramePacer Pacer{ MaxFramesInFlight + 1 }; }),
+            "frame counts outside 1..MaxFramesInFlight throw");
+
+        FramePacer Pacer{ 3 };
+        Harness.Check(Pacer.WaitValue() == 0 && Pacer.BeginFrame(0) == 0, "the first frame needs no wait");
+        Harness.Check(Throws([&]() { Pacer.BeginFrame(0); }), "BeginFrame inside a frame throws");
+        Pacer.EndFrame(1);
+        Harness.Check(Throws([&]() { Pacer.EndFrame(2); }), "EndFrame outside a frame throws");
+        Harness.Check(Pacer.BeginFrame(0) == 1, "the next frame takes the next slot while the GPU is behind");
+        Harness.Check(Throws([&]() { Pacer.EndFrame(1); }), "a fence value that does not grow throws");
+        Pacer.EndFrame(2);
+        Harness.Check(Pacer.BeginFrame(0) == 2, "the CPU runs up to FramesInFlight - 1 frames ahead");
+        Pacer.EndFrame(3);
+
+        Harness.Check(Pacer.WaitValue() == 1, "the wrapped slot waits for the fence of its last frame");
+        Harness.Check(Throws([&]() { Pacer.BeginFrame(0); }) && !Pacer.InFrame(), "reusing a slot the GPU still reads throws");
+        Harness.Check(Pacer.BeginFrame(1) == 0 && Pacer.FrameNumber() == 3, "the slot is reused once its fence has completed");
+        Pacer.EndFrame(4);
+    });
+
+    // Every workload with every frame count, the fence rules are checked on each frame of the simulated GPU.
+    for (const Workload& Load : Workloads)
+    {
+        Harness.Run(Load.Name, [&]()
+        {
+            for (uint32_t FramesInFlight = 1; FramesInFlight <= MaxFramesInFlight; ++FramesInFlight)
+            {
+                const PacingResult Result = SimulatePacing(Load, FramesInFlight, 500);
+                Harness.Check(Result.Failure.empty(), Result.Failure.c_str());
+            }
+        });
+    }
+
+    Harness.Run("GPU bound overlap", [&]()
+    {
+        const Workload& GpuBound = Workloads[1];
+        const PacingResult Serial = SimulatePacing(GpuBound, 1, 500);
+        const PacingResult Overlapped = SimulatePacing(GpuBound, 2, 500);
+        Harness.Check(Serial.GpuIdle > 0.2, "with one frame in flight the GPU idles while the CPU records");
+        Harness.Check(Overlapped.GpuIdle < 0.01, "with two frames in flight the GPU never waits for the CPU");
+    });
+
+    return Harness.Finish();
+}
+
+void FramePacer::Benchmark(int Frames)
+{
+    Frames = std::max(Frames, 10);
+
+    std::printf("Frame pacing simulation: %d frames per run, in-order GPU, latency from frame begin to GPU completion\n", Frames);
+    for (const Workload& Load : Workloads)
+    {
+        std::printf("  %s (CPU %.1f ms, GPU %.1f ms, +-%.1f ms)\n", Load.Name, Load.CpuMs, Load.GpuMs, Load.JitterMs);
+        for (uint32_t FramesInFlight = 1; FramesInFlight <= MaxFramesInFlight; ++FramesInFlight)
+        {
+            const PacingResult Result = SimulatePacing(Load, FramesInFlight, Frames);
+            std::printf("    %u in flight : %6.1f fps, latency %5.1f ms avg %5.1f max, GPU idle %4.1f%%, CPU waiting %4.1f%%\n",
+                FramesInFlight, 1000.0 * Frames / Result.TotalMs, Result.AverageLatency, Result.MaxLatency,
+                100.0 * Result.GpuIdle, 100.0 * Result.CpuWaiting);
+        }
+    }
+}
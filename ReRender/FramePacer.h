@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct FramePacerStats
+{
+    size_t Frames = 0;
+    size_t WaitedFrames = 0;
+    double WaitMs = 0.0;
+};
+
+// Frames in flight of the renderer as slots over one monotonically increasing fence. Frame N records into
+// slot N % FramesInFlight (command allocators, transient constants) and may only begin once the frame that
+// used the slot before has completed, so the CPU runs up to FramesInFlight - 1 frames ahead of the GPU. Slots
+// are independent of the swap chain's back buffer index. Only fence values go in and out, the waiting is the
+// caller's, so the state machine runs against a simulated GPU as well.
+class FramePacer
+{
+public:
+    static constexpr uint32_t MaxFramesInFlight = 4;
+
+    // Throws std::invalid_argument outside 1..MaxFramesInFlight.
+    explicit FramePacer(uint32_t FramesInFlight);
+
+    uint32_t FramesInFlight() const { return static_cast<uint32_t>(m_SlotFenceValues.size()); }
+
+    // Fence value the next frame's slot was last submitted with, wait for it before BeginFrame.
+    uint64_t WaitValue() const { return m_SlotFenceValues[m_FrameNumber % m_SlotFenceValues.size()]; }
+
+    // Starts the next frame and returns its slot. Throws std::logic_error inside a frame or if CompletedValue
+    // shows the GPU may still use the slot.
+    uint32_t BeginFrame(uint64_t CompletedValue);
+
+    // The frame's last submission signals FenceValue, which has to grow from frame to frame.
+    void EndFrame(uint64_t FenceValue);
+
+    uint32_t FrameIndex() const { return m_FrameIndex; }
+    uint64_t FrameNumber() const { return m_FrameNumber; }
+    bool InFrame() const { return m_bInFrame; }
+
+    // Time the CPU spent blocked before BeginFrame, measured by the caller.
+    void RecordWait(double Milliseconds);
+
+    const FramePacerStats& Stats() const { return m_Stats; }
+    void PrintStats(const char* Name) const;
+
+    // Checks the slot and fence rules, then runs 1..MaxFramesInFlight frames against a simulated in-order GPU in
+    // CPU bound, GPU bound and jittery workloads and checks that no slot is reused while the GPU still reads it. No GPU needed.
+    static bool SelfTest();
+
+    // The workloads of SelfTest, prints throughput, input to completion latency and idle time per frame count.
+    static void Benchmark(int Frames);
+
+private:
+    std::vector<uint64_t> m_SlotFenceValues;
+    uint64_t m_FrameNumber = 0;
+    uint64_t m_LastFenceValue = 0;
+    uint32_t m_FrameIndex = 0;
+    bool m_bInFrame = false;
+    FramePacerStats m_Stats;
+};
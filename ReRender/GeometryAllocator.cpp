@@ -0,0 +1,528 @@
+#include "GeometryAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "PortableUtils.h"
+#include "UploadBatch.h"
+
+namespace
+{
+    struct ChurnResult
+    {
+        std::string Failure;
+        size_t Loads = 0;
+        size_t FailedLoads = 0;
+        double AverageFragmentation = 0.0;
+        double FinalFragmentation = 0.0;
+        double AverageUsed = 0.0;
+        uint64_t MovedElements = 0;
+        size_t Calls = 0;
+        double Ms = 0.0;
+    };
+
+    // Meshes come and go every frame and the resident set hovers around 60% of the arena. Frame f closes
+    // with fence f + 1 and the simulated GPU finishes Lag frames later. With bVerify every allocation is
+    // filled with its mesh id in a shadow copy of the buffer, moves copy it like the GPU would, and live as
+    // well as freed-but-in-flight ranges must still hold their id afterwards.
+    ChurnResult RunChurn(uint64_t Capacity, int Frames, uint64_t CompactBudget, bool bVerify)
+    {
+        const uint64_t Lag = 2;
+        const double MinSize = 256.0;
+        const double MaxSize = double(std::max<uint64_t>(Capacity / 16, 512));
+
+        struct LiveMesh
+        {
+            uint32_t Handle;
+            uint32_t Id;
+        };
+        struct InFlight
+        {
+            uint64_t Offset;
+            uint64_t Count;
+            uint32_t Id;
+            uint64_t FenceValue;
+        };
+
+        ChurnResult Result;
+        GeometryAllocator Allocator{ Capacity };
+        std::mt19937 Random{ 7 };
+        std::uniform_real_distribution<double> LogSize{ std::log(MinSize), std::log(MaxSize) };
+        std::vector<uint32_t> Memory(bVerify ? Capacity : 0, 0);
+        std::vector<LiveMesh> Live;
+        std::vector<InFlight> Retired;
+        uint32_t NextId = 1;
+
+        const auto Holds = [&](uint64_t Offset, uint64_t Count, uint32_t Id)
+        {
+            return std::all_of(Memory.begin() + Offset, Memory.begin() + Offset + Count, [Id](uint32_t Element) { return Element == Id; });
+        };
+
+        const auto Start = std::chrono::high_resolution_clock::now();
+        for (int Frame = 0; Frame < Frames && Result.Failure.empty(); ++Frame)
+        {
+            const uint64_t FenceValue = uint64_t(Frame) + 1;
+            const uint64_t Completed = FenceValue > Lag ? FenceValue - Lag : 0;
+            Allocator.Reclaim(Completed);
+            ++Result.Calls;
+            if (bVerify)
+            {
+                Retired.erase(std::remove_if(Retired.begin(), Retired.end(), [Completed](const InFlight& Range) { return Range.FenceValue <= Completed; }), Retired.end());
+            }
+
+            // Unload a few, more while the arena is fuller than the target.
+            const int NumUnloads = int(Random() % 3) + (Allocator.UsedElements() > Capacity * 3 / 4 ? 2 : 0);
+            for (int i = 0; i < NumUnloads && !Live.empty(); ++i)
+            {
+                const size_t Victim = Random() % Live.size();
+                if (bVerify)
+                {
+                    Retired.push_back({ Allocator.Offset(Live[Victim].Handle), Allocator.Count(Live[Victim].Handle), Live[Victim].Id, FenceValue });
+                }
+                Allocator.Free(Live[Victim].Handle);
+                ++Result.Calls;
+                Live[Victim] = Live.back();
+                Live.pop_back();
+            }
+
+            const int NumLoads = int(Random() % 3) + 1;
+            for (int i = 0; i < NumLoads; ++i)
+            {
+                const uint64_t Count = uint64_t(std::exp(LogSize(Random)));
+                const uint32_t Handle = Allocator.Allocate(Count);
+                ++Result.Calls;
+                ++Result.Loads;
+                if (Handle == GeometryAllocator::InvalidHandle)
+                {
+                    ++Result.FailedLoads;
+                    continue;
+                }
+                Live.push_back({ Handle, NextId++ });
+                if (bVerify)
+                {
+                    std::fill_n(Memory.begin() + Allocator.Offset(Handle), Count, Live.back().Id);
+                }
+            }
+
+            if (CompactBudget > 0 && Allocator.Fragmentation() > 0.25)
+            {
+                const std::vector<GeometryMove> Moves = Allocator.Compact(CompactBudget);
+                ++Result.Calls;
+                for (const GeometryMove& Move : Moves)
+                {
+                    Result.MovedElements += Move.Count;
+                    if (!bVerify)
+                    {
+                        continue;
+                    }
+                    if (Move.DestOffset + Move.Count > Move.SourceOffset && Move.SourceOffset + Move.Count > Move.DestOffset)
+                    {
+                        Result.Failure = "move overlaps its own source";
+                    }
+                    const uint32_t Id = Memory[Move.SourceOffset];
+                    std::copy_n(Memory.begin() + Move.SourceOffset, Move.Count, Memory.begin() + Move.DestOffset);
+                    Retired.push_back({ Move.SourceOffset, Move.Count, Id, FenceValue });
+                }
+            }
+
+            if (bVerify)
+            {
+                std::vector<std::pair<uint64_t, uint64_t>> LiveRanges;
+                for (const LiveMesh& Mesh : Live)
+                {
+                    if (!Holds(Allocator.Offset(Mesh.Handle), Allocator.Count(Mesh.Handle), Mesh.Id))
+                    {
+                        Result.Failure = "live mesh data overwritten or lost in a move";
+                    }
+                    LiveRanges.emplace_back(Allocator.Offset(Mesh.Handle), Allocator.Count(Mesh.Handle));
+                }
+                std::sort(LiveRanges.begin(), LiveRanges.end());
+                for (size_t i = 1; i < LiveRanges.size(); ++i)
+                {
+                    if (LiveRanges[i - 1].first + LiveRanges[i - 1].second > LiveRanges[i].first)
+                    {
+                        Result.Failure = "two live meshes overlap";
+                    }
+                }
+                for (const InFlight& Range : Retired)
+                {
+                    if (!Holds(Range.Offset, Range.Count, Range.Id))
+                    {
+                        Result.Failure = "range reused while the GPU may still read it";
+                    }
+                }
+                if (Frame % 64 == 0 && !Allocator.Validate())
+                {
+                    Result.Failure = "free, live and retired ranges no longer tile the arena";
+                }
+            }
+
+            Allocator.Close(FenceValue);
+            Result.AverageFragmentation += Allocator.Fragmentation();
+            Result.AverageUsed += double(Allocator.UsedElements()) / Capacity;
+        }
+        Result.Ms = ElapsedMs(Start);
+
+        Result.AverageFragmentation /= Frames;
+        Result.AverageUsed /= Frames;
+        Result.FinalFragmentation = Allocator.Fragmentation();
+        return Result;
+    }
+}
+
+GeometryAllocator::GeometryAllocator(uint64_t InCapacity)
+    :m_Capacity(InCapacity)
+    ,m_FreeElements(InCapacity)
+{
+    if (InCapacity == 0)
+    {
+        throw std::invalid_argument("Geometry allocator needs a capacity");
+    }
+    m_Free.emplace(0, InCapacity);
+}
+
+uint32_t GeometryAllocator::Allocate(uint64_t Count)
+{
+    Count = std::max<uint64_t>(Count, 1);
+
+    auto Hole = m_Free.begin();
+    while (Hole != m_Free.end() && Hole->second < Count)
+    {
+        ++Hole;
+    }
+    if (Hole == m_Free.end())
+    {
+        ++m_Stats.Failures;
+        return InvalidHandle;
+    }
+
+    uint32_t Handle;
+    if (!m_UnusedHandles.empty())
+    {
+        Handle = m_UnusedHandles.back();
+        m_UnusedHandles.pop_back();
+    }
+    else
+    {
+        Handle = static_cast<uint32_t>(m_Allocations.size());
+        m_Allocations.emplace_back();
+    }
+
+    Allocation& New = m_Allocations[Handle];
+    New.Offset = Hole->first;
+    New.Count = Count;
+    New.bLive = true;
+    Carve(Hole, Count);
+    m_Live.emplace(New.Offset, Handle);
+
+    m_UsedElements += Count;
+    m_Stats.PeakUsedElements = std::max(m_Stats.PeakUsedElements, m_UsedElements);
+    ++m_Stats.Allocations;
+    return Handle;
+}
+
+void GeometryAllocator::Free(uint32_t Handle)
+{
+    assert(Handle < m_Allocations.size() && m_Allocations[Handle].bLive && "Freeing a dead geometry handle");
+    Allocation& Dead = m_Allocations[Handle];
+
+    m_Live.erase(Dead.Offset);
+    m_Open.push_back({ Dead.Offset, Dead.Count });
+    m_UsedElements -= Dead.Count;
+    Dead.bLive = false;
+    m_UnusedHandles.push_back(Handle);
+    ++m_Stats.Frees;
+}
+
+void GeometryAllocator::Close(uint64_t FenceValue)
+{
+    assert(FenceValue >= m_LastFenceValue && "Fence values must not decrease");
+    m_LastFenceValue = FenceValue;
+
+    if (m_Open.empty())
+    {
+        return;
+    }
+    if (!m_Closed.empty() && m_Closed.back().FenceValue == FenceValue)
+    {
+        m_Closed.back().Ranges.insert(m_Closed.back().Ranges.end(), m_Open.begin(), m_Open.end());
+        m_Open.clear();
+        return;
+    }
+    m_Closed.push_back({ FenceValue, std::move(m_Open) });
+    m_Open.clear();
+}
+
+void GeometryAllocator::Reclaim(uint64_t CompletedValue)
+{
+    while (!m_Closed.empty() && m_Closed.front().FenceValue <= CompletedValue)
+    {
+        for (const Range& Retired : m_Closed.front().Ranges)
+        {
+            InsertFree(Retired.Offset, Retired.Count);
+        }
+        m_Closed.pop_front();
+    }
+}
+
+void GeometryAllocator::Attach(UploadBatch& Batch)
+{
+    Batch.OnSubmit([this](uint64_t FenceValue) { Close(FenceValue); });
+
+    UploadQueue& Queue = Batch.Queue();
+    Batch.OnIdle([this, &Queue]() { Reclaim(Queue.CompletedValue()); });
+}
+
+double GeometryAllocator::Fragmentation() const
+{
+    return m_FreeElements > 0 ? 1.0 - double(LargestFreeBlock()) / m_FreeElements : 0.0;
+}
+
+std::vector<GeometryMove> GeometryAllocator::Compact(uint64_t MaxElements)
+{
+    std::vector<GeometryMove> Moves;
+    std::vector<bool> bMoved(m_Allocations.size(), false);
+    uint64_t Budget = MaxElements;
+
+    auto Candidate = m_Live.end();
+    while (Candidate != m_Live.begin() && Budget > 0)
+    {
+        --Candidate;
+        const uint32_t Handle = Candidate->second;
+        Allocation& Moved = m_Allocations[Handle];
+        if (bMoved[Handle] || Moved.Count > Budget)
+        {
+            continue;
+        }
+
+        // Lowest hole below the allocation that holds it, moving up would only undo earlier work.
+        auto Hole = m_Free.begin();
+        while (Hole != m_Free.end() && Hole->first < Moved.Offset && Hole->second < Moved.Count)
+        {
+            ++Hole;
+        }
+        if (Hole == m_Free.end() || Hole->first >= Moved.Offset)
+        {
+            continue;
+        }
+
+        const uint64_t DestOffset = Hole->first;
+        Moves.push_back({ Handle, Moved.Offset, DestOffset, Moved.Count });
+        Carve(Hole, Moved.Count);
+        m_Open.push_back({ Moved.Offset, Moved.Count });
+
+        // The new entry lies below and may be the next candidate, bMoved keeps one handle to one move per call.
+        Candidate = m_Live.erase(Candidate);
+        m_Live.emplace(DestOffset, Handle);
+        Moved.Offset = DestOffset;
+        bMoved[Handle] = true;
+
+        Budget -= Moved.Count;
+        ++m_Stats.Moves;
+        m_Stats.MovedElements += Moved.Count;
+    }
+    return Moves;
+}
+
+uint64_t GeometryAllocator::LargestFreeBlock() const
+{
+    uint64_t Largest = 0;
+    for (const auto& Hole : m_Free)
+    {
+        Largest = std::max(Largest, Hole.second);
+    }
+    return Largest;
+}
+
+bool GeometryAllocator::Validate() const
+{
+    std::vector<Range> Ranges;
+    uint64_t FreeElements = 0;
+    for (const auto& Hole : m_Free)
+    {
+        Ranges.push_back({ Hole.first, Hole.second });
+        FreeElements += Hole.second;
+    }
+    uint64_t UsedElements = 0;
+    for (const auto& Entry : m_Live)
+    {
+        const Allocation& Live = m_Allocations[Entry.second];
+        if (!Live.bLive || Live.Offset != Entry.first)
+        {
+            return false;
+        }
+        Ranges.push_back({ Live.Offset, Live.Count });
+        UsedElements += Live.Count;
+    }
+    Ranges.insert(Ranges.end(), m_Open.begin(), m_Open.end());
+    for (const ClosedRetirement& Closed : m_Closed)
+    {
+        Ranges.insert(Ranges.end(), Closed.Ranges.begin(), Closed.Ranges.end());
+    }
+
+    std::sort(Ranges.begin(), Ranges.end(), [](const Range& A, const Range& B) { return A.Offset < B.Offset; });
+    uint64_t Cursor = 0;
+    for (const Range& Current : Ranges)
+    {
+        if (Current.Offset != Cursor || Current.Count == 0)
+        {
+            return false;
+        }
+        Cursor += Current.Count;
+    }
+
+    // Two neighbouring holes would mean a missed merge.
+    for (auto Hole = m_Free.begin(); Hole != m_Free.end(); ++Hole)
+    {
+        const auto Next = std::next(Hole);
+        if (Next != m_Free.end() && Hole->first + Hole->second == Next->first)
+        {
+            return false;
+        }
+    }
+
+    return Cursor == m_Capacity && FreeElements == m_FreeElements && UsedElements == m_UsedElements;
+}
+
+void GeometryAllocator::PrintStats(const char* Name) const
+{
+    std::printf("Geometry allocator: %s (%llu elements)\n", Name, static_cast<unsigned long long>(m_Capacity));
+    std::printf("  Allocations   : %zu live, %zu made, %zu freed, %zu failed\n", m_Live.size(), m_Stats.Allocations, m_Stats.Frees, m_Stats.Failures);
+    std::printf("  Used          : %.1f%% (peak %.1f%%), %zu holes, %.1f%% fragmented\n",
+        100.0 * m_UsedElements / m_Capacity, 100.0 * m_Stats.PeakUsedElements / m_Capacity, m_Free.size(), 100.0 * Fragmentation());
+    std::printf("  Compaction    : %zu moves, %llu elements\n", m_Stats.Moves, static_cast<unsigned long long>(m_Stats.MovedElements));
+}
+
+void GeometryAllocator::Carve(std::map<uint64_t, uint64_t>::iterator Hole, uint64_t Count)
+{
+    assert(Hole->second >= Count);
+    const uint64_t Offset = Hole->first + Count;
+    const uint64_t Remaining = Hole->second - Count;
+    m_Free.erase(Hole);
+    if (Remaining > 0)
+    {
+        m_Free.emplace(Offset, Remaining);
+    }
+    m_FreeElements -= Count;
+}
+
+void GeometryAllocator::InsertFree(uint64_t Offset, uint64_t Count)
+{
+    m_FreeElements += Count;
+
+    auto Next = m_Free.lower_bound(Offset);
+    if (Next != m_Free.begin())
+    {
+        const auto Previous = std::prev(Next);
+        if (Previous->first + Previous->second == Offset)
+        {
+            Offset = Previous->first;
+            Count += Previous->second;
+            m_Free.erase(Previous);
+        }
+    }
+    if (Next != m_Free.end() && Offset + Count == Next->first)
+    {
+        Count += Next->second;
+        m_Free.erase(Next);
+    }
+    m_Free.emplace(Offset, Count);
+}
+
+bool GeometryAllocator::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Geometry allocator self test\n");
+
+    Harness.Run("Compact into a hole", [&]()
+    {
+        GeometryAllocator Allocator{ 100 };
+        const uint32_t First = Allocator.Allocate(10);
+        const uint32_t Hole = Allocator.Allocate(20);
+        const uint32_t Middle = Allocator.Allocate(30);
+        const uint32_t Last = Allocator.Allocate(10);
+        Harness.Check(Allocator.Offset(First) == 0 && Allocator.Offset(Middle) == 30 && Allocator.Offset(Last) == 60, "allocations are packed from 0");
+
+        //Every element holds its handle, the moves are applied the way the GPU copy would
+        std::vector<uint32_t> Memory(100, InvalidHandle);
+        for (uint32_t Handle : { First, Hole, Middle, Last })
+        {
+            std::fill_n(Memory.begin() + Allocator.Offset(Handle), Allocator.Count(Handle), Handle);
+        }
+        Allocator.Free(Hole);
+        Allocator.Close(1);
+        Allocator.Reclaim(1);
+
+        Harness.Check(Allocator.Compact(5).empty(), "nothing larger than the budget moves");
+        const std::vector<GeometryMove> Moves = Allocator.Compact(100);
+        Harness.Check(Moves.size() == 1 && Moves[0].Handle == Last && Moves[0].SourceOffset == 60 && Moves[0].DestOffset == 10 && Moves[0].Count == 10,
+            "the highest allocation moves into the lowest hole that fits");
+        for (const GeometryMove& Move : Moves)
+        {
+            std::copy_n(Memory.begin() + Move.SourceOffset, Move.Count, Memory.begin() + Move.DestOffset);
+        }
+        Harness.Check(Allocator.Offset(Last) == 10 && Allocator.Count(Last) == 10, "the handle points at the new range");
+        bool bIntact = true;
+        for (uint32_t Handle : { First, Middle, Last })
+        {
+            const auto Begin = Memory.begin() + Allocator.Offset(Handle);
+            bIntact &= std::all_of(Begin, Begin + Allocator.Count(Handle), [Handle](uint32_t Element) { return Element == Handle; });
+        }
+        Harness.Check(bIntact, "live ranges keep their contents through the move");
+        Harness.Check(Allocator.RetiredElements() == 10 && Allocator.Validate(), "the old range is retired, not free");
+
+        Allocator.Close(2);
+        Allocator.Reclaim(2);
+        Harness.Check(Allocator.RetiredElements() == 0 && Allocator.NumFreeBlocks() == 2 && Allocator.LargestFreeBlock() == 40,
+            "the old range merges with the free tail once its fence passes");
+        Harness.Check(Allocator.Validate(), "free and live ranges tile the arena");
+    });
+
+    // The benchmark's churn on a small arena, every element of every live and in-flight range is checked each frame.
+    const uint64_t Capacity = 1 << 14;
+    Harness.Run("Churn without compaction", [&]()
+    {
+        const ChurnResult Result = RunChurn(Capacity, 600, 0, true);
+        Harness.Check(Result.Failure.empty(), Result.Failure.c_str());
+        Harness.Check(Result.FailedLoads > 0, "the run fills the arena");
+    });
+    Harness.Run("Churn with compaction", [&]()
+    {
+        const ChurnResult Result = RunChurn(Capacity, 600, Capacity / 16, true);
+        Harness.Check(Result.Failure.empty(), Result.Failure.c_str());
+        Harness.Check(Result.MovedElements > 0, "the run moves allocations");
+    });
+
+    return Harness.Finish();
+}
+
+void GeometryAllocator::Benchmark(uint64_t Capacity, int Frames)
+{
+    Capacity = std::max<uint64_t>(Capacity, 1 << 16);
+    Frames = std::max(Frames, 1);
+    const uint64_t CompactBudget = Capacity / 16;
+
+    // Without the shadow buffer, the allocator sees the same calls as in the checked churn of SelfTest.
+    const ChurnResult Plain = RunChurn(Capacity, Frames, 0, false);
+    const ChurnResult Compacted = RunChurn(Capacity, Frames, CompactBudget, false);
+
+    std::printf("Geometry allocator benchmark: %llu elements, %d frames of load/unload churn, GPU 2 frames behind\n",
+        static_cast<unsigned long long>(Capacity), Frames);
+    const auto Report = [Frames](const char* Name, const ChurnResult& Result)
+    {
+        std::printf("  %-14s: %5.1f%% used, %5.1f%% fragmented on average (%5.1f%% at the end), %zu of %zu loads failed\n",
+            Name, 100.0 * Result.AverageUsed, 100.0 * Result.AverageFragmentation, 100.0 * Result.FinalFragmentation,
+            Result.FailedLoads, Result.Loads);
+        std::printf("  %-14s  %.1f elements moved per frame, %.1f ns per call\n",
+            "", double(Result.MovedElements) / Frames, Result.Ms * 1e6 / std::max<size_t>(Result.Calls, 1));
+    };
+    Report("No compaction", Plain);
+    Report("Compaction", Compacted);
+}
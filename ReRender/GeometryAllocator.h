@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+class UploadBatch;
+
+// One allocation that Compact relocated. The caller copies Count elements from SourceOffset to DestOffset
+// before anything reads the allocation at its new place.
+struct GeometryMove
+{
+    uint32_t Handle;
+    uint64_t SourceOffset;
+    uint64_t DestOffset;
+    uint64_t Count;
+};
+
+struct GeometryAllocatorStats
+{
+    size_t Allocations = 0;
+    size_t Frees = 0;
+    size_t Failures = 0;
+    size_t Moves = 0;
+    uint64_t MovedElements = 0;
+    uint64_t PeakUsedElements = 0;
+};
+
+// Address ordered first-fit allocator over the elements of one shared buffer, e.g. every vertex of one stride.
+// Live data stays packed towards offset 0, and Compact moves allocations from the end down into holes so the
+// free space grows back into one block. Handles stay valid across moves, ask Offset for the current place.
+// Freed and moved-away ranges follow the Close/Reclaim fence contract of RingAllocator before they are reused.
+// Only offsets are handed out, so the core runs without a device.
+class GeometryAllocator
+{
+public:
+    static constexpr uint32_t InvalidHandle = ~uint32_t(0);
+
+    explicit GeometryAllocator(uint64_t InCapacity);
+
+    // Lowest free range of Count elements, InvalidHandle if no hole is large enough.
+    uint32_t Allocate(uint64_t Count);
+
+    // The handle dies at once, its range is reused after the fence of the next Close has passed.
+    void Free(uint32_t Handle);
+
+    uint64_t Offset(uint32_t Handle) const { return m_Allocations[Handle].Offset; }
+    uint64_t Count(uint32_t Handle) const { return m_Allocations[Handle].Count; }
+
+    // Tags everything freed or moved away since the last Close with FenceValue. Fence values must not decrease.
+    void Close(uint64_t FenceValue);
+
+    // Frees the ranges of every closed fence value <= CompletedValue.
+    void Reclaim(uint64_t CompletedValue);
+
+    // Closes on each of Batch's submissions and reclaims whenever it goes idle.
+    void Attach(UploadBatch& Batch);
+
+    // 0 while the free space is one block, approaching 1 the more of it is scattered over small holes.
+    double Fragmentation() const;
+
+    // Moves allocations, highest offset first, into the lowest hole below them that fits, until MaxElements
+    // have been moved. Handles point at the new ranges when this returns and the old ranges are retired like a
+    // Free, so the GPU may keep reading them until the next Close's fence.
+    std::vector<GeometryMove> Compact(uint64_t MaxElements);
+
+    uint64_t Capacity() const { return m_Capacity; }
+    uint64_t UsedElements() const { return m_UsedElements; }
+    uint64_t FreeElements() const { return m_FreeElements; }
+    uint64_t RetiredElements() const { return m_Capacity - m_UsedElements - m_FreeElements; }
+    uint64_t LargestFreeBlock() const;
+    size_t NumAllocations() const { return m_Live.size(); }
+    size_t NumFreeBlocks() const { return m_Free.size(); }
+    const GeometryAllocatorStats& Stats() const { return m_Stats; }
+
+    // Checks that live, free and retired ranges tile the capacity exactly. Slow, for tests.
+    bool Validate() const;
+
+    void PrintStats(const char* Name) const;
+
+    // Checks that Compact keeps the contents of moved ranges and retires their old place, then runs load/unload
+    // churn with and without compaction and checks in a shadow buffer that live ranges never overlap and live and
+    // in-flight data survive every move. No GPU needed.
+    static bool SelfTest();
+
+    // Load/unload churn of mesh sized allocations against a GPU that lags a few frames, once without and once
+    // with a per-frame compaction budget. Reports fragmentation, failed loads and time per call.
+    static void Benchmark(uint64_t Capacity, int Frames);
+
+private:
+    struct Allocation
+    {
+        uint64_t Offset = 0;
+        uint64_t Count = 0;
+        bool bLive = false;
+    };
+
+    struct Range
+    {
+        uint64_t Offset;
+        uint64_t Count;
+    };
+
+    struct ClosedRetirement
+    {
+        uint64_t FenceValue;
+        std::vector<Range> Ranges;
+    };
+
+    // Takes Count elements from the front of the hole at Hole, which must be large enough.
+    void Carve(std::map<uint64_t, uint64_t>::iterator Hole, uint64_t Count);
+
+    // Returns a range to the free list and merges it with its neighbours.
+    void InsertFree(uint64_t Offset, uint64_t Count);
+
+    uint64_t m_Capacity;
+    uint64_t m_UsedElements = 0;
+    uint64_t m_FreeElements;
+
+    // Offset -> count of each hole, neighbours are always merged.
+    std::map<uint64_t, uint64_t> m_Free;
+
+    // Offset -> handle of each live allocation, Compact walks it from the top.
+    std::map<uint64_t, uint32_t> m_Live;
+
+    std::vector<Allocation> m_Allocations;
+    std::vector<uint32_t> m_UnusedHandles;
+
+    std::vector<Range> m_Open;
+    std::deque<ClosedRetirement> m_Closed;
+    uint64_t m_LastFenceValue = 0;
+
+    GeometryAllocatorStats m_Stats;
+};
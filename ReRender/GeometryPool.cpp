@@ -0,0 +1,263 @@
+#include "GeometryPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <d3dx12/d3dx12.h>
+
+#include "GpuHeapManager.h"
+#include "StagingBuffer.h"
+#include "UploadBatch.h"
+
+namespace
+{
+    constexpr UINT IndexUnitSize = 4;
+}
+
+GeometryPool::GeometryPool(Microsoft::WRL::ComPtr<ID3D12Device> Device, GpuHeapManager* HeapManager, UINT64 VertexBytes, UINT64 IndexBytes)
+    :m_Device(Device)
+    ,m_HeapManager(HeapManager)
+    ,m_VertexBytes(VertexBytes)
+{
+    m_Indices = CreateArena(IndexBytes, IndexUnitSize, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+}
+
+GeometryAllocation GeometryPool::Allocate(UINT VertexStride, UINT NumVertices, DXGI_FORMAT IndexFormat, UINT NumIndices)
+{
+    if (IndexFormat != DXGI_FORMAT_R16_UINT && IndexFormat != DXGI_FORMAT_R32_UINT)
+    {
+        throw std::invalid_argument("Geometry pool indices must be R16_UINT or R32_UINT");
+    }
+
+    auto VertexArenaIt = m_VertexArenas.find(VertexStride);
+    if (VertexArenaIt == m_VertexArenas.end())
+    {
+        VertexArenaIt = m_VertexArenas.emplace(VertexStride, CreateArena(m_VertexBytes, VertexStride, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER)).first;
+    }
+    GeometryAllocator& Vertices = *VertexArenaIt->second.Allocator;
+
+    GeometryAllocation Allocation;
+    Allocation.VertexStride = VertexStride;
+    Allocation.IndexFormat = IndexFormat;
+    Allocation.NumIndices = NumIndices;
+    Allocation.Vertices = Vertices.Allocate(NumVertices);
+    if (Allocation.Vertices == GeometryAllocator::InvalidHandle)
+    {
+        throw std::runtime_error("Geometry pool is out of vertex space for stride " + std::to_string(VertexStride));
+    }
+    Allocation.Indices = m_Indices.Allocator->Allocate(IndexUnits(IndexFormat, NumIndices));
+    if (Allocation.Indices == GeometryAllocator::InvalidHandle)
+    {
+        //Nothing can reference the vertices yet, but they still go through a fence to keep a single free path
+        Vertices.Free(Allocation.Vertices);
+        throw std::runtime_error("Geometry pool is out of index space");
+    }
+    return Allocation;
+}
+
+void GeometryPool::Upload(UploadBatch& Batch, ID3D12GraphicsCommandList* CommandList, const GeometryAllocation& Allocation, const void* VertexData, const void* IndexData)
+{
+    const Arena& Vertices = VertexArena(Allocation.VertexStride);
+    const UINT64 VertexBytes = Vertices.Allocator->Count(Allocation.Vertices) * Allocation.VertexStride;
+    const UINT64 IndexBytes = UINT64(Allocation.NumIndices) * (Allocation.IndexFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t));
+    UploadRange(Batch, CommandList, Vertices, Vertices.Allocator->Offset(Allocation.Vertices), VertexBytes, VertexData);
+    UploadRange(Batch, CommandList, m_Indices, m_Indices.Allocator->Offset(Allocation.Indices), IndexBytes, IndexData);
+}
+
+void GeometryPool::Free(GeometryAllocation& Allocation)
+{
+    if (!Allocation.IsValid())
+    {
+        return;
+    }
+    VertexArena(Allocation.VertexStride).Allocator->Free(Allocation.Vertices);
+    m_Indices.Allocator->Free(Allocation.Indices);
+    Allocation = GeometryAllocation{};
+}
+
+INT GeometryPool::BaseVertex(const GeometryAllocation& Allocation) const
+{
+    return static_cast<INT>(VertexArena(Allocation.VertexStride).Allocator->Offset(Allocation.Vertices));
+}
+
+UINT GeometryPool::FirstIndex(const GeometryAllocation& Allocation) const
+{
+    const uint64_t Offset = m_Indices.Allocator->Offset(Allocation.Indices);
+    return static_cast<UINT>(Allocation.IndexFormat == DXGI_FORMAT_R16_UINT ? Offset * 2 : Offset);
+}
+
+D3D12_VERTEX_BUFFER_VIEW GeometryPool::VertexBufferView(UINT VertexStride) const
+{
+    const Arena& Vertices = VertexArena(VertexStride);
+    D3D12_VERTEX_BUFFER_VIEW View;
+    View.BufferLocation = Vertices.Buffer->GetGPUVirtualAddress();
+    View.SizeInBytes = static_cast<UINT>(Vertices.Allocator->Capacity() * VertexStride);
+    View.StrideInBytes = VertexStride;
+    return View;
+}
+
+D3D12_INDEX_BUFFER_VIEW GeometryPool::IndexBufferView(DXGI_FORMAT IndexFormat) const
+{
+    D3D12_INDEX_BUFFER_VIEW View;
+    View.BufferLocation = m_Indices.Buffer->GetGPUVirtualAddress();
+    View.SizeInBytes = static_cast<UINT>(m_Indices.Allocator->Capacity() * IndexUnitSize);
+    View.Format = IndexFormat;
+    return View;
+}
+
+UINT64 GeometryPool::Defragment(ID3D12GraphicsCommandList* CommandList, UINT64 BudgetBytes, double Threshold)
+{
+    if (!m_Scratch)
+    {
+        m_ScratchBytes = std::max<UINT64>(BudgetBytes, IndexUnitSize);
+        auto ScratchDesc = CD3DX12_RESOURCE_DESC::Buffer(m_ScratchBytes);
+        if (FAILED(GpuHeapManager::CreateResource(m_HeapManager, m_Device.Get(), &ScratchDesc, m_ScratchState, nullptr, m_Scratch)))
+        {
+            throw std::runtime_error("Failed to create geometry pool scratch buffer");
+        }
+    }
+    BudgetBytes = std::min(BudgetBytes, m_ScratchBytes);
+
+    UINT64 MovedBytes = 0;
+    for (auto& Vertices : m_VertexArenas)
+    {
+        MovedBytes += Compact(CommandList, Vertices.second, BudgetBytes, Threshold);
+    }
+    MovedBytes += Compact(CommandList, m_Indices, BudgetBytes, Threshold);
+    return MovedBytes;
+}
+
+void GeometryPool::Close(uint64_t FenceValue)
+{
+    for (auto& Vertices : m_VertexArenas)
+    {
+        Vertices.second.Allocator->Close(FenceValue);
+    }
+    m_Indices.Allocator->Close(FenceValue);
+}
+
+void GeometryPool::Reclaim(uint64_t CompletedValue)
+{
+    for (auto& Vertices : m_VertexArenas)
+    {
+        Vertices.second.Allocator->Reclaim(CompletedValue);
+    }
+    m_Indices.Allocator->Reclaim(CompletedValue);
+}
+
+void GeometryPool::Attach(UploadBatch& Batch)
+{
+    Batch.OnSubmit([this](uint64_t FenceValue) { Close(FenceValue); });
+
+    UploadQueue& Queue = Batch.Queue();
+    Batch.OnIdle([this, &Queue]() { Reclaim(Queue.CompletedValue()); });
+}
+
+void GeometryPool::PrintStats() const
+{
+    for (const auto& Vertices : m_VertexArenas)
+    {
+        const std::string Name = "Vertices, " + std::to_string(Vertices.first) + " byte stride";
+        Vertices.second.Allocator->PrintStats(Name.c_str());
+    }
+    m_Indices.Allocator->PrintStats("Indices, 4 byte units");
+}
+
+GeometryPool::Arena GeometryPool::CreateArena(UINT64 Bytes, UINT ElementSize, D3D12_RESOURCE_STATES ReadState) const
+{
+    Arena NewArena;
+    NewArena.ElementSize = ElementSize;
+    NewArena.ReadState = ReadState;
+    NewArena.Allocator = std::make_unique<GeometryAllocator>(Bytes / ElementSize);
+
+    auto BufferDesc = CD3DX12_RESOURCE_DESC::Buffer(NewArena.Allocator->Capacity() * ElementSize);
+    if (FAILED(GpuHeapManager::CreateResource(m_HeapManager, m_Device.Get(), &BufferDesc, ReadState, nullptr, NewArena.Buffer)))
+    {
+        throw std::runtime_error("Failed to create geometry pool buffer");
+    }
+    return NewArena;
+}
+
+const GeometryPool::Arena& GeometryPool::VertexArena(UINT VertexStride) const
+{
+    const auto Vertices = m_VertexArenas.find(VertexStride);
+    if (Vertices == m_VertexArenas.end())
+    {
+        throw std::invalid_argument("Geometry pool has no vertices of stride " + std::to_string(VertexStride));
+    }
+    return Vertices->second;
+}
+
+void GeometryPool::UploadRange(UploadBatch& Batch, ID3D12GraphicsCommandList* CommandList, const Arena& Target, uint64_t Offset, UINT64 Bytes, const void* Source) const
+{
+    StagingBuffer Staging = StagingBuffer::CreateStagingBuffer(Batch, m_Device, Source, Bytes);
+
+    auto ToCopyDest = CD3DX12_RESOURCE_BARRIER::Transition(Target.Buffer.Get(), Target.ReadState, D3D12_RESOURCE_STATE_COPY_DEST);
+    CommandList->ResourceBarrier(1, &ToCopyDest);
+    CommandList->CopyBufferRegion(Target.Buffer.Get(), Offset * Target.ElementSize, Staging.Buffer.Get(), Staging.Layouts[0].Offset, Bytes);
+    auto ToRead = CD3DX12_RESOURCE_BARRIER::Transition(Target.Buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, Target.ReadState);
+    CommandList->ResourceBarrier(1, &ToRead);
+
+    Batch.Retain(std::move(Staging), Bytes);
+}
+
+UINT64 GeometryPool::Compact(ID3D12GraphicsCommandList* CommandList, Arena& Target, UINT64 BudgetBytes, double Threshold)
+{
+    if (Target.Allocator->Fragmentation() <= Threshold)
+    {
+        return 0;
+    }
+    const std::vector<GeometryMove> Moves = Target.Allocator->Compact(BudgetBytes / Target.ElementSize);
+    if (Moves.empty())
+    {
+        return 0;
+    }
+
+    ID3D12Resource* Buffer = Target.Buffer.Get();
+    ID3D12Resource* Scratch = m_Scratch.Get();
+    {
+        std::vector<D3D12_RESOURCE_BARRIER> Barriers = { CD3DX12_RESOURCE_BARRIER::Transition(Buffer, Target.ReadState, D3D12_RESOURCE_STATE_COPY_SOURCE) };
+        if (m_ScratchState != D3D12_RESOURCE_STATE_COPY_DEST)
+        {
+            Barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(Scratch, m_ScratchState, D3D12_RESOURCE_STATE_COPY_DEST));
+        }
+        CommandList->ResourceBarrier(static_cast<UINT>(Barriers.size()), Barriers.data());
+    }
+
+    UINT64 ScratchOffset = 0;
+    for (const GeometryMove& Move : Moves)
+    {
+        const UINT64 Bytes = Move.Count * Target.ElementSize;
+        CommandList->CopyBufferRegion(Scratch, ScratchOffset, Buffer, Move.SourceOffset * Target.ElementSize, Bytes);
+        ScratchOffset += Bytes;
+    }
+
+    {
+        const D3D12_RESOURCE_BARRIER Barriers[] =
+        {
+            CD3DX12_RESOURCE_BARRIER::Transition(Buffer, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST),
+            CD3DX12_RESOURCE_BARRIER::Transition(Scratch, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE)
+        };
+        CommandList->ResourceBarrier(2, Barriers);
+    }
+
+    ScratchOffset = 0;
+    for (const GeometryMove& Move : Moves)
+    {
+        const UINT64 Bytes = Move.Count * Target.ElementSize;
+        CommandList->CopyBufferRegion(Buffer, Move.DestOffset * Target.ElementSize, Scratch, ScratchOffset, Bytes);
+        ScratchOffset += Bytes;
+    }
+
+    auto ToRead = CD3DX12_RESOURCE_BARRIER::Transition(Buffer, D3D12_RESOURCE_STATE_COPY_DEST, Target.ReadState);
+    CommandList->ResourceBarrier(1, &ToRead);
+    m_ScratchState = D3D12_RESOURCE_STATE_COPY_SOURCE;
+    return ScratchOffset;
+}
+
+uint64_t GeometryPool::IndexUnits(DXGI_FORMAT IndexFormat, UINT NumIndices)
+{
+    return IndexFormat == DXGI_FORMAT_R16_UINT ? (uint64_t(NumIndices) + 1) / 2 : NumIndices;
+}
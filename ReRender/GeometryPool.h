@@ -0,0 +1,98 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include "GeometryAllocator.h"
+
+class GpuHeapManager;
+class UploadBatch;
+
+// The vertices and indices of one mesh in a GeometryPool. Stays valid while the pool compacts, the draw
+// offsets are asked for at draw time.
+struct GeometryAllocation
+{
+    UINT VertexStride = 0;
+    DXGI_FORMAT IndexFormat = DXGI_FORMAT_UNKNOWN;
+    UINT NumIndices = 0;
+    uint32_t Vertices = GeometryAllocator::InvalidHandle;
+    uint32_t Indices = GeometryAllocator::InvalidHandle;
+
+    bool IsValid() const { return Vertices != GeometryAllocator::InvalidHandle; }
+};
+
+// Every mesh's vertices in one vertex buffer per stride and every index in one shared index buffer, so a
+// scene binds its geometry once and draws select meshes through BaseVertex and FirstIndex. Indices are
+// allocated in 4 byte units, which keeps R16 and R32 meshes in the same buffer behind two views.
+// Defragment moves meshes down into holes left by unloaded ones and retires the old ranges with the
+// Close/Reclaim fence contract, so frames still in flight keep reading valid data.
+class GeometryPool
+{
+public:
+    // Each vertex stride gets an arena of VertexBytes the first time it is allocated, the indices share IndexBytes.
+    // Buffers are placed in HeapManager's buffer pool when one is given, committed otherwise.
+    GeometryPool(Microsoft::WRL::ComPtr<ID3D12Device> Device, GpuHeapManager* HeapManager, UINT64 VertexBytes, UINT64 IndexBytes);
+
+    // Throws when an arena has no hole large enough.
+    GeometryAllocation Allocate(UINT VertexStride, UINT NumVertices, DXGI_FORMAT IndexFormat, UINT NumIndices);
+
+    // Records the copies of the whole allocation into CommandList, the staging memory lives in Batch.
+    void Upload(UploadBatch& Batch, ID3D12GraphicsCommandList* CommandList, const GeometryAllocation& Allocation,
+        const void* VertexData, const void* IndexData);
+
+    // The ranges are reused after the fence of the next Close, Allocation is reset.
+    void Free(GeometryAllocation& Allocation);
+
+    INT BaseVertex(const GeometryAllocation& Allocation) const;
+    UINT FirstIndex(const GeometryAllocation& Allocation) const;
+
+    // Views over a whole arena, bound once for every mesh of that stride or index format.
+    D3D12_VERTEX_BUFFER_VIEW VertexBufferView(UINT VertexStride) const;
+    D3D12_INDEX_BUFFER_VIEW IndexBufferView(DXGI_FORMAT IndexFormat) const;
+
+    // Compacts every arena more fragmented than Threshold, moving at most BudgetBytes of each through a
+    // scratch buffer sized on the first call. BaseVertex and FirstIndex change, so record this before any
+    // draw that uses the pool. Returns the bytes moved.
+    UINT64 Defragment(ID3D12GraphicsCommandList* CommandList, UINT64 BudgetBytes, double Threshold = 0.25);
+
+    void Close(uint64_t FenceValue);
+    void Reclaim(uint64_t CompletedValue);
+
+    // Closes on each of Batch's submissions and reclaims whenever it goes idle.
+    void Attach(UploadBatch& Batch);
+
+    void PrintStats() const;
+
+private:
+    struct Arena
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        UINT ElementSize = 0;
+        D3D12_RESOURCE_STATES ReadState = D3D12_RESOURCE_STATE_COMMON;
+        std::unique_ptr<GeometryAllocator> Allocator;
+    };
+
+    Arena CreateArena(UINT64 Bytes, UINT ElementSize, D3D12_RESOURCE_STATES ReadState) const;
+    const Arena& VertexArena(UINT VertexStride) const;
+
+    // Copies Bytes from Source into Target at element Offset between a pair of barriers.
+    void UploadRange(UploadBatch& Batch, ID3D12GraphicsCommandList* CommandList, const Arena& Target, uint64_t Offset,
+        UINT64 Bytes, const void* Source) const;
+
+    UINT64 Compact(ID3D12GraphicsCommandList* CommandList, Arena& Target, UINT64 BudgetBytes, double Threshold);
+
+    static uint64_t IndexUnits(DXGI_FORMAT IndexFormat, UINT NumIndices);
+
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+    GpuHeapManager* m_HeapManager;
+    UINT64 m_VertexBytes;
+    std::map<UINT, Arena> m_VertexArenas;
+    Arena m_Indices;
+
+    // Moves go source -> scratch -> destination, a buffer cannot be copy source and destination at once.
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_Scratch;
+    UINT64 m_ScratchBytes = 0;
+    D3D12_RESOURCE_STATES m_ScratchState = D3D12_RESOURCE_STATE_COPY_DEST;
+};
@@ -0,0 +1,271 @@
+#include "GpuHeapManager.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+#include <d3dx12/d3dx12.h>
+
+namespace
+{
+    const char* PoolName(GpuHeapPool Pool)
+    {
+        switch (Pool)
+        {
+        case GpuHeapPool::Buffers: return "Buffers";
+        case GpuHeapPool::Textures: return "Textures";
+        default: return "RenderTargets";
+        }
+    }
+}
+
+GpuHeapManager::GpuHeapManager(Microsoft::WRL::ComPtr<ID3D12Device> Device, UINT64 PageSize)
+    :m_Device(Device)
+    ,m_PageSize(PageSize)
+{
+    m_Pools[static_cast<size_t>(GpuHeapPool::Buffers)].Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+    m_Pools[static_cast<size_t>(GpuHeapPool::Textures)].Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+
+    // Multisampled targets need 4 MB placement, so their heaps have to start on it.
+    Pool& RenderTargets = m_Pools[static_cast<size_t>(GpuHeapPool::RenderTargets)];
+    RenderTargets.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+    RenderTargets.HeapAlignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+}
+
+GpuHeapPool GpuHeapManager::PoolFor(const D3D12_RESOURCE_DESC& Desc)
+{
+    if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+    {
+        return GpuHeapPool::Buffers;
+    }
+    if (Desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+    {
+        return GpuHeapPool::RenderTargets;
+    }
+    return GpuHeapPool::Textures;
+}
+
+HRESULT GpuHeapManager::CreateResource(
+    GpuHeapManager* Manager,
+    ID3D12Device* Device,
+    const D3D12_RESOURCE_DESC* Desc,
+    D3D12_RESOURCE_STATES InitialState,
+    const D3D12_CLEAR_VALUE* ClearValue,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource)
+{
+    if (Manager)
+    {
+        return Manager->CreatePlacedResource(*Desc, InitialState, ClearValue, OutResource);
+    }
+
+    const auto DefaultType = CD3DX12_HEAP_PROPERTIES{ D3D12_HEAP_TYPE_DEFAULT };
+    return Device->CreateCommittedResource(
+        &DefaultType,
+        D3D12_HEAP_FLAG_NONE,
+        Desc,
+        InitialState,
+        ClearValue,
+        IID_PPV_ARGS(&OutResource));
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO GpuHeapManager::AllocationInfo(D3D12_RESOURCE_DESC& Desc) const
+{
+    if (PoolFor(Desc) == GpuHeapPool::Textures && Desc.SampleDesc.Count <= 1)
+    {
+        Desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        const D3D12_RESOURCE_ALLOCATION_INFO Info = m_Device->GetResourceAllocationInfo(0, 1, &Desc);
+        if (Info.Alignment == D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+        {
+            return Info;
+        }
+    }
+
+    Desc.Alignment = 0;
+    return m_Device->GetResourceAllocationInfo(0, 1, &Desc);
+}
+
+GpuAllocation GpuHeapManager::Allocate(GpuHeapPool PoolType, UINT64 Size, UINT64 Alignment)
+{
+    Pool& Target = m_Pools[static_cast<size_t>(PoolType)];
+
+    GpuAllocation Allocation;
+    Allocation.Pool = PoolType;
+    for (uint32_t i = 0; i < Target.Pages.size(); ++i)
+    {
+        Page& Candidate = Target.Pages[i];
+        if (Candidate.Heap && !Candidate.bDedicated)
+        {
+            Allocation.Range = Candidate.Allocator->Allocate(Size, Alignment);
+            if (Allocation.IsValid())
+            {
+                Allocation.Page = i;
+                Allocation.Heap = Candidate.Heap.Get();
+                return Allocation;
+            }
+        }
+    }
+
+    // Big resources would leave most of a shared page unusable, they get a heap of their own.
+    const bool bDedicated = Size > m_PageSize / 2;
+    const UINT64 HeapAlignment = std::max<UINT64>(Target.HeapAlignment, Alignment);
+    const UINT64 HeapSize = bDedicated ? (Size + HeapAlignment - 1) / HeapAlignment * HeapAlignment : m_PageSize;
+
+    const D3D12_HEAP_DESC HeapDesc = { HeapSize, CD3DX12_HEAP_PROPERTIES{ D3D12_HEAP_TYPE_DEFAULT }, HeapAlignment, Target.Flags };
+    Page NewPage;
+    if (FAILED(m_Device->CreateHeap(&HeapDesc, IID_PPV_ARGS(&NewPage.Heap))))
+    {
+        throw std::runtime_error("Failed to create GPU heap");
+    }
+    NewPage.Allocator = std::make_unique<TlsfAllocator>(HeapSize);
+    NewPage.bDedicated = bDedicated;
+
+    // Reuse the slot of a dedicated heap that was given back.
+    auto Slot = std::find_if(Target.Pages.begin(), Target.Pages.end(), [](const Page& Existing) { return !Existing.Heap; });
+    if (Slot == Target.Pages.end())
+    {
+        Slot = Target.Pages.insert(Target.Pages.end(), Page{});
+    }
+    *Slot = std::move(NewPage);
+
+    Allocation.Page = static_cast<uint32_t>(Slot - Target.Pages.begin());
+    Allocation.Heap = Slot->Heap.Get();
+    Allocation.Range = Slot->Allocator->Allocate(Size, Alignment);
+    if (!Allocation.IsValid())
+    {
+        throw std::runtime_error("Resource does not fit into a fresh GPU heap");
+    }
+    return Allocation;
+}
+
+HRESULT GpuHeapManager::CreatePlacedResource(
+    const D3D12_RESOURCE_DESC& Desc,
+    D3D12_RESOURCE_STATES InitialState,
+    const D3D12_CLEAR_VALUE* ClearValue,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource)
+{
+    D3D12_RESOURCE_DESC PlacedDesc = Desc;
+    const D3D12_RESOURCE_ALLOCATION_INFO Info = AllocationInfo(PlacedDesc);
+    if (Info.SizeInBytes == UINT64_MAX)
+    {
+        return E_INVALIDARG;
+    }
+
+    const GpuAllocation Allocation = Allocate(PoolFor(PlacedDesc), Info.SizeInBytes, Info.Alignment);
+    const HRESULT Result = m_Device->CreatePlacedResource(
+        Allocation.Heap,
+        Allocation.Range.Offset,
+        &PlacedDesc,
+        InitialState,
+        ClearValue,
+        IID_PPV_ARGS(&OutResource));
+    if (FAILED(Result))
+    {
+        Free(Allocation);
+        return Result;
+    }
+
+    m_Placed[OutResource.Get()] = Allocation;
+    ++m_Pools[static_cast<size_t>(Allocation.Pool)].NumResources;
+    return Result;
+}
+
+void GpuHeapManager::Release(ID3D12Resource* Resource)
+{
+    const auto Found = m_Placed.find(Resource);
+    if (Found == m_Placed.end())
+    {
+        return;
+    }
+
+    --m_Pools[static_cast<size_t>(Found->second.Pool)].NumResources;
+    Free(Found->second);
+    m_Placed.erase(Found);
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO GpuHeapManager::AliasingRequirements(const std::vector<D3D12_RESOURCE_DESC>& Descs) const
+{
+    D3D12_RESOURCE_ALLOCATION_INFO Requirements = { 0, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT };
+    for (D3D12_RESOURCE_DESC Desc : Descs)
+    {
+        // Aliased resources are created with the default placement, see CreateAliasedResource.
+        Desc.Alignment = 0;
+        const D3D12_RESOURCE_ALLOCATION_INFO Info = m_Device->GetResourceAllocationInfo(0, 1, &Desc);
+        Requirements.SizeInBytes = std::max(Requirements.SizeInBytes, Info.SizeInBytes);
+        Requirements.Alignment = std::max(Requirements.Alignment, Info.Alignment);
+    }
+    return Requirements;
+}
+
+GpuAllocation GpuHeapManager::AllocateAliasingRegion(GpuHeapPool Pool, const D3D12_RESOURCE_ALLOCATION_INFO& Info)
+{
+    return Allocate(Pool, Info.SizeInBytes, Info.Alignment);
+}
+
+HRESULT GpuHeapManager::CreateAliasedResource(
+    const GpuAllocation& Region,
+    const D3D12_RESOURCE_DESC& Desc,
+    D3D12_RESOURCE_STATES InitialState,
+    const D3D12_CLEAR_VALUE* ClearValue,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource)
+{
+    return CreateAliasedResource(Region, 0, Desc, InitialState, ClearValue, OutResource);
+}
+
+HRESULT GpuHeapManager::CreateAliasedResource(
+    const GpuAllocation& Region,
+    UINT64 Offset,
+    const D3D12_RESOURCE_DESC& Desc,
+    D3D12_RESOURCE_STATES InitialState,
+    const D3D12_CLEAR_VALUE* ClearValue,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource)
+{
+    D3D12_RESOURCE_DESC AliasedDesc = Desc;
+    AliasedDesc.Alignment = 0;
+    assert(PoolFor(AliasedDesc) == Region.Pool && "Resource does not belong in the region's pool");
+    assert(Offset + m_Device->GetResourceAllocationInfo(0, 1, &AliasedDesc).SizeInBytes <= Region.Range.Size && "Resource larger than its aliasing region");
+
+    return m_Device->CreatePlacedResource(
+        Region.Heap,
+        Region.Range.Offset + Offset,
+        &AliasedDesc,
+        InitialState,
+        ClearValue,
+        IID_PPV_ARGS(&OutResource));
+}
+
+void GpuHeapManager::Free(const GpuAllocation& Allocation)
+{
+    Page& Owner = m_Pools[static_cast<size_t>(Allocation.Pool)].Pages[Allocation.Page];
+    Owner.Allocator->Free(Allocation.Range);
+
+    if (Owner.bDedicated && Owner.Allocator->IsEmpty())
+    {
+        Owner = Page{};
+    }
+}
+
+void GpuHeapManager::PrintStats() const
+{
+    std::printf("GPU heaps     : %.0f MB pages\n", m_PageSize / (1024.0 * 1024.0));
+    for (size_t i = 0; i < static_cast<size_t>(GpuHeapPool::Count); ++i)
+    {
+        const Pool& Current = m_Pools[i];
+        size_t NumHeaps = 0;
+        size_t NumDedicated = 0;
+        UINT64 Reserved = 0;
+        UINT64 Used = 0;
+        for (const Page& Existing : Current.Pages)
+        {
+            if (Existing.Heap)
+            {
+                ++NumHeaps;
+                NumDedicated += Existing.bDedicated ? 1 : 0;
+                Reserved += Existing.Allocator->Capacity();
+                Used += Existing.Allocator->UsedBytes();
+            }
+        }
+        std::printf("  %-13s: %zu resources in %zu heaps (%zu dedicated), %.2f of %.2f MB used\n",
+            PoolName(static_cast<GpuHeapPool>(i)), Current.NumResources, NumHeaps, NumDedicated,
+            Used / (1024.0 * 1024.0), Reserved / (1024.0 * 1024.0));
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "TlsfAllocator.h"
+
+// Heaps are split by what they may hold, resource heap tier 1 hardware cannot mix these.
+enum class GpuHeapPool
+{
+    Buffers,
+    Textures,
+    RenderTargets,
+    Count
+};
+
+// A range of one pooled heap, from AllocateAliasingRegion or behind a placed resource.
+struct GpuAllocation
+{
+    GpuHeapPool Pool = GpuHeapPool::Buffers;
+    uint32_t Page = 0;
+    TlsfAllocation Range;
+    ID3D12Heap* Heap = nullptr;
+
+    bool IsValid() const { return Range.IsValid(); }
+};
+
+// Reserves large ID3D12Heaps per pool and places resources in them through a TlsfAllocator per heap,
+// instead of paying a kernel allocation and a 64 KB rounded heap for every committed resource.
+// Resources larger than half a page get a heap of their own. Must outlive every resource it placed.
+class GpuHeapManager
+{
+public:
+    explicit GpuHeapManager(Microsoft::WRL::ComPtr<ID3D12Device> Device, UINT64 PageSize = 64 * 1024 * 1024);
+
+    static GpuHeapPool PoolFor(const D3D12_RESOURCE_DESC& Desc);
+
+    // Drop-in for CreateCommittedResource on the default heap: placed when Manager is set, committed otherwise.
+    static HRESULT CreateResource(
+        GpuHeapManager* Manager,
+        ID3D12Device* Device,
+        const D3D12_RESOURCE_DESC* Desc,
+        D3D12_RESOURCE_STATES InitialState,
+        const D3D12_CLEAR_VALUE* ClearValue,
+        Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource);
+
+    HRESULT CreatePlacedResource(
+        const D3D12_RESOURCE_DESC& Desc,
+        D3D12_RESOURCE_STATES InitialState,
+        const D3D12_CLEAR_VALUE* ClearValue,
+        Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource);
+
+    // Gives the memory of a placed resource back. The GPU must be done with it.
+    void Release(ID3D12Resource* Resource);
+
+    // Size and alignment of a region that can hold any one of Descs at a time.
+    D3D12_RESOURCE_ALLOCATION_INFO AliasingRequirements(const std::vector<D3D12_RESOURCE_DESC>& Descs) const;
+
+    // Memory for transient targets that never live at the same time. Every resource created in the region
+    // starts at its first byte, switching between them needs an aliasing barrier and a clear, discard or
+    // full overwrite of the new one before it is read.
+    GpuAllocation AllocateAliasingRegion(GpuHeapPool Pool, const D3D12_RESOURCE_ALLOCATION_INFO& Info);
+
+    HRESULT CreateAliasedResource(
+        const GpuAllocation& Region,
+        const D3D12_RESOURCE_DESC& Desc,
+        D3D12_RESOURCE_STATES InitialState,
+        const D3D12_CLEAR_VALUE* ClearValue,
+        Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource);
+
+    // Places the resource Offset bytes into Region, for a frame graph packing transients with disjoint
+    // lifetimes. Offset must meet the resource's placement alignment.
+    HRESULT CreateAliasedResource(
+        const GpuAllocation& Region,
+        UINT64 Offset,
+        const D3D12_RESOURCE_DESC& Desc,
+        D3D12_RESOURCE_STATES InitialState,
+        const D3D12_CLEAR_VALUE* ClearValue,
+        Microsoft::WRL::ComPtr<ID3D12Resource>& OutResource);
+
+    // Frees a region, after the GPU is done with every resource created in it.
+    void Free(const GpuAllocation& Allocation);
+
+    void PrintStats() const;
+
+private:
+    struct Page
+    {
+        Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+        std::unique_ptr<TlsfAllocator> Allocator;
+        bool bDedicated = false;
+    };
+
+    struct Pool
+    {
+        D3D12_HEAP_FLAGS Flags = D3D12_HEAP_FLAG_NONE;
+        UINT64 HeapAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        std::vector<Page> Pages;
+        size_t NumResources = 0;
+    };
+
+    // Asks for 4 KB placement first, which small non render target textures support.
+    D3D12_RESOURCE_ALLOCATION_INFO AllocationInfo(D3D12_RESOURCE_DESC& Desc) const;
+
+    GpuAllocation Allocate(GpuHeapPool PoolType, UINT64 Size, UINT64 Alignment);
+
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+    UINT64 m_PageSize;
+    Pool m_Pools[static_cast<size_t>(GpuHeapPool::Count)];
+    std::unordered_map<ID3D12Resource*, GpuAllocation> m_Placed;
+};
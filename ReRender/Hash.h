@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// 64-bit FNV-1a, used to content-address the on-disk caches.
+class Hash
+{
+public:
+    static constexpr uint64_t OffsetBasis = 14695981039346656037ull;
+    static constexpr uint64_t Prime = 1099511628211ull;
+
+    static uint64_t Fnv1a64(const void* Data, size_t Size, uint64_t Seed = OffsetBasis)
+    {
+        const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+        uint64_t Result = Seed;
+        for (size_t i = 0; i < Size; ++i)
+        {
+            Result ^= Bytes[i];
+            Result *= Prime;
+        }
+        return Result;
+    }
+
+    static uint64_t Fnv1a64(const std::string& Str, uint64_t Seed = OffsetBasis)
+    {
+        return Fnv1a64(Str.data(), Str.size(), Seed);
+    }
+
+    // Folds the bytes of a POD value into an existing hash.
+    template<typename T>
+    static uint64_t Combine(uint64_t Seed, const T& Value)
+    {
+        return Fnv1a64(&Value, sizeof(T), Seed);
+    }
+
+    static std::string ToHex(uint64_t Value)
+    {
+        char Buffer[17];
+        std::snprintf(Buffer, sizeof(Buffer), "%016llx", static_cast<unsigned long long>(Value));
+        return std::string(Buffer);
+    }
+};
@@ -0,0 +1,1177 @@
+#include "IblBaker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <emmintrin.h>
+#include <functional>
+#include <random>
+#include <stdexcept>
+
+#include <glm/include/glm/gtc/packing.hpp>
+
+#include "Camera.h"
+#include "Image.h"
+#include "PortableUtils.h"
+#include "SphericalHarmonics.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    //The shaders' constants, kept as they are so the sample directions match
+    constexpr float PI = 3.141592f;
+    constexpr float TwoPI = 2.0f * PI;
+    //numthreads(32, 32, 1) of every shader, one tile per pool task
+    constexpr uint32_t TileSize = 32;
+
+    uint32_t NumMipLevels(uint32_t Size)
+    {
+        uint32_t Levels = 1;
+        while (Size >> Levels)
+        {
+            ++Levels;
+        }
+        return Levels;
+    }
+
+    //RGBA float faces of every mip, in D3D12 subresource order like BakedTexture
+    struct FloatCube
+    {
+        FloatCube(uint32_t InSize, uint32_t InLevels)
+            :Size(InSize)
+            ,Levels(InLevels)
+        {
+            size_t Total = 0;
+            Offsets.resize(size_t(Levels) * 6);
+            for (uint32_t Face = 0; Face < 6; ++Face)
+            {
+                for (uint32_t Mip = 0; Mip < Levels; ++Mip)
+                {
+                    Offsets[Mip + Face * Levels] = Total;
+                    Total += size_t(MipSize(Mip)) * MipSize(Mip) * 4;
+                }
+            }
+            Texels.resize(Total);
+        }
+
+        uint32_t MipSize(uint32_t Mip) const { return std::max(Size >> Mip, 1u); }
+        float* Face(uint32_t Mip, uint32_t Face) { return Texels.data() + Offsets[Mip + Face * Levels]; }
+        const float* Face(uint32_t Mip, uint32_t Face) const { return Texels.data() + Offsets[Mip + Face * Levels]; }
+
+        uint32_t Size;
+        uint32_t Levels;
+        std::vector<float> Texels;
+        std::vector<size_t> Offsets;
+    };
+
+    //A TileSize square of one face and mip, the unit of work of every stage
+    struct CubeTile
+    {
+        uint32_t Mip;
+        uint32_t Face;
+        uint32_t X0, Y0, X1, Y1;
+    };
+
+    void AppendTiles(uint32_t Mip, uint32_t Size, uint32_t NumFaces, std::vector<CubeTile>& Tiles)
+    {
+        for (uint32_t Face = 0; Face < NumFaces; ++Face)
+        {
+            for (uint32_t Y = 0; Y < Size; Y += TileSize)
+            {
+                for (uint32_t X = 0; X < Size; X += TileSize)
+                {
+                    Tiles.push_back({ Mip, Face, X, Y, std::min(X + TileSize, Size), std::min(Y + TileSize, Size) });
+                }
+            }
+        }
+    }
+
+    // Van der Corput radical inverse, see http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
+    float RadicalInverse(uint32_t Bits)
+    {
+        Bits = (Bits << 16u) | (Bits >> 16u);
+        Bits = ((Bits & 0x55555555u) << 1u) | ((Bits & 0xAAAAAAAAu) >> 1u);
+        Bits = ((Bits & 0x33333333u) << 2u) | ((Bits & 0xCCCCCCCCu) >> 2u);
+        Bits = ((Bits & 0x0F0F0F0Fu) << 4u) | ((Bits & 0xF0F0F0F0u) >> 4u);
+        Bits = ((Bits & 0x00FF00FFu) << 8u) | ((Bits & 0xFF00FF00u) >> 8u);
+        return float(Bits) * 2.3283064365386963e-10f;
+    }
+
+    //The half vector of GGX importance sample (U1, U2) around +Z, sampleGGX in spmap.hlsl and spbrdf.hlsl
+    Vec3 SampleGGX(float U1, float U2, float Roughness)
+    {
+        const float Alpha = Roughness * Roughness;
+        const float CosTheta = std::sqrt((1.0f - U2) / (1.0f + (Alpha * Alpha - 1.0f) * U2));
+        const float SinTheta = std::sqrt(1.0f - CosTheta * CosTheta);
+        const float Phi = TwoPI * U1;
+        return Vec3{ SinTheta * std::cos(Phi), SinTheta * std::sin(Phi), CosTheta };
+    }
+
+    float NdfGGX(float CosLh, float Roughness)
+    {
+        const float Alpha = Roughness * Roughness;
+        const float AlphaSq = Alpha * Alpha;
+        const float Denom = (CosLh * CosLh) * (AlphaSq - 1.0f) + 1.0f;
+        return AlphaSq / (PI * Denom * Denom);
+    }
+
+    //getSamplingVector of the shaders, the direction through the top left corner of texel (X, Y)
+    Vec3 SamplingVector(uint32_t Face, float X, float Y, uint32_t Size)
+    {
+        const float U = 2.0f * (X / float(Size)) - 1.0f;
+        const float V = 2.0f * (1.0f - Y / float(Size)) - 1.0f;
+        Vec3 Direction;
+        switch (Face)
+        {
+        case 0: Direction = Vec3{ 1.0f, V, -U }; break;
+        case 1: Direction = Vec3{ -1.0f, V, U }; break;
+        case 2: Direction = Vec3{ U, 1.0f, -V }; break;
+        case 3: Direction = Vec3{ U, -1.0f, V }; break;
+        case 4: Direction = Vec3{ U, V, 1.0f }; break;
+        default: Direction = Vec3{ -U, V, -1.0f }; break;
+        }
+        return glm::normalize(Direction);
+    }
+
+    //computeBasisVectors, the tangent frame the sample tables get rotated into
+    void BasisVectors(const Vec3& N, Vec3& S, Vec3& T)
+    {
+        T = glm::cross(N, Vec3{ 0.0f, 1.0f, 0.0f });
+        if (glm::dot(T, T) < 0.00001f)
+        {
+            T = glm::cross(N, Vec3{ 1.0f, 0.0f, 0.0f });
+        }
+        T = glm::normalize(T);
+        S = glm::normalize(glm::cross(N, T));
+    }
+
+    __m128 Select(__m128 Mask, __m128 A, __m128 B)
+    {
+        return _mm_or_ps(_mm_and_ps(Mask, A), _mm_andnot_ps(Mask, B));
+    }
+
+    //atan2 to about 1e-5 radians: Abramowitz and Stegun 4.4.49 on the first octant, then mirrored into place
+    __m128 Atan2(__m128 Y, __m128 X)
+    {
+        const __m128 SignMask = _mm_set1_ps(-0.0f);
+        const __m128 AbsX = _mm_andnot_ps(SignMask, X);
+        const __m128 AbsY = _mm_andnot_ps(SignMask, Y);
+        const __m128 A = _mm_div_ps(_mm_min_ps(AbsX, AbsY), _mm_max_ps(_mm_max_ps(AbsX, AbsY), _mm_set1_ps(1e-30f)));
+        const __m128 S = _mm_mul_ps(A, A);
+        __m128 R = _mm_set1_ps(0.0208351f);
+        R = _mm_add_ps(_mm_mul_ps(R, S), _mm_set1_ps(-0.0851330f));
+        R = _mm_add_ps(_mm_mul_ps(R, S), _mm_set1_ps(0.1801410f));
+        R = _mm_add_ps(_mm_mul_ps(R, S), _mm_set1_ps(-0.3302995f));
+        R = _mm_add_ps(_mm_mul_ps(R, S), _mm_set1_ps(0.9998660f));
+        R = _mm_mul_ps(R, A);
+        R = Select(_mm_cmpgt_ps(AbsY, AbsX), _mm_sub_ps(_mm_set1_ps(1.57079637f), R), R);
+        R = Select(_mm_cmplt_ps(X, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.14159274f), R), R);
+        return _mm_or_ps(R, _mm_and_ps(Y, SignMask));
+    }
+
+    //Faces and face coordinates of four directions by D3D's cube map table, the major axis picks the face
+    void CubeLookup(__m128 X, __m128 Y, __m128 Z, int32_t (&Faces)[4], __m128& U, __m128& V)
+    {
+        const __m128 SignMask = _mm_set1_ps(-0.0f);
+        const __m128 AbsX = _mm_andnot_ps(SignMask, X);
+        const __m128 AbsY = _mm_andnot_ps(SignMask, Y);
+        const __m128 AbsZ = _mm_andnot_ps(SignMask, Z);
+        const __m128 MajorX = _mm_and_ps(_mm_cmpge_ps(AbsX, AbsY), _mm_cmpge_ps(AbsX, AbsZ));
+        const __m128 MajorY = _mm_andnot_ps(MajorX, _mm_cmpge_ps(AbsY, AbsZ));
+
+        //+X: (-z, -y), -X: (z, -y), +Y: (x, z), -Y: (x, -z), +Z: (x, -y), -Z: (-x, -y)
+        const __m128 ScX = _mm_xor_ps(Z, _mm_xor_ps(_mm_and_ps(X, SignMask), SignMask));
+        const __m128 ScZ = _mm_xor_ps(X, _mm_and_ps(Z, SignMask));
+        const __m128 TcY = _mm_xor_ps(Z, _mm_and_ps(Y, SignMask));
+        const __m128 MinusY = _mm_xor_ps(Y, SignMask);
+
+        const __m128 Major = Select(MajorX, X, Select(MajorY, Y, Z));
+        const __m128 Sc = Select(MajorX, ScX, Select(MajorY, X, ScZ));
+        const __m128 Tc = Select(MajorY, TcY, MinusY);
+        const __m128 Scale = _mm_div_ps(_mm_set1_ps(0.5f), _mm_andnot_ps(SignMask, Major));
+        const __m128 Half = _mm_set1_ps(0.5f);
+        U = _mm_add_ps(_mm_mul_ps(Sc, Scale), Half);
+        V = _mm_add_ps(_mm_mul_ps(Tc, Scale), Half);
+
+        const __m128 Axis = Select(MajorX, _mm_setzero_ps(), Select(MajorY, _mm_set1_ps(2.0f), _mm_set1_ps(4.0f)));
+        const __m128 Negative = _mm_and_ps(_mm_cmplt_ps(Major, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Faces), _mm_cvttps_epi32(_mm_add_ps(Axis, Negative)));
+    }
+
+    //The four texels of a bilinear lookup per lane, as float offsets into the face, and their weights
+    struct Footprints
+    {
+        alignas(16) int32_t Texel[4][4];    //[Corner][Lane]
+        alignas(16) float Weight[4][4];
+    };
+
+    //Bilinear footprints of (U, V) on faces of Size texels, clamped to the face's edge texels. Weight scales
+    //all four corner weights
+    void BilinearFootprints(__m128 U, __m128 V, __m128 Size, __m128 Weight, Footprints& Out)
+    {
+        const __m128 Half = _mm_set1_ps(0.5f);
+        const __m128 One = _mm_set1_ps(1.0f);
+        const __m128 Zero = _mm_setzero_ps();
+        const __m128 X = _mm_sub_ps(_mm_mul_ps(U, Size), Half);
+        const __m128 Y = _mm_sub_ps(_mm_mul_ps(V, Size), Half);
+        //U and V stay within [0, 1] up to rounding, truncating X + 1 floors X
+        const __m128i MinusOne = _mm_set1_epi32(-1);
+        const __m128 FloorX = _mm_cvtepi32_ps(_mm_add_epi32(_mm_cvttps_epi32(_mm_add_ps(X, One)), MinusOne));
+        const __m128 FloorY = _mm_cvtepi32_ps(_mm_add_epi32(_mm_cvttps_epi32(_mm_add_ps(Y, One)), MinusOne));
+        const __m128 FracX = _mm_sub_ps(X, FloorX);
+        const __m128 FracY = _mm_sub_ps(Y, FloorY);
+
+        const __m128 Last = _mm_sub_ps(Size, One);
+        const __m128 X0 = _mm_min_ps(_mm_max_ps(FloorX, Zero), Last);
+        const __m128 X1 = _mm_min_ps(_mm_max_ps(_mm_add_ps(FloorX, One), Zero), Last);
+        const __m128 Row0 = _mm_mul_ps(_mm_min_ps(_mm_max_ps(FloorY, Zero), Last), Size);
+        const __m128 Row1 = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_add_ps(FloorY, One), Zero), Last), Size);
+        //Texel indices stay far below 2^24, exact in floats
+        _mm_store_si128(reinterpret_cast<__m128i*>(Out.Texel[0]), _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(Row0, X0)), 2));
+        _mm_store_si128(reinterpret_cast<__m128i*>(Out.Texel[1]), _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(Row0, X1)), 2));
+        _mm_store_si128(reinterpret_cast<__m128i*>(Out.Texel[2]), _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(Row1, X0)), 2));
+        _mm_store_si128(reinterpret_cast<__m128i*>(Out.Texel[3]), _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(Row1, X1)), 2));
+
+        const __m128 Top = _mm_mul_ps(_mm_sub_ps(One, FracY), Weight);
+        const __m128 Bottom = _mm_mul_ps(FracY, Weight);
+        _mm_store_ps(Out.Weight[0], _mm_mul_ps(_mm_sub_ps(One, FracX), Top));
+        _mm_store_ps(Out.Weight[1], _mm_mul_ps(FracX, Top));
+        _mm_store_ps(Out.Weight[2], _mm_mul_ps(_mm_sub_ps(One, FracX), Bottom));
+        _mm_store_ps(Out.Weight[3], _mm_mul_ps(FracX, Bottom));
+    }
+
+    //Adds the weighted RGBA texels of Footprint to Sum, lane by lane. Lanes whose bit is clear in LaneMask are skipped
+    __m128 Gather(const FloatCube& Cube, const int32_t (&Faces)[4], const int32_t* Mips, int32_t MipOffset, const Footprints& Footprint, int LaneMask, __m128 Sum)
+    {
+        for (int Lane = 0; Lane < 4; ++Lane)
+        {
+            if (LaneMask & (1 << Lane))
+            {
+                const float* Face = Cube.Face(uint32_t(Mips[Lane] + MipOffset), uint32_t(Faces[Lane]));
+                Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(Face + Footprint.Texel[0][Lane]), _mm_set1_ps(Footprint.Weight[0][Lane])));
+                Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(Face + Footprint.Texel[1][Lane]), _mm_set1_ps(Footprint.Weight[1][Lane])));
+                Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(Face + Footprint.Texel[2][Lane]), _mm_set1_ps(Footprint.Weight[2][Lane])));
+                Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(Face + Footprint.Texel[3][Lane]), _mm_set1_ps(Footprint.Weight[3][Lane])));
+            }
+        }
+        return Sum;
+    }
+
+    //Tangent space sample directions with their weights and source mips, padded with zero weights to a multiple
+    //of four. The directions are the same for every texel of a pass, only the frame they are rotated into
+    //changes. A sample's SampleLevel blends Mip and Mip + 1 by Blend, Size is the face size of Mip
+    struct SampleTable
+    {
+        std::vector<float> X, Y, Z, Weight, Blend, Size;
+        std::vector<int32_t> Mip;
+        float TotalWeight = 0.0f;
+
+        void Add(const Vec3& Direction, float InWeight, float Lod, const FloatCube& Source)
+        {
+            const uint32_t Level = std::min(uint32_t(Lod), Source.Levels - 1);
+            X.push_back(Direction.x);
+            Y.push_back(Direction.y);
+            Z.push_back(Direction.z);
+            Weight.push_back(InWeight);
+            Blend.push_back(Level + 1 < Source.Levels ? Lod - float(Level) : 0.0f);
+            Size.push_back(float(Source.MipSize(Level)));
+            Mip.push_back(int32_t(Level));
+            TotalWeight += InWeight;
+        }
+
+        void Pad(const FloatCube& Source)
+        {
+            while (X.size() % 4)
+            {
+                Add(Vec3{ 0.0f, 0.0f, 1.0f }, 0.0f, 0.0f, Source);
+            }
+        }
+    };
+
+    //spmap.hlsl's loop for a roughness, only the samples above the horizon and their MFIS mip levels
+    SampleTable SpecularSamples(uint32_t NumSamples, float Roughness, const FloatCube& Source)
+    {
+        SampleTable Table;
+        const float TexelSolidAngle = 4.0f * PI / (6.0f * float(Source.Size) * float(Source.Size));
+        const float InvNumSamples = 1.0f / float(NumSamples);
+        for (uint32_t i = 0; i < NumSamples; ++i)
+        {
+            const Vec3 Lh = SampleGGX(float(i) * InvNumSamples, RadicalInverse(i), Roughness);
+            //N = V = +Z, reflect it around the half vector
+            const Vec3 Li = 2.0f * Lh.z * Lh - Vec3{ 0.0f, 0.0f, 1.0f };
+            const float CosLi = Li.z;
+            if (CosLi > 0.0f)
+            {
+                const float Pdf = NdfGGX(std::max(Lh.z, 0.0f), Roughness) * 0.25f;
+                const float SampleSolidAngle = 1.0f / (float(NumSamples) * Pdf);
+                const float Lod = std::max(0.5f * std::log2(SampleSolidAngle / TexelSolidAngle) + 1.0f, 0.0f);
+                Table.Add(Li, CosLi, std::min(Lod, float(Source.Levels - 1)), Source);
+            }
+        }
+        Table.Pad(Source);
+        return Table;
+    }
+
+    //Sum of Weight * Source(Li) over the table rotated into (S, T, N). Directions, faces and footprints are
+    //worked out four samples at a time, then each sample adds its RGBA texels
+    __m128 Convolve(const FloatCube& Source, const SampleTable& Table, const Vec3& N, const Vec3& S, const Vec3& T)
+    {
+        const __m128 SX = _mm_set1_ps(S.x), SY = _mm_set1_ps(S.y), SZ = _mm_set1_ps(S.z);
+        const __m128 TX = _mm_set1_ps(T.x), TY = _mm_set1_ps(T.y), TZ = _mm_set1_ps(T.z);
+        const __m128 NX = _mm_set1_ps(N.x), NY = _mm_set1_ps(N.y), NZ = _mm_set1_ps(N.z);
+        const __m128 One = _mm_set1_ps(1.0f);
+
+        __m128 Sum = _mm_setzero_ps();
+        int32_t Faces[4];
+        Footprints Footprint;
+        for (size_t i = 0; i < Table.X.size(); i += 4)
+        {
+            const __m128 LX = _mm_loadu_ps(&Table.X[i]);
+            const __m128 LY = _mm_loadu_ps(&Table.Y[i]);
+            const __m128 LZ = _mm_loadu_ps(&Table.Z[i]);
+            const __m128 WX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(SX, LX), _mm_mul_ps(TX, LY)), _mm_mul_ps(NX, LZ));
+            const __m128 WY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(SY, LX), _mm_mul_ps(TY, LY)), _mm_mul_ps(NY, LZ));
+            const __m128 WZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(SZ, LX), _mm_mul_ps(TZ, LY)), _mm_mul_ps(NZ, LZ));
+            __m128 U, V;
+            CubeLookup(WX, WY, WZ, Faces, U, V);
+
+            const __m128 Weight = _mm_loadu_ps(&Table.Weight[i]);
+            const __m128 Blend = _mm_loadu_ps(&Table.Blend[i]);
+            const __m128 Size = _mm_loadu_ps(&Table.Size[i]);
+            BilinearFootprints(U, V, Size, _mm_mul_ps(Weight, _mm_sub_ps(One, Blend)), Footprint);
+            Sum = Gather(Source, Faces, &Table.Mip[i], 0, Footprint, 0xF, Sum);
+
+            //The next mip for the samples between two
+            const int Blended = _mm_movemask_ps(_mm_cmpgt_ps(Blend, _mm_setzero_ps()));
+            if (Blended)
+            {
+                BilinearFootprints(U, V, _mm_max_ps(_mm_mul_ps(Size, _mm_set1_ps(0.5f)), One), _mm_mul_ps(Weight, Blend), Footprint);
+                Sum = Gather(Source, Faces, &Table.Mip[i], 1, Footprint, Blended, Sum);
+            }
+        }
+        return Sum;
+    }
+
+    __m128 Lerp(__m128 A, __m128 B, float T)
+    {
+        return _mm_add_ps(A, _mm_mul_ps(_mm_sub_ps(B, A), _mm_set1_ps(T)));
+    }
+
+    //Bilinear RGBA of the equirectangular image at (U, V) with the WRAP sampler equirect2cube.hlsl uses
+    __m128 SampleEquirect(const float* Texels, uint32_t Width, uint32_t Height, float U, float V)
+    {
+        const float X = U * float(Width) - 0.5f;
+        const float Y = V * float(Height) - 0.5f;
+        const int32_t FloorX = int32_t(std::floor(X));
+        const int32_t FloorY = int32_t(std::floor(Y));
+        const float FracX = X - float(FloorX);
+        const float FracY = Y - float(FloorY);
+        const auto Wrap = [](int32_t I, uint32_t N) { return size_t((I % int32_t(N) + int32_t(N)) % int32_t(N)); };
+        const size_t X0 = Wrap(FloorX, Width) * 4;
+        const size_t X1 = Wrap(FloorX + 1, Width) * 4;
+        const float* Row0 = Texels + Wrap(FloorY, Height) * Width * 4;
+        const float* Row1 = Texels + Wrap(FloorY + 1, Height) * Width * 4;
+        const __m128 Top = Lerp(_mm_loadu_ps(Row0 + X0), _mm_loadu_ps(Row0 + X1), FracX);
+        const __m128 Bottom = Lerp(_mm_loadu_ps(Row1 + X0), _mm_loadu_ps(Row1 + X1), FracX);
+        return Lerp(Top, Bottom, FracY);
+    }
+
+    void EncodeHalf(const float* Source, size_t Count, uint16_t* Out)
+    {
+        for (size_t i = 0; i < Count; ++i)
+        {
+            Out[i] = glm::packHalf1x16(Source[i]);
+        }
+    }
+
+    //Both use the same subresource order, so a cube encodes as one run of texels
+    BakedTexture EncodeCube(const FloatCube& Cube, ThreadPool& Pool)
+    {
+        BakedTexture Baked = BakedTexture::Allocate(Cube.Size, Cube.Size, 6, Cube.Levels, 4);
+        Pool.ParallelFor(0, Cube.Texels.size(), 64 * 1024, [&](size_t Begin, size_t End)
+        {
+            EncodeHalf(Cube.Texels.data() + Begin, End - Begin, Baked.Texels.data() + Begin);
+        });
+        return Baked;
+    }
+}
+
+BakedTexture BakedTexture::Allocate(uint32_t Width, uint32_t Height, uint32_t ArraySize, uint32_t Levels, uint32_t Channels)
+{
+    BakedTexture Baked;
+    Baked.Width = Width;
+    Baked.Height = Height;
+    Baked.ArraySize = ArraySize;
+    Baked.Levels = Levels;
+    Baked.Channels = Channels;
+    size_t Total = 0;
+    for (uint32_t Slice = 0; Slice < ArraySize; ++Slice)
+    {
+        for (uint32_t Mip = 0; Mip < Levels; ++Mip)
+        {
+            Baked.Offsets.push_back(Total);
+            Total += size_t(Baked.MipWidth(Mip)) * Baked.MipHeight(Mip) * Channels;
+        }
+    }
+    Baked.Texels.resize(Total);
+    return Baked;
+}
+
+IblBaker::IblBaker(ThreadPool& Pool)
+    :IblBaker(Pool, Settings{})
+{
+}
+
+IblBaker::IblBaker(ThreadPool& Pool, const Settings& Config)
+    :m_Pool(Pool)
+    ,m_Settings(Config)
+{
+    if (m_Settings.EnvironmentSize == 0 || m_Settings.BrdfLutSize == 0 || m_Settings.SpecularSamples == 0 || m_Settings.BrdfSamples == 0)
+    {
+        throw std::invalid_argument("IBL sizes and sample counts have to be positive");
+    }
+}
+
+BakedIbl IblBaker::Bake(const Image& Equirect)
+{
+    if (!Equirect.IsHdr())
+    {
+        throw std::invalid_argument("The IBL baker needs an HDR environment image");
+    }
+    return Bake(Equirect.Pixels<float>(), uint32_t(Equirect.Width()), uint32_t(Equirect.Height()), uint32_t(Equirect.Channels()));
+}
+
+BakedIbl IblBaker::Bake(const float* Equirect, uint32_t Width, uint32_t Height, uint32_t Channels)
+{
+    if (!Equirect || Width == 0 || Height == 0 || (Channels != 3 && Channels != 4))
+    {
+        throw std::invalid_argument("The environment has to be an RGB or RGBA float image");
+    }
+
+    m_Stats = {};
+    const uint32_t Size = m_Settings.EnvironmentSize;
+    const uint32_t Levels = NumMipLevels(Size);
+    BakedIbl Result;
+
+    //equirect2cube.hlsl into mip 0 of the unfiltered cube, four texels of a row at a time
+    FloatCube Unfiltered{ Size, Levels };
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+
+        //RGBA like the R32G32B32A32_FLOAT texture Setup uploads, every texel one load. RGB gets an alpha of one
+        std::vector<float> Expanded;
+        const float* Source = Equirect;
+        if (Channels == 3)
+        {
+            Expanded.resize(size_t(Width) * Height * 4, 1.0f);
+            m_Pool.ParallelFor(0, Height, 64, [&](size_t Begin, size_t End)
+            {
+                for (size_t i = Begin * Width; i < End * Width; ++i)
+                {
+                    std::copy(Equirect + i * 3, Equirect + i * 3 + 3, Expanded.data() + i * 4);
+                }
+            });
+            Source = Expanded.data();
+        }
+
+        std::vector<CubeTile> Tiles;
+        AppendTiles(0, Size, 6, Tiles);
+        m_Pool.ParallelFor(0, Tiles.size(), 1, [&](size_t Begin, size_t End)
+        {
+            const __m128 LaneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+            const __m128 InvSize = _mm_set1_ps(1.0f / float(Size));
+            const __m128 One = _mm_set1_ps(1.0f);
+            const __m128 Two = _mm_set1_ps(2.0f);
+            alignas(16) float U[4];
+            alignas(16) float V[4];
+            for (size_t TileIndex = Begin; TileIndex < End; ++TileIndex)
+            {
+                const CubeTile& Tile = Tiles[TileIndex];
+                float* Face = Unfiltered.Face(0, Tile.Face);
+                for (uint32_t Y = Tile.Y0; Y < Tile.Y1; ++Y)
+                {
+                    const __m128 FaceV = _mm_set1_ps(2.0f * (1.0f - float(Y) / float(Size)) - 1.0f);
+                    for (uint32_t X = Tile.X0; X < Tile.X1; X += 4)
+                    {
+                        const __m128 FaceU = _mm_sub_ps(_mm_mul_ps(Two, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(X)), LaneOffsets), InvSize)), One);
+                        const __m128 MinusU = _mm_sub_ps(_mm_setzero_ps(), FaceU);
+                        const __m128 MinusV = _mm_sub_ps(_mm_setzero_ps(), FaceV);
+                        __m128 DX, DY, DZ;
+                        switch (Tile.Face)
+                        {
+                        case 0: DX = One; DY = FaceV; DZ = MinusU; break;
+                        case 1: DX = _mm_sub_ps(_mm_setzero_ps(), One); DY = FaceV; DZ = FaceU; break;
+                        case 2: DX = FaceU; DY = One; DZ = MinusV; break;
+                        case 3: DX = FaceU; DY = _mm_sub_ps(_mm_setzero_ps(), One); DZ = FaceV; break;
+                        case 4: DX = FaceU; DY = FaceV; DZ = One; break;
+                        default: DX = MinusU; DY = FaceV; DZ = _mm_sub_ps(_mm_setzero_ps(), One); break;
+                        }
+                        const __m128 InvLength = _mm_div_ps(One, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(DX, DX), _mm_mul_ps(DY, DY)), _mm_mul_ps(DZ, DZ))));
+                        DX = _mm_mul_ps(DX, InvLength);
+                        DY = _mm_mul_ps(DY, InvLength);
+                        DZ = _mm_mul_ps(DZ, InvLength);
+
+                        //phi = atan2(z, x), theta = acos(y) which is atan2(|xz|, y) for a unit vector
+                        const __m128 Phi = Atan2(DZ, DX);
+                        const __m128 Theta = Atan2(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(DX, DX), _mm_mul_ps(DZ, DZ))), DY);
+                        _mm_store_ps(U, _mm_div_ps(Phi, _mm_set1_ps(TwoPI)));
+                        _mm_store_ps(V, _mm_div_ps(Theta, _mm_set1_ps(PI)));
+
+                        const uint32_t Lanes = std::min(4u, Tile.X1 - X);
+                        for (uint32_t Lane = 0; Lane < Lanes; ++Lane)
+                        {
+                            _mm_storeu_ps(Face + (size_t(Y) * Size + X + Lane) * 4, SampleEquirect(Source, Width, Height, U[Lane], V[Lane]));
+                        }
+                    }
+                }
+            }
+        });
+        m_Stats.EquirectMs = ElapsedMs(Start);
+    }
+
+    //downsample_array.hlsl, the 2x2 box of every texel below, one row of a face per item
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+        for (uint32_t Mip = 1; Mip < Levels; ++Mip)
+        {
+            const uint32_t MipSize = Unfiltered.MipSize(Mip);
+            const uint32_t ParentSize = Unfiltered.MipSize(Mip - 1);
+            m_Pool.ParallelFor(0, size_t(6) * MipSize, std::max<size_t>(1, 4096 / MipSize), [&](size_t Begin, size_t End)
+            {
+                const __m128 Quarter = _mm_set1_ps(0.25f);
+                for (size_t Row = Begin; Row < End; ++Row)
+                {
+                    const uint32_t Face = uint32_t(Row / MipSize);
+                    const uint32_t Y = uint32_t(Row % MipSize);
+                    const float* Parent0 = Unfiltered.Face(Mip - 1, Face) + size_t(2 * Y) * ParentSize * 4;
+                    const float* Parent1 = Parent0 + size_t(ParentSize) * 4;
+                    float* Out = Unfiltered.Face(Mip, Face) + size_t(Y) * MipSize * 4;
+                    for (uint32_t X = 0; X < MipSize; ++X)
+                    {
+                        const __m128 Sum = _mm_add_ps(
+                            _mm_add_ps(_mm_loadu_ps(Parent0 + X * 8), _mm_loadu_ps(Parent0 + X * 8 + 4)),
+                            _mm_add_ps(_mm_loadu_ps(Parent1 + X * 8), _mm_loadu_ps(Parent1 + X * 8 + 4)));
+                        _mm_storeu_ps(Out + X * 4, _mm_mul_ps(Sum, Quarter));
+                    }
+                }
+            });
+        }
+        m_Stats.MipsMs = ElapsedMs(Start);
+    }
+
+    //spmap.hlsl for every mip below 0, mip 0 is the unfiltered copy. All mips in one parallel loop, a coarse
+    //mip costs as much per texel as a fine one
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+        FloatCube Environment{ Size, Levels };
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            std::copy(Unfiltered.Face(0, Face), Unfiltered.Face(0, Face) + size_t(Size) * Size * 4, Environment.Face(0, Face));
+        }
+
+        const float DeltaRoughness = 1.0f / std::max(float(Levels - 1), 1.0f);
+        std::vector<SampleTable> Tables(Levels);
+        std::vector<CubeTile> Tiles;
+        for (uint32_t Mip = 1; Mip < Levels; ++Mip)
+        {
+            Tables[Mip] = SpecularSamples(m_Settings.SpecularSamples, float(Mip) * DeltaRoughness, Unfiltered);
+            AppendTiles(Mip, Environment.MipSize(Mip), 6, Tiles);
+            m_Stats.SpecularTexels += uint64_t(6) * Environment.MipSize(Mip) * Environment.MipSize(Mip);
+        }
+
+        m_Pool.ParallelFor(0, Tiles.size(), 1, [&](size_t Begin, size_t End)
+        {
+            for (size_t TileIndex = Begin; TileIndex < End; ++TileIndex)
+            {
+                const CubeTile& Tile = Tiles[TileIndex];
+                const SampleTable& Table = Tables[Tile.Mip];
+                const uint32_t MipSize = Environment.MipSize(Tile.Mip);
+                float* Face = Environment.Face(Tile.Mip, Tile.Face);
+                for (uint32_t Y = Tile.Y0; Y < Tile.Y1; ++Y)
+                {
+                    for (uint32_t X = Tile.X0; X < Tile.X1; ++X)
+                    {
+                        const Vec3 N = SamplingVector(Tile.Face, float(X), float(Y), MipSize);
+                        Vec3 S, T;
+                        BasisVectors(N, S, T);
+                        const __m128 Color = _mm_mul_ps(Convolve(Unfiltered, Table, N, S, T), _mm_set1_ps(1.0f / Table.TotalWeight));
+                        _mm_storeu_ps(Face + (size_t(Y) * MipSize + X) * 4, Color);
+                        Face[(size_t(Y) * MipSize + X) * 4 + 3] = 1.0f;
+                    }
+                }
+            }
+        });
+        m_Stats.SpecularMs = ElapsedMs(Start);
+
+        const auto EncodeStart = std::chrono::high_resolution_clock::now();
+        Result.Environment = EncodeCube(Environment, m_Pool);
+        m_Stats.EncodeMs += ElapsedMs(EncodeStart);
+    }
+
+    //Nine SH coefficients of the unfiltered mip 0 instead of a convolved irradiance cube
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+        const float* Faces[6];
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            Faces[Face] = Unfiltered.Face(0, Face);
+        }
+        Result.Irradiance = SphericalHarmonics::ProjectIrradiance(m_Pool, Faces, Size);
+        m_Stats.IrradianceTexels = uint64_t(6) * Size * Size;
+        m_Stats.IrradianceMs = ElapsedMs(Start);
+    }
+
+    //spbrdf.hlsl, a row has one roughness and so one set of half vectors, four cosLo of it at a time
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+        const uint32_t LutSize = m_Settings.BrdfLutSize;
+        const uint32_t NumSamples = m_Settings.BrdfSamples;
+        Result.BrdfLut = BakedTexture::Allocate(LutSize, LutSize, 1, 1, 2);
+        m_Stats.BrdfTexels = uint64_t(LutSize) * LutSize;
+
+        m_Pool.ParallelFor(0, LutSize, 4, [&](size_t Begin, size_t End)
+        {
+            std::vector<float> LhX(NumSamples);
+            std::vector<float> LhZ(NumSamples);
+            const float InvNumSamples = 1.0f / float(NumSamples);
+            const __m128 Zero = _mm_setzero_ps();
+            const __m128 One = _mm_set1_ps(1.0f);
+            for (size_t Row = Begin; Row < End; ++Row)
+            {
+                const float Roughness = float(Row) / float(LutSize);
+                for (uint32_t i = 0; i < NumSamples; ++i)
+                {
+                    const Vec3 Lh = SampleGGX(float(i) * InvNumSamples, RadicalInverse(i), Roughness);
+                    LhX[i] = Lh.x;
+                    LhZ[i] = Lh.z;
+                }
+                //Epic's k = r^2 / 2 for IBL
+                const __m128 K = _mm_set1_ps(Roughness * Roughness / 2.0f);
+                const __m128 OneMinusK = _mm_sub_ps(One, K);
+
+                uint16_t* Out = Result.BrdfLut.Texels.data() + size_t(Row) * LutSize * 2;
+                for (uint32_t X = 0; X < LutSize; X += 4)
+                {
+                    const __m128 Lanes = _mm_add_ps(_mm_set1_ps(float(X)), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+                    const __m128 CosLo = _mm_max_ps(_mm_div_ps(Lanes, _mm_set1_ps(float(LutSize))), _mm_set1_ps(0.001f));
+                    const __m128 SinLo = _mm_sqrt_ps(_mm_sub_ps(One, _mm_mul_ps(CosLo, CosLo)));
+                    const __m128 G1Lo = _mm_div_ps(CosLo, _mm_add_ps(_mm_mul_ps(CosLo, OneMinusK), K));
+
+                    __m128 DFG1 = Zero;
+                    __m128 DFG2 = Zero;
+                    for (uint32_t i = 0; i < NumSamples; ++i)
+                    {
+                        const __m128 HalfX = _mm_set1_ps(LhX[i]);
+                        const __m128 CosLh = _mm_set1_ps(LhZ[i]);
+                        const __m128 LoDotLh = _mm_add_ps(_mm_mul_ps(SinLo, HalfX), _mm_mul_ps(CosLo, CosLh));
+                        const __m128 CosLi = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(LoDotLh, LoDotLh), CosLh), CosLo);
+                        const __m128 CosLoLh = _mm_max_ps(LoDotLh, Zero);
+
+                        const __m128 G = _mm_mul_ps(_mm_div_ps(CosLi, _mm_add_ps(_mm_mul_ps(CosLi, OneMinusK), K)), G1Lo);
+                        const __m128 Gv = _mm_div_ps(_mm_mul_ps(G, CosLoLh), _mm_mul_ps(CosLh, CosLo));
+                        const __m128 F1 = _mm_sub_ps(One, CosLoLh);
+                        const __m128 F2 = _mm_mul_ps(F1, F1);
+                        const __m128 Fc = _mm_mul_ps(_mm_mul_ps(F2, F2), F1);
+
+                        const __m128 Above = _mm_cmpgt_ps(CosLi, Zero);
+                        DFG1 = _mm_add_ps(DFG1, _mm_and_ps(Above, _mm_mul_ps(_mm_sub_ps(One, Fc), Gv)));
+                        DFG2 = _mm_add_ps(DFG2, _mm_and_ps(Above, _mm_mul_ps(Fc, Gv)));
+                    }
+
+                    alignas(16) float Scale[4];
+                    alignas(16) float Bias[4];
+                    _mm_store_ps(Scale, _mm_mul_ps(DFG1, _mm_set1_ps(InvNumSamples)));
+                    _mm_store_ps(Bias, _mm_mul_ps(DFG2, _mm_set1_ps(InvNumSamples)));
+                    for (uint32_t Lane = 0; Lane < std::min(4u, LutSize - X); ++Lane)
+                    {
+                        Out[(X + Lane) * 2 + 0] = glm::packHalf1x16(Scale[Lane]);
+                        Out[(X + Lane) * 2 + 1] = glm::packHalf1x16(Bias[Lane]);
+                    }
+                }
+            }
+        });
+        m_Stats.BrdfMs = ElapsedMs(Start);
+    }
+
+    return Result;
+}
+
+void IblBaker::PrintStats() const
+{
+    const double TotalMs = m_Stats.EquirectMs + m_Stats.MipsMs + m_Stats.SpecularMs + m_Stats.IrradianceMs + m_Stats.BrdfMs + m_Stats.EncodeMs;
+    std::printf("IBL bake: %u cube, %u LUT on %u pool threads plus the caller\n", m_Settings.EnvironmentSize,
+        m_Settings.BrdfLutSize, m_Pool.NumThreads());
+    std::printf("  Convert       : %9.2f ms equirect, %.2f ms mips\n", m_Stats.EquirectMs, m_Stats.MipsMs);
+    std::printf("  Specular      : %9.2f ms, %llu texels x %u samples\n", m_Stats.SpecularMs, (unsigned long long)m_Stats.SpecularTexels, m_Settings.SpecularSamples);
+    std::printf("  Irradiance    : %9.2f ms, %llu texels projected onto SH9\n", m_Stats.IrradianceMs, (unsigned long long)m_Stats.IrradianceTexels);
+    std::printf("  BRDF LUT      : %9.2f ms, %llu texels x %u samples\n", m_Stats.BrdfMs, (unsigned long long)m_Stats.BrdfTexels, m_Settings.BrdfSamples);
+    std::printf("  Total         : %9.2f ms, %.2f ms of it float16 encoding\n", TotalMs, m_Stats.EncodeMs);
+}
+
+namespace
+{
+    //A smooth HDR sky over a dark ground with a bright sun, RGBA rows from the top
+    std::vector<float> ProceduralSky(uint32_t Width, uint32_t Height)
+    {
+        std::vector<float> Texels(size_t(Width) * Height * 4);
+        const Vec3 Sun = glm::normalize(Vec3{ 0.4f, 0.6f, -0.7f });
+        for (uint32_t Y = 0; Y < Height; ++Y)
+        {
+            for (uint32_t X = 0; X < Width; ++X)
+            {
+                const float Phi = (float(X) + 0.5f) / float(Width) * TwoPI;
+                const float Theta = (float(Y) + 0.5f) / float(Height) * PI;
+                const Vec3 Direction{ std::sin(Theta) * std::cos(Phi), std::cos(Theta), std::sin(Theta) * std::sin(Phi) };
+                const float Up = std::max(Direction.y, 0.0f);
+                const Vec3 Sky = Direction.y > 0.0f ? Vec3{ 0.3f, 0.5f, 1.0f } * (0.5f + Up) : Vec3{ 0.15f, 0.12f, 0.1f };
+                const Vec3 Color = Sky + Vec3{ 50.0f, 45.0f, 35.0f } * std::pow(std::max(glm::dot(Direction, Sun), 0.0f), 64.0f);
+                float* Out = Texels.data() + (size_t(Y) * Width + X) * 4;
+                Out[0] = Color.x;
+                Out[1] = Color.y;
+                Out[2] = Color.z;
+                Out[3] = 1.0f;
+            }
+        }
+        return Texels;
+    }
+
+    //The shaders one texel at a time in plain scalar code, for the self test
+    namespace Reference
+    {
+        //Bilinear RGBA at (U, V) of a Size x Size face, clamped to the face's edge texels
+        Vec4 SampleFace(const float* Face, uint32_t Size, float U, float V)
+        {
+            const float X = U * float(Size) - 0.5f;
+            const float Y = V * float(Size) - 0.5f;
+            const float FloorX = std::floor(X);
+            const float FloorY = std::floor(Y);
+            const int32_t Last = int32_t(Size) - 1;
+            const auto Texel = [&](float TexelX, float TexelY)
+            {
+                const float* Color = Face + (size_t(std::clamp(int32_t(TexelY), 0, Last)) * Size + size_t(std::clamp(int32_t(TexelX), 0, Last))) * 4;
+                return Vec4{ Color[0], Color[1], Color[2], Color[3] };
+            };
+            const Vec4 Top = glm::mix(Texel(FloorX, FloorY), Texel(FloorX + 1.0f, FloorY), X - FloorX);
+            const Vec4 Bottom = glm::mix(Texel(FloorX, FloorY + 1.0f), Texel(FloorX + 1.0f, FloorY + 1.0f), X - FloorX);
+            return glm::mix(Top, Bottom, Y - FloorY);
+        }
+
+        Vec4 SampleCube(const FloatCube& Cube, const Vec3& Direction, float Lod)
+        {
+            const Vec3 A = glm::abs(Direction);
+            uint32_t Face;
+            float Major, Sc, Tc;
+            if (A.x >= A.y && A.x >= A.z)
+            {
+                Face = Direction.x >= 0.0f ? 0 : 1;
+                Major = A.x;
+                Sc = Direction.x >= 0.0f ? -Direction.z : Direction.z;
+                Tc = -Direction.y;
+            }
+            else if (A.y >= A.z)
+            {
+                Face = Direction.y >= 0.0f ? 2 : 3;
+                Major = A.y;
+                Sc = Direction.x;
+                Tc = Direction.y >= 0.0f ? Direction.z : -Direction.z;
+            }
+            else
+            {
+                Face = Direction.z >= 0.0f ? 4 : 5;
+                Major = A.z;
+                Sc = Direction.z >= 0.0f ? Direction.x : -Direction.x;
+                Tc = -Direction.y;
+            }
+            const float U = 0.5f * (Sc / Major + 1.0f);
+            const float V = 0.5f * (Tc / Major + 1.0f);
+            Lod = std::min(Lod, float(Cube.Levels - 1));
+            const uint32_t Mip = uint32_t(Lod);
+            const Vec4 Color = SampleFace(Cube.Face(Mip, Face), Cube.MipSize(Mip), U, V);
+            if (Mip + 1 >= Cube.Levels)
+            {
+                return Color;
+            }
+            return glm::mix(Color, SampleFace(Cube.Face(Mip + 1, Face), Cube.MipSize(Mip + 1), U, V), Lod - float(Mip));
+        }
+
+        void Equirect2Cube(const std::vector<float>& Equirect, uint32_t Width, uint32_t Height, FloatCube& Out)
+        {
+            for (uint32_t Face = 0; Face < 6; ++Face)
+            {
+                for (uint32_t Y = 0; Y < Out.Size; ++Y)
+                {
+                    for (uint32_t X = 0; X < Out.Size; ++X)
+                    {
+                        const Vec3 V = SamplingVector(Face, float(X), float(Y), Out.Size);
+                        const float Phi = std::atan2(V.z, V.x);
+                        const float Theta = std::acos(V.y);
+                        _mm_storeu_ps(Out.Face(0, Face) + (size_t(Y) * Out.Size + X) * 4, SampleEquirect(Equirect.data(), Width, Height, Phi / TwoPI, Theta / PI));
+                    }
+                }
+            }
+        }
+
+        void Downsample(FloatCube& Cube)
+        {
+            for (uint32_t Mip = 1; Mip < Cube.Levels; ++Mip)
+            {
+                const uint32_t Size = Cube.MipSize(Mip);
+                const uint32_t Parent = Cube.MipSize(Mip - 1);
+                for (uint32_t Face = 0; Face < 6; ++Face)
+                {
+                    for (uint32_t i = 0; i < Size * Size * 4; ++i)
+                    {
+                        const uint32_t X = i / 4 % Size, Y = i / 4 / Size, C = i % 4;
+                        const float* P = Cube.Face(Mip - 1, Face);
+                        Cube.Face(Mip, Face)[i] = 0.25f * (P[((2 * Y) * Parent + 2 * X) * 4 + C] + P[((2 * Y) * Parent + 2 * X + 1) * 4 + C] +
+                            P[((2 * Y + 1) * Parent + 2 * X) * 4 + C] + P[((2 * Y + 1) * Parent + 2 * X + 1) * 4 + C]);
+                    }
+                }
+            }
+        }
+
+        Vec3 Spmap(const FloatCube& Source, const Vec3& N, float Roughness, uint32_t NumSamples)
+        {
+            const float Wt = 4.0f * PI / (6.0f * float(Source.Size) * float(Source.Size));
+            Vec3 S, T;
+            BasisVectors(N, S, T);
+            Vec3 Color{ 0.0f };
+            float Weight = 0.0f;
+            for (uint32_t i = 0; i < NumSamples; ++i)
+            {
+                //Reflected in tangent space and then rotated, reflecting the rotated half vector is the same
+                //direction but rounds differently, which picks other faces on cube corners
+                const Vec3 Lh = SampleGGX(float(i) * (1.0f / float(NumSamples)), RadicalInverse(i), Roughness);
+                const Vec3 Reflected = 2.0f * Lh.z * Lh - Vec3{ 0.0f, 0.0f, 1.0f };
+                const Vec3 Li = S * Reflected.x + T * Reflected.y + N * Reflected.z;
+                const float CosLi = Reflected.z;
+                if (CosLi > 0.0f)
+                {
+                    const float Pdf = NdfGGX(std::max(Lh.z, 0.0f), Roughness) * 0.25f;
+                    const float Ws = 1.0f / (float(NumSamples) * Pdf);
+                    const float MipLevel = std::max(0.5f * std::log2(Ws / Wt) + 1.0f, 0.0f);
+                    Color += Vec3{ SampleCube(Source, Li, MipLevel) } * CosLi;
+                    Weight += CosLi;
+                }
+            }
+            return Color / Weight;
+        }
+
+        //The uniform hemisphere estimate the irradiance cube used to be convolved with
+        Vec3 Irmap(const FloatCube& Source, const Vec3& N, uint32_t NumSamples)
+        {
+            Vec3 S, T;
+            BasisVectors(N, S, T);
+            Vec3 Irradiance{ 0.0f };
+            for (uint32_t i = 0; i < NumSamples; ++i)
+            {
+                const float U1 = float(i) * (1.0f / float(NumSamples));
+                const float U2 = RadicalInverse(i);
+                const float U1p = std::sqrt(std::max(0.0f, 1.0f - U1 * U1));
+                const Vec3 Sample{ std::cos(TwoPI * U2) * U1p, std::sin(TwoPI * U2) * U1p, U1 };
+                const Vec3 Li = S * Sample.x + T * Sample.y + N * Sample.z;
+                Irradiance += 2.0f * Vec3{ SampleCube(Source, Li, 0.0f) } * std::max(0.0f, glm::dot(Li, N));
+            }
+            return Irradiance / float(NumSamples);
+        }
+
+        glm::vec2 Spbrdf(float CosLo, float Roughness, uint32_t NumSamples)
+        {
+            CosLo = std::max(CosLo, 0.001f);
+            const Vec3 Lo{ std::sqrt(1.0f - CosLo * CosLo), 0.0f, CosLo };
+            const float K = Roughness * Roughness / 2.0f;
+            const auto G1 = [K](float CosTheta) { return CosTheta / (CosTheta * (1.0f - K) + K); };
+            float DFG1 = 0.0f;
+            float DFG2 = 0.0f;
+            for (uint32_t i = 0; i < NumSamples; ++i)
+            {
+                const Vec3 Lh = SampleGGX(float(i) * (1.0f / float(NumSamples)), RadicalInverse(i), Roughness);
+                const Vec3 Li = 2.0f * glm::dot(Lo, Lh) * Lh - Lo;
+                const float CosLoLh = std::max(glm::dot(Lo, Lh), 0.0f);
+                if (Li.z > 0.0f)
+                {
+                    const float Gv = G1(Li.z) * G1(CosLo) * CosLoLh / (Lh.z * CosLo);
+                    const float Fc = std::pow(1.0f - CosLoLh, 5.0f);
+                    DFG1 += (1.0f - Fc) * Gv;
+                    DFG2 += Fc * Gv;
+                }
+            }
+            return glm::vec2{ DFG1, DFG2 } / float(NumSamples);
+        }
+    }
+}
+
+bool IblBaker::SelfTest()
+{
+    TestHarness Harness;
+
+    //Largest difference of a baked float16 channel to the reference, relative above 1
+    const auto MaxError = [](const BakedTexture& Baked, uint32_t Mip, uint32_t Slice, const std::function<float(uint32_t X, uint32_t Y, uint32_t Channel)>& Expected)
+    {
+        float Error = 0.0f;
+        const uint16_t* Texels = Baked.Subresource(Mip, Slice);
+        for (uint32_t Y = 0; Y < Baked.MipHeight(Mip); ++Y)
+        {
+            for (uint32_t X = 0; X < Baked.MipWidth(Mip); ++X)
+            {
+                for (uint32_t Channel = 0; Channel < Baked.Channels; ++Channel)
+                {
+                    const float Value = glm::unpackHalf1x16(Texels[(size_t(Y) * Baked.MipWidth(Mip) + X) * Baked.Channels + Channel]);
+                    const float Reference = Expected(X, Y, Channel);
+                    Error = std::max(Error, std::abs(Value - Reference) / std::max(1.0f, std::abs(Reference)));
+                }
+            }
+        }
+        return Error;
+    };
+
+    ThreadPool& Pool = ThreadPool::Get();
+    Settings Small;
+    Small.EnvironmentSize = 16;
+    Small.SpecularSamples = 64;
+    Small.BrdfLutSize = 10;
+    Small.BrdfSamples = 128;
+
+    const uint32_t SkyWidth = 64;
+    const uint32_t SkyHeight = 32;
+    const std::vector<float> Sky = ProceduralSky(SkyWidth, SkyHeight);
+    FloatCube Expected{ Small.EnvironmentSize, NumMipLevels(Small.EnvironmentSize) };
+    Reference::Equirect2Cube(Sky, SkyWidth, SkyHeight, Expected);
+    Reference::Downsample(Expected);
+
+    IblBaker Baker{ Pool, Small };
+    const BakedIbl Baked = Baker.Bake(Sky.data(), SkyWidth, SkyHeight, 4);
+
+    Harness.Run("Equirect to cube", [&]()
+    {
+        Harness.Check(Baked.Environment.Width == 16 && Baked.Environment.ArraySize == 6 && Baked.Environment.Levels == 5 && Baked.Environment.Channels == 4,
+            "the environment is a 16x16 cube with a full mip chain");
+        float Error = 0.0f;
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            Error = std::max(Error, MaxError(Baked.Environment, 0, Face, [&](uint32_t X, uint32_t Y, uint32_t Channel)
+            {
+                return Expected.Face(0, Face)[(size_t(Y) * 16 + X) * 4 + Channel];
+            }));
+        }
+        Harness.Check(Error < 2e-3f, "mip 0 matches equirect2cube.hlsl within float16 precision");
+
+        //Random texels, the SSE atan2 has to land on the same texels as std::atan2 and std::acos
+        std::mt19937 Random{ 3 };
+        std::uniform_real_distribution<float> Unit(0.0f, 1.0f);
+        std::vector<float> Noise(size_t(SkyWidth) * SkyHeight * 4);
+        for (float& Value : Noise)
+        {
+            Value = Unit(Random);
+        }
+        Settings CubeOnly = Small;
+        CubeOnly.EnvironmentSize = 32;
+        IblBaker NoiseBaker{ Pool, CubeOnly };
+        const BakedIbl NoiseBaked = NoiseBaker.Bake(Noise.data(), SkyWidth, SkyHeight, 4);
+        FloatCube NoiseExpected{ 32, 1 };
+        Reference::Equirect2Cube(Noise, SkyWidth, SkyHeight, NoiseExpected);
+        Error = 0.0f;
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            Error = std::max(Error, MaxError(NoiseBaked.Environment, 0, Face, [&](uint32_t X, uint32_t Y, uint32_t Channel)
+            {
+                return NoiseExpected.Face(0, Face)[(size_t(Y) * 32 + X) * 4 + Channel];
+            }));
+        }
+        Harness.Check(Error < 2e-3f, "noise comes out of the same texels");
+
+        //An RGB image gets an alpha of one
+        std::vector<float> Rgb(size_t(SkyWidth) * SkyHeight * 3);
+        for (size_t i = 0; i < size_t(SkyWidth) * SkyHeight; ++i)
+        {
+            std::copy(Sky.begin() + i * 4, Sky.begin() + i * 4 + 3, Rgb.begin() + i * 3);
+        }
+        IblBaker RgbBaker{ Pool, Small };
+        Harness.Check(RgbBaker.Bake(Rgb.data(), SkyWidth, SkyHeight, 3).Environment.Texels == Baked.Environment.Texels, "3 channels bake like 4");
+    });
+
+    Harness.Run("Specular prefilter", [&]()
+    {
+        const float DeltaRoughness = 1.0f / float(Expected.Levels - 1);
+        float Error = 0.0f;
+        for (uint32_t Mip = 1; Mip < Expected.Levels; ++Mip)
+        {
+            for (uint32_t Face = 0; Face < 6; ++Face)
+            {
+                Error = std::max(Error, MaxError(Baked.Environment, Mip, Face, [&](uint32_t X, uint32_t Y, uint32_t Channel)
+                {
+                    const Vec3 N = SamplingVector(Face, float(X), float(Y), Expected.MipSize(Mip));
+                    return Channel == 3 ? 1.0f : Reference::Spmap(Expected, N, float(Mip) * DeltaRoughness, Small.SpecularSamples)[Channel];
+                }));
+            }
+        }
+        Harness.Check(Error < 4e-3f, "every mip matches spmap.hlsl");
+    });
+
+    Harness.Run("Irradiance", [&]()
+    {
+        const float* Faces[6];
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            Faces[Face] = Expected.Face(0, Face);
+        }
+        const IrradianceSH Projected = SphericalHarmonics::ProjectIrradiance(Pool, Faces, Small.EnvironmentSize);
+
+        //Against the projection of the reference cube, and the cosine integral up to the L2 truncation
+        float Error = 0.0f;
+        float Truncation = 0.0f;
+        float Peak = 0.0f;
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            for (uint32_t Y = 0; Y < 4; ++Y)
+            {
+                for (uint32_t X = 0; X < 4; ++X)
+                {
+                    const Vec3 N = SamplingVector(Face, float(X), float(Y), 4);
+                    const Vec3 Value = Baked.Irradiance.Evaluate(N);
+                    const Vec3 Integral = Reference::Irmap(Expected, N, 4096);
+                    for (int Channel = 0; Channel < 3; ++Channel)
+                    {
+                        Error = std::max(Error, std::abs(Value[Channel] - Projected.Evaluate(N)[Channel]) / std::max(1.0f, Value[Channel]));
+                        Truncation = std::max(Truncation, std::abs(Value[Channel] - Integral[Channel]));
+                        Peak = std::max(Peak, Integral[Channel]);
+                    }
+                }
+            }
+        }
+        Harness.Check(Error < 4e-3f, "matches the projection of the reference cube");
+        Harness.Check(Truncation < Peak * 0.05f, "stays close to the cosine integral");
+    });
+
+    Harness.Run("BRDF LUT", [&]()
+    {
+        Harness.Check(Baked.BrdfLut.Width == 10 && Baked.BrdfLut.Height == 10 && Baked.BrdfLut.Channels == 2, "the LUT is 10x10 with two channels");
+        const float Error = MaxError(Baked.BrdfLut, 0, 0, [&](uint32_t X, uint32_t Y, uint32_t Channel)
+        {
+            return Reference::Spbrdf(float(X) / 10.0f, float(Y) / 10.0f, Small.BrdfSamples)[Channel];
+        });
+        Harness.Check(Error < 2e-3f, "matches spbrdf.hlsl, including the lanes past a multiple of four");
+
+        //A mirror reflects everything, scale and bias add up to one in the first row
+        float Mirror = 0.0f;
+        for (uint32_t X = 0; X < 10; ++X)
+        {
+            Mirror = std::max(Mirror, std::abs(glm::unpackHalf1x16(Baked.BrdfLut.Texels[X * 2]) + glm::unpackHalf1x16(Baked.BrdfLut.Texels[X * 2 + 1]) - 1.0f));
+        }
+        Harness.Check(Mirror < 2e-3f, "roughness 0 sums to one");
+    });
+
+    Harness.Run("White furnace", [&]()
+    {
+        const std::vector<float> White(size_t(SkyWidth) * SkyHeight * 4, 1.0f);
+        IblBaker WhiteBaker{ Pool, Small };
+        const BakedIbl Furnace = WhiteBaker.Bake(White.data(), SkyWidth, SkyHeight, 4);
+        bool bWhite = true;
+        for (uint16_t Texel : Furnace.Environment.Texels)
+        {
+            bWhite &= std::abs(glm::unpackHalf1x16(Texel) - 1.0f) < 1e-3f;
+        }
+        Harness.Check(bWhite, "a white environment prefilters to white in every mip");
+
+        //The cosine lobe over the hemisphere integrates to PI, which the 1/PI cancels
+        bool bIrradiance = true;
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            for (uint32_t Y = 0; Y < 4; ++Y)
+            {
+                for (uint32_t X = 0; X < 4; ++X)
+                {
+                    const Vec3 Irradiance = Furnace.Irradiance.Evaluate(SamplingVector(Face, float(X), float(Y), 4));
+                    bIrradiance &= std::abs(Irradiance.x - 1.0f) < 1e-3f && std::abs(Irradiance.y - 1.0f) < 1e-3f && std::abs(Irradiance.z - 1.0f) < 1e-3f;
+                }
+            }
+        }
+        Harness.Check(bIrradiance, "a white environment irradiates one everywhere");
+    });
+
+    Harness.Run("Thread count independence", [&]()
+    {
+        ThreadPool Serial{ 0 };
+        ThreadPool Parallel{ 3 };
+        IblBaker SerialBaker{ Serial, Small };
+        IblBaker ParallelBaker{ Parallel, Small };
+        const BakedIbl A = SerialBaker.Bake(Sky.data(), SkyWidth, SkyHeight, 4);
+        const BakedIbl B = ParallelBaker.Bake(Sky.data(), SkyWidth, SkyHeight, 4);
+        Harness.Check(A.Environment.Texels == B.Environment.Texels && std::memcmp(A.Irradiance.Coefficients, B.Irradiance.Coefficients, sizeof(A.Irradiance.Coefficients)) == 0 && A.BrdfLut.Texels == B.BrdfLut.Texels,
+            "0 and 3 pool threads bake the same texels");
+    });
+
+    return Harness.Finish();
+}
+
+void IblBaker::Benchmark(const std::string& EnvironmentFile, uint32_t EnvironmentSize, int Iterations)
+{
+    Iterations = Iterations > 0 ? Iterations : 1;
+
+    std::shared_ptr<Image> File;
+    std::vector<float> Sky;
+    uint32_t Width = 2048;
+    uint32_t Height = 1024;
+    if (!EnvironmentFile.empty())
+    {
+        File = Image::FromFile(EnvironmentFile);
+        if (!File->IsHdr())
+        {
+            throw std::invalid_argument("The IBL benchmark needs an HDR environment image");
+        }
+        Width = uint32_t(File->Width());
+        Height = uint32_t(File->Height());
+    }
+    else
+    {
+        Sky = ProceduralSky(Width, Height);
+    }
+
+    Settings Config;
+    Config.EnvironmentSize = EnvironmentSize;
+    ThreadPool& Pool = ThreadPool::Get();
+    IblBaker Baker{ Pool, Config };
+
+    Stats Total;
+    double TotalMs = 0.0;
+    for (int i = 0; i < Iterations; ++i)
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+        if (File)
+        {
+            Baker.Bake(*File);
+        }
+        else
+        {
+            Baker.Bake(Sky.data(), Width, Height, 4);
+        }
+        TotalMs += ElapsedMs(Start);
+
+        const Stats& Last = Baker.LastStats();
+        Total.EquirectMs += Last.EquirectMs;
+        Total.MipsMs += Last.MipsMs;
+        Total.SpecularMs += Last.SpecularMs;
+        Total.IrradianceMs += Last.IrradianceMs;
+        Total.BrdfMs += Last.BrdfMs;
+        Total.EncodeMs += Last.EncodeMs;
+    }
+
+    const Stats& Last = Baker.LastStats();
+    const uint64_t FaceTexels = uint64_t(6) * EnvironmentSize * EnvironmentSize;
+    const auto Rate = [Iterations](double Texels, double Ms) { return Texels / (Ms / Iterations) / 1000.0; };
+    std::printf("IBL bake benchmark: %s %ux%u into a %u cube (%d iterations, %u pool threads plus the caller)\n",
+        EnvironmentFile.empty() ? "procedural sky" : EnvironmentFile.c_str(), Width, Height, EnvironmentSize, Iterations, Pool.NumThreads());
+    std::printf("  Equirect      : %9.2f ms, %10.2f Mtexel/s\n", Total.EquirectMs / Iterations, Rate(double(FaceTexels), Total.EquirectMs));
+    std::printf("  Mips          : %9.2f ms, %10.2f Mtexel/s\n", Total.MipsMs / Iterations, Rate(double(FaceTexels) / 3.0, Total.MipsMs));
+    std::printf("  Specular      : %9.2f ms, %10.4f Mtexel/s, %.1f Msample/s (%u samples)\n", Total.SpecularMs / Iterations,
+        Rate(double(Last.SpecularTexels), Total.SpecularMs), Rate(double(Last.SpecularTexels) * Config.SpecularSamples, Total.SpecularMs), Config.SpecularSamples);
+    std::printf("  Irradiance    : %9.2f ms, %10.2f Mtexel/s projected onto SH9\n", Total.IrradianceMs / Iterations,
+        Rate(double(Last.IrradianceTexels), Total.IrradianceMs));
+    std::printf("  BRDF LUT      : %9.2f ms, %10.4f Mtexel/s, %.1f Msample/s (%u samples)\n", Total.BrdfMs / Iterations,
+        Rate(double(Last.BrdfTexels), Total.BrdfMs), Rate(double(Last.BrdfTexels) * Config.BrdfSamples, Total.BrdfMs), Config.BrdfSamples);
+    std::printf("  Encode        : %9.2f ms\n", Total.EncodeMs / Iterations);
+    std::printf("  Total         : %9.2f ms, %10.2f Mtexel/s baked\n", TotalMs / Iterations,
+        Rate(double(FaceTexels + Last.SpecularTexels + Last.IrradianceTexels + Last.BrdfTexels), TotalMs));
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SphericalHarmonics.h"
+
+class Image;
+class ThreadPool;
+
+// Float16 texels of one texture in D3D12 subresource order, mip + slice * Levels like D3D12CalcSubresource,
+// every row tightly packed. Each subresource goes straight into a D3D12_SUBRESOURCE_DATA, see
+// Texture::CreateTexture.
+struct BakedTexture
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t ArraySize = 0;
+    uint32_t Levels = 0;
+    uint32_t Channels = 0;          // 4 for DXGI_FORMAT_R16G16B16A16_FLOAT, 2 for DXGI_FORMAT_R16G16_FLOAT
+    std::vector<uint16_t> Texels;
+    std::vector<size_t> Offsets;    // Per subresource, into Texels
+
+    // Zeroed texels and the offsets of every subresource.
+    static BakedTexture Allocate(uint32_t Width, uint32_t Height, uint32_t ArraySize, uint32_t Levels, uint32_t Channels);
+
+    uint32_t NumSubresources() const { return ArraySize * Levels; }
+    uint32_t MipWidth(uint32_t Mip) const { return Width >> Mip ? Width >> Mip : 1; }
+    uint32_t MipHeight(uint32_t Mip) const { return Height >> Mip ? Height >> Mip : 1; }
+    size_t RowPitch(uint32_t Mip) const { return size_t(MipWidth(Mip)) * Channels * sizeof(uint16_t); }
+    const uint16_t* Subresource(uint32_t Mip, uint32_t Slice) const { return Texels.data() + Offsets[Mip + Slice * Levels]; }
+};
+
+// What D3D12Renderer's Setup precomputes for image based lighting.
+struct BakedIbl
+{
+    BakedTexture Environment;   // m_EnvTexture, a cube with the GGX prefiltered environment in every mip below 0
+    IrradianceSH Irradiance;    // ShadingCB::Irradiance, projected from the unfiltered mip 0
+    BakedTexture BrdfLut;       // m_spBRDF_LUT, the split-sum scale and bias by (cosLo, roughness)
+};
+
+// CPU reference for the IBL precompute shaders, equirect2cube.hlsl, the downsample_array.hlsl mip chain,
+// spmap.hlsl and spbrdf.hlsl, with the same sample sequences, texel mapping and mip selection so
+// its output can stand in for theirs. The direction math runs four lanes at a time with SSE and the texel
+// fetches work on whole RGBA texels, every stage splits its faces, mips and 32x32 texel tiles over the thread
+// pool. Cube lookups clamp to the face instead of filtering across its edges like the GPU does. Irradiance is
+// the SphericalHarmonics projection of mip 0.
+class IblBaker
+{
+public:
+    // Changes whenever the baked output does, IblCache keys on it.
+    static const uint32_t Version = 2;
+
+    struct Settings
+    {
+        uint32_t EnvironmentSize = 1024;        // Face size of mip 0, the whole chain below it gets prefiltered
+        uint32_t SpecularSamples = 1024;        // Per texel, spmap.hlsl's NumSamples
+        uint32_t BrdfLutSize = 256;
+        uint32_t BrdfSamples = 1024;            // Per texel, spbrdf.hlsl's NumSamples
+    };
+
+    struct Stats
+    {
+        double EquirectMs = 0.0;
+        double MipsMs = 0.0;
+        double SpecularMs = 0.0;
+        double IrradianceMs = 0.0;
+        double BrdfMs = 0.0;
+        double EncodeMs = 0.0;
+        uint64_t SpecularTexels = 0;    // Prefiltered, mip 0 is only converted
+        uint64_t IrradianceTexels = 0;  // Projected
+        uint64_t BrdfTexels = 0;
+    };
+
+    explicit IblBaker(ThreadPool& Pool);
+    IblBaker(ThreadPool& Pool, const Settings& Config);
+
+    const Settings& GetSettings() const { return m_Settings; }
+
+    // Equirect has to be an HDR image with 3 or 4 channels, like the environment1.hdr Setup loads.
+    BakedIbl Bake(const Image& Equirect);
+    // Rows of Width * Channels floats from the top, Channels is 3 or 4.
+    BakedIbl Bake(const float* Equirect, uint32_t Width, uint32_t Height, uint32_t Channels);
+
+    const Stats& LastStats() const { return m_Stats; }
+    // Stage times and texel rates of the last Bake.
+    void PrintStats() const;
+
+    // Compares every stage against a scalar transcription of its shader on small sizes, checks the furnace
+    // test of a constant environment and identical output on any thread count. No GPU needed.
+    static bool SelfTest();
+
+    // Bakes EnvironmentFile, or a procedural sky when it is empty, at the default settings with a cube of
+    // EnvironmentSize and prints the texels per second of every stage.
+    static void Benchmark(const std::string& EnvironmentFile, uint32_t EnvironmentSize, int Iterations);
+
+private:
+    ThreadPool& m_Pool;
+    const Settings m_Settings;
+    Stats m_Stats;
+};
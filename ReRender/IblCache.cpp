@@ -0,0 +1,385 @@
+#include "IblCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+#include "Hash.h"
+#include "Image.h"
+#include "MappedFile.h"
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    //Bytes of a tightly packed float16 texture, 0 for dimensions no bake produces
+    uint64_t TextureBytes(uint32_t Width, uint32_t Height, uint32_t ArraySize, uint32_t Levels, uint32_t Channels)
+    {
+        if (Width == 0 || Height == 0 || Width > 16384 || Height > 16384 || ArraySize == 0 || ArraySize > 6 ||
+            Levels == 0 || Levels > 15 || (Channels != 2 && Channels != 4))
+        {
+            return 0;
+        }
+        uint64_t Texels = 0;
+        for (uint32_t Mip = 0; Mip < Levels; ++Mip)
+        {
+            Texels += uint64_t(Width >> Mip ? Width >> Mip : 1) * (Height >> Mip ? Height >> Mip : 1);
+        }
+        return Texels * ArraySize * Channels * sizeof(uint16_t);
+    }
+
+    IblCacheTextureHeader DescribeTexture(const BakedTexture& Texture, uint64_t Offset)
+    {
+        IblCacheTextureHeader Header = {};
+        Header.Width = Texture.Width;
+        Header.Height = Texture.Height;
+        Header.ArraySize = Texture.ArraySize;
+        Header.Levels = Texture.Levels;
+        Header.Channels = Texture.Channels;
+        Header.Offset = Offset;
+        Header.Size = Texture.Texels.size() * sizeof(uint16_t);
+        return Header;
+    }
+
+    bool ReadTexture(const MappedFile& File, const IblCacheTextureHeader& Header, IblCacheTexture& Texture)
+    {
+        const uint64_t Expected = TextureBytes(Header.Width, Header.Height, Header.ArraySize, Header.Levels, Header.Channels);
+        if (Expected == 0 || Header.Size != Expected || Header.Offset % IblCache::BlockAlignment != 0 ||
+            Header.Offset > File.Size() || Header.Size > File.Size() - Header.Offset)
+        {
+            return false;
+        }
+
+        Texture.Width = Header.Width;
+        Texture.Height = Header.Height;
+        Texture.ArraySize = Header.ArraySize;
+        Texture.Levels = Header.Levels;
+        Texture.Channels = Header.Channels;
+        Texture.Texels = File.At<uint16_t>(Header.Offset);
+        Texture.Offsets.clear();
+        size_t Total = 0;
+        for (uint32_t Slice = 0; Slice < Texture.ArraySize; ++Slice)
+        {
+            for (uint32_t Mip = 0; Mip < Texture.Levels; ++Mip)
+            {
+                Texture.Offsets.push_back(Total);
+                Total += size_t(Texture.MipWidth(Mip)) * Texture.MipHeight(Mip) * Texture.Channels;
+            }
+        }
+        return true;
+    }
+}
+
+std::string IblCache::CachePath(const std::string& SourceFile)
+{
+    return SourceFile + ".ribl";
+}
+
+uint64_t IblCache::HashFiles(const std::vector<std::string>& Files)
+{
+    uint64_t Result = Hash::OffsetBasis;
+    for (const std::string& FileName : Files)
+    {
+        std::shared_ptr<MappedFile> File = MappedFile::Open(FileName);
+        if (!File)
+        {
+            return 0;
+        }
+        //Length prefixed so moving bytes from one file to the next changes the hash
+        Result = Hash::Fnv1a64(File->Data(), File->Size(), Hash::Combine(Result, uint64_t(File->Size())));
+    }
+    return Result;
+}
+
+uint64_t IblCache::HashSettings(const IblBaker::Settings& Config)
+{
+    uint64_t Result = Hash::Combine(Hash::OffsetBasis, Config.EnvironmentSize);
+    Result = Hash::Combine(Result, Config.SpecularSamples);
+    Result = Hash::Combine(Result, Config.BrdfLutSize);
+    return Hash::Combine(Result, Config.BrdfSamples);
+}
+
+std::shared_ptr<const IblCacheEntry> IblCache::Load(const std::string& CacheFile, const IblCacheKey& Key)
+{
+    std::shared_ptr<MappedFile> File = MappedFile::Open(CacheFile);
+    if (!File || File->Size() < sizeof(IblCacheHeader))
+    {
+        return nullptr;
+    }
+
+    const IblCacheHeader& Header = *File->At<IblCacheHeader>(0);
+    if (Header.Magic != Magic ||
+        Header.Version != Version ||
+        Header.SourceHash != Key.SourceHash ||
+        Header.SettingsHash != Key.SettingsHash ||
+        Header.ProducerHash != Key.ProducerHash)
+    {
+        return nullptr;
+    }
+
+    auto Entry = std::make_shared<IblCacheEntry>();
+    if (!ReadTexture(*File, Header.Textures[0], Entry->Environment) ||
+        !ReadTexture(*File, Header.Textures[1], Entry->BrdfLut))
+    {
+        return nullptr;
+    }
+    std::memcpy(Entry->Irradiance.Coefficients, Header.IrradianceSH, sizeof(Header.IrradianceSH));
+    Entry->File = std::move(File);
+    return Entry;
+}
+
+bool IblCache::Save(const std::string& CacheFile, const BakedIbl& Baked, const IblCacheKey& Key)
+{
+    const BakedTexture* Textures[] = { &Baked.Environment, &Baked.BrdfLut };
+
+    IblCacheHeader Header = {};
+    Header.Magic = Magic;
+    Header.Version = Version;
+    Header.SourceHash = Key.SourceHash;
+    Header.SettingsHash = Key.SettingsHash;
+    Header.ProducerHash = Key.ProducerHash;
+    std::memcpy(Header.IrradianceSH, Baked.Irradiance.Coefficients, sizeof(Header.IrradianceSH));
+    uint64_t Offset = sizeof(IblCacheHeader);
+    for (int i = 0; i < 2; ++i)
+    {
+        Header.Textures[i] = DescribeTexture(*Textures[i], AlignUp(Offset, BlockAlignment));
+        Offset = Header.Textures[i].Offset + Header.Textures[i].Size;
+    }
+
+    // Write next to the final file and rename so a crash never leaves a half-written cache behind.
+    const std::string TempFile = CacheFile + ".tmp";
+    {
+        std::ofstream Stream{ TempFile, std::ios::binary | std::ios::trunc };
+        if (!Stream.is_open())
+        {
+            return false;
+        }
+
+        const std::vector<char> Padding(BlockAlignment, 0);
+        Stream.write(reinterpret_cast<const char*>(&Header), sizeof(Header));
+        uint64_t Written = sizeof(Header);
+        for (int i = 0; i < 2; ++i)
+        {
+            Stream.write(Padding.data(), Header.Textures[i].Offset - Written);
+            Stream.write(reinterpret_cast<const char*>(Textures[i]->Texels.data()), Header.Textures[i].Size);
+            Written = Header.Textures[i].Offset + Header.Textures[i].Size;
+        }
+        if (!Stream.good())
+        {
+            Stream.close();
+            std::remove(TempFile.c_str());
+            return false;
+        }
+    }
+
+    std::remove(CacheFile.c_str());
+    return std::rename(TempFile.c_str(), CacheFile.c_str()) == 0;
+}
+
+bool IblCache::SelfTest()
+{
+    TestHarness Harness;
+
+    const std::filesystem::path Scratch = std::filesystem::temp_directory_path() / "rerender_iblcache_test";
+    std::error_code Error;
+    std::filesystem::remove_all(Scratch, Error);
+    std::filesystem::create_directories(Scratch, Error);
+    const std::string SourceFile = (Scratch / "sky.hdr").string();
+    const std::string CacheFile = CachePath(SourceFile);
+
+    //A small gradient is enough, the cache never looks at the texels
+    const uint32_t SkyWidth = 32;
+    const uint32_t SkyHeight = 16;
+    std::vector<float> Sky(size_t(SkyWidth) * SkyHeight * 4);
+    for (size_t i = 0; i < Sky.size(); ++i)
+    {
+        Sky[i] = float(i % 4 == 3 ? 1.0 : double(i % 97) / 16.0);
+    }
+    {
+        std::ofstream Stream{ SourceFile, std::ios::binary | std::ios::trunc };
+        Stream.write(reinterpret_cast<const char*>(Sky.data()), Sky.size() * sizeof(float));
+    }
+
+    IblBaker::Settings Small;
+    Small.EnvironmentSize = 16;
+    Small.SpecularSamples = 16;
+    Small.BrdfLutSize = 8;
+    Small.BrdfSamples = 16;
+    ThreadPool Pool{ 0 };
+    IblBaker Baker{ Pool, Small };
+    const BakedIbl Baked = Baker.Bake(Sky.data(), SkyWidth, SkyHeight, 4);
+
+    const IblCacheKey Key = { HashFiles({ SourceFile }), HashSettings(Small), IblBaker::Version };
+
+    const auto Matches = [](const IblCacheTexture& Cached, const BakedTexture& Expected)
+    {
+        if (Cached.Width != Expected.Width || Cached.Height != Expected.Height || Cached.ArraySize != Expected.ArraySize ||
+            Cached.Levels != Expected.Levels || Cached.Channels != Expected.Channels || Cached.Offsets != Expected.Offsets)
+        {
+            return false;
+        }
+        for (uint32_t Slice = 0; Slice < Expected.ArraySize; ++Slice)
+        {
+            for (uint32_t Mip = 0; Mip < Expected.Levels; ++Mip)
+            {
+                const size_t Count = Expected.RowPitch(Mip) / sizeof(uint16_t) * Expected.MipHeight(Mip);
+                if (!std::equal(Expected.Subresource(Mip, Slice), Expected.Subresource(Mip, Slice) + Count, Cached.Subresource(Mip, Slice)))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    std::printf("IBL cache self test\n");
+
+    Harness.Run("Round trip", [&]()
+    {
+        Harness.Check(!Load(CacheFile, Key), "a missing file misses");
+        Harness.Check(Save(CacheFile, Baked, Key), "the bake is saved");
+        const std::shared_ptr<const IblCacheEntry> Entry = Load(CacheFile, Key);
+        Harness.Check(Entry != nullptr, "the saved entry hits");
+        if (Entry)
+        {
+            Harness.Check(Matches(Entry->Environment, Baked.Environment), "the environment cube and its mips come back unchanged");
+            Harness.Check(std::memcmp(Entry->Irradiance.Coefficients, Baked.Irradiance.Coefficients, sizeof(Baked.Irradiance.Coefficients)) == 0,
+                "the irradiance coefficients come back unchanged");
+            Harness.Check(Matches(Entry->BrdfLut, Baked.BrdfLut), "the BRDF LUT comes back unchanged");
+            Harness.Check(uintptr_t(Entry->Environment.Texels) % BlockAlignment == 0 && uintptr_t(Entry->BrdfLut.Texels) % BlockAlignment == 0,
+                "every block is aligned in the mapping");
+        }
+    });
+
+    Harness.Run("Key fields", [&]()
+    {
+        IblCacheKey Other = Key;
+        Other.SourceHash ^= 1;
+        Harness.Check(!Load(CacheFile, Other), "another source misses");
+        Other = Key;
+        IblBaker::Settings MoreSamples = Small;
+        MoreSamples.SpecularSamples *= 2;
+        Other.SettingsHash = HashSettings(MoreSamples);
+        Harness.Check(Other.SettingsHash != Key.SettingsHash && !Load(CacheFile, Other), "other sample counts miss");
+        Other = Key;
+        Other.ProducerHash = IblBaker::Version + 1;
+        Harness.Check(!Load(CacheFile, Other), "another producer misses");
+        Harness.Check(Load(CacheFile, Key) != nullptr, "the original key still hits");
+    });
+
+    Harness.Run("Source edits", [&]()
+    {
+        const uint64_t Before = HashFiles({ SourceFile });
+        {
+            std::fstream Stream{ SourceFile, std::ios::binary | std::ios::in | std::ios::out };
+            Stream.seekp(5);
+            Stream.put('X');
+        }
+        Harness.Check(HashFiles({ SourceFile }) != Before, "an edited byte changes the source hash");
+        Harness.Check(HashFiles({ SourceFile, SourceFile }) != Before, "every file of a list counts");
+        Harness.Check(HashFiles({ (Scratch / "missing.hdr").string() }) == 0, "a missing file hashes to 0");
+    });
+
+    Harness.Run("Version and layout mismatches", [&]()
+    {
+        Save(CacheFile, Baked, Key);
+        {
+            std::fstream Stream{ CacheFile, std::ios::binary | std::ios::in | std::ios::out };
+            const uint32_t Newer = Version + 1;
+            Stream.seekp(offsetof(IblCacheHeader, Version));
+            Stream.write(reinterpret_cast<const char*>(&Newer), sizeof(Newer));
+        }
+        Harness.Check(!Load(CacheFile, Key), "another version misses");
+
+        Save(CacheFile, Baked, Key);
+        {
+            std::fstream Stream{ CacheFile, std::ios::binary | std::ios::in | std::ios::out };
+            const uint32_t Levels = Baked.Environment.Levels + 1;
+            Stream.seekp(offsetof(IblCacheHeader, Textures) + offsetof(IblCacheTextureHeader, Levels));
+            Stream.write(reinterpret_cast<const char*>(&Levels), sizeof(Levels));
+        }
+        Harness.Check(!Load(CacheFile, Key), "a size that disagrees with the dimensions misses");
+
+        Save(CacheFile, Baked, Key);
+        const uintmax_t Size = std::filesystem::file_size(CacheFile);
+        std::filesystem::resize_file(CacheFile, Size - 1);
+        Harness.Check(!Load(CacheFile, Key), "a truncated last block misses");
+        std::filesystem::resize_file(CacheFile, sizeof(IblCacheHeader) - 1);
+        Harness.Check(!Load(CacheFile, Key), "a cut off header misses");
+
+        Harness.Check(Save(CacheFile, Baked, Key) && Load(CacheFile, Key) != nullptr, "the rewritten entry hits");
+        Harness.Check(!std::filesystem::exists(CacheFile + ".tmp"), "no temporary file is left behind");
+    });
+
+    std::filesystem::remove_all(Scratch, Error);
+    return Harness.Finish();
+}
+
+void IblCache::Benchmark(const std::string& EnvironmentFile, uint32_t EnvironmentSize, int Iterations)
+{
+    Iterations = Iterations > 0 ? Iterations : 1;
+
+    std::shared_ptr<Image> Environment = Image::FromFile(EnvironmentFile);
+    IblBaker::Settings Config;
+    Config.EnvironmentSize = EnvironmentSize;
+    IblBaker Baker{ ThreadPool::Get(), Config };
+
+    const auto Start = std::chrono::high_resolution_clock::now();
+    const BakedIbl Baked = Baker.Bake(*Environment);
+    const double BakeMs = ElapsedMs(Start);
+
+    const std::string CacheFile = CachePath(EnvironmentFile);
+    const IblCacheKey Key = { HashFiles({ EnvironmentFile }), HashSettings(Config), IblBaker::Version };
+    if (!Save(CacheFile, Baked, Key))
+    {
+        std::printf("IBL cache benchmark: cannot write %s\n", CacheFile.c_str());
+        return;
+    }
+
+    double HashMs = 0.0;
+    double LoadMs = 0.0;
+    double ReadMs = 0.0;
+    volatile uint64_t Sink = 0;
+    for (int i = 0; i < Iterations; ++i)
+    {
+        auto Begin = std::chrono::high_resolution_clock::now();
+        const IblCacheKey Current = { HashFiles({ EnvironmentFile }), HashSettings(Config), IblBaker::Version };
+        HashMs += ElapsedMs(Begin);
+
+        Begin = std::chrono::high_resolution_clock::now();
+        const std::shared_ptr<const IblCacheEntry> Entry = Load(CacheFile, Current);
+        LoadMs += ElapsedMs(Begin);
+        if (!Entry)
+        {
+            std::printf("IBL cache benchmark: cache load failed for %s\n", CacheFile.c_str());
+            return;
+        }
+
+        //What the staging copy pays on top: every cache line of the mapping gets read once
+        Begin = std::chrono::high_resolution_clock::now();
+        uint64_t Sum = 0;
+        for (const IblCacheTexture* Texture : { &Entry->Environment, &Entry->BrdfLut })
+        {
+            const size_t Count = Texture->Offsets.back() + Texture->RowPitch(Texture->Levels - 1) / sizeof(uint16_t) * Texture->MipHeight(Texture->Levels - 1);
+            for (size_t Texel = 0; Texel < Count; Texel += 32)
+            {
+                Sum += Texture->Texels[Texel];
+            }
+        }
+        Sink = Sink + Sum;
+        ReadMs += ElapsedMs(Begin);
+    }
+
+    std::printf("IBL cache benchmark: %s into a %u cube (%d iterations, %.1f MB entry)\n", EnvironmentFile.c_str(), EnvironmentSize, Iterations,
+        double(std::filesystem::file_size(CacheFile)) / (1024.0 * 1024.0));
+    std::printf("  CPU bake      : %8.2f ms\n", BakeMs);
+    std::printf("  Source hash   : %8.2f ms\n", HashMs / Iterations);
+    std::printf("  Cache load    : %8.2f ms\n", LoadMs / Iterations);
+    std::printf("  Texel reads   : %8.2f ms\n", ReadMs / Iterations);
+    std::printf("  Speedup       : %8.1fx\n", BakeMs * Iterations / (HashMs + LoadMs + ReadMs));
+}
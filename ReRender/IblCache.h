@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IblBaker.h"
+
+class MappedFile;
+
+// Everything the baked IBL maps depend on: the bytes of the HDR file, the sizes and sample counts, and whatever
+// produced them, the precompute shaders' sources for the GPU path or IblBaker::Version for the CPU one.
+struct IblCacheKey
+{
+    uint64_t SourceHash;
+    uint64_t SettingsHash;
+    uint64_t ProducerHash;
+};
+
+// One texture of an entry. Texels are float16 in BakedTexture's subresource order, every row tightly packed.
+struct IblCacheTextureHeader
+{
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t ArraySize;
+    uint32_t Levels;
+    uint32_t Channels;
+    uint32_t Reserved;
+    uint64_t Offset;
+    uint64_t Size;
+};
+static_assert(sizeof(IblCacheTextureHeader) == 40);
+
+// On-disk layout: header with the irradiance coefficients, then the environment and BRDF LUT texels, each aligned
+// to BlockAlignment.
+struct IblCacheHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t SourceHash;
+    uint64_t SettingsHash;
+    uint64_t ProducerHash;
+    IblCacheTextureHeader Textures[2];
+    float IrradianceSH[9][4];   // IrradianceSH::Coefficients
+};
+static_assert(sizeof(IblCacheHeader) == 256);
+
+// A texture of a cache hit, the texels point into the mapping of its IblCacheEntry.
+struct IblCacheTexture
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t ArraySize = 0;
+    uint32_t Levels = 0;
+    uint32_t Channels = 0;
+    const uint16_t* Texels = nullptr;
+    std::vector<size_t> Offsets;    // Per subresource, into Texels
+
+    uint32_t NumSubresources() const { return ArraySize * Levels; }
+    uint32_t MipWidth(uint32_t Mip) const { return Width >> Mip ? Width >> Mip : 1; }
+    uint32_t MipHeight(uint32_t Mip) const { return Height >> Mip ? Height >> Mip : 1; }
+    size_t RowPitch(uint32_t Mip) const { return size_t(MipWidth(Mip)) * Channels * sizeof(uint16_t); }
+    const uint16_t* Subresource(uint32_t Mip, uint32_t Slice) const { return Texels + Offsets[Mip + Slice * Levels]; }
+};
+
+// A cache hit. Nothing is copied out of the file, the staging upload reads the texels straight from the mapping,
+// which stays open as long as the entry.
+struct IblCacheEntry
+{
+    std::shared_ptr<MappedFile> File;
+    IblCacheTexture Environment;
+    IrradianceSH Irradiance;
+    IblCacheTexture BrdfLut;
+};
+
+// Content-addressed cache of the maps D3D12Renderer's Setup precomputes for image based lighting, one file next
+// to the HDR image. A hit replaces the whole precompute, the equirect conversion, mips, prefiltering, irradiance
+// projection and BRDF LUT dispatch, with two uploads.
+class IblCache
+{
+public:
+    static const uint32_t Magic = 0x4C424952; // "RIBL"
+    static const uint32_t Version = 2;
+    static const uint32_t BlockAlignment = 64;
+
+    static std::string CachePath(const std::string& SourceFile);
+    // 0 when the file cannot be opened, which never matches a saved key.
+    static uint64_t HashFiles(const std::vector<std::string>& Files);
+    static uint64_t HashSettings(const IblBaker::Settings& Config);
+
+    // Returns nullptr on a miss: missing file, version mismatch, any key mismatch, texture sizes that disagree
+    // with their dimensions or truncated blocks.
+    static std::shared_ptr<const IblCacheEntry> Load(const std::string& CacheFile, const IblCacheKey& Key);
+    static bool Save(const std::string& CacheFile, const BakedIbl& Baked, const IblCacheKey& Key);
+
+    // Round trips a small bake and checks that every key field, a newer version and truncated or mismatching
+    // blocks miss, in a scratch directory. No GPU needed.
+    static bool SelfTest();
+
+    // Bakes the HDR EnvironmentFile with IblBaker at the default settings and a cube of EnvironmentSize, then
+    // times that against hashing the source and reading every texel of the cached entry.
+    static void Benchmark(const std::string& EnvironmentFile, uint32_t EnvironmentSize, int Iterations);
+};
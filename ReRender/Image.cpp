@@ -1,8 +1,296 @@
 #include "Image.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <emmintrin.h>
+#include <functional>
+#include <random>
 #include <stdexcept>
 #include <stb/include/stb_image.h>
 
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+
+    int NumMipLevels(int Width, int Height)
+    {
+        int Levels = 1;
+        while ((Width | Height) >> Levels)
+        {
+            ++Levels;
+        }
+        return Levels;
+    }
+
+    //8 bit sRGB in both directions. Encoding rounds like round(255 * ToSrgb(V)) without a pow per texel: the
+    //coarse table gives the code at the start of V's bin, and the bins are narrower than the closest two
+    //thresholds, so at most one more threshold can lie below V
+    const int SrgbBins = 4096;
+
+    struct SrgbTables
+    {
+        float Decode[256];
+        float Thresholds[256];  //Smallest linear value of every code
+        uint8_t Coarse[SrgbBins + 1];
+
+        SrgbTables()
+        {
+            const auto ToLinear = [](double S) { return S <= 0.04045 ? S / 12.92 : std::pow((S + 0.055) / 1.055, 2.4); };
+            Thresholds[0] = 0.0f;
+            for (int Code = 0; Code < 256; ++Code)
+            {
+                Decode[Code] = float(ToLinear(Code / 255.0));
+                if (Code > 0)
+                {
+                    Thresholds[Code] = float(ToLinear((Code - 0.5) / 255.0));
+                }
+            }
+
+            int Code = 0;
+            for (int Bin = 0; Bin <= SrgbBins; ++Bin)
+            {
+                const float Value = float(Bin) / SrgbBins;
+                while (Code < 255 && Value >= Thresholds[Code + 1])
+                {
+                    ++Code;
+                }
+                Coarse[Bin] = uint8_t(Code);
+            }
+        }
+
+        uint8_t Encode(float Value) const
+        {
+            //NaN goes to 0 as well
+            Value = Value > 0.0f ? (Value < 1.0f ? Value : 1.0f) : 0.0f;
+            int Code = Coarse[int(Value * SrgbBins)];
+            Code += Code < 255 && Value >= Thresholds[Code + 1];
+            return uint8_t(Code);
+        }
+    };
+
+    const SrgbTables& Srgb()
+    {
+        static const SrgbTables Tables;
+        return Tables;
+    }
+
+    uint8_t EncodeUnorm(float Value)
+    {
+        Value = Value > 0.0f ? (Value < 1.0f ? Value : 1.0f) : 0.0f;
+        return uint8_t(Value * 255.0f + 0.5f);
+    }
+
+    //16 UNORM bytes to floats and back, for rows without sRGB channels
+    void DecodeUnorm16(const unsigned char* Source, float* Dest)
+    {
+        const __m128i Zero = _mm_setzero_si128();
+        const __m128 Scale = _mm_set1_ps(1.0f / 255.0f);
+        const __m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source));
+        const __m128i Low = _mm_unpacklo_epi8(Bytes, Zero);
+        const __m128i High = _mm_unpackhi_epi8(Bytes, Zero);
+        _mm_storeu_ps(Dest, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(Low, Zero)), Scale));
+        _mm_storeu_ps(Dest + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(Low, Zero)), Scale));
+        _mm_storeu_ps(Dest + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(High, Zero)), Scale));
+        _mm_storeu_ps(Dest + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(High, Zero)), Scale));
+    }
+
+    void EncodeUnorm16(const float* Source, unsigned char* Dest)
+    {
+        __m128i Words[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            //max/min return the second operand for NaN, so NaN clamps to 0 like EncodeUnorm
+            const __m128 Clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(Source + i * 4), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            Words[i] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(Clamped, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+        }
+        const __m128i Packed = _mm_packus_epi16(_mm_packs_epi32(Words[0], Words[1]), _mm_packs_epi32(Words[2], Words[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Dest), Packed);
+    }
+
+    //The texels of one axis every destination texel reads, Stride of them each, padded with zero weights
+    struct FilterTaps
+    {
+        int Stride = 0;
+        std::vector<int> Source;    //Clamped to the edge
+        std::vector<float> Weights;
+    };
+
+    double BesselI0(double X)
+    {
+        double Sum = 1.0;
+        double Term = 1.0;
+        for (int k = 1; k < 32; ++k)
+        {
+            Term *= (X / (2.0 * k)) * (X / (2.0 * k));
+            Sum += Term;
+        }
+        return Sum;
+    }
+
+    //Half width in destination texels and the window's shape, the usual choice for mip generation
+    const double KaiserWidth = 3.0;
+    const double KaiserAlpha = 4.0;
+
+    double Kaiser(double X)
+    {
+        if (std::abs(X) >= KaiserWidth)
+        {
+            return 0.0;
+        }
+        const double Sinc = X == 0.0 ? 1.0 : std::sin(PI * X) / (PI * X);
+        const double R = X / KaiserWidth;
+        return Sinc * BesselI0(KaiserAlpha * std::sqrt(1.0 - R * R)) / BesselI0(KaiserAlpha);
+    }
+
+    FilterTaps ComputeTaps(int SourceSize, int DestSize, MipFilter Filter)
+    {
+        //In source texels
+        const double Scale = double(SourceSize) / DestSize;
+        const double Radius = Filter == MipFilter::Box ? 0.5 * Scale : KaiserWidth * Scale;
+
+        std::vector<std::vector<std::pair<int, double>>> Texels(DestSize);
+        size_t Stride = 1;
+        for (int Dest = 0; Dest < DestSize; ++Dest)
+        {
+            const double Center = (Dest + 0.5) * Scale;
+            double Sum = 0.0;
+            for (int Texel = int(std::floor(Center - Radius)); Texel <= int(std::ceil(Center + Radius)); ++Texel)
+            {
+                const double Weight = Filter == MipFilter::Box ?
+                    std::min(Texel + 1.0, Center + Radius) - std::max(double(Texel), Center - Radius) :
+                    Kaiser((Texel + 0.5 - Center) / Scale);
+                if (Filter == MipFilter::Box ? Weight > 1e-9 : Weight != 0.0)
+                {
+                    Texels[Dest].emplace_back(std::clamp(Texel, 0, SourceSize - 1), Weight);
+                    Sum += Weight;
+                }
+            }
+            for (auto& Texel : Texels[Dest])
+            {
+                Texel.second /= Sum;
+            }
+            Stride = std::max(Stride, Texels[Dest].size());
+        }
+
+        FilterTaps Taps;
+        Taps.Stride = int(Stride);
+        Taps.Source.resize(Stride * DestSize);
+        Taps.Weights.resize(Stride * DestSize, 0.0f);
+        for (int Dest = 0; Dest < DestSize; ++Dest)
+        {
+            for (size_t Tap = 0; Tap < Stride; ++Tap)
+            {
+                const bool bUsed = Tap < Texels[Dest].size();
+                Taps.Source[Dest * Stride + Tap] = bUsed ? Texels[Dest][Tap].first : Texels[Dest].back().first;
+                Taps.Weights[Dest * Stride + Tap] = bUsed ? float(Texels[Dest][Tap].second) : 0.0f;
+            }
+        }
+        return Taps;
+    }
+
+    //One row of the horizontal pass, whole texels of four channels go through SSE
+    template<int Channels>
+    void FilterRow(const float* Source, const FilterTaps& Taps, int DestWidth, float* Dest)
+    {
+        for (int X = 0; X < DestWidth; ++X)
+        {
+            const int* Texels = &Taps.Source[size_t(X) * Taps.Stride];
+            const float* Weights = &Taps.Weights[size_t(X) * Taps.Stride];
+            if constexpr (Channels == 4)
+            {
+                __m128 Sum = _mm_setzero_ps();
+                for (int Tap = 0; Tap < Taps.Stride; ++Tap)
+                {
+                    Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_set1_ps(Weights[Tap]), _mm_loadu_ps(Source + size_t(Texels[Tap]) * 4)));
+                }
+                _mm_storeu_ps(Dest + size_t(X) * 4, Sum);
+            }
+            else
+            {
+                float Sum[Channels] = {};
+                for (int Tap = 0; Tap < Taps.Stride; ++Tap)
+                {
+                    for (int Channel = 0; Channel < Channels; ++Channel)
+                    {
+                        Sum[Channel] += Weights[Tap] * Source[size_t(Texels[Tap]) * Channels + Channel];
+                    }
+                }
+                for (int Channel = 0; Channel < Channels; ++Channel)
+                {
+                    Dest[size_t(X) * Channels + Channel] = Sum[Channel];
+                }
+            }
+        }
+    }
+
+    //Row Y of the level above as linear floats, decoded into Scratch when it is not stored that way
+    using RowFetch = std::function<const float*(int Y, float* Scratch)>;
+
+    //Separable: every source row is filtered horizontally into Rows, then each destination row is a weighted sum
+    //of whole rows of it, four floats at a time whatever the channel count
+    void Downsample(ThreadPool& Pool, const RowFetch& Fetch, int SourceWidth, int SourceHeight, int Channels, MipFilter Filter,
+        int DestWidth, int DestHeight, float* Dest)
+    {
+        const FilterTaps Horizontal = ComputeTaps(SourceWidth, DestWidth, Filter);
+        const FilterTaps Vertical = ComputeTaps(SourceHeight, DestHeight, Filter);
+        const size_t RowFloats = size_t(DestWidth) * Channels;
+        std::vector<float> Rows(RowFloats * SourceHeight);
+
+        const size_t Grain = std::max<size_t>(1, 16384 / (size_t(SourceWidth) * Channels));
+        Pool.ParallelFor(0, SourceHeight, Grain, [&](size_t Begin, size_t End)
+        {
+            std::vector<float> Scratch(size_t(SourceWidth) * Channels);
+            for (size_t Y = Begin; Y < End; ++Y)
+            {
+                const float* Source = Fetch(int(Y), Scratch.data());
+                float* Row = Rows.data() + Y * RowFloats;
+                switch (Channels)
+                {
+                case 1: FilterRow<1>(Source, Horizontal, DestWidth, Row); break;
+                case 2: FilterRow<2>(Source, Horizontal, DestWidth, Row); break;
+                default: FilterRow<4>(Source, Horizontal, DestWidth, Row); break;
+                }
+            }
+        });
+
+        Pool.ParallelFor(0, DestHeight, std::max<size_t>(1, Grain / 2), [&](size_t Begin, size_t End)
+        {
+            for (size_t Y = Begin; Y < End; ++Y)
+            {
+                const int* Texels = &Vertical.Source[Y * Vertical.Stride];
+                const float* Weights = &Vertical.Weights[Y * Vertical.Stride];
+                float* Row = Dest + Y * RowFloats;
+                size_t i = 0;
+                for (; i + 4 <= RowFloats; i += 4)
+                {
+                    __m128 Sum = _mm_setzero_ps();
+                    for (int Tap = 0; Tap < Vertical.Stride; ++Tap)
+                    {
+                        Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_set1_ps(Weights[Tap]), _mm_loadu_ps(Rows.data() + size_t(Texels[Tap]) * RowFloats + i)));
+                    }
+                    _mm_storeu_ps(Row + i, Sum);
+                }
+                for (; i < RowFloats; ++i)
+                {
+                    float Sum = 0.0f;
+                    for (int Tap = 0; Tap < Vertical.Stride; ++Tap)
+                    {
+                        Sum += Weights[Tap] * Rows[size_t(Texels[Tap]) * RowFloats + i];
+                    }
+                    Row[i] = Sum;
+                }
+            }
+        });
+    }
+}
+
 Image::Image()
     :m_Width(0)
     ,m_Height(0)
@@ -50,3 +338,384 @@ std::shared_ptr<Image> Image::FromFile(const std::string& FileName, int Channels
     return image;
 }
 
+MipChain Image::GenerateMips(ThreadPool& Pool, MipFilter Filter, bool bSrgb, int Levels) const
+{
+    return GenerateMips(Pool, m_Pixels.get(), m_Width, m_Height, m_Channels, m_Hdr, Filter, bSrgb, Levels);
+}
+
+MipChain Image::GenerateMips(ThreadPool& Pool, const void* Pixels, int Width, int Height, int Channels, bool bHdr,
+    MipFilter Filter, bool bSrgb, int Levels)
+{
+    if (Width <= 0 || Height <= 0 || !Pixels)
+    {
+        throw std::invalid_argument("Mip generation needs a non-empty image");
+    }
+    if (Channels != 1 && Channels != 2 && Channels != 4)
+    {
+        throw std::invalid_argument("Mip generation supports 1, 2 or 4 channels");
+    }
+
+    MipChain Chain;
+    Chain.Width = Width;
+    Chain.Height = Height;
+    Chain.Channels = Channels;
+    Chain.bHdr = bHdr;
+    const int MaxLevels = NumMipLevels(Width, Height);
+    Chain.Offsets.resize(Levels > 0 ? std::min(Levels, MaxLevels) : MaxLevels);
+    size_t Total = 0;
+    for (int Mip = 0; Mip < Chain.Levels(); ++Mip)
+    {
+        Chain.Offsets[Mip] = Total;
+        Total += Chain.RowPitch(Mip) * Chain.MipHeight(Mip);
+    }
+    Chain.Texels.resize(Total);
+    std::memcpy(Chain.Texels.data(), Pixels, Chain.RowPitch(0) * Height);
+
+    //Per channel, a fourth one is alpha and stays linear
+    const SrgbTables& Tables = Srgb();
+    float UnormDecode[256];
+    for (int Code = 0; Code < 256; ++Code)
+    {
+        UnormDecode[Code] = Code * (1.0f / 255.0f);
+    }
+    const bool bAnySrgb = bSrgb && !bHdr;
+    bool bSrgbChannel[4];
+    const float* DecodeTables[4];
+    for (int Channel = 0; Channel < Channels; ++Channel)
+    {
+        bSrgbChannel[Channel] = bAnySrgb && Channel < 3;
+        DecodeTables[Channel] = bSrgbChannel[Channel] ? Tables.Decode : UnormDecode;
+    }
+    const auto DecodeRow = [&](const unsigned char* Source, size_t Texels, float* Dest)
+    {
+        size_t i = 0;
+        if (!bAnySrgb)
+        {
+            for (; i + 16 <= Texels * Channels; i += 16)
+            {
+                DecodeUnorm16(Source + i, Dest + i);
+            }
+        }
+        for (; i < Texels * Channels; i += Channels)
+        {
+            for (int Channel = 0; Channel < Channels; ++Channel)
+            {
+                Dest[i + Channel] = DecodeTables[Channel][Source[i + Channel]];
+            }
+        }
+    };
+    const auto EncodeRow = [&](const float* Source, size_t Texels, unsigned char* Dest)
+    {
+        size_t i = 0;
+        if (!bAnySrgb)
+        {
+            for (; i + 16 <= Texels * Channels; i += 16)
+            {
+                EncodeUnorm16(Source + i, Dest + i);
+            }
+        }
+        for (; i < Texels * Channels; i += Channels)
+        {
+            for (int Channel = 0; Channel < Channels; ++Channel)
+            {
+                Dest[i + Channel] = bSrgbChannel[Channel] ? Tables.Encode(Source[i + Channel]) : EncodeUnorm(Source[i + Channel]);
+            }
+        }
+    };
+
+    //Each level is filtered from the float one above it, not from its 8 bit encoding
+    std::vector<float> Above;
+    std::vector<float> Current;
+    for (int Mip = 1; Mip < Chain.Levels(); ++Mip)
+    {
+        const int SourceWidth = Chain.MipWidth(Mip - 1);
+        const size_t SourceRow = size_t(SourceWidth) * Channels;
+        RowFetch Fetch;
+        if (Mip > 1)
+        {
+            Fetch = [&](int Y, float*) { return Above.data() + Y * SourceRow; };
+        }
+        else if (bHdr)
+        {
+            Fetch = [&](int Y, float*) { return static_cast<const float*>(Pixels) + Y * SourceRow; };
+        }
+        else
+        {
+            Fetch = [&](int Y, float* Scratch)
+            {
+                DecodeRow(static_cast<const unsigned char*>(Pixels) + Y * SourceRow, SourceWidth, Scratch);
+                return const_cast<const float*>(Scratch);
+            };
+        }
+
+        const int DestWidth = Chain.MipWidth(Mip);
+        const int DestHeight = Chain.MipHeight(Mip);
+        const size_t DestRow = size_t(DestWidth) * Channels;
+        Current.resize(DestRow * DestHeight);
+        Downsample(Pool, Fetch, SourceWidth, Chain.MipHeight(Mip - 1), Channels, Filter, DestWidth, DestHeight, Current.data());
+
+        unsigned char* Level = Chain.Texels.data() + Chain.Offsets[Mip];
+        if (bHdr)
+        {
+            std::memcpy(Level, Current.data(), Current.size() * sizeof(float));
+        }
+        else
+        {
+            Pool.ParallelFor(0, DestHeight, std::max<size_t>(1, 16384 / DestRow), [&](size_t Begin, size_t End)
+            {
+                for (size_t Y = Begin; Y < End; ++Y)
+                {
+                    EncodeRow(Current.data() + Y * DestRow, DestWidth, Level + Y * DestRow);
+                }
+            });
+        }
+        std::swap(Above, Current);
+    }
+    return Chain;
+}
+
+bool Image::SelfTest()
+{
+    TestHarness Harness;
+
+    ThreadPool Serial{ 0 };
+    std::mt19937 Random{ 7 };
+    const auto RandomFloats = [&](size_t Count)
+    {
+        std::uniform_real_distribution<float> Distribution{ 0.0f, 4.0f };
+        std::vector<float> Values(Count);
+        for (float& Value : Values)
+        {
+            Value = Distribution(Random);
+        }
+        return Values;
+    };
+    const auto Floats = [](const MipChain& Chain, int Mip) { return reinterpret_cast<const float*>(Chain.Level(Mip)); };
+    const auto Bytes = [](const MipChain& Chain, int Mip) { return static_cast<const unsigned char*>(Chain.Level(Mip)); };
+
+    std::printf("Mip generation self test\n");
+
+    Harness.Run("Level sizes", [&]()
+    {
+        const std::vector<unsigned char> Pixels(13 * 5 * 4, 0);
+        const MipChain Chain = GenerateMips(Serial, Pixels.data(), 13, 5, 4, false, MipFilter::Box, false);
+        Harness.Check(Chain.Levels() == 4 && Chain.MipWidth(1) == 6 && Chain.MipHeight(1) == 2 && Chain.MipWidth(2) == 3 && Chain.MipHeight(2) == 1 &&
+            Chain.MipWidth(3) == 1 && Chain.MipHeight(3) == 1, "13x5 goes down to 6x2, 3x1 and 1x1");
+        Harness.Check(Chain.Offsets[3] + Chain.RowPitch(3) == Chain.Texels.size(), "the levels are packed back to back");
+        Harness.Check(GenerateMips(Serial, Pixels.data(), 13, 5, 4, false, MipFilter::Box, false, 2).Levels() == 2, "Levels limits the chain");
+    });
+
+    Harness.Run("Box filter", [&]()
+    {
+        const unsigned char Square[] = { 0, 10, 20, 30, 40, 50, 60, 70 };
+        const MipChain Even = GenerateMips(Serial, Square, 2, 2, 2, false, MipFilter::Box, false);
+        Harness.Check(Bytes(Even, 1)[0] == 30 && Bytes(Even, 1)[1] == 40, "2x2 averages four texels");
+
+        //Wide enough for the SSE decode and encode of whole rows
+        std::vector<unsigned char> Wide(64 * 2 * 4);
+        for (unsigned char& Value : Wide)
+        {
+            Value = uint8_t(Random());
+        }
+        const MipChain WideChain = GenerateMips(Serial, Wide.data(), 64, 2, 4, false, MipFilter::Box, false, 2);
+        bool bRounded = true;
+        for (int i = 0; i < 32 * 4; ++i)
+        {
+            const int Texel = i / 4 * 2 * 4 + i % 4;
+            const double Average = (Wide[Texel] + Wide[Texel + 4] + Wide[Texel + 256] + Wide[Texel + 260]) / 4.0;
+            bRounded &= std::abs(Bytes(WideChain, 1)[i] - Average) <= 0.5 + 1e-3;
+        }
+        Harness.Check(bRounded, "every byte rounds to the nearest average");
+
+        //5 texels into 2, each destination texel covers two and a half of them
+        const float Row[] = { 10.0f, 20.0f, 30.0f, 40.0f, 50.0f };
+        const MipChain Odd = GenerateMips(Serial, Row, 5, 1, 1, true, MipFilter::Box, false);
+        Harness.Check(std::abs(Floats(Odd, 1)[0] - 18.0f) < 1e-4f && std::abs(Floats(Odd, 1)[1] - 42.0f) < 1e-4f, "odd sizes weigh the texel in the middle by coverage");
+
+        const std::vector<float> Pixels = RandomFloats(37 * 23);
+        const MipChain Chain = GenerateMips(Serial, Pixels.data(), 37, 23, 1, true, MipFilter::Box, false);
+        bool bMean = true;
+        double Mean = 0.0;
+        for (float Value : Pixels)
+        {
+            Mean += Value / Pixels.size();
+        }
+        for (int Mip = 1; Mip < Chain.Levels(); ++Mip)
+        {
+            const size_t Count = size_t(Chain.MipWidth(Mip)) * Chain.MipHeight(Mip);
+            double LevelMean = 0.0;
+            for (size_t i = 0; i < Count; ++i)
+            {
+                LevelMean += Floats(Chain, Mip)[i] / Count;
+            }
+            bMean &= std::abs(LevelMean - Mean) < 1e-4 * Mean;
+        }
+        Harness.Check(bMean, "every level of a 37x23 image keeps the mean");
+    });
+
+    Harness.Run("sRGB", [&]()
+    {
+        const SrgbTables& Tables = Srgb();
+        bool bRoundTrip = true;
+        bool bRounding = true;
+        for (int Code = 0; Code < 256; ++Code)
+        {
+            bRoundTrip &= Tables.Encode(Tables.Decode[Code]) == Code;
+        }
+        for (int i = 0; i <= 100000; ++i)
+        {
+            const double Linear = i / 100000.0;
+            const double Encoded = Linear <= 0.0031308 ? Linear * 12.92 : 1.055 * std::pow(Linear, 1.0 / 2.4) - 0.055;
+            const double Code = Encoded * 255.0;
+            //Values within float precision of a threshold may go either way
+            bRounding &= Tables.Encode(float(Linear)) == int(Code + 0.5) || std::abs(Code - std::floor(Code) - 0.5) < 1e-4;
+        }
+        Harness.Check(bRoundTrip, "every code decodes and encodes back to itself");
+        Harness.Check(bRounding, "encoding rounds to the nearest code");
+
+        //A checker of black and white is linear 0.5 below, alpha stays linear
+        const unsigned char Checker[] = { 0, 0, 0, 0, 255, 255, 255, 255, 255, 255, 255, 255, 0, 0, 0, 0 };
+        const MipChain Gamma = GenerateMips(Serial, Checker, 2, 2, 4, false, MipFilter::Box, true);
+        const MipChain Linear = GenerateMips(Serial, Checker, 2, 2, 4, false, MipFilter::Box, false);
+        Harness.Check(Bytes(Gamma, 1)[0] == 188 && Bytes(Gamma, 1)[2] == 188 && Bytes(Gamma, 1)[3] == 128, "sRGB color averages in linear space, alpha does not");
+        Harness.Check(Bytes(Linear, 1)[0] == 128 && Bytes(Linear, 1)[3] == 128, "linear data averages as stored");
+    });
+
+    Harness.Run("Kaiser filter", [&]()
+    {
+        const std::vector<unsigned char> Flat(20 * 12 * 4, 77);
+        const MipChain Chain = GenerateMips(Serial, Flat.data(), 20, 12, 4, false, MipFilter::Kaiser, true);
+        Harness.Check(std::all_of(Chain.Texels.begin(), Chain.Texels.end(), [](unsigned char Value) { return Value == 77; }), "a constant image stays constant in every level");
+
+        //The sinc removes the checker at the new Nyquist frequency away from the clamped edges, a box of two does too
+        std::vector<float> Checker(32 * 32);
+        for (size_t i = 0; i < Checker.size(); ++i)
+        {
+            Checker[i] = float((i % 32 + i / 32) % 2);
+        }
+        for (MipFilter Filter : { MipFilter::Box, MipFilter::Kaiser })
+        {
+            const MipChain Filtered = GenerateMips(Serial, Checker.data(), 32, 32, 1, true, Filter, false, 2);
+            bool bFlat = true;
+            for (int Y = 3; Y < 13; ++Y)
+            {
+                for (int X = 3; X < 13; ++X)
+                {
+                    bFlat &= std::abs(Floats(Filtered, 1)[Y * 16 + X] - 0.5f) < 1e-3f;
+                }
+            }
+            Harness.Check(bFlat, "a one texel checker filters to grey");
+        }
+
+        //Ringing past an edge stays within the 8 bit range
+        std::vector<unsigned char> Edge(16 * 4);
+        for (int X = 0; X < 16; ++X)
+        {
+            Edge[X * 4] = X < 8 ? 0 : 255;
+        }
+        const MipChain Clamped = GenerateMips(Serial, Edge.data(), 16, 1, 4, false, MipFilter::Kaiser, false, 2);
+        Harness.Check(Bytes(Clamped, 1)[0] == 0 && Bytes(Clamped, 1)[7 * 4] == 255, "overshoot clamps at 0 and 255");
+    });
+
+    Harness.Run("Channel counts", [&]()
+    {
+        //The four channel SSE path against the scalar one and two channel paths on the same data
+        const int Width = 29;
+        const int Height = 17;
+        const std::vector<float> Pixels = RandomFloats(size_t(Width) * Height * 4);
+        std::vector<float> Single[4];
+        std::vector<float> Pairs[2];
+        for (size_t i = 0; i < Pixels.size(); ++i)
+        {
+            Single[i % 4].push_back(Pixels[i]);
+            Pairs[i % 4 / 2].push_back(Pixels[i]);
+        }
+        for (MipFilter Filter : { MipFilter::Box, MipFilter::Kaiser })
+        {
+            const MipChain Four = GenerateMips(Serial, Pixels.data(), Width, Height, 4, true, Filter, false);
+            float MaxError = 0.0f;
+            for (int Channel = 0; Channel < 4; ++Channel)
+            {
+                const MipChain One = GenerateMips(Serial, Single[Channel].data(), Width, Height, 1, true, Filter, false);
+                const MipChain Two = GenerateMips(Serial, Pairs[Channel / 2].data(), Width, Height, 2, true, Filter, false);
+                for (int Mip = 1; Mip < Four.Levels(); ++Mip)
+                {
+                    for (int i = 0; i < Four.MipWidth(Mip) * Four.MipHeight(Mip); ++i)
+                    {
+                        const float Expected = Floats(Four, Mip)[i * 4 + Channel];
+                        MaxError = std::max({ MaxError, std::abs(Floats(One, Mip)[i] - Expected), std::abs(Floats(Two, Mip)[i * 2 + Channel % 2] - Expected) });
+                    }
+                }
+            }
+            Harness.Check(MaxError < 1e-5f, "1, 2 and 4 channels filter alike");
+        }
+    });
+
+    Harness.Run("Thread count independence", [&]()
+    {
+        std::vector<unsigned char> Pixels(67 * 45 * 4);
+        for (unsigned char& Value : Pixels)
+        {
+            Value = uint8_t(Random());
+        }
+        ThreadPool Threads{ 3 };
+        const MipChain A = GenerateMips(Serial, Pixels.data(), 67, 45, 4, false, MipFilter::Kaiser, true);
+        const MipChain B = GenerateMips(Threads, Pixels.data(), 67, 45, 4, false, MipFilter::Kaiser, true);
+        Harness.Check(A.Texels == B.Texels, "0 and 3 pool threads generate the same texels");
+    });
+
+    Harness.Run("Bad input", [&]()
+    {
+        const std::vector<unsigned char> Pixels(4 * 4 * 3, 0);
+        bool bThrew = false;
+        try
+        {
+            GenerateMips(Serial, Pixels.data(), 4, 4, 3, false, MipFilter::Box, false);
+        }
+        catch (const std::invalid_argument&)
+        {
+            bThrew = true;
+        }
+        Harness.Check(bThrew, "three channels are rejected");
+    });
+
+    return Harness.Finish();
+}
+
+void Image::Benchmark(int Width, int Height, int Iterations)
+{
+    Iterations = Iterations > 0 ? Iterations : 1;
+    Width = Width > 0 ? Width : 1;
+    Height = Height > 0 ? Height : 1;
+
+    std::vector<unsigned char> Pixels(size_t(Width) * Height * 4);
+    for (int Y = 0; Y < Height; ++Y)
+    {
+        for (int X = 0; X < Width; ++X)
+        {
+            unsigned char* Texel = &Pixels[(size_t(Y) * Width + X) * 4];
+            Texel[0] = uint8_t(X * 255 / Width);
+            Texel[1] = uint8_t(Y * 255 / Height);
+            Texel[2] = uint8_t((X ^ Y) & 0xff);
+            Texel[3] = 255;
+        }
+    }
+
+    ThreadPool& Pool = ThreadPool::Get();
+    std::printf("Mip generation benchmark: %dx%d RGBA8 (%d iterations, %u pool threads plus the caller)\n", Width, Height, Iterations, Pool.NumThreads());
+    for (MipFilter Filter : { MipFilter::Box, MipFilter::Kaiser })
+    {
+        for (bool bSrgb : { false, true })
+        {
+            double TotalMs = 0.0;
+            for (int i = 0; i < Iterations; ++i)
+            {
+                const auto Start = std::chrono::high_resolution_clock::now();
+                GenerateMips(Pool, Pixels.data(), Width, Height, 4, false, Filter, bSrgb);
+                TotalMs += ElapsedMs(Start);
+            }
+            std::printf("  %-6s %-6s : %9.2f ms, %8.1f Mtexel/s\n", Filter == MipFilter::Box ? "Box" : "Kaiser", bSrgb ? "sRGB" : "linear",
+                TotalMs / Iterations, double(Width) * Height / (TotalMs / Iterations) / 1000.0);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#include "MappedFile.h"
+
+#if _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    :m_Data(nullptr)
+    ,m_Size(0)
+#if _WIN32
+    ,m_File(INVALID_HANDLE_VALUE)
+    ,m_Mapping(nullptr)
+#else
+    ,m_Descriptor(-1)
+#endif
+{}
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string& FileName)
+{
+    std::shared_ptr<MappedFile> File{ new MappedFile };
+
+#if _WIN32
+    File->m_File = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (File->m_File == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER FileSize;
+    if (!GetFileSizeEx(File->m_File, &FileSize) || FileSize.QuadPart == 0)
+    {
+        return nullptr;
+    }
+    File->m_Size = static_cast<size_t>(FileSize.QuadPart);
+
+    File->m_Mapping = CreateFileMappingA(File->m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!File->m_Mapping)
+    {
+        return nullptr;
+    }
+
+    File->m_Data = static_cast<const uint8_t*>(MapViewOfFile(File->m_Mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    File->m_Descriptor = open(FileName.c_str(), O_RDONLY);
+    if (File->m_Descriptor < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat FileStat;
+    if (fstat(File->m_Descriptor, &FileStat) != 0 || FileStat.st_size == 0)
+    {
+        return nullptr;
+    }
+    File->m_Size = static_cast<size_t>(FileStat.st_size);
+
+    void* View = mmap(nullptr, File->m_Size, PROT_READ, MAP_PRIVATE, File->m_Descriptor, 0);
+    File->m_Data = (View == MAP_FAILED) ? nullptr : static_cast<const uint8_t*>(View);
+#endif
+
+    if (!File->m_Data)
+    {
+        return nullptr;
+    }
+    return File;
+}
+
+MappedFile::~MappedFile()
+{
+#if _WIN32
+    if (m_Data)
+    {
+        UnmapViewOfFile(m_Data);
+    }
+    if (m_Mapping)
+    {
+        CloseHandle(m_Mapping);
+    }
+    if (m_File != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_File);
+    }
+#else
+    if (m_Data)
+    {
+        munmap(const_cast<uint8_t*>(m_Data), m_Size);
+    }
+    if (m_Descriptor >= 0)
+    {
+        close(m_Descriptor);
+    }
+#endif
+}
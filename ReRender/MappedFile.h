@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Read-only memory mapping of a whole file. The view stays valid for the lifetime of the object.
+class MappedFile
+{
+public:
+    // Returns nullptr if the file does not exist or cannot be mapped.
+    static std::shared_ptr<MappedFile> Open(const std::string& FileName);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* Data() const { return m_Data; }
+    size_t Size() const { return m_Size; }
+
+    template<typename T>
+    const T* At(size_t Offset) const
+    {
+        return reinterpret_cast<const T*>(m_Data + Offset);
+    }
+
+private:
+    MappedFile();
+
+    const uint8_t* m_Data;
+    size_t m_Size;
+
+#if _WIN32
+    void* m_File;
+    void* m_Mapping;
+#else
+    int m_Descriptor;
+#endif
+};
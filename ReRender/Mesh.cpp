@@ -7,9 +7,17 @@
 #include <assimp/include/assimp/LogStream.hpp>
 
 #include <cstdio>
+#include <mutex>
 #include <stdexcept>
 
-const unsigned int ImportFlags =
+#include "Hash.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshWelder.h"
+#include "PortableUtils.h"
+
+const unsigned int Mesh::ImportFlags =
     aiProcess_CalcTangentSpace |
     aiProcess_Triangulate |
     aiProcess_SortByPType |
@@ -20,16 +28,46 @@ const unsigned int ImportFlags =
     aiProcess_Debone |
     aiProcess_ValidateDataStructure;
 
+//JoinIdenticalVertices is left out of ImportFlags on purpose, the weld pass below is faster on large meshes and tolerance based
+static const WeldSettings ImportWeldSettings;
+static const OptimizeSettings ImportOptimizeSettings;
+static const SimplifySettings ImportSimplifySettings;
+
+MeshCacheKey Mesh::CacheKey(uint64_t SourceHash)
+{
+    uint64_t ProcessHash = Hash::Fnv1a64(&ImportWeldSettings.PositionEpsilon, sizeof(float));
+    ProcessHash = Hash::Combine(ProcessHash, ImportWeldSettings.NormalEpsilon);
+    ProcessHash = Hash::Combine(ProcessHash, ImportWeldSettings.TangentEpsilon);
+    ProcessHash = Hash::Combine(ProcessHash, ImportWeldSettings.TexcoordEpsilon);
+    ProcessHash = Hash::Combine(ProcessHash, ImportOptimizeSettings.VertexCache);
+    ProcessHash = Hash::Combine(ProcessHash, ImportOptimizeSettings.Overdraw);
+    ProcessHash = Hash::Combine(ProcessHash, ImportOptimizeSettings.VertexFetch);
+    ProcessHash = Hash::Combine(ProcessHash, ImportOptimizeSettings.OverdrawThreshold);
+    for (float Ratio : ImportSimplifySettings.LodRatios)
+    {
+        ProcessHash = Hash::Combine(ProcessHash, Ratio);
+    }
+    ProcessHash = Hash::Combine(ProcessHash, ImportSimplifySettings.NormalWeight);
+    ProcessHash = Hash::Combine(ProcessHash, ImportSimplifySettings.TexcoordWeight);
+    ProcessHash = Hash::Combine(ProcessHash, ImportSimplifySettings.MaxError);
+    return MeshCacheKey{ SourceHash, ProcessHash, ImportFlags };
+}
+
 struct LogStream : public Assimp::LogStream
 {
+    //Meshes may be imported from several loader threads at once, the logger is created once
     static void Initialize()
     {
-        if(Assimp::DefaultLogger::isNullLogger())
+        static std::once_flag Once;
+        std::call_once(Once, []()
         {
-            Assimp::DefaultLogger::create("AssimpLogger",Assimp::Logger::VERBOSE);
-            Assimp::DefaultLogger::get()->attachStream(new LogStream,
-                Assimp::Logger::Err | Assimp::Logger::Warn);
-        }
+            if(Assimp::DefaultLogger::isNullLogger())
+            {
+                Assimp::DefaultLogger::create("AssimpLogger",Assimp::Logger::VERBOSE);
+                Assimp::DefaultLogger::get()->attachStream(new LogStream,
+                    Assimp::Logger::Err | Assimp::Logger::Warn);
+            }
+        });
     }
 
     void write(const char* message) override
@@ -38,13 +76,43 @@ struct LogStream : public Assimp::LogStream
     }
 };
 
-Mesh::Mesh(const aiMesh* Mesh)
+Mesh::Mesh(const aiScene* Scene)
+{
+    size_t NumVertices = 0;
+    size_t NumFaces = 0;
+    for (unsigned int i = 0; i < Scene->mNumMeshes; ++i)
+    {
+        NumVertices += Scene->mMeshes[i]->mNumVertices;
+        NumFaces += Scene->mMeshes[i]->mNumFaces;
+    }
+    m_Vertices.reserve(NumVertices);
+    m_Faces.reserve(NumFaces);
+
+    for (unsigned int i = 0; i < Scene->mNumMeshes; ++i)
+    {
+        //SortByPType splits points/lines into their own meshes, only triangles are drawn
+        if (Scene->mMeshes[i]->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+        {
+            AppendSubMesh(Scene->mMeshes[i]);
+        }
+    }
+
+    ComputeBounds();
+}
+
+void Mesh::AppendSubMesh(const aiMesh* Mesh)
 {
     assert(Mesh->HasPositions());
     assert(Mesh->HasNormals());
 
-    m_Vertices.reserve(Mesh->mNumVertices);
-    for (size_t i = 0; i < m_Vertices.capacity(); ++i) 
+    SubMesh subMesh = {};
+    subMesh.BaseVertex = static_cast<uint32_t>(m_Vertices.size());
+    subMesh.NumVertices = Mesh->mNumVertices;
+    subMesh.FirstIndex = static_cast<uint32_t>(m_Faces.size() * 3);
+    subMesh.NumIndices = Mesh->mNumFaces * 3;
+    subMesh.MaterialIndex = Mesh->mMaterialIndex;
+
+    for (unsigned int i = 0; i < Mesh->mNumVertices; ++i)
     {
         Vertex vertex;
         vertex.Position = { Mesh->mVertices[i].x, Mesh->mVertices[i].y, Mesh->mVertices[i].z };
@@ -65,12 +133,13 @@ Mesh::Mesh(const aiMesh* Mesh)
         m_Vertices.push_back(vertex);
     }
 
-    m_Faces.reserve(Mesh->mNumFaces);
-    for (size_t i = 0; i < m_Faces.capacity(); ++i) 
+    for (unsigned int i = 0; i < Mesh->mNumFaces; ++i) 
     {
         assert(Mesh->mFaces[i].mNumIndices == 3);
         m_Faces.push_back({ Mesh->mFaces[i].mIndices[0], Mesh->mFaces[i].mIndices[1], Mesh->mFaces[i].mIndices[2] });
     }
+
+    m_SubMeshes.push_back(subMesh);
 }
 
 Mesh::Mesh(MeshData& InMeshData)
@@ -93,12 +162,113 @@ Mesh::Mesh(MeshData& InMeshData)
         m_Faces.push_back(face);
     }
 
+    SubMesh subMesh = {};
+    subMesh.NumVertices = static_cast<uint32_t>(m_Vertices.size());
+    subMesh.NumIndices = static_cast<uint32_t>(m_Faces.size() * 3);
+    m_SubMeshes.push_back(subMesh);
+
+    ComputeBounds();
+}
+
+Mesh::Mesh(const Vertex* InVertices, size_t NumVertices,
+    const Face* InFaces, size_t NumFaces,
+    const SubMesh* InSubMeshes, size_t NumSubMeshes,
+    const SubMeshLod* InLods, size_t NumLods)
+    :m_Vertices(InVertices, InVertices + NumVertices)
+    ,m_Faces(InFaces, InFaces + NumFaces)
+    ,m_SubMeshes(InSubMeshes, InSubMeshes + NumSubMeshes)
+    ,m_Lods(InLods, InLods + NumLods)
+{
+    ComputeBounds();
+}
+
+Mesh::Mesh(const Vertex* InVertices, size_t NumVertices,
+    const Face* InFaces, size_t NumFaces,
+    const SubMesh* InSubMeshes, size_t NumSubMeshes,
+    const SubMeshLod* InLods, size_t NumLods,
+    const Vec3& InBoundsMin, const Vec3& InBoundsMax)
+    :m_Vertices(InVertices, InVertices + NumVertices)
+    ,m_Faces(InFaces, InFaces + NumFaces)
+    ,m_SubMeshes(InSubMeshes, InSubMeshes + NumSubMeshes)
+    ,m_Lods(InLods, InLods + NumLods)
+    ,m_BoundsMin(InBoundsMin)
+    ,m_BoundsMax(InBoundsMax)
+{
+}
+
+void Mesh::ReplaceGeometry(std::vector<Vertex>&& InVertices, std::vector<Face>&& InFaces, std::vector<SubMesh>&& InSubMeshes)
+{
+    m_Vertices = std::move(InVertices);
+    m_Faces = std::move(InFaces);
+    m_SubMeshes = std::move(InSubMeshes);
+    m_Lods.clear();
+    ComputeBounds();
 }
 
-std::shared_ptr<Mesh> Mesh::FromFile(const std::string& FileName)
+void Mesh::AppendLods(const std::vector<Face>& LodFaces, std::vector<SubMeshLod>&& InLods)
 {
+    m_Faces.insert(m_Faces.end(), LodFaces.begin(), LodFaces.end());
+    m_Lods = std::move(InLods);
+}
+
+void Mesh::PostProcess(const std::string& Name)
+{
+    const WeldStats Stats = MeshWelder::Weld(*this, ImportWeldSettings);
+    MeshWelder::PrintStats(Name.c_str(), Stats);
+
+    const MeshAnalysis Before = MeshOptimizer::Analyze(*this);
+    MeshOptimizer::Optimize(*this, ImportOptimizeSettings);
+    MeshOptimizer::PrintAnalysis(Name.c_str(), Before, MeshOptimizer::Analyze(*this));
+
+    //LODs go last, they reuse the optimized vertex order and only append faces
+    MeshSimplifier::PrintStats(Name.c_str(), MeshSimplifier::BuildLods(*this, ImportSimplifySettings));
+}
+
+void Mesh::ComputeBounds()
+{
+    m_BoundsMin = m_BoundsMax = Vec3{ 0.0f };
+    bool bHasBounds = false;
+
+    for (size_t i = 0; i < m_SubMeshes.size(); ++i)
+    {
+        SubMesh& subMesh = m_SubMeshes[i];
+        if (subMesh.NumVertices == 0)
+        {
+            subMesh.BoundsMin = subMesh.BoundsMax = Vec3{ 0.0f };
+            continue;
+        }
+
+        subMesh.BoundsMin = subMesh.BoundsMax = m_Vertices[subMesh.BaseVertex].Position;
+        for (uint32_t v = subMesh.BaseVertex; v < subMesh.BaseVertex + subMesh.NumVertices; ++v)
+        {
+            subMesh.BoundsMin = glm::min(subMesh.BoundsMin, m_Vertices[v].Position);
+            subMesh.BoundsMax = glm::max(subMesh.BoundsMax, m_Vertices[v].Position);
+        }
+
+        //Empty submeshes sit at the origin, they must not pull it into the mesh bounds
+        m_BoundsMin = bHasBounds ? glm::min(m_BoundsMin, subMesh.BoundsMin) : subMesh.BoundsMin;
+        m_BoundsMax = bHasBounds ? glm::max(m_BoundsMax, subMesh.BoundsMax) : subMesh.BoundsMax;
+        bHasBounds = true;
+    }
+}
+
+std::shared_ptr<Mesh> Mesh::FromFile(const std::string& FileName, bool UseCache)
+{
+    const auto StartTime = std::chrono::high_resolution_clock::now();
+
+    //Warm start: a cache built from the same source bytes and import flags skips Assimp entirely
+    const std::string CacheFile = MeshCache::CachePath(FileName);
+    const uint64_t SourceHash = UseCache ? MeshCache::HashSourceFile(FileName) : 0;
+    if (UseCache)
+    {
+        if (std::shared_ptr<Mesh> Cached = MeshCache::Load(CacheFile, CacheKey(SourceHash)))
+        {
+            std::printf("Loading mesh : %s (cache, %.2f ms)\n", FileName.c_str(), ElapsedMs(StartTime));
+            return Cached;
+        }
+    }
+
     LogStream::Initialize();
-    std::printf("Loading mesh : %s\n", FileName.c_str());
 
     std::shared_ptr<Mesh>mesh;
     Assimp::Importer Importer;
@@ -106,13 +276,23 @@ std::shared_ptr<Mesh> Mesh::FromFile(const std::string& FileName)
     const aiScene* scene = Importer.ReadFile(FileName, ImportFlags);
     if(scene && scene->HasMeshes())
     {
-        mesh = std::make_shared<Mesh>( Mesh{ scene->mMeshes[0] });
+        mesh = std::shared_ptr<Mesh>(new Mesh{ scene });
     }
-    else
+
+    if (!mesh || mesh->SubMeshes().empty())
     {
         throw std::runtime_error("Failed to load mesh file:" + FileName);
     }
 
+    mesh->PostProcess(FileName);
+
+    std::printf("Loading mesh : %s (import, %zu submeshes, %.2f ms)\n", FileName.c_str(), mesh->SubMeshes().size(), ElapsedMs(StartTime));
+
+    if (UseCache && SourceHash != 0 && !MeshCache::Save(CacheFile, *mesh, CacheKey(SourceHash)))
+    {
+        std::printf("Failed to write mesh cache : %s\n", CacheFile.c_str());
+    }
+
     return mesh;
 }
 
@@ -127,12 +307,15 @@ std::shared_ptr<Mesh> Mesh::FromString(const std::string& data)
 
     if (scene && scene->HasMeshes()) 
     {
-        mesh = std::shared_ptr<Mesh>(new Mesh{ scene->mMeshes[0] });
+        mesh = std::shared_ptr<Mesh>(new Mesh{ scene });
     }
-    else 
+
+    if (!mesh || mesh->SubMeshes().empty())
     {
         throw std::runtime_error("Failed to create mesh from string: " + data);
     }
+
+    mesh->PostProcess("<string>");
     return mesh;
 }
 
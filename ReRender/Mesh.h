@@ -9,6 +9,8 @@
 using Vec3 = glm::vec3;
 using Vec2 = glm::vec2;
 
+struct MeshCacheKey;
+
 struct Vertex
 {
     Vec3 Position;
@@ -36,6 +38,32 @@ struct Face
 };
 static_assert(sizeof(Face) == 3 * sizeof(uint32_t));
 
+//One aiMesh inside the shared vertex/index arena.
+//Face indices are local to the submesh, draw with BaseVertex as BaseVertexLocation.
+struct SubMesh
+{
+    uint32_t BaseVertex;
+    uint32_t NumVertices;
+    uint32_t FirstIndex;
+    uint32_t NumIndices;
+    uint32_t MaterialIndex;
+    Vec3 BoundsMin;
+    Vec3 BoundsMax;
+};
+static_assert(sizeof(SubMesh) == 5 * sizeof(uint32_t) + 6 * sizeof(float));
+
+//One simplified index range of a submesh, stored after the full detail faces in the same face list.
+//Level 0 is the submesh itself. Error is the object-space distance the surface moved by at most.
+struct SubMeshLod
+{
+    uint32_t SubMeshIndex;
+    uint32_t Level;
+    uint32_t FirstIndex;
+    uint32_t NumIndices;
+    float Error;
+};
+static_assert(sizeof(SubMeshLod) == 5 * sizeof(uint32_t));
+
 //For Generator purpose
 struct MeshData
 {
@@ -48,19 +76,58 @@ class Mesh
 
 public:
 
-    static std::shared_ptr<Mesh> FromFile(const std::string& FileName);
+    //Assimp post-processing flags, also part of the mesh cache key
+    static const unsigned int ImportFlags;
+
+    //Source hash plus everything the import pipeline depends on (flags, pass settings)
+    static MeshCacheKey CacheKey(uint64_t SourceHash);
+
+    static std::shared_ptr<Mesh> FromFile(const std::string& FileName, bool UseCache = true);
     static std::shared_ptr<Mesh> FromString(const std::string& Data);
 
     const std::vector<Vertex>& Vertices() const { return m_Vertices; }
     const std::vector<Face>& Faces()const { return m_Faces; }
+    const std::vector<SubMesh>& SubMeshes() const { return m_SubMeshes; }
+
+    //Sorted by submesh then level, every submesh has the same number of levels (empty when no LODs were built)
+    const std::vector<SubMeshLod>& Lods() const { return m_Lods; }
+    uint32_t NumLodLevels() const { return m_SubMeshes.empty() ? 0 : static_cast<uint32_t>(m_Lods.size() / m_SubMeshes.size()); }
+
+    const Vec3& BoundsMin() const { return m_BoundsMin; }
+    const Vec3& BoundsMax() const { return m_BoundsMax; }
+
+    //Used by the offline passes (welding, optimizing, ...) to swap in rewritten geometry, recomputes bounds and drops LODs
+    void ReplaceGeometry(std::vector<Vertex>&& InVertices, std::vector<Face>&& InFaces, std::vector<SubMesh>&& InSubMeshes);
+
+    //Appends LOD faces after the existing ones, InLods already point into the combined face list
+    void AppendLods(const std::vector<Face>& LodFaces, std::vector<SubMeshLod>&& InLods);
 
     Mesh(MeshData& InMeshData);
+    Mesh(const Vertex* InVertices, size_t NumVertices,
+        const Face* InFaces, size_t NumFaces,
+        const SubMesh* InSubMeshes, size_t NumSubMeshes,
+        const SubMeshLod* InLods = nullptr, size_t NumLods = 0);
+    //Bounds already known, e.g. from MeshCache, the submeshes have to carry theirs as well. Skips ComputeBounds
+    Mesh(const Vertex* InVertices, size_t NumVertices,
+        const Face* InFaces, size_t NumFaces,
+        const SubMesh* InSubMeshes, size_t NumSubMeshes,
+        const SubMeshLod* InLods, size_t NumLods,
+        const Vec3& InBoundsMin, const Vec3& InBoundsMax);
 
 private:
 
-    Mesh(const struct aiMesh* Mesh);
+    Mesh(const struct aiScene* Scene);
+    void AppendSubMesh(const struct aiMesh* Mesh);
+    void PostProcess(const std::string& Name);
+    void ComputeBounds();
+
     std::vector<Vertex> m_Vertices;
     std::vector<Face> m_Faces;
+    std::vector<SubMesh> m_SubMeshes;
+    std::vector<SubMeshLod> m_Lods;
+
+    Vec3 m_BoundsMin = Vec3{ 0.0f };
+    Vec3 m_BoundsMax = Vec3{ 0.0f };
 
 };
 
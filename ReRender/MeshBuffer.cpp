@@ -1,29 +1,73 @@
 #include "MeshBuffer.h"
+#include <cstddef>
 #include <stdexcept>
 #include <d3dx12/d3dx12.h>
 #include <d3dcompiler.h>
 
+#include "CommandContext.h"
+#include "GpuHeapManager.h"
 #include "Mesh.h"
+#include "MeshletCuller.h"
 #include "StagingBuffer.h"
+#include "UploadBatch.h"
+#include "VertexPacking.h"
 
-MeshBuffer MeshBuffer::CreateMeshBuffer(std::function<void()>CallBack, ComPtr<ID3D12GraphicsCommandList> m_CommandList, ComPtr<ID3D12Device>m_Device, std::shared_ptr<class Mesh>mesh)
+MeshBuffer MeshBuffer::CreateMeshBuffer(UploadBatch& Batch, ComPtr<ID3D12GraphicsCommandList> m_CommandList, ComPtr<ID3D12Device>m_Device, std::shared_ptr<class Mesh>mesh, VertexFormat Format, GpuHeapManager* HeapManager, GeometryPool* Pool)
 {
     MeshBuffer Buffer;
     Buffer.NumElements = static_cast<UINT>(mesh->Faces().size() * 3);
+    Buffer.SubMeshes = mesh->SubMeshes();
+    Buffer.Lods = mesh->Lods();
+    Buffer.Format = Format;
 
-    const size_t VertexDataSize = mesh->Vertices().size() * sizeof(Vertex);
-    const size_t IndexDataSize = mesh->Faces().size() * sizeof(Face);
+    PackedVertexData Packed;
+    if (Format == VertexFormat::Packed)
+    {
+        Packed = VertexPacking::Encode(*mesh);
+        Buffer.PositionOffset = Packed.PositionOffset;
+        Buffer.PositionScale = Packed.PositionScale;
+    }
+    const void* VertexData = Format == VertexFormat::Packed ? static_cast<const void*>(Packed.Vertices.data()) : mesh->Vertices().data();
+    const UINT VertexStride = Format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+
+    //Indices are local to each submesh, so R16 only needs every submesh below 65536 vertices
+    const bool bUse16BitIndices = VertexPacking::CanUse16BitIndices(*mesh);
+    std::vector<uint16_t> Indices16;
+    if (bUse16BitIndices)
+    {
+        Indices16.reserve(Buffer.NumElements);
+        for (const Face& face : mesh->Faces())
+        {
+            Indices16.push_back(static_cast<uint16_t>(face.v1));
+            Indices16.push_back(static_cast<uint16_t>(face.v2));
+            Indices16.push_back(static_cast<uint16_t>(face.v3));
+        }
+    }
+    const void* IndexData = bUse16BitIndices ? static_cast<const void*>(Indices16.data()) : mesh->Faces().data();
+
+    const size_t VertexDataSize = mesh->Vertices().size() * VertexStride;
+    const size_t IndexDataSize = size_t(Buffer.NumElements) * (bUse16BitIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+    const DXGI_FORMAT IndexFormat = bUse16BitIndices ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+
+    if (Pool)
+    {
+        Buffer.Pool = Pool;
+        Buffer.Geometry = Pool->Allocate(VertexStride, static_cast<UINT>(mesh->Vertices().size()), IndexFormat, Buffer.NumElements);
+        Pool->Upload(Batch, m_CommandList.Get(), Buffer.Geometry, VertexData, IndexData);
+        Buffer.Vbv = Pool->VertexBufferView(VertexStride);
+        Buffer.Ibv = Pool->IndexBufferView(IndexFormat);
+        return Buffer;
+    }
 
     //GPUԴ
-    auto DefaultType = CD3DX12_HEAP_PROPERTIES{ D3D12_HEAP_TYPE_DEFAULT };
     auto ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(VertexDataSize);
-    if (FAILED(m_Device->CreateCommittedResource(
-        &DefaultType,
-        D3D12_HEAP_FLAG_NONE,
+    if (FAILED(GpuHeapManager::CreateResource(
+        HeapManager,
+        m_Device.Get(),
         &ResourceDesc,
         D3D12_RESOURCE_STATE_COPY_DEST,
         nullptr,
-        IID_PPV_ARGS(&Buffer.VertexBuffer)
+        Buffer.VertexBuffer
     )))
     {
         throw std::runtime_error("Failed to create vertex buffer");
@@ -31,40 +75,40 @@ MeshBuffer MeshBuffer::CreateMeshBuffer(std::function<void()>CallBack, ComPtr<ID
 
     Buffer.Vbv.BufferLocation = Buffer.VertexBuffer->GetGPUVirtualAddress();
     Buffer.Vbv.SizeInBytes = static_cast<UINT>(VertexDataSize);
-    Buffer.Vbv.StrideInBytes = sizeof(Vertex);
+    Buffer.Vbv.StrideInBytes = VertexStride;
 
     auto IndexDesc = CD3DX12_RESOURCE_DESC::Buffer(IndexDataSize);
-    if (FAILED(m_Device->CreateCommittedResource(
-        &DefaultType,
-        D3D12_HEAP_FLAG_NONE,
+    if (FAILED(GpuHeapManager::CreateResource(
+        HeapManager,
+        m_Device.Get(),
         &IndexDesc,
         D3D12_RESOURCE_STATE_COPY_DEST,
         nullptr,
-        IID_PPV_ARGS(&Buffer.IndexBuffer)
+        Buffer.IndexBuffer
     )))
     {
         throw std::runtime_error("Failed to create index buffer");
     }
     Buffer.Ibv.BufferLocation = Buffer.IndexBuffer->GetGPUVirtualAddress();
     Buffer.Ibv.SizeInBytes = static_cast<UINT>(IndexDataSize);
-    Buffer.Ibv.Format = DXGI_FORMAT_R32_UINT;
+    Buffer.Ibv.Format = IndexFormat;
 
     //һʱ
+    //Each copy is recorded before the next staging allocation, which may submit the batch to make room in the ring
     StagingBuffer VertexStagingBuffer;
     {
-        const D3D12_SUBRESOURCE_DATA Data = { mesh->Vertices().data() };
-        VertexStagingBuffer = StagingBuffer::CreateStagingBuffer(m_Device, Buffer.VertexBuffer, 0, 1, &Data);
+        const D3D12_SUBRESOURCE_DATA Data = { VertexData };
+        VertexStagingBuffer = StagingBuffer::CreateStagingBuffer(Batch, m_Device, Buffer.VertexBuffer, 0, 1, &Data);
+        m_CommandList->CopyBufferRegion(Buffer.VertexBuffer.Get(), 0, VertexStagingBuffer.Buffer.Get(), VertexStagingBuffer.Layouts[0].Offset, VertexDataSize);
     }
     StagingBuffer IndexStagingBuffer;
     {
-        const D3D12_SUBRESOURCE_DATA Data = { mesh->Faces().data() };
-        IndexStagingBuffer = StagingBuffer::CreateStagingBuffer(m_Device, Buffer.IndexBuffer, 0, 1, &Data);
+        const D3D12_SUBRESOURCE_DATA Data = { IndexData };
+        IndexStagingBuffer = StagingBuffer::CreateStagingBuffer(Batch, m_Device, Buffer.IndexBuffer, 0, 1, &Data);
+        m_CommandList->CopyBufferRegion(Buffer.IndexBuffer.Get(), 0, IndexStagingBuffer.Buffer.Get(), IndexStagingBuffer.Layouts[0].Offset, IndexDataSize);
     }
 
     //ϴGPU
-    m_CommandList->CopyResource(Buffer.VertexBuffer.Get(), VertexStagingBuffer.Buffer.Get());
-    m_CommandList->CopyResource(Buffer.IndexBuffer.Get(), IndexStagingBuffer.Buffer.Get());
-
     const D3D12_RESOURCE_BARRIER Barriers[] =
     {
         CD3DX12_RESOURCE_BARRIER::Transition(
@@ -81,17 +125,84 @@ MeshBuffer MeshBuffer::CreateMeshBuffer(std::function<void()>CallBack, ComPtr<ID
 
     m_CommandList->ResourceBarrier(2, Barriers);
 
-    CallBack();
+    Batch.Retain(std::move(VertexStagingBuffer), VertexDataSize);
+    Batch.Retain(std::move(IndexStagingBuffer), IndexDataSize);
 
     return Buffer;
 }
 
-MeshBuffer MeshBuffer::CreateMeshBuffer(std::function<void()> CallBack, ComPtr<ID3D12GraphicsCommandList> m_CommandList,
-    ComPtr<ID3D12Device> m_Device, MeshData& meshData)
+//The element offsets below
+static_assert(offsetof(PackedVertex, Normal) == 8 && offsetof(PackedVertex, Tangent) == 12 && offsetof(PackedVertex, Texcoord) == 16);
+
+std::vector<D3D12_INPUT_ELEMENT_DESC> MeshBuffer::PackedInputLayout()
+{
+    return
+    {
+        {
+            "POSITION",
+            0,
+            DXGI_FORMAT_R16G16B16A16_SNORM,
+            0,
+            0,
+            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+            0
+        },
+        {
+            "NORMAL",
+            0,
+            DXGI_FORMAT_R16G16_SNORM,
+            0,
+            8,
+            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+            0
+        },
+        {
+            "TANGENT",
+            0,
+            DXGI_FORMAT_R16G16_SNORM,
+            0,
+            12,
+            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+            0
+        },
+        {
+            "TEXCOORD",
+            0,
+            DXGI_FORMAT_R16G16_FLOAT,
+            0,
+            16,
+            D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+            0
+        }
+    };
+}
+
+void MeshBuffer::DrawSubMeshes(CommandContext& Context, UINT InstanceCount) const
+{
+    const INT PoolBaseVertex = Pool ? Pool->BaseVertex(Geometry) : 0;
+    const UINT PoolFirstIndex = Pool ? Pool->FirstIndex(Geometry) : 0;
+    for (const SubMesh& subMesh : SubMeshes)
+    {
+        Context.DrawIndexed(subMesh.NumIndices, InstanceCount, PoolFirstIndex + subMesh.FirstIndex, PoolBaseVertex + INT(subMesh.BaseVertex));
+    }
+}
+
+void MeshBuffer::DrawRanges(CommandContext& Context, const std::vector<DrawRange>& Ranges, UINT InstanceCount) const
+{
+    const INT PoolBaseVertex = Pool ? Pool->BaseVertex(Geometry) : 0;
+    const UINT PoolFirstIndex = Pool ? Pool->FirstIndex(Geometry) : 0;
+    for (const DrawRange& Range : Ranges)
+    {
+        Context.DrawIndexed(Range.NumIndices, InstanceCount, PoolFirstIndex + Range.FirstIndex, PoolBaseVertex + INT(Range.BaseVertex));
+    }
+}
+
+MeshBuffer MeshBuffer::CreateMeshBuffer(UploadBatch& Batch, ComPtr<ID3D12GraphicsCommandList> m_CommandList,
+    ComPtr<ID3D12Device> m_Device, MeshData& meshData, VertexFormat Format, GpuHeapManager* HeapManager, GeometryPool* Pool)
 {
     auto GeneratorMesh = std::make_shared<Mesh>(meshData);
 
-    MeshBuffer buffer = CreateMeshBuffer(CallBack, m_CommandList, m_Device, GeneratorMesh);
+    MeshBuffer buffer = CreateMeshBuffer(Batch, m_CommandList, m_Device, GeneratorMesh, Format, HeapManager, Pool);
 
     return buffer;
 }
@@ -3,11 +3,36 @@
 #include <functional>
 #include <wrl/client.h>
 #include <memory>
+#include <vector>
 #include <d3d12.h>
 #include <dxgi1_4.h>
 
+#include "GeometryPool.h"
+#include "Mesh.h"
+
 using Microsoft::WRL::ComPtr;
 
+class CommandContext;
+struct DrawRange;
+class UploadBatch;
+class GpuHeapManager;
+
+enum class VertexFormat
+{
+    Full,   //56-byte Vertex, the layout the shaders take by default
+    Packed, //20-byte PackedVertex, see VertexPacking.h and shaders/hlsl/packed_vertex.hlsli
+};
+
+//Root constants of the pipelines that decode VertexFormat::Packed, PackedPositionConstants in packed_vertex.hlsli
+struct PackedPositionConstants
+{
+    Vec3 Offset{ 0.0f };
+    float Padding0 = 0.0f;
+    Vec3 Scale{ 1.0f };
+    float Padding1 = 0.0f;
+};
+static_assert(sizeof(PackedPositionConstants) == 8 * sizeof(uint32_t));
+
 class MeshBuffer
 {
 public:
@@ -16,10 +41,40 @@ public:
     D3D12_VERTEX_BUFFER_VIEW Vbv;
     D3D12_INDEX_BUFFER_VIEW Ibv;
     UINT NumElements;
+    std::vector<SubMesh> SubMeshes;
+    std::vector<SubMeshLod> Lods; //Ranges in the same index buffer, empty for generated meshes
+
+    //Packed only: the shader rebuilds positions as PositionOffset + snorm * PositionScale
+    VertexFormat Format = VertexFormat::Full;
+    Vec3 PositionOffset = Vec3{ 0.0f };
+    Vec3 PositionScale = Vec3{ 1.0f };
+
+    //Set when the mesh lives in a GeometryPool: VertexBuffer/IndexBuffer stay empty, Vbv/Ibv cover the pool's
+    //shared buffers and the draws add the mesh's current offsets, which change when the pool compacts
+    GeometryPool* Pool = nullptr;
+    GeometryAllocation Geometry;
+
+    //VB/IB must already be bound, one CommandContext::DrawIndexed per submesh
+    void DrawSubMeshes(CommandContext& Context, UINT InstanceCount = 1) const;
+
+    //Same, but only the ranges that survived MeshletCuller
+    void DrawRanges(CommandContext& Context, const std::vector<DrawRange>& Ranges, UINT InstanceCount = 1) const;
+
+    //Set as 32-bit root constants before drawing with a packed pipeline
+    PackedPositionConstants PositionConstants() const { return { PositionOffset, 0.0f, PositionScale, 0.0f }; }
+
+    //Input layout matching PackedVertex
+    static std::vector<D3D12_INPUT_ELEMENT_DESC> PackedInputLayout();
 
-    static MeshBuffer CreateMeshBuffer(std::function<void()>CallBack,ComPtr<ID3D12GraphicsCommandList> m_CommandList,ComPtr<ID3D12Device>m_Device, std::shared_ptr<class Mesh>mesh);
+    //Index format is picked automatically: R16 when every submesh has fewer than 65536 vertices
+    //Records the copies into m_CommandList, the staging buffers stay alive in Batch until its fence passes
+    //VB/IB are placed in HeapManager's buffer pool when one is given, committed otherwise
+    //With a Pool the mesh is suballocated from its shared buffers instead and HeapManager is not used
+    static MeshBuffer CreateMeshBuffer(UploadBatch& Batch,ComPtr<ID3D12GraphicsCommandList> m_CommandList,ComPtr<ID3D12Device>m_Device, std::shared_ptr<class Mesh>mesh,
+        VertexFormat Format = VertexFormat::Full, GpuHeapManager* HeapManager = nullptr, GeometryPool* Pool = nullptr);
 
-    static MeshBuffer CreateMeshBuffer(std::function<void()> CallBack, ComPtr<ID3D12GraphicsCommandList> m_CommandList,
-        ComPtr<ID3D12Device> m_Device, class MeshData& meshData);
+    static MeshBuffer CreateMeshBuffer(UploadBatch& Batch, ComPtr<ID3D12GraphicsCommandList> m_CommandList,
+        ComPtr<ID3D12Device> m_Device, class MeshData& meshData, VertexFormat Format = VertexFormat::Full,
+        GpuHeapManager* HeapManager = nullptr, GeometryPool* Pool = nullptr);
 };
 
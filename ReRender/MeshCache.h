@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class Mesh;
+
+// Everything a cached mesh depends on: the source bytes, the Assimp flags and the settings of the
+// offline passes that run after the import. Any change to one of them invalidates the cache.
+struct MeshCacheKey
+{
+    uint64_t SourceHash;
+    uint64_t ProcessHash;
+    uint32_t ImportFlags;
+};
+
+// On-disk layout: header, then the Vertex, Face, SubMesh and SubMeshLod blocks, each aligned to BlockAlignment.
+// All blocks use the in-memory layout of Vertex/Face/SubMesh/SubMeshLod so a hit is a straight copy out of the mapping.
+struct MeshCacheHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t SourceHash;
+    uint64_t ProcessHash;
+    uint32_t ImportFlags;
+    uint32_t VertexStride;
+    uint32_t NumVertices;
+    uint32_t NumFaces;
+    uint32_t NumSubMeshes;
+    uint32_t NumLods;
+    uint64_t VertexOffset;
+    uint64_t FaceOffset;
+    uint64_t SubMeshOffset;
+    uint64_t LodOffset;
+    float BoundsMin[3];
+    float BoundsMax[3];
+};
+static_assert(sizeof(MeshCacheHeader) == 104);
+
+class MeshCache
+{
+public:
+    static const uint32_t Magic = 0x48534D52; // "RMSH"
+    static const uint32_t Version = 4;
+    static const uint32_t BlockAlignment = 64;
+
+    static std::string CachePath(const std::string& SourceFile);
+    static uint64_t HashSourceFile(const std::string& SourceFile);
+
+    // Returns nullptr on a miss: missing file, version/stride mismatch, any key mismatch, truncated blocks, or
+    // submesh and LOD ranges that reach past the vertex or face block.
+    static std::shared_ptr<Mesh> Load(const std::string& CacheFile, const MeshCacheKey& Key);
+    static bool Save(const std::string& CacheFile, const Mesh& mesh, const MeshCacheKey& Key);
+
+    // Round trips a small mesh with LODs and checks that key mismatches, truncated files, block offsets that
+    // wrap around and out of range submesh and LOD tables all miss, in a scratch directory. No GPU needed.
+    static bool SelfTest();
+
+    // Times the Assimp import against the cache path and prints the averages.
+    static void Benchmark(const std::string& SourceFile, int Iterations);
+};
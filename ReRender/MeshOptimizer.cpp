@@ -0,0 +1,654 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const uint32_t InvalidIndex = ~0u;
+
+    // Forsyth, "Linear-Speed Vertex Cache Optimisation". The scoring cache is larger than the
+    // simulated FIFO on purpose, it only has to rank vertices, not model the hardware exactly.
+    const int ScoreCacheSize = 32;
+    const int MaxValenceScore = 64;
+    const float CacheDecayPower = 1.5f;
+    const float LastTriScore = 0.75f;
+    const float ValenceBoostScale = 2.0f;
+    const float ValenceBoostPower = 0.5f;
+
+    struct ScoreTables
+    {
+        float Cache[ScoreCacheSize];
+        float Valence[MaxValenceScore];
+
+        ScoreTables()
+        {
+            for (int i = 0; i < ScoreCacheSize; ++i)
+            {
+                // The three vertices of the last triangle get a fixed score so the next triangle
+                // does not simply reuse the same edge over and over.
+                Cache[i] = i < 3 ? LastTriScore : std::pow(1.0f - float(i - 3) / (ScoreCacheSize - 3), CacheDecayPower);
+            }
+            for (int i = 0; i < MaxValenceScore; ++i)
+            {
+                Valence[i] = i == 0 ? 0.0f : ValenceBoostScale * std::pow(float(i), -ValenceBoostPower);
+            }
+        }
+
+        float Score(int CachePosition, uint32_t LiveValence) const
+        {
+            if (LiveValence == 0)
+            {
+                return -1.0f;
+            }
+            const float CacheScore = CachePosition >= 0 ? Cache[CachePosition] : 0.0f;
+            const float ValenceScore = LiveValence < MaxValenceScore ? Valence[LiveValence] : ValenceBoostScale * std::pow(float(LiveValence), -ValenceBoostPower);
+            return CacheScore + ValenceScore;
+        }
+    };
+
+    const ScoreTables& GetScoreTables()
+    {
+        static const ScoreTables Tables;
+        return Tables;
+    }
+
+    void ForsythVertexCache(Face* Faces, size_t NumFaces, uint32_t NumVertices)
+    {
+        if (NumFaces == 0)
+        {
+            return;
+        }
+        const ScoreTables& Tables = GetScoreTables();
+
+        // Vertex -> triangle adjacency, the live part of each list shrinks as triangles are emitted.
+        std::vector<uint32_t> AdjacencyOffset(NumVertices + 1, 0);
+        for (size_t f = 0; f < NumFaces; ++f)
+        {
+            ++AdjacencyOffset[Faces[f].v1 + 1];
+            ++AdjacencyOffset[Faces[f].v2 + 1];
+            ++AdjacencyOffset[Faces[f].v3 + 1];
+        }
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            AdjacencyOffset[v + 1] += AdjacencyOffset[v];
+        }
+
+        std::vector<uint32_t> LiveValence(NumVertices, 0);
+        std::vector<uint32_t> Adjacency(NumFaces * 3);
+        for (uint32_t f = 0; f < NumFaces; ++f)
+        {
+            for (uint32_t v : { Faces[f].v1, Faces[f].v2, Faces[f].v3 })
+            {
+                Adjacency[AdjacencyOffset[v] + LiveValence[v]++] = f;
+            }
+        }
+
+        std::vector<int> CachePosition(NumVertices, -1);
+        std::vector<float> VertexScore(NumVertices);
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            VertexScore[v] = Tables.Score(-1, LiveValence[v]);
+        }
+
+        std::vector<float> TriangleScore(NumFaces);
+        uint32_t Best = 0;
+        for (uint32_t f = 0; f < NumFaces; ++f)
+        {
+            TriangleScore[f] = VertexScore[Faces[f].v1] + VertexScore[Faces[f].v2] + VertexScore[Faces[f].v3];
+            if (TriangleScore[f] > TriangleScore[Best])
+            {
+                Best = f;
+            }
+        }
+
+        std::vector<bool> Emitted(NumFaces, false);
+        std::vector<Face> Output;
+        Output.reserve(NumFaces);
+
+        uint32_t Cache[ScoreCacheSize + 3];
+        uint32_t NewCache[ScoreCacheSize + 3];
+        int CacheCount = 0;
+        size_t Cursor = 0;
+
+        while (Output.size() < NumFaces)
+        {
+            // Dead end: nothing in the cache has triangles left, restart from the next unused input triangle.
+            if (Best == InvalidIndex)
+            {
+                while (Emitted[Cursor])
+                {
+                    ++Cursor;
+                }
+                Best = static_cast<uint32_t>(Cursor);
+            }
+
+            const Face& Tri = Faces[Best];
+            Emitted[Best] = true;
+            Output.push_back(Tri);
+
+            const uint32_t TriVertices[3] = { Tri.v1, Tri.v2, Tri.v3 };
+            for (uint32_t v : TriVertices)
+            {
+                uint32_t* List = &Adjacency[AdjacencyOffset[v]];
+                uint32_t* Last = List + LiveValence[v] - 1;
+                *std::find(List, Last + 1, Best) = *Last;
+                --LiveValence[v];
+            }
+
+            // The new triangle moves to the front of the LRU, everything else shifts back.
+            int NewCount = 0;
+            for (uint32_t v : TriVertices)
+            {
+                NewCache[NewCount++] = v;
+            }
+            for (int i = 0; i < CacheCount; ++i)
+            {
+                const uint32_t v = Cache[i];
+                if (v != TriVertices[0] && v != TriVertices[1] && v != TriVertices[2])
+                {
+                    NewCache[NewCount++] = v;
+                }
+            }
+
+            for (int i = 0; i < NewCount; ++i)
+            {
+                const uint32_t v = NewCache[i];
+                CachePosition[v] = i < ScoreCacheSize ? i : -1;
+
+                const float Score = Tables.Score(CachePosition[v], LiveValence[v]);
+                const float Delta = Score - VertexScore[v];
+                VertexScore[v] = Score;
+
+                const uint32_t* List = &Adjacency[AdjacencyOffset[v]];
+                for (uint32_t t = 0; t < LiveValence[v]; ++t)
+                {
+                    TriangleScore[List[t]] += Delta;
+                }
+            }
+
+            CacheCount = std::min(NewCount, ScoreCacheSize);
+            std::copy(NewCache, NewCache + CacheCount, Cache);
+
+            Best = InvalidIndex;
+            float BestScore = -1.0f;
+            for (int i = 0; i < CacheCount; ++i)
+            {
+                const uint32_t v = Cache[i];
+                const uint32_t* List = &Adjacency[AdjacencyOffset[v]];
+                for (uint32_t t = 0; t < LiveValence[v]; ++t)
+                {
+                    if (TriangleScore[List[t]] > BestScore)
+                    {
+                        BestScore = TriangleScore[List[t]];
+                        Best = List[t];
+                    }
+                }
+            }
+        }
+
+        std::copy(Output.begin(), Output.end(), Faces);
+    }
+
+    // FIFO post-transform cache with timestamps: a vertex hits if it was inserted less than CacheSize misses ago.
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t NumEntries, uint32_t InCacheSize)
+            :m_Timestamps(NumEntries, 0), m_CacheSize(InCacheSize), m_Time(InCacheSize + 1)
+        {
+        }
+
+        // Returns true on a miss.
+        bool Access(size_t Entry)
+        {
+            if (m_Time - m_Timestamps[Entry] > m_CacheSize)
+            {
+                m_Timestamps[Entry] = m_Time++;
+                return true;
+            }
+            return false;
+        }
+
+        void Reset()
+        {
+            m_Time += m_CacheSize + 1;
+        }
+
+    private:
+        std::vector<uint32_t> m_Timestamps;
+        uint32_t m_CacheSize;
+        uint32_t m_Time;
+    };
+
+    void OptimizeOverdraw(Face* Faces, size_t NumFaces, const Vertex* Vertices, uint32_t NumVertices, float Threshold)
+    {
+        if (NumFaces == 0)
+        {
+            return;
+        }
+
+        // Hard boundaries: triangles where the cache optimizer started over (all three vertices missed).
+        FifoCache Cache{ NumVertices, MeshOptimizer::AnalyzeCacheSize };
+        std::vector<uint32_t> HardClusters;
+        for (uint32_t f = 0; f < NumFaces; ++f)
+        {
+            const int Misses = Cache.Access(Faces[f].v1) + Cache.Access(Faces[f].v2) + Cache.Access(Faces[f].v3);
+            if (f == 0 || Misses == 3)
+            {
+                HardClusters.push_back(f);
+            }
+        }
+        HardClusters.push_back(static_cast<uint32_t>(NumFaces));
+
+        // Soft boundaries: split a hard cluster wherever its local ACMR is already close to the cluster's,
+        // so reordering the pieces costs little cache efficiency.
+        std::vector<uint32_t> Clusters;
+        for (size_t c = 0; c + 1 < HardClusters.size(); ++c)
+        {
+            const uint32_t Begin = HardClusters[c];
+            const uint32_t End = HardClusters[c + 1];
+
+            Cache.Reset();
+            size_t ClusterMisses = 0;
+            for (uint32_t f = Begin; f < End; ++f)
+            {
+                ClusterMisses += Cache.Access(Faces[f].v1) + Cache.Access(Faces[f].v2) + Cache.Access(Faces[f].v3);
+            }
+            const double ClusterACMR = double(ClusterMisses) / (End - Begin);
+
+            Cache.Reset();
+            Clusters.push_back(Begin);
+            uint32_t Start = Begin;
+            size_t Misses = 0;
+            for (uint32_t f = Begin; f < End; ++f)
+            {
+                Misses += Cache.Access(Faces[f].v1) + Cache.Access(Faces[f].v2) + Cache.Access(Faces[f].v3);
+                if (f + 1 < End && double(Misses) / (f + 1 - Start) <= ClusterACMR * Threshold)
+                {
+                    Clusters.push_back(f + 1);
+                    Start = f + 1;
+                    Misses = 0;
+                    Cache.Reset();
+                }
+            }
+        }
+        Clusters.push_back(static_cast<uint32_t>(NumFaces));
+
+        // Draw clusters facing away from the mesh center first, they are the most likely to occlude the rest.
+        Vec3 MeshCenter{ 0.0f };
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            MeshCenter += Vertices[v].Position;
+        }
+        MeshCenter /= float(std::max(NumVertices, 1u));
+
+        const size_t NumClusters = Clusters.size() - 1;
+        std::vector<float> SortKeys(NumClusters);
+        for (size_t c = 0; c < NumClusters; ++c)
+        {
+            Vec3 Centroid{ 0.0f };
+            Vec3 Normal{ 0.0f };
+            float Area = 0.0f;
+            for (uint32_t f = Clusters[c]; f < Clusters[c + 1]; ++f)
+            {
+                const Vec3& P1 = Vertices[Faces[f].v1].Position;
+                const Vec3& P2 = Vertices[Faces[f].v2].Position;
+                const Vec3& P3 = Vertices[Faces[f].v3].Position;
+                const Vec3 N = glm::cross(P2 - P1, P3 - P1);
+                const float TriArea = glm::length(N);
+
+                Centroid += (P1 + P2 + P3) * (TriArea / 3.0f);
+                Normal += N;
+                Area += TriArea;
+            }
+
+            const float NormalLength = glm::length(Normal);
+            if (Area > 0.0f && NormalLength > 0.0f)
+            {
+                SortKeys[c] = glm::dot(Centroid / Area - MeshCenter, Normal / NormalLength);
+            }
+            else
+            {
+                SortKeys[c] = 0.0f;
+            }
+        }
+
+        std::vector<uint32_t> Order(NumClusters);
+        for (uint32_t c = 0; c < NumClusters; ++c)
+        {
+            Order[c] = c;
+        }
+        std::stable_sort(Order.begin(), Order.end(), [&SortKeys](uint32_t A, uint32_t B) { return SortKeys[A] > SortKeys[B]; });
+
+        std::vector<Face> Output;
+        Output.reserve(NumFaces);
+        for (uint32_t c : Order)
+        {
+            Output.insert(Output.end(), Faces + Clusters[c], Faces + Clusters[c + 1]);
+        }
+        std::copy(Output.begin(), Output.end(), Faces);
+    }
+
+    // Renumbers vertices in the order the faces first reference them, unreferenced vertices are dropped.
+    std::vector<Vertex> OptimizeVertexFetch(Face* Faces, size_t NumFaces, const Vertex* Vertices, uint32_t NumVertices)
+    {
+        std::vector<uint32_t> Remap(NumVertices, InvalidIndex);
+        std::vector<Vertex> Output;
+        Output.reserve(NumVertices);
+
+        for (size_t f = 0; f < NumFaces; ++f)
+        {
+            for (uint32_t* Index : { &Faces[f].v1, &Faces[f].v2, &Faces[f].v3 })
+            {
+                if (Remap[*Index] == InvalidIndex)
+                {
+                    Remap[*Index] = static_cast<uint32_t>(Output.size());
+                    Output.push_back(Vertices[*Index]);
+                }
+                *Index = Remap[*Index];
+            }
+        }
+        return Output;
+    }
+}
+
+void MeshOptimizer::Optimize(Mesh& mesh, const OptimizeSettings& Settings)
+{
+    std::vector<Face> Faces = mesh.Faces();
+    std::vector<SubMesh> SubMeshes = mesh.SubMeshes();
+
+    // LOD faces follow the submeshes and would index the old vertex order, ReplaceGeometry drops the LODs anyway.
+    size_t NumSubMeshFaces = 0;
+    for (const SubMesh& Sub : SubMeshes)
+    {
+        NumSubMeshFaces = std::max<size_t>(NumSubMeshFaces, (Sub.FirstIndex + Sub.NumIndices) / 3);
+    }
+    Faces.resize(NumSubMeshFaces);
+    const std::vector<Vertex>& Vertices = mesh.Vertices();
+    std::vector<std::vector<Vertex>> SubMeshVertices(SubMeshes.size());
+
+    // Submeshes own disjoint face ranges, so each one is a separate task.
+    ThreadPool::Get().ParallelFor(0, SubMeshes.size(), 1, [&](size_t Begin, size_t End)
+    {
+        for (size_t i = Begin; i < End; ++i)
+        {
+            const SubMesh& Sub = SubMeshes[i];
+            Face* SubFaces = Faces.data() + Sub.FirstIndex / 3;
+            const size_t NumFaces = Sub.NumIndices / 3;
+            const Vertex* SubVertices = Vertices.data() + Sub.BaseVertex;
+
+            if (Settings.VertexCache)
+            {
+                ForsythVertexCache(SubFaces, NumFaces, Sub.NumVertices);
+            }
+            if (Settings.Overdraw)
+            {
+                OptimizeOverdraw(SubFaces, NumFaces, SubVertices, Sub.NumVertices, Settings.OverdrawThreshold);
+            }
+            if (Settings.VertexFetch)
+            {
+                SubMeshVertices[i] = OptimizeVertexFetch(SubFaces, NumFaces, SubVertices, Sub.NumVertices);
+            }
+            else
+            {
+                SubMeshVertices[i].assign(SubVertices, SubVertices + Sub.NumVertices);
+            }
+        }
+    });
+
+    std::vector<Vertex> NewVertices;
+    NewVertices.reserve(Vertices.size());
+    for (size_t i = 0; i < SubMeshes.size(); ++i)
+    {
+        SubMeshes[i].BaseVertex = static_cast<uint32_t>(NewVertices.size());
+        SubMeshes[i].NumVertices = static_cast<uint32_t>(SubMeshVertices[i].size());
+        NewVertices.insert(NewVertices.end(), SubMeshVertices[i].begin(), SubMeshVertices[i].end());
+    }
+
+    mesh.ReplaceGeometry(std::move(NewVertices), std::move(Faces), std::move(SubMeshes));
+}
+
+void MeshOptimizer::OptimizeVertexCache(Face* Faces, size_t NumFaces, uint32_t NumVertices)
+{
+    ForsythVertexCache(Faces, NumFaces, NumVertices);
+}
+
+MeshAnalysis MeshOptimizer::Analyze(const Mesh& mesh, size_t VertexStride)
+{
+    MeshAnalysis Result;
+    VertexStride = VertexStride > 0 ? VertexStride : sizeof(Vertex);
+
+    const size_t NumLines = (mesh.Vertices().size() * VertexStride + CacheLineSize - 1) / CacheLineSize;
+    FifoCache VertexCache{ mesh.Vertices().size(), AnalyzeCacheSize };
+    FifoCache FetchCache{ NumLines + 1, FetchCacheLines };
+    std::vector<bool> Referenced(mesh.Vertices().size(), false);
+
+    for (const SubMesh& Sub : mesh.SubMeshes())
+    {
+        // Every draw starts with a cold post-transform cache; the fetch cache is shared by the whole buffer.
+        VertexCache.Reset();
+
+        for (uint32_t f = Sub.FirstIndex / 3; f < (Sub.FirstIndex + Sub.NumIndices) / 3; ++f)
+        {
+            const Face& face = mesh.Faces()[f];
+            for (uint32_t Index : { face.v1, face.v2, face.v3 })
+            {
+                const size_t v = Sub.BaseVertex + Index;
+                if (!VertexCache.Access(v))
+                {
+                    continue;
+                }
+
+                ++Result.TransformedVertices;
+                if (!Referenced[v])
+                {
+                    Referenced[v] = true;
+                    ++Result.Vertices;
+                }
+
+                const size_t FirstLine = v * VertexStride / CacheLineSize;
+                const size_t LastLine = ((v + 1) * VertexStride - 1) / CacheLineSize;
+                for (size_t Line = FirstLine; Line <= LastLine; ++Line)
+                {
+                    Result.FetchedBytes += FetchCache.Access(Line) ? CacheLineSize : 0;
+                }
+            }
+        }
+        Result.Triangles += Sub.NumIndices / 3;
+    }
+
+    if (Result.Triangles > 0)
+    {
+        Result.ACMR = double(Result.TransformedVertices) / Result.Triangles;
+        Result.ATVR = double(Result.TransformedVertices) / Result.Vertices;
+        Result.Overfetch = double(Result.FetchedBytes) / (Result.Vertices * VertexStride);
+    }
+    return Result;
+}
+
+void MeshOptimizer::PrintAnalysis(const char* Name, const MeshAnalysis& Before, const MeshAnalysis& After)
+{
+    std::printf("Optimized mesh : %s (%zu triangles, %zu vertices)\n", Name, After.Triangles, After.Vertices);
+    std::printf("  ACMR      : %6.3f -> %6.3f\n", Before.ACMR, After.ACMR);
+    std::printf("  ATVR      : %6.3f -> %6.3f\n", Before.ATVR, After.ATVR);
+    std::printf("  Overfetch : %6.3f -> %6.3f\n", Before.Overfetch, After.Overfetch);
+}
+
+bool MeshOptimizer::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Mesh optimizer self test\n");
+
+    // Two Cells x Cells grids with shuffled faces and vertex numbering, the second one also has a vertex no face uses
+    const uint32_t Cells = 32;
+    std::mt19937 Random{ 3 };
+    std::vector<Vertex> Vertices;
+    std::vector<Face> Faces;
+    std::vector<SubMesh> SubMeshes;
+    for (uint32_t s = 0; s < 2; ++s)
+    {
+        const uint32_t NumVertices = (Cells + 1) * (Cells + 1);
+        std::vector<uint32_t> Numbering(NumVertices);
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            Numbering[v] = v;
+        }
+        std::shuffle(Numbering.begin(), Numbering.end(), Random);
+
+        const uint32_t BaseVertex = uint32_t(Vertices.size());
+        const uint32_t FirstFace = uint32_t(Faces.size());
+        Vertices.resize(BaseVertex + NumVertices + s);
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            const Vec3 Position{ float(v % (Cells + 1)), float(v / (Cells + 1)), float(s) };
+            Vertices[BaseVertex + Numbering[v]] = Vertex{ Position, Vec3{ 0.0f, 0.0f, 1.0f }, Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f }, Vec2{ Position } };
+        }
+        if (s == 1)
+        {
+            Vertices.back() = Vertex{ Vec3{ -1.0f }, Vec3{ 0.0f, 0.0f, 1.0f }, Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f }, Vec2{ 0.0f } };
+        }
+        for (uint32_t y = 0; y < Cells; ++y)
+        {
+            for (uint32_t x = 0; x < Cells; ++x)
+            {
+                const uint32_t A = y * (Cells + 1) + x;
+                const uint32_t B = A + Cells + 1;
+                Faces.push_back({ Numbering[A], Numbering[A + 1], Numbering[B] });
+                Faces.push_back({ Numbering[A + 1], Numbering[B + 1], Numbering[B] });
+            }
+        }
+        std::shuffle(Faces.begin() + FirstFace, Faces.end(), Random);
+        SubMeshes.push_back({ BaseVertex, NumVertices + s, FirstFace * 3, uint32_t(Faces.size() - FirstFace) * 3, s, {}, {} });
+    }
+
+    // Faces as the bytes of their vertices, rotated to start at the smallest so only winding and content count
+    const auto FaceKeys = [](const Mesh& mesh)
+    {
+        std::vector<std::string> Keys;
+        for (const SubMesh& Sub : mesh.SubMeshes())
+        {
+            for (uint32_t f = Sub.FirstIndex / 3; f < (Sub.FirstIndex + Sub.NumIndices) / 3; ++f)
+            {
+                const Face& face = mesh.Faces()[f];
+                std::string Corners[3];
+                const uint32_t Indices[3] = { face.v1, face.v2, face.v3 };
+                for (int c = 0; c < 3; ++c)
+                {
+                    Corners[c].assign(reinterpret_cast<const char*>(&mesh.Vertices()[Sub.BaseVertex + Indices[c]]), sizeof(Vertex));
+                }
+                const int First = int(std::min_element(Corners, Corners + 3) - Corners);
+                Keys.push_back(std::to_string(Sub.MaterialIndex) + Corners[First] + Corners[(First + 1) % 3] + Corners[(First + 2) % 3]);
+            }
+        }
+        std::sort(Keys.begin(), Keys.end());
+        return Keys;
+    };
+    const auto VertexKeys = [](const Mesh& mesh, bool bReferencedOnly)
+    {
+        std::vector<std::string> Keys;
+        for (const SubMesh& Sub : mesh.SubMeshes())
+        {
+            std::vector<bool> Referenced(Sub.NumVertices, !bReferencedOnly);
+            for (uint32_t f = Sub.FirstIndex / 3; f < (Sub.FirstIndex + Sub.NumIndices) / 3; ++f)
+            {
+                const Face& face = mesh.Faces()[f];
+                Referenced[face.v1] = Referenced[face.v2] = Referenced[face.v3] = true;
+            }
+            for (uint32_t v = 0; v < Sub.NumVertices; ++v)
+            {
+                if (Referenced[v])
+                {
+                    Keys.push_back(std::to_string(Sub.MaterialIndex) + std::string(reinterpret_cast<const char*>(&mesh.Vertices()[Sub.BaseVertex + v]), sizeof(Vertex)));
+                }
+            }
+        }
+        std::sort(Keys.begin(), Keys.end());
+        return Keys;
+    };
+
+    const Mesh Source{ Vertices.data(), Vertices.size(), Faces.data(), Faces.size(), SubMeshes.data(), SubMeshes.size() };
+    const std::vector<std::string> SourceFaces = FaceKeys(Source);
+    const std::vector<std::string> SourceVertices = VertexKeys(Source, true);
+
+    Harness.Run("Passes only reorder", [&]()
+    {
+        const struct { const char* Name; bool VertexCache, Overdraw, VertexFetch; } Passes[] =
+        {
+            { "vertex cache", true, false, false },
+            { "overdraw", false, true, false },
+            { "vertex fetch", false, false, true },
+            { "all passes", true, true, true },
+        };
+        for (const auto& Pass : Passes)
+        {
+            OptimizeSettings Settings;
+            Settings.VertexCache = Pass.VertexCache;
+            Settings.Overdraw = Pass.Overdraw;
+            Settings.VertexFetch = Pass.VertexFetch;
+            Mesh Optimized = Source;
+            Optimize(Optimized, Settings);
+
+            const std::string Name = Pass.Name;
+            Harness.Check(FaceKeys(Optimized) == SourceFaces, (Name + ": same faces and winding").c_str());
+            Harness.Check(VertexKeys(Optimized, !Pass.VertexFetch) == SourceVertices, (Name + ": same referenced vertices").c_str());
+        }
+
+        std::vector<Face> Standalone(Faces.begin(), Faces.begin() + SubMeshes[0].NumIndices / 3);
+        OptimizeVertexCache(Standalone.data(), Standalone.size(), SubMeshes[0].NumVertices);
+        const Mesh Reordered{ Vertices.data(), SubMeshes[0].NumVertices, Standalone.data(), Standalone.size(), SubMeshes.data(), 1 };
+        const Mesh First{ Vertices.data(), SubMeshes[0].NumVertices, Faces.data(), Standalone.size(), SubMeshes.data(), 1 };
+        Harness.Check(FaceKeys(Reordered) == FaceKeys(First), "OptimizeVertexCache alone keeps the faces");
+    });
+
+    Harness.Run("Vertex fetch remap", [&]()
+    {
+        Mesh Optimized = Source;
+        Optimize(Optimized);
+
+        bool bFirstUse = true;
+        bool bDense = true;
+        for (const SubMesh& Sub : Optimized.SubMeshes())
+        {
+            uint32_t Next = 0;
+            for (uint32_t f = Sub.FirstIndex / 3; f < (Sub.FirstIndex + Sub.NumIndices) / 3; ++f)
+            {
+                const Face& face = Optimized.Faces()[f];
+                for (uint32_t Index : { face.v1, face.v2, face.v3 })
+                {
+                    // A new vertex has to be the next number, anything else was already seen
+                    bFirstUse &= Index <= Next;
+                    Next += Index == Next ? 1 : 0;
+                }
+            }
+            bDense &= Next == Sub.NumVertices;
+        }
+        Harness.Check(bFirstUse, "vertices are numbered in the order the faces first use them");
+        Harness.Check(bDense, "every kept vertex is used");
+        Harness.Check(Optimized.Vertices().size() == Vertices.size() - 1 && Optimized.SubMeshes()[1].NumVertices == SubMeshes[1].NumVertices - 1,
+            "the unreferenced vertex is dropped");
+    });
+
+    Harness.Run("ACMR drops", [&]()
+    {
+        Mesh Optimized = Source;
+        Optimize(Optimized);
+        const MeshAnalysis Before = Analyze(Source);
+        const MeshAnalysis After = Analyze(Optimized);
+        PrintAnalysis("shuffled grids", Before, After);
+        Harness.Check(After.Triangles == Before.Triangles && After.Vertices == Before.Vertices, "same triangles and referenced vertices");
+        Harness.Check(After.ACMR < Before.ACMR && After.ACMR < 1.0, "ACMR of the shuffled grid drops below 1");
+        Harness.Check(After.Overfetch <= Before.Overfetch, "overfetch does not grow");
+    });
+
+    return Harness.Finish();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+class Mesh;
+struct Face;
+
+struct OptimizeSettings
+{
+    bool VertexCache = true;
+    bool Overdraw = true;
+    bool VertexFetch = true;
+
+    // A cluster is split once its running ACMR drops to Threshold x the ACMR of the whole cluster.
+    // Higher values give more, smaller clusters: better overdraw sorting at some vertex cache cost.
+    float OverdrawThreshold = 1.05f;
+};
+
+// CPU model of the post-transform cache (FIFO, reset per draw) and of vertex fetch (FIFO of cache lines).
+struct MeshAnalysis
+{
+    size_t Triangles = 0;
+    size_t Vertices = 0;
+    size_t TransformedVertices = 0;
+    size_t FetchedBytes = 0;
+
+    // Average cache miss ratio, transformed vertices per triangle. 0.5 is the ideal for a regular grid, 3 the worst.
+    double ACMR = 0.0;
+    // Average transform to vertex ratio, 1 means every vertex is shaded exactly once.
+    double ATVR = 0.0;
+    // Fetched bytes over the bytes of the referenced vertices, 1 means every byte is read once.
+    double Overfetch = 0.0;
+};
+
+class MeshOptimizer
+{
+public:
+    static const uint32_t AnalyzeCacheSize = 16;
+    static const uint32_t FetchCacheLines = 64;
+    static const uint32_t CacheLineSize = 64;
+
+    // Reorders the faces of every submesh for the vertex cache (Forsyth), then sorts triangle clusters
+    // front-to-back from the outside in (Tipsify-style overdraw pass), then renumbers the vertices
+    // into first-use order. Vertices no triangle references are dropped. Submeshes run in parallel.
+    static void Optimize(Mesh& mesh, const OptimizeSettings& Settings = OptimizeSettings{});
+
+    // Vertex cache pass alone, for index lists built after Optimize such as LODs. Indices must be below NumVertices.
+    static void OptimizeVertexCache(Face* Faces, size_t NumFaces, uint32_t NumVertices);
+
+    // VertexStride only affects the fetch model, so other vertex layouts can be compared on the same mesh.
+    // 0 means sizeof(Vertex).
+    static MeshAnalysis Analyze(const Mesh& mesh, size_t VertexStride = 0);
+    static void PrintAnalysis(const char* Name, const MeshAnalysis& Before, const MeshAnalysis& After);
+
+    // Runs every pass alone and together on shuffled grids and checks that the faces (with their winding) and the
+    // referenced vertices are only reordered, that the vertex remap is first-use order and that ACMR drops. No GPU needed.
+    static bool SelfTest();
+};
@@ -0,0 +1,715 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include "MeshletCuller.h"
+#include "MeshOptimizer.h"
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    // Garland-Heckbert quadric, the symmetric 4x4 matrix stored as its upper triangle.
+    struct Quadric
+    {
+        double A00 = 0, A01 = 0, A02 = 0, A11 = 0, A12 = 0, A22 = 0;
+        double B0 = 0, B1 = 0, B2 = 0;
+        double C = 0;
+        double Weight = 0;
+
+        static Quadric FromPlane(const glm::dvec3& N, double D, double Weight)
+        {
+            Quadric Q;
+            Q.A00 = N.x * N.x * Weight; Q.A01 = N.x * N.y * Weight; Q.A02 = N.x * N.z * Weight;
+            Q.A11 = N.y * N.y * Weight; Q.A12 = N.y * N.z * Weight; Q.A22 = N.z * N.z * Weight;
+            Q.B0 = N.x * D * Weight; Q.B1 = N.y * D * Weight; Q.B2 = N.z * D * Weight;
+            Q.C = D * D * Weight;
+            Q.Weight = Weight;
+            return Q;
+        }
+
+        void Add(const Quadric& Other)
+        {
+            A00 += Other.A00; A01 += Other.A01; A02 += Other.A02;
+            A11 += Other.A11; A12 += Other.A12; A22 += Other.A22;
+            B0 += Other.B0; B1 += Other.B1; B2 += Other.B2;
+            C += Other.C;
+            Weight += Other.Weight;
+        }
+
+        // Weighted sum of squared distances from P to the accumulated planes.
+        double Evaluate(const Vec3& P) const
+        {
+            const double X = P.x, Y = P.y, Z = P.z;
+            const double Result =
+                A00 * X * X + 2.0 * A01 * X * Y + 2.0 * A02 * X * Z +
+                A11 * Y * Y + 2.0 * A12 * Y * Z +
+                A22 * Z * Z +
+                2.0 * (B0 * X + B1 * Y + B2 * Z) + C;
+            return std::max(Result, 0.0);
+        }
+    };
+
+    struct Collapse
+    {
+        double Cost;
+        float Error;
+        uint32_t From;
+        uint32_t To;
+    };
+
+    Vec3 FaceNormal(const Vec3& P1, const Vec3& P2, const Vec3& P3)
+    {
+        return glm::cross(P2 - P1, P3 - P1);
+    }
+
+    uint64_t EdgeKey(uint32_t A, uint32_t B)
+    {
+        return (uint64_t(A) << 32) | B;
+    }
+
+    // Seams and borders are where two vertices share a position but not their attributes, or where an
+    // edge has no twin. Moving any of those vertices opens cracks or drags UV islands, so they stay put.
+    std::vector<bool> FindLockedVertices(const Vertex* Vertices, uint32_t NumVertices, const std::vector<Face>& Faces)
+    {
+        std::vector<bool> Locked(NumVertices, false);
+
+        std::unordered_map<uint64_t, uint32_t> FirstAtPosition;
+        std::vector<uint32_t> PositionClass(NumVertices);
+        std::vector<uint32_t> ClassSize(NumVertices, 0);
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            uint32_t Bits[3];
+            std::memcpy(Bits, &Vertices[v].Position, sizeof(Bits));
+            const uint64_t Key = (uint64_t(Bits[0]) * 73856093ull) ^ (uint64_t(Bits[1]) * 19349663ull << 16) ^ (uint64_t(Bits[2]) * 83492791ull << 32);
+
+            // Hash buckets may collide, fall back to an exact scan of the bucket's representative.
+            auto It = FirstAtPosition.find(Key);
+            if (It != FirstAtPosition.end() && Vertices[It->second].Position == Vertices[v].Position)
+            {
+                PositionClass[v] = It->second;
+            }
+            else
+            {
+                PositionClass[v] = v;
+                if (It == FirstAtPosition.end())
+                {
+                    FirstAtPosition.emplace(Key, v);
+                }
+            }
+            ++ClassSize[PositionClass[v]];
+        }
+
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            if (ClassSize[PositionClass[v]] > 1)
+            {
+                Locked[v] = true;
+            }
+        }
+
+        std::unordered_map<uint64_t, uint32_t> EdgeCount;
+        EdgeCount.reserve(Faces.size() * 3);
+        for (const Face& face : Faces)
+        {
+            ++EdgeCount[EdgeKey(face.v1, face.v2)];
+            ++EdgeCount[EdgeKey(face.v2, face.v3)];
+            ++EdgeCount[EdgeKey(face.v3, face.v1)];
+        }
+        for (const auto& Edge : EdgeCount)
+        {
+            const uint32_t A = uint32_t(Edge.first >> 32);
+            const uint32_t B = uint32_t(Edge.first & 0xFFFFFFFFu);
+            const auto Twin = EdgeCount.find(EdgeKey(B, A));
+            if (Edge.second > 1 || Twin == EdgeCount.end() || Twin->second > 1)
+            {
+                Locked[A] = true;
+                Locked[B] = true;
+            }
+        }
+        return Locked;
+    }
+
+    class SubMeshSimplifier
+    {
+    public:
+        SubMeshSimplifier(const Vertex* InVertices, uint32_t InNumVertices, const std::vector<Face>& Faces, const SimplifySettings& InSettings, float Diagonal)
+            :m_Vertices(InVertices), m_NumVertices(InNumVertices), m_Settings(InSettings)
+            ,m_AttributeScale(double(Diagonal) * Diagonal), m_MaxError(InSettings.MaxError * Diagonal)
+        {
+            m_Locked = FindLockedVertices(m_Vertices, m_NumVertices, Faces);
+        }
+
+        // Collapses edges of Faces until TargetTriangles is reached or no legal collapse is left.
+        // Returns the largest surface error of any collapse taken.
+        float Simplify(std::vector<Face>& Faces, size_t TargetTriangles)
+        {
+            InitQuadrics(Faces);
+            float Error = 0.0f;
+
+            while (Faces.size() > TargetTriangles)
+            {
+                BuildAdjacency(Faces);
+                std::vector<Collapse> Candidates = CollectCollapses(Faces);
+                if (Candidates.empty())
+                {
+                    break;
+                }
+
+                // Sort by cost with the vertex pair as tie breaker, the result must not depend on anything else.
+                std::sort(Candidates.begin(), Candidates.end(), [](const Collapse& A, const Collapse& B)
+                {
+                    if (A.Cost != B.Cost) return A.Cost < B.Cost;
+                    if (A.From != B.From) return A.From < B.From;
+                    return A.To < B.To;
+                });
+
+                // Collapses touching the one-ring of an earlier collapse wait for the next pass,
+                // so every decision in a pass is made on unmodified adjacency.
+                std::vector<bool> Touched(m_NumVertices, false);
+                std::vector<bool> Removed(Faces.size(), false);
+                size_t Triangles = Faces.size();
+                size_t Collapses = 0;
+
+                for (const Collapse& Candidate : Candidates)
+                {
+                    if (Triangles <= TargetTriangles)
+                    {
+                        break;
+                    }
+                    if (Touched[Candidate.From] || Touched[Candidate.To] || Flips(Faces, Candidate.From, Candidate.To))
+                    {
+                        continue;
+                    }
+
+                    for (uint32_t i = m_AdjacencyOffset[Candidate.From]; i < m_AdjacencyOffset[Candidate.From + 1]; ++i)
+                    {
+                        Face& face = Faces[m_Adjacency[i]];
+                        for (uint32_t v : { face.v1, face.v2, face.v3 })
+                        {
+                            Touched[v] = true;
+                        }
+
+                        if (face.v1 == Candidate.To || face.v2 == Candidate.To || face.v3 == Candidate.To)
+                        {
+                            Removed[m_Adjacency[i]] = true;
+                            --Triangles;
+                        }
+                        else
+                        {
+                            for (uint32_t* v : { &face.v1, &face.v2, &face.v3 })
+                            {
+                                *v = *v == Candidate.From ? Candidate.To : *v;
+                            }
+                        }
+                    }
+
+                    m_Quadrics[Candidate.To].Add(m_Quadrics[Candidate.From]);
+                    Error = std::max(Error, Candidate.Error);
+                    ++Collapses;
+                }
+
+                if (Collapses == 0)
+                {
+                    break;
+                }
+
+                size_t Write = 0;
+                for (size_t f = 0; f < Faces.size(); ++f)
+                {
+                    if (!Removed[f])
+                    {
+                        Faces[Write++] = Faces[f];
+                    }
+                }
+                Faces.resize(Write);
+            }
+            return Error;
+        }
+
+    private:
+        // Quadrics always come from the triangles of the level being simplified, so the error of a
+        // LOD is measured against its parent.
+        void InitQuadrics(const std::vector<Face>& Faces)
+        {
+            m_Quadrics.assign(m_NumVertices, Quadric{});
+            for (const Face& face : Faces)
+            {
+                const Vec3& P1 = m_Vertices[face.v1].Position;
+                const Vec3& P2 = m_Vertices[face.v2].Position;
+                const Vec3& P3 = m_Vertices[face.v3].Position;
+                const glm::dvec3 N = glm::dvec3(FaceNormal(P1, P2, P3));
+                const double Length = glm::length(N);
+                if (Length == 0.0)
+                {
+                    continue;
+                }
+
+                const glm::dvec3 Unit = N / Length;
+                const Quadric Q = Quadric::FromPlane(Unit, -glm::dot(Unit, glm::dvec3(P1)), Length * 0.5);
+                m_Quadrics[face.v1].Add(Q);
+                m_Quadrics[face.v2].Add(Q);
+                m_Quadrics[face.v3].Add(Q);
+            }
+        }
+
+        void BuildAdjacency(const std::vector<Face>& Faces)
+        {
+            m_AdjacencyOffset.assign(m_NumVertices + 1, 0);
+            for (const Face& face : Faces)
+            {
+                ++m_AdjacencyOffset[face.v1 + 1];
+                ++m_AdjacencyOffset[face.v2 + 1];
+                ++m_AdjacencyOffset[face.v3 + 1];
+            }
+            for (uint32_t v = 0; v < m_NumVertices; ++v)
+            {
+                m_AdjacencyOffset[v + 1] += m_AdjacencyOffset[v];
+            }
+
+            std::vector<uint32_t> Cursor(m_AdjacencyOffset.begin(), m_AdjacencyOffset.end() - 1);
+            m_Adjacency.resize(Faces.size() * 3);
+            for (uint32_t f = 0; f < Faces.size(); ++f)
+            {
+                m_Adjacency[Cursor[Faces[f].v1]++] = f;
+                m_Adjacency[Cursor[Faces[f].v2]++] = f;
+                m_Adjacency[Cursor[Faces[f].v3]++] = f;
+            }
+        }
+
+        bool Cost(uint32_t From, uint32_t To, Collapse& Out) const
+        {
+            if (m_Locked[From])
+            {
+                return false;
+            }
+
+            Quadric Q = m_Quadrics[From];
+            Q.Add(m_Quadrics[To]);
+            const Vec3& Target = m_Vertices[To].Position;
+            const double Geometric = Q.Evaluate(Target);
+            const float Error = Q.Weight > 0.0 ? float(std::sqrt(Geometric / Q.Weight)) : 0.0f;
+            if (Error > m_MaxError)
+            {
+                return false;
+            }
+
+            // From's wedge of the surface takes To's attributes, weigh the difference by the area it covers.
+            const Vertex& A = m_Vertices[From];
+            const Vertex& B = m_Vertices[To];
+            const Vec3 NormalDelta = A.Normal - B.Normal;
+            const Vec2 TexcoordDelta = A.Texcoord - B.Texcoord;
+            const double Attribute = m_Quadrics[From].Weight * m_AttributeScale *
+                (m_Settings.NormalWeight * glm::dot(NormalDelta, NormalDelta) + m_Settings.TexcoordWeight * glm::dot(TexcoordDelta, TexcoordDelta));
+
+            Out = Collapse{ Geometric + Attribute, Error, From, To };
+            return true;
+        }
+
+        std::vector<Collapse> CollectCollapses(const std::vector<Face>& Faces) const
+        {
+            std::vector<uint64_t> Edges;
+            Edges.reserve(Faces.size() * 3);
+            for (const Face& face : Faces)
+            {
+                Edges.push_back(EdgeKey(std::min(face.v1, face.v2), std::max(face.v1, face.v2)));
+                Edges.push_back(EdgeKey(std::min(face.v2, face.v3), std::max(face.v2, face.v3)));
+                Edges.push_back(EdgeKey(std::min(face.v3, face.v1), std::max(face.v3, face.v1)));
+            }
+            std::sort(Edges.begin(), Edges.end());
+            Edges.erase(std::unique(Edges.begin(), Edges.end()), Edges.end());
+
+            std::vector<Collapse> Result;
+            Result.reserve(Edges.size());
+            for (uint64_t Edge : Edges)
+            {
+                const uint32_t A = uint32_t(Edge >> 32);
+                const uint32_t B = uint32_t(Edge & 0xFFFFFFFFu);
+
+                Collapse Forward, Backward;
+                const bool bForward = Cost(A, B, Forward);
+                const bool bBackward = Cost(B, A, Backward);
+                if (bForward && (!bBackward || Forward.Cost <= Backward.Cost))
+                {
+                    Result.push_back(Forward);
+                }
+                else if (bBackward)
+                {
+                    Result.push_back(Backward);
+                }
+            }
+            return Result;
+        }
+
+        // Moving From onto To must not turn any surviving triangle around.
+        bool Flips(const std::vector<Face>& Faces, uint32_t From, uint32_t To) const
+        {
+            for (uint32_t i = m_AdjacencyOffset[From]; i < m_AdjacencyOffset[From + 1]; ++i)
+            {
+                const Face& face = Faces[m_Adjacency[i]];
+                if (face.v1 == To || face.v2 == To || face.v3 == To)
+                {
+                    continue;
+                }
+
+                const Vec3 P1 = m_Vertices[face.v1].Position;
+                const Vec3 P2 = m_Vertices[face.v2].Position;
+                const Vec3 P3 = m_Vertices[face.v3].Position;
+                const Vec3& Target = m_Vertices[To].Position;
+
+                const Vec3 Before = FaceNormal(P1, P2, P3);
+                const Vec3 After = FaceNormal(
+                    face.v1 == From ? Target : P1,
+                    face.v2 == From ? Target : P2,
+                    face.v3 == From ? Target : P3);
+                // Anything turning by more than ~75 degrees counts, slivers rotate a lot without quite inverting.
+                if (glm::dot(Before, After) <= 0.25f * glm::length(Before) * glm::length(After))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        const Vertex* m_Vertices;
+        uint32_t m_NumVertices;
+        const SimplifySettings& m_Settings;
+        double m_AttributeScale;
+        float m_MaxError;
+
+        std::vector<bool> m_Locked;
+        std::vector<Quadric> m_Quadrics;
+        std::vector<uint32_t> m_AdjacencyOffset;
+        std::vector<uint32_t> m_Adjacency;
+    };
+}
+
+SimplifyStats MeshSimplifier::BuildLods(Mesh& mesh, const SimplifySettings& Settings)
+{
+    const auto StartTime = std::chrono::high_resolution_clock::now();
+
+    const std::vector<SubMesh>& SubMeshes = mesh.SubMeshes();
+    const uint32_t NumLevels = static_cast<uint32_t>(Settings.LodRatios.size()) + 1;
+    const float Diagonal = glm::length(mesh.BoundsMax() - mesh.BoundsMin());
+
+    SimplifyStats Stats;
+    Stats.TrianglesBefore = mesh.Faces().size();
+    Stats.LodTriangles.assign(NumLevels, 0);
+    Stats.LodErrors.assign(NumLevels, 0.0f);
+
+    // [SubMesh][Level - 1]
+    std::vector<std::vector<std::vector<Face>>> LodFaces(SubMeshes.size());
+    std::vector<std::vector<float>> LodErrors(SubMeshes.size());
+
+    ThreadPool::Get().ParallelFor(0, SubMeshes.size(), 1, [&](size_t Begin, size_t End)
+    {
+        for (size_t i = Begin; i < End; ++i)
+        {
+            const SubMesh& Sub = SubMeshes[i];
+            const Vertex* Vertices = mesh.Vertices().data() + Sub.BaseVertex;
+            const Face* First = mesh.Faces().data() + Sub.FirstIndex / 3;
+            const size_t NumFaces = Sub.NumIndices / 3;
+
+            std::vector<Face> Faces(First, First + NumFaces);
+            SubMeshSimplifier Simplifier{ Vertices, Sub.NumVertices, Faces, Settings, Diagonal };
+
+            float Error = 0.0f;
+            for (float Ratio : Settings.LodRatios)
+            {
+                const size_t Target = static_cast<size_t>(double(NumFaces) * Ratio);
+                // Each level is measured against its parent, summing keeps the error relative to LOD 0 a bound.
+                Error += Simplifier.Simplify(Faces, Target);
+
+                std::vector<Face> Level = Faces;
+                MeshOptimizer::OptimizeVertexCache(Level.data(), Level.size(), Sub.NumVertices);
+                LodFaces[i].push_back(std::move(Level));
+                LodErrors[i].push_back(Error);
+            }
+        }
+    });
+
+    std::vector<Face> AppendedFaces;
+    std::vector<SubMeshLod> Lods;
+    Lods.reserve(SubMeshes.size() * NumLevels);
+    uint32_t NextIndex = static_cast<uint32_t>(mesh.Faces().size() * 3);
+
+    for (uint32_t i = 0; i < SubMeshes.size(); ++i)
+    {
+        Lods.push_back(SubMeshLod{ i, 0, SubMeshes[i].FirstIndex, SubMeshes[i].NumIndices, 0.0f });
+        Stats.LodTriangles[0] += SubMeshes[i].NumIndices / 3;
+
+        for (uint32_t Level = 1; Level < NumLevels; ++Level)
+        {
+            const std::vector<Face>& Faces = LodFaces[i][Level - 1];
+            const uint32_t NumIndices = static_cast<uint32_t>(Faces.size() * 3);
+            Lods.push_back(SubMeshLod{ i, Level, NextIndex, NumIndices, LodErrors[i][Level - 1] });
+            AppendedFaces.insert(AppendedFaces.end(), Faces.begin(), Faces.end());
+            NextIndex += NumIndices;
+
+            Stats.LodTriangles[Level] += Faces.size();
+            Stats.LodErrors[Level] = std::max(Stats.LodErrors[Level], LodErrors[i][Level - 1]);
+        }
+    }
+
+    mesh.AppendLods(AppendedFaces, std::move(Lods));
+
+    Stats.Milliseconds = ElapsedMs(StartTime);
+    return Stats;
+}
+
+void MeshSimplifier::PrintStats(const char* Name, const SimplifyStats& Stats)
+{
+    std::printf("Built LODs : %s (%.2f ms)\n", Name, Stats.Milliseconds);
+    for (size_t Level = 0; Level < Stats.LodTriangles.size(); ++Level)
+    {
+        std::printf("  LOD %zu : %8zu triangles (%5.1f%%), error %g\n",
+            Level,
+            Stats.LodTriangles[Level],
+            100.0 * Stats.LodTriangles[Level] / std::max<size_t>(Stats.TrianglesBefore, 1),
+            Stats.LodErrors[Level]);
+    }
+}
+
+void MeshSimplifier::SelectLods(const std::vector<SubMesh>& SubMeshes, const std::vector<SubMeshLod>& Lods,
+    const Vec3& ObjectSpaceEye, float PixelsPerUnit, float MaxPixelError, std::vector<uint32_t>& OutLevels)
+{
+    OutLevels.assign(SubMeshes.size(), 0);
+    if (SubMeshes.empty() || Lods.empty())
+    {
+        return;
+    }
+
+    const size_t NumLevels = Lods.size() / SubMeshes.size();
+    for (size_t i = 0; i < SubMeshes.size(); ++i)
+    {
+        // Closest point of the submesh's bounding sphere, the eye inside the sphere always gets full detail.
+        const Vec3 Center = (SubMeshes[i].BoundsMin + SubMeshes[i].BoundsMax) * 0.5f;
+        const float Radius = glm::length(SubMeshes[i].BoundsMax - SubMeshes[i].BoundsMin) * 0.5f;
+        const float Distance = glm::length(Center - ObjectSpaceEye) - Radius;
+        if (Distance <= 0.0f)
+        {
+            continue;
+        }
+
+        // Errors grow with the level, so walk up until the next one would be visible.
+        for (size_t Level = 1; Level < NumLevels; ++Level)
+        {
+            const float ProjectedError = Lods[i * NumLevels + Level].Error * PixelsPerUnit / Distance;
+            if (ProjectedError > MaxPixelError)
+            {
+                break;
+            }
+            OutLevels[i] = static_cast<uint32_t>(Level);
+        }
+    }
+}
+
+void MeshSimplifier::AppendLodRanges(const std::vector<SubMesh>& SubMeshes, const std::vector<SubMeshLod>& Lods,
+    const std::vector<uint32_t>& Levels, std::vector<DrawRange>& OutRanges)
+{
+    if (SubMeshes.empty() || Lods.empty())
+    {
+        return;
+    }
+
+    const size_t NumLevels = Lods.size() / SubMeshes.size();
+    for (size_t i = 0; i < SubMeshes.size(); ++i)
+    {
+        if (Levels[i] == 0)
+        {
+            continue;
+        }
+        const SubMeshLod& Lod = Lods[i * NumLevels + Levels[i]];
+        OutRanges.push_back(DrawRange{ Lod.FirstIndex, Lod.NumIndices, SubMeshes[i].BaseVertex });
+    }
+}
+
+bool MeshSimplifier::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Mesh simplifier self test\n");
+
+    // Curved Cells x Cells grid over [0, 4]^2, split at column Seam: both halves keep their own copy of the
+    // seam column with a different u, so the seam copies share positions but not texcoords.
+    const uint32_t Cells = 48;
+    const uint32_t Seam = Cells / 2;
+    const auto Height = [](float X, float Y) { return 0.15f * std::sin(2.0f * X) * std::cos(1.5f * Y); };
+    const auto MakeVertex = [&](uint32_t Column, uint32_t Row, float U)
+    {
+        const float X = 4.0f * Column / Cells;
+        const float Y = 4.0f * Row / Cells;
+        const Vec3 Normal = glm::normalize(Vec3{ -0.3f * std::cos(2.0f * X) * std::cos(1.5f * Y), 0.225f * std::sin(2.0f * X) * std::sin(1.5f * Y), 1.0f });
+        return Vertex{ Vec3{ X, Y, Height(X, Y) }, Normal, Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f }, Vec2{ U, float(Row) / Cells } };
+    };
+
+    std::vector<Vertex> Vertices;
+    std::vector<Face> Faces;
+    std::vector<SubMesh> SubMeshes;
+    std::vector<bool> ExpectLocked;
+    const auto AddHalf = [&](uint32_t FirstColumn, uint32_t LastColumn)
+    {
+        const uint32_t Base = uint32_t(Vertices.size()) - SubMeshes.back().BaseVertex;
+        const uint32_t Columns = LastColumn - FirstColumn + 1;
+        for (uint32_t Row = 0; Row <= Cells; ++Row)
+        {
+            for (uint32_t Column = FirstColumn; Column <= LastColumn; ++Column)
+            {
+                Vertices.push_back(MakeVertex(Column, Row, float(Column - FirstColumn) / (Columns - 1)));
+                ExpectLocked.push_back(Row == 0 || Row == Cells || Column == FirstColumn || Column == LastColumn);
+            }
+        }
+        for (uint32_t Row = 0; Row < Cells; ++Row)
+        {
+            for (uint32_t Column = 0; Column + 1 < Columns; ++Column)
+            {
+                const uint32_t A = Base + Row * Columns + Column;
+                const uint32_t B = A + Columns;
+                Faces.push_back({ A, A + 1, B });
+                Faces.push_back({ A + 1, B + 1, B });
+            }
+        }
+    };
+
+    // Submesh 0 is the split grid, submesh 1 a whole one that also gets material 1
+    SubMeshes.push_back({ 0, 0, 0, 0, 0, {}, {} });
+    AddHalf(0, Seam);
+    AddHalf(Seam, Cells);
+    SubMeshes[0].NumVertices = uint32_t(Vertices.size());
+    SubMeshes[0].NumIndices = uint32_t(Faces.size() * 3);
+    SubMeshes.push_back({ uint32_t(Vertices.size()), 0, uint32_t(Faces.size() * 3), 0, 1, {}, {} });
+    AddHalf(0, Cells);
+    SubMeshes[1].NumVertices = uint32_t(Vertices.size()) - SubMeshes[1].BaseVertex;
+    SubMeshes[1].NumIndices = uint32_t(Faces.size() * 3) - SubMeshes[1].FirstIndex;
+
+    const size_t FullFaces = Faces.size();
+    Mesh Lodded{ Vertices.data(), Vertices.size(), Faces.data(), Faces.size(), SubMeshes.data(), SubMeshes.size() };
+    const SimplifySettings Settings;
+    const SimplifyStats Stats = BuildLods(Lodded, Settings);
+    PrintStats("split grid", Stats);
+
+    const std::vector<SubMeshLod>& Lods = Lodded.Lods();
+    const uint32_t NumLevels = uint32_t(Settings.LodRatios.size()) + 1;
+    const auto LodFaces = [&](const SubMeshLod& Lod)
+    {
+        return std::vector<Face>(Lodded.Faces().begin() + Lod.FirstIndex / 3, Lodded.Faces().begin() + (Lod.FirstIndex + Lod.NumIndices) / 3);
+    };
+
+    Harness.Run("Triangle counts", [&]()
+    {
+        Harness.Check(Lodded.NumLodLevels() == NumLevels && Lods.size() == SubMeshes.size() * NumLevels, "every submesh has every level");
+        bool bNearTarget = true;
+        for (const SubMeshLod& Lod : Lods)
+        {
+            const SubMesh& Sub = SubMeshes[Lod.SubMeshIndex];
+            const double Target = Lod.Level == 0 ? Sub.NumIndices / 3 : Sub.NumIndices / 3 * double(Settings.LodRatios[Lod.Level - 1]);
+            const double Triangles = Lod.NumIndices / 3;
+            // A collapse removes two triangles, so a level may land one below its target, locks may leave it a bit above
+            bNearTarget &= Triangles >= Target - 2.0 && Triangles <= Target * 1.1 + 2.0;
+        }
+        Harness.Check(bNearTarget, "each level is within 10% of its target ratio");
+        Harness.Check(Stats.LodTriangles[0] == FullFaces, "LOD 0 keeps every triangle");
+    });
+
+    Harness.Run("LOD ranges", [&]()
+    {
+        bool bOrdered = true;
+        bool bAligned = true;
+        bool bInside = true;
+        bool bValidIndices = true;
+        for (size_t i = 0; i < Lods.size(); ++i)
+        {
+            const SubMeshLod& Lod = Lods[i];
+            bOrdered &= Lod.SubMeshIndex == i / NumLevels && Lod.Level == i % NumLevels;
+            bAligned &= Lod.FirstIndex % 3 == 0 && Lod.NumIndices % 3 == 0;
+            bInside &= uint64_t(Lod.FirstIndex) + Lod.NumIndices <= Lodded.Faces().size() * 3;
+            if (!bInside)
+            {
+                break;
+            }
+            for (const Face& face : LodFaces(Lod))
+            {
+                const uint32_t NumVertices = SubMeshes[Lod.SubMeshIndex].NumVertices;
+                bValidIndices &= face.v1 < NumVertices && face.v2 < NumVertices && face.v3 < NumVertices;
+            }
+        }
+        Harness.Check(bOrdered, "sorted by submesh, then level");
+        Harness.Check(bAligned, "ranges start and end on whole triangles");
+        Harness.Check(bInside, "ranges stay inside the shared face list");
+        Harness.Check(bValidIndices, "LOD faces index the submesh's own vertices");
+        Harness.Check(Lods[0].FirstIndex == SubMeshes[0].FirstIndex && Lods[NumLevels].FirstIndex == SubMeshes[1].FirstIndex &&
+            Lods[1].FirstIndex >= FullFaces * 3, "level 0 is the submesh, the other levels come after the full detail faces");
+    });
+
+    Harness.Run("Errors grow", [&]()
+    {
+        bool bGrowing = true;
+        for (size_t i = 0; i < Lods.size(); ++i)
+        {
+            bGrowing &= Lods[i].Level == 0 ? Lods[i].Error == 0.0f : Lods[i].Error > Lods[i - 1].Error;
+        }
+        Harness.Check(bGrowing, "level 0 has no error and every further level a larger one");
+        Harness.Check(Stats.LodErrors.back() <= Settings.MaxError * glm::length(Lodded.BoundsMax() - Lodded.BoundsMin()) * Settings.LodRatios.size(),
+            "the summed error stays within MaxError per level");
+    });
+
+    Harness.Run("Seams and borders locked", [&]()
+    {
+        bool bKept = true;
+        for (const SubMeshLod& Lod : Lods)
+        {
+            const SubMesh& Sub = SubMeshes[Lod.SubMeshIndex];
+            std::vector<bool> Used(Sub.NumVertices, false);
+            for (const Face& face : LodFaces(Lod))
+            {
+                Used[face.v1] = Used[face.v2] = Used[face.v3] = true;
+            }
+            for (uint32_t v = 0; v < Sub.NumVertices; ++v)
+            {
+                bKept &= !ExpectLocked[Sub.BaseVertex + v] || Used[v];
+            }
+        }
+        Harness.Check(bKept, "every seam copy and border vertex is still used by every level");
+
+        // Collapses only move vertices onto their neighbours, so no face may join the two halves of the seam
+        bool bSplit = true;
+        const uint32_t LeftVertices = (Seam + 1) * (Cells + 1);
+        for (uint32_t Level = 0; Level < NumLevels; ++Level)
+        {
+            for (const Face& face : LodFaces(Lods[Level]))
+            {
+                const uint32_t Left = (face.v1 < LeftVertices) + (face.v2 < LeftVertices) + (face.v3 < LeftVertices);
+                bSplit &= Left == 0 || Left == 3;
+            }
+        }
+        Harness.Check(bSplit, "the halves of the split grid stay apart");
+    });
+
+    Harness.Run("SelectLods by distance", [&]()
+    {
+        const float PixelsPerUnit = 1080.0f / (2.0f * std::tan(glm::radians(30.0f)));
+        const Vec3 Center = (Lodded.BoundsMin() + Lodded.BoundsMax()) * 0.5f;
+        std::vector<uint32_t> Levels;
+        std::vector<uint32_t> Previous(SubMeshes.size(), 0);
+        bool bMonotonic = true;
+        for (float Distance = 0.0f; Distance < 10000.0f; Distance = Distance * 1.5f + 0.5f)
+        {
+            SelectLods(Lodded.SubMeshes(), Lods, Center + Vec3{ 0.0f, 0.0f, Distance }, PixelsPerUnit, 1.0f, Levels);
+            for (size_t i = 0; i < Levels.size(); ++i)
+            {
+                bMonotonic &= Levels[i] >= Previous[i];
+            }
+            Previous = Levels;
+        }
+        Harness.Check(bMonotonic, "levels never get finer as the eye moves away");
+        Harness.Check(Previous[0] == NumLevels - 1 && Previous[1] == NumLevels - 1, "far away the coarsest level is picked");
+
+        SelectLods(Lodded.SubMeshes(), Lods, Center, PixelsPerUnit, 1.0f, Levels);
+        Harness.Check(Levels[0] == 0 && Levels[1] == 0, "an eye inside the bounds gets full detail");
+    });
+
+    return Harness.Finish();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+
+struct DrawRange;
+
+struct SimplifySettings
+{
+    // Target triangle count of each LOD relative to LOD 0. Every LOD is simplified from the previous one.
+    std::vector<float> LodRatios = { 0.5f, 0.25f, 0.125f };
+
+    // Attribute cost per unit of squared difference, scaled by the area the collapse sweeps and the mesh size.
+    float NormalWeight = 0.5f;
+    float TexcoordWeight = 1.0f;
+
+    // Collapses that move the surface further than this fraction of the mesh diagonal are never taken,
+    // a LOD may stop above its target ratio because of it.
+    float MaxError = 0.02f;
+};
+
+struct SimplifyStats
+{
+    size_t TrianglesBefore = 0;
+    std::vector<size_t> LodTriangles;
+    std::vector<float> LodErrors;
+    double Milliseconds = 0.0;
+};
+
+class MeshSimplifier
+{
+public:
+    // Quadric error edge collapse onto existing vertices, so every LOD shares the vertex buffer.
+    // UV seams, open borders and non-manifold vertices are locked. The LOD faces are appended to the
+    // mesh's face list, vertex cache optimized, and described by Mesh::Lods().
+    static SimplifyStats BuildLods(Mesh& mesh, const SimplifySettings& Settings = SimplifySettings{});
+
+    static void PrintStats(const char* Name, const SimplifyStats& Stats);
+
+    // Picks the coarsest level of each submesh whose error projects to at most MaxPixelError pixels.
+    // PixelsPerUnit is the projection scale at distance 1: ViewportHeight / (2 * tan(FovY / 2)).
+    static void SelectLods(const std::vector<SubMesh>& SubMeshes, const std::vector<SubMeshLod>& Lods,
+        const Vec3& ObjectSpaceEye, float PixelsPerUnit, float MaxPixelError, std::vector<uint32_t>& OutLevels);
+
+    // Adds one draw for every submesh that selected a level above 0, level 0 submeshes are left to the meshlet culler.
+    static void AppendLodRanges(const std::vector<SubMesh>& SubMeshes, const std::vector<SubMeshLod>& Lods,
+        const std::vector<uint32_t>& Levels, std::vector<DrawRange>& OutRanges);
+
+    // Builds LODs of a curved grid split at a UV seam plus a second submesh and checks the triangle counts
+    // against their ratios, the LOD ranges, growing errors, that seam and border vertices survive every
+    // level and that SelectLods coarsens with distance. No GPU needed.
+    static bool SelfTest();
+};
@@ -0,0 +1,401 @@
+#include "MeshWelder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+#include "Mesh.h"
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    // 3 + 3 + 3 + 3 + 2 attribute components plus the owning submesh.
+    const int NumKeyComponents = 15;
+
+    struct VertexKey
+    {
+        int64_t Components[NumKeyComponents];
+
+        bool operator==(const VertexKey& Other) const
+        {
+            return std::memcmp(Components, Other.Components, sizeof(Components)) == 0;
+        }
+    };
+
+    int64_t Quantize(float Value, float Epsilon)
+    {
+        if (Epsilon <= 0.0f)
+        {
+            uint32_t Bits;
+            std::memcpy(&Bits, &Value, sizeof(Bits));
+            return Bits;
+        }
+        return static_cast<int64_t>(std::floor(double(Value) / double(Epsilon) + 0.5));
+    }
+
+    VertexKey MakeKey(const Vertex& vertex, uint32_t SubMeshIndex, const WeldSettings& Settings)
+    {
+        VertexKey Key;
+        int64_t* Out = Key.Components;
+        for (int i = 0; i < 3; ++i) *Out++ = Quantize(vertex.Position[i], Settings.PositionEpsilon);
+        for (int i = 0; i < 3; ++i) *Out++ = Quantize(vertex.Normal[i], Settings.NormalEpsilon);
+        for (int i = 0; i < 3; ++i) *Out++ = Quantize(vertex.Tangent[i], Settings.TangentEpsilon);
+        for (int i = 0; i < 3; ++i) *Out++ = Quantize(vertex.BiTangent[i], Settings.TangentEpsilon);
+        for (int i = 0; i < 2; ++i) *Out++ = Quantize(vertex.Texcoord[i], Settings.TexcoordEpsilon);
+        *Out++ = SubMeshIndex;
+        return Key;
+    }
+
+    uint32_t NextPowerOfTwo(size_t Value)
+    {
+        uint32_t Result = 1;
+        while (Result < Value)
+        {
+            Result <<= 1;
+        }
+        return Result;
+    }
+}
+
+WeldStats MeshWelder::Weld(Mesh& mesh, const WeldSettings& Settings)
+{
+    const auto StartTime = std::chrono::high_resolution_clock::now();
+
+    const std::vector<Vertex>& Vertices = mesh.Vertices();
+    const std::vector<Face>& Faces = mesh.Faces();
+    const std::vector<SubMesh>& SubMeshes = mesh.SubMeshes();
+    const size_t NumVertices = Vertices.size();
+
+    WeldStats Stats;
+    Stats.VerticesBefore = NumVertices;
+    Stats.BytesBefore = NumVertices * sizeof(Vertex);
+    if (NumVertices == 0)
+    {
+        return Stats;
+    }
+
+    ThreadPool& Pool = Settings.Pool ? *Settings.Pool : ThreadPool::Get();
+    const bool bParallel = NumVertices >= Settings.ParallelThreshold && Pool.NumThreads() > 0;
+    const size_t Grain = bParallel ? 4096 : NumVertices;
+
+    std::vector<uint32_t> VertexSubMesh(NumVertices);
+    for (uint32_t i = 0; i < SubMeshes.size(); ++i)
+    {
+        for (uint32_t v = 0; v < SubMeshes[i].NumVertices; ++v)
+        {
+            VertexSubMesh[SubMeshes[i].BaseVertex + v] = i;
+        }
+    }
+
+    // 1. Hash the quantized attributes of every vertex.
+    std::vector<uint64_t> Hashes(NumVertices);
+    Pool.ParallelFor(0, NumVertices, Grain, [&](size_t Begin, size_t End)
+    {
+        for (size_t v = Begin; v < End; ++v)
+        {
+            const VertexKey Key = MakeKey(Vertices[v], VertexSubMesh[v], Settings);
+            Hashes[v] = Hash::Fnv1a64(Key.Components, sizeof(Key.Components));
+        }
+    });
+
+    // 2. Equal keys always land in the same shard, so shards are welded independently.
+    //    Each shard keeps ascending vertex order, which makes the lowest index the representative.
+    const size_t NumShards = bParallel ? (Pool.NumThreads() + 1) * 4 : 1;
+    std::vector<uint32_t> ShardStart(NumShards + 1, 0);
+    for (size_t v = 0; v < NumVertices; ++v)
+    {
+        ++ShardStart[Hashes[v] % NumShards + 1];
+    }
+    for (size_t s = 0; s < NumShards; ++s)
+    {
+        ShardStart[s + 1] += ShardStart[s];
+    }
+
+    std::vector<uint32_t> ShardVertices(NumVertices);
+    {
+        std::vector<uint32_t> Cursor(ShardStart.begin(), ShardStart.end() - 1);
+        for (uint32_t v = 0; v < NumVertices; ++v)
+        {
+            ShardVertices[Cursor[Hashes[v] % NumShards]++] = v;
+        }
+    }
+
+    std::vector<uint32_t> Remap(NumVertices);
+    Pool.ParallelFor(0, NumShards, 1, [&](size_t Begin, size_t End)
+    {
+        const uint32_t Empty = ~0u;
+        std::vector<uint32_t> Table;
+
+        for (size_t s = Begin; s < End; ++s)
+        {
+            const uint32_t ShardSize = ShardStart[s + 1] - ShardStart[s];
+            const uint32_t TableSize = NextPowerOfTwo(ShardSize * 2 + 1);
+            Table.assign(TableSize, Empty);
+
+            for (uint32_t i = ShardStart[s]; i < ShardStart[s + 1]; ++i)
+            {
+                const uint32_t v = ShardVertices[i];
+                const VertexKey Key = MakeKey(Vertices[v], VertexSubMesh[v], Settings);
+
+                // Open addressing with linear probing, collisions fall back to a full key compare.
+                for (uint32_t Slot = static_cast<uint32_t>(Hashes[v] / NumShards) & (TableSize - 1);; Slot = (Slot + 1) & (TableSize - 1))
+                {
+                    const uint32_t Candidate = Table[Slot];
+                    if (Candidate == Empty)
+                    {
+                        Table[Slot] = v;
+                        Remap[v] = v;
+                        break;
+                    }
+                    if (Hashes[Candidate] == Hashes[v] && MakeKey(Vertices[Candidate], VertexSubMesh[Candidate], Settings) == Key)
+                    {
+                        Remap[v] = Candidate;
+                        break;
+                    }
+                }
+            }
+        }
+    });
+
+    // 3. Compact in first-occurrence order. A representative always precedes its duplicates,
+    //    and the first vertex of each submesh is always kept, so submesh ranges stay contiguous.
+    std::vector<uint32_t> NewIndex(NumVertices);
+    std::vector<Vertex> NewVertices;
+    NewVertices.reserve(NumVertices);
+    for (uint32_t v = 0; v < NumVertices; ++v)
+    {
+        if (Remap[v] == v)
+        {
+            NewIndex[v] = static_cast<uint32_t>(NewVertices.size());
+            NewVertices.push_back(Vertices[v]);
+        }
+        else
+        {
+            NewIndex[v] = NewIndex[Remap[v]];
+        }
+    }
+
+    std::vector<SubMesh> NewSubMeshes = SubMeshes;
+    for (size_t i = 0; i < NewSubMeshes.size(); ++i)
+    {
+        const uint32_t NewBase = SubMeshes[i].NumVertices > 0 ? NewIndex[SubMeshes[i].BaseVertex] : static_cast<uint32_t>(NewVertices.size());
+        NewSubMeshes[i].BaseVertex = NewBase;
+    }
+    for (size_t i = 0; i < NewSubMeshes.size(); ++i)
+    {
+        const uint32_t NextBase = (i + 1 < NewSubMeshes.size()) ? NewSubMeshes[i + 1].BaseVertex : static_cast<uint32_t>(NewVertices.size());
+        NewSubMeshes[i].NumVertices = NextBase - NewSubMeshes[i].BaseVertex;
+    }
+
+    // 4. Rewrite the local indices, then drop triangles that collapsed onto a single edge or point.
+    std::vector<Face> RemappedFaces(Faces.size());
+    for (size_t i = 0; i < SubMeshes.size(); ++i)
+    {
+        const SubMesh& Old = SubMeshes[i];
+        const uint32_t NewBase = NewSubMeshes[i].BaseVertex;
+        const size_t FirstFace = Old.FirstIndex / 3;
+
+        Pool.ParallelFor(FirstFace, FirstFace + Old.NumIndices / 3, Grain, [&](size_t Begin, size_t End)
+        {
+            for (size_t f = Begin; f < End; ++f)
+            {
+                RemappedFaces[f].v1 = NewIndex[Old.BaseVertex + Faces[f].v1] - NewBase;
+                RemappedFaces[f].v2 = NewIndex[Old.BaseVertex + Faces[f].v2] - NewBase;
+                RemappedFaces[f].v3 = NewIndex[Old.BaseVertex + Faces[f].v3] - NewBase;
+            }
+        });
+    }
+
+    std::vector<Face> NewFaces;
+    NewFaces.reserve(Faces.size());
+    for (size_t i = 0; i < SubMeshes.size(); ++i)
+    {
+        const size_t FirstFace = SubMeshes[i].FirstIndex / 3;
+        NewSubMeshes[i].FirstIndex = static_cast<uint32_t>(NewFaces.size() * 3);
+
+        for (size_t f = FirstFace; f < FirstFace + SubMeshes[i].NumIndices / 3; ++f)
+        {
+            const Face& face = RemappedFaces[f];
+            if (face.v1 == face.v2 || face.v2 == face.v3 || face.v1 == face.v3)
+            {
+                ++Stats.DegenerateFaces;
+                continue;
+            }
+            NewFaces.push_back(face);
+        }
+
+        NewSubMeshes[i].NumIndices = static_cast<uint32_t>(NewFaces.size() * 3) - NewSubMeshes[i].FirstIndex;
+    }
+
+    Stats.VerticesAfter = NewVertices.size();
+    Stats.BytesAfter = NewVertices.size() * sizeof(Vertex);
+
+    mesh.ReplaceGeometry(std::move(NewVertices), std::move(NewFaces), std::move(NewSubMeshes));
+
+    Stats.Milliseconds = ElapsedMs(StartTime);
+    return Stats;
+}
+
+void MeshWelder::PrintStats(const char* Name, const WeldStats& Stats)
+{
+    std::printf("Welded mesh : %s %zu -> %zu vertices (%.2f MB -> %.2f MB, %zu degenerate faces dropped, %.2f ms)\n",
+        Name,
+        Stats.VerticesBefore,
+        Stats.VerticesAfter,
+        Stats.BytesBefore / (1024.0 * 1024.0),
+        Stats.BytesAfter / (1024.0 * 1024.0),
+        Stats.DegenerateFaces,
+        Stats.Milliseconds);
+}
+
+bool MeshWelder::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Mesh welder self test\n");
+
+    const auto MakeVertex = [](float X, float Y, float U)
+    {
+        return Vertex{ Vec3{ X, Y, 0.0f }, Vec3{ 0.0f, 0.0f, 1.0f }, Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f }, Vec2{ U, 0.0f } };
+    };
+    const auto SameFaces = [](const std::vector<Face>& A, const std::vector<Face>& B)
+    {
+        return A.size() == B.size() && std::equal(A.begin(), A.end(), B.begin(), [](const Face& L, const Face& R)
+        {
+            return L.v1 == R.v1 && L.v2 == R.v2 && L.v3 == R.v3;
+        });
+    };
+    const auto SameRanges = [](const std::vector<SubMesh>& A, const std::vector<SubMesh>& B)
+    {
+        return A.size() == B.size() && std::equal(A.begin(), A.end(), B.begin(), [](const SubMesh& L, const SubMesh& R)
+        {
+            return L.BaseVertex == R.BaseVertex && L.NumVertices == R.NumVertices && L.FirstIndex == R.FirstIndex && L.NumIndices == R.NumIndices;
+        });
+    };
+
+    Harness.Run("First occurrence and remap", [&]()
+    {
+        //Submesh 0 repeats A (once within the position epsilon) and B, its third face collapses once A' is welded.
+        //Submesh 1 starts with A as well but must keep its own copy
+        const Vertex A = MakeVertex(0.0f, 0.0f, 0.0f);
+        const Vertex ANear = MakeVertex(1e-7f, 0.0f, 0.0f);
+        const Vertex B = MakeVertex(1.0f, 0.0f, 0.5f);
+        const Vertex C = MakeVertex(0.0f, 1.0f, 1.0f);
+        const Vertex Vertices[] = { A, B, ANear, C, B, A, MakeVertex(2.0f, 0.0f, 0.0f), MakeVertex(0.0f, 2.0f, 0.0f) };
+        const Face Faces[] = { { 0, 1, 3 }, { 2, 4, 3 }, { 0, 2, 3 }, { 0, 1, 2 } };
+        const SubMesh SubMeshes[] = { { 0, 5, 0, 9, 0, {}, {} }, { 5, 3, 9, 3, 1, {}, {} } };
+        Mesh Welded{ Vertices, 8, Faces, 4, SubMeshes, 2 };
+
+        const WeldStats Stats = Weld(Welded);
+        Harness.Check(Stats.VerticesBefore == 8 && Stats.VerticesAfter == 6 && Stats.DegenerateFaces == 1, "two duplicates merged, one face dropped");
+        Harness.Check(Welded.Vertices().size() == 6 && Welded.Vertices()[0].Position.x == 0.0f && Welded.Vertices()[1].Texcoord.x == 0.5f,
+            "the first occurrence is kept, in its original order");
+        Harness.Check(Welded.Vertices()[3].Position == A.Position, "a vertex equal to one of another submesh is not merged");
+        Harness.Check(SameFaces(Welded.Faces(), { { 0, 1, 2 }, { 0, 1, 2 }, { 0, 1, 2 } }), "faces are remapped to the kept vertices");
+        Harness.Check(SameRanges(Welded.SubMeshes(), { { 0, 3, 0, 6, 0, {}, {} }, { 3, 3, 6, 3, 1, {}, {} } }),
+            "submesh vertex and index ranges shrink to the welded data");
+    });
+
+    Harness.Run("Epsilons", [&]()
+    {
+        const Vertex Vertices[] = { MakeVertex(0.0f, 0.0f, 0.0f), MakeVertex(0.0f, 0.0f, 0.01f), MakeVertex(1.0f, 0.0f, 0.0f), MakeVertex(0.0f, 1.0f, 0.0f) };
+        const Face Faces[] = { { 0, 2, 3 }, { 1, 2, 3 } };
+        const SubMesh SubMeshes[] = { { 0, 4, 0, 6, 0, {}, {} } };
+
+        Mesh Strict{ Vertices, 4, Faces, 2, SubMeshes, 1 };
+        Harness.Check(Weld(Strict).VerticesAfter == 4, "texcoords further apart than the epsilon stay separate");
+
+        WeldSettings Loose;
+        Loose.TexcoordEpsilon = 0.1f;
+        Mesh Welded{ Vertices, 4, Faces, 2, SubMeshes, 1 };
+        const WeldStats Stats = Weld(Welded, Loose);
+        Harness.Check(Stats.VerticesAfter == 3 && Welded.Faces().size() == 2, "a larger epsilon merges them, the faces are remapped but not dropped");
+    });
+
+    // Many exact duplicates on a coarse grid over three submeshes. The reference welds by comparing whole vertices,
+    // per submesh in first-occurrence order, and the serial and pooled welds have to match it exactly.
+    Harness.Run("1 and 4 threads match reference", [&]()
+    {
+        std::mt19937 Random{ 99 };
+        std::vector<Vertex> Vertices;
+        std::vector<Face> Faces;
+        std::vector<SubMesh> SubMeshes;
+        for (uint32_t s = 0; s < 3; ++s)
+        {
+            const uint32_t NumVertices = 20000 + s * 5000;
+            SubMeshes.push_back({ uint32_t(Vertices.size()), NumVertices, uint32_t(Faces.size() * 3), 0, s, {}, {} });
+            for (uint32_t v = 0; v < NumVertices; ++v)
+            {
+                Vertices.push_back(MakeVertex(float(Random() % 32) / 8.0f, float(Random() % 32) / 8.0f, float(Random() % 4) / 4.0f));
+            }
+            for (uint32_t f = 0; f < NumVertices; ++f)
+            {
+                Faces.push_back({ uint32_t(Random() % NumVertices), uint32_t(Random() % NumVertices), uint32_t(Random() % NumVertices) });
+            }
+            SubMeshes.back().NumIndices = NumVertices * 3;
+        }
+
+        std::vector<Vertex> ExpectedVertices;
+        std::vector<Face> ExpectedFaces;
+        std::vector<SubMesh> ExpectedSubMeshes = SubMeshes;
+        for (size_t s = 0; s < SubMeshes.size(); ++s)
+        {
+            const SubMesh& Sub = SubMeshes[s];
+            std::map<std::string, uint32_t> Firsts;
+            std::vector<uint32_t> Local(Sub.NumVertices);
+            ExpectedSubMeshes[s].BaseVertex = uint32_t(ExpectedVertices.size());
+            for (uint32_t v = 0; v < Sub.NumVertices; ++v)
+            {
+                const Vertex& Source = Vertices[Sub.BaseVertex + v];
+                const std::string Key(reinterpret_cast<const char*>(&Source), sizeof(Vertex));
+                const auto Inserted = Firsts.emplace(Key, uint32_t(ExpectedVertices.size()) - ExpectedSubMeshes[s].BaseVertex);
+                if (Inserted.second)
+                {
+                    ExpectedVertices.push_back(Source);
+                }
+                Local[v] = Inserted.first->second;
+            }
+            ExpectedSubMeshes[s].NumVertices = uint32_t(ExpectedVertices.size()) - ExpectedSubMeshes[s].BaseVertex;
+
+            ExpectedSubMeshes[s].FirstIndex = uint32_t(ExpectedFaces.size() * 3);
+            for (uint32_t f = Sub.FirstIndex / 3; f < (Sub.FirstIndex + Sub.NumIndices) / 3; ++f)
+            {
+                const Face Remapped{ Local[Faces[f].v1], Local[Faces[f].v2], Local[Faces[f].v3] };
+                if (Remapped.v1 != Remapped.v2 && Remapped.v2 != Remapped.v3 && Remapped.v1 != Remapped.v3)
+                {
+                    ExpectedFaces.push_back(Remapped);
+                }
+            }
+            ExpectedSubMeshes[s].NumIndices = uint32_t(ExpectedFaces.size() * 3) - ExpectedSubMeshes[s].FirstIndex;
+        }
+
+        ThreadPool Pool{ 3 };
+        WeldSettings Serial;
+        Serial.ParallelThreshold = ~size_t(0);
+        WeldSettings Parallel;
+        Parallel.ParallelThreshold = 0;
+        Parallel.Pool = &Pool;
+
+        for (const WeldSettings* Settings : { &Serial, &Parallel })
+        {
+            Mesh Welded{ Vertices.data(), Vertices.size(), Faces.data(), Faces.size(), SubMeshes.data(), SubMeshes.size() };
+            const WeldStats Stats = Weld(Welded, *Settings);
+            const char* What = Settings == &Serial ? "1 thread" : "4 threads";
+            std::printf("    %s: %zu -> %zu vertices, %zu degenerate faces\n", What, Stats.VerticesBefore, Stats.VerticesAfter, Stats.DegenerateFaces);
+            Harness.Check(Welded.Vertices().size() == ExpectedVertices.size() &&
+                std::memcmp(Welded.Vertices().data(), ExpectedVertices.data(), ExpectedVertices.size() * sizeof(Vertex)) == 0,
+                "vertices are the reference's, in first-occurrence order");
+            Harness.Check(SameFaces(Welded.Faces(), ExpectedFaces), "faces match the reference remap, degenerate ones dropped");
+            Harness.Check(SameRanges(Welded.SubMeshes(), ExpectedSubMeshes), "submesh ranges match the reference");
+            Harness.Check(Stats.DegenerateFaces == Faces.size() - ExpectedFaces.size(), "every dropped face is counted");
+        }
+    });
+
+    return Harness.Finish();
+}
@@ -0,0 +1,500 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include <glm/include/glm/gtc/matrix_transform.hpp>
+
+#include "Camera.h"
+#include "MeshletCuller.h"
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const uint32_t InvalidSlot = ~0u;
+
+    void ComputeBounds(Meshlet& Out, const MeshletData& Data, const Vertex* Vertices)
+    {
+        const uint32_t* Indices = &Data.VertexIndices[Out.VertexOffset];
+        const uint8_t* Triangles = &Data.LocalIndices[Out.TriangleOffset * 3];
+
+        Vec3 Min = Vertices[Indices[0]].Position;
+        Vec3 Max = Min;
+        for (uint32_t i = 1; i < Out.VertexCount; ++i)
+        {
+            Min = glm::min(Min, Vertices[Indices[i]].Position);
+            Max = glm::max(Max, Vertices[Indices[i]].Position);
+        }
+
+        Out.Center = (Min + Max) * 0.5f;
+        Out.Radius = 0.0f;
+        for (uint32_t i = 0; i < Out.VertexCount; ++i)
+        {
+            Out.Radius = std::max(Out.Radius, glm::length(Vertices[Indices[i]].Position - Out.Center));
+        }
+
+        // The axis is the average face normal, the cone has to contain every face normal.
+        std::vector<Vec3> Normals;
+        Normals.reserve(Out.TriangleCount);
+        Vec3 AxisSum{ 0.0f };
+        for (uint32_t t = 0; t < Out.TriangleCount; ++t)
+        {
+            const Vec3& P1 = Vertices[Indices[Triangles[t * 3 + 0]]].Position;
+            const Vec3& P2 = Vertices[Indices[Triangles[t * 3 + 1]]].Position;
+            const Vec3& P3 = Vertices[Indices[Triangles[t * 3 + 2]]].Position;
+            const Vec3 N = glm::cross(P2 - P1, P3 - P1);
+            const float Length = glm::length(N);
+            if (Length > 0.0f)
+            {
+                Normals.push_back(N / Length);
+                AxisSum += N / Length;
+            }
+        }
+
+        Out.ConeAxis = Vec3{ 0.0f, 0.0f, 1.0f };
+        Out.ConeCutoff = 1.0f;
+
+        const float AxisLength = glm::length(AxisSum);
+        if (Normals.empty() || AxisLength == 0.0f)
+        {
+            return;
+        }
+
+        const Vec3 Axis = AxisSum / AxisLength;
+        float MinDot = 1.0f;
+        for (const Vec3& N : Normals)
+        {
+            MinDot = std::min(MinDot, glm::dot(Axis, N));
+        }
+
+        // Cones wider than ~84 degrees are almost never culled, keep them out of the test entirely.
+        if (MinDot > 0.1f)
+        {
+            Out.ConeAxis = Axis;
+            Out.ConeCutoff = std::sqrt(1.0f - MinDot * MinDot);
+        }
+    }
+
+    MeshletData BuildSubMesh(const Mesh& mesh, uint32_t SubMeshIndex)
+    {
+        const SubMesh& Sub = mesh.SubMeshes()[SubMeshIndex];
+        const Vertex* Vertices = mesh.Vertices().data() + Sub.BaseVertex;
+        const Face* Faces = mesh.Faces().data() + Sub.FirstIndex / 3;
+        const uint32_t NumFaces = Sub.NumIndices / 3;
+
+        MeshletData Data;
+        Data.Meshlets.reserve(NumFaces / MeshletBuilder::MaxTriangles + 1);
+        Data.VertexIndices.reserve(NumFaces);
+        Data.LocalIndices.reserve(NumFaces * 3);
+
+        // Slot of each vertex in the open meshlet, only valid while Owner matches the meshlet index.
+        std::vector<uint32_t> Owner(Sub.NumVertices, InvalidSlot);
+        std::vector<uint8_t> Slot(Sub.NumVertices, 0);
+
+        Meshlet Current = {};
+        Current.SubMeshIndex = SubMeshIndex;
+        Current.FirstIndex = Sub.FirstIndex;
+
+        const auto Flush = [&]()
+        {
+            if (Current.TriangleCount == 0)
+            {
+                return;
+            }
+            ComputeBounds(Current, Data, Vertices);
+            Data.Meshlets.push_back(Current);
+
+            const uint32_t NextFirstIndex = Current.FirstIndex + Current.TriangleCount * 3;
+            Current = {};
+            Current.SubMeshIndex = SubMeshIndex;
+            Current.FirstIndex = NextFirstIndex;
+            Current.VertexOffset = static_cast<uint32_t>(Data.VertexIndices.size());
+            Current.TriangleOffset = static_cast<uint32_t>(Data.LocalIndices.size() / 3);
+        };
+
+        for (uint32_t f = 0; f < NumFaces; ++f)
+        {
+            const uint32_t Corners[3] = { Faces[f].v1, Faces[f].v2, Faces[f].v3 };
+            const uint32_t MeshletIndex = static_cast<uint32_t>(Data.Meshlets.size());
+
+            uint32_t NewVertices = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                const bool bDuplicate = (c > 0 && Corners[c] == Corners[0]) || (c > 1 && Corners[c] == Corners[1]);
+                NewVertices += (Owner[Corners[c]] != MeshletIndex && !bDuplicate) ? 1 : 0;
+            }
+
+            if (Current.VertexCount + NewVertices > MeshletBuilder::MaxVertices || Current.TriangleCount + 1 > MeshletBuilder::MaxTriangles)
+            {
+                Flush();
+            }
+
+            const uint32_t OpenIndex = static_cast<uint32_t>(Data.Meshlets.size());
+            for (int c = 0; c < 3; ++c)
+            {
+                const uint32_t v = Corners[c];
+                if (Owner[v] != OpenIndex)
+                {
+                    Owner[v] = OpenIndex;
+                    Slot[v] = static_cast<uint8_t>(Current.VertexCount++);
+                    Data.VertexIndices.push_back(v);
+                }
+                Data.LocalIndices.push_back(Slot[v]);
+            }
+            ++Current.TriangleCount;
+        }
+        Flush();
+
+        return Data;
+    }
+}
+
+MeshletData MeshletBuilder::Build(const Mesh& mesh)
+{
+    const size_t NumSubMeshes = mesh.SubMeshes().size();
+    std::vector<MeshletData> PerSubMesh(NumSubMeshes);
+
+    ThreadPool::Get().ParallelFor(0, NumSubMeshes, 1, [&](size_t Begin, size_t End)
+    {
+        for (size_t i = Begin; i < End; ++i)
+        {
+            PerSubMesh[i] = BuildSubMesh(mesh, static_cast<uint32_t>(i));
+        }
+    });
+
+    MeshletData Result;
+    for (const MeshletData& Data : PerSubMesh)
+    {
+        const uint32_t VertexBase = static_cast<uint32_t>(Result.VertexIndices.size());
+        const uint32_t TriangleBase = static_cast<uint32_t>(Result.LocalIndices.size() / 3);
+        for (Meshlet meshlet : Data.Meshlets)
+        {
+            meshlet.VertexOffset += VertexBase;
+            meshlet.TriangleOffset += TriangleBase;
+            Result.Meshlets.push_back(meshlet);
+        }
+        Result.VertexIndices.insert(Result.VertexIndices.end(), Data.VertexIndices.begin(), Data.VertexIndices.end());
+        Result.LocalIndices.insert(Result.LocalIndices.end(), Data.LocalIndices.begin(), Data.LocalIndices.end());
+    }
+    return Result;
+}
+
+bool MeshletBuilder::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Meshlet builder self test\n");
+
+    // Columns x Rows quads in the z = 0 plane over x in [X0, X0 + Columns], y in [-Rows / 4, Rows / 4].
+    // Faces go column by column so meshlets stay narrow in x, bFront winds them towards -z.
+    std::vector<Vertex> Vertices;
+    std::vector<Face> Faces;
+    std::vector<SubMesh> SubMeshes;
+    const auto AddStrip = [&](uint32_t Columns, uint32_t Rows, float X0, bool bFront)
+    {
+        SubMesh Sub{ uint32_t(Vertices.size()), (Columns + 1) * (Rows + 1), uint32_t(Faces.size() * 3), Columns * Rows * 6, uint32_t(SubMeshes.size()), {}, {} };
+        for (uint32_t Column = 0; Column <= Columns; ++Column)
+        {
+            for (uint32_t Row = 0; Row <= Rows; ++Row)
+            {
+                const Vec3 Position{ X0 + float(Column), 0.5f * Row - 0.25f * Rows, 0.0f };
+                Vertices.emplace_back(Position, Vec3{ 0.0f, 0.0f, bFront ? -1.0f : 1.0f }, Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f }, Vec2{ 0.0f });
+            }
+        }
+        for (uint32_t Column = 0; Column < Columns; ++Column)
+        {
+            for (uint32_t Row = 0; Row < Rows; ++Row)
+            {
+                const uint32_t A = Column * (Rows + 1) + Row;
+                const uint32_t B = A + Rows + 1;
+                Faces.push_back(bFront ? Face{ A, A + 1, B } : Face{ A, B, A + 1 });
+                Faces.push_back(bFront ? Face{ A + 1, B + 1, B } : Face{ A + 1, B, B + 1 });
+            }
+        }
+        SubMeshes.push_back(Sub);
+    };
+
+    // A curved grid and the same faces shuffled fill meshlets up to the vertex limit, random faces over 16
+    // vertices up to the triangle limit. A degenerate face exercises the duplicate corner path
+    std::mt19937 Random{ 17 };
+    AddStrip(40, 40, -20.0f, true);
+    const uint32_t Shuffled = uint32_t(SubMeshes.size());
+    AddStrip(40, 40, -20.0f, true);
+    for (uint32_t v = SubMeshes[0].NumVertices; v < Vertices.size(); ++v)
+    {
+        Vertices[v].Position.z = 0.05f * float(Random() % 64);
+    }
+    for (uint32_t v = 0; v < SubMeshes[0].NumVertices; ++v)
+    {
+        Vertices[v].Position.z = 0.002f * Vertices[v].Position.x * Vertices[v].Position.x;
+    }
+    std::shuffle(Faces.begin() + SubMeshes[Shuffled].FirstIndex / 3, Faces.end(), Random);
+    Faces.back() = Face{ Faces.back().v1, Faces.back().v1, Faces.back().v2 };
+    SubMeshes.push_back({ uint32_t(Vertices.size()), 16, uint32_t(Faces.size() * 3), 0, 2, {}, {} });
+    for (uint32_t v = 0; v < 16; ++v)
+    {
+        Vertices.emplace_back(Vec3{ float(v % 4), float(v / 4), float(v % 3) }, Vec3{ 0.0f, 0.0f, 1.0f }, Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f }, Vec2{ 0.0f });
+    }
+    for (uint32_t f = 0; f < 500; ++f)
+    {
+        const uint32_t A = uint32_t(Random() % 16);
+        Faces.push_back({ A, (A + 1 + uint32_t(Random() % 7)) % 16, (A + 8 + uint32_t(Random() % 7)) % 16 });
+    }
+    SubMeshes.back().NumIndices = 1500;
+    const Mesh Shapes{ Vertices.data(), Vertices.size(), Faces.data(), Faces.size(), SubMeshes.data(), SubMeshes.size() };
+    const MeshletData Data = Build(Shapes);
+
+    Harness.Run("Limits and local indices", [&]()
+    {
+        bool bLimits = true;
+        bool bContiguous = true;
+        bool bLocalIndices = true;
+        bool bSameFaces = true;
+        uint32_t MaxVertexCount = 0;
+        uint32_t MaxTriangleCount = 0;
+        uint32_t NextVertex = 0;
+        uint32_t NextTriangle = 0;
+        std::vector<uint32_t> NextIndex;
+        for (const SubMesh& Sub : SubMeshes)
+        {
+            NextIndex.push_back(Sub.FirstIndex);
+        }
+
+        for (const Meshlet& meshlet : Data.Meshlets)
+        {
+            bLimits &= meshlet.VertexCount > 0 && meshlet.VertexCount <= MaxVertices && meshlet.TriangleCount > 0 && meshlet.TriangleCount <= MaxTriangles;
+            MaxVertexCount = std::max(MaxVertexCount, meshlet.VertexCount);
+            MaxTriangleCount = std::max(MaxTriangleCount, meshlet.TriangleCount);
+
+            // Meshlets tile the index buffer of their submesh and the two side arrays in order
+            bContiguous &= meshlet.FirstIndex == NextIndex[meshlet.SubMeshIndex] && meshlet.VertexOffset == NextVertex && meshlet.TriangleOffset == NextTriangle;
+            NextIndex[meshlet.SubMeshIndex] += meshlet.TriangleCount * 3;
+            NextVertex += meshlet.VertexCount;
+            NextTriangle += meshlet.TriangleCount;
+
+            const SubMesh& Sub = SubMeshes[meshlet.SubMeshIndex];
+            for (uint32_t t = 0; t < meshlet.TriangleCount; ++t)
+            {
+                const Face& Source = Faces[meshlet.FirstIndex / 3 + t];
+                const uint32_t SourceCorners[3] = { Source.v1, Source.v2, Source.v3 };
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    const uint8_t Local = Data.LocalIndices[(meshlet.TriangleOffset + t) * 3 + c];
+                    bLocalIndices &= Local < meshlet.VertexCount;
+                    const uint32_t v = Data.VertexIndices[meshlet.VertexOffset + std::min<uint32_t>(Local, meshlet.VertexCount - 1)];
+                    bLocalIndices &= v < Sub.NumVertices;
+                    bSameFaces &= v == SourceCorners[c];
+                }
+            }
+        }
+        for (size_t i = 0; i < SubMeshes.size(); ++i)
+        {
+            bContiguous &= NextIndex[i] == SubMeshes[i].FirstIndex + SubMeshes[i].NumIndices;
+        }
+
+        std::printf("    %zu meshlets, largest has %u vertices and %u triangles\n", Data.Meshlets.size(), MaxVertexCount, MaxTriangleCount);
+        Harness.Check(bLimits, "at most 64 vertices and 124 triangles per meshlet, none empty");
+        Harness.Check(MaxTriangleCount == MaxTriangles && MaxVertexCount >= MaxVertices - 2, "both limits are reached");
+        Harness.Check(bContiguous, "meshlets cover every face once, in order");
+        Harness.Check(bLocalIndices, "local indices stay inside the meshlet and submesh");
+        Harness.Check(bSameFaces, "local indices rebuild the source faces");
+        Harness.Check(NextVertex == Data.VertexIndices.size() && NextTriangle * 3 == Data.LocalIndices.size(), "no unused vertex or triangle entries");
+    });
+
+    Harness.Run("Sphere and cone bounds", [&]()
+    {
+        bool bInSphere = true;
+        bool bInCone = true;
+        bool bConservative = true;
+        size_t Cones = 0;
+        std::uniform_real_distribution<float> Coordinate{ -40.0f, 40.0f };
+        std::vector<Vec3> Eyes;
+        for (int i = 0; i < 64; ++i)
+        {
+            Eyes.push_back(Vec3{ Coordinate(Random), Coordinate(Random), Coordinate(Random) });
+        }
+
+        for (const Meshlet& meshlet : Data.Meshlets)
+        {
+            const Vertex* Base = &Vertices[SubMeshes[meshlet.SubMeshIndex].BaseVertex];
+            for (uint32_t i = 0; i < meshlet.VertexCount; ++i)
+            {
+                const Vec3& P = Base[Data.VertexIndices[meshlet.VertexOffset + i]].Position;
+                bInSphere &= glm::length(P - meshlet.Center) <= meshlet.Radius * (1.0f + 1e-5f) + 1e-6f;
+            }
+            if (meshlet.ConeCutoff >= 1.0f)
+            {
+                continue;
+            }
+            ++Cones;
+
+            // Every face normal lies inside the cone, and an eye the cone culls sees the back of every face
+            const float MinDot = std::sqrt(std::max(1.0f - meshlet.ConeCutoff * meshlet.ConeCutoff, 0.0f));
+            for (uint32_t t = 0; t < meshlet.TriangleCount; ++t)
+            {
+                const Face& face = Faces[meshlet.FirstIndex / 3 + t];
+                const Vec3 N = glm::cross(Base[face.v2].Position - Base[face.v1].Position, Base[face.v3].Position - Base[face.v1].Position);
+                if (glm::length(N) == 0.0f)
+                {
+                    continue;
+                }
+                bInCone &= glm::dot(glm::normalize(N), meshlet.ConeAxis) >= MinDot - 1e-4f;
+                for (const Vec3& Eye : Eyes)
+                {
+                    const Vec3 ToCenter = meshlet.Center - Eye;
+                    if (glm::dot(ToCenter, meshlet.ConeAxis) >= meshlet.ConeCutoff * glm::length(ToCenter) + meshlet.Radius)
+                    {
+                        bConservative &= glm::dot(N, Base[face.v1].Position - Eye) >= 0.0f;
+                    }
+                }
+            }
+        }
+        std::printf("    %zu of %zu meshlets have a cone\n", Cones, Data.Meshlets.size());
+        Harness.Check(bInSphere, "every vertex is inside its meshlet's sphere");
+        Harness.Check(Cones > 0, "the curved grid gets cones");
+        Harness.Check(bInCone, "every face normal is inside its meshlet's cone");
+        Harness.Check(bConservative, "the cone test only culls meshlets that face away entirely");
+    });
+
+    Harness.Run("Deterministic", [&]()
+    {
+        const MeshletData Again = Build(Shapes);
+        Harness.Check(Again.Meshlets.size() == Data.Meshlets.size() &&
+            std::memcmp(Again.Meshlets.data(), Data.Meshlets.data(), Data.Meshlets.size() * sizeof(Meshlet)) == 0,
+            "meshlets are byte identical");
+        Harness.Check(Again.VertexIndices == Data.VertexIndices && Again.LocalIndices == Data.LocalIndices, "vertex and local indices are identical");
+    });
+
+    // A front and a back facing strip from x = -60 to 60, seen head on from (0, 0, -10) with a 45 degree lens.
+    // Meshlets are about 7 units wide, so anything past |x| = 20 is outside the frustum and the middle is in it
+    Harness.Run("Cull against a camera", [&]()
+    {
+        Vertices.clear();
+        Faces.clear();
+        SubMeshes.clear();
+        AddStrip(120, 8, -60.0f, true);
+        AddStrip(120, 8, -60.0f, false);
+        const Mesh Strips{ Vertices.data(), Vertices.size(), Faces.data(), Faces.size(), SubMeshes.data(), SubMeshes.size() };
+        const MeshletData Strip = Build(Strips);
+
+        Camera View;
+        View.SetLens(glm::radians(45.0f), 1024.0f, 1024.0f, 0.1f, 100.0f);
+        View.SetPosition(0.0f, 0.0f, -10.0f);
+
+        std::vector<DrawRange> Ranges;
+        const MeshletCullStats Stats = MeshletCuller::Cull(Strip, SubMeshes, View, glm::mat4{ 1.0f }, Ranges);
+        const auto Kept = [&](const Meshlet& meshlet)
+        {
+            for (const DrawRange& Range : Ranges)
+            {
+                if (Range.BaseVertex == SubMeshes[meshlet.SubMeshIndex].BaseVertex && Range.FirstIndex <= meshlet.FirstIndex &&
+                    meshlet.FirstIndex + meshlet.TriangleCount * 3 <= Range.FirstIndex + Range.NumIndices)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        bool bFarCulled = true;
+        bool bCenterKept = false;
+        bool bBackCulled = true;
+        size_t KeptTriangles = 0;
+        for (const Meshlet& meshlet : Strip.Meshlets)
+        {
+            const bool bKept = Kept(meshlet);
+            KeptTriangles += bKept ? meshlet.TriangleCount : 0;
+            bFarCulled &= std::abs(meshlet.Center.x) < 20.0f || !bKept;
+            if (meshlet.SubMeshIndex == 0)
+            {
+                bCenterKept |= std::abs(meshlet.Center.x) <= meshlet.Radius && bKept;
+            }
+            else
+            {
+                bBackCulled &= !bKept;
+            }
+        }
+        std::printf("    %zu meshlets: %zu frustum culled, %zu cone culled, %zu triangles in %zu draws\n",
+            Stats.Meshlets, Stats.FrustumCulled, Stats.ConeCulled, Stats.Triangles, Stats.Ranges);
+        Harness.Check(bFarCulled, "meshlets far outside the frustum are culled");
+        Harness.Check(bCenterKept, "the front facing meshlet in view is kept");
+        Harness.Check(bBackCulled && Stats.ConeCulled > 0, "the back facing strip is culled, partly by its cones");
+        Harness.Check(KeptTriangles == Stats.Triangles && Stats.Ranges == Ranges.size() && Ranges.size() == 1,
+            "the visible meshlets merge into one draw holding exactly the kept triangles");
+
+        const MeshletCullStats NoCones = MeshletCuller::Cull(Strip, SubMeshes, View.GetProj() * View.GetView(), View.GetPosition(), false, Ranges);
+        Harness.Check(NoCones.ConeCulled == 0 && NoCones.Triangles == 2 * Stats.Triangles, "without cone culling the back facing copy is drawn too");
+    });
+
+    return Harness.Finish();
+}
+
+void MeshletBuilder::Benchmark(const std::string& SourceFile, int Iterations)
+{
+    Iterations = Iterations > 0 ? Iterations : 1;
+    std::shared_ptr<Mesh> mesh = Mesh::FromFile(SourceFile);
+
+    double BuildMs = 0.0;
+    MeshletData Data;
+    for (int i = 0; i < Iterations; ++i)
+    {
+        const auto Start = std::chrono::high_resolution_clock::now();
+        Data = Build(*mesh);
+        BuildMs += ElapsedMs(Start);
+    }
+
+    const MeshletData Again = Build(*mesh);
+    const bool bDeterministic =
+        Again.Meshlets.size() == Data.Meshlets.size() &&
+        std::memcmp(Again.Meshlets.data(), Data.Meshlets.data(), Data.Meshlets.size() * sizeof(Meshlet)) == 0 &&
+        Again.VertexIndices == Data.VertexIndices &&
+        Again.LocalIndices == Data.LocalIndices;
+
+    // Orbit the camera around the mesh and cull from a few directions, the same way the renderer does.
+    const Vec3 Center = (mesh->BoundsMin() + mesh->BoundsMax()) * 0.5f;
+    const float Distance = glm::length(mesh->BoundsMax() - mesh->BoundsMin()) * 0.75f;
+    const glm::mat4 Projection = glm::perspectiveFovRH_ZO(glm::radians(45.0f), 1024.0f, 1024.0f, 0.1f, Distance * 4.0f);
+    const int NumViews = 8;
+
+    double CullMs = 0.0;
+    MeshletCullStats Total;
+    std::vector<DrawRange> Ranges;
+    for (int i = 0; i < Iterations; ++i)
+    {
+        for (int View = 0; View < NumViews; ++View)
+        {
+            const float Angle = glm::radians(360.0f * View / NumViews);
+            const Vec3 Eye = Center + Vec3{ std::cos(Angle), 0.25f, std::sin(Angle) } * Distance;
+            const glm::mat4 ViewProjection = Projection * glm::lookAt(Eye, Center, Vec3{ 0.0f, 1.0f, 0.0f });
+
+            const auto Start = std::chrono::high_resolution_clock::now();
+            const MeshletCullStats Stats = MeshletCuller::Cull(Data, mesh->SubMeshes(), ViewProjection, Eye, true, Ranges);
+            CullMs += ElapsedMs(Start);
+
+            Total.Meshlets += Stats.Meshlets;
+            Total.FrustumCulled += Stats.FrustumCulled;
+            Total.ConeCulled += Stats.ConeCulled;
+            Total.Triangles += Stats.Triangles;
+            Total.Ranges += Stats.Ranges;
+        }
+    }
+
+    const size_t NumCulls = size_t(Iterations) * NumViews;
+    std::printf("Meshlet benchmark: %s (%d iterations, %zu triangles)\n", SourceFile.c_str(), Iterations, mesh->Faces().size());
+    std::printf("  Meshlets      : %zu (%.1f triangles, %.1f vertices avg, %s)\n",
+        Data.Meshlets.size(),
+        double(Data.LocalIndices.size() / 3) / std::max<size_t>(Data.Meshlets.size(), 1),
+        double(Data.VertexIndices.size()) / std::max<size_t>(Data.Meshlets.size(), 1),
+        bDeterministic ? "deterministic" : "NOT deterministic");
+    std::printf("  Build         : %8.3f ms\n", BuildMs / Iterations);
+    std::printf("  Cull          : %8.3f ms\n", CullMs / NumCulls);
+    std::printf("  Frustum culled: %5.1f%%\n", 100.0 * Total.FrustumCulled / std::max<size_t>(Total.Meshlets, 1));
+    std::printf("  Cone culled   : %5.1f%%\n", 100.0 * Total.ConeCulled / std::max<size_t>(Total.Meshlets, 1));
+    std::printf("  Triangles kept: %5.1f%% in %.1f draws\n",
+        100.0 * Total.Triangles / (double(mesh->Faces().size()) * NumCulls),
+        double(Total.Ranges) / NumCulls);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+
+// A small cluster of triangles that is culled as a unit.
+// Triangles are taken from the face list in order, so every meshlet is also one contiguous
+// index range [FirstIndex, FirstIndex + TriangleCount * 3) of its submesh.
+struct Meshlet
+{
+    uint32_t SubMeshIndex;
+    uint32_t FirstIndex;
+
+    // Into MeshletData::VertexIndices (submesh-local vertex indices) and MeshletData::LocalIndices (3 per triangle).
+    uint32_t VertexOffset;
+    uint32_t VertexCount;
+    uint32_t TriangleOffset;
+    uint32_t TriangleCount;
+
+    // Object space bounding sphere.
+    Vec3 Center;
+    float Radius;
+
+    // Backface cone: the meshlet faces away from every eye with
+    // dot(Center - Eye, ConeAxis) >= ConeCutoff * |Center - Eye| + Radius. A cutoff of 1 never culls.
+    Vec3 ConeAxis;
+    float ConeCutoff;
+};
+
+struct MeshletData
+{
+    std::vector<Meshlet> Meshlets;
+    std::vector<uint32_t> VertexIndices;
+    std::vector<uint8_t> LocalIndices;
+};
+
+class MeshletBuilder
+{
+public:
+    static const uint32_t MaxVertices = 64;
+    static const uint32_t MaxTriangles = 124;
+
+    // Deterministic: the result only depends on the face order, submeshes are built in parallel.
+    static MeshletData Build(const Mesh& mesh);
+
+    // Checks the vertex and triangle limits, local indices, sphere and cone bounds and byte identical
+    // rebuilds on procedural meshes, then culls a known strip against a fixed Camera. No GPU needed.
+    static bool SelfTest();
+
+    // Times Build and the culler on a source file and prints the averages.
+    static void Benchmark(const std::string& SourceFile, int Iterations);
+};
@@ -0,0 +1,95 @@
+#include "MeshletCuller.h"
+
+#include "Camera.h"
+
+void MeshletCuller::ExtractFrustum(const glm::mat4& ModelViewProjection, glm::vec4 OutPlanes[6])
+{
+    // Gribb/Hartmann on the rows of the matrix. glm is column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    glm::vec4 Rows[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        Rows[i] = glm::vec4{ ModelViewProjection[0][i], ModelViewProjection[1][i], ModelViewProjection[2][i], ModelViewProjection[3][i] };
+    }
+
+    OutPlanes[0] = Rows[3] + Rows[0]; // left
+    OutPlanes[1] = Rows[3] - Rows[0]; // right
+    OutPlanes[2] = Rows[3] + Rows[1]; // bottom
+    OutPlanes[3] = Rows[3] - Rows[1]; // top
+    OutPlanes[4] = Rows[2];           // near, z >= 0
+    OutPlanes[5] = Rows[3] - Rows[2]; // far
+
+    for (int i = 0; i < 6; ++i)
+    {
+        const float Length = glm::length(glm::vec3{ OutPlanes[i] });
+        OutPlanes[i] /= Length > 0.0f ? Length : 1.0f;
+    }
+}
+
+MeshletCullStats MeshletCuller::Cull(const MeshletData& Data, const std::vector<SubMesh>& SubMeshes,
+    const glm::mat4& ModelViewProjection, const Vec3& ObjectSpaceEye, bool bConeCulling,
+    std::vector<DrawRange>& OutRanges, const std::vector<uint32_t>* SubMeshLevels)
+{
+    glm::vec4 Planes[6];
+    ExtractFrustum(ModelViewProjection, Planes);
+
+    MeshletCullStats Stats;
+    Stats.Meshlets = Data.Meshlets.size();
+    OutRanges.clear();
+
+    for (const Meshlet& meshlet : Data.Meshlets)
+    {
+        if (SubMeshLevels && (*SubMeshLevels)[meshlet.SubMeshIndex] != 0)
+        {
+            continue;
+        }
+
+        bool bVisible = true;
+        for (int i = 0; i < 6 && bVisible; ++i)
+        {
+            bVisible = glm::dot(glm::vec3{ Planes[i] }, meshlet.Center) + Planes[i].w >= -meshlet.Radius;
+        }
+        if (!bVisible)
+        {
+            ++Stats.FrustumCulled;
+            continue;
+        }
+
+        if (bConeCulling)
+        {
+            const Vec3 ToCenter = meshlet.Center - ObjectSpaceEye;
+            if (glm::dot(ToCenter, meshlet.ConeAxis) >= meshlet.ConeCutoff * glm::length(ToCenter) + meshlet.Radius)
+            {
+                ++Stats.ConeCulled;
+                continue;
+            }
+        }
+
+        const uint32_t NumIndices = meshlet.TriangleCount * 3;
+        const uint32_t BaseVertex = SubMeshes[meshlet.SubMeshIndex].BaseVertex;
+        Stats.Triangles += meshlet.TriangleCount;
+
+        // Meshlets are stored in index order, so a visible neighbour just extends the last draw.
+        if (!OutRanges.empty() &&
+            OutRanges.back().BaseVertex == BaseVertex &&
+            OutRanges.back().FirstIndex + OutRanges.back().NumIndices == meshlet.FirstIndex)
+        {
+            OutRanges.back().NumIndices += NumIndices;
+        }
+        else
+        {
+            OutRanges.push_back(DrawRange{ meshlet.FirstIndex, NumIndices, BaseVertex });
+        }
+    }
+
+    Stats.Ranges = OutRanges.size();
+    return Stats;
+}
+
+MeshletCullStats MeshletCuller::Cull(const MeshletData& Data, const std::vector<SubMesh>& SubMeshes,
+    Camera& View, const glm::mat4& Model, std::vector<DrawRange>& OutRanges,
+    const std::vector<uint32_t>* SubMeshLevels)
+{
+    const glm::mat4 ModelViewProjection = View.GetProj() * View.GetView() * Model;
+    const Vec3 ObjectSpaceEye = Vec3{ glm::inverse(Model) * glm::vec4{ View.GetPosition(), 1.0f } };
+    return Cull(Data, SubMeshes, ModelViewProjection, ObjectSpaceEye, true, OutRanges, SubMeshLevels);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Meshlet.h"
+
+class Camera;
+
+// One DrawIndexedInstanced worth of indices, adjacent visible meshlets of a submesh are merged.
+struct DrawRange
+{
+    uint32_t FirstIndex;
+    uint32_t NumIndices;
+    uint32_t BaseVertex;
+};
+
+struct MeshletCullStats
+{
+    size_t Meshlets = 0;
+    size_t FrustumCulled = 0;
+    size_t ConeCulled = 0;
+    size_t Triangles = 0;
+    size_t Ranges = 0;
+};
+
+class MeshletCuller
+{
+public:
+    // Planes of ModelViewProjection (D3D clip space, 0 <= z <= w), so the tests run in object space.
+    static void ExtractFrustum(const glm::mat4& ModelViewProjection, glm::vec4 OutPlanes[6]);
+
+    // Frustum test against every meshlet, plus the backface cone test when bConeCulling is set.
+    // ObjectSpaceEye is the eye transformed into the mesh's object space.
+    // Meshlets are built on LOD 0, submeshes whose entry in SubMeshLevels is above 0 are skipped entirely.
+    static MeshletCullStats Cull(const MeshletData& Data, const std::vector<SubMesh>& SubMeshes,
+        const glm::mat4& ModelViewProjection, const Vec3& ObjectSpaceEye, bool bConeCulling,
+        std::vector<DrawRange>& OutRanges, const std::vector<uint32_t>* SubMeshLevels = nullptr);
+
+    static MeshletCullStats Cull(const MeshletData& Data, const std::vector<SubMesh>& SubMeshes,
+        Camera& View, const glm::mat4& Model, std::vector<DrawRange>& OutRanges,
+        const std::vector<uint32_t>* SubMeshLevels = nullptr);
+};
@@ -0,0 +1,210 @@
+#include "NullRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include "AssetLoader.h"
+#include "Mesh.h"
+#include "PortableUtils.h"
+#include "ScenePasses.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    //D3D12's default placement alignment, and the one of MSAA textures
+    constexpr uint64_t TextureAlignment = 64 * 1024;
+    constexpr uint64_t MsaaTextureAlignment = 4 * 1024 * 1024;
+
+    //What GetResourceAllocationInfo returns for a render target or depth buffer, give or take the tiling padding
+    uint64_t TargetSize(uint32_t Width, uint32_t Height, uint32_t Samples, uint32_t BytesPerPixel)
+    {
+        const uint64_t Alignment = Samples > 1 ? MsaaTextureAlignment : TextureAlignment;
+        const uint64_t Size = uint64_t(Width) * Height * Samples * BytesPerPixel;
+        return (Size + Alignment - 1) / Alignment * Alignment;
+    }
+
+    //Present and Common are both state 0 to D3D12, which records no barrier between them
+    bool IsNoOpTransition(const RenderGraphBarrier& Barrier)
+    {
+        const auto Native = [](ResourceState State) { return State == ResourceState::Present ? ResourceState::Common : State; };
+        return Barrier.BarrierType == RenderGraphBarrier::Type::Transition && Native(Barrier.StateBefore) == Native(Barrier.StateAfter);
+    }
+}
+
+NullRenderer::NullRenderer(uint32_t FramesInFlight)
+    :m_NumFrames(FramesInFlight)
+    ,m_Pacer(FramesInFlight)
+    ,m_Constants(FramesInFlight)
+{}
+
+GLFWwindow* NullRenderer::initialize(int Width, int Height, int MaxSamples)
+{
+    m_Width = static_cast<uint32_t>(Width);
+    m_Height = static_cast<uint32_t>(Height);
+    //D3D12Renderer takes the highest count the device supports up to MaxSamples, every D3D12 device does 4
+    m_Samples = static_cast<uint32_t>(std::min(MaxSamples, 4));
+
+    std::printf("Null Renderer [no GPU, %u frames in flight, %ux%u x%u]\n", m_NumFrames, m_Width, m_Height, m_Samples);
+    return nullptr;
+}
+
+void NullRenderer::ShutDown()
+{
+    const RecordedCommandStats& Stats = m_Backend.Stats();
+    const size_t Frames = m_Pacer.Stats().Frames;
+    const double PerFrame = 1.0 / double(std::max<size_t>(Frames, 1));
+
+    std::printf("Null renderer: %zu frames, %.3f ms update + %.3f ms render per frame\n", Frames, m_UpdateMs * PerFrame, m_RenderMs * PerFrame);
+    std::printf("  Per frame     : %.1f draws, %.0f vertices, %.1f barriers in %.1f calls, %.1f discards, %.1f events\n",
+        double(Stats.Draws) * PerFrame, double(Stats.DrawnVertices) * PerFrame, double(Stats.Barriers) * PerFrame,
+        double(Stats.BarrierBatches) * PerFrame, double(Stats.Discards) * PerFrame, double(Stats.Events) * PerFrame);
+    if (m_Passes)
+    {
+        m_Passes->PrintStats("Frame");
+    }
+    m_Pacer.PrintStats("Frame");
+}
+
+void NullRenderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
+{
+    m_View = view;
+    m_Scene = Scene;
+
+    //The meshes D3D12Renderer draws, textures and the environment only matter to the GPU
+    {
+        AssetLoader Loader;
+        const AssetHandle PbrMeshAsset = Loader.RequestMesh("Meshes/cerberus.fbx");
+        const AssetHandle SkyBoxAsset = Loader.RequestMesh("meshes/skybox.obj");
+
+        m_PbrMesh = Loader.GetMesh(PbrMeshAsset);
+        m_SkyBoxMesh = Loader.GetMesh(SkyBoxAsset);
+        m_PbrMeshlets = MeshletBuilder::Build(*m_PbrMesh);
+        m_SceneFrame.SetModel(&m_PbrMeshlets, &m_PbrMesh->SubMeshes(), &m_PbrMesh->Lods());
+
+        Loader.PrintReport();
+    }
+
+    mCamera.SetLens(m_View.fov, float(1024), float(1024), 1.0f, 1000.0f);
+
+    SetupPasses();
+}
+
+void NullRenderer::Update(const float)
+{
+    const auto Start = std::chrono::high_resolution_clock::now();
+
+    //The simulated GPU has finished every submitted frame, so this never waits
+    m_Pacer.RecordWait(0.0);
+    m_FrameIndex = m_Pacer.BeginFrame(m_FenceValue);
+
+    m_SceneFrame.Update(mCamera, m_Scene, float(1024));
+
+    FrameConstants& Constants = m_Constants[m_FrameIndex];
+    Constants.Transform = m_SceneFrame.Transform();
+    Constants.Shading = m_SceneFrame.Shading();
+    Constants.LightToTexture = m_SceneFrame.Shadow().LightToTexture;
+
+    m_UpdateMs += ElapsedMs(Start);
+}
+
+void NullRenderer::Render(GLFWwindow*, const float)
+{
+    const auto Start = std::chrono::high_resolution_clock::now();
+
+    m_Passes->Execute(m_FrameIndex);
+    //Only the counters are kept, a timeline of every frame would grow without bound
+    m_Backend.ClearTimeline();
+
+    ++m_FenceValue;
+    m_Pacer.EndFrame(m_FenceValue);
+
+    m_RenderMs += ElapsedMs(Start);
+}
+
+void NullRenderer::SetLight()
+{
+    m_Scene.Lights[0].Position = mCamera.GetPosition();
+    m_Scene.Lights[0].Direction = mCamera.GetLook();
+    printf("Set Light[0] Position %.3f %.3f %.3f \n", m_Scene.Lights[0].Position[0], m_Scene.Lights[0].Position[1], m_Scene.Lights[0].Position[2]);
+    printf("Set Light[0] Direction %.3f %.3f %.3f \n", m_Scene.Lights[0].Direction[0], m_Scene.Lights[0].Direction[1], m_Scene.Lights[0].Direction[2]);
+}
+
+void NullRenderer::SetupPasses()
+{
+    m_Passes = std::make_unique<ParallelPassRecorder>(m_Backend, ThreadPool::Get());
+
+    //RGBA16F color and D24S8 depth like D3D12Renderer's frame buffers, the resolve target only with MSAA
+    const RenderGraphResource ShadowMapTexture = m_Graph.Import("ShadowMap", ResourceState::GenericRead, ResourceState::GenericRead);
+    const RenderGraphResource BackBuffer = m_Graph.Import("BackBuffer", ResourceState::Present, ResourceState::Present);
+    const uint64_t Alignment = m_Samples > 1 ? MsaaTextureAlignment : TextureAlignment;
+    const RenderGraphResource SceneColor = m_Graph.CreateTransient("SceneColor", TargetSize(m_Width, m_Height, m_Samples, 8), Alignment, ResourceState::RenderTarget);
+    const RenderGraphResource SceneDepth = m_Graph.CreateTransient("SceneDepthStencil", TargetSize(m_Width, m_Height, m_Samples, 4), Alignment, ResourceState::DepthWrite);
+    const RenderGraphResource ResolveColor = m_Samples > 1 ?
+        m_Graph.CreateTransient("ResolveColor", TargetSize(m_Width, m_Height, 1, 8), TextureAlignment, ResourceState::RenderTarget) : SceneColor;
+
+    //Only the draws, there is nothing to bind. Prepare stands in for the geometry pool compaction, which only
+    //exists on the GPU, and ResolveSubresource has no neutral command
+    ScenePasses::Hooks Hooks;
+    Hooks.Shadow = [this](CommandContext& Context)
+    {
+        for (const DrawRange& Range : m_SceneFrame.ShadowDraws())
+        {
+            Context.DrawIndexed(Range.NumIndices, 1, Range.FirstIndex, static_cast<int32_t>(Range.BaseVertex));
+        }
+    };
+    Hooks.Skybox = [this](CommandContext& Context)
+    {
+        for (const SubMesh& Sub : m_SkyBoxMesh->SubMeshes())
+        {
+            Context.DrawIndexed(Sub.NumIndices, 1, Sub.FirstIndex, static_cast<int32_t>(Sub.BaseVertex));
+        }
+    };
+    Hooks.Pbr = [this](CommandContext& Context)
+    {
+        for (const DrawRange& Range : m_SceneFrame.MainDraws())
+        {
+            Context.DrawIndexed(Range.NumIndices, 1, Range.FirstIndex, static_cast<int32_t>(Range.BaseVertex));
+        }
+
+        //The debugger's shadow map quad
+        Context.DrawIndexed(6, 1, 0, 0);
+    };
+    Hooks.Tonemap = [](CommandContext& Context)
+    {
+        Context.Draw(3, 1);
+    };
+    ScenePasses::Add(m_Graph, { ShadowMapTexture, SceneColor, SceneDepth, ResolveColor, BackBuffer }, std::move(Hooks));
+
+    m_Graph.Compile();
+
+    //Batched like D3D12RenderGraph::EmitBarriers: one call per run of barriers, a discard ends the run
+    m_Graph.Register(*m_Passes, [](CommandContext& Context, const std::vector<RenderGraphBarrier>& Barriers)
+    {
+        RecordingCommandContext& Recording = static_cast<RecordingCommandContext&>(Context);
+        uint32_t Batch = 0;
+        for (const RenderGraphBarrier& Barrier : Barriers)
+        {
+            if (Barrier.BarrierType == RenderGraphBarrier::Type::Discard)
+            {
+                if (Batch > 0)
+                {
+                    Recording.RecordBarriers(Batch);
+                    Batch = 0;
+                }
+                Recording.RecordDiscard();
+            }
+            else if (!IsNoOpTransition(Barrier))
+            {
+                ++Batch;
+            }
+        }
+        if (Batch > 0)
+        {
+            Recording.RecordBarriers(Batch);
+        }
+    });
+    m_Graph.PrintReport("Frame");
+}
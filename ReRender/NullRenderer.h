@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "FramePacer.h"
+#include "Meshlet.h"
+#include "ParallelPassRecorder.h"
+#include "RecordingCommandBackend.h"
+#include "RenderGraph.h"
+#include "Renderer.h"
+#include "SceneFrame.h"
+
+class Mesh;
+
+// Headless RendererInterface without a GPU or a window. Update runs the same SceneFrame work as D3D12Renderer and
+// copies its constants into per-frame slots, Render records the same frame graph of passes with their draws and
+// barriers into a RecordingCommandBackend, which validates and counts every command. The GPU is simulated as
+// finishing each frame as soon as it is submitted. For profiling the CPU cost of a frame on machines without
+// D3D12, e.g. ReRender.exe --null --frames 1000.
+class NullRenderer final : public RendererInterface
+{
+public:
+    //FramesInFlight: 2..FramePacer::MaxFramesInFlight, only changes how many constant slots are cycled through
+    explicit NullRenderer(uint32_t FramesInFlight = 2);
+
+    //Returns nullptr, there is no window
+    GLFWwindow* initialize(int Width, int Height, int MaxSamples) override;
+    void ShutDown() override;
+    void Setup(const ViewSettings& view, const SceneSettings& Scene) override;
+    void Update(const float DeltaTime) override;
+    void Render(GLFWwindow* Window, const float DeltaTime) override;
+
+    void SetLight() override;
+
+    const RecordedCommandStats& CommandStats() const { return m_Backend.Stats(); }
+
+private:
+    //What D3D12Renderer writes to its transient constant buffer every frame
+    struct FrameConstants
+    {
+        TransformCB Transform;
+        ShadingCB Shading;
+        Mat4 LightToTexture;
+    };
+
+    //The ScenePasses D3D12Renderer records, the transient sizes estimate D3D12's placement rules
+    void SetupPasses();
+
+    const uint32_t m_NumFrames;
+    FramePacer m_Pacer;
+    //Last frame submitted to the simulated GPU, which is always done with it
+    uint64_t m_FenceValue = 0;
+    uint32_t m_FrameIndex = 0;
+
+    uint32_t m_Width = 0;
+    uint32_t m_Height = 0;
+    uint32_t m_Samples = 1;
+
+    std::shared_ptr<Mesh> m_PbrMesh;
+    std::shared_ptr<Mesh> m_SkyBoxMesh;
+    MeshletData m_PbrMeshlets;
+    SceneFrame m_SceneFrame;
+    std::vector<FrameConstants> m_Constants;
+
+    RenderGraph m_Graph;
+    RecordingCommandBackend m_Backend;
+    std::unique_ptr<ParallelPassRecorder> m_Passes;
+
+    double m_UpdateMs = 0.0;
+    double m_RenderMs = 0.0;
+
+    ViewSettings m_View;
+    SceneSettings m_Scene;
+};
@@ -0,0 +1,277 @@
+#include "ParallelPassRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "PortableUtils.h"
+#include "RecordingCommandBackend.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    // Roughly what validating and encoding one draw costs a driver, kept opaque to the optimizer.
+    uint64_t SimulateDrawCost(uint64_t Seed)
+    {
+        uint64_t State = Seed | 1;
+        for (int i = 0; i < 256; ++i)
+        {
+            State ^= State << 13;
+            State ^= State >> 7;
+            State ^= State << 17;
+        }
+        return State;
+    }
+
+    uint64_t DrawValue(uint64_t Frame, uint64_t Pass, uint64_t Draw)
+    {
+        return (Frame << 40) | (Pass << 20) | Draw;
+    }
+
+    int32_t DrawBaseVertex(uint32_t Pass, int Draw)
+    {
+        return Draw - int32_t(Pass) * 1000;
+    }
+
+    // Frames of one serial pass and Passes parallel ones recorded on a pool of Threads threads. The serial pass
+    // publishes the frame number and every parallel pass stamps it into its commands. With bVerify each submission
+    // is compared with what the passes recorded in the order they were added, the first mismatch is returned.
+    std::string RecordFrames(int Threads, int Passes, int DrawsPerPass, int Frames, bool bVerify, PassRecorderStats& OutStats)
+    {
+        ThreadPool Pool{ static_cast<unsigned int>(Threads - 1) };
+        RecordingCommandBackend Backend;
+        ParallelPassRecorder Recorder{ Backend, Pool };
+
+        uint64_t CurrentFrame = 0;
+        uint64_t NextFrame = 0;
+        Recorder.AddPass("Prepare", [&CurrentFrame, &NextFrame](CommandContext& Context)
+        {
+            CurrentFrame = NextFrame;
+            static_cast<RecordingCommandContext&>(Context).Record(CurrentFrame);
+        }, PassRecording::Serial);
+        for (int PassIndex = 1; PassIndex <= Passes; ++PassIndex)
+        {
+            Recorder.AddPass("Pass " + std::to_string(PassIndex), [&CurrentFrame, PassIndex, DrawsPerPass](CommandContext& Context)
+            {
+                RecordingCommandContext& Recording = static_cast<RecordingCommandContext&>(Context);
+                volatile uint64_t Sink = 0;
+                for (int Draw = 0; Draw < DrawsPerPass; ++Draw)
+                {
+                    const uint64_t Value = DrawValue(CurrentFrame, PassIndex, Draw);
+                    Sink = Sink + SimulateDrawCost(Value);
+                    Recording.Record(Value);
+                    Recording.DrawIndexed(3, 1, uint32_t(Draw) * 3, DrawBaseVertex(PassIndex, Draw));
+                }
+            });
+        }
+
+        std::string Failure;
+        for (int Frame = 0; Frame < Frames && Failure.empty(); ++Frame)
+        {
+            NextFrame = uint64_t(Frame) + 1;
+            Recorder.Execute(uint32_t(Frame % 3));
+            if (!bVerify)
+            {
+                Backend.ClearTimeline();
+                continue;
+            }
+
+            // Expected timeline: every pass in the order added, each wrapped in its own event.
+            const std::vector<RecordedCommand>& Timeline = Backend.Timeline();
+            size_t Cursor = 0;
+            const auto Expect = [&](RecordedCommand::Type Type, uint32_t Context, uint64_t Value, uint32_t FirstIndex = 0, int32_t BaseVertex = 0)
+            {
+                if (Failure.empty() && (Cursor >= Timeline.size() || Timeline[Cursor].CommandType != Type || Timeline[Cursor].Context != Context ||
+                    ((Type == RecordedCommand::Type::Command || Type == RecordedCommand::Type::Draw) && Timeline[Cursor].Value != Value) ||
+                    Timeline[Cursor].FirstIndex != FirstIndex || Timeline[Cursor].BaseVertex != BaseVertex))
+                {
+                    Failure = "submission out of pass order at command " + std::to_string(Cursor) + " of frame " + std::to_string(Frame);
+                }
+                ++Cursor;
+            };
+            for (uint32_t PassIndex = 0; PassIndex <= uint32_t(Passes) && Failure.empty(); ++PassIndex)
+            {
+                Expect(RecordedCommand::Type::BeginEvent, PassIndex, 0);
+                if (PassIndex == 0)
+                {
+                    Expect(RecordedCommand::Type::Command, 0, NextFrame);
+                }
+                for (int Draw = 0; PassIndex > 0 && Draw < DrawsPerPass; ++Draw)
+                {
+                    Expect(RecordedCommand::Type::Command, PassIndex, DrawValue(NextFrame, PassIndex, Draw));
+                    Expect(RecordedCommand::Type::Draw, PassIndex, 3, uint32_t(Draw) * 3, DrawBaseVertex(PassIndex, Draw));
+                }
+                Expect(RecordedCommand::Type::EndEvent, PassIndex, 0);
+            }
+            if (Failure.empty() && Cursor != Timeline.size())
+            {
+                Failure = "submission holds commands no pass recorded";
+            }
+            Backend.ClearTimeline();
+        }
+        OutStats = Recorder.Stats();
+        return Failure;
+    }
+}
+
+ParallelPassRecorder::ParallelPassRecorder(CommandBackend& InBackend, ThreadPool& InPool)
+    :m_Backend(InBackend)
+    ,m_Pool(InPool)
+{}
+
+void ParallelPassRecorder::AddPass(std::string Name, PassFunction Record, PassRecording Recording)
+{
+    if (Recording == PassRecording::Parallel)
+    {
+        m_ParallelPasses.push_back(m_Passes.size());
+    }
+    m_Passes.push_back({ std::move(Name), std::move(Record), Recording, m_Backend.CreateContext() });
+    m_Submission.push_back(m_Passes.back().Context.get());
+}
+
+void ParallelPassRecorder::Execute(uint32_t FrameIndex)
+{
+    const auto SerialStart = std::chrono::high_resolution_clock::now();
+    for (Pass& Current : m_Passes)
+    {
+        if (Current.Recording == PassRecording::Serial)
+        {
+            RecordPass(Current, FrameIndex);
+        }
+    }
+    m_Stats.SerialMs += ElapsedMs(SerialStart);
+
+    const auto ParallelStart = std::chrono::high_resolution_clock::now();
+    m_Pool.ParallelFor(0, m_ParallelPasses.size(), 1, [this, FrameIndex](size_t Begin, size_t End)
+    {
+        for (size_t i = Begin; i < End; ++i)
+        {
+            RecordPass(m_Passes[m_ParallelPasses[i]], FrameIndex);
+        }
+    });
+    m_Stats.ParallelMs += ElapsedMs(ParallelStart);
+
+    const auto SubmitStart = std::chrono::high_resolution_clock::now();
+    m_Backend.Execute(m_Submission.data(), m_Submission.size());
+    m_Stats.SubmitMs += ElapsedMs(SubmitStart);
+    ++m_Stats.Frames;
+}
+
+void ParallelPassRecorder::PrintStats(const char* Name) const
+{
+    const double Frames = double(std::max<size_t>(m_Stats.Frames, 1));
+    std::printf("Pass recorder: %s (%zu passes, %zu parallel, %u pool threads)\n", Name, m_Passes.size(), m_ParallelPasses.size(), m_Pool.NumThreads());
+    std::printf("  Per frame     : %.3f ms serial, %.3f ms parallel, %.3f ms submit over %zu frames\n",
+        m_Stats.SerialMs / Frames, m_Stats.ParallelMs / Frames, m_Stats.SubmitMs / Frames, m_Stats.Frames);
+}
+
+void ParallelPassRecorder::RecordPass(Pass& Target, uint32_t FrameIndex)
+{
+    CommandContext& Context = *Target.Context;
+    Context.Begin(FrameIndex);
+    Context.BeginEvent(Target.Name.c_str());
+    try
+    {
+        Target.Record(Context);
+    }
+    catch (...)
+    {
+        // Leave the context closed so the next frame can begin it again.
+        Context.EndEvent();
+        Context.End();
+        throw;
+    }
+    Context.EndEvent();
+    Context.End();
+}
+
+bool ParallelPassRecorder::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Parallel pass recorder self test\n");
+
+    for (const int Threads : { 1, 4 })
+    {
+        const std::string Name = "Pass order, " + std::to_string(Threads) + (Threads == 1 ? " thread" : " threads");
+        Harness.Run(Name.c_str(), [&]()
+        {
+            PassRecorderStats Stats;
+            const std::string Failure = RecordFrames(Threads, 6, 20, 30, true, Stats);
+            Harness.Check(Failure.empty(), Failure.c_str());
+            Harness.Check(Stats.Frames == 30, "every frame was executed");
+        });
+    }
+
+    Harness.Run("A throwing pass submits nothing", [&]()
+    {
+        ThreadPool Pool{ 3 };
+        RecordingCommandBackend Backend;
+        ParallelPassRecorder Recorder{ Backend, Pool };
+        bool bThrow = true;
+        Recorder.AddPass("Serial", [](CommandContext& Context) { static_cast<RecordingCommandContext&>(Context).Record(1); }, PassRecording::Serial);
+        Recorder.AddPass("Parallel", [](CommandContext& Context) { static_cast<RecordingCommandContext&>(Context).Record(2); });
+        Recorder.AddPass("Throwing", [&bThrow](CommandContext& Context)
+        {
+            static_cast<RecordingCommandContext&>(Context).Record(3);
+            if (bThrow)
+            {
+                throw std::runtime_error("pass failed");
+            }
+        });
+
+        bool bRethrown = false;
+        try
+        {
+            Recorder.Execute(0);
+        }
+        catch (const std::runtime_error&)
+        {
+            bRethrown = true;
+        }
+        Harness.Check(bRethrown, "Execute rethrows the pass's exception");
+        Harness.Check(Backend.NumSubmissions() == 0 && Backend.Timeline().empty(), "nothing is submitted for the failed frame");
+
+        bThrow = false;
+        Recorder.Execute(1);
+        Harness.Check(Backend.NumSubmissions() == 1 && Backend.Stats().Contexts == 3 && Backend.Timeline().size() == 9,
+            "the next frame records every pass again");
+    });
+
+    return Harness.Finish();
+}
+
+void ParallelPassRecorder::Benchmark(int MaxThreads, int Passes, int DrawsPerPass, int Frames)
+{
+    MaxThreads = std::max(MaxThreads, 1);
+    Passes = std::max(Passes, 1);
+    DrawsPerPass = std::max(DrawsPerPass, 1);
+    Frames = std::max(Frames, 1);
+
+    std::vector<int> ThreadCounts;
+    for (int Threads = 1; Threads < MaxThreads; Threads *= 2)
+    {
+        ThreadCounts.push_back(Threads);
+    }
+    ThreadCounts.push_back(MaxThreads);
+
+    std::printf("Parallel pass recording benchmark: 1 serial + %d parallel passes of %d draws, %d frames\n", Passes, DrawsPerPass, Frames);
+
+    double SingleThreadMs = 0.0;
+    for (const int Threads : ThreadCounts)
+    {
+        PassRecorderStats Stats;
+        RecordFrames(Threads, Passes, DrawsPerPass, Frames, false, Stats);
+
+        const double FrameMs = (Stats.SerialMs + Stats.ParallelMs + Stats.SubmitMs) / Frames;
+        if (Threads == 1)
+        {
+            SingleThreadMs = FrameMs;
+        }
+        std::printf("  %2d thread%s   : %.3f ms per frame (%.3f recording in parallel), %.2fx\n",
+            Threads, Threads == 1 ? " " : "s", FrameMs, Stats.ParallelMs / Frames, SingleThreadMs / FrameMs);
+    }
+    std::printf("  Hardware      : %u threads\n", std::thread::hardware_concurrency());
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CommandContext.h"
+
+class ThreadPool;
+
+enum class PassRecording
+{
+    Parallel,   //Recorded on the pool together with the other parallel passes
+    Serial,     //Recorded on the calling thread before any parallel pass starts, for passes that change CPU state the others read
+};
+
+using PassFunction = std::function<void(CommandContext&)>;
+
+struct PassRecorderStats
+{
+    size_t Frames = 0;
+    double SerialMs = 0.0;
+    double ParallelMs = 0.0;
+    double SubmitMs = 0.0;
+};
+
+// Records a frame as a list of passes, each into a context of its own, so passes can be recorded on worker threads
+// in any order while the GPU still executes them in the order they were added.
+class ParallelPassRecorder
+{
+public:
+    ParallelPassRecorder(CommandBackend& InBackend, ThreadPool& InPool);
+
+    // Passes execute in the order they are added. Record gets the pass's context between its Begin and End, wrapped
+    // in an event named after the pass, and must only touch state no other parallel pass writes.
+    void AddPass(std::string Name, PassFunction Record, PassRecording Recording = PassRecording::Parallel);
+
+    // Records every pass for FrameIndex, serial ones first on this thread and the rest on the pool, then submits all
+    // contexts in pass order with one Execute. Rethrows the first exception a pass threw, nothing is submitted then.
+    void Execute(uint32_t FrameIndex);
+
+    size_t NumPasses() const { return m_Passes.size(); }
+
+    // Accumulated over every Execute so far.
+    const PassRecorderStats& Stats() const { return m_Stats; }
+
+    void PrintStats(const char* Name) const;
+
+    // Records frames into RecordingCommandBackend on 1 and 4 threads and checks that every submission holds each
+    // pass's commands and draw arguments in pass order, that parallel passes see what the serial pass wrote, and
+    // that a throwing pass submits nothing. No GPU needed.
+    static bool SelfTest();
+
+    // Records frames of passes with synthetic CPU cost on pools of 1 to MaxThreads threads and reports frame
+    // recording time and speedup per thread count.
+    static void Benchmark(int MaxThreads, int Passes, int DrawsPerPass, int Frames);
+
+private:
+    struct Pass
+    {
+        std::string Name;
+        PassFunction Record;
+        PassRecording Recording;
+        std::unique_ptr<CommandContext> Context;
+    };
+
+    void RecordPass(Pass& Target, uint32_t FrameIndex);
+
+    CommandBackend& m_Backend;
+    ThreadPool& m_Pool;
+    std::vector<Pass> m_Passes;
+    std::vector<size_t> m_ParallelPasses;
+    std::vector<CommandContext*> m_Submission;
+    PassRecorderStats m_Stats;
+};
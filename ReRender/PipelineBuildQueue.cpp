@@ -0,0 +1,349 @@
+#include "PipelineBuildQueue.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+PipelineBuildQueue::PipelineBuildQueue(ThreadPool& Pool, size_t Capacity)
+    :m_Pool(Pool)
+    ,m_Capacity(Capacity)
+    ,m_Jobs(std::make_unique<std::shared_ptr<Job>[]>(Capacity))
+{}
+
+PipelineBuildQueue::~PipelineBuildQueue()
+{
+    //Builds capture their owner, none may run after this
+    for (size_t Handle = 0; Handle < Size(); ++Handle)
+    {
+        WaitFor(*m_Jobs[Handle], false);
+    }
+}
+
+PipelineHandle PipelineBuildQueue::Add(std::string Name, BuildFunction Build)
+{
+    std::shared_ptr<Job> NewJob = std::make_shared<Job>();
+    NewJob->Name = std::move(Name);
+    NewJob->Build = std::move(Build);
+
+    PipelineHandle Handle;
+    {
+        std::lock_guard<std::mutex> Lock{ m_AddMutex };
+        const size_t Count = m_Count.load(std::memory_order_relaxed);
+        if (Count == m_Capacity)
+        {
+            throw std::length_error("Pipeline build queue is full, " + NewJob->Name + " does not fit");
+        }
+        if (Count == 0)
+        {
+            m_FirstAdd = std::chrono::steady_clock::now();
+        }
+        Handle = static_cast<PipelineHandle>(Count);
+        NewJob->Handle = Handle;
+        m_Jobs[Count] = NewJob;
+        m_Count.store(Count + 1, std::memory_order_release);
+    }
+
+    //A pool without workers runs the build right here
+    m_Pool.Submit([NewJob]() { TryRun(*NewJob, false); });
+    return Handle;
+}
+
+bool PipelineBuildQueue::TryRun(Job& Target, bool bInline)
+{
+    JobState Expected = JobState::Queued;
+    if (!Target.State.compare_exchange_strong(Expected, JobState::Building, std::memory_order_acq_rel))
+    {
+        return false;
+    }
+
+    const auto Start = std::chrono::steady_clock::now();
+    JobState Result = JobState::Done;
+    try
+    {
+        Target.Build(Target.Handle);
+    }
+    catch (...)
+    {
+        Target.Error = std::current_exception();
+        Result = JobState::Failed;
+    }
+    Target.FinishTime = std::chrono::steady_clock::now();
+    Target.BuildMs = ElapsedMs(Start, Target.FinishTime);
+    Target.bBuiltInline = bInline;
+    Target.Build = nullptr;
+
+    {
+        std::lock_guard<std::mutex> Lock{ Target.Mutex };
+        Target.State.store(Result, std::memory_order_release);
+    }
+    Target.Done.notify_all();
+    return true;
+}
+
+void PipelineBuildQueue::WaitFor(Job& Target, bool bRethrow)
+{
+    JobState State = Target.State.load(std::memory_order_acquire);
+    if (State == JobState::Queued || State == JobState::Building)
+    {
+        const auto Start = std::chrono::steady_clock::now();
+        if (!TryRun(Target, true))
+        {
+            std::unique_lock<std::mutex> Lock{ Target.Mutex };
+            Target.Done.wait(Lock, [&Target]()
+            {
+                const JobState Current = Target.State.load(std::memory_order_acquire);
+                return Current == JobState::Done || Current == JobState::Failed;
+            });
+        }
+        const double StallMs = ElapsedMs(Start);
+
+        std::lock_guard<std::mutex> Lock{ m_StatsMutex };
+        ++m_Stalls;
+        m_StallMs += StallMs;
+        State = Target.State.load(std::memory_order_acquire);
+    }
+
+    if (bRethrow && State == JobState::Failed)
+    {
+        std::rethrow_exception(Target.Error);
+    }
+}
+
+PipelineBuildQueue::Job& PipelineBuildQueue::At(PipelineHandle Handle) const
+{
+    if (Handle >= Size())
+    {
+        throw std::invalid_argument("Unknown pipeline handle " + std::to_string(Handle));
+    }
+    return *m_Jobs[Handle];
+}
+
+void PipelineBuildQueue::Wait(PipelineHandle Handle)
+{
+    WaitFor(At(Handle), true);
+}
+
+void PipelineBuildQueue::WaitAll()
+{
+    for (size_t Handle = 0; Handle < Size(); ++Handle)
+    {
+        WaitFor(*m_Jobs[Handle], true);
+    }
+}
+
+bool PipelineBuildQueue::IsReady(PipelineHandle Handle) const
+{
+    return At(Handle).State.load(std::memory_order_acquire) == JobState::Done;
+}
+
+const std::string& PipelineBuildQueue::Name(PipelineHandle Handle) const
+{
+    return At(Handle).Name;
+}
+
+PipelineBuildStats PipelineBuildQueue::Stats() const
+{
+    PipelineBuildStats Result;
+    std::chrono::steady_clock::time_point LastFinish = m_FirstAdd;
+    for (size_t Handle = 0; Handle < Size(); ++Handle)
+    {
+        const Job& Target = *m_Jobs[Handle];
+        const JobState State = Target.State.load(std::memory_order_acquire);
+        if (State != JobState::Done && State != JobState::Failed)
+        {
+            continue;
+        }
+        ++(State == JobState::Done ? Result.Built : Result.Failed);
+        Result.BuiltInline += Target.bBuiltInline ? 1 : 0;
+        Result.BuildMs += Target.BuildMs;
+        LastFinish = std::max(LastFinish, Target.FinishTime);
+    }
+    Result.WallMs = Size() ? ElapsedMs(m_FirstAdd, LastFinish) : 0.0;
+
+    std::lock_guard<std::mutex> Lock{ m_StatsMutex };
+    Result.Stalls = m_Stalls;
+    Result.StallMs = m_StallMs;
+    return Result;
+}
+
+void PipelineBuildQueue::PrintStats(const char* Name) const
+{
+    const PipelineBuildStats Current = Stats();
+    std::printf("Pipeline builds: %s (%zu pool threads)\n", Name, size_t(m_Pool.NumThreads()));
+    std::printf("  Pipelines     : %zu built, %zu failed, %zu built by a waiting thread\n", Current.Built, Current.Failed, Current.BuiltInline);
+    std::printf("  Time          : %.1f ms of builds in %.1f ms wall (%.1fx), %zu waits stalled for %.1f ms\n",
+        Current.BuildMs, Current.WallMs, Current.WallMs > 0.0 ? Current.BuildMs / Current.WallMs : 0.0, Current.Stalls, Current.StallMs);
+}
+
+bool PipelineBuildQueue::SelfTest()
+{
+    TestHarness Harness;
+    const auto Spin = [](double Milliseconds)
+    {
+        const auto Start = std::chrono::steady_clock::now();
+        while (ElapsedMs(Start) < Milliseconds)
+        {
+        }
+    };
+    //Occupies every worker of Pool until Release is ready
+    const auto BlockPool = [](ThreadPool& Pool, std::shared_future<void> Release)
+    {
+        for (unsigned int Worker = 0; Worker < Pool.NumThreads(); ++Worker)
+        {
+            Pool.Submit([Release]() { Release.wait(); });
+        }
+    };
+
+    std::printf("Pipeline build queue self test\n");
+
+    Harness.Run("Exactly once under concurrent waits", [&]()
+    {
+        ThreadPool Pool{ 4 };
+        PipelineBuildQueue Queue{ Pool, 64 };
+        std::vector<std::atomic<int>> Builds(64);
+        for (size_t i = 0; i < Builds.size(); ++i)
+        {
+            Queue.Add("Job" + std::to_string(i), [&Builds, &Spin, i](PipelineHandle)
+            {
+                Spin(0.05 * double(i % 5));
+                ++Builds[i];
+            });
+        }
+
+        std::vector<std::thread> Waiters;
+        for (int Waiter = 0; Waiter < 4; ++Waiter)
+        {
+            Waiters.emplace_back([&Queue, Waiter]()
+            {
+                for (size_t i = 0; i < Queue.Size(); ++i)
+                {
+                    Queue.Wait(static_cast<PipelineHandle>(Waiter % 2 ? Queue.Size() - 1 - i : i));
+                }
+            });
+        }
+        for (std::thread& Waiter : Waiters)
+        {
+            Waiter.join();
+        }
+        Harness.Check(std::all_of(Builds.begin(), Builds.end(), [](const std::atomic<int>& Count) { return Count == 1; }), "every job ran exactly once");
+        bool bAllReady = true;
+        for (PipelineHandle Handle = 0; Handle < Queue.Size(); ++Handle)
+        {
+            bAllReady &= Queue.IsReady(Handle);
+        }
+        Harness.Check(bAllReady, "every job is ready after its waits");
+        Harness.Check(Queue.Stats().Built == 64, "stats count every build");
+    });
+
+    Harness.Run("Waits build when the pool is busy", [&]()
+    {
+        ThreadPool Pool{ 2 };
+        std::promise<void> Release;
+        BlockPool(Pool, Release.get_future().share());
+
+        PipelineBuildQueue Queue{ Pool, 4 };
+        int Built = 0;
+        const PipelineHandle First = Queue.Add("First", [&Built](PipelineHandle) { ++Built; });
+        const PipelineHandle Second = Queue.Add("Second", [&Built](PipelineHandle) { ++Built; });
+        Harness.Check(!Queue.IsReady(First) && !Queue.IsReady(Second), "nothing runs while the pool is blocked");
+        Queue.Wait(Second);
+        Harness.Check(Queue.IsReady(Second) && !Queue.IsReady(First), "Wait builds only the job it waits for");
+        Harness.Check(Queue.Stats().BuiltInline == 1, "the inline build is counted");
+        Release.set_value();
+        Queue.WaitAll();
+        Harness.Check(Built == 2, "the rest builds once the pool is free");
+    });
+
+    Harness.Run("Errors reach every waiter", [&]()
+    {
+        ThreadPool Pool{ 2 };
+        PipelineBuildQueue Queue{ Pool, 4 };
+        const PipelineHandle Broken = Queue.Add("Broken", [](PipelineHandle) { throw std::runtime_error("compile error"); });
+        const PipelineHandle Fine = Queue.Add("Fine", [](PipelineHandle) {});
+        int Thrown = 0;
+        for (int Attempt = 0; Attempt < 2; ++Attempt)
+        {
+            try
+            {
+                Queue.Wait(Broken);
+            }
+            catch (const std::runtime_error& Error)
+            {
+                Thrown += std::string(Error.what()) == "compile error" ? 1 : 0;
+            }
+        }
+        Harness.Check(Thrown == 2, "every Wait on a failed job rethrows its error");
+        Queue.Wait(Fine);
+        Harness.Check(Queue.IsReady(Fine) && !Queue.IsReady(Broken), "other jobs are unaffected");
+        Harness.Check(Queue.Stats().Failed == 1, "the failure is counted");
+
+        bool bInvalid = false;
+        try
+        {
+            Queue.Wait(42);
+        }
+        catch (const std::invalid_argument&)
+        {
+            bInvalid = true;
+        }
+        Harness.Check(bInvalid, "an unknown handle throws");
+
+        bool bFull = false;
+        Queue.Add("Third", [](PipelineHandle) {});
+        Queue.Add("Fourth", [](PipelineHandle) {});
+        try
+        {
+            Queue.Add("Fifth", [](PipelineHandle) {});
+        }
+        catch (const std::length_error&)
+        {
+            bFull = true;
+        }
+        Harness.Check(bFull, "adding past the capacity throws");
+    });
+
+    Harness.Run("Teardown with queued jobs", [&]()
+    {
+        ThreadPool Pool{ 1 };
+        std::promise<void> Release;
+        BlockPool(Pool, Release.get_future().share());
+        std::vector<int> Builds(8, 0);
+        {
+            PipelineBuildQueue Queue{ Pool, Builds.size() };
+            for (size_t i = 0; i < Builds.size(); ++i)
+            {
+                Queue.Add("Queued", [&Builds, i](PipelineHandle) { ++Builds[i]; });
+            }
+        }
+        Harness.Check(std::all_of(Builds.begin(), Builds.end(), [](int Count) { return Count == 1; }), "the destructor builds what the pool has not started");
+        //The stale pool tasks run after the queue is gone and must find their jobs done
+        Release.set_value();
+    });
+
+    const int NumJobs = 24;
+    const double JobMs = 4.0;
+    double SerialMs = 0.0;
+    double ParallelMs = 0.0;
+    for (ThreadPool* Pool : { static_cast<ThreadPool*>(nullptr), &ThreadPool::Get() })
+    {
+        ThreadPool Serial{ 0 };
+        const auto Start = std::chrono::steady_clock::now();
+        PipelineBuildQueue Queue{ Pool ? *Pool : Serial, NumJobs };
+        for (int i = 0; i < NumJobs; ++i)
+        {
+            Queue.Add("Synthetic", [&Spin, JobMs](PipelineHandle) { Spin(JobMs); });
+        }
+        Queue.WaitAll();
+        (Pool ? ParallelMs : SerialMs) = ElapsedMs(Start);
+    }
+    std::printf("  Builds        : %d x %.1f ms, %.1f ms serial, %.1f ms on %u pool threads plus the caller (%.1fx)\n",
+        NumJobs, JobMs, SerialMs, ParallelMs, ThreadPool::Get().NumThreads(), SerialMs / std::max(ParallelMs, 1e-3));
+
+    return Harness.Finish();
+}
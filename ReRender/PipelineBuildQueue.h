@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class ThreadPool;
+
+using PipelineHandle = uint32_t;
+static constexpr PipelineHandle InvalidPipeline = ~0u;
+
+struct PipelineBuildStats
+{
+    size_t Built = 0;
+    size_t Failed = 0;
+    size_t BuiltInline = 0;
+    size_t Stalls = 0;
+    double BuildMs = 0.0;
+    double StallMs = 0.0;
+    double WallMs = 0.0;
+};
+
+// Runs build jobs, e.g. shader compiles plus PSO creation, on a ThreadPool as soon as they are added. Wait blocks
+// until a job is done. A job no worker has started yet runs on the waiting thread instead, so waiting never
+// depends on a busy pool. A job runs exactly once. Its exception is kept and rethrown by every Wait on it.
+// Adds take a lock, and Wait and IsReady from any thread are lock free once the job is done.
+class PipelineBuildQueue
+{
+public:
+    // Gets the handle Add returns, builds may start before Add is back.
+    using BuildFunction = std::function<void(PipelineHandle)>;
+
+    PipelineBuildQueue(ThreadPool& Pool, size_t Capacity);
+
+    // Waits for every job, queued ones run here.
+    ~PipelineBuildQueue();
+
+    PipelineBuildQueue(const PipelineBuildQueue&) = delete;
+    PipelineBuildQueue& operator=(const PipelineBuildQueue&) = delete;
+
+    // Throws std::length_error past Capacity.
+    PipelineHandle Add(std::string Name, BuildFunction Build);
+
+    // Throws std::invalid_argument for an unknown handle and rethrows the build's exception.
+    void Wait(PipelineHandle Handle);
+    void WaitAll();
+
+    bool IsReady(PipelineHandle Handle) const;
+    size_t Size() const { return m_Count.load(std::memory_order_acquire); }
+    const std::string& Name(PipelineHandle Handle) const;
+
+    PipelineBuildStats Stats() const;
+    void PrintStats(const char* Name) const;
+
+    // Checks exactly-once builds under concurrent waits, inline builds while the pool is blocked, error
+    // propagation and teardown with queued jobs, then times synthetic builds serially and on the pool. No GPU needed.
+    static bool SelfTest();
+
+private:
+    enum class JobState : uint32_t
+    {
+        Queued,
+        Building,
+        Done,
+        Failed,
+    };
+
+    // Shared with the pool task, which may still sit in the pool's queue after the job ran elsewhere.
+    struct Job
+    {
+        std::string Name;
+        PipelineHandle Handle = InvalidPipeline;
+        BuildFunction Build;
+        std::atomic<JobState> State{ JobState::Queued };
+        std::exception_ptr Error;
+        std::mutex Mutex;
+        std::condition_variable Done;
+        double BuildMs = 0.0;
+        std::chrono::steady_clock::time_point FinishTime;
+        bool bBuiltInline = false;
+    };
+
+    static bool TryRun(Job& Target, bool bInline);
+    void WaitFor(Job& Target, bool bRethrow);
+    Job& At(PipelineHandle Handle) const;
+
+    ThreadPool& m_Pool;
+    const size_t m_Capacity;
+
+    // Fixed size so readers index it without a lock while Add appends.
+    std::unique_ptr<std::shared_ptr<Job>[]> m_Jobs;
+    std::atomic<size_t> m_Count{ 0 };
+    std::mutex m_AddMutex;
+
+    // Stalls only, Stats() sums up the finished jobs.
+    mutable std::mutex m_StatsMutex;
+    size_t m_Stalls = 0;
+    double m_StallMs = 0.0;
+    std::chrono::steady_clock::time_point m_FirstAdd;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <string>
+
+// Helpers shared by the sources that build without D3D12, Utils.h pulls in the SDK headers.
+
+// Rounds Value up to a power of two Alignment.
+inline uint64_t AlignUp(uint64_t Value, uint64_t Alignment)
+{
+    assert(Alignment > 0 && (Alignment & (Alignment - 1)) == 0);
+    return (Value + Alignment - 1) & ~(Alignment - 1);
+}
+
+// Milliseconds between two points of the same clock, End defaults to now.
+template<typename TimePoint>
+double ElapsedMs(TimePoint Start, TimePoint End = TimePoint::clock::now())
+{
+    return std::chrono::duration<double, std::milli>(End - Start).count();
+}
+
+// Fixture behind the SelfTest functions: Run prints one line per named case, Check counts what failed in it.
+class TestHarness
+{
+public:
+    void Check(bool bCondition, const char* What)
+    {
+        if (!bCondition)
+        {
+            std::printf("    FAILED: %s\n", What);
+            ++m_Failures;
+        }
+    }
+
+    // A case that throws counts as one failure, the remaining cases still run.
+    void Run(const char* Name, const std::function<void()>& Body)
+    {
+        const int Before = m_Failures;
+        try
+        {
+            Body();
+        }
+        catch (const std::exception& Error)
+        {
+            std::printf("    FAILED: threw %s\n", Error.what());
+            ++m_Failures;
+        }
+        std::printf("  %-32s: %s\n", Name, m_Failures == Before ? "ok" : "FAILED");
+    }
+
+    bool Passed() const { return m_Failures == 0; }
+
+    // Prints the summary line, the result is what SelfTest returns.
+    bool Finish() const
+    {
+        std::printf("  Result        : %s\n", Passed() ? "all checks passed" : (std::to_string(m_Failures) + " checks FAILED").c_str());
+        return Passed();
+    }
+
+private:
+    int m_Failures = 0;
+};
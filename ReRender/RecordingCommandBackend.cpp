@@ -0,0 +1,148 @@
+#include "RecordingCommandBackend.h"
+
+#include <stdexcept>
+
+void RecordingCommandContext::Begin(uint32_t FrameIndex)
+{
+    if (m_bRecording)
+    {
+        throw std::logic_error("Command context begun twice");
+    }
+    m_bRecording = true;
+    m_FrameIndex = FrameIndex;
+    m_EventDepth = 0;
+    m_Commands.clear();
+}
+
+void RecordingCommandContext::End()
+{
+    CheckRecording();
+    if (m_EventDepth != 0)
+    {
+        throw std::logic_error("Command context ended inside an event");
+    }
+    m_bRecording = false;
+}
+
+void RecordingCommandContext::BeginEvent(const char* Name)
+{
+    CheckRecording();
+    ++m_EventDepth;
+    m_Commands.push_back({ RecordedCommand::Type::BeginEvent, m_Id, Name, 0 });
+}
+
+void RecordingCommandContext::EndEvent()
+{
+    CheckRecording();
+    if (m_EventDepth == 0)
+    {
+        throw std::logic_error("EndEvent without BeginEvent");
+    }
+    --m_EventDepth;
+    m_Commands.push_back({ RecordedCommand::Type::EndEvent, m_Id, nullptr, 0 });
+}
+
+void RecordingCommandContext::Draw(uint32_t VertexCount, uint32_t InstanceCount)
+{
+    CheckRecording();
+    if (VertexCount == 0 || InstanceCount == 0)
+    {
+        throw std::logic_error("Empty draw recorded");
+    }
+    m_Commands.push_back({ RecordedCommand::Type::Draw, m_Id, nullptr, uint64_t(VertexCount) * InstanceCount });
+}
+
+void RecordingCommandContext::DrawIndexed(uint32_t IndexCount, uint32_t InstanceCount, uint32_t FirstIndex, int32_t BaseVertex)
+{
+    CheckRecording();
+    if (IndexCount == 0 || InstanceCount == 0)
+    {
+        throw std::logic_error("Empty indexed draw recorded");
+    }
+    if (uint64_t(FirstIndex) + IndexCount > UINT32_MAX)
+    {
+        throw std::logic_error("Indexed draw range overflows the index buffer");
+    }
+    m_Commands.push_back({ RecordedCommand::Type::Draw, m_Id, nullptr, uint64_t(IndexCount) * InstanceCount, FirstIndex, BaseVertex });
+}
+
+void RecordingCommandContext::Record(uint64_t Value)
+{
+    CheckRecording();
+    m_Commands.push_back({ RecordedCommand::Type::Command, m_Id, nullptr, Value });
+}
+
+void RecordingCommandContext::RecordBarriers(uint32_t Count)
+{
+    CheckRecording();
+    if (Count == 0)
+    {
+        throw std::logic_error("ResourceBarrier recorded without barriers");
+    }
+    m_Commands.push_back({ RecordedCommand::Type::Barriers, m_Id, nullptr, Count });
+}
+
+void RecordingCommandContext::RecordDiscard()
+{
+    CheckRecording();
+    m_Commands.push_back({ RecordedCommand::Type::Discard, m_Id, nullptr, 0 });
+}
+
+void RecordingCommandContext::CheckRecording() const
+{
+    if (!m_bRecording)
+    {
+        throw std::logic_error("Command recorded outside Begin/End");
+    }
+}
+
+std::unique_ptr<CommandContext> RecordingCommandBackend::CreateContext()
+{
+    return std::make_unique<RecordingCommandContext>(m_NumContexts++);
+}
+
+void RecordingCommandBackend::Execute(CommandContext* const* Contexts, size_t Count)
+{
+    for (size_t i = 0; i < Count; ++i)
+    {
+        const RecordingCommandContext& Context = static_cast<const RecordingCommandContext&>(*Contexts[i]);
+        if (Context.IsRecording())
+        {
+            throw std::logic_error("Submitted a command context that is still recording");
+        }
+        if (Context.FrameIndex() != static_cast<const RecordingCommandContext&>(*Contexts[0]).FrameIndex())
+        {
+            throw std::logic_error("Submitted command contexts begun for different frames");
+        }
+    }
+
+    for (size_t i = 0; i < Count; ++i)
+    {
+        const RecordingCommandContext& Context = static_cast<const RecordingCommandContext&>(*Contexts[i]);
+        for (const RecordedCommand& Command : Context.Commands())
+        {
+            switch (Command.CommandType)
+            {
+            case RecordedCommand::Type::BeginEvent:
+                ++m_Stats.Events;
+                break;
+            case RecordedCommand::Type::Draw:
+                ++m_Stats.Draws;
+                m_Stats.DrawnVertices += Command.Value;
+                break;
+            case RecordedCommand::Type::Barriers:
+                ++m_Stats.BarrierBatches;
+                m_Stats.Barriers += Command.Value;
+                break;
+            case RecordedCommand::Type::Discard:
+                ++m_Stats.Discards;
+                break;
+            default:
+                break;
+            }
+        }
+        m_Timeline.insert(m_Timeline.end(), Context.Commands().begin(), Context.Commands().end());
+    }
+    m_Stats.Contexts += Count;
+    ++m_Stats.Submissions;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CommandContext.h"
+
+struct RecordedCommand
+{
+    enum class Type
+    {
+        BeginEvent,
+        EndEvent,
+        Command,
+        Draw,       //Value is the vertex or index count times the instances
+        Barriers,   //Value is the number of barriers recorded in one call
+        Discard,
+    };
+
+    Type CommandType;
+    uint32_t Context;
+    // Event name for BeginEvent, must outlive the backend's timeline.
+    const char* Name = nullptr;
+    uint64_t Value = 0;
+    // Only set for indexed draws.
+    uint32_t FirstIndex = 0;
+    int32_t BaseVertex = 0;
+};
+
+// Summed over every submission, the timeline can be cleared in between.
+struct RecordedCommandStats
+{
+    size_t Submissions = 0;
+    size_t Contexts = 0;
+    size_t Events = 0;
+    size_t Draws = 0;
+    uint64_t DrawnVertices = 0;
+    size_t Barriers = 0;
+    size_t BarrierBatches = 0;
+    size_t Discards = 0;
+};
+
+// Logs commands instead of sending them to a GPU. Begin/End, event nesting and empty draws or barrier calls are
+// validated and misuse throws.
+class RecordingCommandContext : public CommandContext
+{
+public:
+    explicit RecordingCommandContext(uint32_t InId) :m_Id(InId) {}
+
+    void Begin(uint32_t FrameIndex) override;
+    void End() override;
+    void BeginEvent(const char* Name) override;
+    void EndEvent() override;
+    void Draw(uint32_t VertexCount, uint32_t InstanceCount) override;
+    void DrawIndexed(uint32_t IndexCount, uint32_t InstanceCount, uint32_t FirstIndex, int32_t BaseVertex) override;
+
+    // Stand-in for any other command, Value identifies it in the timeline.
+    void Record(uint64_t Value);
+
+    // One ResourceBarrier call with Count barriers, and a DiscardResource. Recorded by the renderer's barrier
+    // emitter, the way D3D12RenderGraph records the real ones.
+    void RecordBarriers(uint32_t Count);
+    void RecordDiscard();
+
+    uint32_t Id() const { return m_Id; }
+    uint32_t FrameIndex() const { return m_FrameIndex; }
+    bool IsRecording() const { return m_bRecording; }
+    const std::vector<RecordedCommand>& Commands() const { return m_Commands; }
+
+private:
+    void CheckRecording() const;
+
+    uint32_t m_Id;
+    uint32_t m_FrameIndex = 0;
+    bool m_bRecording = false;
+    int m_EventDepth = 0;
+    std::vector<RecordedCommand> m_Commands;
+};
+
+// Appends every submitted context's commands to one timeline, in submission order, and counts them.
+class RecordingCommandBackend : public CommandBackend
+{
+public:
+    std::unique_ptr<CommandContext> CreateContext() override;
+
+    // Throws if a context is still recording or the contexts were begun for different frames.
+    void Execute(CommandContext* const* Contexts, size_t Count) override;
+
+    const std::vector<RecordedCommand>& Timeline() const { return m_Timeline; }
+    size_t NumSubmissions() const { return m_Stats.Submissions; }
+    void ClearTimeline() { m_Timeline.clear(); }
+
+    const RecordedCommandStats& Stats() const { return m_Stats; }
+
+private:
+    uint32_t m_NumContexts = 0;
+    std::vector<RecordedCommand> m_Timeline;
+    RecordedCommandStats m_Stats;
+};
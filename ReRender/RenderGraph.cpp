@@ -0,0 +1,880 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+#include "PortableUtils.h"
+
+namespace
+{
+    bool IsSingleState(ResourceState State)
+    {
+        const uint32_t Bits = uint32_t(State);
+        return Bits != 0 && (Bits & (Bits - 1)) == 0;
+    }
+
+    const char* const StateNames[] =
+    {
+        "VertexAndConstantBuffer", "IndexBuffer", "RenderTarget", "UnorderedAccess", "DepthWrite", "DepthRead",
+        "NonPixelShaderResource", "PixelShaderResource", "IndirectArgument", "CopyDest", "CopySource",
+        "ResolveDest", "ResolveSource", "Present",
+    };
+
+    double Megabytes(uint64_t Bytes)
+    {
+        return double(Bytes) / (1024.0 * 1024.0);
+    }
+}
+
+std::string ResourceStateString(ResourceState State)
+{
+    if (State == ResourceState::Common)
+    {
+        return "Common";
+    }
+    if (State == ResourceState::GenericRead)
+    {
+        return "GenericRead";
+    }
+    std::string Name;
+    for (uint32_t Bit = 0; Bit < sizeof(StateNames) / sizeof(StateNames[0]); ++Bit)
+    {
+        if (uint32_t(State) & (1u << Bit))
+        {
+            Name += Name.empty() ? "" : "|";
+            Name += StateNames[Bit];
+        }
+    }
+    return Name;
+}
+
+RenderGraphPassBuilder& RenderGraphPassBuilder::Read(RenderGraphResource Resource, ResourceState State)
+{
+    if (!IsReadOnly(State) && State != ResourceState::UnorderedAccess)
+    {
+        throw std::invalid_argument("Render graph pass reads a resource in a state that is not read-only: " + ResourceStateString(State));
+    }
+    m_Graph.AddUse(m_Pass, Resource, State, false);
+    return *this;
+}
+
+RenderGraphPassBuilder& RenderGraphPassBuilder::Write(RenderGraphResource Resource, ResourceState State)
+{
+    if (!IsSingleState(State) || IsReadOnly(State))
+    {
+        throw std::invalid_argument("Render graph pass writes a resource in a state that is not a single writable one: " + ResourceStateString(State));
+    }
+    m_Graph.AddUse(m_Pass, Resource, State, true);
+    return *this;
+}
+
+RenderGraphPassBuilder& RenderGraphPassBuilder::KeepAlive()
+{
+    m_Graph.m_Passes[m_Pass].bKeepAlive = true;
+    return *this;
+}
+
+RenderGraphResource RenderGraph::Import(std::string Name, ResourceState InitialState, ResourceState FinalState)
+{
+    ResourceInfo Info;
+    Info.Name = std::move(Name);
+    Info.bImported = true;
+    Info.InitialState = InitialState;
+    Info.FinalState = FinalState;
+    m_Resources.push_back(std::move(Info));
+    return RenderGraphResource(m_Resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::CreateTransient(std::string Name, uint64_t Size, uint64_t Alignment, ResourceState DiscardState)
+{
+    if (Size == 0 || Alignment == 0 || (Alignment & (Alignment - 1)) != 0)
+    {
+        throw std::invalid_argument("Transient " + Name + " needs a size and a power of two alignment");
+    }
+    if (DiscardState != ResourceState::Common && DiscardState != ResourceState::RenderTarget && DiscardState != ResourceState::DepthWrite)
+    {
+        throw std::invalid_argument("Transient " + Name + " can only be discarded as a render target or depth buffer");
+    }
+    ResourceInfo Info;
+    Info.Name = std::move(Name);
+    Info.Size = Size;
+    Info.Alignment = Alignment;
+    Info.DiscardState = DiscardState;
+    m_Resources.push_back(std::move(Info));
+    return RenderGraphResource(m_Resources.size() - 1);
+}
+
+RenderGraphPassBuilder RenderGraph::AddPass(std::string Name, PassFunction Record, PassRecording Recording)
+{
+    PassInfo Info;
+    Info.Name = std::move(Name);
+    Info.Record = std::move(Record);
+    Info.Recording = Recording;
+    m_Passes.push_back(std::move(Info));
+    return RenderGraphPassBuilder{ *this, uint32_t(m_Passes.size() - 1) };
+}
+
+void RenderGraph::AddUse(uint32_t Pass, RenderGraphResource Resource, ResourceState State, bool bWrite)
+{
+    PassInfo& Info = m_Passes[Pass];
+    if (Resource >= m_Resources.size())
+    {
+        throw std::invalid_argument("Render graph pass " + Info.Name + " uses an unknown resource");
+    }
+
+    for (PassUse& Use : Info.Uses)
+    {
+        if (Use.Resource != Resource)
+        {
+            continue;
+        }
+        //Reads of one pass combine, anything else has to agree on the state
+        if (!bWrite && !Use.bWrite && IsReadOnly(State) && IsReadOnly(Use.State))
+        {
+            Use.State = Use.State | State;
+        }
+        else if (Use.State == State)
+        {
+            Use.bWrite = Use.bWrite || bWrite;
+        }
+        else
+        {
+            throw std::invalid_argument("Render graph pass " + Info.Name + " uses " + m_Resources[Resource].Name + " in two states");
+        }
+        return;
+    }
+    Info.Uses.push_back({ Resource, State, bWrite });
+}
+
+std::vector<bool> RenderGraph::Cull() const
+{
+    //Walk backwards: a pass survives if it writes something a surviving later pass reads or that outlives the
+    //graph, since writes keep previous contents the writers before it survive as well
+    std::vector<bool> Needed(m_Resources.size());
+    for (size_t Resource = 0; Resource < m_Resources.size(); ++Resource)
+    {
+        Needed[Resource] = m_Resources[Resource].bImported;
+    }
+
+    std::vector<bool> Alive(m_Passes.size());
+    for (size_t Pass = m_Passes.size(); Pass-- > 0;)
+    {
+        const PassInfo& Info = m_Passes[Pass];
+        bool bAlive = Info.bKeepAlive;
+        for (const PassUse& Use : Info.Uses)
+        {
+            bAlive = bAlive || (Use.bWrite && Needed[Use.Resource]);
+        }
+        if (!bAlive)
+        {
+            continue;
+        }
+        Alive[Pass] = true;
+        for (const PassUse& Use : Info.Uses)
+        {
+            Needed[Use.Resource] = Needed[Use.Resource] || !Use.bWrite;
+        }
+    }
+    return Alive;
+}
+
+const CompiledRenderGraph& RenderGraph::Compile(const RenderGraphCompileOptions& Options)
+{
+    m_Compiled = CompiledRenderGraph{};
+
+    const std::vector<bool> Alive = Cull();
+    std::vector<std::vector<ResourceUse>> Uses(m_Resources.size());
+    for (uint32_t Pass = 0; Pass < m_Passes.size(); ++Pass)
+    {
+        if (!Alive[Pass])
+        {
+            m_Compiled.CulledPasses.push_back(Pass);
+            continue;
+        }
+        const uint32_t CompiledIndex = uint32_t(m_Compiled.Passes.size());
+        m_Compiled.Passes.push_back({ Pass, {}, {} });
+        for (const PassUse& Use : m_Passes[Pass].Uses)
+        {
+            Uses[Use.Resource].push_back({ CompiledIndex, Use.State, Use.bWrite });
+        }
+    }
+
+    for (RenderGraphResource Resource = 0; Resource < m_Resources.size(); ++Resource)
+    {
+        if (!m_Resources[Resource].bImported && !Uses[Resource].empty() && !Uses[Resource].front().bWrite)
+        {
+            const uint32_t Pass = m_Compiled.Passes[Uses[Resource].front().Pass].Pass;
+            throw std::logic_error("Render graph pass " + m_Passes[Pass].Name + " reads transient " + m_Resources[Resource].Name + " before any pass writes it");
+        }
+    }
+
+    PlaceTransients(Uses);
+    ComputeBarriers(Uses, Options);
+    CountBarriers();
+    return m_Compiled;
+}
+
+void RenderGraph::PlaceTransients(const std::vector<std::vector<ResourceUse>>& Uses)
+{
+    std::vector<TransientPlacement>& Placements = m_Compiled.Placements;
+    Placements.assign(m_Resources.size(), {});
+
+    std::vector<RenderGraphResource> Order;
+    for (RenderGraphResource Resource = 0; Resource < m_Resources.size(); ++Resource)
+    {
+        const ResourceInfo& Info = m_Resources[Resource];
+        if (Info.bImported || Uses[Resource].empty())
+        {
+            continue;
+        }
+        TransientPlacement& Placement = Placements[Resource];
+        Placement.Size = Info.Size;
+        Placement.FirstPass = Uses[Resource].front().Pass;
+        Placement.LastPass = Uses[Resource].back().Pass;
+        Placement.FrameStartState = Uses[Resource].front().State;
+        m_Compiled.UnaliasedSize = AlignUp(m_Compiled.UnaliasedSize, Info.Alignment) + Info.Size;
+        m_Compiled.HeapAlignment = std::max(m_Compiled.HeapAlignment, Info.Alignment);
+        Order.push_back(Resource);
+    }
+
+    //Largest first, each at the lowest offset clear of every placed resource alive at the same time
+    std::sort(Order.begin(), Order.end(), [&Placements](RenderGraphResource A, RenderGraphResource B)
+    {
+        if (Placements[A].Size != Placements[B].Size)
+        {
+            return Placements[A].Size > Placements[B].Size;
+        }
+        return Placements[A].FirstPass != Placements[B].FirstPass ? Placements[A].FirstPass < Placements[B].FirstPass : A < B;
+    });
+
+    std::vector<RenderGraphResource> Placed;
+    std::vector<std::pair<uint64_t, uint64_t>> Occupied;
+    for (const RenderGraphResource Resource : Order)
+    {
+        TransientPlacement& Placement = Placements[Resource];
+        Occupied.clear();
+        for (const RenderGraphResource Other : Placed)
+        {
+            const TransientPlacement& OtherPlacement = Placements[Other];
+            if (OtherPlacement.FirstPass <= Placement.LastPass && Placement.FirstPass <= OtherPlacement.LastPass)
+            {
+                Occupied.emplace_back(OtherPlacement.Offset, OtherPlacement.Offset + OtherPlacement.Size);
+            }
+        }
+        std::sort(Occupied.begin(), Occupied.end());
+
+        const uint64_t Alignment = m_Resources[Resource].Alignment;
+        uint64_t Offset = 0;
+        for (const auto& Range : Occupied)
+        {
+            if (Offset + Placement.Size <= Range.first)
+            {
+                break;
+            }
+            Offset = std::max(Offset, AlignUp(Range.second, Alignment));
+        }
+        Placement.Offset = Offset;
+        m_Compiled.HeapSize = std::max(m_Compiled.HeapSize, Offset + Placement.Size);
+        Placed.push_back(Resource);
+    }
+
+    for (size_t i = 0; i < Placed.size(); ++i)
+    {
+        for (size_t j = i + 1; j < Placed.size(); ++j)
+        {
+            TransientPlacement& A = Placements[Placed[i]];
+            TransientPlacement& B = Placements[Placed[j]];
+            if (A.Offset < B.Offset + B.Size && B.Offset < A.Offset + A.Size)
+            {
+                A.bAliased = true;
+                B.bAliased = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::ComputeBarriers(const std::vector<std::vector<ResourceUse>>& Uses, const RenderGraphCompileOptions& Options)
+{
+    std::vector<CompiledRenderPass>& Passes = m_Compiled.Passes;
+    const std::vector<TransientPlacement>& Placements = m_Compiled.Placements;
+    if (Passes.empty())
+    {
+        return;
+    }
+
+    //The aliasing barrier names the resource that used the memory last if there is exactly one, at the first
+    //use of a frame that is one of those placed later in the previous frame
+    const auto AliasedBefore = [&Placements](RenderGraphResource Resource)
+    {
+        const TransientPlacement& Placement = Placements[Resource];
+        RenderGraphResource Before = InvalidRenderGraphResource;
+        size_t NumEarlier = 0;
+        size_t NumOverlapping = 0;
+        RenderGraphResource Earlier = InvalidRenderGraphResource;
+        for (RenderGraphResource Other = 0; Other < Placements.size(); ++Other)
+        {
+            const TransientPlacement& OtherPlacement = Placements[Other];
+            if (Other == Resource || OtherPlacement.Offset == TransientPlacement::Unplaced ||
+                OtherPlacement.Offset >= Placement.Offset + Placement.Size || Placement.Offset >= OtherPlacement.Offset + OtherPlacement.Size)
+            {
+                continue;
+            }
+            ++NumOverlapping;
+            Before = Other;
+            if (OtherPlacement.LastPass < Placement.FirstPass)
+            {
+                ++NumEarlier;
+                Earlier = Other;
+            }
+        }
+        if (NumEarlier > 0)
+        {
+            return NumEarlier == 1 ? Earlier : InvalidRenderGraphResource;
+        }
+        return NumOverlapping == 1 ? Before : InvalidRenderGraphResource;
+    };
+
+    std::vector<ResourceState> States(m_Resources.size());
+    for (RenderGraphResource Resource = 0; Resource < m_Resources.size(); ++Resource)
+    {
+        States[Resource] = m_Resources[Resource].bImported ? m_Resources[Resource].InitialState : Placements[Resource].FrameStartState;
+    }
+
+    std::vector<size_t> NextUse(m_Resources.size());
+    std::vector<RenderGraphBarrier> Activations;
+    std::vector<RenderGraphBarrier> Discards;
+    std::vector<RenderGraphBarrier> Transitions;
+    for (uint32_t PassIndex = 0; PassIndex < Passes.size(); ++PassIndex)
+    {
+        Activations.clear();
+        Discards.clear();
+        Transitions.clear();
+        for (const PassUse& PassResource : m_Passes[Passes[PassIndex].Pass].Uses)
+        {
+            const RenderGraphResource Resource = PassResource.Resource;
+            const std::vector<ResourceUse>& ResourceUses = Uses[Resource];
+            const size_t UseIndex = NextUse[Resource]++;
+            const ResourceUse& Use = ResourceUses[UseIndex];
+            ResourceState& State = States[Resource];
+
+            if (UseIndex == 0 && !m_Resources[Resource].bImported)
+            {
+                if (Placements[Resource].bAliased)
+                {
+                    RenderGraphBarrier Aliasing;
+                    Aliasing.BarrierType = RenderGraphBarrier::Type::Aliasing;
+                    Aliasing.Resource = Resource;
+                    Aliasing.Before = AliasedBefore(Resource);
+                    Activations.push_back(Aliasing);
+                }
+                const ResourceState DiscardState = m_Resources[Resource].DiscardState;
+                if (DiscardState != ResourceState::Common)
+                {
+                    if (State != DiscardState)
+                    {
+                        Activations.push_back({ RenderGraphBarrier::Type::Transition, Resource, InvalidRenderGraphResource, State, DiscardState });
+                        Transitions.push_back({ RenderGraphBarrier::Type::Transition, Resource, InvalidRenderGraphResource, DiscardState, State });
+                    }
+                    Discards.push_back({ RenderGraphBarrier::Type::Discard, Resource });
+                }
+            }
+
+            //Consecutive reads move to the union of their states once
+            ResourceState Target = Use.State;
+            if (!Use.bWrite && IsReadOnly(Use.State))
+            {
+                if (IsReadOnly(State) && Contains(State, Use.State))
+                {
+                    Target = State;
+                }
+                else
+                {
+                    for (size_t Next = UseIndex + 1; Next < ResourceUses.size() && !ResourceUses[Next].bWrite && IsReadOnly(ResourceUses[Next].State); ++Next)
+                    {
+                        Target = Target | ResourceUses[Next].State;
+                    }
+                }
+            }
+
+            if (Target == State)
+            {
+                const ResourceUse* Previous = UseIndex > 0 ? &ResourceUses[UseIndex - 1] : nullptr;
+                if (Target == ResourceState::UnorderedAccess && Previous && Previous->State == ResourceState::UnorderedAccess && (Use.bWrite || Previous->bWrite))
+                {
+                    Transitions.push_back({ RenderGraphBarrier::Type::Uav, Resource });
+                }
+                continue;
+            }
+
+            RenderGraphBarrier Transition{ RenderGraphBarrier::Type::Transition, Resource, InvalidRenderGraphResource, State, Target };
+            if (Options.bSplitBarriers && UseIndex > 0 && ResourceUses[UseIndex - 1].Pass + 1 < PassIndex)
+            {
+                Transition.SplitType = RenderGraphBarrier::Split::Begin;
+                Passes[ResourceUses[UseIndex - 1].Pass].After.push_back(Transition);
+                Transition.SplitType = RenderGraphBarrier::Split::End;
+            }
+            Transitions.push_back(Transition);
+            State = Target;
+        }
+
+        std::vector<RenderGraphBarrier>& Before = Passes[PassIndex].Before;
+        Before.insert(Before.end(), Activations.begin(), Activations.end());
+        Before.insert(Before.end(), Discards.begin(), Discards.end());
+        Before.insert(Before.end(), Transitions.begin(), Transitions.end());
+    }
+
+    //Imported resources leave in their final state, transients in the one the next frame starts with
+    const uint32_t LastPass = uint32_t(Passes.size() - 1);
+    for (RenderGraphResource Resource = 0; Resource < m_Resources.size(); ++Resource)
+    {
+        const ResourceInfo& Info = m_Resources[Resource];
+        if (!Info.bImported && Uses[Resource].empty())
+        {
+            continue;
+        }
+        const ResourceState Target = Info.bImported ? Info.FinalState : Placements[Resource].FrameStartState;
+        if (States[Resource] == Target)
+        {
+            continue;
+        }
+        RenderGraphBarrier Transition{ RenderGraphBarrier::Type::Transition, Resource, InvalidRenderGraphResource, States[Resource], Target };
+        if (Options.bSplitBarriers && !Uses[Resource].empty() && Uses[Resource].back().Pass < LastPass)
+        {
+            Transition.SplitType = RenderGraphBarrier::Split::Begin;
+            Passes[Uses[Resource].back().Pass].After.push_back(Transition);
+            Transition.SplitType = RenderGraphBarrier::Split::End;
+        }
+        Passes[LastPass].After.push_back(Transition);
+    }
+}
+
+void RenderGraph::CountBarriers()
+{
+    for (const CompiledRenderPass& Pass : m_Compiled.Passes)
+    {
+        for (const std::vector<RenderGraphBarrier>* Barriers : { &Pass.Before, &Pass.After })
+        {
+            bool bInBatch = false;
+            for (const RenderGraphBarrier& Barrier : *Barriers)
+            {
+                if (Barrier.BarrierType == RenderGraphBarrier::Type::Discard)
+                {
+                    ++m_Compiled.NumDiscards;
+                    bInBatch = false;
+                    continue;
+                }
+                m_Compiled.NumBarrierBatches += bInBatch ? 0 : 1;
+                bInBatch = true;
+                switch (Barrier.BarrierType)
+                {
+                case RenderGraphBarrier::Type::Transition:
+                    m_Compiled.NumTransitions += Barrier.SplitType == RenderGraphBarrier::Split::None ? 1 : 0;
+                    m_Compiled.NumSplitTransitions += Barrier.SplitType == RenderGraphBarrier::Split::Begin ? 1 : 0;
+                    break;
+                case RenderGraphBarrier::Type::Aliasing:
+                    ++m_Compiled.NumAliasingBarriers;
+                    break;
+                default:
+                    ++m_Compiled.NumUavBarriers;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::Register(ParallelPassRecorder& Recorder, BarrierEmitter EmitBarriers) const
+{
+    for (const CompiledRenderPass& Compiled : m_Compiled.Passes)
+    {
+        const PassInfo& Pass = m_Passes[Compiled.Pass];
+        Recorder.AddPass(Pass.Name, [Before = Compiled.Before, After = Compiled.After, Record = Pass.Record, EmitBarriers](CommandContext& Context)
+        {
+            if (!Before.empty())
+            {
+                EmitBarriers(Context, Before);
+            }
+            if (Record)
+            {
+                Record(Context);
+            }
+            if (!After.empty())
+            {
+                EmitBarriers(Context, After);
+            }
+        }, Pass.Recording);
+    }
+}
+
+void RenderGraph::PrintReport(const char* Name) const
+{
+    const CompiledRenderGraph& Compiled = m_Compiled;
+    std::printf("Render graph: %s (%zu passes, %zu culled, %zu resources)\n", Name, Compiled.Passes.size(), Compiled.CulledPasses.size(), m_Resources.size());
+
+    const auto PrintBarriers = [this](const char* Where, const std::vector<RenderGraphBarrier>& Barriers)
+    {
+        for (const RenderGraphBarrier& Barrier : Barriers)
+        {
+            const std::string& Resource = m_Resources[Barrier.Resource].Name;
+            switch (Barrier.BarrierType)
+            {
+            case RenderGraphBarrier::Type::Transition:
+                std::printf("      %-6s %s %s -> %s%s\n", Where, Resource.c_str(), ResourceStateString(Barrier.StateBefore).c_str(), ResourceStateString(Barrier.StateAfter).c_str(),
+                    Barrier.SplitType == RenderGraphBarrier::Split::Begin ? " (split begin)" : Barrier.SplitType == RenderGraphBarrier::Split::End ? " (split end)" : "");
+                break;
+            case RenderGraphBarrier::Type::Aliasing:
+                std::printf("      %-6s %s aliasing after %s\n", Where, Resource.c_str(), Barrier.Before == InvalidRenderGraphResource ? "any" : m_Resources[Barrier.Before].Name.c_str());
+                break;
+            case RenderGraphBarrier::Type::Uav:
+                std::printf("      %-6s %s UAV\n", Where, Resource.c_str());
+                break;
+            case RenderGraphBarrier::Type::Discard:
+                std::printf("      %-6s %s discard\n", Where, Resource.c_str());
+                break;
+            }
+        }
+    };
+    for (const CompiledRenderPass& Pass : Compiled.Passes)
+    {
+        std::printf("    %s\n", m_Passes[Pass.Pass].Name.c_str());
+        PrintBarriers("before", Pass.Before);
+        PrintBarriers("after", Pass.After);
+    }
+    for (const uint32_t Pass : Compiled.CulledPasses)
+    {
+        std::printf("    %s (culled)\n", m_Passes[Pass].Name.c_str());
+    }
+
+    std::printf("  Barriers      : %zu transitions, %zu split, %zu aliasing, %zu UAV, %zu discards in %zu batches\n",
+        Compiled.NumTransitions, Compiled.NumSplitTransitions, Compiled.NumAliasingBarriers, Compiled.NumUavBarriers, Compiled.NumDiscards, Compiled.NumBarrierBatches);
+    const double Saved = Compiled.UnaliasedSize ? 100.0 * (1.0 - double(Compiled.HeapSize) / double(Compiled.UnaliasedSize)) : 0.0;
+    std::printf("  Transient heap: %.2f MB aliased, %.2f MB as separate allocations (%.1f%% saved)\n", Megabytes(Compiled.HeapSize), Megabytes(Compiled.UnaliasedSize), Saved);
+    for (RenderGraphResource Resource = 0; Resource < m_Resources.size(); ++Resource)
+    {
+        const TransientPlacement& Placement = Compiled.Placements[Resource];
+        if (Placement.Offset != TransientPlacement::Unplaced)
+        {
+            std::printf("    %-14s %8.2f MB at %8.2f MB, passes %u-%u%s\n", m_Resources[Resource].Name.c_str(), Megabytes(Placement.Size), Megabytes(Placement.Offset),
+                Placement.FirstPass, Placement.LastPass, Placement.bAliased ? ", aliased" : "");
+        }
+    }
+}
+
+bool RenderGraph::SelfTest()
+{
+    using Barrier = RenderGraphBarrier;
+    using State = ResourceState;
+
+    TestHarness Harness;
+    const auto Has = [](const std::vector<Barrier>& Barriers, Barrier::Type Type, RenderGraphResource Resource, State Before = State::Common, State After = State::Common, Barrier::Split Split = Barrier::Split::None)
+    {
+        return std::any_of(Barriers.begin(), Barriers.end(), [&](const Barrier& Entry)
+        {
+            return Entry.BarrierType == Type && Entry.Resource == Resource &&
+                (Type != Barrier::Type::Transition || (Entry.StateBefore == Before && Entry.StateAfter == After && Entry.SplitType == Split));
+        });
+    };
+    const auto Count = [](const std::vector<Barrier>& Barriers, RenderGraphResource Resource)
+    {
+        return std::count_if(Barriers.begin(), Barriers.end(), [Resource](const Barrier& Entry) { return Entry.Resource == Resource; });
+    };
+
+    std::printf("Render graph self test\n");
+
+    Harness.Run("Culling", [&]()
+    {
+        RenderGraph Graph;
+        const RenderGraphResource BackBuffer = Graph.Import("BackBuffer", State::Present, State::Present);
+        const RenderGraphResource Scene = Graph.CreateTransient("Scene", 1024, 256, State::RenderTarget);
+        const RenderGraphResource Unused = Graph.CreateTransient("Unused", 1024, 256);
+        Graph.AddPass("Scene").Write(Scene, State::RenderTarget);
+        Graph.AddPass("Unused").Read(Scene, State::PixelShaderResource).Write(Unused, State::UnorderedAccess);
+        Graph.AddPass("Compose").Read(Scene, State::PixelShaderResource).Write(BackBuffer, State::RenderTarget);
+        Graph.AddPass("Capture").KeepAlive();
+        const CompiledRenderGraph& Compiled = Graph.Compile();
+        Harness.Check(Compiled.CulledPasses == std::vector<uint32_t>{ 1 }, "only the pass nobody reads from is culled");
+        Harness.Check(Compiled.Passes.size() == 3 && Compiled.Passes[2].Pass == 3, "kept passes stay in order, KeepAlive survives");
+        Harness.Check(Compiled.Placements[Unused].Offset == TransientPlacement::Unplaced, "a transient only culled passes use gets no memory");
+    });
+
+    Harness.Run("Placement and split barriers", [&]()
+    {
+        for (const bool bSplit : { true, false })
+        {
+            RenderGraph Graph;
+            const RenderGraphResource Shadow = Graph.Import("Shadow", State::GenericRead, State::GenericRead);
+            const RenderGraphResource BackBuffer = Graph.Import("BackBuffer", State::Present, State::Present);
+            Graph.AddPass("Shadow").Write(Shadow, State::DepthWrite);
+            Graph.AddPass("Sky").Write(BackBuffer, State::RenderTarget);
+            Graph.AddPass("Lit").Read(Shadow, State::PixelShaderResource).Write(BackBuffer, State::RenderTarget);
+            Graph.AddPass("Ui").Write(BackBuffer, State::RenderTarget);
+            RenderGraphCompileOptions Options;
+            Options.bSplitBarriers = bSplit;
+            const CompiledRenderGraph& Compiled = Graph.Compile(Options);
+            const std::vector<CompiledRenderPass>& Passes = Compiled.Passes;
+            Harness.Check(Has(Passes[0].Before, Barrier::Type::Transition, Shadow, State::GenericRead, State::DepthWrite), "shadow map moves to depth write before its pass");
+            Harness.Check(Has(Passes[1].Before, Barrier::Type::Transition, BackBuffer, State::Present, State::RenderTarget), "back buffer moves to render target before its first pass");
+            Harness.Check(Count(Passes[2].Before, BackBuffer) == 0 && Passes[3].Before.empty(), "no barrier between writes in the same state");
+            if (bSplit)
+            {
+                Harness.Check(Has(Passes[0].After, Barrier::Type::Transition, Shadow, State::DepthWrite, State::PixelShaderResource, Barrier::Split::Begin), "shadow read transition begins after the shadow pass");
+                Harness.Check(Has(Passes[2].Before, Barrier::Type::Transition, Shadow, State::DepthWrite, State::PixelShaderResource, Barrier::Split::End), "and ends before the pass reading it");
+                Harness.Check(Has(Passes[2].After, Barrier::Type::Transition, Shadow, State::PixelShaderResource, State::GenericRead, Barrier::Split::Begin) &&
+                    Has(Passes[3].After, Barrier::Type::Transition, Shadow, State::PixelShaderResource, State::GenericRead, Barrier::Split::End), "final state split around the last pass");
+                Harness.Check(Compiled.NumSplitTransitions == 2, "two split transitions");
+            }
+            else
+            {
+                Harness.Check(Passes[0].After.empty() && Has(Passes[2].Before, Barrier::Type::Transition, Shadow, State::DepthWrite, State::PixelShaderResource), "without splitting the transition sits before the reader");
+                Harness.Check(Compiled.NumSplitTransitions == 0, "no split transitions");
+            }
+            Harness.Check(Has(Passes[3].After, Barrier::Type::Transition, BackBuffer, State::RenderTarget, State::Present), "back buffer returns to present at the end");
+        }
+    });
+
+    Harness.Run("Read combining and batching", [&]()
+    {
+        RenderGraph Graph;
+        const RenderGraphResource Target = Graph.CreateTransient("Target", 4096, 256, State::RenderTarget);
+        const RenderGraphResource Other = Graph.CreateTransient("Other", 4096, 256, State::RenderTarget);
+        const RenderGraphResource Depth = Graph.CreateTransient("Depth", 4096, 256, State::DepthWrite);
+        Graph.AddPass("Draw").Write(Target, State::RenderTarget).Write(Other, State::RenderTarget).Write(Depth, State::DepthWrite);
+        Graph.AddPass("Blur").Read(Target, State::PixelShaderResource).Read(Other, State::PixelShaderResource).Read(Depth, State::DepthRead).KeepAlive();
+        Graph.AddPass("Cull").Read(Target, State::NonPixelShaderResource).KeepAlive();
+        Graph.AddPass("Copy").Read(Target, State::CopySource).KeepAlive();
+        Graph.AddPass("Redraw").Write(Target, State::RenderTarget).KeepAlive();
+        const CompiledRenderGraph& Compiled = Graph.Compile({ false });
+        const std::vector<CompiledRenderPass>& Passes = Compiled.Passes;
+        const State Reads = State::PixelShaderResource | State::NonPixelShaderResource | State::CopySource;
+        Harness.Check(Has(Passes[1].Before, Barrier::Type::Transition, Target, State::RenderTarget, Reads), "consecutive reads move to their combined state once");
+        Harness.Check(Passes[2].Before.empty() && Passes[3].Before.empty(), "later reads need no barrier");
+        Harness.Check(Has(Passes[4].Before, Barrier::Type::Transition, Target, Reads, State::RenderTarget), "the next write leaves the combined state");
+        Harness.Check(Passes[1].Before.size() == 3 && Compiled.NumBarrierBatches == 3, "one batch before each pass that needs one and for the epilogue");
+        Harness.Check(Has(Passes[4].After, Barrier::Type::Transition, Depth, State::DepthRead, State::DepthWrite), "transients end the frame in their first state");
+        Harness.Check(Compiled.NumDiscards == 3 && Passes[0].Before.size() == 3, "render targets are discarded at their first use");
+    });
+
+    Harness.Run("UAV barriers", [&]()
+    {
+        RenderGraph Graph;
+        const RenderGraphResource Buffer = Graph.CreateTransient("Buffer", 4096, 256);
+        Graph.AddPass("Clear").Write(Buffer, State::UnorderedAccess).KeepAlive();
+        Graph.AddPass("Accumulate").Write(Buffer, State::UnorderedAccess).KeepAlive();
+        Graph.AddPass("ReduceA").Read(Buffer, State::UnorderedAccess).KeepAlive();
+        Graph.AddPass("ReduceB").Read(Buffer, State::UnorderedAccess).KeepAlive();
+        Graph.AddPass("Shade").Read(Buffer, State::PixelShaderResource).KeepAlive();
+        const CompiledRenderGraph& Compiled = Graph.Compile();
+        const std::vector<CompiledRenderPass>& Passes = Compiled.Passes;
+        Harness.Check(Passes[0].Before.empty(), "no barrier for the first write of a frame");
+        Harness.Check(Has(Passes[1].Before, Barrier::Type::Uav, Buffer) && Has(Passes[2].Before, Barrier::Type::Uav, Buffer), "UAV barrier after each write");
+        Harness.Check(Passes[3].Before.empty(), "no UAV barrier between reads");
+        Harness.Check(Has(Passes[4].Before, Barrier::Type::Transition, Buffer, State::UnorderedAccess, State::PixelShaderResource), "transition to the shader read");
+        Harness.Check(Compiled.NumUavBarriers == 2, "two UAV barriers");
+    });
+
+    Harness.Run("MSAA aliasing", [&]()
+    {
+        RenderGraph Graph;
+        const RenderGraphResource BackBuffer = Graph.Import("BackBuffer", State::Present, State::Present);
+        const RenderGraphResource Color = Graph.CreateTransient("SceneColor", 4 << 20, 4 << 20, State::RenderTarget);
+        const RenderGraphResource Depth = Graph.CreateTransient("SceneDepth", 2 << 20, 4 << 20, State::DepthWrite);
+        const RenderGraphResource Resolved = Graph.CreateTransient("ResolvedColor", 1 << 20, 64 << 10, State::RenderTarget);
+        Graph.AddPass("Scene").Write(Color, State::RenderTarget).Write(Depth, State::DepthWrite);
+        Graph.AddPass("Resolve").Read(Color, State::ResolveSource).Write(Resolved, State::ResolveDest);
+        Graph.AddPass("Tonemap").Read(Resolved, State::PixelShaderResource).Write(BackBuffer, State::RenderTarget);
+        const CompiledRenderGraph& Compiled = Graph.Compile();
+        const std::vector<CompiledRenderPass>& Passes = Compiled.Passes;
+        const std::vector<TransientPlacement>& Placements = Compiled.Placements;
+        Harness.Check(Placements[Depth].Offset == Placements[Resolved].Offset && Placements[Depth].bAliased && !Placements[Color].bAliased, "depth and the resolve target share memory");
+        Harness.Check(Compiled.HeapSize == (6u << 20) && Compiled.UnaliasedSize == (7u << 20) && Compiled.HeapAlignment == (4u << 20), "peak memory is color plus depth");
+        const std::vector<Barrier>& Before = Passes[1].Before;
+        Harness.Check(Before.size() == 5 && Before[0].BarrierType == Barrier::Type::Aliasing && Before[0].Resource == Resolved && Before[0].Before == Depth &&
+            Before[1].StateBefore == State::ResolveDest && Before[1].StateAfter == State::RenderTarget && Before[2].BarrierType == Barrier::Type::Discard &&
+            Has(Before, Barrier::Type::Transition, Resolved, State::RenderTarget, State::ResolveDest) &&
+            Has(Before, Barrier::Type::Transition, Color, State::RenderTarget, State::ResolveSource), "resolve target is activated, discarded as a render target and moved back");
+        Harness.Check(Passes[0].Before.size() == 3 && Passes[0].Before[0].BarrierType == Barrier::Type::Aliasing && Passes[0].Before[0].Before == Resolved,
+            "depth takes its memory back from last frame's resolve target");
+        Harness.Check(Has(Passes[2].After, Barrier::Type::Transition, Color, State::ResolveSource, State::RenderTarget, Barrier::Split::End) &&
+            Has(Passes[1].After, Barrier::Type::Transition, Color, State::ResolveSource, State::RenderTarget, Barrier::Split::Begin), "color returns to render target for the next frame");
+        Graph.PrintReport("MSAA frame (sizes scaled down)");
+    });
+
+    Harness.Run("Errors", [&]()
+    {
+        RenderGraph Graph;
+        const RenderGraphResource Texture = Graph.CreateTransient("Texture", 4096, 256);
+        Graph.AddPass("Sample").Read(Texture, State::PixelShaderResource).KeepAlive();
+        bool bThrew = false;
+        try
+        {
+            Graph.Compile();
+        }
+        catch (const std::logic_error&)
+        {
+            bThrew = true;
+        }
+        Harness.Check(bThrew, "reading a transient before it is written throws");
+
+        bThrew = false;
+        try
+        {
+            Graph.AddPass("Bad").Read(Texture, State::RenderTarget);
+        }
+        catch (const std::invalid_argument&)
+        {
+            bThrew = true;
+        }
+        Harness.Check(bThrew, "reading in a write state throws");
+    });
+
+    //Random graphs: simulate every barrier and check each use sees its state and aliased memory is never shared
+    //by two live resources
+    double CompileUs = 0.0;
+    size_t NumPasses = 0;
+    Harness.Run("Random graphs", [&]()
+    {
+        std::mt19937 Random{ 1234 };
+        const State WriteStates[] = { State::RenderTarget, State::UnorderedAccess, State::CopyDest, State::DepthWrite };
+        const State ReadStates[] = { State::PixelShaderResource, State::NonPixelShaderResource, State::CopySource, State::UnorderedAccess, State::DepthRead };
+        const int Graphs = 50;
+        for (int GraphIndex = 0; GraphIndex < Graphs && Harness.Passed(); ++GraphIndex)
+        {
+            RenderGraph Graph;
+            const uint32_t NumImported = 4;
+            const uint32_t NumTransients = 60;
+            for (uint32_t i = 0; i < NumImported; ++i)
+            {
+                Graph.Import("Imported" + std::to_string(i), i % 2 ? State::GenericRead : State::Present, i % 2 ? State::GenericRead : State::Present);
+            }
+            for (uint32_t i = 0; i < NumTransients; ++i)
+            {
+                const State Discard = i % 3 == 0 ? State::RenderTarget : i % 3 == 1 ? State::DepthWrite : State::Common;
+                Graph.CreateTransient("Transient" + std::to_string(i), (1 + Random() % 512) << 16, uint64_t(64) << (10 + Random() % 2 * 6), Discard);
+            }
+            std::vector<bool> Written(NumImported + NumTransients);
+            for (uint32_t i = 0; i < NumImported; ++i)
+            {
+                Written[i] = true;
+            }
+            for (int PassIndex = 0; PassIndex < 256; ++PassIndex)
+            {
+                RenderGraphPassBuilder Pass = Graph.AddPass("Pass" + std::to_string(PassIndex));
+                std::vector<RenderGraphResource> Used;
+                for (uint32_t i = 1 + Random() % 4; i > 0; --i)
+                {
+                    const RenderGraphResource Resource = Random() % (NumImported + NumTransients);
+                    if (std::find(Used.begin(), Used.end(), Resource) != Used.end())
+                    {
+                        continue;
+                    }
+                    Used.push_back(Resource);
+                    if (!Written[Resource] || Random() % 3 == 0)
+                    {
+                        Pass.Write(Resource, WriteStates[Random() % 4]);
+                        Written[Resource] = true;
+                    }
+                    else
+                    {
+                        Pass.Read(Resource, ReadStates[Random() % 5]);
+                    }
+                }
+                if (Random() % 8 == 0)
+                {
+                    Pass.KeepAlive();
+                }
+            }
+
+            const auto Start = std::chrono::high_resolution_clock::now();
+            const CompiledRenderGraph& Compiled = Graph.Compile({ GraphIndex % 2 == 0 });
+            CompileUs += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - Start).count();
+            NumPasses += Graph.NumPasses();
+
+            const std::vector<TransientPlacement>& Placements = Compiled.Placements;
+            for (RenderGraphResource A = 0; A < Placements.size(); ++A)
+            {
+                if (Placements[A].Offset == TransientPlacement::Unplaced)
+                {
+                    continue;
+                }
+                Harness.Check(Placements[A].Offset % Graph.m_Resources[A].Alignment == 0 && Placements[A].Offset + Placements[A].Size <= Compiled.HeapSize, "placement aligned and inside the heap");
+                for (RenderGraphResource B = A + 1; B < Placements.size(); ++B)
+                {
+                    const TransientPlacement& PA = Placements[A];
+                    const TransientPlacement& PB = Placements[B];
+                    if (PB.Offset != TransientPlacement::Unplaced && PA.Offset < PB.Offset + PB.Size && PB.Offset < PA.Offset + PA.Size)
+                    {
+                        Harness.Check(PA.LastPass < PB.FirstPass || PB.LastPass < PA.FirstPass, "resources sharing memory have disjoint lifetimes");
+                        Harness.Check(PA.bAliased && PB.bAliased, "resources sharing memory are marked aliased");
+                    }
+                }
+            }
+            Harness.Check(Compiled.HeapSize <= Compiled.UnaliasedSize, "aliasing never needs more memory");
+
+            //Two frames in a row so the end state of one has to match the start of the next
+            const State Splitting = State(~0u);
+            std::vector<State> States(Graph.NumResources());
+            for (RenderGraphResource Resource = 0; Resource < States.size(); ++Resource)
+            {
+                States[Resource] = Graph.IsImported(Resource) ? Graph.m_Resources[Resource].InitialState : Placements[Resource].FrameStartState;
+            }
+            for (int Frame = 0; Frame < 2; ++Frame)
+            {
+                std::vector<bool> Active(Graph.NumResources(), false);
+                std::vector<State> Pending(Graph.NumResources(), State::Common);
+                const auto Apply = [&](const std::vector<Barrier>& Barriers)
+                {
+                    for (const Barrier& Entry : Barriers)
+                    {
+                        State& Current = States[Entry.Resource];
+                        switch (Entry.BarrierType)
+                        {
+                        case Barrier::Type::Transition:
+                            if (Entry.SplitType == Barrier::Split::End)
+                            {
+                                Harness.Check(Current == Splitting && Pending[Entry.Resource] == Entry.StateAfter, "split transition ends the way it began");
+                                Current = Entry.StateAfter;
+                                break;
+                            }
+                            Harness.Check(Current == Entry.StateBefore && Entry.StateBefore != Entry.StateAfter, "transition starts from the tracked state");
+                            Current = Entry.SplitType == Barrier::Split::Begin ? Splitting : Entry.StateAfter;
+                            Pending[Entry.Resource] = Entry.StateAfter;
+                            break;
+                        case Barrier::Type::Aliasing:
+                            Active[Entry.Resource] = true;
+                            break;
+                        case Barrier::Type::Discard:
+                            Harness.Check(Current == Graph.m_Resources[Entry.Resource].DiscardState, "discard in the state DiscardResource needs");
+                            break;
+                        default:
+                            Harness.Check(Current == State::UnorderedAccess, "UAV barrier on a resource in UAV state");
+                            break;
+                        }
+                    }
+                };
+                for (const CompiledRenderPass& Pass : Compiled.Passes)
+                {
+                    Apply(Pass.Before);
+                    for (const PassUse& Use : Graph.m_Passes[Pass.Pass].Uses)
+                    {
+                        const State Current = States[Use.Resource];
+                        Harness.Check(Use.bWrite || !IsReadOnly(Use.State) ? Current == Use.State : (IsReadOnly(Current) && Contains(Current, Use.State)), "every use sees its state");
+                        Harness.Check(!Placements[Use.Resource].bAliased || Active[Use.Resource], "aliased memory is activated before use");
+                    }
+                    Apply(Pass.After);
+                }
+                for (RenderGraphResource Resource = 0; Resource < States.size(); ++Resource)
+                {
+                    const State Expected = Graph.IsImported(Resource) ? Graph.m_Resources[Resource].FinalState :
+                        Placements[Resource].Offset == TransientPlacement::Unplaced ? States[Resource] : Placements[Resource].FrameStartState;
+                    Harness.Check(States[Resource] == Expected, "frame ends in the final and frame start states");
+                }
+            }
+        }
+    });
+    std::printf("  Compile       : %.1f us per 256 pass graph (%.2f us per pass)\n", CompileUs / 50.0, NumPasses ? CompileUs / double(NumPasses) : 0.0);
+
+    return Harness.Finish();
+}
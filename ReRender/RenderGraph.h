@@ -0,0 +1,239 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ParallelPassRecorder.h"
+
+// Resource states as the graph tracks them, D3D12RenderGraph translates them to D3D12_RESOURCE_STATES.
+// Read-only states may be combined, a resource in a combination needs no barrier for any read it contains.
+enum class ResourceState : uint32_t
+{
+    Common = 0,
+    VertexAndConstantBuffer = 1 << 0,
+    IndexBuffer = 1 << 1,
+    RenderTarget = 1 << 2,
+    UnorderedAccess = 1 << 3,
+    DepthWrite = 1 << 4,
+    DepthRead = 1 << 5,
+    NonPixelShaderResource = 1 << 6,
+    PixelShaderResource = 1 << 7,
+    IndirectArgument = 1 << 8,
+    CopyDest = 1 << 9,
+    CopySource = 1 << 10,
+    ResolveDest = 1 << 11,
+    ResolveSource = 1 << 12,
+    Present = 1 << 13,
+
+    ReadOnly = VertexAndConstantBuffer | IndexBuffer | DepthRead | NonPixelShaderResource | PixelShaderResource |
+        IndirectArgument | CopySource | ResolveSource,
+    GenericRead = VertexAndConstantBuffer | IndexBuffer | NonPixelShaderResource | PixelShaderResource |
+        IndirectArgument | CopySource,
+};
+
+inline ResourceState operator|(ResourceState A, ResourceState B) { return ResourceState(uint32_t(A) | uint32_t(B)); }
+inline ResourceState operator&(ResourceState A, ResourceState B) { return ResourceState(uint32_t(A) & uint32_t(B)); }
+
+// True when every bit of B is set in A.
+inline bool Contains(ResourceState A, ResourceState B) { return (A & B) == B; }
+
+// True for a non-empty combination of read-only states.
+inline bool IsReadOnly(ResourceState State) { return State != ResourceState::Common && Contains(ResourceState::ReadOnly, State); }
+
+// "RenderTarget", "PixelShaderResource|CopySource", ... for reports.
+std::string ResourceStateString(ResourceState State);
+
+using RenderGraphResource = uint32_t;
+constexpr RenderGraphResource InvalidRenderGraphResource = ~uint32_t(0);
+
+struct RenderGraphBarrier
+{
+    enum class Type
+    {
+        Transition,
+        Aliasing,   //Resource takes over memory, Before is the previous owner or invalid for any of them
+        Uav,
+        Discard,    //Not a barrier: Resource must be cleared, discarded or fully copied before it is read
+    };
+
+    enum class Split
+    {
+        None,
+        Begin,
+        End,
+    };
+
+    Type BarrierType = Type::Transition;
+    RenderGraphResource Resource = InvalidRenderGraphResource;
+    RenderGraphResource Before = InvalidRenderGraphResource;
+    ResourceState StateBefore = ResourceState::Common;
+    ResourceState StateAfter = ResourceState::Common;
+    Split SplitType = Split::None;
+};
+
+struct RenderGraphCompileOptions
+{
+    // Begin a transition right after a resource's last use and end it just before the next one. Legacy
+    // D3D12 split barriers must begin and end in one command list, so only for passes recorded into one.
+    bool bSplitBarriers = true;
+};
+
+// A surviving pass with the barriers recorded around it, in submission order.
+struct CompiledRenderPass
+{
+    uint32_t Pass;
+    std::vector<RenderGraphBarrier> Before;
+    std::vector<RenderGraphBarrier> After;
+};
+
+// Memory of a transient resource inside the graph's aliasing heap.
+struct TransientPlacement
+{
+    static constexpr uint64_t Unplaced = ~uint64_t(0);
+
+    uint64_t Offset = Unplaced;
+    uint64_t Size = 0;
+    uint32_t FirstPass = 0;
+    uint32_t LastPass = 0;
+    // Shares memory with another transient, its first use starts with an aliasing barrier.
+    bool bAliased = false;
+    // State of the first use, the resource is created in it and returned to it at the end of every frame.
+    ResourceState FrameStartState = ResourceState::Common;
+};
+
+struct CompiledRenderGraph
+{
+    std::vector<CompiledRenderPass> Passes;
+    std::vector<uint32_t> CulledPasses;
+
+    // Indexed by resource, Offset is Unplaced for imported resources and transients no surviving pass uses.
+    std::vector<TransientPlacement> Placements;
+
+    uint64_t HeapSize = 0;
+    uint64_t HeapAlignment = 1;
+    uint64_t UnaliasedSize = 0;
+
+    size_t NumTransitions = 0;
+    size_t NumSplitTransitions = 0;
+    size_t NumAliasingBarriers = 0;
+    size_t NumUavBarriers = 0;
+    size_t NumDiscards = 0;
+    // ResourceBarrier calls when consecutive barriers around a pass go in one call.
+    size_t NumBarrierBatches = 0;
+};
+
+class RenderGraph;
+
+// Declares what one pass reads and writes, returned by RenderGraph::AddPass.
+class RenderGraphPassBuilder
+{
+public:
+    RenderGraphPassBuilder(RenderGraph& InGraph, uint32_t InPass) :m_Graph(InGraph), m_Pass(InPass) {}
+
+    // State must be read-only or UnorderedAccess.
+    RenderGraphPassBuilder& Read(RenderGraphResource Resource, ResourceState State);
+
+    // State must not be read-only. Writing a resource keeps its previous contents, e.g. drawing on top of them.
+    RenderGraphPassBuilder& Write(RenderGraphResource Resource, ResourceState State);
+
+    // Never culled, for passes whose effect the graph cannot see.
+    RenderGraphPassBuilder& KeepAlive();
+
+private:
+    RenderGraph& m_Graph;
+    uint32_t m_Pass;
+};
+
+// Frame graph compiler without a device. Passes declare reads and writes, Compile culls passes nothing needs,
+// places transient resources with disjoint lifetimes at the same memory and computes batched and split barriers
+// in pass order. Imported resources are owned elsewhere and return to their final state at the end of the graph,
+// transient ones start every frame in the state of their first use.
+class RenderGraph
+{
+public:
+    // State at the start of the graph and the one the graph leaves it in.
+    RenderGraphResource Import(std::string Name, ResourceState InitialState, ResourceState FinalState);
+
+    // Size and Alignment come from the backend. Render targets and depth buffers must be cleared, discarded or
+    // copied to before anything else after they were placed or took over aliased memory, they pass the state
+    // DiscardResource needs (RenderTarget or DepthWrite) and get a Discard at their first use every frame.
+    RenderGraphResource CreateTransient(std::string Name, uint64_t Size, uint64_t Alignment, ResourceState DiscardState = ResourceState::Common);
+
+    // Passes execute in the order added.
+    RenderGraphPassBuilder AddPass(std::string Name, PassFunction Record = {}, PassRecording Recording = PassRecording::Parallel);
+
+    // Throws std::logic_error if a transient is read before any pass wrote it.
+    const CompiledRenderGraph& Compile(const RenderGraphCompileOptions& Options = {});
+
+    const CompiledRenderGraph& Compiled() const { return m_Compiled; }
+
+    // Adds every surviving pass to Recorder, wrapped in its barriers. EmitBarriers records one list of them, a
+    // Discard ends the batch before it since it is a command of its own.
+    using BarrierEmitter = std::function<void(CommandContext&, const std::vector<RenderGraphBarrier>&)>;
+    void Register(ParallelPassRecorder& Recorder, BarrierEmitter EmitBarriers) const;
+
+    size_t NumPasses() const { return m_Passes.size(); }
+    size_t NumResources() const { return m_Resources.size(); }
+    const std::string& PassName(uint32_t Pass) const { return m_Passes[Pass].Name; }
+    const std::string& ResourceName(RenderGraphResource Resource) const { return m_Resources[Resource].Name; }
+    bool IsImported(RenderGraphResource Resource) const { return m_Resources[Resource].bImported; }
+
+    // Surviving passes with their barriers, culled passes and the aliasing heap against separate allocations.
+    void PrintReport(const char* Name) const;
+
+    // Checks culling, barrier placement, read combining, splitting, batching, UAV barriers and aliasing on small
+    // graphs, prints the memory report of an MSAA frame and times the compile of a large one. Returns false if
+    // any check failed. No GPU needed.
+    static bool SelfTest();
+
+private:
+    friend class RenderGraphPassBuilder;
+
+    struct ResourceInfo
+    {
+        std::string Name;
+        bool bImported = false;
+        ResourceState InitialState = ResourceState::Common;
+        ResourceState FinalState = ResourceState::Common;
+        uint64_t Size = 0;
+        uint64_t Alignment = 1;
+        ResourceState DiscardState = ResourceState::Common;
+    };
+
+    struct PassUse
+    {
+        RenderGraphResource Resource;
+        ResourceState State;
+        bool bWrite;
+    };
+
+    struct PassInfo
+    {
+        std::string Name;
+        PassFunction Record;
+        PassRecording Recording;
+        std::vector<PassUse> Uses;
+        bool bKeepAlive = false;
+    };
+
+    // A use by a surviving pass, Pass is its index in the compiled order.
+    struct ResourceUse
+    {
+        uint32_t Pass;
+        ResourceState State;
+        bool bWrite;
+    };
+
+    void AddUse(uint32_t Pass, RenderGraphResource Resource, ResourceState State, bool bWrite);
+    std::vector<bool> Cull() const;
+    void PlaceTransients(const std::vector<std::vector<ResourceUse>>& Uses);
+    void ComputeBarriers(const std::vector<std::vector<ResourceUse>>& Uses, const RenderGraphCompileOptions& Options);
+    void CountBarriers();
+
+    std::vector<ResourceInfo> m_Resources;
+    std::deque<PassInfo> m_Passes;
+    CompiledRenderGraph m_Compiled;
+};
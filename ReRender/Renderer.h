@@ -5,11 +5,12 @@
 #include "glm/include/glm/mat4x4.hpp"
 #include <type_traits>
 
+//Zero unless set, glm leaves vectors uninitialized and a golden image has to come out the same every run
 struct Light
 {
-    glm::vec3 Position;
-    glm::vec3 Direction;
-    glm::vec3 Radiance;
+    glm::vec3 Position{ 0.0f };
+    glm::vec3 Direction{ 0.0f };
+    glm::vec3 Radiance{ 0.0f };
     bool Enabel = false;
 };
 
@@ -0,0 +1,374 @@
+#include "RingAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "PortableUtils.h"
+#include "UploadBatch.h"
+
+namespace
+{
+    // Finishes a submission once Lag newer ones have been submitted, like a GPU that runs a few frames behind.
+    class LaggingQueue : public UploadQueue
+    {
+    public:
+        explicit LaggingQueue(uint64_t InLag) : m_Lag(InLag) {}
+
+        uint64_t Submit() override { return ++m_Submitted; }
+
+        uint64_t CompletedValue() const override
+        {
+            return std::max(m_Waited, m_Submitted > m_Lag ? m_Submitted - m_Lag : 0);
+        }
+
+        void Wait(uint64_t FenceValue) override
+        {
+            assert(FenceValue <= m_Submitted && "Waiting for a fence that was never signaled");
+            m_Waited = std::max(m_Waited, FenceValue);
+        }
+
+    private:
+        uint64_t m_Lag;
+        uint64_t m_Submitted = 0;
+        uint64_t m_Waited = 0;
+    };
+}
+
+RingAllocator::RingAllocator(uint64_t InCapacity)
+    :m_Capacity(InCapacity)
+{}
+
+uint64_t RingAllocator::Allocate(uint64_t Size, uint64_t Alignment)
+{
+    assert(Size > 0);
+    if (Size > m_Capacity)
+    {
+        return InvalidOffset;
+    }
+
+    // Nothing in use, start over at 0 so the whole ring is one free range.
+    if (m_Used == 0)
+    {
+        m_Head = 0;
+        m_Tail = 0;
+    }
+
+    const uint64_t Aligned = AlignUp(m_Head, Alignment);
+    if (m_Head >= m_Tail)
+    {
+        if (m_Used == m_Capacity)
+        {
+            return InvalidOffset;
+        }
+
+        // Free space is [m_Head, m_Capacity) followed by [0, m_Tail).
+        if (Aligned + Size <= m_Capacity)
+        {
+            return Commit(Aligned, Size, Aligned + Size - m_Head);
+        }
+        if (Size <= m_Tail)
+        {
+            ++m_Stats.Wraps;
+            return Commit(0, Size, m_Capacity - m_Head + Size);
+        }
+        return InvalidOffset;
+    }
+
+    // Wrapped, free space is [m_Head, m_Tail).
+    if (Aligned + Size <= m_Tail)
+    {
+        return Commit(Aligned, Size, Aligned + Size - m_Head);
+    }
+    return InvalidOffset;
+}
+
+uint64_t RingAllocator::Commit(uint64_t Offset, uint64_t Size, uint64_t ConsumedBytes)
+{
+    m_Head = Offset + Size;
+    m_Used += ConsumedBytes;
+    m_OpenBytes += ConsumedBytes;
+
+    ++m_Stats.Allocations;
+    m_Stats.AllocatedBytes += Size;
+    m_Stats.PaddingBytes += ConsumedBytes - Size;
+    m_Stats.PeakUsedBytes = std::max(m_Stats.PeakUsedBytes, m_Used);
+    return Offset;
+}
+
+uint64_t RingAllocator::AllocateBlocking(UploadBatch& Batch, uint64_t Size, uint64_t Alignment)
+{
+    if (Size > m_Capacity)
+    {
+        return InvalidOffset;
+    }
+
+    for (;;)
+    {
+        Reclaim(Batch.Queue().CompletedValue());
+
+        const uint64_t Offset = Allocate(Size, Alignment);
+        if (Offset != InvalidOffset)
+        {
+            return Offset;
+        }
+
+        if (!m_Closed.empty())
+        {
+            ++m_Stats.Stalls;
+            Batch.Queue().Wait(m_Closed.front().FenceValue);
+        }
+        else if (m_OpenBytes > 0)
+        {
+            // The ring is full of our own unsubmitted copies, submit them so they can be reclaimed.
+            ++m_Stats.ForcedSubmits;
+            Batch.Submit();
+            assert(m_OpenBytes == 0 && "RingAllocator::Attach was not called for this batch");
+        }
+        else
+        {
+            return InvalidOffset;
+        }
+    }
+}
+
+void RingAllocator::Close(uint64_t FenceValue)
+{
+    assert(FenceValue >= m_LastFenceValue && "Fence values must not decrease");
+    m_LastFenceValue = FenceValue;
+
+    if (m_OpenBytes == 0)
+    {
+        return;
+    }
+    m_Closed.push_back({ FenceValue, m_Head, m_OpenBytes });
+    m_OpenBytes = 0;
+}
+
+void RingAllocator::Reclaim(uint64_t CompletedValue)
+{
+    while (!m_Closed.empty() && m_Closed.front().FenceValue <= CompletedValue)
+    {
+        m_Tail = m_Closed.front().End;
+        m_Used -= m_Closed.front().Bytes;
+        m_Closed.pop_front();
+    }
+}
+
+void RingAllocator::Attach(UploadBatch& Batch)
+{
+    Batch.OnSubmit([this](uint64_t FenceValue) { Close(FenceValue); });
+}
+
+void RingAllocator::PrintStats(const char* Name) const
+{
+    std::printf("Ring allocator: %s (%.2f MB)\n", Name, m_Capacity / (1024.0 * 1024.0));
+    std::printf("  Allocations   : %zu, %.2f MB (%.2f MB padding)\n", m_Stats.Allocations,
+        m_Stats.AllocatedBytes / (1024.0 * 1024.0), m_Stats.PaddingBytes / (1024.0 * 1024.0));
+    std::printf("  Peak used     : %.2f MB\n", m_Stats.PeakUsedBytes / (1024.0 * 1024.0));
+    std::printf("  Wraps         : %zu, stalls %zu, forced submits %zu\n", m_Stats.Wraps, m_Stats.Stalls, m_Stats.ForcedSubmits);
+}
+
+bool RingAllocator::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Staging ring self test\n");
+
+    Harness.Run("Wrap and reclaim", [&]()
+    {
+        RingAllocator Ring{ 1024 };
+        Harness.Check(Ring.Allocate(2048, 1) == InvalidOffset, "a request larger than the ring never fits");
+        Harness.Check(Ring.Allocate(600, 1) == 0, "the first allocation starts at 0");
+        Harness.Check(Ring.Allocate(600, 1) == InvalidOffset, "nothing fits before the first submission is reclaimed");
+        Ring.Close(1);
+        Harness.Check(Ring.Allocate(300, 1) == 600, "allocations follow each other");
+        Ring.Close(2);
+
+        Ring.Reclaim(1);
+        Harness.Check(Ring.UsedBytes() == 300 && Ring.NumClosedSubmissions() == 1, "Reclaim frees exactly the completed submission");
+        Harness.Check(Ring.Allocate(200, 1) == 0, "a request that does not fit the end wraps to 0");
+        Harness.Check(Ring.Stats().Wraps == 1 && Ring.Stats().PaddingBytes == 124, "the skipped end counts as padding");
+        Harness.Check(Ring.Allocate(500, 1) == InvalidOffset, "a wrapped ring stops at the oldest live submission");
+        Harness.Check(Ring.Allocate(400, 1) == 200 && Ring.UsedBytes() == 1024, "the gap up to the oldest submission can be filled");
+        Harness.Check(Ring.Allocate(1, 1) == InvalidOffset, "a full ring hands out nothing");
+
+        Ring.Close(3);
+        Ring.Reclaim(3);
+        Harness.Check(Ring.UsedBytes() == 0 && Ring.NumClosedSubmissions() == 0, "reclaiming everything empties the ring");
+    });
+
+    Harness.Run("Alignment padding", [&]()
+    {
+        RingAllocator Ring{ 1024 };
+        Harness.Check(Ring.Allocate(10, 1) == 0 && Ring.Allocate(10, 256) == 256, "offsets are rounded up to the alignment");
+        Harness.Check(Ring.UsedBytes() == 266 && Ring.Stats().PaddingBytes == 246, "the rounding counts as used padding");
+        Harness.Check(Ring.HasOpenAllocations(), "allocations stay open until Close");
+    });
+
+    struct LiveAllocation
+    {
+        uint64_t Offset;
+        uint64_t Size;
+        uint64_t FenceValue;
+        uint8_t Pattern;
+    };
+
+    // Random sizes and alignments, random submission sizes, every live allocation is filled with its own byte
+    // and must stay intact until the simulated GPU is past its fence.
+    const uint64_t Capacities[] = { 4096, 256 * 1024 };
+    for (uint64_t Capacity : Capacities)
+    {
+        const std::string Name = "Stress, " + std::to_string(Capacity / 1024) + " KB ring";
+        Harness.Run(Name.c_str(), [&]()
+        {
+            LaggingQueue Queue{ 3 };
+            UploadBatch Batch{ Queue };
+            RingAllocator Ring{ Capacity };
+            Ring.Attach(Batch);
+
+            std::vector<uint8_t> Memory(Capacity);
+            std::vector<LiveAllocation> Live;
+            std::mt19937 Random{ 1234 };
+            const uint64_t Alignments[] = { 1, 16, 256, 512 };
+            size_t Overlaps = 0;
+            size_t Overwritten = 0;
+            size_t Misplaced = 0;
+            size_t Refused = 0;
+            size_t Oversized = 0;
+
+            auto VerifyContents = [&]()
+            {
+                for (const LiveAllocation& Allocation : Live)
+                {
+                    const uint8_t* Bytes = Memory.data() + Allocation.Offset;
+                    if (std::any_of(Bytes, Bytes + Allocation.Size, [&](uint8_t Byte) { return Byte != Allocation.Pattern; }))
+                    {
+                        ++Overwritten;
+                    }
+                }
+            };
+
+            for (int i = 0; i < 5000; ++i)
+            {
+                // Mostly small uploads, a few large ones that force wraps and stalls, now and then one that never fits.
+                uint64_t Size = 1 + Random() % (Capacity / 64);
+                if (Random() % 16 == 0)
+                {
+                    Size = 1 + Random() % (Capacity / 2);
+                }
+                if (Random() % 256 == 0)
+                {
+                    Size = Capacity + 1 + Random() % Capacity;
+                }
+                const uint64_t Alignment = Alignments[Random() % 4];
+
+                const uint64_t Offset = Ring.AllocateBlocking(Batch, Size, Alignment);
+
+                const uint64_t Completed = Queue.CompletedValue();
+                Live.erase(std::remove_if(Live.begin(), Live.end(), [Completed](const LiveAllocation& Allocation)
+                {
+                    return Allocation.FenceValue <= Completed;
+                }), Live.end());
+
+                if (Offset == InvalidOffset)
+                {
+                    Oversized += Size > Capacity ? 1 : 0;
+                    Refused += Size > Capacity ? 0 : 1;
+                    continue;
+                }
+
+                if (Offset % Alignment != 0 || Offset + Size > Capacity)
+                {
+                    ++Misplaced;
+                }
+                for (const LiveAllocation& Other : Live)
+                {
+                    if (Offset < Other.Offset + Other.Size && Other.Offset < Offset + Size)
+                    {
+                        ++Overlaps;
+                    }
+                }
+
+                // Not closed yet, the fence is the one the next submission will get.
+                const LiveAllocation Allocation{ Offset, Size, Batch.Stats().Submissions + 1, static_cast<uint8_t>(i) };
+                std::memset(Memory.data() + Offset, Allocation.Pattern, Size);
+                Live.push_back(Allocation);
+
+                if (Random() % 4 == 0)
+                {
+                    Batch.Submit();
+                }
+                if (i % 64 == 0)
+                {
+                    VerifyContents();
+                }
+            }
+            VerifyContents();
+            Batch.Flush();
+            Ring.Reclaim(Queue.CompletedValue());
+
+            const RingAllocatorStats& Stats = Ring.Stats();
+            std::printf("    %zu allocations, %zu wraps, %zu stalls, %zu forced submits, %.2f%% padding\n",
+                Stats.Allocations, Stats.Wraps, Stats.Stalls, Stats.ForcedSubmits,
+                100.0 * Stats.PaddingBytes / std::max<uint64_t>(Stats.AllocatedBytes, 1));
+            Harness.Check(Overlaps == 0, "live allocations never overlap");
+            Harness.Check(Overwritten == 0, "live allocations are not overwritten before their fence");
+            Harness.Check(Misplaced == 0, "offsets are aligned and inside the ring");
+            Harness.Check(Refused == 0, "AllocateBlocking only refuses requests larger than the ring");
+            Harness.Check(Oversized > 0 && Stats.Wraps > 0 && Stats.Stalls > 0, "the run hit oversized requests, wraps and stalls");
+            Harness.Check(Ring.UsedBytes() == 0, "the ring drains after Flush");
+        });
+    }
+
+    return Harness.Finish();
+}
+
+void RingAllocator::Benchmark(uint64_t Capacity, int Iterations)
+{
+    Iterations = Iterations > 0 ? Iterations : 1;
+
+    // Allocation bookkeeping alone, then 64 KB uploads copied into the ring memory. The old path paid a
+    // CreateCommittedResource plus Map/Unmap per upload on top of the copy, which this cannot measure without a device.
+    // The ring has to hold at least one upload, smaller sizes are raised to that.
+    const uint64_t UploadSize = 64 * 1024;
+    const int NumUploads = Iterations * 10000;
+    Capacity = std::max(Capacity, UploadSize);
+    std::vector<uint8_t> Source(UploadSize, 0x5a);
+
+    auto RunUploads = [&](bool bCopy)
+    {
+        LaggingQueue Queue{ 2 };
+        UploadBatch Batch{ Queue };
+        RingAllocator Ring{ Capacity };
+        Ring.Attach(Batch);
+        std::vector<uint8_t> Memory(Capacity);
+
+        const auto Start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < NumUploads; ++i)
+        {
+            const uint64_t Offset = Ring.AllocateBlocking(Batch, UploadSize, 512);
+            if (bCopy && Offset != InvalidOffset)
+            {
+                std::memcpy(Memory.data() + Offset, Source.data(), UploadSize);
+            }
+            if (i % 16 == 15)
+            {
+                Batch.Submit();
+            }
+        }
+        Batch.Flush();
+        return ElapsedMs(Start);
+    };
+    const double AllocateMs = RunUploads(false);
+    const double CopyMs = RunUploads(true);
+
+    const double UploadedGB = double(UploadSize) * NumUploads / (1024.0 * 1024.0 * 1024.0);
+    std::printf("Staging ring benchmark: %.2f MB ring (%d iterations)\n", Capacity / (1024.0 * 1024.0), Iterations);
+    std::printf("  Allocate      : %8.3f ms, %.1f ns per allocation\n", AllocateMs, AllocateMs * 1e6 / NumUploads);
+    std::printf("  Allocate+copy : %8.3f ms, %.2f GB/s\n", CopyMs, UploadedGB / (CopyMs / 1000.0));
+}
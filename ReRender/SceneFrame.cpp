@@ -0,0 +1,92 @@
+#include "SceneFrame.h"
+
+#include <glm/include/glm/gtc/matrix_transform.hpp>
+#include <glm/include/glm/gtx/euler_angles.hpp>
+
+#include "MeshSimplifier.h"
+
+void SceneFrame::SetModel(const MeshletData* Meshlets, const std::vector<SubMesh>* SubMeshes, const std::vector<SubMeshLod>* Lods)
+{
+    m_Meshlets = Meshlets;
+    m_SubMeshes = SubMeshes;
+    m_Lods = Lods;
+}
+
+void SceneFrame::Update(Camera& View, const SceneSettings& Scene, float TargetHeight)
+{
+    const Vec3 EyePosition = glm::inverse(View.GetView())[3];
+
+    m_Shadow = ComputeShadowMatrices(Scene.Lights[0]);
+
+    //Update TransformCB
+    {
+        m_Transform.ViewPorjectionMatrix = View.GetProj() * View.GetView();
+        m_Transform.SkyProjectionMatrix = View.GetProj() * View.GetRotation();
+
+        //ObjectMvp
+        //Scale first, then rotate, then translate
+        Mat4 ModelMVP = glm::mat4x4(1);
+        ModelMVP = glm::translate(ModelMVP, Vec3{ 5,0,0 });
+        ModelMVP *= glm::eulerAngleXY(glm::radians(Scene.pitch), glm::radians(Scene.yaw));
+        m_Transform.ObjectMVPMatix = ModelMVP;
+
+        m_MainDraws.clear();
+        m_ShadowDraws.clear();
+        if (m_Meshlets && m_SubMeshes && m_Lods)
+        {
+            //LOD levels come from the main camera, the shadow pass reuses them so both draw the same surface
+            const Vec3 ObjectSpaceEye = Vec3{ glm::inverse(ModelMVP) * glm::vec4{ View.GetPosition(), 1.0f } };
+            const float PixelsPerUnit = TargetHeight * View.GetNearZ() / View.GetNearWindowHeight();
+            MeshSimplifier::SelectLods(*m_SubMeshes, *m_Lods, ObjectSpaceEye, PixelsPerUnit, 1.0f, m_LodLevels);
+
+            MeshletCuller::Cull(*m_Meshlets, *m_SubMeshes, View, ModelMVP, m_MainDraws, &m_LodLevels);
+            MeshSimplifier::AppendLodRanges(*m_SubMeshes, *m_Lods, m_LodLevels, m_MainDraws);
+
+            //The shadow shader draws the model untransformed with LightToTexture as its view projection
+            MeshletCuller::Cull(*m_Meshlets, *m_SubMeshes, m_Shadow.LightToTexture, Vec3{ 0.0f }, false, m_ShadowDraws, &m_LodLevels);
+            MeshSimplifier::AppendLodRanges(*m_SubMeshes, *m_Lods, m_LodLevels, m_ShadowDraws);
+        }
+    }
+
+    //Update Shading constant
+    {
+        m_Shading.EyePosition = Vec4{ EyePosition,0.0f };
+        for (int i = 0; i < SceneSettings::NumLights; ++i)
+        {
+            const Light& light = Scene.Lights[i];
+            m_Shading.Light[i].Direction = Vec4{ light.Direction,0.0f };
+            if (light.Enabel)
+            {
+                m_Shading.Light[i].Radiance = Vec4{ light.Radiance,0.0f };
+            }
+            else
+            {
+                m_Shading.Light[i].Radiance = Vec4{ 1.0,1.0,1.0,0.0 };
+            }
+        }
+    }
+}
+
+ShadowMatrices SceneFrame::ComputeShadowMatrices(const Light& InLight)
+{
+    ShadowMatrices Result;
+    Result.LightPosition = InLight.Position;
+    Result.LightDirection = InLight.Direction;
+    const Vec3 LightUp = Vec3{ 0.0f,1.0f,0.0f };
+
+    Result.LightView = glm::lookAt(Result.LightPosition, Result.LightPosition + Result.LightDirection, LightUp);
+    Result.LightProjection = glm::orthoRH_ZO(-100.0f,100.0f,-100.0f,100.0f,0.0f,1000.0f);
+
+    //NDCToTexture
+    const Mat4 T
+    {
+        0.5f , 0.0f ,0.0f , 0.5f,
+        0.0f , 0.5f , 0.0f , 0.5f,
+        0.0f , 0.0f , 1.0f , 0.0f,
+        0.0f , 0.0f , 0.0f , 1.0f
+    };
+
+    //LightToTexture
+    Result.LightToTexture = T * Result.LightProjection * Result.LightView;
+    return Result;
+}
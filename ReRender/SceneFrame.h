@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Meshlet.h"
+#include "MeshletCuller.h"
+#include "Renderer.h"
+#include "SphericalHarmonics.h"
+
+// Constant buffer layouts of the PBR and skybox shaders, see shaders/hlsl/pbr.hlsl and skybox.hlsl.
+struct TransformCB
+{
+    Mat4 ViewPorjectionMatrix;
+    Mat4 SkyProjectionMatrix;
+    Mat4 ObjectMVPMatix;
+};
+
+struct ShadingCB
+{
+    struct
+    {
+        Vec4 Position;
+        Vec4 Direction;
+        Vec4 Radiance;
+    }Light[SceneSettings::NumLights];
+
+    Vec4 EyePosition;
+    float RenderTargetWidth;
+    float RenderTargetHeight;
+    float NearZ;
+    float FarZ;
+    Mat4 ShadowTransform;
+    IrradianceSH Irradiance;
+};
+
+// Orthographic light view of the shadow map, LightToTexture goes from world space to shadow map UV and depth.
+struct ShadowMatrices
+{
+    Vec3 LightPosition;
+    Vec3 LightDirection;
+    Mat4 LightView;
+    Mat4 LightProjection;
+    Mat4 LightToTexture;
+};
+
+// The CPU half of a frame that does not depend on the graphics API: transform and shading constants, the
+// shadow transform and the LOD-selected, culled draw lists of the model. Every RendererInterface backend runs it
+// in Update and only copies the results to GPU memory and records the passes, so NullRenderer profiles the same
+// work D3D12Renderer does.
+class SceneFrame
+{
+public:
+    // The model's meshlets, submeshes and LODs, owned by the renderer and kept alive while frames are built.
+    void SetModel(const MeshletData* Meshlets, const std::vector<SubMesh>* SubMeshes, const std::vector<SubMeshLod>* Lods);
+
+    // TargetHeight is the height in pixels of the target the model is drawn to, for LOD selection.
+    void Update(Camera& View, const SceneSettings& Scene, float TargetHeight);
+
+    static ShadowMatrices ComputeShadowMatrices(const Light& InLight);
+
+    // Diffuse IBL of the environment, set once after the precompute and kept across frames.
+    void SetIrradiance(const IrradianceSH& Irradiance) { m_Shading.Irradiance = Irradiance; }
+
+    const TransformCB& Transform() const { return m_Transform; }
+    const ShadingCB& Shading() const { return m_Shading; }
+    const ShadowMatrices& Shadow() const { return m_Shadow; }
+
+    // The shadow pass only uses the frustum test, both lists draw the LOD levels selected for the main camera.
+    const std::vector<DrawRange>& MainDraws() const { return m_MainDraws; }
+    const std::vector<DrawRange>& ShadowDraws() const { return m_ShadowDraws; }
+
+private:
+    const MeshletData* m_Meshlets = nullptr;
+    const std::vector<SubMesh>* m_SubMeshes = nullptr;
+    const std::vector<SubMeshLod>* m_Lods = nullptr;
+
+    TransformCB m_Transform = {};
+    ShadingCB m_Shading = {};
+    ShadowMatrices m_Shadow = {};
+
+    std::vector<DrawRange> m_MainDraws;
+    std::vector<DrawRange> m_ShadowDraws;
+    std::vector<uint32_t> m_LodLevels;
+};
@@ -0,0 +1,33 @@
+#include "ScenePasses.h"
+
+#include <utility>
+
+void ScenePasses::Add(RenderGraph& Graph, const Targets& Resources, Hooks PassHooks)
+{
+    //Kept alive, its moves are not visible to the graph
+    Graph.AddPass("Prepare", std::move(PassHooks.Prepare), PassRecording::Serial).KeepAlive();
+
+    Graph.AddPass("Shadow", std::move(PassHooks.Shadow)).Write(Resources.ShadowMap, ResourceState::DepthWrite);
+
+    Graph.AddPass("Skybox", std::move(PassHooks.Skybox))
+        .Write(Resources.SceneColor, ResourceState::RenderTarget)
+        .Write(Resources.SceneDepth, ResourceState::DepthWrite);
+
+    //Draws the debugger's shadow map quad on top
+    Graph.AddPass("PBR", std::move(PassHooks.Pbr))
+        .Read(Resources.ShadowMap, ResourceState::PixelShaderResource)
+        .Write(Resources.SceneColor, ResourceState::RenderTarget)
+        .Write(Resources.SceneDepth, ResourceState::DepthWrite);
+
+    if (Resources.ResolveColor != Resources.SceneColor)
+    {
+        Graph.AddPass("Resolve", std::move(PassHooks.Resolve))
+            .Read(Resources.SceneColor, ResourceState::ResolveSource)
+            .Write(Resources.ResolveColor, ResourceState::ResolveDest);
+    }
+
+    //A full screen triangle
+    Graph.AddPass("Tonemap", std::move(PassHooks.Tonemap))
+        .Read(Resources.ResolveColor, ResourceState::PixelShaderResource)
+        .Write(Resources.BackBuffer, ResourceState::RenderTarget);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "RenderGraph.h"
+
+// The passes of a frame and what each one reads and writes, declared once for D3D12Renderer and NullRenderer so
+// their graphs, barriers and transient heaps stay the same. The backend creates or imports the targets and hooks
+// in what runs inside each pass.
+class ScenePasses
+{
+public:
+    struct Targets
+    {
+        RenderGraphResource ShadowMap = InvalidRenderGraphResource;
+        RenderGraphResource SceneColor = InvalidRenderGraphResource;
+        RenderGraphResource SceneDepth = InvalidRenderGraphResource;
+        // SceneColor itself without MSAA, then there is no Resolve pass.
+        RenderGraphResource ResolveColor = InvalidRenderGraphResource;
+        RenderGraphResource BackBuffer = InvalidRenderGraphResource;
+    };
+
+    // Every hook binds the backend's pipeline, targets and buffers and draws through the context, e.g. with
+    // MeshBuffer::DrawRanges. An empty hook records only the barriers of its pass.
+    struct Hooks
+    {
+        PassFunction Prepare;   // Recorded serially, it may move geometry every later draw reads
+        PassFunction Shadow;
+        PassFunction Skybox;
+        PassFunction Pbr;
+        PassFunction Resolve;
+        PassFunction Tonemap;
+    };
+
+    static void Add(RenderGraph& Graph, const Targets& Resources, Hooks PassHooks);
+};
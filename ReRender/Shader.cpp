@@ -1 +1,165 @@
 #include "Shader.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+
+namespace
+{
+    std::string ReadFile(const std::filesystem::path& FileName, bool& bOpened)
+    {
+        std::ifstream Stream{ FileName, std::ios::binary };
+        bOpened = Stream.is_open();
+        return std::string(std::istreambuf_iterator<char>(Stream), std::istreambuf_iterator<char>());
+    }
+
+    std::string BlobString(ID3DBlob* Blob)
+    {
+        return Blob ? std::string(static_cast<const char*>(Blob->GetBufferPointer()), Blob->GetBufferSize()) : std::string();
+    }
+
+    // Opens includes relative to the shader that is being preprocessed and keeps them until the handler goes away.
+    class FileIncludeHandler final : public ID3DInclude
+    {
+    public:
+        explicit FileIncludeHandler(std::filesystem::path Directory)
+            :m_Directory(std::move(Directory))
+        {}
+
+        HRESULT __stdcall Open(D3D_INCLUDE_TYPE IncludeType, LPCSTR FileName, LPCVOID ParentData, LPCVOID* Data, UINT* Bytes) override
+        {
+            bool bOpened = false;
+            auto Contents = std::make_unique<std::string>(ReadFile(m_Directory / FileName, bOpened));
+            if (!bOpened)
+            {
+                return E_FAIL;
+            }
+            *Data = Contents->data();
+            *Bytes = static_cast<UINT>(Contents->size());
+            m_Files.push_back(std::move(Contents));
+            return S_OK;
+        }
+
+        HRESULT __stdcall Close(LPCVOID Data) override
+        {
+            return S_OK;
+        }
+
+    private:
+        std::filesystem::path m_Directory;
+        std::vector<std::unique_ptr<std::string>> m_Files;
+    };
+}
+
+bool D3DShaderCompiler::Preprocess(const ShaderCompileRequest& Request, std::string& Source, std::string& Errors)
+{
+    bool bOpened = false;
+    const std::string File = ReadFile(Request.FileName, bOpened);
+    if (!bOpened)
+    {
+        Errors = "Cannot open " + Request.FileName;
+        return false;
+    }
+
+    std::vector<D3D_SHADER_MACRO> Macros;
+    for (const auto& Define : Request.Defines)
+    {
+        Macros.push_back({ Define.first.c_str(), Define.second.c_str() });
+    }
+    Macros.push_back({ nullptr, nullptr });
+
+    FileIncludeHandler Includes{ std::filesystem::path(Request.FileName).parent_path() };
+    Microsoft::WRL::ComPtr<ID3DBlob> Output;
+    Microsoft::WRL::ComPtr<ID3DBlob> ErrorBlob;
+    if (FAILED(D3DPreprocess(File.data(), File.size(), Request.FileName.c_str(), Macros.data(), &Includes, &Output, &ErrorBlob)))
+    {
+        Errors = BlobString(ErrorBlob.Get());
+        return false;
+    }
+
+    //The blob is null terminated
+    Source = BlobString(Output.Get());
+    while (!Source.empty() && Source.back() == '\0')
+    {
+        Source.pop_back();
+    }
+    return true;
+}
+
+bool D3DShaderCompiler::Compile(const ShaderCompileRequest& Request, const std::string& Source, std::vector<uint8_t>& Bytecode, std::string& Errors)
+{
+    //Includes and defines are already expanded, the #line directives keep the messages pointing at the real files
+    Microsoft::WRL::ComPtr<ID3DBlob> Output;
+    Microsoft::WRL::ComPtr<ID3DBlob> ErrorBlob;
+    if (FAILED(D3DCompile(
+        Source.data(),
+        Source.size(),
+        Request.FileName.c_str(),
+        nullptr,
+        nullptr,
+        Request.EntryPoint.c_str(),
+        Request.Profile.c_str(),
+        Request.Flags,
+        0,
+        &Output,
+        &ErrorBlob)))
+    {
+        Errors = BlobString(ErrorBlob.Get());
+        return false;
+    }
+
+    const uint8_t* Data = static_cast<const uint8_t*>(Output->GetBufferPointer());
+    Bytecode.assign(Data, Data + Output->GetBufferSize());
+    return true;
+}
+
+std::string D3DShaderCompiler::Version() const
+{
+    return "d3dcompiler_" + std::to_string(D3D_COMPILER_VERSION);
+}
+
+ShaderCompileRequest Shader::Request(
+    const std::string& filename,
+    const std::string& entryPoint,
+    const std::string& profile,
+    const std::vector<std::pair<std::string, std::string>>& Defines)
+{
+    ShaderCompileRequest Result;
+    Result.FileName = filename;
+    Result.EntryPoint = entryPoint;
+    Result.Profile = profile;
+    Result.Defines = Defines;
+    Result.Flags = D3DCOMPILE_ENABLE_STRICTNESS;
+#if  _DEBUG
+    Result.Flags |= D3DCOMPILE_DEBUG;
+    Result.Flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+    return Result;
+}
+
+Microsoft::WRL::ComPtr<ID3DBlob> Shader::compileShader(
+    const std::string& filename,
+    const std::string& entryPoint,
+    const std::string& profile,
+    const std::vector<std::pair<std::string, std::string>>& Defines)
+{
+    const std::vector<uint8_t> Bytecode = Cache().Compile(Request(filename, entryPoint, profile, Defines));
+
+    Microsoft::WRL::ComPtr<ID3DBlob> Blob;
+    if (FAILED(D3DCreateBlob(Bytecode.size(), &Blob)))
+    {
+        throw std::runtime_error("Failed to allocate shader blob: " + filename);
+    }
+    std::memcpy(Blob->GetBufferPointer(), Bytecode.data(), Bytecode.size());
+    return Blob;
+}
+
+ShaderCache& Shader::Cache()
+{
+    static D3DShaderCompiler Compiler;
+    static ShaderCache Instance{ "shaders/cache", Compiler };
+    return Instance;
+}
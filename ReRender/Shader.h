@@ -3,45 +3,38 @@
 #include <d3dcompiler.h>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 #include <wrl/client.h>
 
-#include "Utils.h"
+#include "ShaderCache.h"
 
-class Shader
+// ShaderCompilerBackend over d3dcompiler_47: D3DPreprocess resolves includes next to the shader file, D3DCompile
+// then compiles the expanded text.
+class D3DShaderCompiler final : public ShaderCompilerBackend
 {
 public:
-    static Microsoft::WRL::ComPtr<ID3DBlob> compileShader(const std::string& filename, const std::string& entryPoint, const std::string& profile)
-    {
-        UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if  _DEBUG
-        flags |= D3DCOMPILE_DEBUG;
-        flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-
-        Microsoft::WRL::ComPtr<ID3DBlob> Shader;
-        Microsoft::WRL::ComPtr<ID3DBlob> ErrorBlob;
+    bool Preprocess(const ShaderCompileRequest& Request, std::string& Source, std::string& Errors) override;
+    bool Compile(const ShaderCompileRequest& Request, const std::string& Source, std::vector<uint8_t>& Bytecode, std::string& Errors) override;
+    std::string Version() const override;
+};
 
-        std::printf("Compiling HLSL shader: %s [%s]\n", filename.c_str(), entryPoint.c_str());
+class Shader
+{
+public:
+    //Goes through the bytecode cache in shaders/cache, throws std::runtime_error if compilation fails
+    static Microsoft::WRL::ComPtr<ID3DBlob> compileShader(
+        const std::string& filename,
+        const std::string& entryPoint,
+        const std::string& profile,
+        const std::vector<std::pair<std::string, std::string>>& Defines = {});
 
-        if (FAILED(D3DCompileFromFile(
-            Utils::convertToUTF16(filename).c_str(),
-            nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE,
-            entryPoint.c_str(),
-            profile.c_str(),
-            flags,
-            0,
-            &Shader,
-            &ErrorBlob)))
-        {
-            std::string ErrorMsg = "Shader compilation failed: " + filename;
-            if (ErrorBlob)
-            {
-                ErrorMsg += std::string("\n") + static_cast<const char*>(ErrorBlob->GetBufferPointer());
-            }
+    //Request with the build's default flags, for compiles that go through the cache directly
+    static ShaderCompileRequest Request(
+        const std::string& filename,
+        const std::string& entryPoint,
+        const std::string& profile,
+        const std::vector<std::pair<std::string, std::string>>& Defines = {});
 
-            throw std::runtime_error(ErrorMsg);
-        }
-        return Shader;
-    }
+    static ShaderCache& Cache();
 };
-
@@ -0,0 +1,436 @@
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "PortableUtils.h"
+
+namespace
+{
+    // Length prefixed so "ab"+"c" and "a"+"bc" hash differently.
+    uint64_t HashField(uint64_t Seed, const std::string& Field)
+    {
+        return Hash::Fnv1a64(Field, Hash::Combine(Seed, static_cast<uint64_t>(Field.size())));
+    }
+
+    uint64_t HashIdentity(const ShaderCompileRequest& Request)
+    {
+        uint64_t Result = HashField(Hash::OffsetBasis, Request.FileName);
+        Result = HashField(Result, Request.EntryPoint);
+        Result = HashField(Result, Request.Profile);
+        for (const auto& Define : Request.Defines)
+        {
+            Result = HashField(Result, Define.first);
+            Result = HashField(Result, Define.second);
+        }
+        return Hash::Combine(Result, Request.Flags);
+    }
+}
+
+ShaderCache::ShaderCache(std::string Directory, ShaderCompilerBackend& Backend)
+    :m_Directory(std::move(Directory))
+    ,m_Backend(Backend)
+{
+    //Without the directory every lookup misses and every save fails, compiling still works
+    std::error_code Error;
+    std::filesystem::create_directories(m_Directory, Error);
+}
+
+std::string ShaderCache::CachePath(const ShaderCompileRequest& Request) const
+{
+    const std::string Stem = std::filesystem::path(Request.FileName).stem().string();
+    return m_Directory + "/" + Stem + "_" + Request.EntryPoint + "_" + Hash::ToHex(HashIdentity(Request)) + ".rshader";
+}
+
+uint64_t ShaderCache::Key(const ShaderCompileRequest& Request, const std::string& PreprocessedSource, const std::string& CompilerVersion)
+{
+    uint64_t Result = HashIdentity(Request);
+    Result = HashField(Result, CompilerVersion);
+    return HashField(Result, PreprocessedSource);
+}
+
+std::vector<uint8_t> ShaderCache::Compile(const ShaderCompileRequest& Request)
+{
+    auto Start = std::chrono::high_resolution_clock::now();
+    std::string Source;
+    std::string Errors;
+    if (!m_Backend.Preprocess(Request, Source, Errors))
+    {
+        throw std::runtime_error("Shader preprocessing failed: " + Request.FileName + "\n" + Errors);
+    }
+    const double PreprocessMs = ElapsedMs(Start);
+
+    const uint64_t CacheKey = Key(Request, Source, m_Backend.Version());
+    const std::string CacheFile = CachePath(Request);
+
+    Start = std::chrono::high_resolution_clock::now();
+    std::vector<uint8_t> Bytecode;
+    const LoadResult Result = Load(CacheFile, CacheKey, Bytecode);
+    const double LoadMs = ElapsedMs(Start);
+    if (Result == LoadResult::Hit)
+    {
+        std::lock_guard<std::mutex> Lock{ m_StatsMutex };
+        ++m_Stats.Hits;
+        m_Stats.PreprocessMs += PreprocessMs;
+        m_Stats.LoadMs += LoadMs;
+        return Bytecode;
+    }
+
+    //Drop the stale entry before compiling so a failing edit cannot leave it behind to be trusted later
+    if (Result != LoadResult::Missing)
+    {
+        std::remove(CacheFile.c_str());
+    }
+
+    std::printf("Compiling HLSL shader: %s [%s]\n", Request.FileName.c_str(), Request.EntryPoint.c_str());
+    Start = std::chrono::high_resolution_clock::now();
+    if (!m_Backend.Compile(Request, Source, Bytecode, Errors))
+    {
+        throw std::runtime_error("Shader compilation failed: " + Request.FileName + "\n" + Errors);
+    }
+    const double CompileMs = ElapsedMs(Start);
+    Save(CacheFile, CacheKey, Bytecode);
+
+    std::lock_guard<std::mutex> Lock{ m_StatsMutex };
+    ++m_Stats.Misses;
+    m_Stats.Stale += Result == LoadResult::Stale ? 1 : 0;
+    m_Stats.Corrupt += Result == LoadResult::Corrupt ? 1 : 0;
+    m_Stats.PreprocessMs += PreprocessMs;
+    m_Stats.LoadMs += LoadMs;
+    m_Stats.CompileMs += CompileMs;
+    return Bytecode;
+}
+
+ShaderCache::LoadResult ShaderCache::Load(const std::string& CacheFile, uint64_t Key, std::vector<uint8_t>& Bytecode) const
+{
+    //The mapping is released on return, Compile may delete the file afterwards
+    std::shared_ptr<MappedFile> File = MappedFile::Open(CacheFile);
+    if (!File)
+    {
+        return LoadResult::Missing;
+    }
+    if (File->Size() < sizeof(ShaderCacheHeader))
+    {
+        return LoadResult::Corrupt;
+    }
+
+    const ShaderCacheHeader& Header = *File->At<ShaderCacheHeader>(0);
+    if (Header.Magic != Magic || Header.Version != Version || Header.Key != Key)
+    {
+        return LoadResult::Stale;
+    }
+    if (Header.BytecodeSize == 0 ||
+        Header.BytecodeSize != File->Size() - sizeof(ShaderCacheHeader) ||
+        Hash::Fnv1a64(File->Data() + sizeof(ShaderCacheHeader), Header.BytecodeSize) != Header.BytecodeHash)
+    {
+        return LoadResult::Corrupt;
+    }
+
+    Bytecode.assign(File->Data() + sizeof(ShaderCacheHeader), File->Data() + File->Size());
+    return LoadResult::Hit;
+}
+
+bool ShaderCache::Save(const std::string& CacheFile, uint64_t Key, const std::vector<uint8_t>& Bytecode) const
+{
+    ShaderCacheHeader Header = {};
+    Header.Magic = Magic;
+    Header.Version = Version;
+    Header.Key = Key;
+    Header.BytecodeSize = Bytecode.size();
+    Header.BytecodeHash = Hash::Fnv1a64(Bytecode.data(), Bytecode.size());
+
+    // Write next to the final file and rename so a crash never leaves a half-written entry behind. The temp name
+    // is per thread in case two threads compile the same shader.
+    std::ostringstream TempFile;
+    TempFile << CacheFile << "." << std::this_thread::get_id() << ".tmp";
+    {
+        std::ofstream Stream{ TempFile.str(), std::ios::binary | std::ios::trunc };
+        if (!Stream.is_open())
+        {
+            return false;
+        }
+        Stream.write(reinterpret_cast<const char*>(&Header), sizeof(Header));
+        Stream.write(reinterpret_cast<const char*>(Bytecode.data()), Bytecode.size());
+        if (!Stream.good())
+        {
+            Stream.close();
+            std::remove(TempFile.str().c_str());
+            return false;
+        }
+    }
+
+    std::remove(CacheFile.c_str());
+    if (std::rename(TempFile.str().c_str(), CacheFile.c_str()) != 0)
+    {
+        std::remove(TempFile.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+ShaderCacheStats ShaderCache::Stats() const
+{
+    std::lock_guard<std::mutex> Lock{ m_StatsMutex };
+    return m_Stats;
+}
+
+void ShaderCache::PrintStats(const char* Name) const
+{
+    const ShaderCacheStats Current = Stats();
+    std::printf("Shader cache: %s (%s)\n", Name, m_Directory.c_str());
+    std::printf("  Requests      : %zu hits, %zu misses (%zu stale, %zu corrupt)\n", Current.Hits, Current.Misses, Current.Stale, Current.Corrupt);
+    std::printf("  Time          : %.2f ms preprocessing, %.2f ms loading, %.2f ms compiling\n", Current.PreprocessMs, Current.LoadMs, Current.CompileMs);
+}
+
+namespace
+{
+    // Stand-in compiler for the self test. Sources live in memory, #include "name" lines are expanded
+    // recursively, "bytecode" is the reversed source, and a source containing "#error" fails to compile.
+    class FakeShaderCompiler final : public ShaderCompilerBackend
+    {
+    public:
+        std::vector<std::pair<std::string, std::string>> Files;
+        std::string CompilerVersion = "fake 1.0";
+        size_t Compiles = 0;
+
+        void SetFile(const std::string& Name, const std::string& Contents)
+        {
+            for (auto& File : Files)
+            {
+                if (File.first == Name)
+                {
+                    File.second = Contents;
+                    return;
+                }
+            }
+            Files.emplace_back(Name, Contents);
+        }
+
+        bool Preprocess(const ShaderCompileRequest& Request, std::string& Source, std::string& Errors) override
+        {
+            Source.clear();
+            for (const auto& Define : Request.Defines)
+            {
+                Source += "#define " + Define.first + " " + Define.second + "\n";
+            }
+            return Expand(Request.FileName, Source, Errors, 0);
+        }
+
+        bool Compile(const ShaderCompileRequest& Request, const std::string& Source, std::vector<uint8_t>& Bytecode, std::string& Errors) override
+        {
+            ++Compiles;
+            if (Source.find("#error") != std::string::npos)
+            {
+                Errors = Request.FileName + ": #error";
+                return false;
+            }
+            Bytecode.assign(Source.rbegin(), Source.rend());
+            Bytecode.push_back(static_cast<uint8_t>(Request.Flags));
+            return true;
+        }
+
+        std::string Version() const override
+        {
+            return CompilerVersion;
+        }
+
+    private:
+        bool Expand(const std::string& Name, std::string& Source, std::string& Errors, int Depth) const
+        {
+            const auto File = std::find_if(Files.begin(), Files.end(), [&Name](const auto& Entry) { return Entry.first == Name; });
+            if (File == Files.end() || Depth > 16)
+            {
+                Errors = "cannot open " + Name;
+                return false;
+            }
+            std::istringstream Lines{ File->second };
+            std::string Line;
+            while (std::getline(Lines, Line))
+            {
+                const std::string Directive = "#include \"";
+                if (Line.compare(0, Directive.size(), Directive) == 0)
+                {
+                    if (!Expand(Line.substr(Directive.size(), Line.size() - Directive.size() - 1), Source, Errors, Depth + 1))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                Source += Line + "\n";
+            }
+            return true;
+        }
+    };
+}
+
+bool ShaderCache::SelfTest()
+{
+    TestHarness Harness;
+
+    const std::filesystem::path Scratch = std::filesystem::temp_directory_path() / "rerender_shadercache_test";
+    std::error_code Error;
+    std::filesystem::remove_all(Scratch, Error);
+    const std::string Directory = Scratch.string();
+
+    FakeShaderCompiler Compiler;
+    Compiler.SetFile("pbr.hlsl", "#include \"common.hlsli\"\nfloat4 main_ps() : SV_Target { return Shade(); }\n");
+    Compiler.SetFile("common.hlsli", "float4 Shade() { return 1; }\n");
+    Compiler.SetFile("tonemap.hlsl", "float4 main_ps() : SV_Target { return 0.5; }\n");
+
+    ShaderCompileRequest Pbr;
+    Pbr.FileName = "pbr.hlsl";
+    Pbr.EntryPoint = "main_ps";
+    Pbr.Profile = "ps_5_0";
+
+    std::printf("Shader cache self test\n");
+
+    Harness.Run("Miss then hit across launches", [&]()
+    {
+        std::vector<uint8_t> First;
+        {
+            ShaderCache Cache{ Directory, Compiler };
+            First = Cache.Compile(Pbr);
+            Harness.Check(Cache.Stats().Misses == 1 && Compiler.Compiles == 1, "a cold cache compiles");
+        }
+        ShaderCache Cache{ Directory, Compiler };
+        const std::vector<uint8_t> Second = Cache.Compile(Pbr);
+        Harness.Check(Cache.Stats().Hits == 1 && Compiler.Compiles == 1, "a new cache instance hits what the last one saved");
+        Harness.Check(First == Second, "cached bytecode matches the compiled bytecode");
+    });
+
+    Harness.Run("Include edits", [&]()
+    {
+        ShaderCache Cache{ Directory, Compiler };
+        const std::vector<uint8_t> Before = Cache.Compile(Pbr);
+        Compiler.SetFile("common.hlsli", "float4 Shade() { return 2; }\n");
+        const std::vector<uint8_t> After = Cache.Compile(Pbr);
+        Harness.Check(Cache.Stats().Stale == 1 && Compiler.Compiles == 2, "an edited include invalidates the entry");
+        Harness.Check(Before != After, "the recompiled bytecode is returned");
+        Harness.Check(Cache.Compile(Pbr) == After && Compiler.Compiles == 2, "the replacement entry hits");
+        Harness.Check(std::distance(std::filesystem::directory_iterator(Scratch), std::filesystem::directory_iterator()) == 1, "the stale entry was replaced, not kept");
+    });
+
+    Harness.Run("Defines, profiles and flags", [&]()
+    {
+        ShaderCache Cache{ Directory, Compiler };
+        ShaderCompileRequest Variant = Pbr;
+        Variant.Defines = { { "SHADOWS", "1" } };
+        ShaderCompileRequest Debug = Pbr;
+        Debug.Flags = 1;
+        ShaderCompileRequest Profile = Pbr;
+        Profile.Profile = "ps_5_1";
+        Harness.Check(Cache.CachePath(Variant) != Cache.CachePath(Pbr) && Cache.CachePath(Debug) != Cache.CachePath(Pbr) &&
+            Cache.CachePath(Profile) != Cache.CachePath(Pbr), "every variant gets an entry of its own");
+
+        const size_t Compiles = Compiler.Compiles;
+        const std::vector<uint8_t> Base = Cache.Compile(Pbr);
+        const std::vector<uint8_t> Shadowed = Cache.Compile(Variant);
+        Cache.Compile(Debug);
+        Cache.Compile(Profile);
+        Harness.Check(Compiler.Compiles == Compiles + 3, "each variant compiles once");
+        Harness.Check(Cache.Compile(Pbr) == Base && Cache.Compile(Variant) == Shadowed && Compiler.Compiles == Compiles + 3, "variants do not evict each other");
+    });
+
+    Harness.Run("Compiler upgrade", [&]()
+    {
+        ShaderCache Cache{ Directory, Compiler };
+        Compiler.CompilerVersion = "fake 1.1";
+        const size_t Compiles = Compiler.Compiles;
+        Cache.Compile(Pbr);
+        Harness.Check(Cache.Stats().Stale == 1 && Compiler.Compiles == Compiles + 1, "a new compiler version invalidates the entry");
+    });
+
+    Harness.Run("Corrupted and truncated entries", [&]()
+    {
+        ShaderCache Cache{ Directory, Compiler };
+        const std::vector<uint8_t> Expected = Cache.Compile(Pbr);
+        const std::string CacheFile = Cache.CachePath(Pbr);
+        const uintmax_t Size = std::filesystem::file_size(CacheFile);
+        {
+            std::fstream Stream{ CacheFile, std::ios::binary | std::ios::in | std::ios::out };
+            Stream.seekp(sizeof(ShaderCacheHeader) + 3);
+            Stream.put('X');
+        }
+        const size_t Compiles = Compiler.Compiles;
+        Harness.Check(Cache.Compile(Pbr) == Expected && Compiler.Compiles == Compiles + 1, "a flipped payload byte is detected and recompiled");
+
+        std::filesystem::resize_file(CacheFile, Size - 5);
+        Harness.Check(Cache.Compile(Pbr) == Expected && Compiler.Compiles == Compiles + 2, "a truncated entry is detected and recompiled");
+        std::filesystem::resize_file(CacheFile, 7);
+        Harness.Check(Cache.Compile(Pbr) == Expected && Compiler.Compiles == Compiles + 3, "a cut off header is detected and recompiled");
+        Harness.Check(Cache.Stats().Corrupt == 3, "all three count as corrupt");
+        Harness.Check(Cache.Compile(Pbr) == Expected && Compiler.Compiles == Compiles + 3, "the rewritten entry hits");
+    });
+
+    Harness.Run("Compile errors", [&]()
+    {
+        ShaderCache Cache{ Directory, Compiler };
+        Cache.Compile(Pbr);
+        Compiler.SetFile("common.hlsli", "#error broken\n");
+        bool bThrew = false;
+        try
+        {
+            Cache.Compile(Pbr);
+        }
+        catch (const std::runtime_error&)
+        {
+            bThrew = true;
+        }
+        Harness.Check(bThrew, "a failed compile throws");
+        Harness.Check(!std::filesystem::exists(Cache.CachePath(Pbr)), "the stale entry is dropped even though nothing replaced it");
+
+        ShaderCompileRequest Missing = Pbr;
+        Missing.FileName = "missing.hlsl";
+        bThrew = false;
+        try
+        {
+            Cache.Compile(Missing);
+        }
+        catch (const std::runtime_error&)
+        {
+            bThrew = true;
+        }
+        Harness.Check(bThrew, "a failed preprocess throws");
+        Compiler.SetFile("common.hlsli", "float4 Shade() { return 2; }\n");
+    });
+
+    Harness.Run("Parallel requests", [&]()
+    {
+        ShaderCache Cache{ Directory, Compiler };
+        ShaderCompileRequest Tonemap = Pbr;
+        Tonemap.FileName = "tonemap.hlsl";
+        const std::vector<uint8_t> Expected[] = { Cache.Compile(Pbr), Cache.Compile(Tonemap) };
+
+        //The fake compiler is not thread safe, so every thread only hits
+        bool bMismatch[8] = {};
+        std::vector<std::thread> Threads;
+        for (int Thread = 0; Thread < 8; ++Thread)
+        {
+            Threads.emplace_back([&, Thread]()
+            {
+                for (int i = 0; i < 50; ++i)
+                {
+                    bMismatch[Thread] |= Cache.Compile((Thread + i) % 2 ? Tonemap : Pbr) != Expected[(Thread + i) % 2];
+                }
+            });
+        }
+        for (std::thread& Thread : Threads)
+        {
+            Thread.join();
+        }
+        Harness.Check(std::none_of(std::begin(bMismatch), std::end(bMismatch), [](bool bValue) { return bValue; }), "concurrent hits return the right bytecode");
+        Harness.Check(Cache.Stats().Hits == 400, "every concurrent request is counted");
+    });
+
+    std::filesystem::remove_all(Scratch, Error);
+    return Harness.Finish();
+}
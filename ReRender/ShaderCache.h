@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ShaderCompileRequest
+{
+    std::string FileName;
+    std::string EntryPoint;
+    std::string Profile;
+    std::vector<std::pair<std::string, std::string>> Defines;
+    uint32_t Flags = 0;
+};
+
+// Compiler behind the ShaderCache. Preprocess expands includes and defines, the cache keys on its output and
+// hands the same text to Compile so the bytecode always matches the key. Both return false and fill Errors on
+// failure.
+class ShaderCompilerBackend
+{
+public:
+    virtual ~ShaderCompilerBackend() = default;
+
+    virtual bool Preprocess(const ShaderCompileRequest& Request, std::string& Source, std::string& Errors) = 0;
+    virtual bool Compile(const ShaderCompileRequest& Request, const std::string& Source, std::vector<uint8_t>& Bytecode, std::string& Errors) = 0;
+
+    // Changes with the compiler build, folded into every key.
+    virtual std::string Version() const = 0;
+};
+
+// On-disk layout: header, then the bytecode. One file per file/entry/profile/defines/flags identity, so a
+// changed source overwrites its stale entry instead of piling up next to it.
+struct ShaderCacheHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t Key;
+    uint64_t BytecodeSize;
+    uint64_t BytecodeHash;
+};
+static_assert(sizeof(ShaderCacheHeader) == 32);
+
+struct ShaderCacheStats
+{
+    size_t Hits = 0;
+    size_t Misses = 0;
+    size_t Stale = 0;
+    size_t Corrupt = 0;
+    double PreprocessMs = 0.0;
+    double CompileMs = 0.0;
+    double LoadMs = 0.0;
+};
+
+// Persistent bytecode cache. Every request is preprocessed, and the key hashes the preprocessed source with the
+// entry point, profile, defines, flags and compiler version, so an edited include is a miss like an edited
+// file. Entries with another key or a broken payload are deleted and recompiled. Safe to call from several
+// threads for different shaders.
+class ShaderCache
+{
+public:
+    static const uint32_t Magic = 0x43534852; // "RHSC"
+    static const uint32_t Version = 1;
+
+    ShaderCache(std::string Directory, ShaderCompilerBackend& Backend);
+
+    // Throws std::runtime_error with the compiler's messages if preprocessing or compilation fails.
+    std::vector<uint8_t> Compile(const ShaderCompileRequest& Request);
+
+    std::string CachePath(const ShaderCompileRequest& Request) const;
+    static uint64_t Key(const ShaderCompileRequest& Request, const std::string& PreprocessedSource, const std::string& CompilerVersion);
+
+    ShaderCacheStats Stats() const;
+    void PrintStats(const char* Name) const;
+
+    // Runs hits, misses, include and define edits, compiler upgrades, corrupted and truncated entries and
+    // compile errors against a fake compiler in a scratch directory. No GPU or D3D compiler needed.
+    static bool SelfTest();
+
+private:
+    enum class LoadResult
+    {
+        Hit,
+        Missing,
+        Stale,
+        Corrupt,
+    };
+
+    LoadResult Load(const std::string& CacheFile, uint64_t Key, std::vector<uint8_t>& Bytecode) const;
+    bool Save(const std::string& CacheFile, uint64_t Key, const std::vector<uint8_t>& Bytecode) const;
+
+    std::string m_Directory;
+    ShaderCompilerBackend& m_Backend;
+
+    mutable std::mutex m_StatsMutex;
+    ShaderCacheStats m_Stats;
+};
@@ -13,8 +13,11 @@ ShadowMap::ShadowMap(
     UINT InWidth, UINT InHeight,
     UINT SamperCount,
     const std::vector<D3D12_INPUT_ELEMENT_DESC> Layout,
+    VertexFormat ModelFormat,
     CD3DX12_STATIC_SAMPLER_DESC& DefaultSamplerDesc,
-    D3D_ROOT_SIGNATURE_VERSION& RootSignatureVersion):
+    D3D_ROOT_SIGNATURE_VERSION& RootSignatureVersion,
+    D3D12PipelineLibrary& Pipelines,
+    GpuHeapManager* HeapManager):
     m_Device(Device),
     m_DescHeapCBV_SRV_UAV(InDescHeapCBV_SRV_UAV),
     m_DescHeapDsv(InDescHeapDsv),
@@ -26,44 +29,29 @@ ShadowMap::ShadowMap(
 {
     // DescriptorHeapMark mark(m_DescHeapCBV_SRV_UAV);
 
-    ShadowMapTexture = Texture::CreateTexture(m_Device, m_DescHeapCBV_SRV_UAV, Width, Height, 1, DXGI_FORMAT_R24G8_TYPELESS, 1,D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+    ShadowMapTexture = Texture::CreateTexture(m_Device, m_DescHeapCBV_SRV_UAV, Width, Height, 1, DXGI_FORMAT_R24G8_TYPELESS, 1,D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL, HeapManager);
 
     //ShadowMapĸǩPSO
     {
-        ComPtr<ID3DBlob> ShadowMapVS = Shader::compileShader(
-            "shaders/hlsl/ShadowMap.hlsl",
-            "main_vs",
-            "vs_5_0"
-            );
-
-        ComPtr<ID3DBlob> ShadowMapPS = Shader::compileShader(
-            "shaders/hlsl/ShadowMap.hlsl",
-            "main_ps",
-            "ps_5_0"
-            );
-
-        const CD3DX12_DESCRIPTOR_RANGE1 DescriptorRanges[] =
-        {
-            {
-                D3D12_DESCRIPTOR_RANGE_TYPE_CBV,1,0,0,
-                D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC
-            }
-        };
-
-        CD3DX12_ROOT_PARAMETER1 root_parameter[1];
-        root_parameter[0].InitAsDescriptorTable(1, &DescriptorRanges[0], D3D12_SHADER_VISIBILITY_VERTEX);
+        CD3DX12_ROOT_PARAMETER1 root_parameter[2];
+        root_parameter[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_VERTEX);
+        root_parameter[1].InitAsConstants(sizeof(PackedPositionConstants) / sizeof(uint32_t), 2, 0, D3D12_SHADER_VISIBILITY_VERTEX);
 
         CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC SignatureDesc = {};
-        SignatureDesc.Init_1_1(1, root_parameter, 1, &m_DefaultSamplerDesc,
+        SignatureDesc.Init_1_1(2, root_parameter, 1, &m_DefaultSamplerDesc,
             D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
         m_ShadowSignature = RootSignature::CreateRootSignature(m_Device, m_RootSignatureVersion, SignatureDesc);
 
-        D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-        psoDesc.pRootSignature = m_ShadowSignature.Get();
-        psoDesc.InputLayout = { Layout.data(), (UINT)Layout.size() };
-        psoDesc.VS = CD3DX12_SHADER_BYTECODE(ShadowMapVS.Get());
-        psoDesc.PS = CD3DX12_SHADER_BYTECODE(ShadowMapPS.Get());
+        const bool bPacked = ModelFormat == VertexFormat::Packed;
+        GraphicsPipelineDesc Pipeline;
+        Pipeline.Name = bPacked ? "ShadowMapPackedPSO" : "ShadowMapPSO";
+        Pipeline.RootSignature = m_ShadowSignature;
+        Pipeline.VS = Shader::Request("shaders/hlsl/ShadowMap.hlsl", bPacked ? "main_vs_packed" : "main_vs", "vs_5_0");
+        Pipeline.PS = Shader::Request("shaders/hlsl/ShadowMap.hlsl", "main_ps", "ps_5_0");
+        Pipeline.InputLayout = bPacked ? MeshBuffer::PackedInputLayout() : Layout;
+
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc = Pipeline.Desc;
         psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
         psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
         psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
@@ -78,10 +66,7 @@ ShadowMap::ShadowMap(
         psoDesc.SampleMask = UINT_MAX;
         psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 
-        if (FAILED(m_Device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_ShadowPipelineState)))) 
-        {
-            throw std::runtime_error("Failed to create graphics pipeline state for ShadowMap");
-        }
+        m_ShadowPipeline = Pipelines.AddGraphics(std::move(Pipeline));
     }
 
     //ӿ
@@ -101,45 +86,30 @@ ShadowMap::ShadowMap(
 
 
      Re::SetName(ShadowMapTexture.texture.Get(), std::string("ShadowMapTexture").c_str());
-     Re::SetName(m_ShadowPipelineState.Get(), std::string("ShadowMapPSO").c_str());
      Re::SetName(m_ShadowSignature.Get(), std::string("ShadowMapRootSignature").c_str());
      Re::SetName(m_DescHeapCBV_SRV_UAV.Heap.Get(), std::string("UAV_SAR_CBV").c_str());
      Re::SetName(m_DescHeapDsv.Heap.Get(), std::string("DsvHeap").c_str());
 }
 
-void ShadowMap::UpdateShadowTransform(const float DeltaTime,Light InLight, ConstantBufferView ConstantBuffer)
+void ShadowMap::UpdateShadowTransform(const ShadowMatrices& Matrices, const UploadBufferRegion& ConstantBuffer)
 {
-    m_LightPosition = InLight.Position;
-    m_LightDirection = InLight.Direction;
-    auto LightUp = Vec3{ 0.0f,1.0f,0.0f };
-
-    m_LightView = glm::lookAt(m_LightPosition, m_LightPosition + m_LightDirection, LightUp);
-
-    m_LightProject = glm::orthoRH_ZO(-100.0f,100.0f,-100.0f,100.0f,0.0f,1000.0f);
-
-    //NDCToTexture
-    Mat4 T
-    { 
-        0.5f , 0.0f ,0.0f , 0.5f,
-        0.0f , 0.5f , 0.0f , 0.5f,
-        0.0f , 0.0f , 1.0f , 0.0f,
-        0.0f , 0.0f , 0.0f , 1.0f
-    };
-
-    //LightToTexture
-    m_LightToTexture = T * m_LightProject * m_LightView;
+    m_LightPosition = Matrices.LightPosition;
+    m_LightDirection = Matrices.LightDirection;
+    m_LightView = Matrices.LightView;
+    m_LightProject = Matrices.LightProjection;
+    m_LightToTexture = Matrices.LightToTexture;
 
     UpdateShadowConstantBuffer(ConstantBuffer);
 }
 
-void ShadowMap::UpdateShadowConstantBuffer(ConstantBufferView ConstantBuffer)
+void ShadowMap::UpdateShadowConstantBuffer(const UploadBufferRegion& ConstantBuffer)
 {
     CpuConstant.Light2Tetxure = m_LightToTexture;
     CpuConstant.NearZ = 0.1f;
     CpuConstant.FarZ = 1000.0f;
     CpuConstant.RenderTargetSize = { 1024.0f,1024.0f };
 
-    Constant4Shader* ShadowConstantInBuffer = ConstantBuffer.as<Constant4Shader>();
+    Constant4Shader* ShadowConstantInBuffer = reinterpret_cast<Constant4Shader*>(ConstantBuffer.CpuAddress);
     ShadowConstantInBuffer->FarZ = CpuConstant.FarZ;
     ShadowConstantInBuffer->NearZ = CpuConstant.NearZ;
     ShadowConstantInBuffer->Light2Tetxure = CpuConstant.Light2Tetxure;
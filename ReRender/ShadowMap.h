@@ -4,7 +4,10 @@
 #include <wrl/client.h>
 
 #include "Camera.h"
+#include "D3D12PipelineLibrary.h"
+#include "MeshBuffer.h"
 #include "renderer.h"
+#include "SceneFrame.h"
 #include "Texture.h"
 #include "UploadBuffer.h"
 
@@ -22,6 +25,8 @@ struct Constant4Shader
 class ShadowMap
 {
 public:
+    //Layout is the one of the full Vertex, a VertexFormat::Packed model gets MeshBuffer::PackedInputLayout and the
+    //decoding vertex shader instead, with the dequantization constants at root parameter 1
     ShadowMap(
         ComPtr<ID3D12Device> m_Device,
         DescriptorHeap& m_DescHeapCBV_SRV_UAV,
@@ -30,15 +35,20 @@ public:
         UINT Height,
         UINT SamperCount,
         const std::vector<D3D12_INPUT_ELEMENT_DESC> Layout,
+        VertexFormat ModelFormat,
         CD3DX12_STATIC_SAMPLER_DESC& DefaultSamplerDesc,
-        D3D_ROOT_SIGNATURE_VERSION& RootSignatureVersion);
+        D3D_ROOT_SIGNATURE_VERSION& RootSignatureVersion,
+        D3D12PipelineLibrary& Pipelines,
+        GpuHeapManager* HeapManager = nullptr);
 
-    void UpdateShadowTransform(const float DeltaTime,Light InLight, ConstantBufferView ConstantBuffer);
-    void UpdateShadowConstantBuffer(ConstantBufferView ConstantBuffer);
+    //Matrices come from SceneFrame, the same ones its shadow draws were culled with
+    void UpdateShadowTransform(const ShadowMatrices& Matrices, const UploadBufferRegion& ConstantBuffer);
+    void UpdateShadowConstantBuffer(const UploadBufferRegion& ConstantBuffer);
 
     ComPtr<ID3D12Device> m_Device;
     ComPtr<ID3D12RootSignature> m_ShadowSignature;
-    ComPtr<ID3D12PipelineState> m_ShadowPipelineState;
+    //Built on the pipeline library's pool, fetch it with Pipelines.Get
+    PipelineHandle m_ShadowPipeline = InvalidPipeline;
 
     DescriptorHeap& m_DescHeapCBV_SRV_UAV;
     DescriptorHeap& m_DescHeapDsv;
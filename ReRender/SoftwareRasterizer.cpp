@@ -0,0 +1,858 @@
+#include "SoftwareRasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <emmintrin.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <glm/include/glm/gtc/matrix_transform.hpp>
+
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    constexpr uint32_t InvalidTriangle = ~0u;
+    constexpr int32_t SubPixelBits = 4;
+    constexpr int32_t SubPixels = 1 << SubPixelBits;
+    //Triangles queued per setup task
+    constexpr size_t SetupChunk = 4096;
+
+    struct ClipVertex
+    {
+        Vec4 Position;
+        Vec3 Source;
+    };
+
+    //Sutherland-Hodgman against one plane, inside where dot(Plane, Position) >= 0
+    uint32_t ClipPolygon(const ClipVertex* In, uint32_t Count, const Vec4& Plane, ClipVertex* Out)
+    {
+        uint32_t NumOut = 0;
+        for (uint32_t i = 0; i < Count; ++i)
+        {
+            const ClipVertex& A = In[i];
+            const ClipVertex& B = In[(i + 1) % Count];
+            const float DistanceA = glm::dot(Plane, A.Position);
+            const float DistanceB = glm::dot(Plane, B.Position);
+            if (DistanceA >= 0.0f)
+            {
+                Out[NumOut++] = A;
+            }
+            if ((DistanceA >= 0.0f) != (DistanceB >= 0.0f))
+            {
+                const float T = DistanceA / (DistanceA - DistanceB);
+                Out[NumOut++] = { A.Position + (B.Position - A.Position) * T, A.Source + (B.Source - A.Source) * T };
+            }
+        }
+        return NumOut;
+    }
+}
+
+SoftwareRasterizer::SoftwareRasterizer(uint32_t Width, uint32_t Height, ThreadPool& Pool)
+    :m_Width(Width)
+    ,m_Height(Height)
+    ,m_TilesX((Width + TileSize - 1) / TileSize)
+    ,m_TilesY((Height + TileSize - 1) / TileSize)
+    ,m_Pool(Pool)
+    ,m_Bins(size_t(m_TilesX) * m_TilesY)
+    ,m_Depth(size_t(Width) * Height, 1.0f)
+    ,m_TriangleIds(size_t(Width) * Height, InvalidTriangle)
+    ,m_L1(size_t(Width) * Height, 0.0f)
+    ,m_L2(size_t(Width) * Height, 0.0f)
+{
+    if (Width == 0 || Height == 0 || float(std::max(Width, Height)) > GuardBand)
+    {
+        throw std::invalid_argument("SoftwareRasterizer: the target has to be 1.." + std::to_string(int(GuardBand)) + " pixels wide and high");
+    }
+}
+
+void SoftwareRasterizer::Begin(float ClearDepth)
+{
+    m_ClearDepth = ClearDepth;
+    m_Draws.clear();
+    m_NumQueued = 0;
+}
+
+void SoftwareRasterizer::DrawIndexed(const Vec4* ClipPositions, const uint32_t* Indices, uint32_t NumIndices, uint32_t FirstIndex, uint32_t BaseVertex, const RasterState& State)
+{
+    if (NumIndices % 3 != 0)
+    {
+        throw std::invalid_argument("SoftwareRasterizer::DrawIndexed: " + std::to_string(NumIndices) + " indices are not a triangle list");
+    }
+    if (NumIndices == 0)
+    {
+        return;
+    }
+
+    m_Draws.push_back({ ClipPositions, Indices, NumIndices, FirstIndex, BaseVertex, State, m_NumQueued });
+    m_NumQueued += NumIndices / 3;
+}
+
+void SoftwareRasterizer::Rasterize()
+{
+    m_Stats = {};
+    m_Stats.Triangles = m_NumQueued;
+
+    //Setup in fixed chunks, so the triangle order and with it the depth ties do not depend on the thread count
+    auto Start = std::chrono::high_resolution_clock::now();
+    const size_t NumChunks = (m_NumQueued + SetupChunk - 1) / SetupChunk;
+    std::vector<std::vector<Triangle>> ChunkTriangles(NumChunks);
+    std::vector<Stats> ChunkStats(NumChunks);
+    m_Pool.ParallelFor(0, NumChunks, 1, [&](size_t ChunkBegin, size_t ChunkEnd)
+    {
+        for (size_t Chunk = ChunkBegin; Chunk < ChunkEnd; ++Chunk)
+        {
+            SetupTriangles(Chunk * SetupChunk, std::min(m_NumQueued, (Chunk + 1) * SetupChunk), ChunkTriangles[Chunk], ChunkStats[Chunk]);
+        }
+    });
+
+    m_Triangles.clear();
+    for (size_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+    {
+        m_Triangles.insert(m_Triangles.end(), ChunkTriangles[Chunk].begin(), ChunkTriangles[Chunk].end());
+        m_Stats.Culled += ChunkStats[Chunk].Culled;
+        m_Stats.Clipped += ChunkStats[Chunk].Clipped;
+    }
+    m_Stats.Rasterized = m_Triangles.size();
+    m_Stats.SetupMs = ElapsedMs(Start);
+
+    //Every tile row scans the whole list, which keeps each bin in triangle order without merging
+    Start = std::chrono::high_resolution_clock::now();
+    m_Pool.ParallelFor(0, m_TilesY, 1, [this](size_t RowBegin, size_t RowEnd)
+    {
+        for (size_t TileY = RowBegin; TileY < RowEnd; ++TileY)
+        {
+            for (uint32_t TileX = 0; TileX < m_TilesX; ++TileX)
+            {
+                m_Bins[TileY * m_TilesX + TileX].clear();
+            }
+            for (uint32_t Index = 0; Index < uint32_t(m_Triangles.size()); ++Index)
+            {
+                const Triangle& Tri = m_Triangles[Index];
+                if (uint32_t(Tri.MinY) / TileSize > TileY || uint32_t(Tri.MaxY) / TileSize < TileY)
+                {
+                    continue;
+                }
+                for (uint32_t TileX = uint32_t(Tri.MinX) / TileSize; TileX <= uint32_t(Tri.MaxX) / TileSize; ++TileX)
+                {
+                    m_Bins[TileY * m_TilesX + TileX].push_back(Index);
+                }
+            }
+        }
+    });
+    for (const std::vector<uint32_t>& Bin : m_Bins)
+    {
+        m_Stats.BinEntries += Bin.size();
+    }
+    m_Stats.BinMs = ElapsedMs(Start);
+
+    Start = std::chrono::high_resolution_clock::now();
+    m_Pool.ParallelFor(0, m_Bins.size(), 1, [this](size_t TileBegin, size_t TileEnd)
+    {
+        for (size_t Tile = TileBegin; Tile < TileEnd; ++Tile)
+        {
+            RasterizeTile(uint32_t(Tile));
+        }
+    });
+    m_Stats.RasterMs = ElapsedMs(Start);
+}
+
+void SoftwareRasterizer::SetupTriangles(size_t Begin, size_t End, std::vector<Triangle>& Out, Stats& Counters) const
+{
+    //Clip space planes: near, then the guard band in x and y
+    const float GuardX = 1.0f + 2.0f * GuardBand / float(m_Width);
+    const float GuardY = 1.0f + 2.0f * GuardBand / float(m_Height);
+    const Vec4 ClipPlanes[] = {
+        { 0.0f, 0.0f, 1.0f, 0.0f },
+        { -1.0f, 0.0f, 0.0f, GuardX },
+        { 1.0f, 0.0f, 0.0f, GuardX },
+        { 0.0f, -1.0f, 0.0f, GuardY },
+        { 0.0f, 1.0f, 0.0f, GuardY },
+    };
+    const auto OutCode = [](const Vec4& P)
+    {
+        //One bit per view frustum plane, trivially rejected when every vertex is outside the same one
+        return (P.x < -P.w ? 1u : 0u) | (P.x > P.w ? 2u : 0u) | (P.y < -P.w ? 4u : 0u) | (P.y > P.w ? 8u : 0u) |
+            (P.z < 0.0f ? 16u : 0u) | (P.z > P.w ? 32u : 0u);
+    };
+    const auto NeedsClipping = [&ClipPlanes](const Vec4& P)
+    {
+        return std::any_of(std::begin(ClipPlanes), std::end(ClipPlanes), [&P](const Vec4& Plane) { return glm::dot(Plane, P) < 0.0f; });
+    };
+    const Vec3 Corners[3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+
+    Out.reserve(End - Begin);
+    size_t DrawIndex = std::upper_bound(m_Draws.begin(), m_Draws.end(), Begin, [](size_t Index, const Draw& Entry) { return Index < Entry.FirstTriangle; }) - m_Draws.begin() - 1;
+    for (size_t Index = Begin; Index < End; ++Index)
+    {
+        while (DrawIndex + 1 < m_Draws.size() && m_Draws[DrawIndex + 1].FirstTriangle <= Index)
+        {
+            ++DrawIndex;
+        }
+        const Draw& Entry = m_Draws[DrawIndex];
+        const uint32_t* TriangleIndices = Entry.Indices + Entry.FirstIndex + (Index - Entry.FirstTriangle) * 3;
+
+        uint32_t Vertices[3];
+        Vec4 Clip[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            Vertices[i] = Entry.BaseVertex + TriangleIndices[i];
+            Clip[i] = Entry.ClipPositions[Vertices[i]];
+        }
+
+        if ((OutCode(Clip[0]) & OutCode(Clip[1]) & OutCode(Clip[2])) != 0)
+        {
+            ++Counters.Culled;
+            continue;
+        }
+
+        Triangle Tri;
+        if (!NeedsClipping(Clip[0]) && !NeedsClipping(Clip[1]) && !NeedsClipping(Clip[2]))
+        {
+            if (SetupTriangle(Clip, Corners, Vertices, Entry.State, Tri))
+            {
+                Out.push_back(Tri);
+            }
+            else
+            {
+                ++Counters.Culled;
+            }
+            continue;
+        }
+
+        //Every plane can add one vertex
+        ClipVertex Polygon[2][3 + 5];
+        uint32_t Count = 3;
+        for (int i = 0; i < 3; ++i)
+        {
+            Polygon[0][i] = { Clip[i], Corners[i] };
+        }
+        int Current = 0;
+        for (const Vec4& Plane : ClipPlanes)
+        {
+            Count = ClipPolygon(Polygon[Current], Count, Plane, Polygon[1 - Current]);
+            Current = 1 - Current;
+            if (Count < 3)
+            {
+                break;
+            }
+        }
+
+        ++Counters.Clipped;
+        bool bAny = false;
+        for (uint32_t i = 1; i + 1 < Count; ++i)
+        {
+            const ClipVertex& A = Polygon[Current][0];
+            const ClipVertex& B = Polygon[Current][i];
+            const ClipVertex& C = Polygon[Current][i + 1];
+            const Vec4 FanClip[3] = { A.Position, B.Position, C.Position };
+            const Vec3 FanSource[3] = { A.Source, B.Source, C.Source };
+            if (SetupTriangle(FanClip, FanSource, Vertices, Entry.State, Tri))
+            {
+                Out.push_back(Tri);
+                bAny = true;
+            }
+        }
+        if (!bAny)
+        {
+            ++Counters.Culled;
+        }
+    }
+}
+
+bool SoftwareRasterizer::SetupTriangle(const Vec4 (&Clip)[3], const Vec3 (&Source)[3], const uint32_t (&Vertices)[3], const RasterState& State, Triangle& Out) const
+{
+    float ScreenX[3];
+    float ScreenY[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!(Clip[i].w > 0.0f))
+        {
+            return false;
+        }
+        Out.InvW[i] = 1.0f / Clip[i].w;
+        ScreenX[i] = (Clip[i].x * Out.InvW[i] * 0.5f + 0.5f) * float(m_Width);
+        ScreenY[i] = (0.5f - Clip[i].y * Out.InvW[i] * 0.5f) * float(m_Height);
+        Out.Z[i] = Clip[i].z * Out.InvW[i];
+        Out.X[i] = static_cast<int32_t>(std::floor(ScreenX[i] * float(SubPixels) + 0.5f));
+        Out.Y[i] = static_cast<int32_t>(std::floor(ScreenY[i] * float(SubPixels) + 0.5f));
+        Out.Source[i] = Source[i];
+        Out.Vertices[i] = Vertices[i];
+    }
+
+    //Positive for clockwise on screen, where y points down
+    int64_t Area = int64_t(Out.X[1] - Out.X[0]) * (Out.Y[2] - Out.Y[0]) - int64_t(Out.X[2] - Out.X[0]) * (Out.Y[1] - Out.Y[0]);
+    if (Area == 0 || (State.bCullBack && Area > 0))
+    {
+        return false;
+    }
+    if (Area < 0)
+    {
+        std::swap(Out.X[1], Out.X[2]);
+        std::swap(Out.Y[1], Out.Y[2]);
+        std::swap(Out.Z[1], Out.Z[2]);
+        std::swap(Out.InvW[1], Out.InvW[2]);
+        std::swap(Out.Source[1], Out.Source[2]);
+        Area = -Area;
+    }
+
+    //Pixel centers are at half a pixel, ceil and floor of the bounds in fixed point
+    const int32_t HalfPixel = SubPixels / 2;
+    Out.MinX = std::max(0, (std::min({ Out.X[0], Out.X[1], Out.X[2] }) - HalfPixel + SubPixels - 1) >> SubPixelBits);
+    Out.MinY = std::max(0, (std::min({ Out.Y[0], Out.Y[1], Out.Y[2] }) - HalfPixel + SubPixels - 1) >> SubPixelBits);
+    Out.MaxX = std::min(int32_t(m_Width) - 1, (std::max({ Out.X[0], Out.X[1], Out.X[2] }) - HalfPixel) >> SubPixelBits);
+    Out.MaxY = std::min(int32_t(m_Height) - 1, (std::max({ Out.Y[0], Out.Y[1], Out.Y[2] }) - HalfPixel) >> SubPixelBits);
+    if (Out.MinX > Out.MaxX || Out.MinY > Out.MaxY)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const int Next = (i + 1) % 3;
+        Out.EdgeA[i] = Out.Y[i] - Out.Y[Next];
+        Out.EdgeB[i] = Out.X[Next] - Out.X[i];
+        Out.EdgeC[i] = -int64_t(Out.EdgeA[i]) * Out.X[i] - int64_t(Out.EdgeB[i]) * Out.Y[i];
+        //Clockwise on screen, left edges go up and top edges go right
+        Out.EdgeBias[i] = (Out.EdgeA[i] > 0 || (Out.EdgeA[i] == 0 && Out.EdgeB[i] > 0)) ? 0 : -1;
+    }
+
+    //Vertex 1's weight is edge 2 over the area, vertex 2's is edge 0, both are zero at vertex 0
+    const double Scale = double(SubPixels) / double(Area);
+    Out.X0 = float(Out.X[0]) / float(SubPixels);
+    Out.Y0 = float(Out.Y[0]) / float(SubPixels);
+    Out.L1A = float(Out.EdgeA[2] * Scale);
+    Out.L1B = float(Out.EdgeB[2] * Scale);
+    Out.L2A = float(Out.EdgeA[0] * Scale);
+    Out.L2B = float(Out.EdgeB[0] * Scale);
+
+    if (State.DepthBias != 0 || State.SlopeScaledDepthBias != 0.0f)
+    {
+        const float SlopeX = Out.L1A * (Out.Z[1] - Out.Z[0]) + Out.L2A * (Out.Z[2] - Out.Z[0]);
+        const float SlopeY = Out.L1B * (Out.Z[1] - Out.Z[0]) + Out.L2B * (Out.Z[2] - Out.Z[0]);
+        const float Bias = float(State.DepthBias) / float(1 << 24) + State.SlopeScaledDepthBias * std::max(std::abs(SlopeX), std::abs(SlopeY));
+        for (float& Z : Out.Z)
+        {
+            Z += Bias;
+        }
+    }
+    return true;
+}
+
+bool SoftwareRasterizer::Covers(const Triangle& Tri, int32_t X, int32_t Y)
+{
+    const int64_t PixelX = int64_t(X) * SubPixels + SubPixels / 2;
+    const int64_t PixelY = int64_t(Y) * SubPixels + SubPixels / 2;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (Tri.EdgeA[i] * PixelX + Tri.EdgeB[i] * PixelY + Tri.EdgeC[i] + Tri.EdgeBias[i] < 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+float SoftwareRasterizer::InterpolateDepth(const Triangle& Tri, float X, float Y)
+{
+    //Same operations in the same order as the SIMD path, so both give the same bits
+    const float DeltaX = (X + 0.5f) - Tri.X0;
+    const float DeltaY = (Y + 0.5f) - Tri.Y0;
+    const float L1 = Tri.L1A * DeltaX + Tri.L1B * DeltaY;
+    const float L2 = Tri.L2A * DeltaX + Tri.L2B * DeltaY;
+    return (Tri.Z[0] + L1 * (Tri.Z[1] - Tri.Z[0])) + L2 * (Tri.Z[2] - Tri.Z[0]);
+}
+
+void SoftwareRasterizer::RasterizeTile(uint32_t Tile)
+{
+    const int32_t TileX0 = int32_t(Tile % m_TilesX * TileSize);
+    const int32_t TileY0 = int32_t(Tile / m_TilesX * TileSize);
+    const int32_t TileX1 = std::min(TileX0 + int32_t(TileSize), int32_t(m_Width));
+    const int32_t TileY1 = std::min(TileY0 + int32_t(TileSize), int32_t(m_Height));
+
+    for (int32_t Y = TileY0; Y < TileY1; ++Y)
+    {
+        const size_t Row = size_t(Y) * m_Width;
+        std::fill(m_Depth.begin() + Row + TileX0, m_Depth.begin() + Row + TileX1, m_ClearDepth);
+        std::fill(m_TriangleIds.begin() + Row + TileX0, m_TriangleIds.begin() + Row + TileX1, InvalidTriangle);
+    }
+
+    const int32_t BlockSpan = int32_t(BlockSize - 1) * SubPixels;
+    const __m128 LaneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 Half = _mm_set1_ps(0.5f);
+
+    for (const uint32_t Index : m_Bins[Tile])
+    {
+        const Triangle& Tri = m_Triangles[Index];
+        const int32_t MinX = std::max(Tri.MinX, TileX0);
+        const int32_t MinY = std::max(Tri.MinY, TileY0);
+        const int32_t MaxX = std::min(Tri.MaxX, TileX1 - 1);
+        const int32_t MaxY = std::min(Tri.MaxY, TileY1 - 1);
+
+        const __m128 X0 = _mm_set1_ps(Tri.X0);
+        const __m128 L1A = _mm_set1_ps(Tri.L1A);
+        const __m128 L2A = _mm_set1_ps(Tri.L2A);
+        const __m128 Z0 = _mm_set1_ps(Tri.Z[0]);
+        const __m128 DeltaZ1 = _mm_set1_ps(Tri.Z[1] - Tri.Z[0]);
+        const __m128 DeltaZ2 = _mm_set1_ps(Tri.Z[2] - Tri.Z[0]);
+        const __m128i Id = _mm_set1_epi32(int32_t(Index));
+
+        //Tiles start on a block boundary, so do the blocks
+        for (int32_t BlockY = MinY & ~int32_t(BlockSize - 1); BlockY <= MaxY; BlockY += BlockSize)
+        {
+            for (int32_t BlockX = MinX & ~int32_t(BlockSize - 1); BlockX <= MaxX; BlockX += BlockSize)
+            {
+                //An edge whose worst corner is inside can be ignored, one whose best corner is outside rejects the
+                //block. Only the edges crossing the block are stepped, their values there fit in 32 bits
+                const int64_t CornerX = int64_t(BlockX) * SubPixels + SubPixels / 2;
+                const int64_t CornerY = int64_t(BlockY) * SubPixels + SubPixels / 2;
+                int32_t EdgeRow[3] = { 0, 0, 0 };
+                int32_t EdgeStepX[3] = { 0, 0, 0 };
+                int32_t EdgeStepY[3] = { 0, 0, 0 };
+                bool bRejected = false;
+                for (int i = 0; i < 3 && !bRejected; ++i)
+                {
+                    const int64_t Value = Tri.EdgeA[i] * CornerX + Tri.EdgeB[i] * CornerY + Tri.EdgeC[i] + Tri.EdgeBias[i];
+                    const int64_t SpanX = int64_t(Tri.EdgeA[i]) * BlockSpan;
+                    const int64_t SpanY = int64_t(Tri.EdgeB[i]) * BlockSpan;
+                    const int64_t Worst = Value + std::min<int64_t>(SpanX, 0) + std::min<int64_t>(SpanY, 0);
+                    const int64_t Best = Value + std::max<int64_t>(SpanX, 0) + std::max<int64_t>(SpanY, 0);
+                    if (Best < 0)
+                    {
+                        bRejected = true;
+                    }
+                    else if (Worst < 0)
+                    {
+                        EdgeRow[i] = int32_t(Value);
+                        EdgeStepX[i] = Tri.EdgeA[i] * SubPixels;
+                        EdgeStepY[i] = Tri.EdgeB[i] * SubPixels;
+                    }
+                }
+                if (bRejected)
+                {
+                    continue;
+                }
+
+                __m128i LaneSteps[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    LaneSteps[i] = _mm_set_epi32(3 * EdgeStepX[i], 2 * EdgeStepX[i], EdgeStepX[i], 0);
+                }
+
+                const int32_t RowEnd = std::min(BlockY + int32_t(BlockSize), MaxY + 1);
+                for (int32_t Y = std::max(BlockY, MinY); Y < RowEnd; ++Y)
+                {
+                    const int32_t Rows = Y - BlockY;
+                    const float DeltaYScalar = (float(Y) + 0.5f) - Tri.Y0;
+                    const __m128 L1Y = _mm_set1_ps(Tri.L1B * DeltaYScalar);
+                    const __m128 L2Y = _mm_set1_ps(Tri.L2B * DeltaYScalar);
+                    const size_t Row = size_t(Y) * m_Width;
+
+                    for (int32_t Group = 0; Group < int32_t(BlockSize); Group += 4)
+                    {
+                        const int32_t X = BlockX + Group;
+                        if (X > MaxX)
+                        {
+                            break;
+                        }
+
+                        //Groups hanging over the tile or the triangle's bounds go pixel by pixel, with the same math
+                        if (X < MinX || X + 3 > MaxX)
+                        {
+                            for (int32_t Lane = std::max(X, MinX); Lane <= std::min(X + 3, MaxX); ++Lane)
+                            {
+                                if (!Covers(Tri, Lane, Y))
+                                {
+                                    continue;
+                                }
+                                const float Depth = InterpolateDepth(Tri, float(Lane), float(Y));
+                                if (Depth < m_Depth[Row + Lane])
+                                {
+                                    const float DeltaX = (float(Lane) + 0.5f) - Tri.X0;
+                                    m_Depth[Row + Lane] = Depth;
+                                    m_TriangleIds[Row + Lane] = Index;
+                                    m_L1[Row + Lane] = Tri.L1A * DeltaX + Tri.L1B * DeltaYScalar;
+                                    m_L2[Row + Lane] = Tri.L2A * DeltaX + Tri.L2B * DeltaYScalar;
+                                }
+                            }
+                            continue;
+                        }
+
+                        __m128i Edges = _mm_setzero_si128();
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            const __m128i Edge = _mm_add_epi32(_mm_set1_epi32(EdgeRow[i] + Rows * EdgeStepY[i] + Group * EdgeStepX[i]), LaneSteps[i]);
+                            Edges = _mm_or_si128(Edges, Edge);
+                        }
+                        //The sign bit survives the or where any edge is negative
+                        const __m128 Outside = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_setzero_si128(), Edges));
+                        if (_mm_movemask_ps(Outside) == 0xF)
+                        {
+                            continue;
+                        }
+
+                        const __m128 DeltaX = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_set1_ps(float(X)), LaneOffsets), Half), X0);
+                        const __m128 L1 = _mm_add_ps(_mm_mul_ps(L1A, DeltaX), L1Y);
+                        const __m128 L2 = _mm_add_ps(_mm_mul_ps(L2A, DeltaX), L2Y);
+                        const __m128 Depth = _mm_add_ps(_mm_add_ps(Z0, _mm_mul_ps(L1, DeltaZ1)), _mm_mul_ps(L2, DeltaZ2));
+
+                        float* DepthRow = &m_Depth[Row + X];
+                        const __m128 OldDepth = _mm_loadu_ps(DepthRow);
+                        const __m128 Pass = _mm_andnot_ps(Outside, _mm_cmplt_ps(Depth, OldDepth));
+                        if (_mm_movemask_ps(Pass) == 0)
+                        {
+                            continue;
+                        }
+
+                        const auto Select = [&Pass](__m128 New, __m128 Old) { return _mm_or_ps(_mm_and_ps(Pass, New), _mm_andnot_ps(Pass, Old)); };
+                        __m128i* IdRow = reinterpret_cast<__m128i*>(&m_TriangleIds[Row + X]);
+                        _mm_storeu_ps(DepthRow, Select(Depth, OldDepth));
+                        _mm_storeu_si128(IdRow, _mm_castps_si128(Select(_mm_castsi128_ps(Id), _mm_castsi128_ps(_mm_loadu_si128(IdRow)))));
+                        _mm_storeu_ps(&m_L1[Row + X], Select(L1, _mm_loadu_ps(&m_L1[Row + X])));
+                        _mm_storeu_ps(&m_L2[Row + X], Select(L2, _mm_loadu_ps(&m_L2[Row + X])));
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool SoftwareRasterizer::Resolve(uint32_t X, uint32_t Y, Sample& Out) const
+{
+    const size_t Pixel = size_t(Y) * m_Width + X;
+    const uint32_t Index = m_TriangleIds[Pixel];
+    if (Index == InvalidTriangle)
+    {
+        return false;
+    }
+
+    //Screen space weights divided by w are linear in clip space
+    const Triangle& Tri = m_Triangles[Index];
+    const float L1 = m_L1[Pixel];
+    const float L2 = m_L2[Pixel];
+    const Vec3 Weights = Vec3{ (1.0f - L1 - L2) * Tri.InvW[0], L1 * Tri.InvW[1], L2 * Tri.InvW[2] } / (
+        (1.0f - L1 - L2) * Tri.InvW[0] + L1 * Tri.InvW[1] + L2 * Tri.InvW[2]);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        Out.Vertices[i] = Tri.Vertices[i];
+    }
+    Out.Barycentrics = Tri.Source[0] * Weights.x + Tri.Source[1] * Weights.y + Tri.Source[2] * Weights.z;
+    Out.Depth = m_Depth[Pixel];
+    return true;
+}
+
+void SoftwareRasterizer::ForEachTile(const std::function<void(uint32_t X0, uint32_t Y0, uint32_t X1, uint32_t Y1)>& Body) const
+{
+    m_Pool.ParallelFor(0, m_Bins.size(), 1, [this, &Body](size_t TileBegin, size_t TileEnd)
+    {
+        for (size_t Tile = TileBegin; Tile < TileEnd; ++Tile)
+        {
+            const uint32_t X0 = uint32_t(Tile % m_TilesX) * TileSize;
+            const uint32_t Y0 = uint32_t(Tile / m_TilesX) * TileSize;
+            Body(X0, Y0, std::min(X0 + TileSize, m_Width), std::min(Y0 + TileSize, m_Height));
+        }
+    });
+}
+
+bool SoftwareRasterizer::SelfTest()
+{
+    TestHarness Harness;
+
+    //Screen position in pixels to clip space at depth Z
+    const auto ToClip = [](float X, float Y, float Z, float W, uint32_t Width, uint32_t Height)
+    {
+        return Vec4{ (X / float(Width) * 2.0f - 1.0f) * W, (1.0f - Y / float(Height) * 2.0f) * W, Z * W, W };
+    };
+    //Random clip space triangles of Extent in NDC. With bMixed a tenth is huge, a third half the view and a tenth crosses the near plane
+    const auto RandomScene = [](std::mt19937& Random, size_t NumTriangles, float Extent, bool bMixed, std::vector<Vec4>& Positions, std::vector<uint32_t>& Indices)
+    {
+        std::uniform_real_distribution<float> Unit(0.0f, 1.0f);
+        Positions.clear();
+        Indices.clear();
+        for (size_t i = 0; i < NumTriangles; ++i)
+        {
+            const float Kind = bMixed ? Unit(Random) : 0.75f;
+            const float Size = Kind < 0.1f ? 40.0f : (Kind < 0.5f ? 1.0f : Extent);
+            const Vec3 Center{ Unit(Random) * 2.4f - 1.2f, Unit(Random) * 2.4f - 1.2f, Unit(Random) };
+            for (int Corner = 0; Corner < 3; ++Corner)
+            {
+                const float W = 0.5f + Unit(Random) * 2.5f;
+                const float Z = Kind > 0.9f ? Unit(Random) * 1.4f - 0.6f : Center.z + (Unit(Random) - 0.5f) * 0.2f;
+                Positions.push_back(Vec4{ Center.x + (Unit(Random) - 0.5f) * Size, Center.y + (Unit(Random) - 0.5f) * Size, Z, 1.0f } * W);
+                Indices.push_back(uint32_t(Indices.size()));
+            }
+        }
+    };
+    //Per pixel reference: the first triangle in order with the least depth covering the pixel center
+    const auto CheckAgainstReference = [&Harness](const SoftwareRasterizer& Rasterizer)
+    {
+        size_t CoverageMismatches = 0;
+        size_t DepthMismatches = 0;
+        for (uint32_t Y = 0; Y < Rasterizer.m_Height; ++Y)
+        {
+            for (uint32_t X = 0; X < Rasterizer.m_Width; ++X)
+            {
+                uint32_t Best = InvalidTriangle;
+                float BestDepth = Rasterizer.m_ClearDepth;
+                for (uint32_t Index = 0; Index < Rasterizer.m_Triangles.size(); ++Index)
+                {
+                    const Triangle& Tri = Rasterizer.m_Triangles[Index];
+                    if (Covers(Tri, int32_t(X), int32_t(Y)))
+                    {
+                        const float Depth = InterpolateDepth(Tri, float(X), float(Y));
+                        if (Depth < BestDepth)
+                        {
+                            Best = Index;
+                            BestDepth = Depth;
+                        }
+                    }
+                }
+                const size_t Pixel = size_t(Y) * Rasterizer.m_Width + X;
+                CoverageMismatches += Rasterizer.m_TriangleIds[Pixel] != Best;
+                DepthMismatches += Rasterizer.m_Depth[Pixel] != BestDepth;
+            }
+        }
+        Harness.Check(CoverageMismatches == 0, "every pixel is won by the triangle the scalar reference picks");
+        Harness.Check(DepthMismatches == 0, "depth matches the scalar reference bit for bit");
+    };
+
+    std::printf("Software rasterizer self test\n");
+    ThreadPool& Pool = ThreadPool::Get();
+
+    Harness.Run("Shared edges", [&]()
+    {
+        //A jittered grid with mixed winding over and past the target, some vertices exactly on pixel centers so
+        //edges run through them. Every pixel has to be covered by exactly one triangle
+        const uint32_t Width = 93;
+        const uint32_t Height = 71;
+        const int Columns = 13;
+        const int Rows = 9;
+        std::mt19937 Random{ 7 };
+        std::uniform_int_distribution<int> Jitter(-40, 40);
+        std::vector<Vec4> Positions;
+        for (int Row = 0; Row <= Rows; ++Row)
+        {
+            for (int Column = 0; Column <= Columns; ++Column)
+            {
+                const bool bInner = Row > 0 && Row < Rows && Column > 0 && Column < Columns;
+                const bool bOnCenter = (Row + Column) % 3 == 0;
+                float X = -3.0f + float(Column) * float(Width + 6) / float(Columns);
+                float Y = -3.0f + float(Row) * float(Height + 6) / float(Rows);
+                if (bInner && bOnCenter)
+                {
+                    X = std::floor(X) + 0.5f;
+                    Y = std::floor(Y) + 0.5f;
+                }
+                else if (bInner)
+                {
+                    X += float(Jitter(Random)) / 16.0f;
+                    Y += float(Jitter(Random)) / 16.0f;
+                }
+                Positions.push_back(ToClip(X, Y, 0.5f, 1.0f, Width, Height));
+            }
+        }
+        std::vector<uint32_t> Indices;
+        for (int Row = 0; Row < Rows; ++Row)
+        {
+            for (int Column = 0; Column < Columns; ++Column)
+            {
+                const uint32_t A = uint32_t(Row * (Columns + 1) + Column);
+                const uint32_t B = A + 1;
+                const uint32_t C = A + Columns + 1;
+                const uint32_t D = C + 1;
+                const bool bFlip = (Row + Column) % 2 == 0;
+                const std::vector<uint32_t> Cell = bFlip ? std::vector<uint32_t>{ A, B, D, A, C, D } : std::vector<uint32_t>{ A, C, B, B, D, C };
+                Indices.insert(Indices.end(), Cell.begin(), Cell.end());
+            }
+        }
+
+        SoftwareRasterizer Rasterizer{ Width, Height, Pool };
+        Rasterizer.Begin();
+        RasterState NoCulling;
+        NoCulling.bCullBack = false;
+        Rasterizer.DrawIndexed(Positions.data(), Indices.data(), uint32_t(Indices.size()), 0, 0, NoCulling);
+        Rasterizer.Rasterize();
+
+        size_t Gaps = 0;
+        size_t Overlaps = 0;
+        for (uint32_t Y = 0; Y < Height; ++Y)
+        {
+            for (uint32_t X = 0; X < Width; ++X)
+            {
+                const auto Count = std::count_if(Rasterizer.m_Triangles.begin(), Rasterizer.m_Triangles.end(),
+                    [X, Y](const Triangle& Tri) { return Covers(Tri, int32_t(X), int32_t(Y)); });
+                Gaps += Count == 0 || Rasterizer.m_TriangleIds[size_t(Y) * Width + X] == InvalidTriangle;
+                Overlaps += Count > 1;
+            }
+        }
+        Harness.Check(Rasterizer.LastStats().Rasterized == Indices.size() / 3, "no triangle of the grid is culled");
+        Harness.Check(Gaps == 0, "no pixel falls between two triangles");
+        Harness.Check(Overlaps == 0, "no pixel on a shared edge is covered twice");
+        CheckAgainstReference(Rasterizer);
+    });
+
+    Harness.Run("Random triangles", [&]()
+    {
+        std::mt19937 Random{ 1234 };
+        std::vector<Vec4> Positions;
+        std::vector<uint32_t> Indices;
+        RandomScene(Random, 400, 0.3f, true, Positions, Indices);
+
+        SoftwareRasterizer Rasterizer{ 97, 61, Pool };
+        for (const bool bCullBack : { false, true })
+        {
+            RasterState State;
+            State.bCullBack = bCullBack;
+            Rasterizer.Begin();
+            //Two draws over the same vertices, with an offset into the index buffer
+            Rasterizer.DrawIndexed(Positions.data(), Indices.data(), 600, 0, 0, State);
+            Rasterizer.DrawIndexed(Positions.data(), Indices.data(), uint32_t(Indices.size()) - 600, 600, 0, State);
+            Rasterizer.Rasterize();
+
+            Harness.Check(Rasterizer.LastStats().Clipped > 0, "some triangles were clipped");
+            Harness.Check(Rasterizer.LastStats().Culled > 0, "some triangles were culled");
+            CheckAgainstReference(Rasterizer);
+        }
+    });
+
+    Harness.Run("Near plane clipping", [&]()
+    {
+        //A ground plane reaching behind the camera, every pixel it covers has to resolve to barycentrics whose
+        //world position projects back onto the pixel center
+        const uint32_t Width = 160;
+        const uint32_t Height = 120;
+        const Mat4 ViewProjection = glm::perspectiveFovRH_ZO(glm::radians(60.0f), float(Width), float(Height), 0.5f, 100.0f) *
+            glm::lookAt(Vec3{ 0.0f, 1.0f, 0.0f }, Vec3{ 0.0f, 0.8f, -1.0f }, Vec3{ 0.0f, 1.0f, 0.0f });
+        const Vec3 World[4] = { { -50.0f, 0.0f, -50.0f }, { 50.0f, 0.0f, -50.0f }, { -50.0f, 0.0f, 50.0f }, { 50.0f, 0.0f, 50.0f } };
+        std::vector<Vec4> Positions;
+        for (const Vec3& Corner : World)
+        {
+            Positions.push_back(ViewProjection * Vec4{ Corner, 1.0f });
+        }
+        const std::vector<uint32_t> Indices = { 0, 2, 1, 1, 2, 3 };
+
+        SoftwareRasterizer Rasterizer{ Width, Height, Pool };
+        Rasterizer.Begin();
+        RasterState NoCulling;
+        NoCulling.bCullBack = false;
+        Rasterizer.DrawIndexed(Positions.data(), Indices.data(), uint32_t(Indices.size()), 0, 0, NoCulling);
+        Rasterizer.Rasterize();
+        Harness.Check(Rasterizer.LastStats().Clipped == 2, "both triangles cross the near plane");
+
+        float WorstError = 0.0f;
+        size_t Covered = 0;
+        for (uint32_t Y = 0; Y < Height; ++Y)
+        {
+            for (uint32_t X = 0; X < Width; ++X)
+            {
+                Sample Result;
+                if (!Rasterizer.Resolve(X, Y, Result))
+                {
+                    continue;
+                }
+                ++Covered;
+                const Vec3 Position = World[Result.Vertices[0]] * Result.Barycentrics.x + World[Result.Vertices[1]] * Result.Barycentrics.y +
+                    World[Result.Vertices[2]] * Result.Barycentrics.z;
+                const Vec4 Clip = ViewProjection * Vec4{ Position, 1.0f };
+                const float ScreenX = (Clip.x / Clip.w * 0.5f + 0.5f) * float(Width);
+                const float ScreenY = (0.5f - Clip.y / Clip.w * 0.5f) * float(Height);
+                WorstError = std::max({ WorstError, std::abs(ScreenX - (float(X) + 0.5f)), std::abs(ScreenY - (float(Y) + 0.5f)) });
+            }
+        }
+        bool bBottomRowCovered = true;
+        for (uint32_t X = 0; X < Width; ++X)
+        {
+            Sample Result;
+            bBottomRowCovered = bBottomRowCovered && Rasterizer.Resolve(X, Height - 1, Result);
+        }
+        Harness.Check(bBottomRowCovered, "the plane below the camera covers the bottom row");
+        Harness.Check(Covered > Width * Height / 4 && Covered < Width * Height, "the plane covers the lower part of the view");
+        Harness.Check(WorstError < 0.05f, "perspective-correct barycentrics land on the pixel center");
+    });
+
+    Harness.Run("Front faces", [&]()
+    {
+        //FrontCounterClockwise: counter-clockwise as seen on screen is the front, with y up in NDC
+        const std::vector<Vec4> Positions = { { -0.5f, -0.5f, 0.5f, 1.0f }, { 0.5f, -0.5f, 0.5f, 1.0f }, { 0.0f, 0.5f, 0.5f, 1.0f } };
+        const std::vector<uint32_t> Indices = { 0, 1, 2, 0, 2, 1 };
+
+        SoftwareRasterizer Rasterizer{ 32, 32, Pool };
+        Rasterizer.Begin();
+        Rasterizer.DrawIndexed(Positions.data(), Indices.data(), 6, 0, 0);
+        Rasterizer.Rasterize();
+        Sample Result;
+        Harness.Check(Rasterizer.LastStats().Culled == 1 && Rasterizer.Resolve(16, 16, Result) && Result.Vertices[1] == 1, "the clockwise copy is culled");
+    });
+
+    Harness.Run("Depth bias", [&]()
+    {
+        const std::vector<Vec4> Positions = { ToClip(2.0f, 2.0f, 0.5f, 1.0f, 32, 32), ToClip(30.0f, 2.0f, 0.5f, 1.0f, 32, 32), ToClip(2.0f, 30.0f, 0.5f, 1.0f, 32, 32) };
+        const std::vector<uint32_t> Indices = { 0, 1, 2 };
+        RasterState State;
+        State.bCullBack = false;
+        State.DepthBias = 100000;
+        State.SlopeScaledDepthBias = 1.0f;
+
+        SoftwareRasterizer Rasterizer{ 32, 32, Pool };
+        Rasterizer.Begin();
+        Rasterizer.DrawIndexed(Positions.data(), Indices.data(), 3, 0, 0, State);
+        Rasterizer.Rasterize();
+        Sample Result;
+        Harness.Check(Rasterizer.Resolve(8, 8, Result) && std::abs(Result.Depth - (0.5f + 100000.0f / float(1 << 24))) < 1e-6f, "a flat triangle only gets the constant bias");
+    });
+
+    Harness.Run("Thread count independence", [&]()
+    {
+        std::mt19937 Random{ 99 };
+        std::vector<Vec4> Positions;
+        std::vector<uint32_t> Indices;
+        RandomScene(Random, 5000, 0.1f, true, Positions, Indices);
+
+        ThreadPool Serial{ 0 };
+        ThreadPool Parallel{ 3 };
+        SoftwareRasterizer A{ 300, 200, Serial };
+        SoftwareRasterizer B{ 300, 200, Parallel };
+        for (SoftwareRasterizer* Rasterizer : { &A, &B })
+        {
+            Rasterizer->Begin();
+            Rasterizer->DrawIndexed(Positions.data(), Indices.data(), uint32_t(Indices.size()), 0, 0);
+            Rasterizer->Rasterize();
+        }
+        Harness.Check(A.m_Depth == B.m_Depth && A.m_TriangleIds == B.m_TriangleIds && A.m_L1 == B.m_L1 && A.m_L2 == B.m_L2,
+            "0 and 3 pool threads write the same buffers");
+    });
+
+    //200k small triangles over a 1024x1024 target, on the process-wide pool
+    {
+        std::mt19937 Random{ 5 };
+        std::vector<Vec4> Positions;
+        std::vector<uint32_t> Indices;
+        RandomScene(Random, 200000, 0.02f, false, Positions, Indices);
+
+        SoftwareRasterizer Rasterizer{ 1024, 1024, Pool };
+        const int Iterations = 5;
+        Stats Total;
+        const auto Start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < Iterations; ++i)
+        {
+            Rasterizer.Begin();
+            Rasterizer.DrawIndexed(Positions.data(), Indices.data(), uint32_t(Indices.size()), 0, 0);
+            Rasterizer.Rasterize();
+            Total.SetupMs += Rasterizer.LastStats().SetupMs;
+            Total.BinMs += Rasterizer.LastStats().BinMs;
+            Total.RasterMs += Rasterizer.LastStats().RasterMs;
+        }
+        const double Ms = ElapsedMs(Start) / Iterations;
+        std::printf("  Triangles     : %zu queued, %zu culled, %zu clipped, %zu rasterized into %zu bin entries\n", Rasterizer.LastStats().Triangles,
+            Rasterizer.LastStats().Culled, Rasterizer.LastStats().Clipped, Rasterizer.LastStats().Rasterized, Rasterizer.LastStats().BinEntries);
+        std::printf("  Time          : %.2f ms setup, %.2f ms binning, %.2f ms raster per pass, %.1f Mtri/s on %u pool threads plus the caller\n",
+            Total.SetupMs / Iterations, Total.BinMs / Iterations, Total.RasterMs / Iterations, double(Indices.size() / 3) / (Ms * 1000.0), Pool.NumThreads());
+    }
+
+    return Harness.Finish();
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Camera.h"
+
+class ThreadPool;
+
+// Fixed function state of a draw, named after the D3D12_RASTERIZER_DESC fields the PSOs set.
+struct RasterState
+{
+    // Culls clockwise triangles, the PSOs all use CULL_BACK with FrontCounterClockwise.
+    bool bCullBack = true;
+    // Added to every depth like D3D12 does for UNORM depth: DepthBias / 2^24 + SlopeScaledDepthBias * max slope.
+    int32_t DepthBias = 0;
+    float SlopeScaledDepthBias = 0.0f;
+};
+
+// Tile based triangle rasterizer with a LESS depth test into a float depth buffer, the CPU stand-in for the
+// GPU's rasterizer and output merger. Draws only queue their triangles; Rasterize clips them against the near
+// plane and a guard band, snaps them to 28.4 fixed point, bins them into TileSize square tiles and then walks
+// every tile on the thread pool in 8x8 pixel blocks, testing four pixels at a time with SSE edge functions
+// under the top-left fill rule. Instead of colors it keeps the winning triangle and its barycentrics per
+// pixel, so a pixel is shaded once after all draws, with Resolve, no matter how many triangles overlapped it.
+class SoftwareRasterizer
+{
+public:
+    static constexpr uint32_t TileSize = 64;
+    static constexpr uint32_t BlockSize = 8;
+    // Rasterized triangles are clipped to this many pixels around the target, which keeps edge functions
+    // inside a block within 32 bits.
+    static constexpr float GuardBand = 8192.0f;
+
+    // The triangle covering a pixel. Vertices already include the draw's BaseVertex, Barycentrics are
+    // perspective-correct and relative to those three vertices even when the triangle was clipped.
+    struct Sample
+    {
+        uint32_t Vertices[3];
+        Vec3 Barycentrics;
+        float Depth;
+    };
+
+    struct Stats
+    {
+        size_t Triangles = 0;       // Queued by draws
+        size_t Culled = 0;          // Back facing, degenerate, outside the view or between pixel centers
+        size_t Clipped = 0;         // Crossed the near plane or the guard band
+        size_t Rasterized = 0;      // After clipping, a clipped triangle can turn into several
+        size_t BinEntries = 0;
+        double SetupMs = 0.0;
+        double BinMs = 0.0;
+        double RasterMs = 0.0;
+    };
+
+    SoftwareRasterizer(uint32_t Width, uint32_t Height, ThreadPool& Pool);
+
+    uint32_t Width() const { return m_Width; }
+    uint32_t Height() const { return m_Height; }
+
+    // Drops the draws of the previous pass, the depth buffer is cleared to ClearDepth by the next Rasterize.
+    void Begin(float ClearDepth = 1.0f);
+
+    // Queues NumIndices / 3 triangles of ClipPositions[BaseVertex + Indices[FirstIndex + i]], D3D12's
+    // DrawIndexedInstanced addressing. Both arrays have to stay alive until Rasterize returns.
+    void DrawIndexed(const Vec4* ClipPositions, const uint32_t* Indices, uint32_t NumIndices, uint32_t FirstIndex, uint32_t BaseVertex, const RasterState& State = {});
+
+    // Clears the depth buffer and rasterizes every queued draw, in draw order for equal depths.
+    void Rasterize();
+
+    // False where no triangle was drawn.
+    bool Resolve(uint32_t X, uint32_t Y, Sample& Out) const;
+
+    // Runs Body for every tile on the thread pool, with the pixel rectangle [X0, X1) x [Y0, Y1).
+    void ForEachTile(const std::function<void(uint32_t X0, uint32_t Y0, uint32_t X1, uint32_t Y1)>& Body) const;
+
+    const std::vector<float>& Depth() const { return m_Depth; }
+    const Stats& LastStats() const { return m_Stats; }
+
+    // Checks coverage and depth against a per-pixel scalar reference, the fill rule on shared edges, near plane
+    // clipping with perspective-correct barycentrics and identical results on any thread count, then times
+    // random scenes. No GPU needed.
+    static bool SelfTest();
+
+private:
+    struct Draw
+    {
+        const Vec4* ClipPositions;
+        const uint32_t* Indices;
+        uint32_t NumIndices;
+        uint32_t FirstIndex;
+        uint32_t BaseVertex;
+        RasterState State;
+        size_t FirstTriangle;   //Running count of the triangles of the draws before
+    };
+
+    //A clipped, snapped triangle with clockwise screen space winding, edge i runs from vertex i to i + 1
+    struct Triangle
+    {
+        int32_t X[3];
+        int32_t Y[3];
+        int32_t MinX, MinY, MaxX, MaxY;     //Pixels whose centers are in the bounds, clamped to the target
+        int64_t EdgeC[3];
+        int32_t EdgeA[3];
+        int32_t EdgeB[3];
+        int32_t EdgeBias[3];                //0 on top and left edges, -1 elsewhere
+        //Screen space barycentrics of vertex 1 and 2 per pixel, relative to vertex 0
+        float X0, Y0;
+        float L1A, L1B, L2A, L2B;
+        float Z[3];
+        float InvW[3];
+        Vec3 Source[3];                     //Barycentrics of each vertex in the draw's triangle
+        uint32_t Vertices[3];
+    };
+
+    //Clips the queued triangles [Begin, End) and appends what survives to Out
+    void SetupTriangles(size_t Begin, size_t End, std::vector<Triangle>& Out, Stats& Counters) const;
+    bool SetupTriangle(const Vec4 (&Clip)[3], const Vec3 (&Source)[3], const uint32_t (&Vertices)[3], const RasterState& State, Triangle& Out) const;
+    void RasterizeTile(uint32_t Tile);
+
+    //Whether the center of pixel (X, Y) is inside, by the same fill rule as the SIMD path
+    static bool Covers(const Triangle& Tri, int32_t X, int32_t Y);
+    static float InterpolateDepth(const Triangle& Tri, float X, float Y);
+
+    const uint32_t m_Width;
+    const uint32_t m_Height;
+    const uint32_t m_TilesX;
+    const uint32_t m_TilesY;
+    ThreadPool& m_Pool;
+
+    float m_ClearDepth = 1.0f;
+    std::vector<Draw> m_Draws;
+    size_t m_NumQueued = 0;
+
+    std::vector<Triangle> m_Triangles;
+    std::vector<std::vector<uint32_t>> m_Bins;
+
+    //Per pixel, row major
+    std::vector<float> m_Depth;
+    std::vector<uint32_t> m_TriangleIds;
+    std::vector<float> m_L1;
+    std::vector<float> m_L2;
+
+    Stats m_Stats;
+};
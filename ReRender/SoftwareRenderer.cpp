@@ -0,0 +1,488 @@
+#include "SoftwareRenderer.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "AssetLoader.h"
+#include "Image.h"
+#include "Mesh.h"
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    constexpr float PI = 3.141592f;
+    constexpr float Epsilon = 0.00001f;
+    //pbr.hlsl's constant normal incidence Fresnel factor for all dielectrics
+    constexpr float Fdielectric = 0.04f;
+    //tonemap.hlsl
+    constexpr float Gamma = 2.2f;
+    constexpr float Exposure = 1.0f;
+    constexpr float PureWhite = 1.0f;
+
+    //The size D3D12Renderer creates its shadow map with
+    constexpr uint32_t ShadowMapSize = 1024;
+
+    //What sampling an R8_UNORM or an R8G8B8A8_UNORM_SRGB texture decodes each byte to
+    struct DecodeTables
+    {
+        float Unorm[256];
+        float Srgb[256];
+    };
+
+    const DecodeTables& Decode()
+    {
+        static const DecodeTables Tables = []()
+        {
+            DecodeTables Result;
+            for (int i = 0; i < 256; ++i)
+            {
+                const float Value = float(i) / 255.0f;
+                Result.Unorm[i] = Value;
+                Result.Srgb[i] = Value <= 0.04045f ? Value / 12.92f : std::pow((Value + 0.055f) / 1.055f, 2.4f);
+            }
+            return Result;
+        }();
+        return Tables;
+    }
+
+    //tonemap.hlsl's pow(c, 1 / gamma) into an R8G8B8A8_UNORM target, as a search over the values where the byte changes
+    uint8_t EncodeGamma(float Value)
+    {
+        static const std::array<float, 255> Steps = []()
+        {
+            std::array<float, 255> Result;
+            for (int i = 0; i < 255; ++i)
+            {
+                Result[i] = std::pow((float(i) + 0.5f) / 255.0f, Gamma);
+            }
+            return Result;
+        }();
+        return static_cast<uint8_t>(std::upper_bound(Steps.begin(), Steps.end(), Value) - Steps.begin());
+    }
+
+    int Wrap(int Coordinate, int Size)
+    {
+        const int Result = Coordinate % Size;
+        return Result < 0 ? Result + Size : Result;
+    }
+
+    //The four texels of a bilinear sample with wrap addressing on mip 0, like the default sampler without mips
+    struct Footprint
+    {
+        size_t Texels[4];   //Top left, top right, bottom left, bottom right
+        float FractionX;
+        float FractionY;
+    };
+
+    Footprint BilinearFootprint(int Width, int Height, float U, float V)
+    {
+        const float X = U * float(Width) - 0.5f;
+        const float Y = V * float(Height) - 0.5f;
+        const float FloorX = std::floor(X);
+        const float FloorY = std::floor(Y);
+        const int X0 = Wrap(int(FloorX), Width);
+        const int Y0 = Wrap(int(FloorY), Height);
+        const int X1 = X0 + 1 == Width ? 0 : X0 + 1;
+        const int Y1 = Y0 + 1 == Height ? 0 : Y0 + 1;
+
+        Footprint Result;
+        Result.Texels[0] = size_t(Y0) * Width + X0;
+        Result.Texels[1] = size_t(Y0) * Width + X1;
+        Result.Texels[2] = size_t(Y1) * Width + X0;
+        Result.Texels[3] = size_t(Y1) * Width + X1;
+        Result.FractionX = X - FloorX;
+        Result.FractionY = Y - FloorY;
+        return Result;
+    }
+
+    template<typename T>
+    float Filter(const T* Pixels, const Footprint& At, int Stride, int Channel, const float* Table)
+    {
+        const auto Texel = [&](int i)
+        {
+            const T Value = Pixels[At.Texels[i] * Stride + Channel];
+            if constexpr (std::is_same_v<T, float>)
+            {
+                return Value;
+            }
+            else
+            {
+                return Table[Value];
+            }
+        };
+        const float Top = Texel(0) + (Texel(1) - Texel(0)) * At.FractionX;
+        const float Bottom = Texel(2) + (Texel(3) - Texel(2)) * At.FractionX;
+        return Top + (Bottom - Top) * At.FractionY;
+    }
+
+    //The first Count channels, 8 bit textures as UNORM or, with bSrgb, their color channels as SRGB
+    Vec4 Sample(const Image& Texture, float U, float V, int Count, bool bSrgb = false)
+    {
+        const Footprint At = BilinearFootprint(Texture.Width(), Texture.Height(), U, V);
+        Vec4 Result{ 0.0f, 0.0f, 0.0f, 1.0f };
+        for (int c = 0; c < std::min(Count, Texture.Channels()); ++c)
+        {
+            Result[c] = Texture.IsHdr() ? Filter(Texture.Pixels<float>(), At, Texture.Channels(), c, nullptr) :
+                Filter(Texture.Pixels<unsigned char>(), At, Texture.Channels(), c, bSrgb && c < 3 ? Decode().Srgb : Decode().Unorm);
+        }
+        return Result;
+    }
+
+    //GGX/Towbridge-Reitz normal distribution function with alpha = roughness^2
+    float NdfGGX(float CosLh, float Roughness)
+    {
+        const float Alpha = Roughness * Roughness;
+        const float AlphaSq = Alpha * Alpha;
+        const float Denom = (CosLh * CosLh) * (AlphaSq - 1.0f) + 1.0f;
+        return AlphaSq / (PI * Denom * Denom);
+    }
+
+    float GaSchlickG1(float CosTheta, float K)
+    {
+        return CosTheta / (CosTheta * (1.0f - K) + K);
+    }
+
+    //Schlick-GGX with Epic's k remapping for analytic lights
+    float GaSchlickGGX(float CosLi, float CosLo, float Roughness)
+    {
+        const float R = Roughness + 1.0f;
+        const float K = (R * R) / 8.0f;
+        return GaSchlickG1(CosLi, K) * GaSchlickG1(CosLo, K);
+    }
+
+    Vec3 FresnelSchlick(const Vec3& F0, float CosTheta)
+    {
+        const float Base = 1.0f - CosTheta;
+        const float Base2 = Base * Base;
+        return F0 + (Vec3{ 1.0f } - F0) * (Base2 * Base2 * Base);
+    }
+}
+
+SoftwareRenderer::SoftwareRenderer(std::string CapturePath)
+    :m_CapturePath(std::move(CapturePath))
+{}
+
+GLFWwindow* SoftwareRenderer::initialize(int Width, int Height, int)
+{
+    m_Width = static_cast<uint32_t>(Width);
+    m_Height = static_cast<uint32_t>(Height);
+    m_Rasterizer = std::make_unique<SoftwareRasterizer>(m_Width, m_Height, ThreadPool::Get());
+    m_ShadowRasterizer = std::make_unique<SoftwareRasterizer>(ShadowMapSize, ShadowMapSize, ThreadPool::Get());
+    m_Frame.assign(size_t(m_Width) * m_Height * 3, 0);
+
+    std::printf("Software Renderer [no GPU, %ux%u x1, %u pool threads plus the caller]\n", m_Width, m_Height, ThreadPool::Get().NumThreads());
+    return nullptr;
+}
+
+void SoftwareRenderer::ShutDown()
+{
+    const double PerFrame = 1.0 / double(std::max<size_t>(m_Frames, 1));
+    std::printf("Software renderer: %zu frames, %.3f ms update + %.3f ms render per frame\n", m_Frames, m_UpdateMs * PerFrame,
+        (m_VertexMs + m_ShadowMs + m_MainMs + m_ShadeMs) * PerFrame);
+    std::printf("  Per frame     : %.2f ms vertices, %.2f ms shadow pass, %.2f ms main pass, %.2f ms shading\n",
+        m_VertexMs * PerFrame, m_ShadowMs * PerFrame, m_MainMs * PerFrame, m_ShadeMs * PerFrame);
+    for (const SoftwareRasterizer* Rasterizer : { m_ShadowRasterizer.get(), m_Rasterizer.get() })
+    {
+        if (Rasterizer)
+        {
+            const SoftwareRasterizer::Stats& Stats = Rasterizer->LastStats();
+            std::printf("  %-14s: %zu triangles, %zu culled, %zu clipped, %zu rasterized into %zu bin entries\n",
+                Rasterizer == m_Rasterizer.get() ? "Main pass" : "Shadow pass", Stats.Triangles, Stats.Culled, Stats.Clipped, Stats.Rasterized, Stats.BinEntries);
+        }
+    }
+
+    if (!m_CapturePath.empty() && m_Frames > 0)
+    {
+        WritePpm(m_CapturePath, m_Width, m_Height, m_Frame);
+        std::printf("Wrote %s\n", m_CapturePath.c_str());
+    }
+}
+
+void SoftwareRenderer::Setup(const ViewSettings& view, const SceneSettings& Scene)
+{
+    m_View = view;
+    m_Scene = Scene;
+
+    //The assets D3D12Renderer draws, the sky comes straight from the equirectangular image
+    {
+        AssetLoader Loader;
+        const AssetHandle PbrMeshAsset = Loader.RequestMesh("Meshes/cerberus.fbx");
+        const AssetHandle AlbedoAsset = Loader.RequestImage("textures/cerberus_A.png");
+        const AssetHandle NormalAsset = Loader.RequestImage("textures/cerberus_N.png");
+        const AssetHandle MetalnessAsset = Loader.RequestImage("textures/cerberus_M.png");
+        const AssetHandle RoughnessAsset = Loader.RequestImage("textures/cerberus_R.png", 1);
+        const AssetHandle EnvironmentAsset = Loader.RequestImage("environment1.hdr");
+
+        m_PbrMesh = Loader.GetMesh(PbrMeshAsset);
+        m_Albedo = Loader.GetImage(AlbedoAsset);
+        m_Normal = Loader.GetImage(NormalAsset);
+        m_Metalness = Loader.GetImage(MetalnessAsset);
+        m_Roughness = Loader.GetImage(RoughnessAsset);
+        m_Environment = Loader.GetImage(EnvironmentAsset);
+
+        m_PbrMeshlets = MeshletBuilder::Build(*m_PbrMesh);
+        m_SceneFrame.SetModel(&m_PbrMeshlets, &m_PbrMesh->SubMeshes(), &m_PbrMesh->Lods());
+
+        Loader.PrintReport();
+    }
+
+    m_MainClip.resize(m_PbrMesh->Vertices().size());
+    m_ShadowClip.resize(m_PbrMesh->Vertices().size());
+
+    mCamera.SetLens(m_View.fov, float(1024), float(1024), 1.0f, 1000.0f);
+}
+
+void SoftwareRenderer::Update(const float)
+{
+    const auto Start = std::chrono::high_resolution_clock::now();
+
+    m_SceneFrame.Update(mCamera, m_Scene, float(m_Height));
+    m_InverseSkyProjection = glm::inverse(m_SceneFrame.Transform().SkyProjectionMatrix);
+
+    m_UpdateMs += ElapsedMs(Start);
+}
+
+void SoftwareRenderer::Render(GLFWwindow*, const float)
+{
+    ThreadPool& Pool = ThreadPool::Get();
+    const TransformCB& Transform = m_SceneFrame.Transform();
+    const std::vector<Vertex>& Vertices = m_PbrMesh->Vertices();
+    const uint32_t* Indices = reinterpret_cast<const uint32_t*>(m_PbrMesh->Faces().data());
+
+    //pbr.hlsl's and ShadowMap.hlsl's vertex shaders, the shadow pass draws the model untransformed
+    auto Start = std::chrono::high_resolution_clock::now();
+    const Mat4 ModelViewProjection = Transform.ViewPorjectionMatrix * Transform.ObjectMVPMatix;
+    const Mat4 LightToTexture = m_SceneFrame.Shadow().LightToTexture;
+    Pool.ParallelFor(0, Vertices.size(), 4096, [&](size_t Begin, size_t End)
+    {
+        for (size_t i = Begin; i < End; ++i)
+        {
+            const Vec4 Position{ Vertices[i].Position, 1.0f };
+            m_MainClip[i] = ModelViewProjection * Position;
+            m_ShadowClip[i] = LightToTexture * Position;
+        }
+    });
+    m_VertexMs += ElapsedMs(Start);
+
+    //ShadowMap's PSO: depth bias 100000 with a slope scale of 1
+    Start = std::chrono::high_resolution_clock::now();
+    RasterState ShadowState;
+    ShadowState.DepthBias = 100000;
+    ShadowState.SlopeScaledDepthBias = 1.0f;
+    m_ShadowRasterizer->Begin();
+    for (const DrawRange& Range : m_SceneFrame.ShadowDraws())
+    {
+        m_ShadowRasterizer->DrawIndexed(m_ShadowClip.data(), Indices, Range.NumIndices, Range.FirstIndex, Range.BaseVertex, ShadowState);
+    }
+    m_ShadowRasterizer->Rasterize();
+    m_ShadowMs += ElapsedMs(Start);
+
+    Start = std::chrono::high_resolution_clock::now();
+    m_Rasterizer->Begin();
+    for (const DrawRange& Range : m_SceneFrame.MainDraws())
+    {
+        m_Rasterizer->DrawIndexed(m_MainClip.data(), Indices, Range.NumIndices, Range.FirstIndex, Range.BaseVertex);
+    }
+    m_Rasterizer->Rasterize();
+    m_MainMs += ElapsedMs(Start);
+
+    //Sky behind the model, the debugger's quad over the bottom right quarter, then tonemap.hlsl
+    Start = std::chrono::high_resolution_clock::now();
+    m_Rasterizer->ForEachTile([this](uint32_t X0, uint32_t Y0, uint32_t X1, uint32_t Y1)
+    {
+        for (uint32_t Y = Y0; Y < Y1; ++Y)
+        {
+            for (uint32_t X = X0; X < X1; ++X)
+            {
+                const float NdcX = (float(X) + 0.5f) / float(m_Width) * 2.0f - 1.0f;
+                const float NdcY = 1.0f - (float(Y) + 0.5f) / float(m_Height) * 2.0f;
+
+                Vec3 Color;
+                SoftwareRasterizer::Sample Pixel;
+                if (NdcX >= 0.0f && NdcY <= 0.0f)
+                {
+                    Color = Vec3{ SampleShadowMap(NdcX, -NdcY) };
+                }
+                else if (m_Rasterizer->Resolve(X, Y, Pixel))
+                {
+                    Color = ShadePbr(Pixel);
+                }
+                else
+                {
+                    Color = ShadeSky(NdcX, NdcY);
+                }
+
+                //Reinhard on luminance
+                Color *= Exposure;
+                const float Luminance = glm::dot(Color, Vec3{ 0.2126f, 0.7152f, 0.0722f });
+                const float MappedLuminance = (Luminance * (1.0f + Luminance / (PureWhite * PureWhite))) / (1.0f + Luminance);
+                const Vec3 Mapped = Luminance > 0.0f ? (MappedLuminance / Luminance) * Color : Vec3{ 0.0f };
+
+                uint8_t* Out = &m_Frame[(size_t(Y) * m_Width + X) * 3];
+                for (int c = 0; c < 3; ++c)
+                {
+                    Out[c] = EncodeGamma(Mapped[c]);
+                }
+            }
+        }
+    });
+    m_ShadeMs += ElapsedMs(Start);
+
+    ++m_Frames;
+}
+
+Vec3 SoftwareRenderer::ShadePbr(const SoftwareRasterizer::Sample& Pixel) const
+{
+    const std::vector<Vertex>& Vertices = m_PbrMesh->Vertices();
+    const Vertex& A = Vertices[Pixel.Vertices[0]];
+    const Vertex& B = Vertices[Pixel.Vertices[1]];
+    const Vertex& C = Vertices[Pixel.Vertices[2]];
+    const Vec3& Weights = Pixel.Barycentrics;
+    const auto Interpolate = [&Weights](const auto& InA, const auto& InB, const auto& InC) { return InA * Weights.x + InB * Weights.y + InC * Weights.z; };
+
+    //main_vs
+    const Mat4& Model = m_SceneFrame.Transform().ObjectMVPMatix;
+    const Vec3 Position = Vec3{ Model * Vec4{ Interpolate(A.Position, B.Position, C.Position), 1.0f } };
+    const Vec2 Texcoord = Interpolate(A.Texcoord, B.Texcoord, C.Texcoord);
+    const float U = Texcoord.x;
+    const float V = 1.0f - Texcoord.y;
+    const glm::mat3 TangentBasis = glm::mat3{ Model } * glm::mat3{ Interpolate(A.Tangent, B.Tangent, C.Tangent),
+        Interpolate(A.BiTangent, B.BiTangent, C.BiTangent), Interpolate(A.Normal, B.Normal, C.Normal) };
+
+    //main_ps
+    const ShadingCB& Shading = m_SceneFrame.Shading();
+    const Vec3 Albedo = Vec3{ Sample(*m_Albedo, U, V, 3, true) };
+    const float Metalness = Sample(*m_Metalness, U, V, 1).r;
+    const float Roughness = Sample(*m_Roughness, U, V, 1).r;
+
+    const Vec3 Lo = glm::normalize(Vec3{ Shading.EyePosition } - Position);
+    const Vec3 N = glm::normalize(TangentBasis * glm::normalize(2.0f * Vec3{ Sample(*m_Normal, U, V, 3) } - 1.0f));
+    const float CosLo = std::max(0.0f, glm::dot(N, Lo));
+    const Vec3 F0 = glm::mix(Vec3{ Fdielectric }, Albedo, Metalness);
+
+    Vec3 DirectLighting{ 0.0f };
+    for (int i = 0; i < SceneSettings::NumLights; ++i)
+    {
+        const Vec3 Li = -Vec3{ Shading.Light[i].Direction };
+        const Vec3 Lradiance = Vec3{ Shading.Light[i].Radiance };
+        const Vec3 Lh = glm::normalize(Li + Lo);
+
+        const float CosLi = std::max(0.0f, glm::dot(N, Li));
+        const float CosLh = std::max(0.0f, glm::dot(N, Lh));
+
+        const Vec3 F = FresnelSchlick(F0, std::max(0.0f, glm::dot(Lh, Lo)));
+        const float D = NdfGGX(CosLh, Roughness);
+        const float G = GaSchlickGGX(CosLi, CosLo, Roughness);
+
+        //Lambert without the 1/PI, like the shader
+        const Vec3 Kd = glm::mix(Vec3{ 1.0f } - F, Vec3{ 0.0f }, Metalness);
+        const Vec3 DiffuseBRDF = Kd * Albedo;
+        const Vec3 SpecularBRDF = (F * D * G) / std::max(Epsilon, 4.0f * CosLi * CosLo);
+
+        DirectLighting += (DiffuseBRDF + SpecularBRDF) * Lradiance * CosLi;
+    }
+    return DirectLighting;
+}
+
+Vec3 SoftwareRenderer::ShadeSky(float X, float Y) const
+{
+    //The skybox's local position is the view ray, what equirect2cube.hlsl maps to lat-long coordinates
+    const Vec4 Far = m_InverseSkyProjection * Vec4{ X, Y, 1.0f, 1.0f };
+    const Vec3 Direction = glm::normalize(Vec3{ Far } / Far.w);
+    const float Phi = std::atan2(Direction.z, Direction.x);
+    const float Theta = std::acos(std::clamp(Direction.y, -1.0f, 1.0f));
+    return Vec3{ Sample(*m_Environment, Phi / (2.0f * PI), Theta / PI, 3) };
+}
+
+float SoftwareRenderer::SampleShadowMap(float U, float V) const
+{
+    const Footprint At = BilinearFootprint(int(ShadowMapSize), int(ShadowMapSize), U, V);
+    return Filter(m_ShadowRasterizer->Depth().data(), At, 1, 0, nullptr);
+}
+
+void SoftwareRenderer::SetLight()
+{
+    m_Scene.Lights[0].Position = mCamera.GetPosition();
+    m_Scene.Lights[0].Direction = mCamera.GetLook();
+    printf("Set Light[0] Position %.3f %.3f %.3f \n", m_Scene.Lights[0].Position[0], m_Scene.Lights[0].Position[1], m_Scene.Lights[0].Position[2]);
+    printf("Set Light[0] Direction %.3f %.3f %.3f \n", m_Scene.Lights[0].Direction[0], m_Scene.Lights[0].Direction[1], m_Scene.Lights[0].Direction[2]);
+}
+
+void SoftwareRenderer::WritePpm(const std::string& FileName, uint32_t Width, uint32_t Height, const std::vector<uint8_t>& Rgb)
+{
+    if (Rgb.size() != size_t(Width) * Height * 3)
+    {
+        throw std::invalid_argument("WritePpm: " + std::to_string(Rgb.size()) + " bytes are not a " + std::to_string(Width) + "x" + std::to_string(Height) + " RGB image");
+    }
+
+    std::ofstream File(FileName, std::ios::binary);
+    File << "P6\n" << Width << " " << Height << "\n255\n";
+    File.write(reinterpret_cast<const char*>(Rgb.data()), std::streamsize(Rgb.size()));
+    if (!File)
+    {
+        throw std::runtime_error("Failed to write image file :" + FileName);
+    }
+}
+
+void SoftwareRenderer::ReadPpm(const std::string& FileName, uint32_t& Width, uint32_t& Height, std::vector<uint8_t>& Rgb)
+{
+    std::ifstream File(FileName, std::ios::binary);
+    std::string Magic;
+    uint32_t MaxValue = 0;
+    File >> Magic >> Width >> Height >> MaxValue;
+    if (!File || Magic != "P6" || MaxValue != 255 || Width == 0 || Height == 0)
+    {
+        throw std::runtime_error("Not an 8 bit binary PPM file :" + FileName);
+    }
+
+    //A single whitespace separates the header from the pixels
+    File.get();
+    Rgb.resize(size_t(Width) * Height * 3);
+    File.read(reinterpret_cast<char*>(Rgb.data()), std::streamsize(Rgb.size()));
+    if (!File)
+    {
+        throw std::runtime_error("Truncated PPM file :" + FileName);
+    }
+}
+
+bool SoftwareRenderer::CompareImages(const std::string& ExpectedFile, const std::string& ActualFile, double Tolerance)
+{
+    uint32_t ExpectedWidth, ExpectedHeight, ActualWidth, ActualHeight;
+    std::vector<uint8_t> Expected, Actual;
+    ReadPpm(ExpectedFile, ExpectedWidth, ExpectedHeight, Expected);
+    ReadPpm(ActualFile, ActualWidth, ActualHeight, Actual);
+    if (ExpectedWidth != ActualWidth || ExpectedHeight != ActualHeight)
+    {
+        std::printf("Image compare: %ux%u expected, %ux%u actual: FAILED\n", ExpectedWidth, ExpectedHeight, ActualWidth, ActualHeight);
+        return false;
+    }
+
+    double SquaredError = 0.0;
+    int MaxDifference = 0;
+    size_t DifferentPixels = 0;
+    for (size_t Pixel = 0; Pixel < Expected.size() / 3; ++Pixel)
+    {
+        bool bDifferent = false;
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const int Difference = std::abs(int(Expected[Pixel * 3 + c]) - int(Actual[Pixel * 3 + c]));
+            SquaredError += double(Difference) * Difference;
+            MaxDifference = std::max(MaxDifference, Difference);
+            bDifferent = bDifferent || Difference != 0;
+        }
+        DifferentPixels += bDifferent;
+    }
+    const double RmsError = std::sqrt(SquaredError / double(Expected.size()));
+    const bool bPassed = RmsError <= Tolerance;
+
+    std::printf("Image compare: %ux%u, %zu pixels differ (%.3f%%), max difference %d, RMS error %.4f against %.4f: %s\n", ActualWidth, ActualHeight,
+        DifferentPixels, 100.0 * double(DifferentPixels) / double(Expected.size() / 3), MaxDifference, RmsError, Tolerance, bPassed ? "ok" : "FAILED");
+    return bPassed;
+}
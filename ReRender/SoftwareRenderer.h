@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Meshlet.h"
+#include "Renderer.h"
+#include "SceneFrame.h"
+#include "SoftwareRasterizer.h"
+
+class Image;
+class Mesh;
+
+// Headless RendererInterface that draws the D3D12Renderer scene on the CPU, as the reference for shading
+// regressions and for golden images on machines without a GPU. Update runs the same SceneFrame work, Render
+// transforms the model on the thread pool, rasterizes the shadow and main pass draw lists with
+// SoftwareRasterizer and shades every pixel once, tile by tile: the environment behind the model, pbr.hlsl's
+// direct lighting with the same textures, the debugger's shadow map quad and tonemap.hlsl's Reinhard and gamma.
+// Differences to the GPU: one sample per pixel, bilinear filtering of mip 0, the sky sampled straight from the
+// equirectangular image and no IBL ambient term, the baked environment maps only exist on the GPU.
+// E.g. ReRender.exe --software --capture frame.ppm
+class SoftwareRenderer final : public RendererInterface
+{
+public:
+    //CapturePath: ShutDown writes the last frame there as a binary PPM, nothing is written when empty
+    explicit SoftwareRenderer(std::string CapturePath = {});
+
+    //Returns nullptr, there is no window. MaxSamples is ignored, every pixel is shaded once
+    GLFWwindow* initialize(int Width, int Height, int MaxSamples) override;
+    void ShutDown() override;
+    void Setup(const ViewSettings& view, const SceneSettings& Scene) override;
+    void Update(const float DeltaTime) override;
+    void Render(GLFWwindow* Window, const float DeltaTime) override;
+
+    void SetLight() override;
+
+    //The last frame after tonemapping, 8 bit RGB rows from the top
+    const std::vector<uint8_t>& Frame() const { return m_Frame; }
+
+    static void WritePpm(const std::string& FileName, uint32_t Width, uint32_t Height, const std::vector<uint8_t>& Rgb);
+    static void ReadPpm(const std::string& FileName, uint32_t& Width, uint32_t& Height, std::vector<uint8_t>& Rgb);
+
+    // Compares two captures channel by channel and prints the differences. False when the sizes differ or the
+    // RMS error over all channels, in 8 bit steps, is above Tolerance.
+    static bool CompareImages(const std::string& ExpectedFile, const std::string& ActualFile, double Tolerance);
+
+private:
+    //pbr.hlsl's main_ps for the pixel's triangle, in linear HDR
+    Vec3 ShadePbr(const SoftwareRasterizer::Sample& Pixel) const;
+    //skybox.hlsl for the view ray through NDC (X, Y)
+    Vec3 ShadeSky(float X, float Y) const;
+    //debug.hlsl's shadow map depth at UV
+    float SampleShadowMap(float U, float V) const;
+
+    const std::string m_CapturePath;
+
+    uint32_t m_Width = 0;
+    uint32_t m_Height = 0;
+    std::unique_ptr<SoftwareRasterizer> m_Rasterizer;
+    std::unique_ptr<SoftwareRasterizer> m_ShadowRasterizer;
+
+    std::shared_ptr<Mesh> m_PbrMesh;
+    MeshletData m_PbrMeshlets;
+    std::shared_ptr<Image> m_Albedo;
+    std::shared_ptr<Image> m_Normal;
+    std::shared_ptr<Image> m_Metalness;
+    std::shared_ptr<Image> m_Roughness;
+    std::shared_ptr<Image> m_Environment;
+
+    SceneFrame m_SceneFrame;
+    Mat4 m_InverseSkyProjection = Mat4{ 1.0f };
+
+    //Per vertex of the model, the main pass's and the shadow pass's clip positions
+    std::vector<Vec4> m_MainClip;
+    std::vector<Vec4> m_ShadowClip;
+    std::vector<uint8_t> m_Frame;
+
+    size_t m_Frames = 0;
+    double m_UpdateMs = 0.0;
+    double m_VertexMs = 0.0;
+    double m_ShadowMs = 0.0;
+    double m_MainMs = 0.0;
+    double m_ShadeMs = 0.0;
+
+    ViewSettings m_View;
+    SceneSettings m_Scene;
+};
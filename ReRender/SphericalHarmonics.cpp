@@ -0,0 +1,503 @@
+#include "SphericalHarmonics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <emmintrin.h>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/include/glm/gtc/packing.hpp>
+
+#include "PortableUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+
+    //Direction of face texel (s, t) in [-1, 1] is Origin + s * S + t * T, the D3D cube layout
+    struct FaceAxes
+    {
+        float Origin[3];
+        float S[3];
+        float T[3];
+    };
+    const FaceAxes CubeFaces[6] = {
+        { {  1.0f,  0.0f,  0.0f }, {  0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f,  0.0f } },
+        { { -1.0f,  0.0f,  0.0f }, {  0.0f, 0.0f,  1.0f }, { 0.0f, -1.0f,  0.0f } },
+        { {  0.0f,  1.0f,  0.0f }, {  1.0f, 0.0f,  0.0f }, { 0.0f,  0.0f,  1.0f } },
+        { {  0.0f, -1.0f,  0.0f }, {  1.0f, 0.0f,  0.0f }, { 0.0f,  0.0f, -1.0f } },
+        { {  0.0f,  0.0f,  1.0f }, {  1.0f, 0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f } },
+        { {  0.0f,  0.0f, -1.0f }, { -1.0f, 0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f } },
+    };
+
+    //Per basis function, the cosine lobe's A_l / PI times the square of the basis constant, see IrradianceSH
+    const double BasisScale[9] = {
+        1.0 / (4.0 * PI),
+        1.0 / (2.0 * PI), 1.0 / (2.0 * PI), 1.0 / (2.0 * PI),
+        15.0 / (16.0 * PI), 15.0 / (16.0 * PI), 5.0 / (64.0 * PI), 15.0 / (16.0 * PI), 15.0 / (64.0 * PI),
+    };
+
+    //Four float16 values to float, denormals, infinities and NaNs included
+    __m128 DecodeHalf4(const uint16_t* Source)
+    {
+        const __m128i Half = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Source)), _mm_setzero_si128());
+        const __m128i Sign = _mm_slli_epi32(_mm_and_si128(Half, _mm_set1_epi32(0x8000)), 16);
+        const __m128i Magnitude = _mm_and_si128(Half, _mm_set1_epi32(0x7fff));
+        const __m128i Shifted = _mm_slli_epi32(Magnitude, 13);
+        //Rebias the exponent by 2^112, the multiply also normalizes float16 denormals
+        const __m128i Scaled = _mm_castps_si128(_mm_mul_ps(_mm_castsi128_ps(Shifted), _mm_castsi128_ps(_mm_set1_epi32(0x77800000))));
+        const __m128i Special = _mm_cmpgt_epi32(Magnitude, _mm_set1_epi32(0x7bff));
+        const __m128i Bits = _mm_or_si128(_mm_andnot_si128(Special, Scaled), _mm_and_si128(Special, _mm_or_si128(Shifted, _mm_set1_epi32(0x7f800000))));
+        return _mm_castsi128_ps(_mm_or_si128(Bits, Sign));
+    }
+
+    //Row Y of a face as RGBA floats, padded with zero texels up to a multiple of four
+    const float* FaceRow(const float* Face, uint32_t Size, uint32_t Y, std::vector<float>& Scratch)
+    {
+        const float* Row = Face + size_t(Y) * Size * 4;
+        if (Size % 4 == 0)
+        {
+            return Row;
+        }
+        std::copy(Row, Row + size_t(Size) * 4, Scratch.begin());
+        return Scratch.data();
+    }
+
+    const float* FaceRow(const uint16_t* Face, uint32_t Size, uint32_t Y, std::vector<float>& Scratch)
+    {
+        const uint16_t* Row = Face + size_t(Y) * Size * 4;
+        for (uint32_t Value = 0; Value < Size * 4; Value += 4)
+        {
+            _mm_storeu_ps(Scratch.data() + Value, DecodeHalf4(Row + Value));
+        }
+        return Scratch.data();
+    }
+
+    //Sums of radiance times each basis polynomial and of the weights, per face before any normalization
+    struct FaceMoments
+    {
+        double Sum[9][3] = {};
+        double Weight = 0.0;
+    };
+
+    template<typename TexelType>
+    FaceMoments ProjectFace(const TexelType* Face, const FaceAxes& Axes, uint32_t Size)
+    {
+        const uint32_t PaddedSize = (Size + 3) & ~3u;
+        std::vector<float> Scratch(size_t(PaddedSize) * 4, 0.0f);
+        const float TexelSize = 2.0f / float(Size);
+        const __m128 LaneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 One = _mm_set1_ps(1.0f);
+        const __m128 Three = _mm_set1_ps(3.0f);
+
+        FaceMoments Moments;
+        for (uint32_t Y = 0; Y < Size; ++Y)
+        {
+            const float* Row = FaceRow(Face, Size, Y, Scratch);
+            const __m128 T = _mm_set1_ps((float(Y) + 0.5f) * TexelSize - 1.0f);
+            const __m128 RowX = _mm_add_ps(_mm_set1_ps(Axes.Origin[0]), _mm_mul_ps(T, _mm_set1_ps(Axes.T[0])));
+            const __m128 RowY = _mm_add_ps(_mm_set1_ps(Axes.Origin[1]), _mm_mul_ps(T, _mm_set1_ps(Axes.T[1])));
+            const __m128 RowZ = _mm_add_ps(_mm_set1_ps(Axes.Origin[2]), _mm_mul_ps(T, _mm_set1_ps(Axes.T[2])));
+            const __m128 RowLength2 = _mm_add_ps(One, _mm_mul_ps(T, T));
+
+            __m128 Sum[9][3];
+            for (int k = 0; k < 9; ++k)
+            {
+                Sum[k][0] = Sum[k][1] = Sum[k][2] = _mm_setzero_ps();
+            }
+            __m128 WeightSum = _mm_setzero_ps();
+
+            for (uint32_t X = 0; X < Size; X += 4)
+            {
+                const __m128 S = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(X)), LaneOffsets), _mm_set1_ps(TexelSize)), One);
+                //|Origin + s S + t T|^2 = 1 + s^2 + t^2, the face axes are orthonormal
+                const __m128 InvLength = _mm_div_ps(One, _mm_sqrt_ps(_mm_add_ps(RowLength2, _mm_mul_ps(S, S))));
+                const __m128 Dx = _mm_mul_ps(_mm_add_ps(RowX, _mm_mul_ps(S, _mm_set1_ps(Axes.S[0]))), InvLength);
+                const __m128 Dy = _mm_mul_ps(_mm_add_ps(RowY, _mm_mul_ps(S, _mm_set1_ps(Axes.S[1]))), InvLength);
+                const __m128 Dz = _mm_mul_ps(_mm_add_ps(RowZ, _mm_mul_ps(S, _mm_set1_ps(Axes.S[2]))), InvLength);
+
+                //Solid angle of a texel, up to the constant texel area: the projected area falls off with 1 / r^3
+                __m128 Weight = _mm_mul_ps(InvLength, _mm_mul_ps(InvLength, InvLength));
+                if (X + 4 > Size)
+                {
+                    const __m128 Valid = _mm_cmplt_ps(_mm_add_ps(_mm_set1_ps(float(X)), LaneOffsets), _mm_set1_ps(float(Size)));
+                    Weight = _mm_and_ps(Weight, Valid);
+                }
+
+                __m128 R = _mm_loadu_ps(Row + size_t(X) * 4);
+                __m128 G = _mm_loadu_ps(Row + size_t(X) * 4 + 4);
+                __m128 B = _mm_loadu_ps(Row + size_t(X) * 4 + 8);
+                __m128 A = _mm_loadu_ps(Row + size_t(X) * 4 + 12);
+                _MM_TRANSPOSE4_PS(R, G, B, A);
+                R = _mm_mul_ps(R, Weight);
+                G = _mm_mul_ps(G, Weight);
+                B = _mm_mul_ps(B, Weight);
+
+                const __m128 Basis[9] = {
+                    One,
+                    Dy,
+                    Dz,
+                    Dx,
+                    _mm_mul_ps(Dx, Dy),
+                    _mm_mul_ps(Dy, Dz),
+                    _mm_sub_ps(_mm_mul_ps(Three, _mm_mul_ps(Dz, Dz)), One),
+                    _mm_mul_ps(Dx, Dz),
+                    _mm_sub_ps(_mm_mul_ps(Dx, Dx), _mm_mul_ps(Dy, Dy)),
+                };
+                for (int k = 0; k < 9; ++k)
+                {
+                    Sum[k][0] = _mm_add_ps(Sum[k][0], _mm_mul_ps(Basis[k], R));
+                    Sum[k][1] = _mm_add_ps(Sum[k][1], _mm_mul_ps(Basis[k], G));
+                    Sum[k][2] = _mm_add_ps(Sum[k][2], _mm_mul_ps(Basis[k], B));
+                }
+                WeightSum = _mm_add_ps(WeightSum, Weight);
+            }
+
+            //Rows are short enough for float lanes, the face total is kept in double
+            alignas(16) float Lanes[4];
+            for (int k = 0; k < 9; ++k)
+            {
+                for (int Channel = 0; Channel < 3; ++Channel)
+                {
+                    _mm_store_ps(Lanes, Sum[k][Channel]);
+                    Moments.Sum[k][Channel] += double(Lanes[0]) + double(Lanes[1]) + double(Lanes[2]) + double(Lanes[3]);
+                }
+            }
+            _mm_store_ps(Lanes, WeightSum);
+            Moments.Weight += double(Lanes[0]) + double(Lanes[1]) + double(Lanes[2]) + double(Lanes[3]);
+        }
+        return Moments;
+    }
+
+    template<typename TexelType>
+    IrradianceSH Project(ThreadPool& Pool, const TexelType* const Faces[6], uint32_t Size)
+    {
+        if (Size == 0)
+        {
+            throw std::invalid_argument("The SH projection needs a cube with at least one texel per face");
+        }
+
+        FaceMoments Moments[6];
+        Pool.ParallelFor(0, 6, 1, [&](size_t Begin, size_t End)
+        {
+            for (size_t Face = Begin; Face < End; ++Face)
+            {
+                Moments[Face] = ProjectFace(Faces[Face], CubeFaces[Face], Size);
+            }
+        });
+
+        //Normalizing by the summed weights makes the discrete solid angles add up to exactly 4 PI
+        double Sum[9][3] = {};
+        double Weight = 0.0;
+        for (const FaceMoments& Face : Moments)
+        {
+            for (int k = 0; k < 9; ++k)
+            {
+                for (int Channel = 0; Channel < 3; ++Channel)
+                {
+                    Sum[k][Channel] += Face.Sum[k][Channel];
+                }
+            }
+            Weight += Face.Weight;
+        }
+
+        IrradianceSH Result;
+        for (int k = 0; k < 9; ++k)
+        {
+            const double Scale = BasisScale[k] * 4.0 * PI / Weight;
+            Result.Coefficients[k] = Vec4{ float(Sum[k][0] * Scale), float(Sum[k][1] * Scale), float(Sum[k][2] * Scale), 0.0f };
+        }
+        return Result;
+    }
+}
+
+Vec3 IrradianceSH::Evaluate(const Vec3& N) const
+{
+    return Vec3{ Coefficients[0] }
+        + Vec3{ Coefficients[1] } * N.y
+        + Vec3{ Coefficients[2] } * N.z
+        + Vec3{ Coefficients[3] } * N.x
+        + Vec3{ Coefficients[4] } * (N.x * N.y)
+        + Vec3{ Coefficients[5] } * (N.y * N.z)
+        + Vec3{ Coefficients[6] } * (3.0f * N.z * N.z - 1.0f)
+        + Vec3{ Coefficients[7] } * (N.x * N.z)
+        + Vec3{ Coefficients[8] } * (N.x * N.x - N.y * N.y);
+}
+
+IrradianceSH SphericalHarmonics::ProjectIrradiance(ThreadPool& Pool, const float* const Faces[6], uint32_t Size)
+{
+    return Project(Pool, Faces, Size);
+}
+
+IrradianceSH SphericalHarmonics::ProjectIrradiance(ThreadPool& Pool, const uint16_t* const Faces[6], uint32_t Size)
+{
+    return Project(Pool, Faces, Size);
+}
+
+namespace
+{
+    //A float RGBA cube with Radiance evaluated at every texel center
+    std::vector<float> MakeCube(uint32_t Size, const std::function<Vec3(const Vec3&)>& Radiance)
+    {
+        std::vector<float> Cube(size_t(6) * Size * Size * 4);
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            const FaceAxes& Axes = CubeFaces[Face];
+            for (uint32_t Y = 0; Y < Size; ++Y)
+            {
+                for (uint32_t X = 0; X < Size; ++X)
+                {
+                    const float S = (float(X) + 0.5f) * 2.0f / float(Size) - 1.0f;
+                    const float T = (float(Y) + 0.5f) * 2.0f / float(Size) - 1.0f;
+                    const Vec3 Direction = glm::normalize(Vec3{ Axes.Origin[0], Axes.Origin[1], Axes.Origin[2] } +
+                        S * Vec3{ Axes.S[0], Axes.S[1], Axes.S[2] } + T * Vec3{ Axes.T[0], Axes.T[1], Axes.T[2] });
+                    const Vec3 Value = Radiance(Direction);
+                    float* Out = Cube.data() + ((size_t(Face) * Size + Y) * Size + X) * 4;
+                    Out[0] = Value.x;
+                    Out[1] = Value.y;
+                    Out[2] = Value.z;
+                    Out[3] = 1.0f;
+                }
+            }
+        }
+        return Cube;
+    }
+
+    //Exact solid angle of the texel between (S0, T0) and (S1, T1) on a face at distance one
+    double TexelSolidAngle(double S0, double T0, double S1, double T1)
+    {
+        const auto Corner = [](double S, double T) { return std::atan2(S * T, std::sqrt(S * S + T * T + 1.0)); };
+        return Corner(S0, T0) - Corner(S0, T1) - Corner(S1, T0) + Corner(S1, T1);
+    }
+
+    //Diffuse irradiance by brute force: the cosine weighted integral of every texel over PI
+    Vec3 BruteForceIrradiance(const std::vector<float>& Cube, uint32_t Size, const Vec3& N)
+    {
+        double Sum[3] = {};
+        const double Step = 2.0 / Size;
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            const FaceAxes& Axes = CubeFaces[Face];
+            for (uint32_t Y = 0; Y < Size; ++Y)
+            {
+                for (uint32_t X = 0; X < Size; ++X)
+                {
+                    const double S = (X + 0.5) * Step - 1.0;
+                    const double T = (Y + 0.5) * Step - 1.0;
+                    double Direction[3];
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        Direction[i] = Axes.Origin[i] + S * Axes.S[i] + T * Axes.T[i];
+                    }
+                    const double Length = std::sqrt(1.0 + S * S + T * T);
+                    const double CosTheta = (N.x * Direction[0] + N.y * Direction[1] + N.z * Direction[2]) / Length;
+                    if (CosTheta <= 0.0)
+                    {
+                        continue;
+                    }
+                    const double Weight = CosTheta * TexelSolidAngle(X * Step - 1.0, Y * Step - 1.0, (X + 1) * Step - 1.0, (Y + 1) * Step - 1.0);
+                    const float* Texel = Cube.data() + ((size_t(Face) * Size + Y) * Size + X) * 4;
+                    for (int Channel = 0; Channel < 3; ++Channel)
+                    {
+                        Sum[Channel] += Texel[Channel] * Weight;
+                    }
+                }
+            }
+        }
+        return Vec3{ float(Sum[0] / PI), float(Sum[1] / PI), float(Sum[2] / PI) };
+    }
+
+    std::vector<uint16_t> EncodeCube(const std::vector<float>& Cube)
+    {
+        std::vector<uint16_t> Half(Cube.size());
+        for (size_t i = 0; i < Cube.size(); ++i)
+        {
+            Half[i] = glm::packHalf1x16(Cube[i]);
+        }
+        return Half;
+    }
+
+    template<typename TexelType>
+    IrradianceSH ProjectCube(ThreadPool& Pool, const std::vector<TexelType>& Cube, uint32_t Size)
+    {
+        const TexelType* Faces[6];
+        for (uint32_t Face = 0; Face < 6; ++Face)
+        {
+            Faces[Face] = Cube.data() + size_t(Face) * Size * Size * 4;
+        }
+        return SphericalHarmonics::ProjectIrradiance(Pool, Faces, Size);
+    }
+
+    //Fibonacci sphere, normals spread evenly over every face and its edges
+    std::vector<Vec3> TestNormals(uint32_t Count)
+    {
+        std::vector<Vec3> Normals;
+        for (uint32_t i = 0; i < Count; ++i)
+        {
+            const float Z = 1.0f - 2.0f * (float(i) + 0.5f) / float(Count);
+            const float Radius = std::sqrt(std::max(0.0f, 1.0f - Z * Z));
+            const float Phi = float(i) * 2.39996323f;
+            Normals.push_back(Vec3{ Radius * std::cos(Phi), Radius * std::sin(Phi), Z });
+        }
+        return Normals;
+    }
+
+    Vec3 SmoothSky(const Vec3& D)
+    {
+        return Vec3{ 1.0f + 0.5f * D.x + 0.25f * D.y + 0.6f * D.z * D.z,
+            2.0f - 0.3f * D.x * D.y + 0.2f * D.z,
+            0.5f + 0.4f * (D.x * D.x - D.y * D.y) + 0.3f * D.y * D.z };
+    }
+
+    //A small, very bright sun over a dim sky, about as far from band limited as environments get
+    Vec3 SunSky(const Vec3& D)
+    {
+        const Vec3 Sun = glm::normalize(Vec3{ 0.3f, 0.8f, -0.5f });
+        const float Disc = std::pow(std::max(0.0f, glm::dot(D, Sun)), 64.0f);
+        return Vec3{ 0.2f, 0.3f, 0.5f } * (0.75f + 0.25f * D.y) + Vec3{ 40.0f, 36.0f, 30.0f } * Disc;
+    }
+}
+
+bool SphericalHarmonics::SelfTest()
+{
+    TestHarness Harness;
+
+    ThreadPool Serial{ 0 };
+    const std::vector<Vec3> Normals = TestNormals(96);
+    //Largest difference to the brute-force integral over every normal and channel, relative to the mean or to the
+    //peak irradiance
+    const auto RelativeError = [&](const IrradianceSH& Projected, const std::vector<float>& Cube, uint32_t Size, bool bToPeak = false)
+    {
+        double MaxError = 0.0;
+        double Mean = 0.0;
+        double Peak = 0.0;
+        for (const Vec3& N : Normals)
+        {
+            const Vec3 Expected = BruteForceIrradiance(Cube, Size, N);
+            const Vec3 Actual = Projected.Evaluate(N);
+            for (int Channel = 0; Channel < 3; ++Channel)
+            {
+                MaxError = std::max(MaxError, double(std::abs(Actual[Channel] - Expected[Channel])));
+                Mean += Expected[Channel];
+                Peak = std::max(Peak, double(Expected[Channel]));
+            }
+        }
+        return MaxError / (bToPeak ? Peak : Mean / (3.0 * Normals.size()));
+    };
+
+    std::printf("Spherical harmonics self test\n");
+
+    Harness.Run("White furnace", [&]()
+    {
+        for (uint32_t Size : { 1u, 6u, 32u })
+        {
+            const std::vector<float> White = MakeCube(Size, [](const Vec3&) { return Vec3{ 1.0f }; });
+            const IrradianceSH Projected = ProjectCube(Serial, White, Size);
+            float MaxError = 0.0f;
+            for (const Vec3& N : Normals)
+            {
+                const Vec3 Value = Projected.Evaluate(N);
+                MaxError = std::max({ MaxError, std::abs(Value.x - 1.0f), std::abs(Value.y - 1.0f), std::abs(Value.z - 1.0f) });
+            }
+            Harness.Check(MaxError < 1e-4f, "a white environment irradiates one everywhere, on any face size");
+        }
+    });
+
+    Harness.Run("Smooth environment", [&]()
+    {
+        //Quadratic in the direction, so L2 holds all of it and only the quadrature differs from the brute force
+        const uint32_t Size = 32;
+        const std::vector<float> Cube = MakeCube(Size, SmoothSky);
+        const double Error = RelativeError(ProjectCube(Serial, Cube, Size), Cube, Size);
+        std::printf("    max error %.2e of the mean irradiance\n", Error);
+        Harness.Check(Error < 2e-3, "matches the brute-force cosine integral");
+    });
+
+    Harness.Run("Sharp environment", [&]()
+    {
+        //The sun is far above band 2, what is left is the truncation of the clamped cosine itself. For a directional
+        //light that is at most 3/32 of its peak irradiance, a disc of finite size stays below
+        const uint32_t Size = 32;
+        const std::vector<float> Cube = MakeCube(Size, SunSky);
+        const double Error = RelativeError(ProjectCube(Serial, Cube, Size), Cube, Size, true);
+        std::printf("    max error %.2e of the peak irradiance\n", Error);
+        Harness.Check(Error < 3.0 / 32.0, "stays within the L2 truncation bound of the brute-force integral");
+    });
+
+    Harness.Run("Odd face sizes", [&]()
+    {
+        for (uint32_t Size : { 5u, 7u, 30u })
+        {
+            const std::vector<float> Cube = MakeCube(Size, SmoothSky);
+            Harness.Check(RelativeError(ProjectCube(Serial, Cube, Size), Cube, Size) < 2e-2, "partial SIMD rows are masked");
+        }
+    });
+
+    Harness.Run("Float16 input", [&]()
+    {
+        const uint32_t Size = 30;
+        const std::vector<float> Cube = MakeCube(Size, SunSky);
+        const IrradianceSH Float = ProjectCube(Serial, Cube, Size);
+        const IrradianceSH Half = ProjectCube(Serial, EncodeCube(Cube), Size);
+        float MaxError = 0.0f;
+        for (int k = 0; k < 9; ++k)
+        {
+            for (int Channel = 0; Channel < 3; ++Channel)
+            {
+                MaxError = std::max(MaxError, std::abs(Float.Coefficients[k][Channel] - Half.Coefficients[k][Channel]));
+            }
+        }
+        Harness.Check(MaxError < 2e-3f * std::abs(Float.Coefficients[0].x), "float16 texels project like their float originals");
+
+        const uint16_t Specials[4] = { 0x0001, 0x7c00, 0xfc00, 0x8400 };
+        alignas(16) float Decoded[4];
+        _mm_store_ps(Decoded, DecodeHalf4(Specials));
+        Harness.Check(Decoded[0] == glm::unpackHalf1x16(Specials[0]) && std::isinf(Decoded[1]) && Decoded[1] > 0.0f &&
+            std::isinf(Decoded[2]) && Decoded[2] < 0.0f && Decoded[3] == glm::unpackHalf1x16(Specials[3]), "denormals, infinities and signs decode exactly");
+    });
+
+    Harness.Run("Thread count independence", [&]()
+    {
+        const uint32_t Size = 64;
+        const std::vector<uint16_t> Cube = EncodeCube(MakeCube(Size, SunSky));
+        ThreadPool Threads{ 3 };
+        const IrradianceSH A = ProjectCube(Serial, Cube, Size);
+        const IrradianceSH B = ProjectCube(Threads, Cube, Size);
+        Harness.Check(std::equal(std::begin(A.Coefficients), std::end(A.Coefficients), std::begin(B.Coefficients)), "bit identical on 0 and 3 pool threads");
+    });
+
+    return Harness.Finish();
+}
+
+void SphericalHarmonics::Benchmark(uint32_t Size, int Iterations)
+{
+    Iterations = Iterations > 0 ? Iterations : 1;
+    Size = Size > 0 ? Size : 1;
+
+    const std::vector<float> Cube = MakeCube(Size, SunSky);
+    const std::vector<uint16_t> Half = EncodeCube(Cube);
+    ThreadPool& Pool = ThreadPool::Get();
+
+    double FloatMs = 0.0;
+    double HalfMs = 0.0;
+    for (int i = 0; i < Iterations; ++i)
+    {
+        auto Start = std::chrono::high_resolution_clock::now();
+        ProjectCube(Pool, Cube, Size);
+        FloatMs += ElapsedMs(Start);
+
+        Start = std::chrono::high_resolution_clock::now();
+        ProjectCube(Pool, Half, Size);
+        HalfMs += ElapsedMs(Start);
+    }
+
+    const double Texels = 6.0 * Size * Size;
+    std::printf("SH irradiance benchmark: %u cube (%d iterations, %u pool threads plus the caller)\n", Size, Iterations, Pool.NumThreads());
+    std::printf("  Float input   : %9.3f ms, %8.1f Mtexel/s\n", FloatMs / Iterations, Texels / (FloatMs / Iterations) / 1000.0);
+    std::printf("  Float16 input : %9.3f ms, %8.1f Mtexel/s\n", HalfMs / Iterations, Texels / (HalfMs / Iterations) / 1000.0);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+
+#include "Camera.h"
+
+class ThreadPool;
+
+// L2 spherical harmonics irradiance, nine RGB coefficients in xyz. The clamped cosine convolution, the 1/PI of
+// the Lambertian BRDF and the basis constants are folded in, so evaluating it at a normal is a short polynomial,
+// see Evaluate and irradianceSH in shaders/hlsl/pbr.hlsl. The layout of ShadingCB::Irradiance.
+struct IrradianceSH
+{
+    // Basis order: 1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2.
+    Vec4 Coefficients[9] = {};
+
+    Vec3 Evaluate(const Vec3& N) const;
+};
+
+// Projects an environment cube onto the first nine SH basis functions on the CPU. Each texel is weighted by the
+// solid angle it covers, the direction math and accumulation run four texels at a time with SSE, and the faces
+// are projected in parallel on the thread pool and summed in face order, so the result does not depend on the
+// thread count. Use the unfiltered mip 0 of the environment, irradiance needs the radiance itself.
+class SphericalHarmonics
+{
+public:
+    // Faces: D3D cube face order +X, -X, +Y, -Y, +Z, -Z, Size x Size RGBA texels each, rows tightly packed.
+    static IrradianceSH ProjectIrradiance(ThreadPool& Pool, const float* const Faces[6], uint32_t Size);
+    // The same for float16 texels, e.g. a BakedTexture, a cache entry or a GPU readback.
+    static IrradianceSH ProjectIrradiance(ThreadPool& Pool, const uint16_t* const Faces[6], uint32_t Size);
+
+    // Checks the projection against a brute-force cosine integral over every texel for smooth and sharp
+    // environments, the white furnace, float16 input and identical output on any thread count. No GPU needed.
+    static bool SelfTest();
+
+    // Projects a procedural float16 environment with Size x Size faces and prints the texel rate.
+    static void Benchmark(uint32_t Size, int Iterations);
+};
@@ -4,31 +4,94 @@
 #include <stdexcept>
 #include <d3dx12/d3dx12.h>
 
+#include "StagingRing.h"
+#include "UploadBatch.h"
+
+namespace
+{
+    struct CopyableFootprints
+    {
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
+        std::vector<UINT> NumRows;
+        std::vector<UINT64> RowBytes;
+        UINT64 NumBytesTotal = 0;
+    };
+
+    CopyableFootprints GetFootprints(ID3D12Device* m_Device, const D3D12_RESOURCE_DESC& ResourceDesc, UINT FirstSubresource, UINT NumSubResources)
+    {
+        CopyableFootprints Footprints;
+        Footprints.Layouts.resize(NumSubResources);
+        Footprints.NumRows.resize(NumSubResources);
+        Footprints.RowBytes.resize(NumSubResources);
+        m_Device->GetCopyableFootprints(
+            &ResourceDesc,
+            FirstSubresource,
+            NumSubResources,
+            0,
+            Footprints.Layouts.data(),
+            Footprints.NumRows.data(),
+            Footprints.RowBytes.data(),
+            &Footprints.NumBytesTotal);
+        return Footprints;
+    }
+
+    // Memory is where offset 0 of the footprints lives, either a mapped staging buffer or a slice of the ring.
+    void CopySubresources(uint8_t* Memory, const D3D12_RESOURCE_DESC& ResourceDesc, const CopyableFootprints& Footprints, const D3D12_SUBRESOURCE_DATA* Data)
+    {
+        assert(ResourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE3D);
+
+        for (size_t subresource = 0; subresource < Footprints.Layouts.size(); ++subresource)
+        {
+            uint8_t* subresourceMemory = Memory + Footprints.Layouts[subresource].Offset;
+
+            //ԵĻһ
+            if (ResourceDesc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+            {
+                std::memcpy(subresourceMemory, Data->pData, Footprints.NumBytesTotal);
+            }
+            else
+            {
+                //TextureҪи
+                for (UINT row = 0; row < Footprints.NumRows[subresource]; ++row)
+                {
+                    const uint8_t* srcRowPtr = reinterpret_cast<const uint8_t*>(Data[subresource].pData) + row * Data[subresource].RowPitch;
+
+                    uint8_t* destRowPtr = subresourceMemory + row * Footprints.Layouts[subresource].Footprint.RowPitch;
+
+                    std::memcpy(destRowPtr, srcRowPtr, Footprints.RowBytes[subresource]);
+                }
+            }
+        }
+    }
+}
+
 StagingBuffer StagingBuffer::CreateStagingBuffer(Microsoft::WRL::ComPtr<ID3D12Device> m_Device, const Microsoft::WRL::ComPtr<ID3D12Resource>& Resource, UINT FirstSubresource, UINT NumSubResources, const D3D12_SUBRESOURCE_DATA* Data)
 {
-    StagingBuffer stagingBuffer;
-    stagingBuffer.FirstSubResource = FirstSubresource;
-    stagingBuffer.NumSubResource = NumSubResources;
-    stagingBuffer.Layouts.resize(NumSubResources);
+    return CreateStagingBuffer(m_Device, Resource->GetDesc(), FirstSubresource, NumSubResources, Data);
+}
 
-    const D3D12_RESOURCE_DESC ResourceDesc = Resource->GetDesc();
+StagingBuffer StagingBuffer::CreateStagingBuffer(UploadBatch& Batch, Microsoft::WRL::ComPtr<ID3D12Device> m_Device, const Microsoft::WRL::ComPtr<ID3D12Resource>& Resource, UINT FirstSubresource, UINT NumSubResources, const D3D12_SUBRESOURCE_DATA* Data)
+{
+    return CreateStagingBuffer(Batch, m_Device, Resource->GetDesc(), FirstSubresource, NumSubResources, Data);
+}
+
+StagingBuffer StagingBuffer::CreateStagingBuffer(UploadBatch& Batch, Microsoft::WRL::ComPtr<ID3D12Device> m_Device, const void* Data, UINT64 Size)
+{
+    const D3D12_SUBRESOURCE_DATA SubresourceData = { Data };
+    return CreateStagingBuffer(Batch, m_Device, CD3DX12_RESOURCE_DESC::Buffer(Size), 0, 1, &SubresourceData);
+}
 
-    UINT64 NumBytesTotal;
-    std::vector<UINT> numRows{ NumSubResources };
-    std::vector<UINT64> rowBytes{ NumSubResources };
-    m_Device->GetCopyableFootprints(
-        &ResourceDesc,
-        FirstSubresource,
-        NumSubResources,
-        0,
-        stagingBuffer.Layouts.data(),
-        numRows.data(),
-        rowBytes.data(),
-        &NumBytesTotal);
+StagingBuffer StagingBuffer::CreateStagingBuffer(Microsoft::WRL::ComPtr<ID3D12Device> m_Device, const D3D12_RESOURCE_DESC& ResourceDesc, UINT FirstSubresource, UINT NumSubResources, const D3D12_SUBRESOURCE_DATA* Data)
+{
+    const CopyableFootprints Footprints = GetFootprints(m_Device.Get(), ResourceDesc, FirstSubresource, NumSubResources);
 
+    StagingBuffer stagingBuffer;
+    stagingBuffer.FirstSubResource = FirstSubresource;
+    stagingBuffer.NumSubResource = NumSubResources;
+    stagingBuffer.Layouts = Footprints.Layouts;
 
     auto UploadType = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-    auto BufferDesc = CD3DX12_RESOURCE_DESC::Buffer(NumBytesTotal);
+    auto BufferDesc = CD3DX12_RESOURCE_DESC::Buffer(Footprints.NumBytesTotal);
     if (FAILED(m_Device->CreateCommittedResource(
         &UploadType,
         D3D12_HEAP_FLAG_NONE,
@@ -43,8 +106,6 @@ StagingBuffer StagingBuffer::CreateStagingBuffer(Microsoft::WRL::ComPtr<ID3D12De
 
     if (Data)
     {
-        assert(ResourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE3D);
-
         auto Range = CD3DX12_RANGE{ 0,0 };
         void* BufferMemory;
         if (FAILED(stagingBuffer.Buffer->Map(0, &Range, &BufferMemory)))
@@ -52,31 +113,46 @@ StagingBuffer StagingBuffer::CreateStagingBuffer(Microsoft::WRL::ComPtr<ID3D12De
             throw std::runtime_error("Failed to map GPU staging buffer to host address space");
         }
 
-        for (UINT subresource = 0; subresource < NumSubResources; ++subresource)
-        {
-            uint8_t* subresourceMemory = reinterpret_cast<uint8_t*>(BufferMemory) + stagingBuffer.Layouts[subresource].Offset;
+        CopySubresources(reinterpret_cast<uint8_t*>(BufferMemory), ResourceDesc, Footprints, Data);
 
-            //ԵĻһ
-            if (ResourceDesc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
-            {
-                std::memcpy(subresourceMemory, Data->pData, NumBytesTotal);
-            }
-            else
-            {
-                //TextureҪи
-                for (UINT row = 0; row < numRows[subresource]; ++row)
-                {
-                    const uint8_t* srcRowPtr = reinterpret_cast<const uint8_t*>(Data[subresource].pData) + row * Data[subresource].RowPitch;
+        stagingBuffer.Buffer->Unmap(0, nullptr);
+    }
+
+    return stagingBuffer;
+}
 
-                    uint8_t* destRowPtr = subresourceMemory + row * stagingBuffer.Layouts[subresource].Footprint.RowPitch;
+StagingBuffer StagingBuffer::CreateStagingBuffer(UploadBatch& Batch, Microsoft::WRL::ComPtr<ID3D12Device> m_Device, const D3D12_RESOURCE_DESC& ResourceDesc, UINT FirstSubresource, UINT NumSubResources, const D3D12_SUBRESOURCE_DATA* Data)
+{
+    StagingRing* Ring = Batch.GetStagingRing();
+    if (!Ring)
+    {
+        return CreateStagingBuffer(m_Device, ResourceDesc, FirstSubresource, NumSubResources, Data);
+    }
 
-                    std::memcpy(destRowPtr, srcRowPtr, rowBytes[subresource]);
-                }
-            }
-        }
+    const CopyableFootprints Footprints = GetFootprints(m_Device.Get(), ResourceDesc, FirstSubresource, NumSubResources);
 
-        stagingBuffer.Buffer->Unmap(0, nullptr);
+    // Placed texture footprints must start on a 512 byte boundary, buffer copies only want aligned memcpys.
+    const uint64_t Alignment = ResourceDesc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER ? 16 : D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT;
+    const StagingAllocation Allocation = Ring->Allocate(Batch, Footprints.NumBytesTotal, Alignment);
+    if (!Allocation.Buffer)
+    {
+        //Larger than the whole ring, give it a buffer of its own
+        return CreateStagingBuffer(m_Device, ResourceDesc, FirstSubresource, NumSubResources, Data);
     }
 
+    if (Data)
+    {
+        CopySubresources(Allocation.CpuAddress, ResourceDesc, Footprints, Data);
+    }
+
+    StagingBuffer stagingBuffer;
+    stagingBuffer.Buffer = Allocation.Buffer;
+    stagingBuffer.FirstSubResource = FirstSubresource;
+    stagingBuffer.NumSubResource = NumSubResources;
+    stagingBuffer.Layouts = Footprints.Layouts;
+    for (D3D12_PLACED_SUBRESOURCE_FOOTPRINT& Layout : stagingBuffer.Layouts)
+    {
+        Layout.Offset += Allocation.Offset;
+    }
     return stagingBuffer;
 }
@@ -6,10 +6,12 @@
 #include <vector>
 #include <wrl/client.h>
 
+class UploadBatch;
 
 class StagingBuffer
 {
 public:
+    //Either a buffer of its own or the shared staging ring, copies must go through the offsets in Layouts
     Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
 
     std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
@@ -25,6 +27,42 @@ public:
         UINT NumSubResources,
         const D3D12_SUBRESOURCE_DATA* Data
     );
+
+    //Sub-allocates from the batch's StagingRing when it has one, record the copy before creating the next staging buffer
+    static StagingBuffer CreateStagingBuffer(
+        UploadBatch& Batch,
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        const Microsoft::WRL::ComPtr<ID3D12Resource>& Resource,
+        UINT FirstSubresource,
+        UINT NumSubResources,
+        const D3D12_SUBRESOURCE_DATA* Data
+    );
+
+    //Size bytes for a range of a larger buffer, e.g. one mesh in a GeometryPool, copy from Layouts[0].Offset
+    static StagingBuffer CreateStagingBuffer(
+        UploadBatch& Batch,
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        const void* Data,
+        UINT64 Size
+    );
+
+private:
+    static StagingBuffer CreateStagingBuffer(
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        const D3D12_RESOURCE_DESC& ResourceDesc,
+        UINT FirstSubresource,
+        UINT NumSubResources,
+        const D3D12_SUBRESOURCE_DATA* Data
+    );
+
+    static StagingBuffer CreateStagingBuffer(
+        UploadBatch& Batch,
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        const D3D12_RESOURCE_DESC& ResourceDesc,
+        UINT FirstSubresource,
+        UINT NumSubResources,
+        const D3D12_SUBRESOURCE_DATA* Data
+    );
 };
 
 
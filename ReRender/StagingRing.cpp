@@ -0,0 +1,27 @@
+#include "StagingRing.h"
+
+#include "UploadBatch.h"
+
+StagingRing::StagingRing(Microsoft::WRL::ComPtr<ID3D12Device> m_Device, UINT Capacity)
+    :m_Buffer(UploadBuffer::CreateUploadBuffer(m_Device, Capacity))
+    ,m_Allocator(Capacity)
+{}
+
+void StagingRing::Attach(UploadBatch& Batch)
+{
+    m_Allocator.Attach(Batch);
+    Batch.SetStagingRing(this);
+}
+
+StagingAllocation StagingRing::Allocate(UploadBatch& Batch, uint64_t Size, uint64_t Alignment)
+{
+    StagingAllocation Allocation;
+    const uint64_t Offset = m_Allocator.AllocateBlocking(Batch, Size, Alignment);
+    if (Offset != RingAllocator::InvalidOffset)
+    {
+        Allocation.Buffer = m_Buffer.Buffer;
+        Allocation.Offset = Offset;
+        Allocation.CpuAddress = m_Buffer.CpuAddress + Offset;
+    }
+    return Allocation;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+#include <cstdint>
+
+#include "RingAllocator.h"
+#include "UploadBuffer.h"
+
+class UploadBatch;
+
+// A slice of the staging ring. Buffer is null if the request was larger than the ring.
+struct StagingAllocation
+{
+    Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+    uint64_t Offset = 0;
+    uint8_t* CpuAddress = nullptr;
+};
+
+// One persistently mapped upload buffer shared by every staging copy. Space is handed out by a RingAllocator
+// and comes back once the fence of the batch submission that read it has passed.
+class StagingRing
+{
+public:
+    StagingRing(Microsoft::WRL::ComPtr<ID3D12Device> m_Device, UINT Capacity);
+
+    // Routes Batch's staging copies through this ring. The ring has to outlive Batch.
+    void Attach(UploadBatch& Batch);
+
+    // Blocks while the ring is full. The copy reading the allocation must be recorded before the next
+    // Allocate call, which may submit Batch to make room.
+    StagingAllocation Allocate(UploadBatch& Batch, uint64_t Size, uint64_t Alignment);
+
+    void PrintStats(const char* Name) const { m_Allocator.PrintStats(Name); }
+
+private:
+    UploadBuffer m_Buffer;
+    RingAllocator m_Allocator;
+};
@@ -1,5 +1,6 @@
 #include "Texture.h"
 
+#include <cstring>
 #include <stdexcept>
 #include <d3dx12/d3dx12.h>
 
@@ -8,12 +9,16 @@
 #include <glm/include/glm/gtc/matrix_transform.hpp>
 #include <glm/include/glm/gtx/euler_angles.hpp>
 
+#include "D3D12PipelineLibrary.h"
+#include "DescriptorAllocator.h"
+#include "GpuHeapManager.h"
 #include "RootSignature.h"
 #include "Shader.h"
 #include "StagingBuffer.h"
+#include "UploadBatch.h"
 #include "Utils.h"
 
-Texture Texture::CreateTexture(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,DescriptorHeap& m_DescHeapCBV_SRV_UAV,UINT Width,UINT Height,UINT Depth,DXGI_FORMAT Format,UINT Levels,D3D12_RESOURCE_FLAGS Flags)
+Texture Texture::CreateTexture(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,DescriptorHeap& m_DescHeapCBV_SRV_UAV,UINT Width,UINT Height,UINT Depth,DXGI_FORMAT Format,UINT Levels,D3D12_RESOURCE_FLAGS Flags,GpuHeapManager* HeapManager)
 {
     assert(Depth == 1 || Depth == 6);
 
@@ -39,14 +44,13 @@ Texture Texture::CreateTexture(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,Des
         OptClear.DepthStencil.Depth = 1.0f;
         OptClear.DepthStencil.Stencil = 0;
 
-        auto DefaultType = CD3DX12_HEAP_PROPERTIES{ D3D12_HEAP_TYPE_DEFAULT };
-        if (FAILED(m_Device->CreateCommittedResource(
-            &DefaultType,
-            D3D12_HEAP_FLAG_NONE,
+        if (FAILED(GpuHeapManager::CreateResource(
+            HeapManager,
+            m_Device.Get(),
             &Desc,
             D3D12_RESOURCE_STATE_GENERIC_READ,
             &OptClear,
-            IID_PPV_ARGS(&texture.texture))))
+            texture.texture)))
         {
             throw std::runtime_error("Failed to create 2D texture");
         }
@@ -64,14 +68,13 @@ Texture Texture::CreateTexture(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,Des
         return texture;
     }
 
-    auto DefaultType = CD3DX12_HEAP_PROPERTIES{ D3D12_HEAP_TYPE_DEFAULT };
-    if (FAILED(m_Device->CreateCommittedResource(
-        &DefaultType,
-        D3D12_HEAP_FLAG_NONE,
+    if (FAILED(GpuHeapManager::CreateResource(
+        HeapManager,
+        m_Device.Get(),
         &Desc,
         D3D12_RESOURCE_STATE_COMMON,
         nullptr,
-        IID_PPV_ARGS(&texture.texture))))
+        texture.texture)))
     {
         throw std::runtime_error("Failed to create 2D texture");
     }
@@ -89,164 +92,188 @@ Texture Texture::CreateTexture(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,Des
 }
 
 Texture Texture::CreateTexture(
-    std::function<void()> CallBack,
+    UploadBatch& Batch,
     Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
-    MipMapGeneration& m_mipmapGeneration,
     DescriptorHeap& m_DescHeapCBV_SRV_UAV,
-    D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion,
-    const std::shared_ptr<class Image>& Image, DXGI_FORMAT Format,
-    UINT Levels)
+    const MipChain& Mips, DXGI_FORMAT Format,
+    GpuHeapManager* HeapManager)
 {
-    Texture texture = CreateTexture(m_Device, m_DescHeapCBV_SRV_UAV,Image->Width(), Image->Height(), 1, Format, Levels);
-    StagingBuffer TextureStagingBuffer;
+    std::vector<D3D12_SUBRESOURCE_DATA> Subresources(Mips.Levels());
+    for (int Mip = 0; Mip < Mips.Levels(); ++Mip)
     {
-        const D3D12_SUBRESOURCE_DATA Data{ Image->Pixels<void>(),Image->Pitch() };
-        TextureStagingBuffer = StagingBuffer::CreateStagingBuffer(m_Device,texture.texture, 0, 1, &Data);
+        const LONG_PTR RowPitch = LONG_PTR(Mips.RowPitch(Mip));
+        Subresources[Mip] = { Mips.Level(Mip), RowPitch, RowPitch * Mips.MipHeight(Mip) };
     }
+    return CreateTexture(Batch, m_Device, m_CommandList, m_DescHeapCBV_SRV_UAV, UINT(Mips.Width), UINT(Mips.Height), 1, Format, UINT(Mips.Levels()), Subresources.data(), HeapManager);
+}
 
-    {
-        const CD3DX12_TEXTURE_COPY_LOCATION DestCopyLocation{ texture.texture.Get(),0 };
-        const CD3DX12_TEXTURE_COPY_LOCATION SrcCopyLocation{ TextureStagingBuffer.Buffer.Get(),TextureStagingBuffer.Layouts[0] };
-
-        auto Common2Dest = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST, 0);
-
-        auto Dest2Common = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON, 0);
+Texture Texture::CreateTexture(
+    UploadBatch& Batch,
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
+    DescriptorHeap& m_DescHeapCBV_SRV_UAV,
+    UINT Width,
+    UINT Height,
+    UINT Depth,
+    DXGI_FORMAT Format,
+    UINT Levels,
+    const D3D12_SUBRESOURCE_DATA* Data,
+    GpuHeapManager* HeapManager)
+{
+    Texture texture = CreateTexture(m_Device, m_DescHeapCBV_SRV_UAV, Width, Height, Depth, Format, Levels, D3D12_RESOURCE_FLAG_NONE, HeapManager);
+    const UINT NumSubresources = texture.Levels * Depth;
+    StagingBuffer TextureStagingBuffer = StagingBuffer::CreateStagingBuffer(Batch, m_Device, texture.texture, 0, NumSubresources, Data);
 
-        m_CommandList->ResourceBarrier(1, &Common2Dest);
-        m_CommandList->CopyTextureRegion(&DestCopyLocation, 0, 0, 0, &SrcCopyLocation, nullptr);
-        m_CommandList->ResourceBarrier(1, &Dest2Common);
-    }
+    auto Common2Dest = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+    auto Dest2Common = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
 
-    if (texture.Levels > 1 && texture.Width == texture.Height && Utils::IsPowerOfTwo(texture.Width))
+    size_t StagedBytes = 0;
+    m_CommandList->ResourceBarrier(1, &Common2Dest);
+    for (UINT Subresource = 0; Subresource < NumSubresources; ++Subresource)
     {
-        GenerateMipmaps(CallBack,m_Device,m_CommandList, m_mipmapGeneration,m_DescHeapCBV_SRV_UAV,m_RootSignatureVersion,texture);
-    }
-    else {
-        // Only execute & wait if not generating mipmaps (so that we don't wait redundantly).
-        CallBack();
-        // ExecuteCommandList();
-        // WaitForGPU();
+        const CD3DX12_TEXTURE_COPY_LOCATION DestCopyLocation{ texture.texture.Get(), Subresource };
+        const CD3DX12_TEXTURE_COPY_LOCATION SrcCopyLocation{ TextureStagingBuffer.Buffer.Get(), TextureStagingBuffer.Layouts[Subresource] };
+        m_CommandList->CopyTextureRegion(&DestCopyLocation, 0, 0, 0, &SrcCopyLocation, nullptr);
+        StagedBytes += size_t(TextureStagingBuffer.Layouts[Subresource].Footprint.RowPitch) * TextureStagingBuffer.Layouts[Subresource].Footprint.Height;
     }
+    m_CommandList->ResourceBarrier(1, &Dest2Common);
 
+    Batch.Retain(std::move(TextureStagingBuffer), StagedBytes);
     return texture;
 }
 
-void Texture::GenerateMipmaps(std::function<void()> Callback, Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+TextureReadback Texture::RecordReadback(
+    Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
-    MipMapGeneration& m_mipmapGeneration,
-    DescriptorHeap& m_DescHeapCBV_SRV_UAV,
-    D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion,
     const Texture& texture)
 {
-    assert(texture.Width == texture.Height);
-    assert(Utils::IsPowerOfTwo(texture.Width));
+    const D3D12_RESOURCE_DESC Desc = texture.texture->GetDesc();
+    const UINT NumSubresources = UINT(Desc.MipLevels) * Desc.DepthOrArraySize;
+
+    TextureReadback Readback;
+    Readback.Layouts.resize(NumSubresources);
+    Readback.NumRows.resize(NumSubresources);
+    Readback.RowBytes.resize(NumSubresources);
+    UINT64 NumBytesTotal = 0;
+    m_Device->GetCopyableFootprints(&Desc, 0, NumSubresources, 0, Readback.Layouts.data(), Readback.NumRows.data(), Readback.RowBytes.data(), &NumBytesTotal);
 
-    if (!m_mipmapGeneration.RootSignature)
+    auto ReadbackType = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+    auto BufferDesc = CD3DX12_RESOURCE_DESC::Buffer(NumBytesTotal);
+    if (FAILED(m_Device->CreateCommittedResource(
+        &ReadbackType,
+        D3D12_HEAP_FLAG_NONE,
+        &BufferDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&Readback.Buffer)
+    )))
     {
-        const CD3DX12_DESCRIPTOR_RANGE1 descriptorRanges[] = {
-            {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE},
-            {D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE},
-        };
-        CD3DX12_ROOT_PARAMETER1 rootParameters[2];
-        rootParameters[0].InitAsDescriptorTable(1, &descriptorRanges[0]);
-        rootParameters[1].InitAsDescriptorTable(1, &descriptorRanges[1]);
-
-        CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-        rootSignatureDesc.Init_1_1(2, rootParameters);
-        m_mipmapGeneration.RootSignature = RootSignature::CreateRootSignature(m_Device, m_RootSignatureVersion,rootSignatureDesc);
+        throw std::runtime_error("Failed to create GPU readback buffer");
     }
 
-    ID3D12PipelineState* pipelineState = nullptr;
+    auto Common2Source = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    auto Source2Common = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON);
 
-    const D3D12_RESOURCE_DESC desc = texture.texture->GetDesc();
-    if (desc.DepthOrArraySize == 1 && desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) {
-        if (!m_mipmapGeneration.gammaTexturePipelineState)
-        {
-            Microsoft::WRL::ComPtr<ID3DBlob> computeShader = Shader::compileShader(
-                "shaders/hlsl/downsample.hlsl",
-                "downsample_gamma",
-                "cs_5_0");
-
-            D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
-            psoDesc.pRootSignature = m_mipmapGeneration.RootSignature.Get();
-            psoDesc.CS = CD3DX12_SHADER_BYTECODE(computeShader.Get());
-
-            if (FAILED(m_Device->CreateComputePipelineState(
-                &psoDesc,
-                IID_PPV_ARGS(&m_mipmapGeneration.gammaTexturePipelineState))))
-            {
-                throw std::runtime_error("Failed to create compute pipeline state (gamma correct downsample filter)");
-            }
-        }
-        pipelineState = m_mipmapGeneration.gammaTexturePipelineState.Get();
+    m_CommandList->ResourceBarrier(1, &Common2Source);
+    for (UINT Subresource = 0; Subresource < NumSubresources; ++Subresource)
+    {
+        const CD3DX12_TEXTURE_COPY_LOCATION DestCopyLocation{ Readback.Buffer.Get(), Readback.Layouts[Subresource] };
+        const CD3DX12_TEXTURE_COPY_LOCATION SrcCopyLocation{ texture.texture.Get(), Subresource };
+        m_CommandList->CopyTextureRegion(&DestCopyLocation, 0, 0, 0, &SrcCopyLocation, nullptr);
     }
-    else if (desc.DepthOrArraySize > 1 && desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+    m_CommandList->ResourceBarrier(1, &Source2Common);
+
+    return Readback;
+}
+
+void Texture::ReadSubresources(const TextureReadback& Readback, void* Destination)
+{
+    void* BufferMemory;
+    if (FAILED(Readback.Buffer->Map(0, nullptr, &BufferMemory)))
     {
-        if (!m_mipmapGeneration.ArrayTexturePipelineState)
-        {
-            Microsoft::WRL::ComPtr<ID3DBlob> computeShader = Shader::compileShader(
-                "shaders/hlsl/downsample_array.hlsl",
-                "downsample_linear",
-                "cs_5_0");
-            D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
-            psoDesc.pRootSignature = m_mipmapGeneration.RootSignature.Get();
-            psoDesc.CS = CD3DX12_SHADER_BYTECODE(computeShader.Get());
-            if (FAILED(m_Device->CreateComputePipelineState(
-                &psoDesc,
-                IID_PPV_ARGS(&m_mipmapGeneration.ArrayTexturePipelineState))))
-            {
-                throw std::runtime_error("Failed to create compute pipeline state (array downsample filter)");
-            }
-        }
-        pipelineState = m_mipmapGeneration.ArrayTexturePipelineState.Get();
+        throw std::runtime_error("Failed to map GPU readback buffer to host address space");
     }
-    else {
-        assert(desc.DepthOrArraySize == 1);
-        if (!m_mipmapGeneration.LinearTexturePipelineState)
+
+    uint8_t* Dest = static_cast<uint8_t*>(Destination);
+    for (size_t Subresource = 0; Subresource < Readback.Layouts.size(); ++Subresource)
+    {
+        const uint8_t* Source = static_cast<const uint8_t*>(BufferMemory) + Readback.Layouts[Subresource].Offset;
+        for (UINT Row = 0; Row < Readback.NumRows[Subresource]; ++Row)
         {
-            Microsoft::WRL::ComPtr<ID3DBlob> computeShader = Shader::compileShader(
-                "shaders/hlsl/downsample.hlsl",
-                "downsample_linear",
-                "cs_5_0");
-            D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
-            psoDesc.pRootSignature = m_mipmapGeneration.RootSignature.Get();
-            psoDesc.CS = CD3DX12_SHADER_BYTECODE(computeShader.Get());
-            if (FAILED(m_Device->CreateComputePipelineState(
-                &psoDesc,
-                IID_PPV_ARGS(&m_mipmapGeneration.LinearTexturePipelineState))))
-            {
-                throw std::runtime_error("Failed to create compute pipeline state (linear downsample filter)");
-            }
+            std::memcpy(Dest, Source + size_t(Row) * Readback.Layouts[Subresource].Footprint.RowPitch, Readback.RowBytes[Subresource]);
+            Dest += Readback.RowBytes[Subresource];
         }
-        pipelineState = m_mipmapGeneration.LinearTexturePipelineState.Get();
     }
 
-    DescriptorHeapMark mark(m_DescHeapCBV_SRV_UAV);
+    //Nothing was written
+    auto Range = CD3DX12_RANGE{ 0,0 };
+    Readback.Buffer->Unmap(0, &Range);
+}
 
-    Texture linearTexture = texture;
-    if (desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+void Texture::PrewarmMipmapPipelines(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+    MipMapGeneration& m_mipmapGeneration,
+    D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion)
+{
+    if (m_mipmapGeneration.RootSignature)
     {
-        pipelineState = m_mipmapGeneration.gammaTexturePipelineState.Get();
-        linearTexture = CreateTexture(
-            m_Device,
-            m_DescHeapCBV_SRV_UAV,
-            texture.Width,
-            texture.Height,
-            1,
-            DXGI_FORMAT_R8G8B8A8_UNORM,
-            texture.Levels);
-
-        auto Common2Dest = CD3DX12_RESOURCE_BARRIER::Transition(linearTexture.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
-        auto Dest2Common = CD3DX12_RESOURCE_BARRIER::Transition(linearTexture.texture.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
-
-        m_CommandList->ResourceBarrier(1, &Common2Dest);
-        m_CommandList->CopyResource(linearTexture.texture.Get(), texture.texture.Get());
-        m_CommandList->ResourceBarrier(1, &Dest2Common);
+        return;
     }
+    if (!m_mipmapGeneration.Pipelines)
+    {
+        throw std::logic_error("MipMapGeneration::Pipelines is not set");
+    }
+
+    const CD3DX12_DESCRIPTOR_RANGE1 descriptorRanges[] = {
+        {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE},
+        {D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE},
+    };
+    CD3DX12_ROOT_PARAMETER1 rootParameters[2];
+    rootParameters[0].InitAsDescriptorTable(1, &descriptorRanges[0]);
+    rootParameters[1].InitAsDescriptorTable(1, &descriptorRanges[1]);
+
+    CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
+    rootSignatureDesc.Init_1_1(2, rootParameters);
+    m_mipmapGeneration.RootSignature = RootSignature::CreateRootSignature(m_Device, m_RootSignatureVersion,rootSignatureDesc);
+
+    m_mipmapGeneration.ArrayTexturePipeline = m_mipmapGeneration.Pipelines->AddCompute(
+        "array downsample filter",
+        m_mipmapGeneration.RootSignature,
+        Shader::Request("shaders/hlsl/downsample_array.hlsl", "downsample_linear", "cs_5_0"));
+}
+
+void Texture::GenerateMipmaps(UploadBatch& Batch, Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
+    MipMapGeneration& m_mipmapGeneration,
+    D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion,
+    const Texture& texture)
+{
+    assert(texture.Width == texture.Height);
+    assert(Utils::IsPowerOfTwo(texture.Width));
+
+    PrewarmMipmapPipelines(m_Device, m_mipmapGeneration, m_RootSignatureVersion);
+
+    //downsample_array.hlsl filters linearly, which is right for the float environment maps this is left for
+    const D3D12_RESOURCE_DESC desc = texture.texture->GetDesc();
+    assert(desc.DepthOrArraySize > 1 && "2D textures get their mips on the CPU, see Image::GenerateMips");
+    assert(desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+    ID3D12PipelineState* pipelineState = m_mipmapGeneration.Pipelines->Get(m_mipmapGeneration.ArrayTexturePipeline);
+
+    //The dispatches read their descriptors when the batch executes, so each level's pair is retired, not freed,
+    //and comes back once that submission is done. Flushing brings back everything earlier textures retired
+    assert(m_mipmapGeneration.Descriptors && "MipMapGeneration::Descriptors is not set");
+    DescriptorAllocator& Descriptors = *m_mipmapGeneration.Descriptors;
+    const UINT NumDescriptorsNeeded = 2 * (texture.Levels - 1);
+    if (Descriptors.NumFree() < NumDescriptorsNeeded)
+    {
+        Batch.Flush();
+    }
+
+    //Only its Srv/Uav change, each level's views are written into this copy
+    Texture levelTexture = texture;
 
     ID3D12DescriptorHeap* descriptorHeaps[] = {
-        m_DescHeapCBV_SRV_UAV.Heap.Get()
+        Descriptors.Heap().Heap.Get()
     };
 
     m_CommandList->SetComputeRootSignature(m_mipmapGeneration.RootSignature.Get());
@@ -257,15 +284,17 @@ void Texture::GenerateMipmaps(std::function<void()> Callback, Microsoft::WRL::Co
     std::vector<CD3DX12_RESOURCE_BARRIER> postDispatchBarriers{ desc.DepthOrArraySize };
     for (UINT level = 1, levelWidth = texture.Width / 2, levelHeight = texture.Height / 2; level < texture.Levels; ++level, levelWidth /= 2, levelHeight /= 2)
     {
+        const DescriptorHandle SrvHandle = Descriptors.Allocate();
+        const DescriptorHandle UavHandle = Descriptors.Allocate();
         CreateTextureSRV(
             m_Device,
-            m_DescHeapCBV_SRV_UAV,
-            linearTexture,
-            desc.DepthOrArraySize > 1 ? D3D12_SRV_DIMENSION_TEXTURE2DARRAY : D3D12_SRV_DIMENSION_TEXTURE2D,
+            Descriptors[SrvHandle],
+            levelTexture,
+            D3D12_SRV_DIMENSION_TEXTURE2DARRAY,
             level - 1,
             1);
 
-        CreateTextureUAV(m_Device,m_DescHeapCBV_SRV_UAV,linearTexture, level);
+        CreateTextureUAV(m_Device, Descriptors[UavHandle], levelTexture, level);
 
         for (UINT arraySlice = 0; arraySlice < desc.DepthOrArraySize; ++arraySlice)
         {
@@ -276,35 +305,23 @@ void Texture::GenerateMipmaps(std::function<void()> Callback, Microsoft::WRL::Co
                 texture.Levels,
                 desc.DepthOrArraySize);
 
-            preDispatchBarriers[arraySlice] = CD3DX12_RESOURCE_BARRIER::Transition(linearTexture.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, subresourceIndex);
+            preDispatchBarriers[arraySlice] = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, subresourceIndex);
 
-            postDispatchBarriers[arraySlice] = CD3DX12_RESOURCE_BARRIER::Transition(linearTexture.texture.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, subresourceIndex);
+            postDispatchBarriers[arraySlice] = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, subresourceIndex);
         }
 
         m_CommandList->ResourceBarrier(desc.DepthOrArraySize, preDispatchBarriers.data());
-        m_CommandList->SetComputeRootDescriptorTable(0, linearTexture.Srv.GpuHandle);
-        m_CommandList->SetComputeRootDescriptorTable(1, linearTexture.Uav.GpuHandle);
+        m_CommandList->SetComputeRootDescriptorTable(0, levelTexture.Srv.GpuHandle);
+        m_CommandList->SetComputeRootDescriptorTable(1, levelTexture.Uav.GpuHandle);
         m_CommandList->Dispatch(glm::max(UINT(1), levelWidth / 8), glm::max(UINT(1), levelHeight / 8), desc.DepthOrArraySize);
         m_CommandList->ResourceBarrier(desc.DepthOrArraySize, postDispatchBarriers.data());
+
+        Descriptors.Retire(SrvHandle);
+        Descriptors.Retire(UavHandle);
     }
 
     auto Non2Common = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON);
-
-    auto Source2Dest = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-
-    auto Dest2Source = CD3DX12_RESOURCE_BARRIER::Transition(texture.texture.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
-
-
-    if (texture.texture == linearTexture.texture) {
-        m_CommandList->ResourceBarrier(1, &Non2Common);
-    }
-    else {
-        m_CommandList->ResourceBarrier(1, &Source2Dest);
-        m_CommandList->CopyResource(texture.texture.Get(), linearTexture.texture.Get());
-        m_CommandList->ResourceBarrier(1, &Dest2Source);
-    }
-    
-    Callback();
+    m_CommandList->ResourceBarrier(1, &Non2Common);
 }
 
 void Texture::CreateTextureSRV(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
@@ -314,12 +331,23 @@ void Texture::CreateTextureSRV(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
     UINT MostDetailedMip,
     UINT MipLevels,
     bool IsOnlyDepth)
+{
+    CreateTextureSRV(m_Device, m_DescHeapCBV_SRV_UAV.Alloc(), texture, Dimension, MostDetailedMip, MipLevels, IsOnlyDepth);
+}
+
+void Texture::CreateTextureSRV(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+    const Descriptor& Target,
+    Texture& texture,
+    D3D12_SRV_DIMENSION Dimension,
+    UINT MostDetailedMip,
+    UINT MipLevels,
+    bool IsOnlyDepth)
 {
     const D3D12_RESOURCE_DESC Desc = texture.texture->GetDesc();
     const UINT EffectiveMipLevels = (MipLevels > 0) ? MipLevels : (Desc.MipLevels - MostDetailedMip);
 
     assert(!(Desc.Flags & D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE));
-    texture.Srv = m_DescHeapCBV_SRV_UAV.Alloc();
+    texture.Srv = Target;
 
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
     srvDesc.Format = Desc.Format;
@@ -354,15 +382,36 @@ void Texture::CreateTextureSRV(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
     m_Device->CreateShaderResourceView(texture.texture.Get(), &srvDesc, texture.Srv.CpuHandle);
 }
 
+void Texture::CreateBindlessSRV(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+    DescriptorAllocator& Bindless,
+    Texture& texture,
+    D3D12_SRV_DIMENSION Dimension)
+{
+    //The SRV from CreateTexture stays where it is for the passes that still bind tables
+    assert(Bindless.Dimension() == Dimension && "The bindless range is bound with another dimension");
+    const Descriptor Srv = texture.Srv;
+    texture.Bindless = Bindless.Allocate();
+    CreateTextureSRV(m_Device, Bindless[texture.Bindless], texture, Dimension);
+    texture.Srv = Srv;
+}
+
 void Texture::CreateTextureUAV(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
     DescriptorHeap& m_DescHeapCBV_SRV_UAV,
     Texture& texture,
     UINT mipSlice)
+{
+    CreateTextureUAV(m_Device, m_DescHeapCBV_SRV_UAV.Alloc(), texture, mipSlice);
+}
+
+void Texture::CreateTextureUAV(Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+    const Descriptor& Target,
+    Texture& texture,
+    UINT mipSlice)
 {
     const D3D12_RESOURCE_DESC desc = texture.texture->GetDesc();
     assert(desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
-    texture.Uav = m_DescHeapCBV_SRV_UAV.Alloc();
+    texture.Uav = Target;
 
     D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
     uavDesc.Format = desc.Format;
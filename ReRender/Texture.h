@@ -4,26 +4,48 @@
 #include <dxgi1_4.h>
 #include <functional>
 #include <memory>
+#include <vector>
 #include <wrl/client.h>
 #include "Image.h"
 
 #include "Descriptor.h"
+#include "DescriptorIndexAllocator.h"
+#include "PipelineBuildQueue.h"
+
+class UploadBatch;
+class GpuHeapManager;
+class DescriptorAllocator;
+class D3D12PipelineLibrary;
 
 struct MipMapGeneration
 {
     Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature;
-    Microsoft::WRL::ComPtr<ID3D12PipelineState> LinearTexturePipelineState;
-    Microsoft::WRL::ComPtr<ID3D12PipelineState> gammaTexturePipelineState;
-    Microsoft::WRL::ComPtr<ID3D12PipelineState>ArrayTexturePipelineState;
+
+    //Queued on Pipelines by PrewarmMipmapPipelines, or by the first GenerateMipmaps if nobody prewarmed them
+    D3D12PipelineLibrary* Pipelines = nullptr;
+    PipelineHandle ArrayTexturePipeline = InvalidPipeline;
+
+    //Per-level SRV/UAVs come from here and are retired right after their dispatch, must be attached to the batch
+    DescriptorAllocator* Descriptors = nullptr;
 };
 
 
+//Every subresource of a texture in a readback buffer, see Texture::RecordReadback
+struct TextureReadback
+{
+    Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
+    std::vector<UINT> NumRows;
+    std::vector<UINT64> RowBytes;
+};
+
 class Texture
 {
 public:
     Microsoft::WRL::ComPtr<ID3D12Resource> texture;
     Descriptor Srv;
     Descriptor Uav;
+    DescriptorHandle Bindless; //Index into the bindless table, see CreateBindlessSRV
     UINT Width, Height;
     UINT Levels;
 
@@ -36,26 +58,59 @@ public:
         UINT Depth,
         DXGI_FORMAT Format,
         UINT Levels = 0,
-        D3D12_RESOURCE_FLAGS Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+        D3D12_RESOURCE_FLAGS Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+        GpuHeapManager* HeapManager = nullptr
     );
 
+    //Records the upload of every level of Mips into m_CommandList through one staging buffer, temporaries stay alive
+    //in Batch. Nothing is filtered here, the chain comes from Image::GenerateMips, e.g. in AssetLoader::RequestTexture
     static Texture CreateTexture(
-        std::function<void()>CallBack ,
+        UploadBatch& Batch,
         Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
         Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
-        MipMapGeneration& m_mipmapGeneration,
         DescriptorHeap& m_DescHeapCBV_SRV_UAV,
-        D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion,
-        const std::shared_ptr<class Image>& Image, DXGI_FORMAT Format,
-        UINT Levels = 0
+        const MipChain& Mips, DXGI_FORMAT Format,
+        GpuHeapManager* HeapManager = nullptr
     );
 
+    //Every subresource from Data in D3D12CalcSubresource order, Levels * Depth of them, through one staging buffer.
+    //Nothing gets generated, e.g. for IblBaker's output
+    static Texture CreateTexture(
+        UploadBatch& Batch,
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
+        DescriptorHeap& m_DescHeapCBV_SRV_UAV,
+        UINT Width,
+        UINT Height,
+        UINT Depth,
+        DXGI_FORMAT Format,
+        UINT Levels,
+        const D3D12_SUBRESOURCE_DATA* Data,
+        GpuHeapManager* HeapManager = nullptr
+    );
+
+    //Records a copy of every subresource into a new readback buffer, the texture has to be in COMMON.
+    //E.g. to keep compute results in IblCache, read them with ReadSubresources once the copies have executed
+    static TextureReadback RecordReadback(
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
+        const Texture& texture);
+
+    //Every subresource in D3D12CalcSubresource order with its rows tightly packed, like BakedTexture
+    static void ReadSubresources(const TextureReadback& Readback, void* Destination);
+
+    //Creates the root signature and queues the array downsample pipeline, it builds while other work goes on
+    static void PrewarmMipmapPipelines(
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        MipMapGeneration& m_mipmapGeneration,
+        D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion);
+
+    //Array and cube textures only, e.g. the environment map. 2D textures get their mips from Image::GenerateMips
     static void GenerateMipmaps(
-        std::function<void()> CallBack ,
+        UploadBatch& Batch,
         Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
         Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList,
         MipMapGeneration& m_mipmapGeneration,
-        DescriptorHeap& m_DescHeapCBV_SRV_UAV,
         D3D_ROOT_SIGNATURE_VERSION& m_RootSignatureVersion,
         const Texture& texture);
 
@@ -69,6 +124,25 @@ public:
         bool bIsOnlyDepth = false
     );
 
+    static void CreateTextureSRV(
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        const Descriptor& Target,
+        Texture& texture,
+        D3D12_SRV_DIMENSION Dimension,
+        UINT MostDetailedMip = 0,
+        UINT MipLevels = 0,
+        bool bIsOnlyDepth = false
+    );
+
+    //Every mip in a descriptor of Bindless, shaders find it at texture.Bindless.Index of the range for Dimension,
+    //which has to be Bindless's. Srv is left alone
+    static void CreateBindlessSRV(
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        DescriptorAllocator& Bindless,
+        Texture& texture,
+        D3D12_SRV_DIMENSION Dimension
+    );
+
     static void CreateTextureUAV(
         Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
         DescriptorHeap& m_DescHeapCBV_SRV_UAV,
@@ -76,5 +150,12 @@ public:
         UINT mipSlice
     );
 
+    static void CreateTextureUAV(
+        Microsoft::WRL::ComPtr<ID3D12Device> m_Device,
+        const Descriptor& Target,
+        Texture& texture,
+        UINT mipSlice
+    );
+
 };
 
@@ -0,0 +1,225 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include "PortableUtils.h"
+
+ThreadPool& ThreadPool::Get()
+{
+    static ThreadPool Pool{ std::max(1u, std::thread::hardware_concurrency()) - 1 };
+    return Pool;
+}
+
+ThreadPool::ThreadPool(unsigned int NumThreads)
+    :m_Stop(false)
+{
+    m_Workers.reserve(NumThreads);
+    for (unsigned int i = 0; i < NumThreads; ++i)
+    {
+        m_Workers.emplace_back([this]() { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Condition.notify_all();
+
+    for (std::thread& Worker : m_Workers)
+    {
+        Worker.join();
+    }
+}
+
+void ThreadPool::Enqueue(std::function<void()> Task)
+{
+    if (m_Workers.empty())
+    {
+        Task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Tasks.push_back(std::move(Task));
+    }
+    m_Condition.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> Task;
+        {
+            std::unique_lock<std::mutex> Lock(m_Mutex);
+            m_Condition.wait(Lock, [this]() { return m_Stop || !m_Tasks.empty(); });
+            if (m_Stop && m_Tasks.empty())
+            {
+                return;
+            }
+            Task = std::move(m_Tasks.front());
+            m_Tasks.pop_front();
+        }
+        Task();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t Begin, size_t End, size_t Grain, const std::function<void(size_t, size_t)>& Body)
+{
+    if (End <= Begin)
+    {
+        return;
+    }
+
+    Grain = std::max<size_t>(Grain, 1);
+    const size_t Count = End - Begin;
+    if (m_Workers.empty() || Count <= Grain)
+    {
+        Body(Begin, End);
+        return;
+    }
+
+    // A few chunks per thread so uneven chunks still balance out. Rounding the size up can need fewer chunks than
+    // that, e.g. 10 items in chunks of 2 are 5 and not 8, so the count follows from the size and no chunk starts past End.
+    const size_t MaxChunks = (m_Workers.size() + 1) * 4;
+    const size_t TargetChunks = std::min((Count + Grain - 1) / Grain, MaxChunks);
+    const size_t ChunkSize = (Count + TargetChunks - 1) / TargetChunks;
+    const size_t NumChunks = (Count + ChunkSize - 1) / ChunkSize;
+
+    // Shared with the helper tasks, which may still be queued after this call returns.
+    struct SharedState
+    {
+        std::atomic<size_t> NextChunk{ 0 };
+        std::atomic<size_t> FinishedChunks{ 0 };
+        std::mutex Mutex;
+        std::condition_variable Done;
+        std::exception_ptr Error;
+    };
+    auto State = std::make_shared<SharedState>();
+
+    auto RunChunks = [State, Begin, End, NumChunks, ChunkSize, &Body]()
+    {
+        for (size_t Chunk = State->NextChunk++; Chunk < NumChunks; Chunk = State->NextChunk++)
+        {
+            const size_t ChunkBegin = Begin + Chunk * ChunkSize;
+            const size_t ChunkEnd = std::min(End, ChunkBegin + ChunkSize);
+            try
+            {
+                Body(ChunkBegin, ChunkEnd);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> Lock(State->Mutex);
+                if (!State->Error)
+                {
+                    State->Error = std::current_exception();
+                }
+            }
+
+            if (++State->FinishedChunks == NumChunks)
+            {
+                std::lock_guard<std::mutex> Lock(State->Mutex);
+                State->Done.notify_all();
+            }
+        }
+    };
+
+    // Helpers only touch Body while they hold a chunk, and every chunk finishes before we return.
+    const size_t NumHelpers = std::min(m_Workers.size(), NumChunks - 1);
+    for (size_t i = 0; i < NumHelpers; ++i)
+    {
+        Enqueue(RunChunks);
+    }
+    RunChunks();
+
+    std::unique_lock<std::mutex> Lock(State->Mutex);
+    State->Done.wait(Lock, [&State, NumChunks]() { return State->FinishedChunks == NumChunks; });
+    if (State->Error)
+    {
+        std::rethrow_exception(State->Error);
+    }
+}
+
+bool ThreadPool::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Thread pool self test\n");
+
+    for (unsigned int NumThreads = 0; NumThreads <= 3; ++NumThreads)
+    {
+        const std::string Name = "ParallelFor, " + std::to_string(NumThreads) + " workers";
+        Harness.Run(Name.c_str(), [&]()
+        {
+            ThreadPool Pool{ NumThreads };
+            const size_t Begin = 5;
+            size_t BadChunks = 0;
+            size_t BadCoverage = 0;
+            for (size_t Count : { size_t(0), size_t(1), size_t(7), size_t(10), size_t(33), size_t(100), size_t(1000), size_t(4097) })
+            {
+                for (size_t Grain : { size_t(0), size_t(1), size_t(3), size_t(64), size_t(10000) })
+                {
+                    std::vector<std::atomic<int>> Hits(Count);
+                    std::atomic<size_t> Outside{ 0 };
+                    Pool.ParallelFor(Begin, Begin + Count, Grain, [&](size_t ChunkBegin, size_t ChunkEnd)
+                    {
+                        if (ChunkBegin < Begin || ChunkEnd > Begin + Count || ChunkBegin >= ChunkEnd)
+                        {
+                            ++Outside;
+                            return;
+                        }
+                        for (size_t i = ChunkBegin; i < ChunkEnd; ++i)
+                        {
+                            ++Hits[i - Begin];
+                        }
+                    });
+                    BadChunks += Outside.load();
+                    BadCoverage += size_t(std::count_if(Hits.begin(), Hits.end(), [](const std::atomic<int>& Hit) { return Hit.load() != 1; }));
+                }
+            }
+            Harness.Check(BadChunks == 0, "every chunk is non-empty and inside the range");
+            Harness.Check(BadCoverage == 0, "every index is covered exactly once");
+        });
+    }
+
+    Harness.Run("Exceptions and nesting", [&]()
+    {
+        ThreadPool Pool{ 2 };
+        bool bRethrown = false;
+        try
+        {
+            Pool.ParallelFor(0, 100, 1, [](size_t ChunkBegin, size_t ChunkEnd)
+            {
+                if (ChunkBegin <= 50 && 50 < ChunkEnd)
+                {
+                    throw std::runtime_error("chunk failed");
+                }
+            });
+        }
+        catch (const std::runtime_error&)
+        {
+            bRethrown = true;
+        }
+        Harness.Check(bRethrown, "a chunk's exception reaches the caller");
+
+        std::atomic<size_t> Sum{ 0 };
+        Pool.ParallelFor(0, 8, 1, [&](size_t OuterBegin, size_t OuterEnd)
+        {
+            for (size_t Outer = OuterBegin; Outer < OuterEnd; ++Outer)
+            {
+                Pool.ParallelFor(0, 100, 7, [&](size_t ChunkBegin, size_t ChunkEnd) { Sum += ChunkEnd - ChunkBegin; });
+            }
+        });
+        Harness.Check(Sum.load() == 800, "a ParallelFor inside a chunk completes and covers its range");
+    });
+
+    return Harness.Finish();
+}
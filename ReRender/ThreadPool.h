@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // Process-wide pool with one worker per hardware thread minus the caller.
+    static ThreadPool& Get();
+
+    explicit ThreadPool(unsigned int NumThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int NumThreads() const { return static_cast<unsigned int>(m_Workers.size()); }
+
+    template<typename Func>
+    auto Submit(Func&& Task) -> std::future<decltype(Task())>
+    {
+        using ResultType = decltype(Task());
+        auto Packaged = std::make_shared<std::packaged_task<ResultType()>>(std::forward<Func>(Task));
+        std::future<ResultType> Result = Packaged->get_future();
+        Enqueue([Packaged]() { (*Packaged)(); });
+        return Result;
+    }
+
+    // Splits [Begin, End) into chunks of at least Grain items and blocks until every chunk ran.
+    // The calling thread takes chunks as well, so this is safe to call from inside a pool task.
+    void ParallelFor(size_t Begin, size_t End, size_t Grain, const std::function<void(size_t ChunkBegin, size_t ChunkEnd)>& Body);
+
+    // Checks on pools of 0 to 3 workers that ParallelFor hands every index of the range to exactly one non-empty
+    // chunk for many counts and grains, rethrows a chunk's exception and can be nested. No GPU needed.
+    static bool SelfTest();
+
+private:
+    void Enqueue(std::function<void()> Task);
+    void WorkerLoop();
+
+    std::vector<std::thread> m_Workers;
+    std::deque<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_Stop;
+};
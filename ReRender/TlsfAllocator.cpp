@@ -0,0 +1,568 @@
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "PortableUtils.h"
+
+namespace
+{
+    // Index of the highest set bit, Value must not be 0.
+    uint32_t HighestBit(uint64_t Value)
+    {
+#if defined(_MSC_VER)
+        unsigned long Index;
+        _BitScanReverse64(&Index, Value);
+        return Index;
+#else
+        return 63 - __builtin_clzll(Value);
+#endif
+    }
+
+    // Index of the lowest set bit, Value must not be 0.
+    uint32_t LowestBit(uint64_t Value)
+    {
+#if defined(_MSC_VER)
+        unsigned long Index;
+        _BitScanForward64(&Index, Value);
+        return Index;
+#else
+        return __builtin_ctzll(Value);
+#endif
+    }
+
+    // Placed resources: 4 KB aligned small buffers, 64 KB aligned textures up to a 2K mip chain, 4 MB aligned MSAA targets.
+    uint64_t RandomResource(std::mt19937& Random, uint64_t& OutAlignment)
+    {
+        const uint64_t KB = 1024;
+        const uint64_t MB = 1024 * KB;
+        const uint32_t Kind = Random() % 16;
+        if (Kind < 6)
+        {
+            OutAlignment = 4 * KB;
+            return (1 + Random() % 16) * 4 * KB;
+        }
+        if (Kind < 15)
+        {
+            OutAlignment = 64 * KB;
+            const uint64_t Side = uint64_t(64) << (Random() % 6);
+            return AlignUp(Side * Side * 4 * 4 / 3, 64 * KB);
+        }
+        OutAlignment = 4 * MB;
+        return (1 + Random() % 4) * 4 * MB;
+    }
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t InCapacity)
+    :m_Capacity(InCapacity / Granularity * Granularity)
+    ,m_FreeBytes(m_Capacity)
+{
+    for (auto& Lists : m_FreeLists)
+    {
+        std::fill(std::begin(Lists), std::end(Lists), NoBlock);
+    }
+
+    // Block 0 always starts at offset 0, merges keep the lower block of a pair.
+    const uint32_t First = NewBlock();
+    m_Blocks[First].Size = m_Capacity;
+    if (m_Capacity > 0)
+    {
+        InsertFree(First);
+    }
+}
+
+void TlsfAllocator::Mapping(uint64_t Size, uint32_t& OutFirst, uint32_t& OutSecond)
+{
+    if (Size < (uint64_t(1) << FirstLevelShift))
+    {
+        // Small sizes get linear bins of (1 << FirstLevelShift) / SecondLevelCount bytes.
+        OutFirst = 0;
+        OutSecond = static_cast<uint32_t>(Size >> (FirstLevelShift - SecondLevelBits));
+        return;
+    }
+
+    const uint32_t Highest = HighestBit(Size);
+    OutFirst = Highest - FirstLevelShift + 1;
+    OutSecond = static_cast<uint32_t>(Size >> (Highest - SecondLevelBits)) - SecondLevelCount;
+}
+
+uint32_t TlsfAllocator::FindFreeBlock(uint64_t Size, uint64_t Alignment) const
+{
+    // Enough room for the worst case padding in front of the aligned offset, rounded up to the next bin
+    // boundary, so every block of the bin that is found fits without looking at it.
+    const uint64_t SearchSize = Size + Alignment - Granularity;
+    uint64_t Rounded = SearchSize;
+    if (Rounded >= (uint64_t(1) << FirstLevelShift))
+    {
+        Rounded += (uint64_t(1) << (HighestBit(Rounded) - SecondLevelBits)) - 1;
+    }
+
+    uint32_t First, Second;
+    Mapping(Rounded, First, Second);
+    const uint32_t FastBin = First * SecondLevelCount + Second;
+    if (SearchSize <= m_FreeBytes && First < FirstLevelCount)
+    {
+        uint32_t SecondMap = m_SecondLevelBitmap[First] & (~0u << Second);
+        if (SecondMap == 0)
+        {
+            const uint64_t FirstMap = First + 1 < 64 ? m_FirstLevelBitmap & (~uint64_t(0) << (First + 1)) : 0;
+            if (FirstMap != 0)
+            {
+                First = LowestBit(FirstMap);
+                SecondMap = m_SecondLevelBitmap[First];
+            }
+        }
+        if (SecondMap != 0)
+        {
+            return m_FreeLists[First][LowestBit(SecondMap)];
+        }
+    }
+
+    // The bins below that may still hold a block that fits with its actual padding, e.g. a heap sized for
+    // exactly one resource. Only reached when the fast path found nothing.
+    Mapping(Size, First, Second);
+    for (uint32_t Bin = First * SecondLevelCount + Second; Bin < FastBin && Bin < FirstLevelCount * SecondLevelCount; ++Bin)
+    {
+        for (uint32_t Index = m_FreeLists[Bin / SecondLevelCount][Bin % SecondLevelCount]; Index != NoBlock; Index = m_Blocks[Index].NextFree)
+        {
+            const Block& Candidate = m_Blocks[Index];
+            if (AlignUp(Candidate.Offset, Alignment) - Candidate.Offset + Size <= Candidate.Size)
+            {
+                return Index;
+            }
+        }
+    }
+    return NoBlock;
+}
+
+TlsfAllocation TlsfAllocator::Allocate(uint64_t Size, uint64_t Alignment)
+{
+    Size = AlignUp(std::max<uint64_t>(Size, 1), Granularity);
+    Alignment = std::max(Alignment, Granularity);
+
+    if (Size > m_FreeBytes)
+    {
+        return TlsfAllocation{};
+    }
+
+    uint32_t Index = FindFreeBlock(Size, Alignment);
+    if (Index == NoBlock)
+    {
+        return TlsfAllocation{};
+    }
+    RemoveFree(Index);
+
+    const uint64_t Padding = AlignUp(m_Blocks[Index].Offset, Alignment) - m_Blocks[Index].Offset;
+    if (Padding > 0)
+    {
+        Split(Index, Padding);
+        const uint32_t Aligned = m_Blocks[Index].NextPhysical;
+        InsertFree(Index);
+        Index = Aligned;
+    }
+    if (m_Blocks[Index].Size > Size)
+    {
+        Split(Index, Size);
+        InsertFree(m_Blocks[Index].NextPhysical);
+    }
+
+    Block& Allocated = m_Blocks[Index];
+    Allocated.bFree = false;
+    m_FreeBytes -= Allocated.Size;
+    ++m_NumAllocations;
+
+    TlsfAllocation Allocation;
+    Allocation.Offset = Allocated.Offset;
+    Allocation.Size = Allocated.Size;
+    Allocation.Block = Index;
+    return Allocation;
+}
+
+void TlsfAllocator::Free(const TlsfAllocation& Allocation)
+{
+    uint32_t Index = Allocation.Block;
+    assert(Index < m_Blocks.size() && m_Blocks[Index].bUsed && !m_Blocks[Index].bFree && "Freeing a block that is not allocated");
+
+    m_FreeBytes += m_Blocks[Index].Size;
+    --m_NumAllocations;
+
+    const uint32_t Prev = m_Blocks[Index].PrevPhysical;
+    if (Prev != NoBlock && m_Blocks[Prev].bFree)
+    {
+        RemoveFree(Prev);
+        Merge(Prev, Index);
+        Index = Prev;
+    }
+    const uint32_t Next = m_Blocks[Index].NextPhysical;
+    if (Next != NoBlock && m_Blocks[Next].bFree)
+    {
+        RemoveFree(Next);
+        Merge(Index, Next);
+    }
+    InsertFree(Index);
+}
+
+void TlsfAllocator::InsertFree(uint32_t Index)
+{
+    Block& Free = m_Blocks[Index];
+    uint32_t First, Second;
+    Mapping(Free.Size, First, Second);
+
+    Free.bFree = true;
+    Free.PrevFree = NoBlock;
+    Free.NextFree = m_FreeLists[First][Second];
+    if (Free.NextFree != NoBlock)
+    {
+        m_Blocks[Free.NextFree].PrevFree = Index;
+    }
+    m_FreeLists[First][Second] = Index;
+    m_FirstLevelBitmap |= uint64_t(1) << First;
+    m_SecondLevelBitmap[First] |= 1u << Second;
+    ++m_NumFreeBlocks;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t Index)
+{
+    Block& Free = m_Blocks[Index];
+    uint32_t First, Second;
+    Mapping(Free.Size, First, Second);
+
+    if (Free.PrevFree != NoBlock)
+    {
+        m_Blocks[Free.PrevFree].NextFree = Free.NextFree;
+    }
+    else
+    {
+        m_FreeLists[First][Second] = Free.NextFree;
+    }
+    if (Free.NextFree != NoBlock)
+    {
+        m_Blocks[Free.NextFree].PrevFree = Free.PrevFree;
+    }
+
+    if (m_FreeLists[First][Second] == NoBlock)
+    {
+        m_SecondLevelBitmap[First] &= ~(1u << Second);
+        if (m_SecondLevelBitmap[First] == 0)
+        {
+            m_FirstLevelBitmap &= ~(uint64_t(1) << First);
+        }
+    }
+
+    Free.bFree = false;
+    Free.PrevFree = NoBlock;
+    Free.NextFree = NoBlock;
+    --m_NumFreeBlocks;
+}
+
+uint32_t TlsfAllocator::NewBlock()
+{
+    uint32_t Index;
+    if (!m_UnusedBlocks.empty())
+    {
+        Index = m_UnusedBlocks.back();
+        m_UnusedBlocks.pop_back();
+        m_Blocks[Index] = Block{};
+    }
+    else
+    {
+        Index = static_cast<uint32_t>(m_Blocks.size());
+        m_Blocks.emplace_back();
+    }
+    m_Blocks[Index].bUsed = true;
+    return Index;
+}
+
+void TlsfAllocator::DeleteBlock(uint32_t Index)
+{
+    m_Blocks[Index].bUsed = false;
+    m_UnusedBlocks.push_back(Index);
+}
+
+void TlsfAllocator::Split(uint32_t Index, uint64_t Size)
+{
+    assert(Size < m_Blocks[Index].Size);
+
+    const uint32_t Rest = NewBlock();
+    Block& Front = m_Blocks[Index];
+    Block& Back = m_Blocks[Rest];
+    Back.Offset = Front.Offset + Size;
+    Back.Size = Front.Size - Size;
+    Back.PrevPhysical = Index;
+    Back.NextPhysical = Front.NextPhysical;
+    if (Back.NextPhysical != NoBlock)
+    {
+        m_Blocks[Back.NextPhysical].PrevPhysical = Rest;
+    }
+    Front.Size = Size;
+    Front.NextPhysical = Rest;
+}
+
+void TlsfAllocator::Merge(uint32_t Index, uint32_t Next)
+{
+    Block& Front = m_Blocks[Index];
+    const Block& Back = m_Blocks[Next];
+    assert(Front.NextPhysical == Next && Front.Offset + Front.Size == Back.Offset);
+
+    Front.Size += Back.Size;
+    Front.NextPhysical = Back.NextPhysical;
+    if (Front.NextPhysical != NoBlock)
+    {
+        m_Blocks[Front.NextPhysical].PrevPhysical = Index;
+    }
+    DeleteBlock(Next);
+}
+
+uint64_t TlsfAllocator::LargestFreeBlock() const
+{
+    if (m_FirstLevelBitmap == 0)
+    {
+        return 0;
+    }
+
+    // Blocks in the highest bin differ by less than one bin step, look at all of them.
+    const uint32_t First = HighestBit(m_FirstLevelBitmap);
+    const uint32_t Second = HighestBit(m_SecondLevelBitmap[First]);
+    uint64_t Largest = 0;
+    for (uint32_t Index = m_FreeLists[First][Second]; Index != NoBlock; Index = m_Blocks[Index].NextFree)
+    {
+        Largest = std::max(Largest, m_Blocks[Index].Size);
+    }
+    return Largest;
+}
+
+bool TlsfAllocator::Validate() const
+{
+    uint64_t Offset = 0;
+    uint64_t FreeBytes = 0;
+    size_t NumFree = 0;
+    size_t NumAllocated = 0;
+    uint32_t Prev = NoBlock;
+    for (uint32_t Index = 0; Index != NoBlock; Index = m_Blocks[Index].NextPhysical)
+    {
+        const Block& Current = m_Blocks[Index];
+        if (!Current.bUsed || Current.Offset != Offset || Current.PrevPhysical != Prev || Current.Size % Granularity != 0)
+        {
+            return false;
+        }
+        if (Current.bFree)
+        {
+            // Free neighbours must have been merged.
+            if (Prev != NoBlock && m_Blocks[Prev].bFree)
+            {
+                return false;
+            }
+
+            uint32_t First, Second;
+            Mapping(Current.Size, First, Second);
+            if (!(m_SecondLevelBitmap[First] & (1u << Second)))
+            {
+                return false;
+            }
+            uint32_t Listed = m_FreeLists[First][Second];
+            while (Listed != NoBlock && Listed != Index)
+            {
+                Listed = m_Blocks[Listed].NextFree;
+            }
+            if (Listed != Index)
+            {
+                return false;
+            }
+            FreeBytes += Current.Size;
+            ++NumFree;
+        }
+        else if (Current.Size > 0)
+        {
+            ++NumAllocated;
+        }
+        Offset += Current.Size;
+        Prev = Index;
+    }
+
+    return Offset == m_Capacity && FreeBytes == m_FreeBytes && NumFree == m_NumFreeBlocks && NumAllocated == m_NumAllocations;
+}
+
+bool TlsfAllocator::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("TLSF allocator self test\n");
+    const uint64_t KB = 1024;
+    const uint64_t MB = 1024 * KB;
+
+    Harness.Run("Alignment and coalescing", [&]()
+    {
+        TlsfAllocator Allocator{ MB };
+        const TlsfAllocation Small = Allocator.Allocate(1000);
+        const TlsfAllocation Middle = Allocator.Allocate(4 * KB);
+        const TlsfAllocation Aligned = Allocator.Allocate(256, 64 * KB);
+        Harness.Check(Small.Offset == 0 && Small.Size == 1024, "sizes are rounded up to the granularity");
+        Harness.Check(Middle.Offset == 1024 && Aligned.Offset == 64 * KB, "blocks follow each other, larger alignments skip ahead");
+        Harness.Check(Allocator.NumFreeBlocks() == 2 && Allocator.UsedBytes() == 5 * KB + 256, "the skipped gap stays free, not used");
+        Harness.Check(!Allocator.Allocate(2 * MB).IsValid(), "a request larger than the heap fails");
+
+        Allocator.Free(Middle);
+        Harness.Check(Allocator.NumFreeBlocks() == 2 && Allocator.LargestFreeBlock() == MB - 64 * KB - 256, "a freed block merges with the free block after it");
+        Allocator.Free(Small);
+        Harness.Check(Allocator.NumFreeBlocks() == 2 && Allocator.Validate(), "a freed block merges with the free block before it");
+        Allocator.Free(Aligned);
+        Harness.Check(Allocator.IsEmpty() && Allocator.NumFreeBlocks() == 1 && Allocator.LargestFreeBlock() == MB, "freeing everything leaves one block");
+
+        const TlsfAllocation Whole = Allocator.Allocate(MB);
+        Harness.Check(Whole.Offset == 0 && Allocator.FreeBytes() == 0 && !Allocator.Allocate(1).IsValid(), "the coalesced heap fits one allocation of its full size");
+        Allocator.Free(Whole);
+        Harness.Check(Allocator.Validate() && Allocator.NumFreeBlocks() == 1, "the heap is whole again");
+    });
+
+    // The benchmark's workload on a small heap, with every live range checked against the others.
+    Harness.Run("Random churn", [&]()
+    {
+        TlsfAllocator Allocator{ 64 * MB };
+        std::vector<TlsfAllocation> Live;
+        std::mt19937 Random{ 4321 };
+        size_t Misplaced = 0;
+        size_t Overlaps = 0;
+        size_t Failures = 0;
+        bool bValid = true;
+
+        for (int Step = 0; Step < 4000; ++Step)
+        {
+            if (!Live.empty() && Random() % 3 == 0)
+            {
+                const size_t Victim = Random() % Live.size();
+                Allocator.Free(Live[Victim]);
+                Live[Victim] = Live.back();
+                Live.pop_back();
+                continue;
+            }
+
+            uint64_t Alignment;
+            const uint64_t Size = RandomResource(Random, Alignment);
+            const TlsfAllocation Allocation = Allocator.Allocate(Size, Alignment);
+            if (!Allocation.IsValid())
+            {
+                ++Failures;
+                continue;
+            }
+            if (Allocation.Offset % Alignment != 0 || Allocation.Size < Size || Allocation.Offset + Allocation.Size > Allocator.Capacity())
+            {
+                ++Misplaced;
+            }
+            Live.push_back(Allocation);
+
+            if (Step % 100 == 99)
+            {
+                std::vector<TlsfAllocation> Sorted = Live;
+                std::sort(Sorted.begin(), Sorted.end(), [](const TlsfAllocation& A, const TlsfAllocation& B) { return A.Offset < B.Offset; });
+                for (size_t i = 1; i < Sorted.size(); ++i)
+                {
+                    Overlaps += Sorted[i - 1].Offset + Sorted[i - 1].Size > Sorted[i].Offset ? 1 : 0;
+                }
+                bValid = bValid && Allocator.Validate();
+            }
+        }
+
+        std::printf("    %zu live, %zu failed allocations, %zu free blocks\n", Live.size(), Failures, Allocator.NumFreeBlocks());
+        Harness.Check(Misplaced == 0, "allocations are aligned, large enough and inside the heap");
+        Harness.Check(Overlaps == 0, "live allocations never overlap");
+        Harness.Check(bValid, "the block chain and bins stay consistent");
+        Harness.Check(Failures > 0, "the run fills the heap");
+
+        for (const TlsfAllocation& Allocation : Live)
+        {
+            Allocator.Free(Allocation);
+        }
+        Harness.Check(Allocator.Validate() && Allocator.IsEmpty() && Allocator.FreeBytes() == Allocator.Capacity(), "freeing everything returns every byte");
+        Harness.Check(Allocator.NumFreeBlocks() == 1 && Allocator.LargestFreeBlock() == Allocator.Capacity(), "freeing everything coalesces into one block");
+    });
+
+    return Harness.Finish();
+}
+
+void TlsfAllocator::Benchmark(uint64_t Capacity, int Iterations)
+{
+    Iterations = Iterations > 0 ? Iterations : 1;
+    const uint64_t MB = 1024 * 1024;
+    Capacity = std::max(Capacity, 16 * MB);
+
+    size_t Allocations = 0;
+    size_t Failures = 0;
+    size_t Frees = 0;
+    double AllocateMs = 0.0;
+    double FreeMs = 0.0;
+    double Fragmentation = 0.0;
+    size_t FragmentationSamples = 0;
+    double UsedAtFirstFailure = 0.0;
+
+    std::mt19937 Random{ 4321 };
+    for (int Iteration = 0; Iteration < Iterations; ++Iteration)
+    {
+        TlsfAllocator Allocator{ Capacity };
+        std::vector<TlsfAllocation> Live;
+        bool bFailedOnce = false;
+
+        // Fill until the first failure, then churn: free a random resource, allocate a new one.
+        for (int Step = 0; Step < 20000; ++Step)
+        {
+            const bool bFree = !Live.empty() && (bFailedOnce ? Random() % 2 == 0 : Random() % 4 == 0);
+            if (bFree)
+            {
+                const size_t Victim = Random() % Live.size();
+                const auto Start = std::chrono::high_resolution_clock::now();
+                Allocator.Free(Live[Victim]);
+                FreeMs += ElapsedMs(Start);
+                ++Frees;
+                Live[Victim] = Live.back();
+                Live.pop_back();
+            }
+            else
+            {
+                uint64_t Alignment;
+                const uint64_t Size = RandomResource(Random, Alignment);
+                const auto Start = std::chrono::high_resolution_clock::now();
+                const TlsfAllocation Allocation = Allocator.Allocate(Size, Alignment);
+                AllocateMs += ElapsedMs(Start);
+                ++Allocations;
+
+                if (!Allocation.IsValid())
+                {
+                    ++Failures;
+                    if (!bFailedOnce)
+                    {
+                        bFailedOnce = true;
+                        UsedAtFirstFailure += double(Allocator.UsedBytes()) / Allocator.Capacity();
+                    }
+                    continue;
+                }
+                Live.push_back(Allocation);
+            }
+
+            if (Step % 1000 == 999 && Allocator.FreeBytes() > 0)
+            {
+                Fragmentation += 1.0 - double(Allocator.LargestFreeBlock()) / Allocator.FreeBytes();
+                ++FragmentationSamples;
+            }
+        }
+
+        for (const TlsfAllocation& Allocation : Live)
+        {
+            Allocator.Free(Allocation);
+        }
+        if (!bFailedOnce)
+        {
+            UsedAtFirstFailure += 1.0;
+        }
+    }
+
+    std::printf("TLSF benchmark: %.0f MB heap (%d iterations)\n", Capacity / double(MB), Iterations);
+    std::printf("  Allocate      : %zu calls, %.1f ns each, %zu failed\n", Allocations, AllocateMs * 1e6 / std::max<size_t>(Allocations, 1), Failures);
+    std::printf("  Free          : %.1f ns each\n", FreeMs * 1e6 / std::max<size_t>(Frees, 1));
+    std::printf("  First failure : at %.1f%% used\n", 100.0 * UsedAtFirstFailure / Iterations);
+    std::printf("  Fragmentation : %.1f%% (1 - largest free block / free bytes)\n", 100.0 * Fragmentation / std::max<size_t>(FragmentationSamples, 1));
+}
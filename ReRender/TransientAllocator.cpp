@@ -0,0 +1,219 @@
+#include "TransientAllocator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include "PortableUtils.h"
+
+TransientAllocator::TransientAllocator(uint64_t BytesPerFrame, uint32_t NumFrames)
+    :m_BytesPerFrame(AlignUp(BytesPerFrame, ConstantBufferAlignment))
+    ,m_Frames(NumFrames)
+{}
+
+void TransientAllocator::BeginFrame(uint32_t FrameIndex, uint64_t CompletedValue)
+{
+    if (m_Current != NoFrame)
+    {
+        throw std::runtime_error("TransientAllocator::BeginFrame called twice without EndFrame");
+    }
+    if (FrameIndex >= m_Frames.size())
+    {
+        throw std::out_of_range("Transient frame index out of range");
+    }
+    if (m_Frames[FrameIndex].FenceValue > CompletedValue)
+    {
+        throw std::runtime_error("Transient frame rewound while the GPU may still read it");
+    }
+
+    m_Current = FrameIndex;
+    m_Cursor = 0;
+}
+
+uint64_t TransientAllocator::Allocate(uint64_t Size, uint64_t Alignment)
+{
+    if (m_Current == NoFrame)
+    {
+        throw std::runtime_error("Transient allocation outside BeginFrame/EndFrame");
+    }
+
+    const uint64_t Offset = AlignUp(m_Cursor, Alignment);
+    if (Offset + Size > m_BytesPerFrame)
+    {
+        throw std::overflow_error("Out of transient constant buffer memory for this frame");
+    }
+
+    m_Cursor = Offset + Size;
+    ++m_Stats.Allocations;
+    return m_Current * m_BytesPerFrame + Offset;
+}
+
+void TransientAllocator::EndFrame(uint64_t FenceValue)
+{
+    if (m_Current == NoFrame)
+    {
+        throw std::runtime_error("TransientAllocator::EndFrame without BeginFrame");
+    }
+
+    m_Frames[m_Current].FenceValue = FenceValue;
+    m_Stats.PeakFrameBytes = std::max(m_Stats.PeakFrameBytes, m_Cursor);
+    ++m_Stats.Frames;
+    m_Current = NoFrame;
+}
+
+void TransientAllocator::PrintStats(const char* Name) const
+{
+    std::printf("Transient allocator: %s (%zu x %.2f KB)\n", Name, m_Frames.size(), m_BytesPerFrame / 1024.0);
+    std::printf("  Frames        : %zu, %.1f allocations per frame\n", m_Stats.Frames,
+        double(m_Stats.Allocations) / std::max<size_t>(m_Stats.Frames, 1));
+    std::printf("  Peak per frame: %.2f KB\n", m_Stats.PeakFrameBytes / 1024.0);
+}
+
+bool TransientAllocator::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Transient allocator self test\n");
+
+    const auto Throws = [](const std::function<void()>& Body)
+    {
+        try
+        {
+            Body();
+        }
+        catch (const std::exception&)
+        {
+            return true;
+        }
+        return false;
+    };
+
+    Harness.Run("Call order and overflow", [&]()
+    {
+        TransientAllocator Allocator{ 1000, 2 };
+        Harness.Check(Allocator.BytesPerFrame() == 1024 && Allocator.Capacity() == 2048, "slices are rounded up to the alignment");
+        Harness.Check(Throws([&]() { Allocator.Allocate(16); }), "Allocate outside a frame throws");
+        Harness.Check(Throws([&]() { Allocator.BeginFrame(2, 0); }), "an out of range frame index throws");
+
+        Allocator.BeginFrame(1, 0);
+        Harness.Check(Throws([&]() { Allocator.BeginFrame(0, 0); }), "BeginFrame twice throws");
+        Harness.Check(Allocator.Allocate(16) == 1024 && Allocator.Allocate(16) == 1024 + 256, "allocations are aligned inside the slice");
+        Harness.Check(Allocator.Allocate(8, 8) == 1024 + 272, "a smaller alignment packs tighter");
+        Harness.Check(Throws([&]() { Allocator.Allocate(1024); }), "an allocation past the end of the slice throws");
+        Allocator.EndFrame(5);
+        Harness.Check(Throws([&]() { Allocator.EndFrame(6); }), "EndFrame twice throws");
+        Harness.Check(Allocator.RetireFenceValue(1) == 5 && Allocator.Stats().PeakFrameBytes == 280, "EndFrame records the fence and the peak");
+    });
+
+    Harness.Run("Fenced reset", [&]()
+    {
+        TransientAllocator Allocator{ 256, 2 };
+        Allocator.BeginFrame(0, 0);
+        Allocator.Allocate(64);
+        Allocator.EndFrame(3);
+        Harness.Check(Throws([&]() { Allocator.BeginFrame(0, 2); }), "a slice is not rewound before its fence completes");
+        Allocator.BeginFrame(0, 3);
+        Harness.Check(Allocator.Allocate(64) == 0, "a rewound slice starts over at its beginning");
+        Allocator.EndFrame(4);
+    });
+
+    // The frame loop of the renderer, with a GPU that lags NumFrames frames behind so every BeginFrame has to
+    // wait. Each frame's constants are stamped with the frame number and must survive until its fence completes.
+    for (uint32_t NumFrames = 2; NumFrames <= 3; ++NumFrames)
+    {
+        const std::string Name = "Frame loop, " + std::to_string(NumFrames) + " frames in flight";
+        Harness.Run(Name.c_str(), [&]()
+        {
+            const int DrawsPerFrame = 64;
+            const uint64_t ConstantSize = 64;
+            TransientAllocator Allocator{ uint64_t(DrawsPerFrame) * ConstantBufferAlignment, NumFrames };
+            std::vector<uint8_t> Memory(Allocator.Capacity());
+            std::vector<std::vector<uint64_t>> FrameOffsets(NumFrames);
+            std::vector<uint8_t> FrameStamps(NumFrames);
+            uint64_t Signaled = 0;
+            size_t EarlyResets = 0;
+            size_t Misplaced = 0;
+            size_t Overwritten = 0;
+
+            for (int FrameNumber = 0; FrameNumber < 200; ++FrameNumber)
+            {
+                const uint32_t FrameIndex = FrameNumber % NumFrames;
+                const uint64_t Completed = Signaled > NumFrames ? Signaled - NumFrames : 0;
+
+                if (Allocator.RetireFenceValue(FrameIndex) > Completed && !Throws([&]() { Allocator.BeginFrame(FrameIndex, Completed); }))
+                {
+                    ++EarlyResets;
+                    Allocator.EndFrame(Signaled);
+                }
+                // Waiting for the fence, as the renderer does before rewinding a slice.
+                Allocator.BeginFrame(FrameIndex, std::max(Completed, Allocator.RetireFenceValue(FrameIndex)));
+
+                FrameOffsets[FrameIndex].clear();
+                FrameStamps[FrameIndex] = static_cast<uint8_t>(FrameNumber);
+                for (int Draw = 0; Draw < DrawsPerFrame; ++Draw)
+                {
+                    const uint64_t Offset = Allocator.Allocate(ConstantSize);
+                    if (Offset % ConstantBufferAlignment != 0 || Offset / Allocator.BytesPerFrame() != FrameIndex ||
+                        (Draw == 0 && Offset != FrameIndex * Allocator.BytesPerFrame()))
+                    {
+                        ++Misplaced;
+                    }
+                    std::memset(Memory.data() + Offset, FrameStamps[FrameIndex], ConstantSize);
+                    FrameOffsets[FrameIndex].push_back(Offset);
+                }
+
+                // Writing this frame must not have touched the frames the GPU is still reading.
+                for (uint32_t Other = 0; Other < NumFrames; ++Other)
+                {
+                    for (uint64_t Offset : Other != FrameIndex ? FrameOffsets[Other] : std::vector<uint64_t>{})
+                    {
+                        Overwritten += Memory[Offset] != FrameStamps[Other] ? 1 : 0;
+                    }
+                }
+
+                Allocator.EndFrame(++Signaled);
+            }
+
+            Harness.Check(EarlyResets == 0, "BeginFrame throws while the slice's fence has not completed");
+            Harness.Check(Misplaced == 0, "allocations are aligned and start at the frame's own slice");
+            Harness.Check(Overwritten == 0, "frames in flight are never overwritten");
+            Harness.Check(Allocator.Stats().Frames == 200 && Allocator.Stats().Allocations == 200 * DrawsPerFrame, "stats count every frame and allocation");
+        });
+    }
+
+    return Harness.Finish();
+}
+
+void TransientAllocator::Benchmark(int DrawsPerFrame, int Frames)
+{
+    DrawsPerFrame = std::max(DrawsPerFrame, 1);
+    Frames = std::max(Frames, 1);
+
+    // One transform per draw, the way per-draw root CBVs are filled.
+    const uint32_t NumFrames = 2;
+    double TotalMs = 0.0;
+    {
+        TransientAllocator Allocator{ uint64_t(DrawsPerFrame) * ConstantBufferAlignment, NumFrames };
+        std::vector<uint8_t> Memory(Allocator.Capacity());
+        const float Transform[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+        const auto Start = std::chrono::high_resolution_clock::now();
+        for (int FrameNumber = 0; FrameNumber < Frames; ++FrameNumber)
+        {
+            Allocator.BeginFrame(FrameNumber % NumFrames, FrameNumber);
+            for (int Draw = 0; Draw < DrawsPerFrame; ++Draw)
+            {
+                std::memcpy(Memory.data() + Allocator.Allocate(sizeof(Transform)), Transform, sizeof(Transform));
+            }
+            Allocator.EndFrame(FrameNumber + 1);
+        }
+        TotalMs = ElapsedMs(Start);
+    }
+
+    std::printf("Transient constants benchmark: %d draws per frame, %d frames\n", DrawsPerFrame, Frames);
+    std::printf("  Per frame     : %8.3f ms, %.1f ns per constant buffer\n",
+        TotalMs / Frames, TotalMs * 1e6 / (double(Frames) * DrawsPerFrame));
+}
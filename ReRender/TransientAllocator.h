@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct TransientAllocatorStats
+{
+    size_t Frames = 0;
+    size_t Allocations = 0;
+    uint64_t PeakFrameBytes = 0;
+};
+
+// Linear allocator for data that lives for one frame, e.g. constants written in Update and read by Render.
+// Every frame in flight owns its own slice of the backing memory, so the GPU can read frame N while the CPU
+// writes frame N+1. A slice is rewound in BeginFrame and only once the fence its last frame ended with has
+// completed. Only offsets are handed out, so the core runs without a device.
+class TransientAllocator
+{
+public:
+    // Placement alignment of a constant buffer, root CBV addresses must be multiples of it.
+    static constexpr uint64_t ConstantBufferAlignment = 256;
+
+    // BytesPerFrame is rounded up to ConstantBufferAlignment.
+    TransientAllocator(uint64_t BytesPerFrame, uint32_t NumFrames);
+
+    // Fence value the slice of FrameIndex was last ended with, wait for it before BeginFrame.
+    uint64_t RetireFenceValue(uint32_t FrameIndex) const { return m_Frames[FrameIndex].FenceValue; }
+
+    // Rewinds the slice of FrameIndex. Throws if CompletedValue shows the GPU may still read it.
+    void BeginFrame(uint32_t FrameIndex, uint64_t CompletedValue);
+
+    // Offset from the start of the backing memory. Throws std::overflow_error once the frame's slice is full.
+    uint64_t Allocate(uint64_t Size, uint64_t Alignment = ConstantBufferAlignment);
+
+    // The current frame's allocations stay untouched until FenceValue has completed.
+    void EndFrame(uint64_t FenceValue);
+
+    uint64_t BytesPerFrame() const { return m_BytesPerFrame; }
+    uint64_t Capacity() const { return m_BytesPerFrame * m_Frames.size(); }
+    uint64_t UsedBytes() const { return m_Cursor; }
+    const TransientAllocatorStats& Stats() const { return m_Stats; }
+
+    void PrintStats(const char* Name) const;
+
+    // Checks call order, overflow, and the fenced reset and aliasing rules in a frame loop against a GPU that
+    // lags behind. No GPU needed.
+    static bool SelfTest();
+
+    // Times DrawsPerFrame constant allocations per frame.
+    static void Benchmark(int DrawsPerFrame, int Frames);
+
+private:
+    struct Frame
+    {
+        uint64_t FenceValue = 0;
+    };
+
+    uint64_t m_BytesPerFrame;
+    std::vector<Frame> m_Frames;
+
+    static constexpr uint32_t NoFrame = ~uint32_t(0);
+    uint32_t m_Current = NoFrame;
+    uint64_t m_Cursor = 0;
+
+    TransientAllocatorStats m_Stats;
+};
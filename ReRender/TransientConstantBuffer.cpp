@@ -0,0 +1,34 @@
+#include "TransientConstantBuffer.h"
+
+TransientConstantBuffer::TransientConstantBuffer(Microsoft::WRL::ComPtr<ID3D12Device> m_Device, UINT BytesPerFrame, UINT NumFrames)
+    :m_Allocator(BytesPerFrame, NumFrames)
+{
+    m_Buffer = UploadBuffer::CreateUploadBuffer(m_Device, static_cast<UINT>(m_Allocator.Capacity()));
+}
+
+void TransientConstantBuffer::BeginFrame(UINT FrameIndex, ID3D12Fence* Fence, HANDLE FenceEvent)
+{
+    const UINT64 FenceValue = m_Allocator.RetireFenceValue(FrameIndex);
+    if (Fence->GetCompletedValue() < FenceValue)
+    {
+        Fence->SetEventOnCompletion(FenceValue, FenceEvent);
+        WaitForSingleObject(FenceEvent, INFINITE);
+    }
+    m_Allocator.BeginFrame(FrameIndex, Fence->GetCompletedValue());
+}
+
+UploadBufferRegion TransientConstantBuffer::Allocate(UINT Size)
+{
+    const uint64_t Offset = m_Allocator.Allocate(Size);
+
+    UploadBufferRegion Region;
+    Region.CpuAddress = m_Buffer.CpuAddress + Offset;
+    Region.GpuAddress = m_Buffer.GpuAddress + Offset;
+    Region.Size = Size;
+    return Region;
+}
+
+void TransientConstantBuffer::EndFrame(UINT64 FenceValue)
+{
+    m_Allocator.EndFrame(FenceValue);
+}
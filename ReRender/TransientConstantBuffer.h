@@ -0,0 +1,36 @@
+#pragma once
+#include <wrl/client.h>
+#include <d3d12.h>
+
+#include "TransientAllocator.h"
+#include "UploadBuffer.h"
+
+// Per frame constants without descriptors. Regions are 256 byte aligned, so their GpuAddress goes straight
+// into SetGraphicsRootConstantBufferView, and each frame's slice is rewound once its fence has completed.
+class TransientConstantBuffer
+{
+public:
+    TransientConstantBuffer(Microsoft::WRL::ComPtr<ID3D12Device> m_Device, UINT BytesPerFrame, UINT NumFrames);
+
+    // Waits for the fence the slice of FrameIndex was last ended with, then rewinds it.
+    void BeginFrame(UINT FrameIndex, ID3D12Fence* Fence, HANDLE FenceEvent);
+
+    // Valid until the fence passed to EndFrame completes.
+    UploadBufferRegion Allocate(UINT Size);
+
+    template<typename T>
+    T* Allocate(D3D12_GPU_VIRTUAL_ADDRESS& OutGpuAddress)
+    {
+        const UploadBufferRegion Region = Allocate(sizeof(T));
+        OutGpuAddress = Region.GpuAddress;
+        return reinterpret_cast<T*>(Region.CpuAddress);
+    }
+
+    void EndFrame(UINT64 FenceValue);
+
+    void PrintStats(const char* Name) const { m_Allocator.PrintStats(Name); }
+
+private:
+    UploadBuffer m_Buffer;
+    TransientAllocator m_Allocator;
+};
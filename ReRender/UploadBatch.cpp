@@ -0,0 +1,248 @@
+#include "UploadBatch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+#include "PortableUtils.h"
+
+namespace
+{
+    // Finishes submissions only when told to, or when waited on, like a GPU that is never faster than asked.
+    class ManualQueue : public UploadQueue
+    {
+    public:
+        uint64_t Submit() override { return ++m_Submitted; }
+
+        uint64_t CompletedValue() const override { return m_Completed; }
+
+        void Wait(uint64_t FenceValue) override
+        {
+            assert(FenceValue <= m_Submitted && "Waiting for a fence that was never signaled");
+            ++m_Waits;
+            m_Completed = std::max(m_Completed, FenceValue);
+        }
+
+        void Complete(uint64_t FenceValue) { m_Completed = std::max(m_Completed, std::min(FenceValue, m_Submitted)); }
+
+        uint64_t Submitted() const { return m_Submitted; }
+        size_t Waits() const { return m_Waits; }
+
+    private:
+        uint64_t m_Submitted = 0;
+        uint64_t m_Completed = 0;
+        size_t m_Waits = 0;
+    };
+}
+
+UploadBatch::UploadBatch(UploadQueue& InQueue)
+    :m_Queue(InQueue)
+{}
+
+UploadBatch::~UploadBatch()
+{
+    assert(m_Recording.Objects.empty() && "UploadBatch destroyed with unsubmitted uploads");
+    if (!m_InFlight.empty())
+    {
+        m_Queue.Wait(m_InFlight.back().FenceValue);
+    }
+}
+
+void UploadBatch::OnIdle(std::function<void()> Callback)
+{
+    m_IdleCallbacks.push_back(std::move(Callback));
+}
+
+void UploadBatch::OnSubmit(std::function<void(uint64_t)> Callback)
+{
+    m_SubmitCallbacks.push_back(std::move(Callback));
+}
+
+uint64_t UploadBatch::Submit()
+{
+    // Always submit, callers record dispatches and barriers that need no retained objects as well.
+    m_Recording.FenceValue = m_Queue.Submit();
+    const uint64_t FenceValue = m_Recording.FenceValue;
+    ++m_Stats.Submissions;
+    for (const std::function<void(uint64_t)>& Callback : m_SubmitCallbacks)
+    {
+        Callback(FenceValue);
+    }
+
+    m_InFlight.push_back(std::move(m_Recording));
+    m_Recording = Submission{};
+
+    size_t BytesInFlight = 0;
+    for (const Submission& InFlight : m_InFlight)
+    {
+        BytesInFlight += InFlight.Bytes;
+    }
+    m_Stats.PeakBytesInFlight = std::max(m_Stats.PeakBytesInFlight, BytesInFlight);
+
+    Retire();
+    return FenceValue;
+}
+
+void UploadBatch::Retire()
+{
+    // Fence values only grow, so finished submissions are always a prefix of m_InFlight.
+    const uint64_t Completed = m_Queue.CompletedValue();
+    const auto FirstPending = std::find_if(m_InFlight.begin(), m_InFlight.end(), [Completed](const Submission& InFlight)
+    {
+        return InFlight.FenceValue > Completed;
+    });
+    m_InFlight.erase(m_InFlight.begin(), FirstPending);
+
+    NotifyIfIdle();
+}
+
+void UploadBatch::Flush()
+{
+    const uint64_t FenceValue = Submit();
+    m_Queue.Wait(FenceValue);
+    Retire();
+}
+
+void UploadBatch::NotifyIfIdle()
+{
+    if (IsIdle())
+    {
+        for (const std::function<void()>& Callback : m_IdleCallbacks)
+        {
+            Callback();
+        }
+    }
+}
+
+void UploadBatch::PrintStats(const char* Name) const
+{
+    std::printf("Upload batch : %s\n", Name);
+    std::printf("  Submissions   : %zu\n", m_Stats.Submissions);
+    std::printf("  Retained      : %zu objects, %.2f MB staged\n", m_Stats.RetainedObjects, m_Stats.StagedBytes / (1024.0 * 1024.0));
+    std::printf("  Peak in flight: %.2f MB\n", m_Stats.PeakBytesInFlight / (1024.0 * 1024.0));
+}
+
+bool UploadBatch::SelfTest()
+{
+    TestHarness Harness;
+    //Retained copies share ownership of the token, so its use count tells whether the batch still holds it
+    using Token = std::shared_ptr<int>;
+    const auto IsHeld = [](const Token& Object) { return Object.use_count() > 1; };
+
+    std::printf("Upload batch self test\n");
+
+    Harness.Run("Retain until the fence passes", [&]()
+    {
+        ManualQueue Queue;
+        UploadBatch Batch(Queue);
+        const Token First = std::make_shared<int>(1);
+        const Token Second = std::make_shared<int>(2);
+        Batch.Retain(First, 100);
+        Harness.Check(IsHeld(First) && !Batch.IsIdle(), "a recorded object is held before any submission");
+        const uint64_t FirstFence = Batch.Submit();
+        Batch.Retain(Second, 50);
+        const uint64_t SecondFence = Batch.Submit();
+        Harness.Check(FirstFence == 1 && SecondFence == 2 && Batch.NumInFlight() == 2, "each submission takes the queue's next fence");
+        Harness.Check(IsHeld(First) && IsHeld(Second), "nothing is released while the queue has not finished");
+
+        Queue.Complete(FirstFence);
+        Harness.Check(IsHeld(First), "objects are only released by Retire or Submit, not by the queue");
+        Batch.Retire();
+        Harness.Check(!IsHeld(First) && IsHeld(Second) && Batch.NumInFlight() == 1, "Retire releases exactly the completed prefix");
+
+        Queue.Complete(SecondFence);
+        Batch.Retire();
+        Harness.Check(!IsHeld(Second) && Batch.IsIdle(), "the last completion leaves the batch idle");
+        Harness.Check(Batch.Stats().Submissions == 2 && Batch.Stats().RetainedObjects == 2 && Batch.Stats().StagedBytes == 150,
+            "stats count submissions, objects and staged bytes");
+        Harness.Check(Batch.Stats().PeakBytesInFlight == 150, "the peak covers both submissions in flight");
+    });
+
+    Harness.Run("Submit retires finished work", [&]()
+    {
+        ManualQueue Queue;
+        UploadBatch Batch(Queue);
+        const Token Object = std::make_shared<int>(0);
+        Batch.Retain(Object);
+        const uint64_t FenceValue = Batch.Submit();
+        Queue.Complete(FenceValue);
+        Batch.Submit();
+        Harness.Check(!IsHeld(Object) && Batch.NumInFlight() == 1, "the next submission drops the finished one");
+        Harness.Check(Queue.Waits() == 0, "Submit never waits");
+        Queue.Complete(Queue.Submitted());
+        Batch.Retire();
+    });
+
+    Harness.Run("Flush", [&]()
+    {
+        ManualQueue Queue;
+        UploadBatch Batch(Queue);
+        const Token Earlier = std::make_shared<int>(0);
+        const Token Later = std::make_shared<int>(1);
+        Batch.Retain(Earlier);
+        Batch.Submit();
+        Batch.Retain(Later);
+        Batch.Flush();
+        Harness.Check(Queue.Waits() == 1 && Queue.CompletedValue() == 2, "Flush waits once for its own submission");
+        Harness.Check(!IsHeld(Earlier) && !IsHeld(Later) && Batch.IsIdle(), "everything is released after Flush");
+        Batch.Flush();
+        Harness.Check(Batch.Stats().Submissions == 3, "an empty Flush still submits");
+    });
+
+    Harness.Run("OnSubmit", [&]()
+    {
+        ManualQueue Queue;
+        UploadBatch Batch(Queue);
+        std::vector<uint64_t> Seen;
+        bool bHeldDuringCallback = false;
+        const Token Object = std::make_shared<int>(0);
+        Batch.OnSubmit([&](uint64_t FenceValue)
+        {
+            Seen.push_back(FenceValue);
+            bHeldDuringCallback = IsHeld(Object);
+        });
+        Batch.Retain(Object);
+        Queue.Complete(Queue.Submitted());
+        Batch.Submit();
+        Batch.Flush();
+        Harness.Check(Seen == std::vector<uint64_t>{ 1, 2 }, "every submission reports its fence, Flush included");
+        Harness.Check(bHeldDuringCallback, "the callback runs before the submission is retired");
+    });
+
+    Harness.Run("OnIdle", [&]()
+    {
+        ManualQueue Queue;
+        UploadBatch Batch(Queue);
+        int IdleCalls = 0;
+        Batch.OnIdle([&IdleCalls]() { ++IdleCalls; });
+        Batch.Retain(std::make_shared<int>(0));
+        const uint64_t FenceValue = Batch.Submit();
+        Harness.Check(IdleCalls == 0, "not idle while a submission is in flight");
+        Batch.Retain(std::make_shared<int>(1));
+        Queue.Complete(FenceValue);
+        Batch.Retire();
+        Harness.Check(IdleCalls == 0, "not idle while something is recorded");
+        Batch.Submit();
+        Harness.Check(IdleCalls == 0, "not idle while the new submission is in flight");
+        Queue.Complete(Queue.Submitted());
+        Batch.Retire();
+        Harness.Check(IdleCalls == 1, "idle once everything finished");
+        Batch.Retire();
+        Harness.Check(IdleCalls == 2, "every Retire of an idle batch notifies again");
+    });
+
+    Harness.Run("Destructor waits", [&]()
+    {
+        ManualQueue Queue;
+        const Token Object = std::make_shared<int>(0);
+        {
+            UploadBatch Batch(Queue);
+            Batch.Retain(Object);
+            Batch.Submit();
+        }
+        Harness.Check(Queue.Waits() == 1 && Queue.CompletedValue() == 1, "the destructor waits for what is in flight");
+        Harness.Check(!IsHeld(Object), "and releases it");
+    });
+
+    return Harness.Finish();
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class StagingRing;
+
+// Where an UploadBatch sends its work. D3D12UploadQueue is the real one, anything that hands out
+// increasing fence values works, so the batching and lifetime rules do not depend on a device.
+class UploadQueue
+{
+public:
+    virtual ~UploadQueue() = default;
+
+    // Executes everything recorded since the last Submit, returns the fence value that marks its completion.
+    virtual uint64_t Submit() = 0;
+
+    virtual uint64_t CompletedValue() const = 0;
+
+    // Blocks until CompletedValue() >= FenceValue.
+    virtual void Wait(uint64_t FenceValue) = 0;
+};
+
+struct UploadBatchStats
+{
+    size_t Submissions = 0;
+    size_t RetainedObjects = 0;
+    size_t StagedBytes = 0;
+    size_t PeakBytesInFlight = 0;
+};
+
+// Collects uploads from many assets into one submission. Staging buffers and other temporaries are
+// handed to Retain and live until the fence of the submission that used them has passed.
+class UploadBatch
+{
+public:
+    explicit UploadBatch(UploadQueue& InQueue);
+
+    // Waits for everything already submitted. Work that was recorded but never submitted is a bug.
+    ~UploadBatch();
+
+    UploadBatch(const UploadBatch&) = delete;
+    UploadBatch& operator=(const UploadBatch&) = delete;
+
+    // Keeps Object alive until the GPU is done with the next submission. StagedBytes only feeds the stats.
+    template<typename T>
+    void Retain(T Object, size_t StagedBytes = 0)
+    {
+        m_Recording.Objects.push_back(std::make_shared<T>(std::move(Object)));
+        m_Recording.Bytes += StagedBytes;
+        m_Stats.RetainedObjects += 1;
+        m_Stats.StagedBytes += StagedBytes;
+    }
+
+    // Runs every time the batch has nothing recorded and nothing in flight, e.g. to rewind scratch descriptors.
+    void OnIdle(std::function<void()> Callback);
+
+    // Runs right after every submission with its fence value, e.g. to tag ring allocations made since the last one.
+    void OnSubmit(std::function<void(uint64_t)> Callback);
+
+    // Submits what was recorded so far without waiting for it, then releases anything already finished.
+    uint64_t Submit();
+
+    // Releases the retained objects of every submission the queue has finished.
+    void Retire();
+
+    // Submit and wait, afterwards every retained object is released.
+    void Flush();
+
+    bool IsIdle() const { return m_InFlight.empty() && m_Recording.Objects.empty(); }
+    size_t NumInFlight() const { return m_InFlight.size(); }
+    const UploadBatchStats& Stats() const { return m_Stats; }
+    UploadQueue& Queue() const { return m_Queue; }
+
+    // Staging memory is sub-allocated from this ring when set, see StagingRing::Attach.
+    void SetStagingRing(StagingRing* Ring) { m_StagingRing = Ring; }
+    StagingRing* GetStagingRing() const { return m_StagingRing; }
+
+    void PrintStats(const char* Name) const;
+
+    // Checks that retained objects live until the queue reports their fence, Flush, and when the idle and
+    // submit callbacks run, against a fake queue. No GPU needed.
+    static bool SelfTest();
+
+private:
+    struct Submission
+    {
+        uint64_t FenceValue = 0;
+        size_t Bytes = 0;
+        std::vector<std::shared_ptr<void>> Objects;
+    };
+
+    void NotifyIfIdle();
+
+    UploadQueue& m_Queue;
+    Submission m_Recording;
+    std::vector<Submission> m_InFlight;
+    std::vector<std::function<void()>> m_IdleCallbacks;
+    std::vector<std::function<void(uint64_t)>> m_SubmitCallbacks;
+    StagingRing* m_StagingRing = nullptr;
+    UploadBatchStats m_Stats;
+};
@@ -0,0 +1,317 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include <glm/include/glm/gtc/packing.hpp>
+
+#include "MeshOptimizer.h"
+#include "PortableUtils.h"
+
+namespace
+{
+    const float SnormMax = 32767.0f;
+    const float RadiansToDegrees = 57.2957795f;
+
+    float SignNotZero(float Value)
+    {
+        return Value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    int16_t PackSnorm(float Value)
+    {
+        return static_cast<int16_t>(std::lround(glm::clamp(Value, -1.0f, 1.0f) * SnormMax));
+    }
+
+    float UnpackSnorm(int16_t Value)
+    {
+        return std::max(Value / SnormMax, -1.0f);
+    }
+
+    float AngleDegrees(const Vec3& A, const Vec3& B)
+    {
+        const float LengthA = glm::length(A);
+        const float LengthB = glm::length(B);
+        if (LengthA == 0.0f || LengthB == 0.0f)
+        {
+            return 0.0f;
+        }
+        // atan2 of cross/dot stays accurate for the tiny angles we are measuring, acos does not.
+        return std::atan2(glm::length(glm::cross(A, B)), glm::dot(A, B)) * RadiansToDegrees;
+    }
+}
+
+Vec2 VertexPacking::OctEncode(const Vec3& Direction)
+{
+    const float L1 = std::abs(Direction.x) + std::abs(Direction.y) + std::abs(Direction.z);
+    if (L1 == 0.0f)
+    {
+        return Vec2{ 0.0f };
+    }
+
+    const Vec3 N = Direction / L1;
+    if (N.z >= 0.0f)
+    {
+        return Vec2{ N.x, N.y };
+    }
+    // Fold the lower hemisphere over the diagonals.
+    return Vec2{ (1.0f - std::abs(N.y)) * SignNotZero(N.x), (1.0f - std::abs(N.x)) * SignNotZero(N.y) };
+}
+
+Vec3 VertexPacking::OctDecode(const Vec2& Encoded)
+{
+    Vec3 N{ Encoded.x, Encoded.y, 1.0f - std::abs(Encoded.x) - std::abs(Encoded.y) };
+    if (N.z < 0.0f)
+    {
+        N.x = (1.0f - std::abs(Encoded.y)) * SignNotZero(Encoded.x);
+        N.y = (1.0f - std::abs(Encoded.x)) * SignNotZero(Encoded.y);
+    }
+    return glm::normalize(N);
+}
+
+PackedVertexData VertexPacking::Encode(const Mesh& mesh)
+{
+    PackedVertexData Result;
+    Result.PositionOffset = 0.5f * (mesh.BoundsMin() + mesh.BoundsMax());
+    Result.PositionScale = 0.5f * (mesh.BoundsMax() - mesh.BoundsMin());
+    Result.Vertices.resize(mesh.Vertices().size());
+
+    for (size_t i = 0; i < mesh.Vertices().size(); ++i)
+    {
+        const Vertex& Source = mesh.Vertices()[i];
+        PackedVertex& Packed = Result.Vertices[i];
+
+        for (int Axis = 0; Axis < 3; ++Axis)
+        {
+            const float Scale = Result.PositionScale[Axis];
+            Packed.Position[Axis] = PackSnorm(Scale > 0.0f ? (Source.Position[Axis] - Result.PositionOffset[Axis]) / Scale : 0.0f);
+        }
+
+        const float Handedness = glm::dot(glm::cross(Source.Normal, Source.Tangent), Source.BiTangent) < 0.0f ? -1.0f : 1.0f;
+        Packed.Position[3] = PackSnorm(Handedness);
+
+        const Vec2 Normal = OctEncode(Source.Normal);
+        const Vec2 Tangent = OctEncode(Source.Tangent);
+        Packed.Normal[0] = PackSnorm(Normal.x);
+        Packed.Normal[1] = PackSnorm(Normal.y);
+        Packed.Tangent[0] = PackSnorm(Tangent.x);
+        Packed.Tangent[1] = PackSnorm(Tangent.y);
+
+        Packed.Texcoord[0] = glm::packHalf1x16(Source.Texcoord.x);
+        Packed.Texcoord[1] = glm::packHalf1x16(Source.Texcoord.y);
+    }
+    return Result;
+}
+
+Vertex VertexPacking::Decode(const PackedVertex& Packed, const Vec3& PositionOffset, const Vec3& PositionScale)
+{
+    Vertex Result;
+    for (int Axis = 0; Axis < 3; ++Axis)
+    {
+        Result.Position[Axis] = PositionOffset[Axis] + UnpackSnorm(Packed.Position[Axis]) * PositionScale[Axis];
+    }
+
+    const float Handedness = Packed.Position[3] < 0 ? -1.0f : 1.0f;
+    Result.Normal = OctDecode(Vec2{ UnpackSnorm(Packed.Normal[0]), UnpackSnorm(Packed.Normal[1]) });
+    Result.Tangent = OctDecode(Vec2{ UnpackSnorm(Packed.Tangent[0]), UnpackSnorm(Packed.Tangent[1]) });
+    Result.BiTangent = glm::cross(Result.Normal, Result.Tangent) * Handedness;
+    Result.Texcoord = Vec2{ glm::unpackHalf1x16(Packed.Texcoord[0]), glm::unpackHalf1x16(Packed.Texcoord[1]) };
+    return Result;
+}
+
+PackingError VertexPacking::ErrorBounds(const Mesh& mesh)
+{
+    PackingError Bounds;
+
+    // Half a snorm16 step of the half extent on every axis, plus float rounding in the center, the encode
+    // divide and the dequantize multiply-add.
+    const Vec3 HalfExtent = 0.5f * (mesh.BoundsMax() - mesh.BoundsMin());
+    const Vec3 MaxAbs = glm::max(glm::abs(mesh.BoundsMin()), glm::abs(mesh.BoundsMax()));
+    Bounds.Position = 0.5f * glm::length(HalfExtent) / SnormMax + 4.0f * FLT_EPSILON * glm::length(MaxAbs);
+
+    // Each snorm16 component is off by at most half a step, so |dp| <= sqrt(2) * HalfStep.
+    // Unfolding to v = (x, y, 1 - |x| - |y|) gives |dv| <= sqrt(3) * |dp|, and normalizing divides by
+    // |v| >= 1 / sqrt(3), so the angle is bounded by sqrt(18) * HalfStep radians.
+    const float HalfStep = 0.5f / SnormMax;
+    Bounds.NormalDegrees = std::sqrt(18.0f) * HalfStep * RadiansToDegrees;
+    Bounds.TangentDegrees = Bounds.NormalDegrees;
+
+    // Half an ulp of the largest magnitude texcoord, float16 has 10 explicit mantissa bits.
+    float MaxTexcoord = 0.0f;
+    for (const Vertex& vertex : mesh.Vertices())
+    {
+        MaxTexcoord = std::max({ MaxTexcoord, std::abs(vertex.Texcoord.x), std::abs(vertex.Texcoord.y) });
+    }
+    const float MinNormal = std::ldexp(1.0f, -14);
+    Bounds.Texcoord = MaxTexcoord < MinNormal ? std::ldexp(1.0f, -25) : std::ldexp(1.0f, std::ilogb(MaxTexcoord) - 11);
+    return Bounds;
+}
+
+PackingError VertexPacking::MeasureError(const Mesh& mesh, const PackedVertexData& Packed)
+{
+    PackingError Error;
+    for (size_t i = 0; i < mesh.Vertices().size(); ++i)
+    {
+        const Vertex& Source = mesh.Vertices()[i];
+        const Vertex Decoded = Decode(Packed.Vertices[i], Packed.PositionOffset, Packed.PositionScale);
+
+        Error.Position = std::max(Error.Position, glm::length(Decoded.Position - Source.Position));
+        Error.NormalDegrees = std::max(Error.NormalDegrees, AngleDegrees(Decoded.Normal, Source.Normal));
+        Error.TangentDegrees = std::max(Error.TangentDegrees, AngleDegrees(Decoded.Tangent, Source.Tangent));
+        Error.Texcoord = std::max({ Error.Texcoord,
+            std::abs(Decoded.Texcoord.x - Source.Texcoord.x),
+            std::abs(Decoded.Texcoord.y - Source.Texcoord.y) });
+    }
+    return Error;
+}
+
+bool VertexPacking::CanUse16BitIndices(const Mesh& mesh)
+{
+    for (const SubMesh& subMesh : mesh.SubMeshes())
+    {
+        if (subMesh.NumVertices > 0xFFFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void VertexPacking::PrintBandwidthReport(const char* Name, const Mesh& mesh)
+{
+    const PackedVertexData Packed = Encode(mesh);
+    const PackingError Bounds = ErrorBounds(mesh);
+    const PackingError Measured = MeasureError(mesh, Packed);
+
+    const size_t NumVertices = mesh.Vertices().size();
+    const size_t NumIndices = mesh.Faces().size() * 3;
+    const size_t IndexSize = CanUse16BitIndices(mesh) ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    const size_t FullBytes = NumVertices * sizeof(Vertex) + NumIndices * sizeof(uint32_t);
+    const size_t PackedBytes = NumVertices * sizeof(PackedVertex) + NumIndices * IndexSize;
+
+    const MeshAnalysis FullFetch = MeshOptimizer::Analyze(mesh, sizeof(Vertex));
+    const MeshAnalysis PackedFetch = MeshOptimizer::Analyze(mesh, sizeof(PackedVertex));
+
+    const double MB = 1024.0 * 1024.0;
+    std::printf("Vertex bandwidth : %s (%zu vertices, %zu indices)\n", Name, NumVertices, NumIndices);
+    std::printf("  Layout        : %zu B/vertex, 4 B/index -> %zu B/vertex, %zu B/index\n", sizeof(Vertex), sizeof(PackedVertex), IndexSize);
+    std::printf("  Buffers       : %8.2f MB -> %8.2f MB (%.1f%%)\n", FullBytes / MB, PackedBytes / MB, 100.0 * PackedBytes / FullBytes);
+    std::printf("  Fetch / draw  : %8.2f MB -> %8.2f MB\n", (FullFetch.FetchedBytes + NumIndices * sizeof(uint32_t)) / MB, (PackedFetch.FetchedBytes + NumIndices * IndexSize) / MB);
+    std::printf("  Position err  : %g (bound %g)\n", Measured.Position, Bounds.Position);
+    std::printf("  Normal err    : %g deg (bound %g deg)\n", Measured.NormalDegrees, Bounds.NormalDegrees);
+    std::printf("  Tangent err   : %g deg (bound %g deg)\n", Measured.TangentDegrees, Bounds.TangentDegrees);
+    std::printf("  Texcoord err  : %g (bound %g)\n", Measured.Texcoord, Bounds.Texcoord);
+}
+
+bool VertexPacking::SelfTest()
+{
+    TestHarness Harness;
+    std::printf("Vertex packing self test\n");
+
+    // UV sphere away from the origin, every other column mirrored (negative handedness), texcoords tiled up to 4
+    const uint32_t Rings = 24;
+    const uint32_t Segments = 48;
+    const Vec3 Center{ 10.0f, -5.0f, 2.0f };
+    const float Radius = 3.0f;
+    std::vector<Vertex> Vertices;
+    std::vector<Face> Faces;
+    for (uint32_t i = 0; i <= Rings; ++i)
+    {
+        const float Phi = 3.14159265f * i / Rings;
+        for (uint32_t j = 0; j <= Segments; ++j)
+        {
+            const float Theta = 6.28318531f * j / Segments;
+            const Vec3 Normal{ std::sin(Phi) * std::cos(Theta), std::cos(Phi), std::sin(Phi) * std::sin(Theta) };
+            const Vec3 Tangent{ -std::sin(Theta), 0.0f, std::cos(Theta) };
+            const float Handedness = (j % 2) ? -1.0f : 1.0f;
+            Vertices.emplace_back(Center + Normal * Radius, Normal, Tangent, glm::cross(Normal, Tangent) * Handedness,
+                Vec2{ 4.0f * j / Segments, 2.0f * i / Rings });
+        }
+    }
+    for (uint32_t i = 0; i < Rings; ++i)
+    {
+        for (uint32_t j = 0; j < Segments; ++j)
+        {
+            const uint32_t A = i * (Segments + 1) + j;
+            const uint32_t B = A + Segments + 1;
+            Faces.push_back({ A, B, A + 1 });
+            Faces.push_back({ A + 1, B, B + 1 });
+        }
+    }
+    const SubMesh Sub{ 0, uint32_t(Vertices.size()), 0, uint32_t(Faces.size() * 3), 0, {}, {} };
+    const Mesh Sphere{ Vertices.data(), Vertices.size(), Faces.data(), Faces.size(), &Sub, 1 };
+    const PackedVertexData Packed = Encode(Sphere);
+    const PackingError Bounds = ErrorBounds(Sphere);
+
+    Harness.Run("Layout", [&]()
+    {
+        Harness.Check(sizeof(PackedVertex) == 20, "a packed vertex is 20 bytes");
+        Harness.Check(Packed.Vertices.size() == Sphere.Vertices().size(), "one packed vertex per vertex");
+        Harness.Check(Packed.PositionOffset == 0.5f * (Sphere.BoundsMin() + Sphere.BoundsMax()) &&
+            Packed.PositionScale == 0.5f * (Sphere.BoundsMax() - Sphere.BoundsMin()), "positions are quantized over the mesh AABB");
+    });
+
+    Harness.Run("Error within bounds", [&]()
+    {
+        const PackingError Measured = MeasureError(Sphere, Packed);
+        std::printf("    position %g <= %g, normal %g <= %g deg, tangent %g <= %g deg, texcoord %g <= %g\n",
+            Measured.Position, Bounds.Position, Measured.NormalDegrees, Bounds.NormalDegrees,
+            Measured.TangentDegrees, Bounds.TangentDegrees, Measured.Texcoord, Bounds.Texcoord);
+        Harness.Check(Measured.Position <= Bounds.Position, "position error within its bound");
+        Harness.Check(Measured.NormalDegrees <= Bounds.NormalDegrees, "normal error within its bound");
+        Harness.Check(Measured.TangentDegrees <= Bounds.TangentDegrees, "tangent error within its bound");
+        Harness.Check(Measured.Texcoord <= Bounds.Texcoord, "texcoord error within its bound");
+    });
+
+    Harness.Run("Handedness", [&]()
+    {
+        bool bBitMatches = true;
+        bool bBiTangentMatches = true;
+        for (size_t i = 0; i < Vertices.size(); ++i)
+        {
+            const Vertex& Source = Vertices[i];
+            const bool bNegative = glm::dot(glm::cross(Source.Normal, Source.Tangent), Source.BiTangent) < 0.0f;
+            bBitMatches &= Packed.Vertices[i].Position[3] == (bNegative ? -32767 : 32767);
+            const Vertex Decoded = Decode(Packed.Vertices[i], Packed.PositionOffset, Packed.PositionScale);
+            bBiTangentMatches &= glm::dot(Decoded.BiTangent, Source.BiTangent) > 0.99f;
+        }
+        Harness.Check(bBitMatches, "w holds the bitangent sign");
+        Harness.Check(bBiTangentMatches, "decoded bitangents point the same way as the source");
+    });
+
+    // Unquantized the mapping is exact up to float rounding, through snorm16 it stays within the angle bound.
+    // The axes and the fold diagonals of the lower hemisphere are the edge cases
+    Harness.Run("Octahedral round trip", [&]()
+    {
+        std::vector<Vec3> Directions = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+            { 1, 1, -1 }, { -1, 1, -1 }, { 1, -1, -1 }, { -1, -1, -1 }, { 1, 1, 1 }, { 1, 0, -1e-7f } };
+        std::mt19937 Random{ 5 };
+        std::normal_distribution<float> Gaussian;
+        for (int i = 0; i < 20000; ++i)
+        {
+            Directions.push_back(Vec3{ Gaussian(Random), Gaussian(Random), Gaussian(Random) });
+        }
+
+        float MaxExact = 0.0f;
+        float MaxQuantized = 0.0f;
+        bool bInSquare = true;
+        for (const Vec3& Direction : Directions)
+        {
+            const Vec2 Encoded = OctEncode(Direction);
+            bInSquare &= std::abs(Encoded.x) <= 1.0f && std::abs(Encoded.y) <= 1.0f;
+            MaxExact = std::max(MaxExact, AngleDegrees(OctDecode(Encoded), Direction));
+            const Vec2 Quantized{ UnpackSnorm(PackSnorm(Encoded.x)), UnpackSnorm(PackSnorm(Encoded.y)) };
+            MaxQuantized = std::max(MaxQuantized, AngleDegrees(OctDecode(Quantized), Direction));
+        }
+        std::printf("    %zu directions: exact %g deg, snorm16 %g deg\n", Directions.size(), MaxExact, MaxQuantized);
+        Harness.Check(bInSquare, "encoded directions stay inside the snorm range");
+        Harness.Check(MaxExact < 1e-3f, "the float round trip returns the direction");
+        Harness.Check(MaxQuantized <= Bounds.NormalDegrees, "the snorm16 round trip stays within the angle bound");
+    });
+
+    return Harness.Finish();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+
+// 20-byte alternative to the 56-byte Vertex, decoded in shaders/hlsl/packed_vertex.hlsli.
+// Position: R16G16B16A16_SNORM relative to the mesh AABB, w holds the bitangent sign (-1 or +1).
+// Normal, Tangent: octahedral R16G16_SNORM. BiTangent is rebuilt as cross(Normal, Tangent) * sign.
+// Texcoord: R16G16_FLOAT.
+struct PackedVertex
+{
+    int16_t Position[4];
+    int16_t Normal[2];
+    int16_t Tangent[2];
+    uint16_t Texcoord[2];
+};
+static_assert(sizeof(PackedVertex) == 20);
+
+// Position = PositionOffset + Snorm * PositionScale per axis, i.e. the AABB center and half extent.
+struct PackedVertexData
+{
+    std::vector<PackedVertex> Vertices;
+    Vec3 PositionOffset = Vec3{ 0.0f };
+    Vec3 PositionScale = Vec3{ 0.0f };
+};
+
+// Largest error over a mesh. Directions are in degrees, positions in object units.
+struct PackingError
+{
+    float Position = 0.0f;
+    float NormalDegrees = 0.0f;
+    float TangentDegrees = 0.0f;
+    float Texcoord = 0.0f;
+};
+
+class VertexPacking
+{
+public:
+    static PackedVertexData Encode(const Mesh& mesh);
+
+    // Reference decoder, matches the HLSL one.
+    static Vertex Decode(const PackedVertex& Packed, const Vec3& PositionOffset, const Vec3& PositionScale);
+
+    // Worst case the format allows for this mesh: half a quantization step per position axis,
+    // the octahedral snorm16 angle bound, and half a float16 ulp at the largest texcoord.
+    static PackingError ErrorBounds(const Mesh& mesh);
+
+    // Round-trips every vertex and measures the actual error.
+    static PackingError MeasureError(const Mesh& mesh, const PackedVertexData& Packed);
+
+    // Faces can use R16 indices when every submesh has fewer than 65536 vertices, indices are submesh-local.
+    static bool CanUse16BitIndices(const Mesh& mesh);
+
+    // Vertex/index buffer sizes and estimated fetch traffic for both layouts, plus the error bounds.
+    static void PrintBandwidthReport(const char* Name, const Mesh& mesh);
+
+    static Vec2 OctEncode(const Vec3& Direction);
+    static Vec3 OctDecode(const Vec2& Encoded);
+
+    // Encodes a procedural sphere with mixed handedness and tiled texcoords and checks the measured error
+    // against ErrorBounds, the octahedral round trip on both hemispheres and the layout size. No GPU needed.
+    static bool SelfTest();
+};
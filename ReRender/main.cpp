@@ -1,12 +1,38 @@
 #include<cstdio>
+#include <cstdlib>
 #include <string>
 #include <memory>
 #include <iostream>
+#include <stdexcept>
 #include <glfw/include/GLFW/glfw3.h>
 #include <glm/include/glm/gtc/matrix_transform.hpp>
 
 #include "Application.h"
-#include "D3D12Renderer.h"
+#include "DescriptorIndexAllocator.h"
+#include "FramePacer.h"
+#include "GeometryAllocator.h"
+#include "IblBaker.h"
+#include "IblCache.h"
+#include "Image.h"
+#include "ParallelPassRecorder.h"
+#include "PipelineBuildQueue.h"
+#include "RenderGraph.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshWelder.h"
+#include "Meshlet.h"
+#include "RingAllocator.h"
+#include "ShaderCache.h"
+#include "SphericalHarmonics.h"
+#include "SoftwareRasterizer.h"
+#include "SoftwareRenderer.h"
+#include "ThreadPool.h"
+#include "TlsfAllocator.h"
+#include "TransientAllocator.h"
+#include "UploadBatch.h"
+#include "VertexPacking.h"
 #include "Renderer.h"
 
 
@@ -14,9 +40,375 @@
 
 
 #define GLM_
-int main()
+int main(int argc, char** argv)
 {
-    Application app;
+    //ReRender.exe --bench-meshcache meshes/cerberus.fbx [iterations]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-meshcache")
+    {
+        MeshCache::Benchmark(argv[2], argc >= 4 ? std::atoi(argv[3]) : 10);
+        return 0;
+    }
+
+    //ReRender.exe --test-meshcache
+    //Checks the cache round trip and that mismatching keys, truncated files and corrupt headers or tables miss, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-meshcache")
+    {
+        return MeshCache::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-meshlets meshes/cerberus.fbx [iterations]
+    if (argc >= 3 && std::string(argv[1]) == "--bench-meshlets")
+    {
+        MeshletBuilder::Benchmark(argv[2], argc >= 4 ? std::atoi(argv[3]) : 10);
+        return 0;
+    }
+
+    //ReRender.exe --test-meshlets
+    //Checks meshlet limits, bounds, cones and determinism on procedural meshes and culls a strip against a fixed camera, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-meshlets")
+    {
+        return MeshletBuilder::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-threadpool
+    //Checks that ParallelFor covers every index exactly once for many ranges and grain sizes, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-threadpool")
+    {
+        return ThreadPool::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-upload
+    //Checks retirement on completed fences, Flush and the idle/submit callbacks of the upload batch against a fake queue, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-upload")
+    {
+        return UploadBatch::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-staging
+    //Checks that the staging ring never hands out live memory against a simulated lagging queue, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-staging")
+    {
+        return RingAllocator::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-staging [ring MB] [iterations]
+    //Measures the staging ring's allocation and copy throughput, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-staging")
+    {
+        const uint64_t RingMB = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 64;
+        RingAllocator::Benchmark(RingMB * 1024 * 1024, argc >= 4 ? std::atoi(argv[3]) : 10);
+        return 0;
+    }
+
+    //ReRender.exe --test-transient
+    //Checks the fenced reset and aliasing rules of the per-frame constant allocator, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-transient")
+    {
+        return TransientAllocator::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-transient [draws per frame] [frames]
+    //Times the per-frame constant allocator, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-transient")
+    {
+        TransientAllocator::Benchmark(argc >= 3 ? std::atoi(argv[2]) : 4096, argc >= 4 ? std::atoi(argv[3]) : 1000);
+        return 0;
+    }
+
+    //ReRender.exe --test-descriptors
+    //Checks generations, stale handles and fenced reuse of the descriptor free list, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-descriptors")
+    {
+        return DescriptorIndexAllocator::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-descriptors [threads] [calls per thread]
+    //Times the lock-free descriptor free list against a mutex, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-descriptors")
+    {
+        DescriptorIndexAllocator::Benchmark(argc >= 3 ? std::atoi(argv[2]) : 8, argc >= 4 ? std::atoi(argv[3]) : 200000);
+        return 0;
+    }
+
+    //ReRender.exe --test-passes
+    //Checks that passes recorded on worker threads are submitted in pass order with their draw arguments, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-passes")
+    {
+        return ParallelPassRecorder::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-passes [max threads] [passes] [draws per pass] [frames]
+    //Records synthetic passes on 1..max threads into a logging backend and prints the speedup, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-passes")
+    {
+        ParallelPassRecorder::Benchmark(argc >= 3 ? std::atoi(argv[2]) : 8, argc >= 4 ? std::atoi(argv[3]) : 6,
+            argc >= 5 ? std::atoi(argv[4]) : 500, argc >= 6 ? std::atoi(argv[5]) : 200);
+        return 0;
+    }
+
+    //ReRender.exe --test-rendergraph
+    //Checks culling, barrier placement and transient aliasing of the frame graph compiler and prints its memory report, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-rendergraph")
+    {
+        return RenderGraph::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-pacing
+    //Checks that the frame pacer never hands out a slot the simulated GPU still reads, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-pacing")
+    {
+        return FramePacer::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-pacing [frames]
+    //Runs the frame pacer with 1..4 frames in flight against a simulated GPU and prints throughput against latency, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-pacing")
+    {
+        FramePacer::Benchmark(argc >= 3 ? std::atoi(argv[2]) : 1000);
+        return 0;
+    }
+
+    //ReRender.exe --test-shadercache
+    //Checks hits, include/define/compiler invalidation and corrupted entries of the shader bytecode cache against a fake compiler, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-shadercache")
+    {
+        return ShaderCache::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-pipelines
+    //Checks exactly-once and inline pipeline builds, error propagation and teardown, then times serial vs pooled builds, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-pipelines")
+    {
+        return PipelineBuildQueue::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-raster
+    //Checks the software rasterizer's coverage, fill rule, clipping and depth against a scalar reference and times it, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-raster")
+    {
+        return SoftwareRasterizer::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-ibl
+    //Checks the CPU IBL baker's cube conversion, prefiltering, irradiance SH and BRDF LUT against scalar transcriptions of the shaders, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-ibl")
+    {
+        return IblBaker::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-ibl [environment.hdr] [cube size] [iterations]
+    //Bakes the environment, or a procedural sky when none is given, on the thread pool and prints the rate of every stage, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-ibl")
+    {
+        try
+        {
+            IblBaker::Benchmark(argc >= 3 ? argv[2] : "", argc >= 4 ? uint32_t(std::atoi(argv[3])) : 1024, argc >= 5 ? std::atoi(argv[4]) : 1);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    //ReRender.exe --test-iblcache
+    //Round trips a small bake through the IBL cache and checks that changed keys, versions and broken entries miss, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-iblcache")
+    {
+        return IblCache::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-iblcache environment.hdr [cube size] [iterations]
+    //Times a CPU bake of the environment against hashing it and reading the cached maps, no GPU needed
+    if (argc >= 3 && std::string(argv[1]) == "--bench-iblcache")
+    {
+        try
+        {
+            IblCache::Benchmark(argv[2], argc >= 4 ? uint32_t(std::atoi(argv[3])) : 1024, argc >= 5 ? std::atoi(argv[4]) : 10);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    //ReRender.exe --test-sh
+    //Checks the SH irradiance projection against a brute-force cosine integral over every texel, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-sh")
+    {
+        return SphericalHarmonics::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-sh [cube size] [iterations]
+    //Projects a procedural float16 cube onto SH9 on the thread pool and prints the texel rate, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-sh")
+    {
+        SphericalHarmonics::Benchmark(argc >= 3 ? uint32_t(std::atoi(argv[2])) : 1024, argc >= 4 ? std::atoi(argv[3]) : 10);
+        return 0;
+    }
+
+    //ReRender.exe --test-mips
+    //Checks the CPU mip generator's level sizes, box and Kaiser weights, sRGB rounding and channel counts, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-mips")
+    {
+        return Image::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-mips [width] [height] [iterations]
+    //Generates the mip chain of a procedural RGBA8 image with both filters, linear and sRGB, on the thread pool, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-mips")
+    {
+        Image::Benchmark(argc >= 3 ? std::atoi(argv[2]) : 2048, argc >= 4 ? std::atoi(argv[3]) : 2048, argc >= 5 ? std::atoi(argv[4]) : 10);
+        return 0;
+    }
+
+    //ReRender.exe --compare-images expected.ppm actual.ppm [max RMS error]
+    //Golden image check of two --software captures, fails when the RMS error in 8 bit steps is above the tolerance (default 0.5)
+    if (argc >= 4 && std::string(argv[1]) == "--compare-images")
+    {
+        try
+        {
+            return SoftwareRenderer::CompareImages(argv[2], argv[3], argc >= 5 ? std::atof(argv[4]) : 0.5) ? 0 : 1;
+        }
+        catch (std::runtime_error e)
+        {
+            std::cout << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    //ReRender.exe --test-geometry
+    //Checks that GeometryPool compaction keeps the data of moved meshes and never overlaps live ranges, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-geometry")
+    {
+        return GeometryAllocator::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-geometry [elements] [frames]
+    //Mesh load/unload churn through the GeometryPool allocator with and without compaction, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-geometry")
+    {
+        GeometryAllocator::Benchmark(uint64_t(argc >= 3 ? std::atoll(argv[2]) : 1 << 20), argc >= 4 ? std::atoi(argv[3]) : 3000);
+        return 0;
+    }
+
+    //ReRender.exe --test-tlsf
+    //Checks alignment, overlap and coalescing of the TLSF core of GpuHeapManager, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-tlsf")
+    {
+        return TlsfAllocator::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --bench-tlsf [heap MB] [iterations]
+    //Random texture/render target churn through the TLSF core of GpuHeapManager, 20000 calls on a fresh heap per iteration, prints time per call and fragmentation, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--bench-tlsf")
+    {
+        TlsfAllocator::Benchmark(uint64_t(argc >= 3 ? std::atoi(argv[2]) : 256) * 1024 * 1024, argc >= 4 ? std::atoi(argv[3]) : 10);
+        return 0;
+    }
+
+    //ReRender.exe --test-weld
+    //Checks the vertex welder against a brute force reference on 1 and 4 threads, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-weld")
+    {
+        return MeshWelder::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-packing
+    //Checks the packed vertex encoder against its error bounds, the octahedral round trip and the handedness bit, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-packing")
+    {
+        return VertexPacking::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-simplify
+    //Checks LOD triangle counts, ranges, errors and locked seams on a procedural grid and the distance based selection, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-simplify")
+    {
+        return MeshSimplifier::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --test-optimizer
+    //Checks that the vertex cache, overdraw and vertex fetch passes only reorder faces and vertices and lower ACMR, no GPU needed
+    if (argc >= 2 && std::string(argv[1]) == "--test-optimizer")
+    {
+        return MeshOptimizer::SelfTest() ? 0 : 1;
+    }
+
+    //ReRender.exe --analyze-mesh meshes/cerberus.fbx
+    //Imports without the cache and prints the weld, ACMR/ATVR/overfetch and packed vertex bandwidth numbers, no GPU needed
+    if (argc >= 3 && std::string(argv[1]) == "--analyze-mesh")
+    {
+        try
+        {
+            std::shared_ptr<Mesh> mesh = Mesh::FromFile(argv[2], false);
+            VertexPacking::PrintBandwidthReport(argv[2], *mesh);
+        }
+        catch (std::runtime_error e)
+        {
+            std::cout << e.what();
+            return 1;
+        }
+        return 0;
+    }
+
+    //ReRender.exe [--frames-in-flight N] [--frames N] [--cpu-ibl] [--packed-vertices] [--null | --software [--capture frame.ppm]]
+    //--cpu-ibl bakes the D3D12 backend's environment maps with IblBaker instead of the compute shaders
+    //--packed-vertices draws the D3D12 backend's model from 20-byte packed vertices instead of the full 56-byte ones
+    //--null runs the frame logic and pass recording headless on NullRenderer, 600 frames unless --frames says otherwise
+    //--software draws the scene on the CPU, one frame unless --frames says otherwise, and writes the last one to --capture
+    int FramesInFlight = 2;
+    int MaxFrames = 0;
+    RendererBackend Backend = RendererBackend::D3D12;
+    std::string CapturePath;
+    bool bBakeIblOnCpu = false;
+    bool bPackedVertices = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--frames-in-flight" && i + 1 < argc)
+        {
+            FramesInFlight = std::atoi(argv[i + 1]);
+        }
+        else if (std::string(argv[i]) == "--frames" && i + 1 < argc)
+        {
+            MaxFrames = std::atoi(argv[i + 1]);
+        }
+        else if (std::string(argv[i]) == "--null")
+        {
+            Backend = RendererBackend::Null;
+        }
+        else if (std::string(argv[i]) == "--software")
+        {
+            Backend = RendererBackend::Software;
+        }
+        else if (std::string(argv[i]) == "--capture" && i + 1 < argc)
+        {
+            CapturePath = argv[i + 1];
+        }
+        else if (std::string(argv[i]) == "--cpu-ibl")
+        {
+            bBakeIblOnCpu = true;
+        }
+        else if (std::string(argv[i]) == "--packed-vertices")
+        {
+            bPackedVertices = true;
+        }
+    }
+    if (MaxFrames <= 0)
+    {
+        MaxFrames = Backend == RendererBackend::Null ? 600 : (Backend == RendererBackend::Software ? 1 : 0);
+    }
+    //A single frame in flight serializes CPU and GPU, it only exists as the baseline of --bench-pacing
+    if (FramesInFlight < 2 || FramesInFlight > int(FramePacer::MaxFramesInFlight))
+    {
+        std::cout << "--frames-in-flight has to be between 2 and " << FramePacer::MaxFramesInFlight << "\n";
+        return 1;
+    }
+
+    Application app{ FramesInFlight, Backend, MaxFrames, CapturePath, bBakeIblOnCpu, bPackedVertices };
     
     try
     {
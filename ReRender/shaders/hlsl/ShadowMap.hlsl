@@ -1,3 +1,5 @@
+#include "packed_vertex.hlsli"
+
 cbuffer ShadowCB : register(b0)
 {
 	float4x4 viewProjectionMatrix;
@@ -25,6 +27,14 @@ PixelShaderInput main_vs(VertexShaderInput In)
     return Vout;
 }
 
+// Only the position of a VertexFormat::Packed mesh
+PixelShaderInput main_vs_packed(float4 position : POSITION)
+{
+    VertexShaderInput vin;
+    vin.position = decodePackedPosition(position);
+    return main_vs(vin);
+}
+
 void main_ps(PixelShaderInput Pin)
 {
 
@@ -0,0 +1,43 @@
+// Decoder for the 20-byte PackedVertex layout (see VertexPacking.h / MeshBuffer::PackedInputLayout).
+// Mirrors VertexPacking::Decode on the CPU.
+
+// AABB center and half extent of the mesh, root constants set per mesh (see PackedPositionConstants in MeshBuffer.h).
+// The PBR and shadow root signatures both put them at b2.
+cbuffer PackedPositionConstants : register(b2)
+{
+	float3 positionOffset;
+	float3 positionScale;
+};
+
+struct PackedVertexShaderInput
+{
+	float4 position : POSITION; // snorm16 xyz relative to the mesh AABB, w = bitangent sign (-1 or +1)
+	float2 normal   : NORMAL;   // octahedral snorm16
+	float2 tangent  : TANGENT;  // octahedral snorm16
+	float2 texcoord : TEXCOORD; // float16
+};
+
+float3 octDecode(float2 e)
+{
+	float3 n = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0) {
+		n.xy = (1.0 - abs(e.yx)) * (e.xy >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+float3 decodePackedPosition(float4 position)
+{
+	return positionOffset + position.xyz * positionScale;
+}
+
+// Expands a packed vertex into the same attributes the full 56-byte layout provides.
+void decodePackedVertex(PackedVertexShaderInput vin,
+	out float3 position, out float3 normal, out float3 tangent, out float3 bitangent, out float2 texcoord)
+{
+	position  = decodePackedPosition(vin.position);
+	normal    = octDecode(vin.normal);
+	tangent   = octDecode(vin.tangent);
+	bitangent = cross(normal, tangent) * (vin.position.w < 0.0 ? -1.0 : 1.0);
+	texcoord  = vin.texcoord;
+}
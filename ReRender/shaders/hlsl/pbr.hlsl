@@ -8,6 +8,8 @@ static const float Epsilon = 0.00001;
 
 static const uint NumLights = 3;
 
+#include "packed_vertex.hlsli"
+
 // Constant normal incidence Fresnel factor for all dielectrics.
 static const float3 Fdielectric = 0.04;
 
@@ -27,6 +29,10 @@ cbuffer ShadingConstants : register(b0)
 		float3 radiance;
 	} lights[NumLights];
 	float3 eyePosition;
+	float4 renderTargetSizeNearFar;
+	float4x4 shadowTransform;
+	// Diffuse irradiance as L2 spherical harmonics, see SphericalHarmonics.h.
+	float4 irradianceCoefficients[9];
 };
 
 struct VertexShaderInput
@@ -45,13 +51,20 @@ struct PixelShaderInput
 	float3x3 tangentBasis : TBASIS;
 };
 
-Texture2D albedoTexture : register(t0);
-Texture2D normalTexture : register(t1);
-Texture2D metalnessTexture : register(t2);
-Texture2D roughnessTexture : register(t3);
-TextureCube specularTexture : register(t4);
-TextureCube irradianceTexture : register(t5);
-Texture2D specularBRDF_LUT : register(t6);
+// Indices into the bindless table, set as root constants per draw.
+cbuffer MaterialIndices : register(b1)
+{
+	uint albedoIndex;
+	uint normalIndex;
+	uint metalnessIndex;
+	uint roughnessIndex;
+	uint specularIndex;
+	uint specularBRDFIndex;
+};
+
+// The bindless table: the 2D textures, then the cubes. Each index counts from the start of its own range.
+Texture2D bindlessTextures[] : register(t0, space1);
+TextureCube bindlessCubes[] : register(t0, space2);
 
 SamplerState defaultSampler : register(s0);
 SamplerState spBRDF_Sampler : register(s1);
@@ -67,6 +80,20 @@ float ndfGGX(float cosLh, float roughness)
 	return alphaSq / (PI * denom * denom);
 }
 
+// Diffuse irradiance at normal N, the cosine convolution and basis constants are folded into the coefficients.
+float3 irradianceSH(float3 N)
+{
+	return irradianceCoefficients[0].rgb
+		+ irradianceCoefficients[1].rgb * N.y
+		+ irradianceCoefficients[2].rgb * N.z
+		+ irradianceCoefficients[3].rgb * N.x
+		+ irradianceCoefficients[4].rgb * (N.x * N.y)
+		+ irradianceCoefficients[5].rgb * (N.y * N.z)
+		+ irradianceCoefficients[6].rgb * (3.0 * N.z * N.z - 1.0)
+		+ irradianceCoefficients[7].rgb * (N.x * N.z)
+		+ irradianceCoefficients[8].rgb * (N.x * N.x - N.y * N.y);
+}
+
 // Single term for separable Schlick-GGX below.
 float gaSchlickG1(float cosTheta, float k)
 {
@@ -91,7 +118,7 @@ float3 fresnelSchlick(float3 F0, float cosTheta)
 uint querySpecularTextureLevels()
 {
 	uint width, height, levels;
-	specularTexture.GetDimensions(0, width, height, levels);
+	bindlessCubes[specularIndex].GetDimensions(0, width, height, levels);
 	return levels;
 }
 
@@ -113,19 +140,27 @@ PixelShaderInput main_vs(VertexShaderInput vin)
 	return vout;
 }
 
+// Vertex shader for meshes uploaded as VertexFormat::Packed
+PixelShaderInput main_vs_packed(PackedVertexShaderInput packed)
+{
+	VertexShaderInput vin;
+	decodePackedVertex(packed, vin.position, vin.normal, vin.tangent, vin.bitangent, vin.texcoord);
+	return main_vs(vin);
+}
+
 // Pixel shader
 float4 main_ps(PixelShaderInput pin) : SV_Target
 {
 	// Sample input textures to get shading model params.
-	float3 albedo = albedoTexture.Sample(defaultSampler, pin.texcoord).rgb;
-	float metalness = metalnessTexture.Sample(defaultSampler, pin.texcoord).r;
-	float roughness = roughnessTexture.Sample(defaultSampler, pin.texcoord).r;
+	float3 albedo = bindlessTextures[albedoIndex].Sample(defaultSampler, pin.texcoord).rgb;
+	float metalness = bindlessTextures[metalnessIndex].Sample(defaultSampler, pin.texcoord).r;
+	float roughness = bindlessTextures[roughnessIndex].Sample(defaultSampler, pin.texcoord).r;
 
 	// Outgoing light direction (vector from world-space fragment position to the "eye").
 	float3 Lo = normalize(eyePosition - pin.position);
 
 	// Get current fragment's normal and transform to world space.
-	float3 N = normalize(2.0 * normalTexture.Sample(defaultSampler, pin.texcoord).rgb - 1.0);
+	float3 N = normalize(2.0 * bindlessTextures[normalIndex].Sample(defaultSampler, pin.texcoord).rgb - 1.0);
 	N = normalize(mul(pin.tangentBasis, N));
 	
 	// Angle between surface normal and outgoing light direction.
@@ -178,8 +213,8 @@ float4 main_ps(PixelShaderInput pin) : SV_Target
 	// Ambient lighting (IBL).
 	float3 ambientLighting;
 	{
-		// Sample diffuse irradiance at normal direction.
-		float3 irradiance = irradianceTexture.Sample(defaultSampler, N).rgb;
+		// Evaluate diffuse irradiance at normal direction.
+		float3 irradiance = irradianceSH(N);
 
 		// Calculate Fresnel term for ambient lighting.
 		// Since we use pre-filtered cubemap(s) and irradiance is coming from many directions
@@ -190,15 +225,15 @@ float4 main_ps(PixelShaderInput pin) : SV_Target
 		// Get diffuse contribution factor (as with direct lighting).
 		float3 kd = lerp(1.0 - F, 0.0, metalness);
 
-		// Irradiance map contains exitant radiance assuming Lambertian BRDF, no need to scale by 1/PI here either.
+		// Irradiance SH contains exitant radiance assuming Lambertian BRDF, no need to scale by 1/PI here either.
 		float3 diffuseIBL = kd * albedo * irradiance;
 
 		// Sample pre-filtered specular reflection environment at correct mipmap level.
 		uint specularTextureLevels = querySpecularTextureLevels();
-		float3 specularIrradiance = specularTexture.SampleLevel(defaultSampler, Lr, roughness * specularTextureLevels).rgb;
+		float3 specularIrradiance = bindlessCubes[specularIndex].SampleLevel(defaultSampler, Lr, roughness * specularTextureLevels).rgb;
 
 		// Split-sum approximation factors for Cook-Torrance specular BRDF.
-		float2 specularBRDF = specularBRDF_LUT.Sample(spBRDF_Sampler, float2(cosLo, roughness)).rg;
+		float2 specularBRDF = bindlessTextures[specularBRDFIndex].Sample(spBRDF_Sampler, float2(cosLo, roughness)).rg;
 
 		// Total specular IBL contribution.
 		float3 specularIBL = (F0 * specularBRDF.x + specularBRDF.y) * specularIrradiance;